@@ -56,7 +56,14 @@ void pcap_close(pcap_t *p);
 char *pcap_geterr(pcap_t *p);
 int pcap_datalink(pcap_t *p);
 
+#define DLT_NULL 0
 #define DLT_EN10MB 1
+#define DLT_RAW 12
+#define DLT_LOOP 108
+#define DLT_LINUX_SLL 113
+#define DLT_IPV4 228
+#define DLT_IPV6 229
+#define DLT_LINUX_SLL2 276
 
 #ifdef __cplusplus
 }
@@ -51,7 +51,7 @@ int main(int argc, char** argv) {
     // But we can configure it further.
 
     // 3. Setup Session 0
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // Register Callbacks
     KTermNetCallbacks callbacks = {
@@ -103,7 +103,7 @@ void process_shell(KTerm* term, int session_idx, const char* data, size_t len) {
             if (sh->cmd_len > 0) {
                 if (strcmp(sh->cmd_buf, "exit") == 0) {
                     KTerm_WriteString(term, "Goodbye.\r\n");
-                    KTerm_Net_Disconnect(term, &term->sessions[session_idx]);
+                    KTerm_Net_Disconnect(term, KTerm_GetSession(term, session_idx));
                 } else if (strcmp(sh->cmd_buf, "help") == 0) {
                     KTerm_WriteString(term, "Commands: help, status, resize <w> <h>, clear, exit\r\n");
                 } else if (strcmp(sh->cmd_buf, "status") == 0) {
@@ -142,13 +142,13 @@ void process_shell(KTerm* term, int session_idx, const char* data, size_t len) {
 }
 
 bool my_on_data(KTerm* term, KTermSession* session, const char* data, size_t len) {
-    int idx = (int)(session - term->sessions);
+    int idx = session->index;
     process_shell(term, idx, data, len);
     return true;
 }
 
 void my_on_connect(KTerm* term, KTermSession* session) {
-    int idx = (int)(session - term->sessions);
+    int idx = session->index;
     printf("[Server] Client Connected on Session %d\n", idx);
     shells[idx].cmd_len = 0;
     shells[idx].last_was_cr = false;
@@ -178,9 +178,9 @@ int main() {
     cb.on_data = my_on_data;
     cb.on_connect = my_on_connect;
 
-    KTerm_Net_SetCallbacks(term, &term->sessions[0], cb);
-    KTerm_Net_SetProtocol(term, &term->sessions[0], KTERM_NET_PROTO_TELNET);
-    KTerm_Net_Listen(term, &term->sessions[0], 8023);
+    KTerm_Net_SetCallbacks(term, term->sessions[0], cb);
+    KTerm_Net_SetProtocol(term, term->sessions[0], KTERM_NET_PROTO_TELNET);
+    KTerm_Net_Listen(term, term->sessions[0], 8023);
 
     // Main Loop
     while(server_running) {
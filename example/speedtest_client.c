@@ -122,10 +122,8 @@ static double GetTime() {
 }
 
 static int GetSessionIndex(KTerm* term, KTermSession* session) {
-    for (int i=0; i<MAX_SESSIONS; i++) {
-        if (&term->sessions[i] == session) return i;
-    }
-    return -1;
+    (void)term;
+    return session ? session->index : -1;
 }
 
 // --- Config Fetch Callbacks ---
@@ -436,8 +434,8 @@ int main(int argc, char** argv) {
                 cfg_cb.on_data = cb_config_on_data;
                 cfg_cb.on_disconnect = cb_config_on_disconnect;
 
-                KTerm_Net_SetCallbacks(term, &term->sessions[0], cfg_cb);
-                KTerm_Net_Connect(term, &term->sessions[0], CONFIG_HOST, 80, "", "");
+                KTerm_Net_SetCallbacks(term, term->sessions[0], cfg_cb);
+                KTerm_Net_Connect(term, term->sessions[0], CONFIG_HOST, 80, "", "");
 
                 ctx.config_len = 0;
                 ctx.state = STATE_FETCH_CONFIG_CONNECTING;
@@ -447,7 +445,7 @@ int main(int argc, char** argv) {
                 // Wait for connect callback
                 if (frames > 500 && ctx.state == STATE_FETCH_CONFIG_CONNECTING) { // 5s timeout approx
                      snprintf(ctx.status_msg, sizeof(ctx.status_msg), "Config Timeout. Using Default.");
-                     KTerm_Net_Disconnect(term, &term->sessions[0]);
+                     KTerm_Net_Disconnect(term, term->sessions[0]);
                      ctx.state = STATE_IDLE;
                 }
                 break;
@@ -456,7 +454,7 @@ int main(int argc, char** argv) {
                 {
                     char req[256];
                     snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", CONFIG_PATH, CONFIG_HOST);
-                    int sock = (int)KTerm_Net_GetSocket(term, &term->sessions[0]);
+                    int sock = (int)KTerm_Net_GetSocket(term, term->sessions[0]);
                     if (sock >= 0) {
                         send(sock, req, strlen(req), 0);
                         ctx.state = STATE_FETCH_CONFIG_READING;
@@ -469,7 +467,7 @@ int main(int argc, char** argv) {
             case STATE_FETCH_CONFIG_READING:
                  if (frames > 2000) {
                      snprintf(ctx.status_msg, sizeof(ctx.status_msg), "Config Fetch Timeout. Using Default.");
-                     KTerm_Net_Disconnect(term, &term->sessions[0]);
+                     KTerm_Net_Disconnect(term, term->sessions[0]);
                      ctx.state = STATE_IDLE;
                  }
                  break;
@@ -501,7 +499,7 @@ int main(int argc, char** argv) {
                      } else {
                          snprintf(ctx.status_msg, sizeof(ctx.status_msg), "Config Parse Failed. Using Default.");
                      }
-                     KTerm_Net_Disconnect(term, &term->sessions[0]);
+                     KTerm_Net_Disconnect(term, term->sessions[0]);
                      ctx.state = STATE_IDLE;
                  }
                  break;
@@ -542,7 +540,7 @@ int main(int argc, char** argv) {
                     } else {
                         // Start Next Probe
                         ctx.latency_probe_active = true;
-                        if (!KTerm_Net_ResponseTime(term, &term->sessions[0], ctx.host, 1, 0, 2000, cb_latency_result, NULL)) {
+                        if (!KTerm_Net_ResponseTime(term, term->sessions[0], ctx.host, 1, 0, 2000, cb_latency_result, NULL)) {
                              // Fail
                              ctx.latency_probe_active = false;
                              ctx.latency_samples[ctx.latency_sample_count++] = 0; // Error
@@ -566,8 +564,8 @@ int main(int argc, char** argv) {
                 dl_cb.on_data = cb_dl_on_data;
 
                 for(int i=0; i<NUM_STREAMS; i++) {
-                    KTerm_Net_SetCallbacks(term, &term->sessions[i], dl_cb);
-                    KTerm_Net_Connect(term, &term->sessions[i], ctx.host, ctx.port, "", "");
+                    KTerm_Net_SetCallbacks(term, KTerm_AcquireSession(term, i), dl_cb);
+                    KTerm_Net_Connect(term, KTerm_AcquireSession(term, i), ctx.host, ctx.port, "", "");
                 }
 
                 ctx.dl_progress = 0.0;
@@ -605,7 +603,7 @@ int main(int argc, char** argv) {
 
                     if (elapsed >= TEST_DURATION_SEC) {
                         ctx.state = STATE_DOWNLOAD_DONE;
-                        for(int i=0; i<NUM_STREAMS; i++) KTerm_Net_Disconnect(term, &term->sessions[i]);
+                        for(int i=0; i<NUM_STREAMS; i++) KTerm_Net_Disconnect(term, KTerm_GetSession(term, i));
                     } else {
                         ctx.dl_progress = elapsed / TEST_DURATION_SEC;
                     }
@@ -628,8 +626,8 @@ int main(int argc, char** argv) {
                 ul_cb.on_data = cb_ul_on_data;
 
                 for(int i=0; i<NUM_STREAMS; i++) {
-                    KTerm_Net_SetCallbacks(term, &term->sessions[i], ul_cb);
-                    KTerm_Net_Connect(term, &term->sessions[i], ctx.host, ctx.port, "", "");
+                    KTerm_Net_SetCallbacks(term, KTerm_AcquireSession(term, i), ul_cb);
+                    KTerm_Net_Connect(term, KTerm_AcquireSession(term, i), ctx.host, ctx.port, "", "");
                 }
 
                 ctx.ul_progress = 0.0;
@@ -659,7 +657,7 @@ int main(int argc, char** argv) {
                     for(int i=0; i<NUM_STREAMS; i++) {
                         if (!ctx.ul_streams[i].connected) continue;
 
-                        int sock = (int)KTerm_Net_GetSocket(term, &term->sessions[i]);
+                        int sock = (int)KTerm_Net_GetSocket(term, KTerm_GetSession(term, i));
                         if (sock >= 0) {
                             char chunk[16384];
                             memset(chunk, 'X', sizeof(chunk));
@@ -690,7 +688,7 @@ int main(int argc, char** argv) {
 
                     if (elapsed >= TEST_DURATION_SEC) {
                         ctx.state = STATE_UPLOAD_DONE;
-                        for(int i=0; i<NUM_STREAMS; i++) KTerm_Net_Disconnect(term, &term->sessions[i]);
+                        for(int i=0; i<NUM_STREAMS; i++) KTerm_Net_Disconnect(term, KTerm_GetSession(term, i));
                     } else {
                         ctx.ul_progress = elapsed / TEST_DURATION_SEC;
                     }
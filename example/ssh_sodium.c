@@ -517,7 +517,7 @@ int main(int argc, char** argv) {
     KTermConfig config = {0};
     KTerm* term = KTerm_Create(config);
     KTerm_Net_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // 3. SSH Security Init
     global_ssh_ctx.state = SSH_STATE_INIT;
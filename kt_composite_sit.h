@@ -128,6 +128,7 @@ typedef struct {
     GPUCell* cells;
     size_t cell_count;
     size_t cell_capacity;
+    int damage_top, damage_bottom; // Grid rows written by the last Prepare (top > bottom: none)
 
     KTermPushConstants constants;
 
@@ -162,6 +163,9 @@ typedef struct {
     int rb_front;
     int rb_back;
     kterm_mutex_t render_lock;
+
+    // Grid rows the GPU terminal buffer has not received yet; Render uploads only these
+    int upload_top, upload_bottom;
 } KTermCompositor;
 
 // API
@@ -183,6 +187,8 @@ bool KTermCompositor_Init(KTermCompositor* comp, int width, int height) {
     comp->rb_front = 0;
     comp->rb_back = 1;
     KTERM_MUTEX_INIT(comp->render_lock);
+    comp->upload_top = 0;
+    comp->upload_bottom = height - 1;
 
     for (int i = 0; i < 2; i++) {
         // Cells
@@ -191,6 +197,8 @@ bool KTermCompositor_Init(KTermCompositor* comp, int width, int height) {
         comp->render_buffers[i].cell_capacity = cell_count;
         comp->render_buffers[i].cells = (GPUCell*)KTerm_Calloc(cell_count, sizeof(GPUCell));
         if (!comp->render_buffers[i].cells) return false;
+        comp->render_buffers[i].damage_top = 0;
+        comp->render_buffers[i].damage_bottom = -1;
 
         // Vectors
         comp->render_buffers[i].vector_capacity = 1024;
@@ -250,11 +258,29 @@ void KTermCompositor_Resize(KTermCompositor* comp, int width, int height) {
         if (comp->render_buffers[i].cells) {
             memset(comp->render_buffers[i].cells, 0, new_cell_count * sizeof(GPUCell));
         }
+        comp->render_buffers[i].damage_top = 0;
+        comp->render_buffers[i].damage_bottom = -1;
     }
 
+    // The GPU buffer is recreated at the new size, so all of it is uploaded again
+    comp->upload_top = 0;
+    comp->upload_bottom = height - 1;
+
     KTERM_MUTEX_UNLOCK(comp->render_lock);
 }
 
+// Extends a [top, bottom] row span (empty while top > bottom) to cover rows y0..y1
+static void KTerm_AddRowDamage(int* top, int* bottom, int y0, int y1) {
+    if (y0 > y1) return;
+    if (*top > *bottom) {
+        *top = y0;
+        *bottom = y1;
+        return;
+    }
+    if (y0 < *top) *top = y0;
+    if (y1 > *bottom) *bottom = y1;
+}
+
 // JIT Run Builder
 static KTermTextRun KTerm_BuildRun(EnhancedTermChar* row, int start_idx, int max_idx) {
     KTermTextRun run = {0};
@@ -327,9 +353,10 @@ static void KTerm_UpdatePaneRow(KTerm* term, KTermSession* source_session, KTerm
 
                         gpu_cell->char_code = (v == 0) ? char_code : 0;
 
+                        // Cells can come straight from a mapped snapshot file: keep indices inside the palette
                         KTermColor fg = {255, 255, 255, 255};
                         if (cell->fg_color.color_mode == 0) {
-                             RGB_KTermColor c = term->color_palette[cell->fg_color.value.index];
+                             RGB_KTermColor c = term->color_palette[cell->fg_color.value.index & 0xFF];
                              fg = (KTermColor){c.r, c.g, c.b, 255};
                         } else {
                             fg = (KTermColor){cell->fg_color.value.rgb.r, cell->fg_color.value.rgb.g, cell->fg_color.value.rgb.b, 255};
@@ -338,7 +365,7 @@ static void KTerm_UpdatePaneRow(KTerm* term, KTermSession* source_session, KTerm
 
                         KTermColor bg = {0, 0, 0, 255};
                         if (cell->bg_color.color_mode == 0) {
-                             RGB_KTermColor c = term->color_palette[cell->bg_color.value.index];
+                             RGB_KTermColor c = term->color_palette[cell->bg_color.value.index & 0xFF];
                              bg = (KTermColor){c.r, c.g, c.b, 255};
                              if (cell->bg_color.value.index == 0) bg.a = 0;
                         } else {
@@ -349,7 +376,7 @@ static void KTerm_UpdatePaneRow(KTerm* term, KTermSession* source_session, KTerm
                         KTermColor ul = fg;
                         if (cell->ul_color.color_mode != 2) {
                              if (cell->ul_color.color_mode == 0) {
-                                 RGB_KTermColor c = term->color_palette[cell->ul_color.value.index];
+                                 RGB_KTermColor c = term->color_palette[cell->ul_color.value.index & 0xFF];
                                  ul = (KTermColor){c.r, c.g, c.b, 255};
                              } else {
                                  ul = (KTermColor){cell->ul_color.value.rgb.r, cell->ul_color.value.rgb.g, cell->ul_color.value.rgb.b, 255};
@@ -360,7 +387,7 @@ static void KTerm_UpdatePaneRow(KTerm* term, KTermSession* source_session, KTerm
                         KTermColor st = fg;
                         if (cell->st_color.color_mode != 2) {
                              if (cell->st_color.color_mode == 0) {
-                                 RGB_KTermColor c = term->color_palette[cell->st_color.value.index];
+                                 RGB_KTermColor c = term->color_palette[cell->st_color.value.index & 0xFF];
                                  st = (KTermColor){c.r, c.g, c.b, 255};
                              } else {
                                  st = (KTermColor){cell->st_color.value.rgb.r, cell->st_color.value.rgb.g, cell->st_color.value.rgb.b, 255};
@@ -384,11 +411,34 @@ static void KTerm_UpdatePaneRow(KTerm* term, KTermSession* source_session, KTerm
         current_visual_x += run.visual_width;
     }
 
+    if (global_y >= 0 && global_y < term->height) {
+        KTerm_AddRowDamage(&rb->damage_top, &rb->damage_bottom, global_y, global_y);
+    }
+
     if (source_session->row_dirty[source_y] > 0) {
         source_session->row_dirty[source_y]--;
     }
 }
 
+// Blanks a pane's rectangle after its geometry changed, so that cells its session does not
+// cover (a narrower grid, or a resize still queued) keep nothing of the previous occupant
+static void KTerm_ClearPaneRect(KTerm* term, KTermRenderBuffer* rb, KTermPane* pane) {
+    int x0 = pane->x < 0 ? 0 : pane->x;
+    int x1 = pane->x + pane->width;
+    int y0 = pane->y < 0 ? 0 : pane->y;
+    int y1 = pane->y + pane->height;
+    if (x1 > term->width) x1 = term->width;
+    if (y1 > term->height) y1 = term->height;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    for (int y = y0; y < y1; y++) {
+        size_t offset = (size_t)y * term->width + x0;
+        if (offset + (x1 - x0) > rb->cell_capacity) break;
+        memset(&rb->cells[offset], 0, (x1 - x0) * sizeof(GPUCell));
+    }
+    KTerm_AddRowDamage(&rb->damage_top, &rb->damage_bottom, y0, y1 - 1);
+}
+
 static void KTerm_UpdateAtlasWithSoftFont(KTerm* term) {
     if (!term->font_atlas_pixels) return;
 
@@ -464,35 +514,46 @@ static bool KTerm_RecursiveUpdateSSBO(KTerm* term, KTermPane* pane, KTermRenderB
     bool any_update = false;
 
     if (pane->type == PANE_LEAF) {
-        if (pane->session_index >= 0 && pane->session_index < MAX_SESSIONS) {
-            KTermSession* session = &term->sessions[pane->session_index];
-            if (session->session_open) {
-                if (session->synchronized_update) return false;
-
-                for (int y = 0; y < pane->height; y++) {
-                    if (y < session->rows && session->row_dirty[y]) {
-                        int sx = 0;
-                        int sw = pane->width;
-
-                        if (session->dirty_rect.w > 0) {
-                            int dr_x = session->dirty_rect.x;
-                            int dr_w = session->dirty_rect.w;
-                            int dr_end = dr_x + dr_w;
-
-                            int start_x = 0;
-                            int end_x = pane->width;
-
-                            if (start_x < dr_x) start_x = dr_x;
-                            if (end_x > dr_end) end_x = dr_end;
-
-                            if (start_x < end_x) {
-                                sx = start_x;
-                                sw = end_x - start_x;
-                            }
+        // Panes tile the grid without overlapping, so a pane's rectangle is its own region of
+        // the cell buffer: nothing else draws there and a pane with no damage is skipped.
+        KTermSession* session = KTerm_GetSession(term, pane->session_index);
+        bool live = session && session->session_open;
+
+        // A synchronized update holds the pane's last frame, geometry changes included
+        if (live && session->synchronized_update) return false;
+
+        // Only panes that KTermLayout_Recalculate moved or resized are re-encoded whole
+        bool relayout = pane->geometry_dirty > 0;
+        if (relayout) {
+            KTerm_ClearPaneRect(term, rb, pane);
+            pane->geometry_dirty--;
+            any_update = true;
+        }
+
+        if (live) {
+            for (int y = 0; y < pane->height; y++) {
+                if (y < session->rows && (relayout || session->row_dirty[y])) {
+                    int sx = 0;
+                    int sw = pane->width;
+
+                    if (!relayout && session->dirty_rect.w > 0) {
+                        int dr_x = session->dirty_rect.x;
+                        int dr_w = session->dirty_rect.w;
+                        int dr_end = dr_x + dr_w;
+
+                        int start_x = 0;
+                        int end_x = pane->width;
+
+                        if (start_x < dr_x) start_x = dr_x;
+                        if (end_x > dr_end) end_x = dr_end;
+
+                        if (start_x < end_x) {
+                            sx = start_x;
+                            sw = end_x - start_x;
                         }
-                        KTerm_UpdatePaneRow(term, session, rb, pane->x + sx, pane->y + y, sw, y, sx);
-                        any_update = true;
                     }
+                    KTerm_UpdatePaneRow(term, session, rb, pane->x + sx, pane->y + y, sw, y, sx);
+                    any_update = true;
                 }
             }
         }
@@ -692,7 +753,7 @@ void KTermCompositor_Prepare(KTermCompositor* comp, KTerm* term) {
     uint32_t cursor_idx = 0xFFFFFFFF;
     KTermSession* focused_session = NULL;
     if (term->layout && term->layout->focused && term->layout->focused->type == PANE_LEAF) {
-        if (term->layout->focused->session_index >= 0) focused_session = &term->sessions[term->layout->focused->session_index];
+        focused_session = KTerm_GetSession(term, term->layout->focused->session_index);
     }
     if (!focused_session) focused_session = GET_SESSION(term);
 
@@ -754,8 +815,8 @@ void KTermCompositor_Prepare(KTermCompositor* comp, KTerm* term) {
         // Voice Energy
         float max_energy = 0.0f;
 #ifndef KTERM_DISABLE_VOICE
-        for (int i = 0; i < MAX_SESSIONS; i++) {
-            KTermVoiceContext* vctx = KTerm_Voice_GetContext(&term->sessions[i]);
+        for (int n = 0; n < term->live_session_count; n++) {
+            KTermVoiceContext* vctx = KTerm_Voice_GetContext(term->sessions[term->live_sessions[n]]);
             if (vctx && vctx->enabled) {
                 if (vctx->energy_level > max_energy) max_energy = vctx->energy_level;
             }
@@ -791,8 +852,9 @@ void KTermCompositor_Prepare(KTermCompositor* comp, KTerm* term) {
 
     // Copy Kitty Graphics Ops
     rb->kitty_count = 0;
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTermSession* session = &term->sessions[i];
+    for (int n = 0; n < term->live_session_count; n++) {
+        int i = term->live_sessions[n];
+        KTermSession* session = term->sessions[i];
         if (!session->session_open || !session->kitty.images) continue;
 
         KTermPane* pane = NULL;
@@ -854,6 +916,11 @@ void KTermCompositor_Prepare(KTermCompositor* comp, KTerm* term) {
         }
     }
 
+    // The rows just written are what the next upload owes the GPU buffer
+    KTerm_AddRowDamage(&comp->upload_top, &comp->upload_bottom, rb->damage_top, rb->damage_bottom);
+    rb->damage_top = 0;
+    rb->damage_bottom = -1;
+
     // Swap Buffers
     int temp = comp->rb_front;
     comp->rb_front = comp->rb_back;
@@ -946,9 +1013,20 @@ void KTermCompositor_Render(KTermCompositor* comp, KTerm* term) {
         }
 
         // 4. Terminal Text
-        size_t required_size = rb->cell_count * sizeof(GPUCell);
-        fprintf(stderr, "[KTerm] Rendering terminal: %zu cells\n", rb->cell_count); fflush(stderr);
-        KTerm_UpdateBuffer(term->terminal_buffer, 0, required_size, rb->cells);
+        // Only the rows damaged since the last upload are sent. Every row written to the
+        // back buffer is also in this front buffer by now (rows stay dirty for
+        // KTERM_DIRTY_FRAMES prepares), so the front copy of the span is current.
+        if (comp->upload_top <= comp->upload_bottom && term->width > 0) {
+            size_t row_cells = (size_t)term->width;
+            size_t first = (size_t)comp->upload_top * row_cells;
+            size_t end = (size_t)(comp->upload_bottom + 1) * row_cells;
+            if (end > rb->cell_count) end = rb->cell_count;
+            if (first < end) {
+                KTerm_UpdateBuffer(term->terminal_buffer, first * sizeof(GPUCell), (end - first) * sizeof(GPUCell), rb->cells + first);
+            }
+            comp->upload_top = 0;
+            comp->upload_bottom = -1;
+        }
         
         // Debug: Check terminal buffer content (first frame only)
         static bool buffer_checked = false;
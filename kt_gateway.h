@@ -32,6 +32,11 @@ extern "C" {
 // This function replaces the internal handling in the main parser.
 void KTerm_GatewayProcess(KTerm* term, KTermSession* session, const char* class_id, const char* id, const char* command, const char* params);
 
+// Streaming entry point for "DCS GATE KTERM;<ID>;PIPE;VT;<B64|HEX|RAW>;<Payload> ST".
+// The parser offers each DCS header ending in ';'; a PIPE header takes over the payload,
+// which is decoded into the target session as it arrives instead of being buffered.
+bool KTerm_Gateway_OpenStringSink(KTerm* term, KTermSession* session, const char* header, size_t len);
+
 // Registers built-in extensions (called by KTerm_Init)
 void KTerm_RegisterBuiltinExtensions(KTerm* term);
 
@@ -206,13 +211,7 @@ static bool KTerm_Gateway_DecodePipePayload(KTerm* term, KTermSession* session,
 
     const char* payload = payload_start + 1;
 
-    int session_idx = -1;
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (&term->sessions[i] == session) {
-            session_idx = i;
-            break;
-        }
-    }
+    int session_idx = session ? session->index : -1;
 
     if (session_idx != -1) {
         if (KTerm_Strcasecmp(encoding, "B64") == 0) {
@@ -676,17 +675,94 @@ typedef struct {
 
 // Helpers
 static KTermSession* KTerm_GetTargetSession(KTerm* term, KTermSession* session) {
-    if (term->gateway_target_session >= 0 && term->gateway_target_session < MAX_SESSIONS) {
-        return &term->sessions[term->gateway_target_session];
-    }
-    return session;
+    KTermSession* target = KTerm_GetSession(term, term->gateway_target_session);
+    return target ? target : session;
 }
 
 static int KTerm_GetSessionIndex(KTerm* term, KTermSession* session) {
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (&term->sessions[i] == session) return i;
+    (void)term;
+    return session ? session->index : -1;
+}
+
+// PIPE streaming (see KTerm_Gateway_OpenStringSink)
+enum { KTERM_PIPE_SINK_B64 = 0, KTERM_PIPE_SINK_HEX, KTERM_PIPE_SINK_RAW };
+
+static void KTerm_Gateway_PipeSinkWrite(KTerm* term, KTermSession* session, KTermStringSink* sink, const char* data, size_t len) {
+    (void)session;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)data[i];
+        if (sink->mode == KTERM_PIPE_SINK_RAW) {
+            KTerm_WriteCharToSession(term, sink->target, ch);
+        } else if (sink->mode == KTERM_PIPE_SINK_HEX) {
+            // Pairs are taken by position; a pair with a non-hex digit is skipped
+            if (!sink->bit_count) {
+                sink->bits = ch;
+                sink->bit_count = 1;
+                continue;
+            }
+            int h1 = KTerm_HexValue((char)sink->bits);
+            int h2 = KTerm_HexValue((char)ch);
+            sink->bit_count = 0;
+            if (h1 != -1 && h2 != -1) KTerm_WriteCharToSession(term, sink->target, (unsigned char)((h1 << 4) | h2));
+        } else {
+            if (sink->bit_count < 0) return; // Padding seen
+            if (ch == '=') { sink->bit_count = -1; return; }
+            int c = kterm_base64_table[ch];
+            if (c == -1) continue;
+            sink->bits = (sink->bits << 6) + (uint32_t)c;
+            sink->bit_count += 6;
+            if (sink->bit_count >= 8) {
+                sink->bit_count -= 8;
+                KTerm_WriteCharToSession(term, sink->target, (unsigned char)((sink->bits >> sink->bit_count) & 0xFF));
+            }
+        }
     }
-    return -1;
+}
+
+bool KTerm_Gateway_OpenStringSink(KTerm* term, KTermSession* session, const char* header, size_t len) {
+    if (!term || !session || len < 5 || strncmp(header, "GATE", 4) != 0 || header[len - 1] != ';') return false;
+    size_t pos = 4;
+    if (header[pos] == ';') pos++;
+
+    // Fields: Class ; ID ; Command ; VT ; Encoding ;
+    const char* field[5];
+    size_t field_len[5];
+    int count = 0;
+    size_t start = pos;
+    for (size_t i = pos; i < len; i++) {
+        if (header[i] != ';') continue;
+        if (count == 5) return false;
+        field[count] = header + start;
+        field_len[count] = i - start;
+        count++;
+        start = i + 1;
+    }
+    if (count != 5) return false;
+    if (field_len[0] != 5 || strncmp(field[0], "KTERM", 5) != 0) return false;
+    if (field_len[2] != 4 || KTerm_Strncasecmp(field[2], "PIPE", 4) != 0) return false;
+    if (field_len[3] != 2 || strncmp(field[3], "VT", 2) != 0) return false;
+    if (field_len[4] != 3) return false;
+
+    int mode;
+    if (KTerm_Strncasecmp(field[4], "B64", 3) == 0) mode = KTERM_PIPE_SINK_B64;
+    else if (KTerm_Strncasecmp(field[4], "HEX", 3) == 0) mode = KTERM_PIPE_SINK_HEX;
+    else if (KTerm_Strncasecmp(field[4], "RAW", 3) == 0) mode = KTERM_PIPE_SINK_RAW;
+    else return false;
+
+    KTermStringSink* sink = &session->string_sink;
+    sink->write = KTerm_Gateway_PipeSinkWrite;
+    sink->end = NULL;
+    sink->mode = mode;
+    sink->target = KTerm_GetTargetSession(term, session)->index;
+    return true;
+}
+
+// Host output may target any existing session but only creates sessions below
+// KTERM_GATEWAY_SESSION_LIMIT, so a stream of GATE commands cannot fill the session table.
+static KTermSession* KTerm_Gateway_AcquireSession(KTerm* term, int index) {
+    KTermSession* session = KTerm_GetSession(term, index);
+    if (session || index >= KTERM_GATEWAY_SESSION_LIMIT) return session;
+    return KTerm_AcquireSession(term, index);
 }
 
 // Handler Definitions
@@ -739,7 +815,7 @@ static void KTerm_Gateway_HandleHelp(KTerm* term, KTermSession* session, const c
         "init;<subsys>_session - Initialize subsystem|"
         "ping;host - Ping host|"
         "pipe;banner|vt - Inject content|"
-        "portscan;host;ports - Scan ports|"
+        "portscan;host;ports;[timeout];[window];[rate] - Scan ports|"
         "rawdump;start|stop - Raw input mirroring|"
         "reset;graphics|attr|blink|tabs - Reset state|"
         "set;level|font|size|attr|blink|keyboard|grid|shader - Set property|"
@@ -764,8 +840,13 @@ static void KTerm_Gateway_HandleAttach(KTerm* term, KTermSession* session, const
         if (Stream_Expect(scanner, '=')) {
             int s_idx;
             if (Stream_ReadInt(scanner, &s_idx)) {
-                KTerm_Net_SetTargetSession(term, session, s_idx);
                 char response[64];
+                if (!KTerm_Gateway_AcquireSession(term, s_idx)) {
+                    snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;ATTACH;ERR;SESSION\x1B\\", id);
+                    KTerm_QueueResponse(term, response);
+                    return;
+                }
+                KTerm_Net_SetTargetSession(term, session, s_idx);
                 snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;ATTACH;OK;SESSION=%d\x1B\\", id, s_idx);
                 KTerm_QueueResponse(term, response);
             }
@@ -781,6 +862,47 @@ static void KTerm_ResponseTime_Callback(KTerm* term, KTermSession* session, cons
 static void KTerm_PortScan_Callback(KTerm* term, KTermSession* session, const char* host, int port, int status, void* user_data);
 static void KTerm_Whois_Callback(KTerm* term, KTermSession* session, const char* data, size_t len, bool done, void* user_data);
 static void KTerm_Speedtest_Callback(KTerm* term, KTermSession* session, const SpeedtestResult* result, void* user_data);
+static void KTerm_Dns_Callback(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data);
+
+// Pending DNS command (owned by KTerm_Dns_Callback)
+typedef struct {
+    char id[64];
+    GatewayResponseCallback respond; // NULL = reply with a raw DNS Gateway response
+} KTermGatewayDnsRequest;
+
+static void KTerm_Gateway_DnsReply(KTerm* term, KTermSession* session, const char* id, GatewayResponseCallback respond, const KTermResolveResult* result) {
+    if (!term || !session) return;
+    char msg[128];
+    if (result->success) snprintf(msg, sizeof(msg), "OK;IP=%s", result->ip);
+    else snprintf(msg, sizeof(msg), "ERR;RESOLVE_FAILED");
+
+    if (respond) {
+        respond(term, session, msg);
+    } else {
+        char response[256];
+        snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;DNS;%s\x1B\\", id, msg);
+        KTerm_QueueSessionResponse(term, session, response);
+    }
+}
+
+// Answers immediately for literals/cache hits, otherwise from KTerm_Dns_Callback once the lookup completes.
+static void KTerm_Gateway_StartDns(KTerm* term, KTermSession* session, const char* id, const char* host, GatewayResponseCallback respond) {
+    KTermResolveResult result;
+    if (KTerm_Net_ResolveCached(host, KTERM_RESOLVE_IPV4, &result)) {
+        KTerm_Gateway_DnsReply(term, session, id, respond, &result);
+        return;
+    }
+
+    KTermGatewayDnsRequest* req = (KTermGatewayDnsRequest*)calloc(1, sizeof(KTermGatewayDnsRequest));
+    if (req) {
+        strncpy(req->id, id, sizeof(req->id)-1);
+        req->respond = respond;
+        if (KTerm_Net_ResolveAsync(term, session, host, KTERM_RESOLVE_IPV4, KTerm_Dns_Callback, req)) return;
+        free(req);
+    }
+    memset(&result, 0, sizeof(result));
+    KTerm_Gateway_DnsReply(term, session, id, respond, &result);
+}
 #endif
 
 static void KTerm_Gateway_HandleDNS(KTerm* term, KTermSession* session, const char* id, StreamScanner* scanner) {
@@ -800,16 +922,7 @@ static void KTerm_Gateway_HandleDNS(KTerm* term, KTermSession* session, const ch
         host[len] = '\0';
 
         if (host[0]) {
-            char ip[64];
-            if (KTerm_Net_Resolve(host, ip, sizeof(ip))) {
-                char response[128];
-                snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;DNS;OK;IP=%s\x1B\\", id, ip);
-                KTerm_QueueResponse(term, response);
-            } else {
-                char response[64];
-                snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;DNS;ERR;RESOLVE_FAILED\x1B\\", id);
-                KTerm_QueueResponse(term, response);
-            }
+            KTerm_Gateway_StartDns(term, session, id, host, NULL);
         } else {
             char response[64];
             snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;DNS;ERR;MISSING_HOST\x1B\\", id);
@@ -889,11 +1002,13 @@ static void KTerm_Gateway_HandlePortScan(KTerm* term, KTermSession* session, con
     snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;PORTSCAN;ERR;NET_DISABLED\x1B\\", id);
     KTerm_QueueResponse(term, response);
 #else
-    // PORTSCAN;host;ports;[timeout]
+    // PORTSCAN;host;ports;[timeout];[window];[rate]
     if (Stream_Expect(scanner, ';')) {
         char host[256];
         char ports[256];
         int timeout = 1000;
+        int window = 0;
+        int rate = 0;
 
         char* token = (char*)scanner->ptr + scanner->pos;
         char* next_semi = strchr(token, ';');
@@ -916,6 +1031,13 @@ static void KTerm_Gateway_HandlePortScan(KTerm* term, KTermSession* session, con
             if (next_semi) {
                 token = next_semi + 1;
                 timeout = atoi(token);
+                next_semi = strchr(token, ';');
+                if (next_semi) {
+                    token = next_semi + 1;
+                    window = atoi(token);
+                    next_semi = strchr(token, ';');
+                    if (next_semi) rate = atoi(next_semi + 1);
+                }
             }
         } else {
             ports[0] = '\0';
@@ -923,7 +1045,7 @@ static void KTerm_Gateway_HandlePortScan(KTerm* term, KTermSession* session, con
 
         if (host[0] && ports[0]) {
             // Optimized: Use inline tag
-            if (KTerm_Net_PortScan(term, session, host, ports, timeout, KTerm_PortScan_Callback, NULL, id)) {
+            if (KTerm_Net_PortScanEx(term, session, host, ports, timeout, window, rate, KTerm_PortScan_Callback, NULL, id)) {
                 char response[64];
                 snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;PORTSCAN;OK;STARTED\x1B\\", id);
                 KTerm_QueueResponse(term, response);
@@ -1004,35 +1126,35 @@ static void KTerm_Gateway_HandleSet(KTerm* term, KTermSession* session, const ch
         if (Stream_Expect(scanner, ';')) {
             int s_idx;
             if (Stream_ReadInt(scanner, &s_idx)) {
-                if (s_idx >= 0 && s_idx < MAX_SESSIONS) term->gateway_target_session = s_idx;
+                if (KTerm_Gateway_AcquireSession(term, s_idx)) term->gateway_target_session = s_idx;
             }
         }
     } else if (KTerm_Strcasecmp(subcmd, "REGIS_SESSION") == 0) {
         if (Stream_Expect(scanner, ';')) {
              int s_idx;
              if (Stream_ReadInt(scanner, &s_idx)) {
-                 if (s_idx >= 0 && s_idx < MAX_SESSIONS) term->regis_target_session = s_idx;
+                 if (KTerm_Gateway_AcquireSession(term, s_idx)) term->regis_target_session = s_idx;
              }
         }
     } else if (KTerm_Strcasecmp(subcmd, "TEKTRONIX_SESSION") == 0) {
         if (Stream_Expect(scanner, ';')) {
              int s_idx;
              if (Stream_ReadInt(scanner, &s_idx)) {
-                 if (s_idx >= 0 && s_idx < MAX_SESSIONS) term->tektronix_target_session = s_idx;
+                 if (KTerm_Gateway_AcquireSession(term, s_idx)) term->tektronix_target_session = s_idx;
              }
         }
     } else if (KTerm_Strcasecmp(subcmd, "KITTY_SESSION") == 0) {
         if (Stream_Expect(scanner, ';')) {
              int s_idx;
              if (Stream_ReadInt(scanner, &s_idx)) {
-                 if (s_idx >= 0 && s_idx < MAX_SESSIONS) term->kitty_target_session = s_idx;
+                 if (KTerm_Gateway_AcquireSession(term, s_idx)) term->kitty_target_session = s_idx;
              }
         }
     } else if (KTerm_Strcasecmp(subcmd, "SIXEL_SESSION") == 0) {
         if (Stream_Expect(scanner, ';')) {
              int s_idx;
              if (Stream_ReadInt(scanner, &s_idx)) {
-                 if (s_idx >= 0 && s_idx < MAX_SESSIONS) term->sixel_target_session = s_idx;
+                 if (KTerm_Gateway_AcquireSession(term, s_idx)) term->sixel_target_session = s_idx;
              }
         }
     } else if (KTerm_Strcasecmp(subcmd, "CURSOR") == 0) {
@@ -1494,8 +1616,7 @@ static void KTerm_Gateway_HandleInit(KTerm* term, KTermSession* session, const c
     if (!Stream_ReadIdentifier(scanner, subcmd, sizeof(subcmd))) return;
 
     // session finding logic
-    int s_idx = -1;
-    for(int i=0; i<MAX_SESSIONS; i++) if(&term->sessions[i] == session) { s_idx = i; break; }
+    int s_idx = session ? session->index : -1;
 
     if (s_idx != -1) {
         if (KTerm_Strcasecmp(subcmd, "REGIS_SESSION") == 0) {
@@ -1693,8 +1814,9 @@ static void KTerm_Ext_Broadcast(KTerm* term, KTermSession* session, const char*
     if (!args) return;
 
     // Simple broadcast: write chars to all sessions
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (term->sessions[i].session_open) {
+    for (int n = 0; n < term->live_session_count; n++) {
+        int i = term->live_sessions[n];
+        if (term->sessions[i]->session_open) {
             for (const char* p = args; *p; p++) {
                 KTerm_WriteCharToSession(term, i, (unsigned char)*p);
             }
@@ -1831,6 +1953,14 @@ static void KTerm_ResponseTime_Callback(KTerm* term, KTermSession* session, cons
     // Note: user_data is owned by the Net context and will be freed when the context is destroyed/reset.
 }
 
+// Callback for async DNS results
+static void KTerm_Dns_Callback(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    KTermGatewayDnsRequest* req = (KTermGatewayDnsRequest*)user_data;
+    if (!req) return;
+    KTerm_Gateway_DnsReply(term, session, req->id, req->respond, result);
+    free(req);
+}
+
 // Callback for async port scan results
 static void KTerm_PortScan_Callback(KTerm* term, KTermSession* session, const char* host, int port, int status, void* user_data) {
     if (!term || !session) return;
@@ -1841,6 +1971,7 @@ static void KTerm_PortScan_Callback(KTerm* term, KTermSession* session, const ch
     const char* status_str = "CLOSED";
     if (status == 1) status_str = "OPEN";
     else if (status == 0) status_str = "TIMEOUT"; // Or Closed/Refused
+    else if (status == 2) status_str = "ERROR";
 
     snprintf(payload, sizeof(payload), "HOST=%s;PORT=%d;STATUS=%s", host ? host : "*", port, status_str);
 
@@ -1918,8 +2049,8 @@ static void KTerm_Speedtest_Callback(KTerm* term, KTermSession* session, const S
     char payload[256];
     if (result->done) {
         // Final Result
-        snprintf(payload, sizeof(payload), "RESULT;DL=%.2fMbps;UL=%.2fMbps;JITTER=%.2fms",
-                 result->dl_mbps, result->ul_mbps, result->jitter_ms);
+        snprintf(payload, sizeof(payload), "RESULT;DL=%.2fMbps;UL=%.2fMbps;JITTER=%.2fms%s",
+                 result->dl_mbps, result->ul_mbps, result->jitter_ms, result->kernel_timed ? ";TS=KERNEL" : "");
     } else {
         // Progress
         if (result->phase == 1) { // DL
@@ -1987,6 +2118,32 @@ static void KTerm_HttpProbe_Callback(KTerm* term, KTermSession* session, const K
     KTerm_QueueSessionResponse(term, session, response);
 }
 
+static void KTerm_HttpBatch_Callback(KTerm* term, KTermSession* session, const KTermHttpProbeResult* result, void* user_data) {
+    if (!term || !session || !result) return;
+    char* id = (char*)user_data;
+    if (!id) id = "0";
+
+    char payload[1024];
+    if (result->error) {
+        snprintf(payload, sizeof(payload), "INDEX=%d;ERR;%s", result->index, result->error_msg);
+    } else {
+        snprintf(payload, sizeof(payload),
+            "INDEX=%d;OK;STATUS=%d;DNS=%.1f;TCP=%.1f;TTFB=%.1f;DL=%.1f;TOTAL=%.1f;SIZE=%llu;SPEED=%.2f;REUSED=%d",
+            result->index, result->status_code, result->dns_ms, result->connect_ms, result->ttfb_ms,
+            result->download_ms, result->total_ms, (unsigned long long)result->size_bytes, result->speed_mbps,
+            result->reused ? 1 : 0);
+    }
+
+    char response[2048];
+    snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;HTTPBATCH;%s\x1B\\", id, payload);
+    KTerm_QueueSessionResponse(term, session, response);
+
+    if (result->remaining == 0) {
+        snprintf(response, sizeof(response), "\x1BPGATE;KTERM;%s;HTTPBATCH;DONE\x1B\\", id);
+        KTerm_QueueSessionResponse(term, session, response);
+    }
+}
+
 static void KTerm_MtuProbe_Callback(KTerm* term, KTermSession* session, const KTermMtuProbeResult* result, void* user_data) {
     if (!term || !session || !result) return;
     char* id = (char*)user_data;
@@ -2198,14 +2355,7 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
     } else if (KTerm_Strcasecmp(cmd, "dns") == 0) {
         char* host = KTerm_Strtok(NULL, ";", &saveptr);
         if (host) {
-            char ip[64];
-            if (KTerm_Net_Resolve(host, ip, sizeof(ip))) {
-                char msg[128];
-                snprintf(msg, sizeof(msg), "OK;IP=%s", ip);
-                if (respond) respond(term, session, msg);
-            } else {
-                if (respond) respond(term, session, "ERR;RESOLVE_FAILED");
-            }
+            if (respond) KTerm_Gateway_StartDns(term, session, id, host, respond);
         } else {
             if (respond) respond(term, session, "ERR;MISSING_HOST");
         }
@@ -2213,12 +2363,16 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         char* host = NULL;
         char* ports = NULL;
         int timeout_ms = 1000;
+        int window = 0;
+        int rate = 0;
 
         char* arg = KTerm_Strtok(NULL, ";", &saveptr);
         while(arg) {
             if (KTerm_Strncasecmp(arg, "host=", 5) == 0) host = arg + 5;
             else if (KTerm_Strncasecmp(arg, "ports=", 6) == 0) ports = arg + 6;
             else if (KTerm_Strncasecmp(arg, "timeout=", 8) == 0) timeout_ms = atoi(arg+8);
+            else if (KTerm_Strncasecmp(arg, "window=", 7) == 0) window = atoi(arg+7);
+            else if (KTerm_Strncasecmp(arg, "rate=", 5) == 0) rate = atoi(arg+5);
             else if (!host) host = arg; // 1st Positional
             else if (!ports) ports = arg; // 2nd Positional
             arg = KTerm_Strtok(NULL, ";", &saveptr);
@@ -2226,7 +2380,7 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
 
         if (host && ports) {
              // Optimized: Use inline tag
-             if (KTerm_Net_PortScan(term, session, host, ports, timeout_ms, KTerm_PortScan_Callback, NULL, id)) {
+             if (KTerm_Net_PortScanEx(term, session, host, ports, timeout_ms, window, rate, KTerm_PortScan_Callback, NULL, id)) {
                  if (respond) respond(term, session, "OK;STARTED");
              } else {
                  if (respond) respond(term, session, "ERR;START_FAILED");
@@ -2253,6 +2407,7 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         int streams = 4;
         char* path = NULL;
         int graph = 0;
+        KTermSpeedtestOptions opts = {0};
 
         char* arg = KTerm_Strtok(NULL, ";", &saveptr);
         while(arg) {
@@ -2261,6 +2416,11 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
             else if (KTerm_Strncasecmp(arg, "streams=", 8) == 0) streams = atoi(arg+8);
             else if (KTerm_Strncasecmp(arg, "path=", 5) == 0) path = arg + 5;
             else if (KTerm_Strncasecmp(arg, "graph=", 6) == 0) graph = atoi(arg+6);
+            else if (KTerm_Strncasecmp(arg, "threads=", 8) == 0) opts.threaded = atoi(arg+8) != 0;
+            else if (KTerm_Strncasecmp(arg, "sockbuf=", 8) == 0) opts.sock_buf_bytes = atoi(arg+8);
+            else if (KTerm_Strncasecmp(arg, "hz=", 3) == 0) opts.report_hz = atoi(arg+3);
+            else if (KTerm_Strncasecmp(arg, "duration=", 9) == 0) opts.duration_sec = atof(arg+9);
+            else if (KTerm_Strncasecmp(arg, "tstamp=", 7) == 0) opts.kernel_timestamps = atoi(arg+7) != 0;
             else if (!host) host = arg; // 1st Positional
             arg = KTerm_Strtok(NULL, ";", &saveptr);
         }
@@ -2272,7 +2432,7 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         snprintf(id_buf, sizeof(id_buf), "%s:%d", id, graph);
 
         // Optimized: Use inline tag
-        if (KTerm_Net_Speedtest(term, session, host, port, streams, path, KTerm_Speedtest_Callback, NULL, id_buf)) {
+        if (KTerm_Net_SpeedtestEx(term, session, host, port, streams, path, &opts, KTerm_Speedtest_Callback, NULL, id_buf)) {
             if (respond) respond(term, session, "OK;STARTED");
         } else {
             if (respond) respond(term, session, "ERR;START_FAILED");
@@ -2297,6 +2457,41 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         } else {
              if (respond) respond(term, session, "ERR;MISSING_URL");
         }
+    } else if (KTerm_Strcasecmp(cmd, "httpbatch") == 0) {
+        // httpbatch;url1,url2,...;[conns=N];[per_host=N];[depth=N]
+        char* list = NULL;
+        KTermHttpProbeOptions opts = {0};
+
+        char* arg = KTerm_Strtok(NULL, ";", &saveptr);
+        while(arg) {
+            if (KTerm_Strncasecmp(arg, "conns=", 6) == 0) opts.max_connections = atoi(arg+6);
+            else if (KTerm_Strncasecmp(arg, "per_host=", 9) == 0) opts.per_host = atoi(arg+9);
+            else if (KTerm_Strncasecmp(arg, "depth=", 6) == 0) opts.pipeline_depth = atoi(arg+6);
+            else if (KTerm_Strncasecmp(arg, "urls=", 5) == 0) list = arg + 5;
+            else if (!list) list = arg; // 1st Positional
+            arg = KTerm_Strtok(NULL, ";", &saveptr);
+        }
+
+        const char* urls[128];
+        int count = 0;
+        if (list) {
+            char* url_save = NULL;
+            char* url = KTerm_Strtok(list, ",", &url_save);
+            while (url && count < 128) {
+                urls[count++] = url;
+                url = KTerm_Strtok(NULL, ",", &url_save);
+            }
+        }
+
+        if (count > 0) {
+            if (KTerm_Net_HttpProbeBatch(term, session, urls, count, &opts, KTerm_HttpBatch_Callback, NULL, id)) {
+                if (respond) respond(term, session, "OK;STARTED");
+            } else {
+                if (respond) respond(term, session, "ERR;START_FAILED");
+            }
+        } else {
+            if (respond) respond(term, session, "ERR;MISSING_URL");
+        }
     } else if (KTerm_Strcasecmp(cmd, "mtu_probe") == 0) {
         char* host = NULL;
         bool df = false;
@@ -2375,7 +2570,15 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
     } else if (KTerm_Strcasecmp(cmd, "packetdiag") == 0) {
         // args in saveptr
         const char* params = saveptr ? saveptr : "";
-        if (KTerm_Net_PacketDiag_Start(term, session, params)) {
+        // record= creates or truncates a file, so like the Follow file sink it is API-only
+        bool wants_record = false;
+        for (const char* p = params; p; p = strchr(p, ';')) {
+            if (*p == ';') p++;
+            if (KTerm_Strncasecmp(p, "record=", 7) == 0) wants_record = true;
+        }
+        if (wants_record) {
+            if (respond) respond(term, session, "ERR;RECORD_API_ONLY");
+        } else if (KTerm_Net_PacketDiag_Start(term, session, params)) {
             if (respond) respond(term, session, "OK;STARTED");
         } else {
             if (respond) respond(term, session, "ERR;START_FAILED");
@@ -2423,6 +2626,9 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         snprintf(msg, sizeof(msg), "OK;%s", status);
         if (respond) respond(term, session, msg);
     } else if (KTerm_Strcasecmp(cmd, "packetdiag_follow") == 0) {
+        // packetdiag_follow;flow_id
+        // The file sink is API-only (KTerm_Net_PacketDiag_FollowEx): host output must not be
+        // able to create or truncate files.
         char* token = KTerm_Strtok(NULL, ";", &saveptr);
         uint32_t fid = 0;
         if (token && KTerm_Strncasecmp(token, "flow_id=", 8) == 0) {
@@ -2430,8 +2636,14 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         } else if (token) {
             fid = (uint32_t)strtoul(token, NULL, 10); // Positional
         }
+        bool wants_file = false;
+        while ((token = KTerm_Strtok(NULL, ";", &saveptr)) != NULL) {
+            if (KTerm_Strncasecmp(token, "file=", 5) == 0) wants_file = true;
+        }
 
-        if (KTerm_Net_PacketDiag_Follow(term, session, fid)) {
+        if (wants_file) {
+            if (respond) respond(term, session, "ERR;FILE_API_ONLY");
+        } else if (KTerm_Net_PacketDiag_Follow(term, session, fid)) {
             if (respond) respond(term, session, "OK;FOLLOW_UPDATED");
         } else {
             if (respond) respond(term, session, "ERR;FAILED");
@@ -2446,10 +2658,19 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
             if (respond) respond(term, session, "ERR;FAILED");
         }
     } else if (KTerm_Strcasecmp(cmd, "packetdiag_flows") == 0) {
+        // packetdiag_flows[;cursor=N][;limit=M]
+        uint64_t cursor = 0, next = 0;
+        int limit = 10;
+        char* token;
+        while ((token = KTerm_Strtok(NULL, ";", &saveptr)) != NULL) {
+            if (KTerm_Strncasecmp(token, "cursor=", 7) == 0) cursor = strtoull(token + 7, NULL, 10);
+            else if (KTerm_Strncasecmp(token, "limit=", 6) == 0) limit = atoi(token + 6);
+        }
         char buf[4096];
-        if (KTerm_Net_PacketDiag_GetFlows(term, session, buf, sizeof(buf))) {
+        if (KTerm_Net_PacketDiag_GetFlowsPage(term, session, cursor, limit, buf, sizeof(buf), &next)) {
             char msg[4200];
-            snprintf(msg, sizeof(msg), "OK;%s", buf);
+            if (next) snprintf(msg, sizeof(msg), "OK;%sNEXT=%llu", buf, (unsigned long long)next);
+            else snprintf(msg, sizeof(msg), "OK;%s", buf);
             if (respond) respond(term, session, msg);
         } else {
             if (respond) respond(term, session, "ERR;FAILED");
@@ -2483,6 +2704,32 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
         } else {
             if (respond) respond(term, session, "ERR;FAILED");
         }
+    } else if (KTerm_Strcasecmp(cmd, "metrics") == 0) {
+        // metrics;series[;window=S]
+        char* series = KTerm_Strtok(NULL, ";", &saveptr);
+        int window = 60;
+        char* token;
+        while ((token = KTerm_Strtok(NULL, ";", &saveptr)) != NULL) {
+            if (KTerm_Strncasecmp(token, "window=", 7) == 0) window = atoi(token + 7);
+        }
+        KTermMetricsSummary m;
+        if (!series) {
+            if (respond) respond(term, session, "ERR;MISSING_SERIES");
+        } else if (KTerm_Net_Metrics_Query(term, session, series, window, &m)) {
+            char msg[512];
+            snprintf(msg, sizeof(msg), "OK;SERIES=%s;WINDOW=%d;N=%llu;LOST=%llu;RATE=%.3f;TOTAL=%.0f;MIN=%.3f;P50=%.3f;P90=%.3f;P99=%.3f;MAX=%.3f",
+                series, m.window_sec, (unsigned long long)m.samples, (unsigned long long)m.lost,
+                m.rate, m.total, m.min, m.p50, m.p90, m.p99, m.max);
+            if (respond) respond(term, session, msg);
+        } else {
+            if (respond) respond(term, session, "ERR;UNKNOWN_SERIES");
+        }
+    } else if (KTerm_Strcasecmp(cmd, "metrics_list") == 0) {
+        char buf[2048];
+        KTerm_Net_Metrics_List(term, session, buf, sizeof(buf));
+        char msg[2100];
+        snprintf(msg, sizeof(msg), "OK;%s", buf);
+        if (respond) respond(term, session, msg);
     } else if (KTerm_Strcasecmp(cmd, "help") == 0) {
         const char* help =
             "OK;"
@@ -2496,17 +2743,20 @@ static void KTerm_Ext_SSH(KTerm* term, KTermSession* session, const char* id, co
             "dns;host|"
             "portscan;host;ports|"
             "whois;host|"
-            "speedtest;[host][;streams;graph=1]|"
+            "speedtest;[host][;streams;graph=1;threads=1]|"
             "connections|"
             "httpprobe;url|"
-            "packetdiag;[interface=x;filter=y...]|"
+            "httpbatch;url1,url2,...;[conns=N];[depth=N]|"
+            "packetdiag;[interface=x;filter=y;file=f...]|"
             "packetdiag_stop|"
             "packetdiag_status|"
             "packetdiag_follow;flow_id|"
             "packetdiag_stats|"
-            "packetdiag_flows|"
+            "packetdiag_flows;cursor;limit|"
             "proto_query;port;[UDP]|"
-            "scan_auth";
+            "scan_auth|"
+            "metrics;series[;window=S]|"
+            "metrics_list";
         if (respond) respond(term, session, help);
     } else {
         if (respond) respond(term, session, "ERR;UNKNOWN_CMD");
@@ -2547,15 +2797,7 @@ static void KTerm_Ext_Net(KTerm* term, KTermSession* session, const char* id, co
                 if (net->frag_test->user_data) free(net->frag_test->user_data);
                 free(net->frag_test); net->frag_test = NULL;
             }
-            if (net->ping_ext) {
-                if (IS_VALID_SOCKET(net->ping_ext->sockfd)) CLOSE_SOCKET(net->ping_ext->sockfd);
-#ifdef _WIN32
-                if (net->ping_ext->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(net->ping_ext->icmp_handle);
-                if (net->ping_ext->icmp_event) CloseHandle(net->ping_ext->icmp_event);
-#endif
-                if (net->ping_ext->user_data) free(net->ping_ext->user_data);
-                free(net->ping_ext); net->ping_ext = NULL;
-            }
+            if (net->ping_ext) { KTerm_Net_FreePingExt(net->ping_ext); net->ping_ext = NULL; }
             if (net->packetdiag) {
                 KTerm_Net_PacketDiag_Stop(term, session);
                 KTerm_Net_FreePacketDiag(net->packetdiag);
@@ -2582,7 +2824,7 @@ static void KTerm_Ext_Voice(KTerm* term, KTermSession* session, const char* id,
     if (!args) return;
     (void)id;
 
-    // enable;1 | target;ip | command;text | mute;1
+    // enable;1 | target;ip | command;text | mute;1 | codec;name | gain;[source;]value
     char buffer[256];
     strncpy(buffer, args, sizeof(buffer)-1);
     buffer[sizeof(buffer)-1] = '\0';
@@ -2621,6 +2863,31 @@ static void KTerm_Ext_Voice(KTerm* term, KTermSession* session, const char* id,
         bool mute = (val && (strcmp(val, "1") == 0 || KTerm_Strcasecmp(val, "ON") == 0));
         KTerm_Voice_SetGlobalMute(mute);
         if (respond) respond(term, session, mute ? "OK;MUTED" : "OK;UNMUTED");
+    } else if (KTerm_Strcasecmp(cmd, "codec") == 0) {
+        char* val = KTerm_Strtok(NULL, ";", &saveptr);
+        KTermSession* target = KTerm_GetTargetSession(term, session);
+        if (val && KTerm_Voice_SetCodec(target, val) == SITUATION_SUCCESS) {
+            if (respond) respond(term, session, "OK;CODEC_SET");
+        } else {
+            if (respond) respond(term, session, "ERR;UNKNOWN_CODEC");
+        }
+    } else if (KTerm_Strcasecmp(cmd, "gain") == 0) {
+        // gain;<value> sets the master gain, gain;<source>;<value> one talker's
+        char* first = KTerm_Strtok(NULL, ";", &saveptr);
+        char* second = KTerm_Strtok(NULL, ";", &saveptr);
+        KTermSession* target = KTerm_GetTargetSession(term, session);
+        char* end = NULL;
+        float gain = first ? strtof(second ? second : first, &end) : -1.0f;
+        if (!first || !end || *end || !isfinite(gain) || gain < 0.0f) { // strtof also takes "inf" and "nan"
+            if (respond) respond(term, session, "ERR;INVALID_GAIN");
+        } else if (!second) {
+            KTerm_Voice_SetMasterGain(target, gain);
+            if (respond) respond(term, session, "OK;GAIN_SET");
+        } else if (KTerm_Voice_SetSourceGain(target, (uint32_t)strtoul(first, NULL, 0), gain) == SITUATION_SUCCESS) {
+            if (respond) respond(term, session, "OK;GAIN_SET");
+        } else {
+            if (respond) respond(term, session, "ERR;UNKNOWN_SOURCE");
+        }
     } else {
         if (respond) respond(term, session, "ERR;UNKNOWN_CMD");
     }
@@ -3071,9 +3338,10 @@ static void KTerm_Ext_Grid(KTerm* term, KTermSession* session, const char* id, c
     KTermSession* target = session;
     if (count > 1 && tokens[1][0] != '\0') {
         int s_id = atoi(tokens[1]);
-        if (s_id >= 0 && s_id < MAX_SESSIONS) target = &term->sessions[s_id];
-    } else if (term->gateway_target_session >= 0) {
-        target = &term->sessions[term->gateway_target_session];
+        KTermSession* s = KTerm_Gateway_AcquireSession(term, s_id);
+        if (s) target = s;
+    } else {
+        target = KTerm_GetTargetSession(term, session);
     }
 
     // Initialize Style with Session Defaults (for optional params)
@@ -29,7 +29,7 @@ void KTermSit_ProcessInput(KTerm* term);
 
 // Helper macro to access active session
 #ifndef GET_SESSION
-#define GET_SESSION(term) (&(term)->sessions[(term)->active_session])
+#define GET_SESSION(term) ((term)->sessions[(term)->active_session])
 #endif
 
 // Use Core Key Event Structure
@@ -195,7 +195,7 @@ static void KTermSit_UpdateMouse(KTerm* term) {
     }
 
     // Switch context to target session
-    KTermSession* target_session = &term->sessions[target_session_idx];
+    KTermSession* target_session = term->sessions[target_session_idx];
 
     // Clamp
     if (global_cell_x < 0) global_cell_x = 0;
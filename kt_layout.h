@@ -7,6 +7,10 @@ extern "C" {
 
 #include <stdlib.h>
 
+// Prepares owed a full re-encode after a pane's geometry changes, one per render buffer
+// (matches KTERM_DIRTY_FRAMES)
+#define KTERM_PANE_RELAYOUT_FRAMES 2
+
 typedef enum {
     PANE_SPLIT_VERTICAL,   // Top/Bottom split
     PANE_SPLIT_HORIZONTAL, // Left/Right split
@@ -29,6 +33,10 @@ struct KTermPane_T {
 
     // Geometry (Calculated)
     int x, y, width, height; // Cells
+
+    // Set by KTermLayout_Recalculate when the geometry above changes; the compositor
+    // re-encodes the whole pane and counts it down. Unchanged panes are left alone.
+    int geometry_dirty;
 };
 
 typedef struct {
@@ -71,6 +79,9 @@ static void KL_Free(void* ptr) {
 static void KTermLayout_Recalculate(KTermLayout* layout, KTermPane* pane, int x, int y, int w, int h, KTermLayout_ResizeCallback callback, void* user_data) {
     if (!pane) return;
 
+    if (pane->x != x || pane->y != y || pane->width != w || pane->height != h) {
+        pane->geometry_dirty = KTERM_PANE_RELAYOUT_FRAMES;
+    }
     pane->x = x;
     pane->y = y;
     pane->width = w;
@@ -119,6 +130,7 @@ KTermLayout* KTermLayout_Create(int width, int height) {
     layout->root->session_index = 0; // Default session
     layout->root->width = width;
     layout->root->height = height;
+    layout->root->geometry_dirty = KTERM_PANE_RELAYOUT_FRAMES;
 
     layout->focused = layout->root;
 
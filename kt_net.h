@@ -167,7 +167,8 @@ void KTerm_Net_SetKeepAlive(KTerm* term, KTermSession* session, bool enable, int
 void KTerm_Net_SetAutoReconnect(KTerm* term, KTermSession* session, bool enable, int max_retries, int delay_ms);
 intptr_t KTerm_Net_GetSocket(KTerm* term, KTermSession* session); // Returns socket_fd or -1
 
-// Session Control
+// Session Control. Creates the target session if needed (index < KTERM_SESSION_LIMIT), so call it
+// from the thread that runs KTerm_Update.
 void KTerm_Net_SetTargetSession(KTerm* term, KTermSession* session, int target_idx);
 
 // Send Framed Packet (Helper)
@@ -181,9 +182,78 @@ void KTerm_Net_SendTelnetCommand(KTerm* term, KTermSession* session, uint8_t com
 // Utilities
 void KTerm_Net_GetLocalIP(char* buffer, size_t max_len);
 void KTerm_Net_Ping(const char* host, char* output, size_t max_len);
-bool KTerm_Net_Resolve(const char* host, char* output_ip, size_t max_len); // Sync Resolve
+bool KTerm_Net_Resolve(const char* host, char* output_ip, size_t max_len); // Sync Resolve (Cache-aware)
 void KTerm_Net_DumpConnections(KTerm* term, char* buffer, size_t max_len); // Detailed socket list
 
+// Async DNS Resolver
+// Lookups run on a small worker pool (getaddrinfo) or, when a DNS server is configured with
+// KTerm_Net_SetDnsServer, on a non-blocking UDP client polled from KTerm_Net_Process.
+// Results are cached process-wide (shared by all sessions) and honour the record TTL.
+typedef enum {
+    KTERM_RESOLVE_ANY  = 0,
+    KTERM_RESOLVE_IPV4 = 4,
+    KTERM_RESOLVE_IPV6 = 6
+} KTermResolveFamily;
+
+typedef struct {
+    const char* host;
+    bool success;
+    bool from_cache;
+    int family;            // 4 or 6 on success
+    char ip[64];           // Numeric address string
+    uint8_t addr[28];      // struct sockaddr_in / sockaddr_in6 (port 0)
+    int addr_len;
+    uint32_t ttl_sec;
+    char error[64];
+} KTermResolveResult;
+
+typedef void (*KTermResolveCallback)(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data);
+
+// Starts an async lookup. The callback always runs later from KTerm_Net_Process (never re-entrantly).
+// Returns a request id (never 0) or 0 on failure.
+uint32_t KTerm_Net_ResolveAsync(KTerm* term, KTermSession* session, const char* host, KTermResolveFamily family, KTermResolveCallback cb, void* user_data);
+// Cancels a pending lookup. The callback will not be invoked.
+void KTerm_Net_ResolveCancel(uint32_t request_id);
+// Non-blocking lookup for literal addresses and fresh cache entries. Returns false if a real lookup is needed.
+bool KTerm_Net_ResolveCached(const char* host, KTermResolveFamily family, KTermResolveResult* out);
+// Use a specific DNS server (UDP) instead of the system resolver. NULL restores getaddrinfo.
+void KTerm_Net_SetDnsServer(const char* ip, int port);
+void KTerm_Net_FlushDnsCache(void);
+// Dispatches completed lookups (called by KTerm_Net_Process).
+void KTerm_Net_ProcessResolver(void);
+
+// Shared ICMP Engine
+// All echo probes (ping, responsetime, traceroute) are multiplexed over one ICMP socket per address
+// family, opened lazily (unprivileged SOCK_DGRAM when allowed, SOCK_RAW otherwise). Queued probes are
+// flushed with sendmmsg and replies drained with recvmmsg from KTerm_Net_Process; RTTs use kernel
+// SO_TIMESTAMPNS receive timestamps when available. Strict POSIX builds (no _DEFAULT_SOURCE) send and
+// receive one message per call, and builds without SCM_TIMESTAMPNS time replies in user space.
+// Linux only; other platforms keep their own paths.
+typedef struct {
+    uint32_t probe_id;
+    bool success;          // A reply (echo reply or ICMP error) was received
+    bool reached;          // The reply came from the destination itself
+    bool timeout;
+    bool kernel_timed;     // RTT measured from a kernel receive timestamp
+    int icmp_type;         // Reply type (family specific), -1 if none
+    int icmp_code;
+    int ttl;               // TTL / hop limit the probe was sent with (0 = system default)
+    double rtt_ms;
+    char from[64];         // Responder address
+    char error[32];        // Set when the probe could not be sent
+} KTermIcmpResult;
+
+typedef void (*KTermIcmpCallback)(KTerm* term, KTermSession* session, const KTermIcmpResult* result, void* user_data);
+
+// Queues an echo request to addr (struct sockaddr_in / sockaddr_in6, e.g. KTermResolveResult.addr).
+// size is the ICMP message size including the 8-byte header. The callback runs exactly once from
+// KTerm_Net_Process unless the probe is cancelled. Returns a probe id (never 0) or 0 if the engine is full.
+uint32_t KTerm_Net_IcmpEcho(KTerm* term, KTermSession* session, const void* addr, int addr_len, int ttl, int size, int timeout_ms, KTermIcmpCallback cb, void* user_data);
+// Cancels a pending probe. The callback will not be invoked.
+void KTerm_Net_IcmpCancel(uint32_t probe_id);
+// Flushes queued probes, dispatches replies and timeouts (called by KTerm_Net_Process).
+void KTerm_Net_ProcessIcmp(void);
+
 // Traceroute Callback
 typedef void (*KTermTracerouteCallback)(KTerm* term, KTermSession* session, int hop, const char* ip, double rtt_ms, bool reached, void* user_data);
 
@@ -208,12 +278,16 @@ typedef void (*KTermResponseTimeCallback)(KTerm* term, KTermSession* session, co
 bool KTerm_Net_ResponseTime(KTerm* term, KTermSession* session, const char* host, int count, int interval_ms, int timeout_ms, KTermResponseTimeCallback cb, void* user_data, const char* tag, bool free_user_data);
 
 // Port Scan Callback
-// Status: 0=CLOSED/TIMEOUT, 1=OPEN
+// Status: 0=CLOSED/TIMEOUT, 1=OPEN, 2=ERROR (no socket after KTERM_NET_PORTSCAN_SOCKET_RETRIES ticks)
 typedef void (*KTermPortScanCallback)(KTerm* term, KTermSession* session, const char* host, int port, int status, void* user_data);
 
-// Starts an async port scan. Ports string can be comma separated (e.g., "80,443,22,8080").
-// Timeout is per port.
+// Starts an async port scan. Ports string can be comma separated with ranges (e.g., "22,80,443,8000-8100").
+// Timeout is per port. Up to KTERM_NET_PORTSCAN_WINDOW connects are kept in flight and results are
+// reported in completion order.
 bool KTerm_Net_PortScan(KTerm* term, KTermSession* session, const char* host, const char* ports, int timeout_ms, KTermPortScanCallback cb, void* user_data, const char* tag);
+// As above with an explicit in-flight window (1..KTERM_NET_PORTSCAN_MAX_WINDOW, 0 = default) and a
+// per-target rate limit in connects/sec (0 = unlimited).
+bool KTerm_Net_PortScanEx(KTerm* term, KTermSession* session, const char* host, const char* ports, int timeout_ms, int window, int rate_per_sec, KTermPortScanCallback cb, void* user_data, const char* tag);
 
 // Whois Callback
 typedef void (*KTermWhoisCallback)(KTerm* term, KTermSession* session, const char* data, size_t len, bool done, void* user_data);
@@ -231,14 +305,30 @@ typedef struct {
     double dl_progress;
     double ul_progress;
     int phase; // 0=INIT, 1=DL, 2=UL, 3=DONE
+    // Totals for the current/finished phases
+    uint64_t dl_bytes;
+    uint64_t ul_bytes;
+    bool kernel_timed; // dl_mbps measured from kernel RX timestamps (SO_TIMESTAMPING)
 } SpeedtestResult;
 
 typedef void (*KTermSpeedtestCallback)(KTerm* term, KTermSession* session, const SpeedtestResult* result, void* user_data);
 
+// Speedtest Options (KTerm_Net_SpeedtestEx)
+typedef struct {
+    bool threaded;          // Run each stream on a dedicated worker thread instead of the frame loop
+    int sock_buf_bytes;     // SO_RCVBUF/SO_SNDBUF per stream (0 = 4 MiB when threaded, OS default otherwise)
+    int chunk_bytes;        // Bytes per send/recv call in threaded mode (0 = 256 KiB)
+    int report_hz;          // Interim callback rate in threaded mode (0 = 10)
+    double duration_sec;    // Duration of each phase (0 = 5s)
+    bool kernel_timestamps; // Time the download from SO_TIMESTAMPING RX stamps where available (Linux)
+} KTermSpeedtestOptions;
+
 // Starts an async speedtest (Download/Upload).
 // Streams: number of parallel connections (default 4).
 // Path: URL path for download test (default "/100MB.zip").
 bool KTerm_Net_Speedtest(KTerm* term, KTermSession* session, const char* host, int port, int streams, const char* path, KTermSpeedtestCallback cb, void* user_data, const char* tag);
+// As above with explicit options (NULL = frame-loop defaults).
+bool KTerm_Net_SpeedtestEx(KTerm* term, KTermSession* session, const char* host, int port, int streams, const char* path, const KTermSpeedtestOptions* opts, KTermSpeedtestCallback cb, void* user_data, const char* tag);
 
 // HTTP Probe Result
 typedef struct {
@@ -252,12 +342,26 @@ typedef struct {
     double speed_mbps;
     bool error;
     char error_msg[64];
+    int index;      // Position in the KTerm_Net_HttpProbeBatch URL list (0 for single probes)
+    int remaining;  // Probes of the same call still outstanding (0 on the last result)
+    bool reused;    // Served on a pooled keep-alive connection (dns_ms/connect_ms are 0)
+    bool pipelined; // Sent behind another request on the same connection
 } KTermHttpProbeResult;
 
 typedef void (*KTermHttpProbeCallback)(KTerm* term, KTermSession* session, const KTermHttpProbeResult* result, void* user_data);
 
-// Starts an async HTTP probe.
+// HTTP Probe Options (apply to the session's connection pool)
+typedef struct {
+    int max_connections; // Pooled connections across all hosts (0 = 16, max KTERM_NET_HTTP_POOL_SIZE)
+    int per_host;        // Connections per host:port (0 = 4)
+    int pipeline_depth;  // Requests in flight per connection (0 = 4, 1 disables pipelining)
+} KTermHttpProbeOptions;
+
+// Starts an async HTTP probe. Probes share a per-session keep-alive pool keyed by host:port.
 bool KTerm_Net_HttpProbe(KTerm* term, KTermSession* session, const char* url, KTermHttpProbeCallback cb, void* user_data, const char* tag);
+// Probes a list of URLs concurrently (pooled, pipelined). The callback fires once per URL in
+// completion order with result->index set; result->remaining reaches 0 on the last one.
+bool KTerm_Net_HttpProbeBatch(KTerm* term, KTermSession* session, const char* const* urls, int count, const KTermHttpProbeOptions* opts, KTermHttpProbeCallback cb, void* user_data, const char* tag);
 
 // MTU Probe Result
 typedef struct {
@@ -332,13 +436,103 @@ void KTerm_Net_PacketDiag_Resume(KTerm* term, KTermSession* session);
 bool KTerm_Net_PacketDiag_SetFilter(KTerm* term, KTermSession* session, const char* filter);
 bool KTerm_Net_PacketDiag_GetDetail(KTerm* term, KTermSession* session, int packet_id, char* out, size_t max);
 bool KTerm_Net_PacketDiag_Follow(KTerm* term, KTermSession* session, uint32_t flow_id);
+
+// Reassembled payload of a followed conversation, one direction at a time and in sequence order
+// (TCP) or per datagram (UDP). offset counts the bytes of that direction seen so far; data is
+// NULL for a hole of len bytes the reassembler gave up on. Runs on a dissector thread while the
+// worker's flow table is locked, so it must not call back into PacketDiag.
+typedef void (*KTermPacketDiagStreamCallback)(KTerm* term, KTermSession* session, uint32_t flow_id, uint64_t offset, const uint8_t* data, int len, void* user_data);
+
+// Follows flow_id and its reverse direction (0 stops following). Payload goes to cb and/or is
+// appended to the file at path (holes are skipped); either may be NULL.
+bool KTerm_Net_PacketDiag_FollowEx(KTerm* term, KTermSession* session, uint32_t flow_id, const char* path, KTermPacketDiagStreamCallback cb, void* user_data);
 bool KTerm_Net_PacketDiag_GetStats(KTerm* term, KTermSession* session, char* out, size_t max);
 bool KTerm_Net_PacketDiag_GetFlows(KTerm* term, KTermSession* session, char* out, size_t max);
+// Pages through every tracked flow. Start with cursor 0; *next_cursor is 0 once the walk is complete.
+bool KTerm_Net_PacketDiag_GetFlowsPage(KTerm* term, KTermSession* session, uint64_t cursor, int limit, char* out, size_t max, uint64_t* next_cursor);
+
+// Fixed-size packet summary produced by the dissector workers
+typedef enum {
+    KTERM_PACKETDIAG_EVENT_PACKET = 0,
+    KTERM_PACKETDIAG_EVENT_STREAM        // Payload of the followed flow
+} KTermPacketDiagEventKind;
+
+#define KTERM_PACKETDIAG_EVENT_F_FRAGMENT    0x01 // IP fragment not (yet) reassembled, no ports
+#define KTERM_PACKETDIAG_EVENT_F_MF          0x02 // More fragments follow
+#define KTERM_PACKETDIAG_EVENT_F_REASSEMBLED 0x04 // This fragment completed the datagram
+#define KTERM_PACKETDIAG_EVENT_F_HEURISTIC   0x08 // `info` came from a payload heuristic, not the port
+
+typedef struct {
+    uint64_t id;             // Capture sequence number (packet_id for GetDetail)
+    int64_t ts_sec;
+    int32_t ts_usec;
+    uint32_t wire_len;
+    uint8_t kind;            // KTermPacketDiagEventKind
+    uint8_t family;          // 4 or 6
+    uint8_t proto;           // IP protocol after any IPv6 extension headers
+    uint8_t flags;           // KTERM_PACKETDIAG_EVENT_F_*
+    uint8_t tcp_flags;
+    uint8_t icmp_type;
+    uint8_t icmp_code;
+    uint8_t vlan_count;
+    uint16_t vlan[2];        // Outer tag first
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t src_ip[16];      // Network order; IPv4 uses the first 4 bytes
+    uint8_t dst_ip[16];
+    uint32_t frag_id;
+    uint32_t frag_offset;    // Bytes
+    int32_t length;          // UDP length field, reassembled size or stream payload bytes
+    const KTermProtocolDef* protocol; // kterm_protocols[] match on the ports, NULL if none
+    const char* info_color;  // ANSI color of `info`
+    char info[80];           // Application summary or stream preview
+} KTermPacketDiagEvent;
+
+// Moves up to max pending events into out, oldest first. Only useful with render=0, otherwise
+// KTerm_Net_ProcessPacketDiag consumes them. Returns the number written.
+int KTerm_Net_PacketDiag_PollEvents(KTerm* term, KTermSession* session, KTermPacketDiagEvent* out, int max);
+// Formats an event as the one-line ANSI summary the renderer writes (CRLF terminated).
+int KTerm_Net_PacketDiag_FormatEvent(const KTermPacketDiagEvent* ev, char* out, size_t max);
 
 // Advanced Auth / Protocol Analysis
+// Constant time: backed by a per-port index of kterm_protocols[] (exact ports beat ranges).
 const KTermProtocolDef* KTerm_Net_QueryProtocol(uint16_t port, bool is_udp);
 bool KTerm_Net_ScanAuthFlows(KTerm* term, KTermSession* session, char* out, size_t max);
 
+// Time-Series Metrics
+// Each session keeps up to KTERM_NET_METRICS_MAX_SERIES named series in one-second ring buckets
+// covering the last KTERM_NET_METRICS_HORIZON seconds. Latency series also keep an HDR histogram
+// per KTERM_NET_METRICS_HIST_SEC slice, so percentiles over a window are merged from slices rather
+// than recomputed from samples. Built-in feeds:
+//   "icmp:<addr>"   Ping/responsetime RTTs in ms (no reply counts as lost)
+//   "http:<host>"   HTTP probe total time in ms (errors count as lost)
+//   "packetdiag:bytes", "packetdiag:packets"  Captured traffic (counters)
+//   "flow:<id>"     Bytes of one PacketDiag flow, read from the flow's own 10 s ring (query only)
+// Call from the thread that runs KTerm_Net_Process.
+typedef enum {
+    KTERM_METRIC_LATENCY = 0, // Samples in ms with a distribution
+    KTERM_METRIC_COUNTER      // Amounts summed per second (bytes, packets, ...)
+} KTermMetricKind;
+
+typedef struct {
+    KTermMetricKind kind;
+    int window_sec;      // Seconds covered: less than asked while the series is younger than the window
+    uint64_t samples;    // Latency samples, or Add calls for a counter
+    uint64_t lost;       // Latency only
+    double total;        // Sum of the values or amounts
+    double rate;         // Counter: total per second. Latency: samples per second
+    double min, mean, max;
+    double p50, p90, p99, p999; // Latency only, ms (HDR resolution, 10 s slices)
+} KTermMetricsSummary;
+
+void KTerm_Net_Metrics_Record(KTerm* term, KTermSession* session, const char* series, double ms);
+void KTerm_Net_Metrics_RecordLoss(KTerm* term, KTermSession* session, const char* series);
+void KTerm_Net_Metrics_Add(KTerm* term, KTermSession* session, const char* series, double amount);
+// Summarizes the last window_sec seconds (1..KTERM_NET_METRICS_HORIZON). False if the series is unknown.
+bool KTerm_Net_Metrics_Query(KTerm* term, KTermSession* session, const char* series, int window_sec, KTermMetricsSummary* out);
+// Lists the series names as "name|name|...". Returns the number of series.
+int KTerm_Net_Metrics_List(KTerm* term, KTermSession* session, char* out, size_t max);
+
 // Cleanup Functions (Internal/Advanced use)
 void KTerm_Net_FreeTraceroute(KTermTracerouteContext* ctx);
 void KTerm_Net_FreeResponseTime(KTermResponseTimeContext* ctx);
@@ -373,8 +567,10 @@ void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx);
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <ctype.h>
 #include <time.h>
 #include <math.h>
+#include <stdatomic.h>
 #ifndef _WIN32
 #include <pthread.h>
 #endif
@@ -387,6 +583,29 @@ void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx);
 #else
     #include <pcap.h>
 #endif
+// Older libpcap headers lack the newer link types
+#ifndef DLT_LINUX_SLL
+#define DLT_LINUX_SLL 113
+#endif
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2 276
+#endif
+#ifndef DLT_IPV4
+#define DLT_IPV4 228
+#endif
+#ifndef DLT_IPV6
+#define DLT_IPV6 229
+#endif
+// Native Linux capture (backend=tpacket): AF_PACKET with a TPACKET_V3 block ring and a
+// built-in filter compiler, so neither the packets nor the filter go through libpcap.
+#if defined(KTERM_PACKETDIAG_TPACKET) && defined(__linux__)
+#define KTERM_PACKETDIAG_HAVE_TPACKET
+#include <sys/mman.h>
+#include <net/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#endif
 #endif
 
 #ifdef KTERM_USE_LIBSSH
@@ -401,6 +620,8 @@ void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx);
     typedef SOCKET socket_t;
     #define CLOSE_SOCKET closesocket
     #define IS_VALID_SOCKET(s) ((s) != INVALID_SOCKET)
+    typedef WSAPOLLFD KT_POLLFD;
+    #define KT_POLL WSAPoll
 #else
     #include <sys/types.h>
     #include <sys/socket.h>
@@ -408,19 +629,25 @@ void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx);
     #include <netdb.h>
     #include <arpa/inet.h>
     #include <sys/select.h>
+    #include <poll.h>
     #include <sys/ioctl.h>
     #include <net/if.h>
     #include <ifaddrs.h>
     #ifdef __linux__
         #include <linux/errqueue.h>
+        #include <linux/net_tstamp.h>
         #include <sys/uio.h>
         #include <sys/time.h>
         #include <netinet/ip_icmp.h>
+        #include <netinet/icmp6.h>
+        #include <sys/syscall.h>
     #endif
     typedef int socket_t;
     #define CLOSE_SOCKET close
     #define IS_VALID_SOCKET(s) ((s) >= 0)
     #define INVALID_SOCKET -1
+    typedef struct pollfd KT_POLLFD;
+    #define KT_POLL poll
 #endif
 
 #ifdef _WIN32
@@ -493,48 +720,60 @@ static const KTermProtocolDef kterm_protocols[] = {
     { 0,     0,    NULL,        NULL,                                         NULL,      NULL,         false, false, false, false, false, false, false, false, NULL, NULL }
 };
 
-static const KTermProtocolDef* KTerm_Net_IdentifyProtocol(uint16_t port, bool is_udp) {
-    const KTermProtocolDef* best_match = NULL;
+// One-time initialisation shared by worker threads
+#ifndef _WIN32
+typedef pthread_once_t KTermNetOnce;
+#define KTERM_NET_ONCE_INIT PTHREAD_ONCE_INIT
+static void KTerm_Net_RunOnce(KTermNetOnce* once, void (*fn)(void)) { pthread_once(once, fn); }
+#else
+typedef INIT_ONCE KTermNetOnce;
+#define KTERM_NET_ONCE_INIT INIT_ONCE_STATIC_INIT
+static BOOL CALLBACK KTerm_Net_OnceThunk(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+    (void)once; (void)ctx;
+    ((void (*)(void))param)();
+    return TRUE;
+}
+static void KTerm_Net_RunOnce(KTermNetOnce* once, void (*fn)(void)) { InitOnceExecuteOnce(once, KTerm_Net_OnceThunk, (PVOID)fn, NULL); }
+#endif
 
-    for (int i = 0; kterm_protocols[i].short_name != NULL; i++) {
-        // Range check
-        bool match = false;
-        if (kterm_protocols[i].port_end > 0) {
-            if (port >= kterm_protocols[i].port_start && port <= kterm_protocols[i].port_end) match = true;
-        } else {
-            if (port == kterm_protocols[i].port_start) match = true;
-        }
-
-        if (match) {
-            // Found a match. Prioritize exact matches over ranges.
-            if (kterm_protocols[i].port_end == 0) {
-                // Exact match found. Check if transport matches strictly if needed, but for now we return first exact.
-                // Optionally, we could prefer is_udp match if multiple exacts exist (e.g. Kerberos).
-                if (!best_match || best_match->port_end > 0) {
-                    best_match = &kterm_protocols[i];
-                } else if (kterm_protocols[i].is_udp_preferred == is_udp) {
-                    // Both exact, prefer matching transport
-                    // Only overwrite if previous match did NOT match transport preference
-                    if (best_match->is_udp_preferred != is_udp) {
-                        best_match = &kterm_protocols[i];
-                    }
-                }
-            } else {
-                // Range match. Keep looking for exact match.
-                if (!best_match) {
-                    best_match = &kterm_protocols[i];
-                } else if (best_match->port_end > 0) {
-                    // Both are ranges. Prefer the smaller range (more specific).
-                    int curr_len = best_match->port_end - best_match->port_start;
-                    int new_len = kterm_protocols[i].port_end - kterm_protocols[i].port_start;
-                    if (new_len < curr_len) {
-                         best_match = &kterm_protocols[i];
-                    }
-                }
+// Port -> kterm_protocols[] row + 1, per transport preference ([0] TCP, [1] UDP). 0 = unknown.
+static uint8_t kterm_protocol_index[2][65536];
+static KTermNetOnce kterm_protocol_index_once = KTERM_NET_ONCE_INIT;
+
+static void KTerm_Net_BuildProtocolIndex(void) {
+    _Static_assert(sizeof(kterm_protocols) / sizeof(kterm_protocols[0]) < 256, "kterm_protocol_index stores rows in a uint8_t");
+    for (int t = 0; t < 2; t++) {
+        bool is_udp = (t == 1);
+        uint8_t* idx = kterm_protocol_index[t];
+
+        // Ranges first; where ranges overlap the smaller (more specific) one wins
+        for (int i = 0; kterm_protocols[i].short_name != NULL; i++) {
+            const KTermProtocolDef* p = &kterm_protocols[i];
+            if (p->port_end == 0) continue;
+            int len = p->port_end - p->port_start;
+            for (uint32_t port = p->port_start; port <= p->port_end; port++) {
+                const KTermProtocolDef* cur = idx[port] ? &kterm_protocols[idx[port] - 1] : NULL;
+                if (!cur || len < cur->port_end - cur->port_start) idx[port] = (uint8_t)(i + 1);
+            }
+        }
+
+        // Exact ports override ranges. Among duplicates a row matching the transport preference
+        // beats one that doesn't; otherwise the later row wins (e.g. SSH over SFTP/SCP on 22).
+        for (int i = 0; kterm_protocols[i].short_name != NULL; i++) {
+            const KTermProtocolDef* p = &kterm_protocols[i];
+            if (p->port_end > 0) continue;
+            const KTermProtocolDef* cur = idx[p->port_start] ? &kterm_protocols[idx[p->port_start] - 1] : NULL;
+            if (!cur || cur->port_end > 0 || p->is_udp_preferred == is_udp || cur->is_udp_preferred != is_udp) {
+                idx[p->port_start] = (uint8_t)(i + 1);
             }
         }
     }
-    return best_match;
+}
+
+static const KTermProtocolDef* KTerm_Net_IdentifyProtocol(uint16_t port, bool is_udp) {
+    KTerm_Net_RunOnce(&kterm_protocol_index_once, KTerm_Net_BuildProtocolIndex);
+    uint8_t row = kterm_protocol_index[is_udp ? 1 : 0][port];
+    return row ? &kterm_protocols[row - 1] : NULL;
 }
 
 #ifndef KTERM_DISABLE_VOICE
@@ -639,6 +878,7 @@ typedef struct {
     struct KTermFragTestContext* frag_test;
     struct KTermPingExtContext* ping_ext;
     struct KTermPacketDiagContext* packetdiag;
+    struct KTermMetricsStore* metrics; // Allocated on the first sample
 
     int target_session_index;
 
@@ -647,18 +887,37 @@ typedef struct {
     int retry_count;
     char last_error[256];
 
+    // Async DNS (RESOLVING state)
+    uint32_t dns_req_id;
+    int dns_state; // 0=IDLE, 1=PENDING, 2=RESOLVED, 3=FAILED
+    struct sockaddr_storage resolved_addr;
+    socklen_t resolved_len;
+    char dns_error[64];
+
 } KTermNetSession;
 
+typedef struct {
+    uint32_t probe_id; // ICMP engine probe, 0 = not in flight
+    int status;        // 0=PENDING, 1=REPLY, 2=TIMEOUT
+    bool reached;
+    double rtt_ms;
+    char ip[64];
+} KTermTraceHop;
+
 typedef struct KTermTracerouteContext {
-    int state; // 0=IDLE, 1=RESOLVE, 2=SEND, 3=WAIT, 4=DONE
+    int state; // 0=IDLE, 1=RESOLVE, 2=SEND, 3=WAIT, 4=DONE, 5=WAIT_LOOP
     char host[256];
     struct sockaddr_in dest_addr;
+    uint32_t dns_req_id;
     int current_ttl;
     int max_hops;
-    int current_probe;
     int timeout_ms;
 
-    socket_t sockfd;
+    // One probe per hop is in flight for the whole round; results are reported in hop order.
+    KTermTraceHop* hops;
+    int next_report;  // Next hop to report (1-based)
+    int reached_hop;  // Lowest hop that answered from the destination, 0 = none yet
+
     struct timeval probe_start_time;
 
     KTermTracerouteCallback callback;
@@ -693,8 +952,7 @@ typedef struct KTermResponseTimeContext {
     struct timeval probe_start_time;
     struct timeval last_complete_time;
 
-    socket_t sockfd;
-    bool is_raw;
+    uint32_t probe_id; // ICMP engine probe in flight
 
     KTermResponseTimeCallback callback;
     void* user_data;
@@ -708,19 +966,46 @@ typedef struct KTermResponseTimeContext {
 #endif
 } KTermResponseTimeContext;
 
+#ifndef KTERM_NET_PORTSCAN_WINDOW
+#define KTERM_NET_PORTSCAN_WINDOW 256
+#endif
+#define KTERM_NET_PORTSCAN_MAX_WINDOW 1024
+#ifndef KTERM_NET_PORTSCAN_SOCKET_RETRIES
+#define KTERM_NET_PORTSCAN_SOCKET_RETRIES 50 // Ticks a port waits for a descriptor before it is reported as ERROR
+#endif
+
+typedef struct {
+    socket_t fd;
+    int port;
+    double start_time;
+} PortScanProbe;
+
 typedef struct KTermPortScanContext {
-    int state; // 0=IDLE, 1=CONNECTING, 2=NEXT
+    int state; // 0=IDLE, 1=SCANNING, 2=DONE, 3=RESOLVE
     char host[256];
+    uint32_t dns_req_id;
     char ports_str[256];
-    int current_port;
     int timeout_ms;
 
-    // Parser state for ports_str
+    // Parser state for ports_str ("a,b,c-d")
     char* ports_ptr;
-    char* ports_next;
+    int range_next;
+    int range_end;
+    int retry_port;    // Port whose socket() failed, launched again before the parser moves on
+    int retry_count;
 
-    socket_t sockfd;
-    struct timeval start_time;
+    // In-flight window (completion order)
+    PortScanProbe* probes;
+    int window;
+    int in_flight;
+
+    // Per-target rate limit (token bucket, connects/sec)
+    int rate_per_sec;
+    double tokens;
+    double last_refill;
+
+    int scanned;
+    int open_count;
     struct sockaddr_in dest_addr;
 
     KTermPortScanCallback callback;
@@ -730,8 +1015,9 @@ typedef struct KTermPortScanContext {
 } KTermPortScanContext;
 
 typedef struct KTermWhoisContext {
-    int state; // 0=IDLE, 1=CONNECTING, 2=SENDING, 3=RECEIVING, 4=DONE
+    int state; // 0=IDLE, 1=CONNECTING, 2=SENDING, 3=RECEIVING, 4=DONE, 5=RESOLVE
     char host[256];
+    uint32_t dns_req_id;
     char query[256];
     socket_t sockfd;
     struct sockaddr_in dest_addr;
@@ -746,10 +1032,27 @@ typedef struct KTermWhoisContext {
     bool free_user_data;
 } KTermWhoisContext;
 
+struct KTermSpeedtestContext;
+
 typedef struct {
     socket_t fd;
     bool connected;
-    uint64_t bytes;
+    _Atomic uint64_t bytes; // Written by the stream worker in threaded mode
+
+    // Threaded mode
+    struct KTermSpeedtestContext* owner;
+    bool upload;
+    bool worker_started;
+    atomic_bool worker_done;
+#ifndef _WIN32
+    pthread_t thread;
+#else
+    HANDLE thread;
+#endif
+    // Kernel RX timestamps (seconds); only read after the worker is joined
+    double ts_first;
+    double ts_last;
+    uint64_t ts_bytes; // Bytes received after ts_first
 } SpeedtestStream;
 
 #define MAX_ST_STREAMS 8
@@ -778,6 +1081,8 @@ typedef struct KTermSpeedtestContext {
     double dl_mbps;
     double ul_mbps;
     double jitter_ms;
+    uint64_t dl_bytes;
+    bool kernel_timed;
 
     bool latency_started;
     bool latency_done;
@@ -785,42 +1090,102 @@ typedef struct KTermSpeedtestContext {
     bool ul_initiated;
     bool auto_initiated;
 
+    // Threaded mode (KTermSpeedtestOptions)
+    bool threaded;
+    int sock_buf_bytes;
+    int chunk_bytes;
+    double report_interval;
+    bool kernel_timestamps;
+    bool workers_running;
+    atomic_bool stop_workers;
+    double last_report;
+
     KTermSpeedtestCallback callback;
     void* user_data;
     char req_tag[64];
     bool free_user_data;
 } KTermSpeedtestContext;
 
-typedef struct KTermHttpProbeContext {
-    int state; // 0=IDLE, 1=RESOLVE, 2=CONNECT, 3=SEND, 4=WAIT_HEAD, 5=READ_BODY, 6=DONE
+#ifndef KTERM_NET_HTTP_POOL_SIZE
+#define KTERM_NET_HTTP_POOL_SIZE 32
+#endif
+#define KTERM_NET_HTTP_PIPELINE_MAX 16
+#ifndef KTERM_NET_HTTP_IDLE_SEC
+#define KTERM_NET_HTTP_IDLE_SEC 30.0
+#endif
+
+typedef struct {
+    int state; // 0=QUEUED, 1=ASSIGNED, 2=DONE
     char host[256];
     int port;
     char path[1024];
-    struct sockaddr_in dest_addr;
-    socket_t sockfd;
-
+    int batch_id;
+    int batch_index;
+    int retries;
+    bool no_pipeline; // Must run alone on its connection (server broke a pipeline)
+    bool reused;
+    bool pipelined;
     double start_time;
-    double dns_start_time;
-    double connect_start_time;
-    double request_start_time;
-    double first_byte_time;
-
-    // Metrics
-    double dns_ms;
-    double connect_ms;
-    double ttfb_ms;
-
-    char buffer[8192];
-    int buffer_len;
-
-    int status_code;
-    uint64_t size_bytes;
-    uint64_t content_length; // For keep-alive support
+    double sent_time;
 
     KTermHttpProbeCallback callback;
     void* user_data;
     char req_tag[64];
-    bool free_user_data;
+} KTermHttpRequest;
+
+typedef struct {
+    int state; // 0=FREE, 1=RESOLVE, 2=CONNECT, 3=IDLE, 4=ACTIVE, 5=FAILED
+    char host[256];
+    int port;
+    socket_t fd;
+    uint32_t dns_req_id;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+
+    double open_time;
+    double connect_start;
+    double dns_ms;
+    double connect_ms;
+    double idle_since;
+    double last_activity;
+    double head_ready; // When the head-of-line response became due
+    int served;
+    bool close_after;
+    bool no_pipeline;
+
+    // Requests in send order; pipe[0] is the response being read
+    int pipe[KTERM_NET_HTTP_PIPELINE_MAX];
+    int pipe_count;
+    int sent_count;
+    char out[4096];
+    int out_len;
+    int out_off;
+
+    // Response framer
+    int pstate; // 0=HEAD, 1=LENGTH, 2=CHUNK_SIZE, 3=CHUNK_DATA, 4=CHUNK_CRLF, 5=TRAILER, 6=UNTIL_CLOSE
+    char hdr[8192];
+    int hdr_len;
+    char line[32];
+    int line_len;
+    int status;
+    uint64_t remaining;
+    uint64_t resp_bytes;
+    double resp_first;
+} KTermHttpConn;
+
+typedef struct KTermHttpProbeContext {
+    KTermHttpRequest* reqs;
+    int req_count;
+    int req_cap;
+    int pending;
+    int first_queued;
+    int next_batch_id;
+
+    int max_connections;
+    int per_host;
+    int pipeline_depth;
+
+    KTermHttpConn pool[KTERM_NET_HTTP_POOL_SIZE];
 } KTermHttpProbeContext;
 
 typedef struct KTermMtuProbeContext {
@@ -881,8 +1246,7 @@ typedef struct KTermPingExtContext {
     int state;
     char host[256];
     struct sockaddr_in dest_addr;
-    socket_t sockfd;
-    bool is_raw;
+    uint32_t probe_id; // ICMP engine probe in flight
 
     int count;
     int interval_ms;
@@ -924,27 +1288,46 @@ typedef struct KTermPingExtContext {
 #endif
 } KTermPingExtContext;
 
+#ifndef KTERM_PACKETDIAG_SLOT_BYTES
+#define KTERM_PACKETDIAG_SLOT_BYTES 1536 // Full 1500-byte MTU plus link headers and two VLAN tags
+#endif
+
 typedef struct {
     struct timeval ts;
     int len;
-    uint8_t data[1500];
+    uint8_t data[KTERM_PACKETDIAG_SLOT_BYTES];
+    uint32_t wire_len; // Original length on the wire (len is the captured part)
+    uint64_t id;       // Capture sequence number (packet_id for GetDetail)
 } CapturedPacket;
 
 typedef struct {
-    uint32_t src_ip;
-    uint32_t dst_ip;
+    uint8_t src_ip[16]; // Network order; IPv4 uses the first 4 bytes
+    uint8_t dst_ip[16];
     uint16_t src_port;
     uint16_t dst_port;
     uint8_t proto;
+    uint8_t family; // 4 or 6
 } PacketDiagFlowKey;
 
-typedef struct {
+// Out-of-order TCP data waiting for the hole before it to fill. `span` is the sequence space
+// the segment covers; only the first `len` bytes were captured when the snaplen cut it short.
+typedef struct PacketDiagSegment {
+    struct PacketDiagSegment* next;
     uint32_t seq;
-    uint32_t ack;
-    uint32_t last_ts;
-    // Buffer for reassembly
-    char buffer[4096];
-    int buf_len;
+    uint32_t span;
+    uint32_t len;
+    uint8_t data[];
+} PacketDiagSegment;
+
+// Reassembler for one direction of a TCP connection (flows are directional). Bytes are handed on
+// in sequence order; segments past a hole wait in `ooo`, sorted and non-overlapping.
+typedef struct {
+    bool synced;            // next_seq is known (SYN or first segment seen)
+    uint32_t next_seq;      // Next byte expected
+    uint64_t offset;        // Bytes handed on so far, holes included
+    PacketDiagSegment* ooo;
+    uint32_t ooo_bytes;     // Captured bytes queued in `ooo`
+    uint8_t auth_state;     // Auth automaton state after the data handed on, for signatures split across segments
 } PacketDiagStream;
 
 typedef struct {
@@ -959,12 +1342,20 @@ typedef struct {
     uint32_t ssrc;
 } PacketDiagFlowStats;
 
+#define KTERM_PACKETDIAG_FLOW_RATE_SEC 10    // Per-flow throughput history: 30 x 10 s of packet time
+#define KTERM_PACKETDIAG_FLOW_RATE_SLOTS 30
+
 typedef struct PacketDiagFlow {
     PacketDiagFlowKey key;
-    PacketDiagStream stream;
+    PacketDiagStream* stream; // TCP reassembly while auth is being scanned for, or while followed
+    bool stream_done;         // Past KTERM_PACKETDIAG_STREAM_SCAN: segments are scanned one by one
     PacketDiagFlowStats stats;
-    struct PacketDiagFlow* next; // Chaining for hash collisions
-    uint32_t id; // Unique ID for referencing
+    uint32_t id; // Unique ID for referencing, 0 = free pool record
+    uint32_t hash; // Low bits of the keyed hash (home slot)
+    uint32_t lru_prev, lru_next; // Pool indices, KTERM_PACKETDIAG_NIL terminated
+    double last_seen; // Packet time
+    uint32_t rate_period; // Packet time / KTERM_PACKETDIAG_FLOW_RATE_SEC of the newest slot
+    uint32_t rate_bytes[KTERM_PACKETDIAG_FLOW_RATE_SLOTS];
 
     // Auth Tracking
     bool auth_detected;
@@ -973,6 +1364,144 @@ typedef struct PacketDiagFlow {
     bool auth_risk;
 } PacketDiagFlow;
 
+#ifndef KTERM_PACKETDIAG_MAX_WORKERS
+#define KTERM_PACKETDIAG_MAX_WORKERS 8
+#endif
+#ifndef KTERM_PACKETDIAG_RING_SLOTS
+#define KTERM_PACKETDIAG_RING_SLOTS 2048 // Per worker, power of two
+#endif
+#ifndef KTERM_PACKETDIAG_DEFAULT_FLOWS
+#define KTERM_PACKETDIAG_DEFAULT_FLOWS 65536 // Total across workers, flows=N overrides
+#endif
+#define KTERM_PACKETDIAG_MAX_FLOWS (1u << 24)
+#define KTERM_PACKETDIAG_FLOW_IDLE_SEC 300   // flow_idle=N overrides, 0 = never
+#define KTERM_PACKETDIAG_HISTORY 128     // Recent packets kept per worker for GetDetail
+#define KTERM_PACKETDIAG_EVENT_SLOTS 1024 // Per worker event ring, power of two
+#ifndef KTERM_PACKETDIAG_LINES_PER_SEC
+#define KTERM_PACKETDIAG_LINES_PER_SEC 50 // Rendered packet lines, lines=N overrides
+#endif
+#define KTERM_PACKETDIAG_NIL 0xFFFFFFFFu
+#define KTERM_PACKETDIAG_RECORD_BYTES (1u << 22) // Record ring, power of two
+#define KTERM_PACKETDIAG_RECORD_CHUNK (1u << 20) // Bytes per write(), multiple of 4096 for O_DIRECT
+#define KTERM_PACKETDIAG_REASM_SLOTS 8       // Datagrams being reassembled per worker
+#define KTERM_PACKETDIAG_REASM_TIMEOUT 30.0  // Seconds of packet time
+#ifndef KTERM_PACKETDIAG_STREAM_MEM
+#define KTERM_PACKETDIAG_STREAM_MEM (64u << 20) // Out-of-order TCP bytes queued in total, stream_mem=MB overrides
+#endif
+#define KTERM_PACKETDIAG_STREAM_FLOW_BYTES (256u << 10) // Out-of-order TCP bytes queued per direction
+#define KTERM_PACKETDIAG_STREAM_SCAN (64u << 10) // Leading stream bytes reassembled for the auth scanner
+// snaplen=auto: two VLAN tags, IPv6 plus extension headers, a full TCP header and the
+// leading payload bytes the application decoders and auth scanner look at
+#define KTERM_PACKETDIAG_AUTO_SNAPLEN (14 + 8 + 40 + 64 + 60 + 192)
+#ifndef KTERM_PACKETDIAG_TPACKET_BLOCK
+#define KTERM_PACKETDIAG_TPACKET_BLOCK (1u << 20) // TPACKET_V3 block, power of two
+#endif
+#ifndef KTERM_PACKETDIAG_TPACKET_BLOCKS
+#define KTERM_PACKETDIAG_TPACKET_BLOCKS 16
+#endif
+#define KTERM_PACKETDIAG_BPF_MAX 512 // Instructions the filter compiler may emit
+#ifndef KTERM_PACKETDIAG_DEFAULT_TPACKET
+#define KTERM_PACKETDIAG_DEFAULT_TPACKET 1 // With KTERM_PACKETDIAG_TPACKET: native unless backend=pcap
+#endif
+
+// Link layer of the capture, from pcap_datalink(). Ethernet is the zero value.
+typedef enum {
+    PACKETDIAG_LINK_ETHERNET = 0,
+    PACKETDIAG_LINK_SLL,   // Linux cooked capture v1 ("any" device)
+    PACKETDIAG_LINK_SLL2,  // Linux cooked capture v2
+    PACKETDIAG_LINK_RAW,   // Bare IPv4/IPv6
+    PACKETDIAG_LINK_NULL   // BSD loopback (4-byte family)
+} PacketDiagLinkType;
+
+// IPv4/IPv6 fragment reassembly. Only fragmented datagrams are copied; everything else is
+// dissected in place in the captured buffer.
+typedef struct {
+    bool active;
+    uint8_t family;
+    uint8_t proto;
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint32_t id;
+    double first_seen;
+    int total_len;   // -1 until the last fragment arrives
+    uint32_t blocks; // 8-byte blocks received
+    uint8_t* data;   // 64 KB, allocated on first use
+    uint8_t map[1024]; // One bit per 8-byte block
+} PacketDiagReasm;
+
+// Open-addressing flow table (linear probing, backward-shift deletion) over a fixed record pool.
+// Records are bump-allocated, recycled through `free_head` and kept on an LRU list for eviction.
+typedef struct {
+    PacketDiagFlow* pool;
+    uint32_t* slots;     // Pool index + 1, 0 = empty
+    uint32_t slot_mask;
+    uint32_t capacity;   // Pool records
+    uint32_t used;       // High-water mark of the pool
+    uint32_t count;
+    uint32_t free_head;
+    uint32_t lru_head;   // Most recently seen
+    uint32_t lru_tail;   // Eviction candidate
+    uint64_t evicted;
+} PacketDiagFlowTable;
+
+typedef struct {
+    uint64_t total_packets;
+    uint64_t total_bytes;
+    uint64_t tcp_packets;
+    uint64_t udp_packets;
+    uint64_t icmp_packets;
+    uint64_t other_packets;
+    uint64_t stream_gaps;   // Holes the TCP reassembler skipped
+} PacketDiagStats;
+
+// One dissector worker. The capture thread is the only producer of `ring` and the worker its only
+// consumer; the worker is the only producer of `events` and KTerm_Net_ProcessPacketDiag its consumer.
+// `mutex` only guards the flows/history/stats against readers on the UI thread.
+typedef struct PacketDiagShard {
+    struct KTermPacketDiagContext* ctx;
+    CapturedPacket* ring;
+    _Atomic uint32_t ring_head;
+    _Atomic uint32_t ring_tail;
+    _Atomic uint64_t dropped; // Ring full: packet discarded on the capture thread
+
+    KTermPacketDiagEvent events[KTERM_PACKETDIAG_EVENT_SLOTS];
+    _Atomic uint32_t ev_head;
+    _Atomic uint32_t ev_tail;
+    _Atomic uint64_t ev_dropped; // Events discarded because the UI fell behind
+
+#ifndef _WIN32
+    pthread_t thread;
+    pthread_mutex_t mutex;
+#else
+    HANDLE thread;
+    CRITICAL_SECTION mutex;
+#endif
+    atomic_bool stop;
+
+    PacketDiagFlowTable flows; // Flows whose addresses hash to this worker
+    PacketDiagReasm reasm[KTERM_PACKETDIAG_REASM_SLOTS]; // Worker-private
+    CapturedPacket history[KTERM_PACKETDIAG_HISTORY];
+    uint64_t history_count;
+    PacketDiagStats stats;
+    double last_ts; // Packet time of the newest packet dissected
+} PacketDiagShard;
+
+// Offline reader for classic pcap (usec/nsec, either byte order) and PCAP-NG.
+#define KTERM_PACKETDIAG_REPLAY_IFACES 16
+
+typedef struct {
+    FILE* f;
+    bool pcapng;
+    bool swap;                 // File byte order differs from ours
+    bool nsec;                 // Classic pcap with nanosecond stamps
+    int dlt;                   // Link type of the first interface
+    int if_count;
+    uint64_t if_units[KTERM_PACKETDIAG_REPLAY_IFACES]; // PCAP-NG timestamp units per second
+    struct timeval last_ts;    // Simple Packet Blocks carry no timestamp
+    uint8_t* buf;
+    size_t buf_size;
+} PacketDiagReplayReader;
+
 typedef struct KTermPacketDiagContext {
     void* pcap_handle; // void* to avoid pcap dependency in header if possible, but we included pcap.h in impl
     // Actually this struct is in IMPLEMENTATION block, so we can use pcap_t if included
@@ -987,18 +1516,20 @@ typedef struct KTermPacketDiagContext {
     int promisc;
     int count;
     int timeout_ms;
+    int link_type; // PacketDiagLinkType
 
     // Control
     bool paused;
-    bool trigger_mtu_probe;
+    atomic_bool trigger_mtu_probe;
     char last_frag_ip[64];
 
     // Stats
     int captured_count;
     int error_count;
-    bool running;
+    atomic_bool running; // Cleared by the capture thread when pcap_loop returns
 
-    // Threading
+    // Threading: one capture thread feeding worker_count dissector workers.
+    // worker_count == 0 dissects inline on the capture thread using shards[0] and `mutex`.
 #ifndef _WIN32
     pthread_t thread;
     pthread_mutex_t mutex;
@@ -1006,30 +1537,76 @@ typedef struct KTermPacketDiagContext {
     HANDLE thread;
     CRITICAL_SECTION mutex;
 #endif
+    bool thread_started;
+    int worker_count;
+    PacketDiagShard shards[KTERM_PACKETDIAG_MAX_WORKERS];
 
-    // Output Ring Buffer (Text)
+    // Output Ring Buffer (Text, control messages)
     char out_buf[65536];
     int buf_head;
     int buf_tail;
 
-    // Packet Ring Buffer (Raw)
-    CapturedPacket packet_ring[128];
-    int ring_head;
-    int ring_count; // Total packets processed (redundant with captured_count but used for relative index)
-
-    // Flow Tracking & Stats
-    struct PacketDiagFlow* flow_table[256]; // Hash table
-    uint32_t next_flow_id;
-    uint32_t follow_flow_id; // 0 = None
-
-    struct {
-        uint64_t total_packets;
-        uint64_t total_bytes;
-        uint64_t tcp_packets;
-        uint64_t udp_packets;
-        uint64_t icmp_packets;
-        uint64_t other_packets;
-    } stats;
+    // Flow Tracking
+    _Atomic uint32_t next_flow_id;
+    _Atomic uint32_t follow_flow_id; // 0 = None
+    _Atomic uint32_t follow_peer_id; // Reverse direction of the followed flow, once seen
+    KTermPacketDiagStreamCallback follow_cb; // Follow sinks, changed only with every shard locked
+    void* follow_user;
+    FILE* follow_file;
+    _Atomic uint64_t stream_mem; // Out-of-order TCP bytes queued across workers
+    uint64_t stream_mem_max;
+    uint32_t flow_capacity; // 0 = KTERM_PACKETDIAG_DEFAULT_FLOWS
+    int flow_idle_sec;
+    uint64_t flow_hash_key[2]; // SipHash key, random per capture
+
+    // Recording (record=path): the capture thread appends PCAP-NG blocks to `record_ring`,
+    // a writer thread flushes them to disk in KTERM_PACKETDIAG_RECORD_CHUNK writes.
+    char record_path[256];
+    int record_fd;            // -1 when not recording
+    bool record_direct;       // O_DIRECT (record_direct=1, Linux)
+    int dlt;                  // pcap link type written to the Interface Description Block
+    uint8_t* record_ring;     // KTERM_PACKETDIAG_RECORD_BYTES
+    _Atomic uint64_t record_head;
+    _Atomic uint64_t record_tail;
+    _Atomic uint64_t record_packets;
+    _Atomic uint64_t record_dropped;
+    atomic_bool record_stop;
+    atomic_bool record_failed;
+#ifndef _WIN32
+    pthread_t record_thread;
+#else
+    HANDLE record_thread;
+#endif
+    bool record_started;
+
+    // Offline replay (file=path): a reader thread stands in for pcap_loop
+    char replay_path[256];
+    bool offline;
+    PacketDiagReplayReader replay;
+    atomic_bool replay_done;
+    double replay_seconds;    // Wall time to read the file
+
+    // Native capture (backend=tpacket): the kernel fills `tp_map` a block at a time
+    bool tpacket;             // Backend in use, otherwise libpcap
+    int tp_fd;                // -1 when not open
+    uint8_t* tp_map;
+    size_t tp_map_len;
+    uint32_t tp_block_nr;
+    bool tp_loopback;         // Skip our own outgoing copies on lo, as libpcap does
+    uint64_t tp_drops;        // Kernel ring overflows so far
+
+    // Renderer (UI thread only): a token bucket of `lines_per_sec`, at most one screen per pass.
+    // Events over budget are only counted and reported once a second as a per-protocol summary.
+    bool render;              // render=0 leaves events for KTerm_Net_PacketDiag_PollEvents
+    int lines_per_sec;
+    double line_tokens;
+    double render_last;       // Wall time of the last refill
+    double summary_start;     // Wall time the summary window opened
+    uint64_t window_events;
+    uint64_t window_shown;
+    uint64_t window_lost_base; // Sum of shard ev_dropped when the window opened
+    uint32_t window_l4[4];    // TCP, UDP, ICMP, other
+    uint32_t window_proto[sizeof(kterm_protocols) / sizeof(kterm_protocols[0])];
 
     // Target
     KTerm* term;
@@ -1037,144 +1614,1754 @@ typedef struct KTermPacketDiagContext {
 
 } KTermPacketDiagContext;
 
-// --- Helper Functions ---
-
-static KTermNetSession* KTerm_Net_GetContext(KTermSession* session) {
-    if (!session) return NULL;
-    return (KTermNetSession*)session->user_data;
-}
-
-static KTermNetSession* KTerm_Net_CreateContext(KTermSession* session) {
-    if (!session) return NULL;
-    if (session->user_data) return (KTermNetSession*)session->user_data;
-
-    KTermNetSession* net = (KTermNetSession*)malloc(sizeof(KTermNetSession));
-    if (net) {
-        memset(net, 0, sizeof(KTermNetSession));
-        net->socket_fd = INVALID_SOCKET;
-        net->listener_fd = INVALID_SOCKET;
-#ifdef KTERM_USE_LIBSSH
-        net->ssh_session = NULL;
-        net->ssh_channel = NULL;
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+static void PacketDiag_TPacketClose(KTermPacketDiagContext* ctx);
 #endif
-        net->target_session_index = -1;
-        net->max_retries = 3; // Default
-        net->retry_delay_ms = 1000;
-        session->user_data = net;
-    }
-    return net;
-}
 
-void KTerm_Net_FreeTraceroute(KTermTracerouteContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-#ifdef _WIN32
-    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
-    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+// Shard locks only serialize the UI thread's readers against one worker. Without workers the capture
+// thread dissects inline into shards[0] and the context mutex stands in (tests zero-init the shards).
+static void PacketDiag_LockShard(KTermPacketDiagContext* ctx, PacketDiagShard* sh) {
+#ifndef _WIN32
+    pthread_mutex_lock(ctx->worker_count > 0 ? &sh->mutex : &ctx->mutex);
+#else
+    EnterCriticalSection(ctx->worker_count > 0 ? &sh->mutex : &ctx->mutex);
 #endif
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
 }
 
-void KTerm_Net_FreeResponseTime(KTermResponseTimeContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-#ifdef _WIN32
-    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
-    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+static void PacketDiag_UnlockShard(KTermPacketDiagContext* ctx, PacketDiagShard* sh) {
+#ifndef _WIN32
+    pthread_mutex_unlock(ctx->worker_count > 0 ? &sh->mutex : &ctx->mutex);
+#else
+    LeaveCriticalSection(ctx->worker_count > 0 ? &sh->mutex : &ctx->mutex);
 #endif
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
 }
 
-void KTerm_Net_FreePortScan(KTermPortScanContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+static int PacketDiag_ShardCount(const KTermPacketDiagContext* ctx) {
+    return ctx->worker_count > 0 ? ctx->worker_count : 1;
 }
 
-void KTerm_Net_FreeWhois(KTermWhoisContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+// --- PacketDiag Flow Table ---
+
+// "1.2.3.4" or "[2001:db8::1]" so it can be followed by ":port"
+static void PacketDiag_FormatFlowAddr(const PacketDiagFlowKey* key, bool src, char* out, size_t max) {
+    const uint8_t* addr = src ? key->src_ip : key->dst_ip;
+    if (key->family == 6) {
+        char tmp[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, addr, tmp, sizeof(tmp));
+        snprintf(out, max, "[%s]", tmp);
+    } else {
+        inet_ntop(AF_INET, addr, out, (socklen_t)max);
+    }
 }
 
-void KTerm_Net_FreeSpeedtest(KTermSpeedtestContext* ctx) {
-    if (!ctx) return;
-    for(int i=0; i<ctx->num_streams; i++) {
-        if (IS_VALID_SOCKET(ctx->streams[i].fd)) CLOSE_SOCKET(ctx->streams[i].fd);
+// ctx may be NULL at teardown, when the shared byte count no longer matters
+static void PacketDiag_StreamFree(KTermPacketDiagContext* ctx, PacketDiagStream* s) {
+    if (!s) return;
+    while (s->ooo) {
+        PacketDiagSegment* seg = s->ooo;
+        s->ooo = seg->next;
+        free(seg);
     }
-    if (IS_VALID_SOCKET(ctx->config_fd)) CLOSE_SOCKET(ctx->config_fd);
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+    if (ctx && s->ooo_bytes) atomic_fetch_sub(&ctx->stream_mem, s->ooo_bytes);
+    free(s);
 }
 
-void KTerm_Net_FreeHttpProbe(KTermHttpProbeContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+static void PacketDiag_FlowTableFree(PacketDiagFlowTable* t) {
+    if (t->pool) {
+        for (uint32_t i = 0; i < t->used; i++) PacketDiag_StreamFree(NULL, t->pool[i].stream);
+    }
+    free(t->pool);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
 }
 
-void KTerm_Net_FreeMtuProbe(KTermMtuProbeContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-#ifdef _WIN32
-    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
-    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
-#endif
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+#ifdef KTERM_ENABLE_PACKETDIAG
+#define KT_SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+    v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+    v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+    v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+// SipHash-1-3, keyed so crafted traffic cannot force long probe chains.
+static uint64_t PacketDiag_SipHash(const uint64_t k[2], const uint8_t* in, size_t len) {
+    uint64_t v0 = k[0] ^ 0x736f6d6570736575ULL, v1 = k[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k[0] ^ 0x6c7967656e657261ULL, v3 = k[1] ^ 0x7465646279746573ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t m;
+        memcpy(&m, in + i, 8);
+        v3 ^= m; KT_SIPROUND(v0, v1, v2, v3); v0 ^= m;
+    }
+    uint64_t b = (uint64_t)len << 56;
+    for (size_t j = 0; i + j < len; j++) b |= (uint64_t)in[i + j] << (8 * j);
+    v3 ^= b; KT_SIPROUND(v0, v1, v2, v3); v0 ^= b;
+    v2 ^= 0xff;
+    KT_SIPROUND(v0, v1, v2, v3); KT_SIPROUND(v0, v1, v2, v3); KT_SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
 }
 
-void KTerm_Net_FreeFragTest(KTermFragTestContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-#ifdef _WIN32
-    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
-    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
-#endif
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+static uint64_t PacketDiag_FlowKeyHash(const uint64_t k[2], const PacketDiagFlowKey* key) {
+    return PacketDiag_SipHash(k, (const uint8_t*)key, sizeof(*key)); // No padding in the key
 }
 
-void KTerm_Net_FreePingExt(KTermPingExtContext* ctx) {
-    if (!ctx) return;
-    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-#ifdef _WIN32
-    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
-    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
-#endif
-    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
-    free(ctx);
+static bool PacketDiag_FlowKeyEqual(const PacketDiagFlowKey* a, const PacketDiagFlowKey* b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
 }
 
-void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx) {
-    if (!ctx) return;
-    if (ctx->running) {
-        // Should have been stopped, but just in case
-        ctx->running = false;
-        // Handle closing in Stop
+static bool PacketDiag_FlowTableInit(PacketDiagFlowTable* t, uint32_t capacity) {
+    uint32_t slots = 16;
+    while (slots < capacity * 2) slots <<= 1; // Load factor <= 0.5 keeps probes short
+    // calloc leaves untouched pages uncommitted; records are bump-allocated on demand
+    t->pool = (PacketDiagFlow*)calloc(capacity, sizeof(PacketDiagFlow));
+    t->slots = (uint32_t*)calloc(slots, sizeof(uint32_t));
+    if (!t->pool || !t->slots) {
+        free(t->pool); free(t->slots);
+        t->pool = NULL; t->slots = NULL;
+        return false;
     }
+    t->slot_mask = slots - 1;
+    t->capacity = capacity;
+    t->used = 0;
+    t->count = 0;
+    t->free_head = KTERM_PACKETDIAG_NIL;
+    t->lru_head = t->lru_tail = KTERM_PACKETDIAG_NIL;
+    return true;
+}
 
-    // Cleanup Flows
-    for (int i = 0; i < 256; i++) {
-        PacketDiagFlow* flow = ctx->flow_table[i];
-        while (flow) {
-            PacketDiagFlow* next = flow->next;
-            free(flow);
-            flow = next;
-        }
-        ctx->flow_table[i] = NULL;
+static PacketDiagFlow* PacketDiag_FlowLookup(PacketDiagFlowTable* t, const PacketDiagFlowKey* key, uint32_t hash) {
+    for (uint32_t i = hash & t->slot_mask; t->slots[i]; i = (i + 1) & t->slot_mask) {
+        PacketDiagFlow* f = &t->pool[t->slots[i] - 1];
+        if (f->hash == hash && PacketDiag_FlowKeyEqual(&f->key, key)) return f;
     }
+    return NULL;
+}
 
-    // Handle is closed in Stop
-    free(ctx);
+static void PacketDiag_FlowLruUnlink(PacketDiagFlowTable* t, uint32_t idx) {
+    PacketDiagFlow* f = &t->pool[idx];
+    if (f->lru_prev != KTERM_PACKETDIAG_NIL) t->pool[f->lru_prev].lru_next = f->lru_next;
+    else t->lru_head = f->lru_next;
+    if (f->lru_next != KTERM_PACKETDIAG_NIL) t->pool[f->lru_next].lru_prev = f->lru_prev;
+    else t->lru_tail = f->lru_prev;
 }
 
-static void KTerm_Net_DestroyContext(KTermSession* session) {
+static void PacketDiag_FlowLruPush(PacketDiagFlowTable* t, uint32_t idx) {
+    PacketDiagFlow* f = &t->pool[idx];
+    f->lru_prev = KTERM_PACKETDIAG_NIL;
+    f->lru_next = t->lru_head;
+    if (t->lru_head != KTERM_PACKETDIAG_NIL) t->pool[t->lru_head].lru_prev = idx;
+    t->lru_head = idx;
+    if (t->lru_tail == KTERM_PACKETDIAG_NIL) t->lru_tail = idx;
+}
+
+static void PacketDiag_FlowTouch(PacketDiagFlowTable* t, PacketDiagFlow* f) {
+    uint32_t idx = (uint32_t)(f - t->pool);
+    if (t->lru_head == idx) return;
+    PacketDiag_FlowLruUnlink(t, idx);
+    PacketDiag_FlowLruPush(t, idx);
+}
+
+static void PacketDiag_FlowEvict(KTermPacketDiagContext* ctx, PacketDiagFlowTable* t, uint32_t idx) {
+    PacketDiagFlow* f = &t->pool[idx];
+    uint32_t i = f->hash & t->slot_mask;
+    while (t->slots[i] != idx + 1) i = (i + 1) & t->slot_mask;
+
+    // Backward-shift deletion: pull later entries of the probe run into the hole
+    for (;;) {
+        t->slots[i] = 0;
+        uint32_t j = i;
+        for (;;) {
+            j = (j + 1) & t->slot_mask;
+            if (!t->slots[j]) goto removed;
+            uint32_t home = t->pool[t->slots[j] - 1].hash & t->slot_mask;
+            bool movable = (j > i) ? (home <= i || home > j) : (home <= i && home > j);
+            if (movable) break;
+        }
+        t->slots[i] = t->slots[j];
+        i = j;
+    }
+removed:
+    PacketDiag_FlowLruUnlink(t, idx);
+    PacketDiag_StreamFree(ctx, f->stream);
+    memset(f, 0, sizeof(*f));
+    f->lru_next = t->free_head;
+    t->free_head = idx;
+    t->count--;
+    t->evicted++;
+}
+
+// Drop flows idle for longer than flow_idle_sec (packet time). Bounded per call to keep
+// per-packet cost flat; the LRU tail is always the oldest flow.
+static void PacketDiag_FlowExpire(KTermPacketDiagContext* ctx, PacketDiagFlowTable* t, double now) {
+    if (ctx->flow_idle_sec <= 0) return;
+    for (int budget = 16; budget > 0 && t->lru_tail != KTERM_PACKETDIAG_NIL; budget--) {
+        if (now - t->pool[t->lru_tail].last_seen <= ctx->flow_idle_sec) break;
+        PacketDiag_FlowEvict(ctx, t, t->lru_tail);
+    }
+}
+
+static PacketDiagFlow* PacketDiag_FlowInsert(KTermPacketDiagContext* ctx, PacketDiagFlowTable* t, const PacketDiagFlowKey* key, uint32_t hash) {
+    if (t->count >= t->capacity) PacketDiag_FlowEvict(ctx, t, t->lru_tail); // Full: recycle least recently seen
+
+    uint32_t idx;
+    if (t->free_head != KTERM_PACKETDIAG_NIL) {
+        idx = t->free_head;
+        t->free_head = t->pool[idx].lru_next;
+    } else {
+        idx = t->used++;
+    }
+
+    PacketDiagFlow* f = &t->pool[idx];
+    memset(f, 0, sizeof(*f));
+    f->key = *key;
+    f->hash = hash;
+    do {
+        f->id = atomic_fetch_add(&ctx->next_flow_id, 1) + 1;
+    } while (f->id == 0);
+
+    uint32_t i = hash & t->slot_mask;
+    while (t->slots[i]) i = (i + 1) & t->slot_mask;
+    t->slots[i] = idx + 1;
+    PacketDiag_FlowLruPush(t, idx);
+    t->count++;
+    return f;
+}
+
+static uint32_t PacketDiag_ShardFlowCapacity(const KTermPacketDiagContext* ctx) {
+    uint32_t total = ctx->flow_capacity ? ctx->flow_capacity : KTERM_PACKETDIAG_DEFAULT_FLOWS;
+    uint32_t per = total / (uint32_t)PacketDiag_ShardCount(ctx);
+    return per < 64 ? 64 : per;
+}
+
+// Per-flow byte counts in KTERM_PACKETDIAG_FLOW_RATE_SEC slots of packet time
+static void PacketDiag_FlowRateAdd(PacketDiagFlow* f, double now, uint32_t bytes) {
+    uint32_t period = (uint32_t)(now / KTERM_PACKETDIAG_FLOW_RATE_SEC);
+    if (period > f->rate_period) {
+        uint32_t gap = period - f->rate_period;
+        if (f->rate_period == 0 || gap >= KTERM_PACKETDIAG_FLOW_RATE_SLOTS) {
+            memset(f->rate_bytes, 0, sizeof(f->rate_bytes));
+        } else {
+            for (uint32_t p = f->rate_period + 1; p <= period; p++) f->rate_bytes[p % KTERM_PACKETDIAG_FLOW_RATE_SLOTS] = 0;
+        }
+        f->rate_period = period;
+    } else if (f->rate_period - period >= KTERM_PACKETDIAG_FLOW_RATE_SLOTS) {
+        return; // Older than the ring
+    }
+    uint32_t* slot = &f->rate_bytes[period % KTERM_PACKETDIAG_FLOW_RATE_SLOTS];
+    *slot = (*slot > UINT32_MAX - bytes) ? UINT32_MAX : *slot + bytes;
+}
+#endif // KTERM_ENABLE_PACKETDIAG
+
+// --- Async DNS Resolver ---
+
+#ifndef KTERM_NET_DNS_WORKERS
+#define KTERM_NET_DNS_WORKERS 2
+#endif
+#ifndef KTERM_NET_DNS_CACHE_SIZE
+#define KTERM_NET_DNS_CACHE_SIZE 128
+#endif
+#ifndef KTERM_NET_DNS_MAX_PENDING
+#define KTERM_NET_DNS_MAX_PENDING 64
+#endif
+#define KTERM_NET_DNS_DEFAULT_TTL 60   // getaddrinfo does not expose TTLs
+#define KTERM_NET_DNS_NEGATIVE_TTL 5
+#define KTERM_NET_DNS_TIMEOUT_MS 2000
+#define KTERM_NET_DNS_RETRIES 2
+
+typedef struct {
+    bool valid;
+    bool negative;
+    int family; // Requested family (KTermResolveFamily)
+    char host[256];
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    double expires;
+    double stored;
+} KTermDnsCacheEntry;
+
+typedef struct {
+    uint32_t id;    // 0 = Free slot
+    int state;      // 0=QUEUED, 1=RUNNING, 2=DONE, 3=UDP_WAIT
+    bool cancelled;
+    char host[256];
+    int family;
+
+    KTerm* term;
+    KTermSession* session;
+    KTermResolveCallback callback;
+    void* user_data;
+
+    // Result
+    bool success;
+    bool from_cache;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    uint32_t ttl;
+    char error[64];
+
+    // UDP Backend
+    socket_t udp_fd;
+    uint16_t txid;
+    double sent_time;
+    int retries;
+} KTermDnsRequest;
+
+static struct {
+    bool initialized;
+    bool shutdown;
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t workers[KTERM_NET_DNS_WORKERS];
+#else
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE cond;
+    HANDLE workers[KTERM_NET_DNS_WORKERS];
+#endif
+    KTermDnsCacheEntry cache[KTERM_NET_DNS_CACHE_SIZE];
+    KTermDnsRequest requests[KTERM_NET_DNS_MAX_PENDING];
+    uint32_t next_id;
+
+    bool use_server;
+    struct sockaddr_in server;
+} kt_dns;
+
+#ifndef _WIN32
+#define KT_DNS_LOCK()   pthread_mutex_lock(&kt_dns.mutex)
+#define KT_DNS_UNLOCK() pthread_mutex_unlock(&kt_dns.mutex)
+#else
+#define KT_DNS_LOCK()   EnterCriticalSection(&kt_dns.mutex)
+#define KT_DNS_UNLOCK() LeaveCriticalSection(&kt_dns.mutex)
+#endif
+
+static bool KTerm_Dns_FamilyMatches(int want, int af) {
+    if (want == KTERM_RESOLVE_IPV4) return af == AF_INET;
+    if (want == KTERM_RESOLVE_IPV6) return af == AF_INET6;
+    return af == AF_INET || af == AF_INET6;
+}
+
+static void KTerm_Dns_FillResult(KTermResolveResult* out, const char* host, bool success, const struct sockaddr_storage* addr, socklen_t addr_len, uint32_t ttl, bool from_cache, const char* error) {
+    memset(out, 0, sizeof(*out));
+    out->host = host;
+    out->success = success;
+    out->from_cache = from_cache;
+    out->ttl_sec = ttl;
+    if (success && addr) {
+        int copy = (addr_len < (socklen_t)sizeof(out->addr)) ? (int)addr_len : (int)sizeof(out->addr);
+        memcpy(out->addr, addr, copy);
+        out->addr_len = copy;
+        if (addr->ss_family == AF_INET6) {
+            out->family = 6;
+            inet_ntop(AF_INET6, &((const struct sockaddr_in6*)addr)->sin6_addr, out->ip, sizeof(out->ip));
+        } else {
+            out->family = 4;
+            inet_ntop(AF_INET, &((const struct sockaddr_in*)addr)->sin_addr, out->ip, sizeof(out->ip));
+        }
+    }
+    if (error) snprintf(out->error, sizeof(out->error), "%s", error);
+}
+
+// Caller holds the lock
+static KTermDnsCacheEntry* KTerm_Dns_CacheFind(const char* host, int family, double now) {
+    for (int i = 0; i < KTERM_NET_DNS_CACHE_SIZE; i++) {
+        KTermDnsCacheEntry* e = &kt_dns.cache[i];
+        if (!e->valid || e->family != family) continue;
+        if (strcmp(e->host, host) != 0) continue;
+        if (now >= e->expires) { e->valid = false; return NULL; }
+        return e;
+    }
+    return NULL;
+}
+
+// Caller holds the lock
+static void KTerm_Dns_CacheStore(const char* host, int family, bool negative, const struct sockaddr_storage* addr, socklen_t addr_len, uint32_t ttl, double now) {
+    KTermDnsCacheEntry* slot = NULL;
+    for (int i = 0; i < KTERM_NET_DNS_CACHE_SIZE; i++) {
+        KTermDnsCacheEntry* e = &kt_dns.cache[i];
+        if (e->valid && e->family == family && strcmp(e->host, host) == 0) { slot = e; break; }
+        if (!e->valid || now >= e->expires) { if (!slot) slot = e; continue; }
+    }
+    if (!slot) {
+        // Full: evict the entry closest to expiry
+        slot = &kt_dns.cache[0];
+        for (int i = 1; i < KTERM_NET_DNS_CACHE_SIZE; i++) {
+            if (kt_dns.cache[i].expires < slot->expires) slot = &kt_dns.cache[i];
+        }
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->valid = true;
+    slot->negative = negative;
+    slot->family = family;
+    strncpy(slot->host, host, sizeof(slot->host)-1);
+    if (!negative && addr) { slot->addr = *addr; slot->addr_len = addr_len; }
+    slot->stored = now;
+    slot->expires = now + (double)ttl;
+}
+
+static bool KTerm_Dns_ParseLiteral(const char* host, int family, struct sockaddr_storage* addr, socklen_t* addr_len) {
+    memset(addr, 0, sizeof(*addr));
+    if (family != KTERM_RESOLVE_IPV6) {
+        struct sockaddr_in* sin = (struct sockaddr_in*)addr;
+        if (inet_pton(AF_INET, host, &sin->sin_addr) == 1) {
+            sin->sin_family = AF_INET;
+            *addr_len = sizeof(struct sockaddr_in);
+            return true;
+        }
+    }
+    if (family != KTERM_RESOLVE_IPV4) {
+        struct sockaddr_in6* sin6 = (struct sockaddr_in6*)addr;
+        if (inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1) {
+            sin6->sin6_family = AF_INET6;
+            *addr_len = sizeof(struct sockaddr_in6);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool KTerm_Dns_SystemLookup(const char* host, int family, struct sockaddr_storage* addr, socklen_t* addr_len, char* err, size_t err_len) {
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = (family == KTERM_RESOLVE_IPV4) ? AF_INET : (family == KTERM_RESOLVE_IPV6) ? AF_INET6 : AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int gai_err = getaddrinfo(host, NULL, &hints, &res);
+    if (gai_err != 0 || !res) {
+        snprintf(err, err_len, "DNS Failed: %s", gai_strerror(gai_err));
+        return false;
+    }
+    bool found = false;
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        if (!KTerm_Dns_FamilyMatches(family, ai->ai_family)) continue;
+        if (ai->ai_addrlen > sizeof(*addr)) continue;
+        memset(addr, 0, sizeof(*addr));
+        memcpy(addr, ai->ai_addr, ai->ai_addrlen);
+        *addr_len = (socklen_t)ai->ai_addrlen;
+        found = true;
+        break;
+    }
+    freeaddrinfo(res);
+    if (!found) snprintf(err, err_len, "DNS Failed: No address");
+    return found;
+}
+
+#ifndef _WIN32
+static void* KTerm_Dns_Worker(void* arg) {
+#else
+static DWORD WINAPI KTerm_Dns_Worker(LPVOID arg) {
+#endif
+    (void)arg;
+    KT_DNS_LOCK();
+    while (!kt_dns.shutdown) {
+        KTermDnsRequest* job = NULL;
+        for (int i = 0; i < KTERM_NET_DNS_MAX_PENDING; i++) {
+            if (kt_dns.requests[i].id && kt_dns.requests[i].state == 0) { job = &kt_dns.requests[i]; break; }
+        }
+        if (!job) {
+#ifndef _WIN32
+            pthread_cond_wait(&kt_dns.cond, &kt_dns.mutex);
+#else
+            SleepConditionVariableCS(&kt_dns.cond, &kt_dns.mutex, INFINITE);
+#endif
+            continue;
+        }
+
+        job->state = 1; // RUNNING
+        uint32_t id = job->id;
+        char host[256];
+        int family = job->family;
+        memcpy(host, job->host, sizeof(host));
+        KT_DNS_UNLOCK();
+
+        struct sockaddr_storage addr;
+        socklen_t addr_len = 0;
+        char err[64] = {0};
+        bool ok = KTerm_Dns_SystemLookup(host, family, &addr, &addr_len, err, sizeof(err));
+
+        KT_DNS_LOCK();
+        double now = KTerm_GetTime();
+        KTerm_Dns_CacheStore(host, family, !ok, &addr, addr_len, ok ? KTERM_NET_DNS_DEFAULT_TTL : KTERM_NET_DNS_NEGATIVE_TTL, now);
+        // Slot may have been recycled if cancelled; match on id
+        if (job->id == id) {
+            job->success = ok;
+            if (ok) { job->addr = addr; job->addr_len = addr_len; job->ttl = KTERM_NET_DNS_DEFAULT_TTL; }
+            else snprintf(job->error, sizeof(job->error), "%s", err);
+            job->state = 2; // DONE
+        }
+    }
+    KT_DNS_UNLOCK();
+#ifndef _WIN32
+    return NULL;
+#else
+    return 0;
+#endif
+}
+
+static void KTerm_Dns_Init(void) {
+    if (kt_dns.initialized) return;
+    memset(&kt_dns, 0, sizeof(kt_dns));
+#ifndef _WIN32
+    pthread_mutex_init(&kt_dns.mutex, NULL);
+    pthread_cond_init(&kt_dns.cond, NULL);
+    for (int i = 0; i < KTERM_NET_DNS_WORKERS; i++) {
+        pthread_create(&kt_dns.workers[i], NULL, KTerm_Dns_Worker, NULL);
+        pthread_detach(kt_dns.workers[i]);
+    }
+#else
+    InitializeCriticalSection(&kt_dns.mutex);
+    InitializeConditionVariable(&kt_dns.cond);
+    for (int i = 0; i < KTERM_NET_DNS_WORKERS; i++) {
+        kt_dns.workers[i] = CreateThread(NULL, 0, KTerm_Dns_Worker, NULL, 0, NULL);
+    }
+#endif
+    for (int i = 0; i < KTERM_NET_DNS_MAX_PENDING; i++) kt_dns.requests[i].udp_fd = INVALID_SOCKET;
+    kt_dns.next_id = 1;
+    kt_dns.initialized = true;
+}
+
+// --- UDP Backend (RFC 1035 A/AAAA client) ---
+
+static int KTerm_Dns_BuildQuery(uint8_t* buf, int max, uint16_t txid, const char* host, uint16_t qtype) {
+    if (max < 12) return -1;
+    memset(buf, 0, 12);
+    buf[0] = (uint8_t)(txid >> 8); buf[1] = (uint8_t)txid;
+    buf[2] = 0x01; // RD
+    buf[5] = 1;    // QDCOUNT
+    int pos = 12;
+    const char* label = host;
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        int len = dot ? (int)(dot - label) : (int)strlen(label);
+        if (len <= 0 || len > 63 || pos + len + 1 >= max) return -1;
+        buf[pos++] = (uint8_t)len;
+        memcpy(buf + pos, label, len);
+        pos += len;
+        label += len;
+        if (*label == '.') label++;
+    }
+    if (pos + 5 > max) return -1;
+    buf[pos++] = 0;
+    buf[pos++] = (uint8_t)(qtype >> 8); buf[pos++] = (uint8_t)qtype;
+    buf[pos++] = 0; buf[pos++] = 1; // IN
+    return pos;
+}
+
+static int KTerm_Dns_SkipName(const uint8_t* buf, int len, int pos) {
+    while (pos < len) {
+        uint8_t l = buf[pos];
+        if (l == 0) return pos + 1;
+        if ((l & 0xC0) == 0xC0) return (pos + 2 <= len) ? pos + 2 : -1;
+        pos += l + 1;
+    }
+    return -1;
+}
+
+// Returns 1 on answer, 0 on NXDOMAIN/empty, -1 on malformed
+static int KTerm_Dns_ParseResponse(const uint8_t* buf, int len, uint16_t txid, int family, struct sockaddr_storage* addr, socklen_t* addr_len, uint32_t* ttl) {
+    if (len < 12) return -1;
+    if ((((uint16_t)buf[0] << 8) | buf[1]) != txid) return -1;
+    if (!(buf[2] & 0x80)) return -1; // Not a response
+    int rcode = buf[3] & 0x0F;
+    int qd = (buf[4] << 8) | buf[5];
+    int an = (buf[6] << 8) | buf[7];
+    if (rcode != 0) return 0;
+
+    int pos = 12;
+    for (int i = 0; i < qd; i++) {
+        pos = KTerm_Dns_SkipName(buf, len, pos);
+        if (pos < 0 || pos + 4 > len) return -1;
+        pos += 4;
+    }
+    for (int i = 0; i < an; i++) {
+        pos = KTerm_Dns_SkipName(buf, len, pos);
+        if (pos < 0 || pos + 10 > len) return -1;
+        uint16_t type = (buf[pos] << 8) | buf[pos+1];
+        uint32_t rr_ttl = ((uint32_t)buf[pos+4] << 24) | ((uint32_t)buf[pos+5] << 16) | ((uint32_t)buf[pos+6] << 8) | buf[pos+7];
+        uint16_t rdlen = (buf[pos+8] << 8) | buf[pos+9];
+        pos += 10;
+        if (pos + rdlen > len) return -1;
+
+        memset(addr, 0, sizeof(*addr));
+        if (type == 1 && rdlen == 4 && family != KTERM_RESOLVE_IPV6) {
+            struct sockaddr_in* sin = (struct sockaddr_in*)addr;
+            sin->sin_family = AF_INET;
+            memcpy(&sin->sin_addr, buf + pos, 4);
+            *addr_len = sizeof(struct sockaddr_in);
+            *ttl = rr_ttl;
+            return 1;
+        }
+        if (type == 28 && rdlen == 16 && family == KTERM_RESOLVE_IPV6) {
+            struct sockaddr_in6* sin6 = (struct sockaddr_in6*)addr;
+            sin6->sin6_family = AF_INET6;
+            memcpy(&sin6->sin6_addr, buf + pos, 16);
+            *addr_len = sizeof(struct sockaddr_in6);
+            *ttl = rr_ttl;
+            return 1;
+        }
+        pos += rdlen; // CNAME etc.
+    }
+    return 0;
+}
+
+// Caller holds the lock
+static bool KTerm_Dns_UdpSend(KTermDnsRequest* req) {
+    uint8_t pkt[512];
+    uint16_t qtype = (req->family == KTERM_RESOLVE_IPV6) ? 28 : 1;
+    int len = KTerm_Dns_BuildQuery(pkt, sizeof(pkt), req->txid, req->host, qtype);
+    if (len < 0) return false;
+    if (!IS_VALID_SOCKET(req->udp_fd)) {
+        req->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (!IS_VALID_SOCKET(req->udp_fd)) return false;
+#ifdef _WIN32
+        u_long mode = 1; ioctlsocket(req->udp_fd, FIONBIO, &mode);
+#else
+        fcntl(req->udp_fd, F_SETFL, fcntl(req->udp_fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    }
+    if (sendto(req->udp_fd, (const char*)pkt, len, 0, (struct sockaddr*)&kt_dns.server, sizeof(kt_dns.server)) < 0) return false;
+    req->sent_time = KTerm_GetTime();
+    return true;
+}
+
+// Caller holds the lock
+static void KTerm_Dns_UdpPoll(KTermDnsRequest* req, double now) {
+    uint8_t buf[1500];
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = (int)recvfrom(req->udp_fd, (char*)buf, sizeof(buf), KTERM_MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+        if (n <= 0) break;
+        if (from.sin_addr.s_addr != kt_dns.server.sin_addr.s_addr || from.sin_port != kt_dns.server.sin_port) continue;
+
+        struct sockaddr_storage addr;
+        socklen_t addr_len = 0;
+        uint32_t ttl = 0;
+        int rc = KTerm_Dns_ParseResponse(buf, n, req->txid, req->family, &addr, &addr_len, &ttl);
+        if (rc < 0) continue; // Ignore spoofed/malformed
+        req->success = (rc == 1);
+        if (req->success) { req->addr = addr; req->addr_len = addr_len; req->ttl = ttl; }
+        else snprintf(req->error, sizeof(req->error), "DNS Failed: No address");
+        KTerm_Dns_CacheStore(req->host, req->family, !req->success, &addr, addr_len, req->success ? ttl : KTERM_NET_DNS_NEGATIVE_TTL, now);
+        req->state = 2;
+        return;
+    }
+
+    if ((now - req->sent_time) * 1000.0 > KTERM_NET_DNS_TIMEOUT_MS) {
+        if (req->retries < KTERM_NET_DNS_RETRIES && KTerm_Dns_UdpSend(req)) {
+            req->retries++;
+        } else {
+            req->success = false;
+            snprintf(req->error, sizeof(req->error), "DNS Failed: Timeout");
+            req->state = 2;
+        }
+    }
+}
+
+bool KTerm_Net_ResolveCached(const char* host, KTermResolveFamily family, KTermResolveResult* out) {
+    if (!host || !out) return false;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = 0;
+    if (KTerm_Dns_ParseLiteral(host, family, &addr, &addr_len)) {
+        KTerm_Dns_FillResult(out, host, true, &addr, addr_len, 0, true, NULL);
+        return true;
+    }
+    if (!kt_dns.initialized) return false;
+
+    bool hit = false;
+    KT_DNS_LOCK();
+    double now = KTerm_GetTime();
+    KTermDnsCacheEntry* e = KTerm_Dns_CacheFind(host, family, now);
+    if (e) {
+        uint32_t remaining = (uint32_t)(e->expires - now);
+        if (e->negative) KTerm_Dns_FillResult(out, host, false, NULL, 0, remaining, true, "DNS Failed: Cached");
+        else KTerm_Dns_FillResult(out, host, true, &e->addr, e->addr_len, remaining, true, NULL);
+        hit = true;
+    }
+    KT_DNS_UNLOCK();
+    return hit;
+}
+
+uint32_t KTerm_Net_ResolveAsync(KTerm* term, KTermSession* session, const char* host, KTermResolveFamily family, KTermResolveCallback cb, void* user_data) {
+    if (!host || !host[0] || strlen(host) >= 256) return 0;
+    KTerm_Dns_Init();
+
+    uint32_t id = 0;
+    KT_DNS_LOCK();
+    KTermDnsRequest* req = NULL;
+    for (int i = 0; i < KTERM_NET_DNS_MAX_PENDING; i++) {
+        if (kt_dns.requests[i].id == 0) { req = &kt_dns.requests[i]; break; }
+    }
+    if (req) {
+        socket_t fd = req->udp_fd;
+        memset(req, 0, sizeof(*req));
+        req->udp_fd = fd;
+        id = kt_dns.next_id++;
+        if (kt_dns.next_id == 0) kt_dns.next_id = 1;
+        req->id = id;
+        strncpy(req->host, host, sizeof(req->host)-1);
+        req->family = family;
+        req->term = term;
+        req->session = session;
+        req->callback = cb;
+        req->user_data = user_data;
+
+        double now = KTerm_GetTime();
+        struct sockaddr_storage addr;
+        socklen_t addr_len = 0;
+        KTermDnsCacheEntry* e = NULL;
+        if (KTerm_Dns_ParseLiteral(host, family, &addr, &addr_len)) {
+            req->success = true; req->addr = addr; req->addr_len = addr_len; req->from_cache = true;
+            req->state = 2;
+        } else if ((e = KTerm_Dns_CacheFind(host, family, now)) != NULL) {
+            req->success = !e->negative;
+            req->addr = e->addr; req->addr_len = e->addr_len;
+            req->ttl = (uint32_t)(e->expires - now);
+            req->from_cache = true;
+            if (e->negative) snprintf(req->error, sizeof(req->error), "DNS Failed: Cached");
+            req->state = 2;
+        } else if (kt_dns.use_server) {
+            req->txid = (uint16_t)((id * 2654435761u) >> 16) ^ (uint16_t)(now * 1000.0);
+            if (KTerm_Dns_UdpSend(req)) {
+                req->state = 3; // UDP_WAIT
+            } else {
+                snprintf(req->error, sizeof(req->error), "DNS Failed: Send");
+                req->state = 2;
+            }
+        } else {
+            req->state = 0; // QUEUED for workers
+#ifndef _WIN32
+            pthread_cond_signal(&kt_dns.cond);
+#else
+            WakeConditionVariable(&kt_dns.cond);
+#endif
+        }
+    }
+    KT_DNS_UNLOCK();
+    return id;
+}
+
+void KTerm_Net_ResolveCancel(uint32_t request_id) {
+    if (!request_id || !kt_dns.initialized) return;
+    KT_DNS_LOCK();
+    for (int i = 0; i < KTERM_NET_DNS_MAX_PENDING; i++) {
+        KTermDnsRequest* req = &kt_dns.requests[i];
+        if (req->id != request_id) continue;
+        if (req->state == 1) {
+            // A worker owns the lookup; let it finish (the result still seeds the cache)
+            req->cancelled = true;
+        } else {
+            req->id = 0;
+        }
+        break;
+    }
+    KT_DNS_UNLOCK();
+}
+
+void KTerm_Net_SetDnsServer(const char* ip, int port) {
+    KTerm_Dns_Init();
+    KT_DNS_LOCK();
+    memset(&kt_dns.server, 0, sizeof(kt_dns.server));
+    kt_dns.use_server = false;
+    if (ip && inet_pton(AF_INET, ip, &kt_dns.server.sin_addr) == 1) {
+        kt_dns.server.sin_family = AF_INET;
+        kt_dns.server.sin_port = htons((uint16_t)((port > 0) ? port : 53));
+        kt_dns.use_server = true;
+    }
+    KT_DNS_UNLOCK();
+}
+
+void KTerm_Net_FlushDnsCache(void) {
+    if (!kt_dns.initialized) return;
+    KT_DNS_LOCK();
+    memset(kt_dns.cache, 0, sizeof(kt_dns.cache));
+    KT_DNS_UNLOCK();
+}
+
+void KTerm_Net_ProcessResolver(void) {
+    if (!kt_dns.initialized) return;
+
+    for (int i = 0; i < KTERM_NET_DNS_MAX_PENDING; i++) {
+        KT_DNS_LOCK();
+        KTermDnsRequest* req = &kt_dns.requests[i];
+        if (req->id && req->state == 3) KTerm_Dns_UdpPoll(req, KTerm_GetTime());
+        if (!req->id || req->state != 2) { KT_DNS_UNLOCK(); continue; }
+
+        // Snapshot and release the slot before running user code (callbacks may start new lookups)
+        KTermDnsRequest done = *req;
+        req->id = 0;
+        KT_DNS_UNLOCK();
+
+        if (done.cancelled || !done.callback) continue;
+        KTermResolveResult result;
+        KTerm_Dns_FillResult(&result, done.host, done.success, &done.addr, done.addr_len, done.ttl, done.from_cache, done.success ? NULL : done.error);
+        done.callback(done.term, done.session, &result, done.user_data);
+    }
+}
+
+// --- Shared ICMP Engine ---
+
+#ifndef KTERM_NET_ICMP_MAX_PROBES
+#define KTERM_NET_ICMP_MAX_PROBES 1024 // Power of two <= 65536: low bits of a probe id select its slot
+#endif
+#define KTERM_NET_ICMP_BATCH 64        // Messages per sendmmsg / recvmmsg call
+#define KTERM_NET_ICMP_MAX_SIZE 1472   // Largest echo message (header + payload)
+
+#ifdef __linux__
+#if defined(_GNU_SOURCE)
+typedef struct mmsghdr KTermMMsgHdr;
+#define KT_SENDMMSG(fd, v, n) sendmmsg((fd), (v), (unsigned int)(n), 0)
+#define KT_RECVMMSG(fd, v, n, f) recvmmsg((fd), (v), (unsigned int)(n), (f), NULL)
+#elif defined(_DEFAULT_SOURCE) && defined(SYS_sendmmsg) && defined(SYS_recvmmsg)
+// libc only declares struct mmsghdr and the mmsg wrappers under _GNU_SOURCE; syscall() is
+// declared under _DEFAULT_SOURCE (the gnu11 default).
+typedef struct { struct msghdr msg_hdr; unsigned int msg_len; } KTermMMsgHdr;
+#define KT_SENDMMSG(fd, v, n) (int)syscall(SYS_sendmmsg, (fd), (v), (unsigned int)(n), 0)
+#define KT_RECVMMSG(fd, v, n, f) (int)syscall(SYS_recvmmsg, (fd), (v), (unsigned int)(n), (f), NULL)
+#else
+// Strict POSIX builds send and receive the batch one message per call, with the same
+// return convention.
+typedef struct { struct msghdr msg_hdr; unsigned int msg_len; } KTermMMsgHdr;
+
+static int KTerm_Icmp_SendBatch(socket_t fd, KTermMMsgHdr* msgs, int n) {
+    int i = 0;
+    for (; i < n; i++) {
+        ssize_t r = sendmsg(fd, &msgs[i].msg_hdr, 0);
+        if (r < 0) return i ? i : -1;
+        msgs[i].msg_len = (unsigned int)r;
+    }
+    return i;
+}
+
+static int KTerm_Icmp_RecvBatch(socket_t fd, KTermMMsgHdr* msgs, int n, int flags) {
+    int i = 0;
+    for (; i < n; i++) {
+        ssize_t r = recvmsg(fd, &msgs[i].msg_hdr, flags);
+        if (r < 0) return i ? i : -1;
+        msgs[i].msg_len = (unsigned int)r;
+    }
+    return i;
+}
+#define KT_SENDMMSG(fd, v, n) KTerm_Icmp_SendBatch((fd), (v), (n))
+#define KT_RECVMMSG(fd, v, n, f) KTerm_Icmp_RecvBatch((fd), (v), (n), (f))
+#endif
+
+typedef struct {
+    uint32_t id;   // 0 = Free slot
+    int state;     // 0=QUEUED, 1=SENT
+    int family;    // AF_INET / AF_INET6
+    struct sockaddr_storage dest;
+    socklen_t dest_len;
+    int ttl;
+    int size;
+    double deadline;
+    struct timespec sent_ts;
+    int live_pos;  // Index in kt_icmp.live
+
+    KTerm* term;
+    KTermSession* session;
+    KTermIcmpCallback callback;
+    void* user_data;
+} KTermIcmpProbe;
+
+static struct {
+    bool initialized;
+    socket_t fd[2];       // [0]=IPv4, [1]=IPv6
+    bool raw[2];
+    bool unavailable[2];  // Socket creation failed (no CAP_NET_RAW and ping_group_range excludes us)
+    uint16_t ident;       // Echo identifier for raw sockets (DGRAM sockets get one from the kernel)
+
+    KTermIcmpProbe probes[KTERM_NET_ICMP_MAX_PROBES];
+    uint16_t generation[KTERM_NET_ICMP_MAX_PROBES];
+    int free_list[KTERM_NET_ICMP_MAX_PROBES];
+    int free_count;
+    int live[KTERM_NET_ICMP_MAX_PROBES]; // Queued + sent probes
+    int live_count;
+    int queued;
+
+    uint8_t tx[KTERM_NET_ICMP_BATCH][KTERM_NET_ICMP_MAX_SIZE];
+    uint8_t rx[KTERM_NET_ICMP_BATCH][1500];
+    char cmsg[KTERM_NET_ICMP_BATCH][256];
+    struct sockaddr_storage names[KTERM_NET_ICMP_BATCH];
+} kt_icmp;
+
+static void KTerm_Icmp_Init(void) {
+    if (kt_icmp.initialized) return;
+    memset(&kt_icmp, 0, sizeof(kt_icmp));
+    kt_icmp.fd[0] = kt_icmp.fd[1] = INVALID_SOCKET;
+    kt_icmp.ident = (uint16_t)(getpid() & 0xFFFF);
+    for (int i = 0; i < KTERM_NET_ICMP_MAX_PROBES; i++) {
+        kt_icmp.free_list[i] = KTERM_NET_ICMP_MAX_PROBES - 1 - i;
+    }
+    kt_icmp.free_count = KTERM_NET_ICMP_MAX_PROBES;
+    kt_icmp.initialized = true;
+}
+
+static socket_t KTerm_Icmp_Socket(int idx) {
+    if (IS_VALID_SOCKET(kt_icmp.fd[idx]) || kt_icmp.unavailable[idx]) return kt_icmp.fd[idx];
+
+    int af = idx ? AF_INET6 : AF_INET;
+    int proto = idx ? IPPROTO_ICMPV6 : IPPROTO_ICMP;
+    socket_t fd = socket(af, SOCK_DGRAM, proto);
+    bool raw = false;
+    if (!IS_VALID_SOCKET(fd)) {
+        fd = socket(af, SOCK_RAW, proto);
+        raw = true;
+    }
+    if (!IS_VALID_SOCKET(fd)) {
+        kt_icmp.unavailable[idx] = true;
+        return INVALID_SOCKET;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    int on = 1;
+#if defined(__linux__) && defined(SCM_TIMESTAMPNS)
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#endif
+    if (!raw) {
+        // DGRAM ICMP sockets only see ICMP errors through the error queue
+        if (idx) setsockopt(fd, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on));
+        else setsockopt(fd, IPPROTO_IP, IP_RECVERR, &on, sizeof(on));
+    } else if (idx) {
+        struct icmp6_filter filt;
+        ICMP6_FILTER_SETBLOCKALL(&filt);
+        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filt);
+        ICMP6_FILTER_SETPASS(ICMP6_TIME_EXCEEDED, &filt);
+        ICMP6_FILTER_SETPASS(ICMP6_DST_UNREACH, &filt);
+        setsockopt(fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filt, sizeof(filt));
+    }
+    int rcvbuf = 256 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    kt_icmp.fd[idx] = fd;
+    kt_icmp.raw[idx] = raw;
+    return fd;
+}
+
+static void KTerm_Icmp_LiveRemove(KTermIcmpProbe* p) {
+    int pos = p->live_pos;
+    int last = kt_icmp.live[--kt_icmp.live_count];
+    kt_icmp.live[pos] = last;
+    kt_icmp.probes[last].live_pos = pos;
+}
+
+static void KTerm_Icmp_Release(KTermIcmpProbe* p) {
+    if (p->state == 0) kt_icmp.queued--;
+    KTerm_Icmp_LiveRemove(p);
+    p->id = 0;
+    kt_icmp.free_list[kt_icmp.free_count++] = (int)(p - kt_icmp.probes);
+}
+
+static KTermIcmpProbe* KTerm_Icmp_Lookup(uint32_t id) {
+    if (!id || !kt_icmp.initialized) return NULL;
+    KTermIcmpProbe* p = &kt_icmp.probes[id & (KTERM_NET_ICMP_MAX_PROBES - 1)];
+    return (p->id == id) ? p : NULL;
+}
+
+// Matches an echo sequence number (the low 16 bits of a probe id) to an in-flight probe.
+static KTermIcmpProbe* KTerm_Icmp_LookupSeq(uint16_t seq, int family) {
+    KTermIcmpProbe* p = &kt_icmp.probes[seq & (KTERM_NET_ICMP_MAX_PROBES - 1)];
+    if (!p->id || p->state != 1 || p->family != family || (uint16_t)(p->id & 0xFFFF) != seq) return NULL;
+    return p;
+}
+
+// Releases the slot before running user code (callbacks commonly queue the next probe).
+static void KTerm_Icmp_Complete(KTermIcmpProbe* p, KTermIcmpResult* res) {
+    KTerm* term = p->term;
+    KTermSession* session = p->session;
+    KTermIcmpCallback cb = p->callback;
+    void* user_data = p->user_data;
+    res->probe_id = p->id;
+    res->ttl = p->ttl;
+    KTerm_Icmp_Release(p);
+    if (cb) cb(term, session, res, user_data);
+}
+
+uint32_t KTerm_Net_IcmpEcho(KTerm* term, KTermSession* session, const void* addr, int addr_len, int ttl, int size, int timeout_ms, KTermIcmpCallback cb, void* user_data) {
+    if (!addr || addr_len < (int)sizeof(struct sockaddr_in) || addr_len > (int)sizeof(struct sockaddr_storage)) return 0;
+    int family = ((const struct sockaddr*)addr)->sa_family;
+    if (family != AF_INET && family != AF_INET6) return 0;
+    KTerm_Icmp_Init();
+    if (kt_icmp.free_count == 0) return 0;
+
+    int slot = kt_icmp.free_list[--kt_icmp.free_count];
+    KTermIcmpProbe* p = &kt_icmp.probes[slot];
+    memset(p, 0, sizeof(*p));
+    uint16_t gen = ++kt_icmp.generation[slot];
+    if (gen == 0) gen = kt_icmp.generation[slot] = 1;
+    p->id = ((uint32_t)gen * KTERM_NET_ICMP_MAX_PROBES) | (uint32_t)slot;
+    p->family = family;
+    memcpy(&p->dest, addr, addr_len);
+    p->dest_len = (socklen_t)addr_len;
+    p->ttl = (ttl > 0 && ttl < 256) ? ttl : 0;
+    p->size = (size < 8) ? 8 : (size > KTERM_NET_ICMP_MAX_SIZE ? KTERM_NET_ICMP_MAX_SIZE : size);
+    p->deadline = KTerm_GetTime() + ((timeout_ms > 0) ? timeout_ms : 1000) / 1000.0;
+    p->term = term;
+    p->session = session;
+    p->callback = cb;
+    p->user_data = user_data;
+    p->live_pos = kt_icmp.live_count;
+    kt_icmp.live[kt_icmp.live_count++] = slot;
+    kt_icmp.queued++;
+    return p->id;
+}
+
+void KTerm_Net_IcmpCancel(uint32_t probe_id) {
+    KTermIcmpProbe* p = KTerm_Icmp_Lookup(probe_id);
+    if (p) KTerm_Icmp_Release(p);
+}
+
+static void KTerm_Icmp_FailQueued(int family, const char* error) {
+    for (int i = 0; i < kt_icmp.live_count; ) {
+        KTermIcmpProbe* p = &kt_icmp.probes[kt_icmp.live[i]];
+        if (p->state != 0 || p->family != family) { i++; continue; }
+        KTermIcmpResult res = {0};
+        res.icmp_type = -1;
+        snprintf(res.error, sizeof(res.error), "%s", error);
+        KTerm_Icmp_Complete(p, &res); // Swap-removes p from live[i]
+    }
+}
+
+// Sends every queued probe of one family, KTERM_NET_ICMP_BATCH messages per syscall.
+static void KTerm_Icmp_Flush(int idx) {
+    int family = idx ? AF_INET6 : AF_INET;
+    socket_t fd = KTerm_Icmp_Socket(idx);
+    if (!IS_VALID_SOCKET(fd)) {
+        KTerm_Icmp_FailQueued(family, "ERR;ICMP_SOCKET");
+        return;
+    }
+
+    KTermMMsgHdr msgs[KTERM_NET_ICMP_BATCH];
+    struct iovec iov[KTERM_NET_ICMP_BATCH];
+    KTermIcmpProbe* batch[KTERM_NET_ICMP_BATCH];
+    int li = 0;
+    while (li < kt_icmp.live_count) {
+        int n = 0;
+        memset(msgs, 0, sizeof(msgs));
+        for (; li < kt_icmp.live_count && n < KTERM_NET_ICMP_BATCH; li++) {
+            KTermIcmpProbe* p = &kt_icmp.probes[kt_icmp.live[li]];
+            if (p->state != 0 || p->family != family) continue;
+
+            uint8_t* pkt = kt_icmp.tx[n];
+            memset(pkt, 0, p->size);
+            uint16_t seq = (uint16_t)(p->id & 0xFFFF);
+            if (idx) {
+                struct icmp6_hdr* h = (struct icmp6_hdr*)pkt;
+                h->icmp6_type = ICMP6_ECHO_REQUEST;
+                h->icmp6_id = htons(kt_icmp.ident);
+                h->icmp6_seq = htons(seq);
+            } else {
+                struct icmphdr* h = (struct icmphdr*)pkt;
+                h->type = ICMP_ECHO;
+                h->un.echo.id = htons(kt_icmp.ident);
+                h->un.echo.sequence = htons(seq);
+            }
+            for (int b = 8; b < p->size; b++) pkt[b] = (uint8_t)(0x20 + (b & 0x3F));
+            // The kernel checksums DGRAM ICMP and raw ICMPv6; raw ICMPv4 is ours to fill
+            if (!idx && kt_icmp.raw[0]) ((struct icmphdr*)pkt)->checksum = KTerm_Checksum(pkt, p->size);
+
+            iov[n].iov_base = pkt;
+            iov[n].iov_len = p->size;
+            msgs[n].msg_hdr.msg_name = &p->dest;
+            msgs[n].msg_hdr.msg_namelen = p->dest_len;
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            if (p->ttl > 0) {
+                // Per-message TTL lets traceroute rounds share the socket (and one sendmmsg)
+                char* cbuf = kt_icmp.cmsg[n];
+                memset(cbuf, 0, CMSG_SPACE(sizeof(int)));
+                msgs[n].msg_hdr.msg_control = cbuf;
+                msgs[n].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+                struct cmsghdr* c = CMSG_FIRSTHDR(&msgs[n].msg_hdr);
+                c->cmsg_level = idx ? IPPROTO_IPV6 : IPPROTO_IP;
+                c->cmsg_type = idx ? IPV6_HOPLIMIT : IP_TTL;
+                c->cmsg_len = CMSG_LEN(sizeof(int));
+                memcpy(CMSG_DATA(c), &p->ttl, sizeof(int));
+            }
+            batch[n++] = p;
+        }
+        if (n == 0) break;
+
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now); // Same clock as SO_TIMESTAMPNS
+        for (int i = 0; i < n; i++) {
+            batch[i]->state = 1;
+            batch[i]->sent_ts = now;
+        }
+        kt_icmp.queued -= n;
+
+        // Messages the kernel refuses (EHOSTUNREACH, full buffer...) simply run into their timeout
+        int off = 0;
+        while (off < n) {
+            int r = KT_SENDMMSG(fd, msgs + off, n - off);
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            off += (r > 0) ? r : 1;
+        }
+    }
+}
+
+static void KTerm_Icmp_ParseReply(int idx, const uint8_t* buf, int len, const struct msghdr* mh, bool errqueue) {
+    int family = idx ? AF_INET6 : AF_INET;
+    bool raw = kt_icmp.raw[idx];
+    KTermIcmpResult res = {0};
+    res.success = true;
+    res.icmp_type = -1;
+    uint16_t seq = 0;
+    bool matched = false;
+
+    struct timespec rx = {0};
+    for (struct cmsghdr* c = CMSG_FIRSTHDR((struct msghdr*)mh); c; c = CMSG_NXTHDR((struct msghdr*)mh, c)) {
+#if defined(__linux__) && defined(SCM_TIMESTAMPNS)
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&rx, CMSG_DATA(c), sizeof(rx));
+            res.kernel_timed = true;
+            continue;
+        }
+#endif
+        if (errqueue && ((c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_RECVERR) ||
+                                (c->cmsg_level == IPPROTO_IPV6 && c->cmsg_type == IPV6_RECVERR))) {
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+            if (ee.ee_origin != SO_EE_ORIGIN_ICMP && ee.ee_origin != SO_EE_ORIGIN_ICMP6) return;
+            res.icmp_type = ee.ee_type;
+            res.icmp_code = ee.ee_code;
+            struct sockaddr* off = SO_EE_OFFENDER((struct sock_extended_err*)CMSG_DATA(c));
+            if (off->sa_family == AF_INET) inet_ntop(AF_INET, &((struct sockaddr_in*)off)->sin_addr, res.from, sizeof(res.from));
+            else if (off->sa_family == AF_INET6) inet_ntop(AF_INET6, &((struct sockaddr_in6*)off)->sin6_addr, res.from, sizeof(res.from));
+        }
+    }
+
+    if (errqueue) {
+        // DGRAM error queue: the payload is our original echo request
+        if (res.icmp_type < 0 || len < 8) return;
+        seq = ntohs(idx ? ((const struct icmp6_hdr*)buf)->icmp6_seq : ((const struct icmphdr*)buf)->un.echo.sequence);
+        matched = true;
+    } else if (idx) {
+        // Raw and DGRAM ICMPv6 sockets both deliver the message without the IPv6 header
+        if (len < 8) return;
+        const struct icmp6_hdr* h = (const struct icmp6_hdr*)buf;
+        res.icmp_type = h->icmp6_type;
+        res.icmp_code = h->icmp6_code;
+        if (h->icmp6_type == ICMP6_ECHO_REPLY) {
+            if (raw && ntohs(h->icmp6_id) != kt_icmp.ident) return;
+            seq = ntohs(h->icmp6_seq);
+            matched = true;
+        } else if (raw && (h->icmp6_type == ICMP6_TIME_EXCEEDED || h->icmp6_type == ICMP6_DST_UNREACH) && len >= 8 + 40 + 8) {
+            const uint8_t* inner = buf + 8;
+            const struct icmp6_hdr* ih = (const struct icmp6_hdr*)(inner + 40);
+            if (inner[6] != IPPROTO_ICMPV6 || ih->icmp6_type != ICMP6_ECHO_REQUEST || ntohs(ih->icmp6_id) != kt_icmp.ident) return;
+            seq = ntohs(ih->icmp6_seq);
+            matched = true;
+        }
+    } else {
+        const uint8_t* ip = NULL;
+        if (raw) {
+            if (len < 20) return;
+            int ihl = (buf[0] & 0x0F) * 4;
+            if (len < ihl + 8) return;
+            ip = buf;
+            buf += ihl; len -= ihl;
+        } else if (len < 8) {
+            return;
+        }
+        const struct icmphdr* h = (const struct icmphdr*)buf;
+        res.icmp_type = h->type;
+        res.icmp_code = h->code;
+        if (h->type == ICMP_ECHOREPLY) {
+            if (raw && ntohs(h->un.echo.id) != kt_icmp.ident) return;
+            seq = ntohs(h->un.echo.sequence);
+            matched = true;
+        } else if (ip && (h->type == ICMP_TIME_EXCEEDED || h->type == ICMP_DEST_UNREACH) && len >= 8 + 20 + 8) {
+            const uint8_t* inner = buf + 8;
+            int ihl = (inner[0] & 0x0F) * 4;
+            if (inner[9] != IPPROTO_ICMP || len < 8 + ihl + 8) return;
+            const struct icmphdr* ih = (const struct icmphdr*)(inner + ihl);
+            if (ih->type != ICMP_ECHO || ntohs(ih->un.echo.id) != kt_icmp.ident) return;
+            seq = ntohs(ih->un.echo.sequence);
+            matched = true;
+        }
+    }
+    if (!matched) return;
+
+    KTermIcmpProbe* p = KTerm_Icmp_LookupSeq(seq, family);
+    if (!p) return;
+
+    if (!res.from[0]) {
+        const struct sockaddr* src = (const struct sockaddr*)mh->msg_name;
+        if (src->sa_family == AF_INET) inet_ntop(AF_INET, &((const struct sockaddr_in*)src)->sin_addr, res.from, sizeof(res.from));
+        else if (src->sa_family == AF_INET6) inet_ntop(AF_INET6, &((const struct sockaddr_in6*)src)->sin6_addr, res.from, sizeof(res.from));
+    }
+    bool echo_reply = idx ? (res.icmp_type == ICMP6_ECHO_REPLY) : (res.icmp_type == ICMP_ECHOREPLY);
+    bool unreachable = idx ? (res.icmp_type == ICMP6_DST_UNREACH) : (res.icmp_type == ICMP_DEST_UNREACH);
+    res.reached = echo_reply || unreachable;
+
+    if (!res.kernel_timed) clock_gettime(CLOCK_REALTIME, &rx);
+    res.rtt_ms = (rx.tv_sec - p->sent_ts.tv_sec) * 1000.0 + (rx.tv_nsec - p->sent_ts.tv_nsec) / 1000000.0;
+    if (res.rtt_ms < 0) res.rtt_ms = 0;
+    KTerm_Icmp_Complete(p, &res);
+}
+
+static void KTerm_Icmp_Drain(int idx, bool errqueue) {
+    socket_t fd = kt_icmp.fd[idx];
+    KTermMMsgHdr msgs[KTERM_NET_ICMP_BATCH];
+    struct iovec iov[KTERM_NET_ICMP_BATCH];
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < KTERM_NET_ICMP_BATCH; i++) {
+            iov[i].iov_base = kt_icmp.rx[i];
+            iov[i].iov_len = sizeof(kt_icmp.rx[i]);
+            msgs[i].msg_hdr.msg_name = &kt_icmp.names[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(kt_icmp.names[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = kt_icmp.cmsg[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(kt_icmp.cmsg[i]);
+        }
+        int n = KT_RECVMMSG(fd, msgs, KTERM_NET_ICMP_BATCH, MSG_DONTWAIT | (errqueue ? MSG_ERRQUEUE : 0));
+        if (n <= 0) break;
+        for (int i = 0; i < n; i++) {
+            KTerm_Icmp_ParseReply(idx, kt_icmp.rx[i], (int)msgs[i].msg_len, &msgs[i].msg_hdr, errqueue);
+        }
+        if (n < KTERM_NET_ICMP_BATCH) break;
+    }
+}
+
+void KTerm_Net_ProcessIcmp(void) {
+    if (!kt_icmp.initialized || kt_icmp.live_count == 0) return;
+
+    if (kt_icmp.queued > 0) {
+        KTerm_Icmp_Flush(0);
+        KTerm_Icmp_Flush(1);
+    }
+
+    for (int idx = 0; idx < 2; idx++) {
+        if (!IS_VALID_SOCKET(kt_icmp.fd[idx])) continue;
+        KTerm_Icmp_Drain(idx, false);
+        if (!kt_icmp.raw[idx]) KTerm_Icmp_Drain(idx, true);
+    }
+
+    double now = KTerm_GetTime();
+    for (int i = 0; i < kt_icmp.live_count; ) {
+        KTermIcmpProbe* p = &kt_icmp.probes[kt_icmp.live[i]];
+        if (p->state != 1 || now < p->deadline) { i++; continue; }
+        KTermIcmpResult res = {0};
+        res.timeout = true;
+        res.icmp_type = -1;
+        KTerm_Icmp_Complete(p, &res);
+    }
+}
+#else
+uint32_t KTerm_Net_IcmpEcho(KTerm* term, KTermSession* session, const void* addr, int addr_len, int ttl, int size, int timeout_ms, KTermIcmpCallback cb, void* user_data) {
+    (void)term; (void)session; (void)addr; (void)addr_len; (void)ttl; (void)size; (void)timeout_ms; (void)cb; (void)user_data;
+    return 0;
+}
+void KTerm_Net_IcmpCancel(uint32_t probe_id) { (void)probe_id; }
+void KTerm_Net_ProcessIcmp(void) {}
+#endif
+
+// --- Helper Functions ---
+
+static KTermNetSession* KTerm_Net_GetContext(KTermSession* session) {
+    if (!session) return NULL;
+    return (KTermNetSession*)session->user_data;
+}
+
+static KTermNetSession* KTerm_Net_CreateContext(KTermSession* session) {
+    if (!session) return NULL;
+    if (session->user_data) return (KTermNetSession*)session->user_data;
+
+    KTermNetSession* net = (KTermNetSession*)malloc(sizeof(KTermNetSession));
+    if (net) {
+        memset(net, 0, sizeof(KTermNetSession));
+        net->socket_fd = INVALID_SOCKET;
+        net->listener_fd = INVALID_SOCKET;
+#ifdef KTERM_USE_LIBSSH
+        net->ssh_session = NULL;
+        net->ssh_channel = NULL;
+#endif
+        net->target_session_index = -1;
+        net->max_retries = 3; // Default
+        net->retry_delay_ms = 1000;
+        session->user_data = net;
+    }
+    return net;
+}
+
+// --- Time-Series Metrics ---
+
+#ifndef KTERM_NET_METRICS_MAX_SERIES
+#define KTERM_NET_METRICS_MAX_SERIES 32 // Per session; the least recently fed series is recycled
+#endif
+#define KTERM_NET_METRICS_HORIZON 300   // Seconds kept, one bucket per second
+#define KTERM_NET_METRICS_HIST_SEC 10   // Seconds per histogram slice
+#define KTERM_NET_METRICS_HIST_SLICES (KTERM_NET_METRICS_HORIZON / KTERM_NET_METRICS_HIST_SEC)
+// HDR histogram over 1 us .. 2^32 us: 2^6 sub-buckets per power of two keep every recorded value
+// within ~3% of the sample, in a fixed 3.5 KB per slice
+#define KTERM_NET_METRICS_SUB_BITS 6
+#define KTERM_NET_METRICS_HALF (1 << (KTERM_NET_METRICS_SUB_BITS - 1))
+#define KTERM_NET_METRICS_HDR_COUNTS ((32 - KTERM_NET_METRICS_SUB_BITS + 2) * KTERM_NET_METRICS_HALF)
+
+typedef struct {
+    int64_t sec;      // Second held, 0 = empty
+    uint32_t count;
+    uint32_t lost;
+    double sum;
+    double min;
+    double max;
+} KTermMetricBucket;
+
+typedef struct {
+    int64_t slice;    // sec / KTERM_NET_METRICS_HIST_SEC, 0 = empty
+    uint32_t counts[KTERM_NET_METRICS_HDR_COUNTS];
+} KTermMetricHist;
+
+typedef struct {
+    char name[64];
+    KTermMetricKind kind;
+    int64_t first_sec;
+    int64_t last_sec;
+    KTermMetricBucket buckets[KTERM_NET_METRICS_HORIZON];
+    KTermMetricHist* hist;  // KTERM_NET_METRICS_HIST_SLICES, latency series only
+} KTermMetricSeries;
+
+typedef struct KTermMetricsStore {
+    KTermMetricSeries* series[KTERM_NET_METRICS_MAX_SERIES];
+    int count;
+    // PacketDiag totals at the last one-second sample
+    double pd_last;
+    uint64_t pd_bytes;
+    uint64_t pd_packets;
+} KTermMetricsStore;
+
+static void KTerm_Metrics_Free(KTermMetricsStore* m) {
+    if (!m) return;
+    for (int i = 0; i < m->count; i++) {
+        free(m->series[i]->hist);
+        free(m->series[i]);
+    }
+    free(m);
+}
+
+static int KTerm_Metrics_Clz64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(v);
+#else
+    int n = 0;
+    while (!(v & (1ULL << 63))) { v <<= 1; n++; }
+    return n;
+#endif
+}
+
+static int KTerm_Metrics_HdrIndex(uint64_t us) {
+    if (us > 0xFFFFFFFFULL) us = 0xFFFFFFFFULL;
+    int bucket = 64 - KTerm_Metrics_Clz64(us | ((1u << KTERM_NET_METRICS_SUB_BITS) - 1)) - KTERM_NET_METRICS_SUB_BITS;
+    int sub = (int)(us >> bucket);
+    return ((bucket + 1) * KTERM_NET_METRICS_HALF) + sub - KTERM_NET_METRICS_HALF;
+}
+
+// Largest value that lands in the same counter
+static uint64_t KTerm_Metrics_HdrValue(int idx) {
+    int bucket = idx / KTERM_NET_METRICS_HALF - 1;
+    int sub = idx;
+    if (bucket > 0) sub = (idx % KTERM_NET_METRICS_HALF) + KTERM_NET_METRICS_HALF;
+    else bucket = 0;
+    return (((uint64_t)sub + 1) << bucket) - 1;
+}
+
+static KTermMetricSeries* KTerm_Metrics_Find(KTermMetricsStore* m, const char* name) {
+    for (int i = 0; i < m->count; i++) {
+        if (strcmp(m->series[i]->name, name) == 0) return m->series[i];
+    }
+    return NULL;
+}
+
+static KTermMetricSeries* KTerm_Metrics_Get(KTermMetricsStore* m, const char* name, KTermMetricKind kind, int64_t sec) {
+    KTermMetricSeries* s = KTerm_Metrics_Find(m, name);
+    if (s) return s;
+
+    if (m->count < KTERM_NET_METRICS_MAX_SERIES) {
+        s = (KTermMetricSeries*)malloc(sizeof(KTermMetricSeries));
+        if (!s) return NULL;
+        m->series[m->count++] = s;
+    } else {
+        // Full: recycle the series fed least recently
+        s = m->series[0];
+        for (int i = 1; i < m->count; i++) {
+            if (m->series[i]->last_sec < s->last_sec) s = m->series[i];
+        }
+        free(s->hist);
+    }
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->kind = kind;
+    s->first_sec = sec;
+    if (kind == KTERM_METRIC_LATENCY) s->hist = (KTermMetricHist*)calloc(KTERM_NET_METRICS_HIST_SLICES, sizeof(KTermMetricHist));
+    return s;
+}
+
+static KTermMetricBucket* KTerm_Metrics_Bucket(KTermMetricSeries* s, int64_t sec) {
+    KTermMetricBucket* b = &s->buckets[sec % KTERM_NET_METRICS_HORIZON];
+    if (b->sec != sec) {
+        memset(b, 0, sizeof(*b));
+        b->sec = sec;
+    }
+    if (sec > s->last_sec) s->last_sec = sec;
+    return b;
+}
+
+// value < 0 records a loss (latency series only)
+static void KTerm_Metrics_RecordAt(KTermMetricsStore* m, const char* name, KTermMetricKind kind, double value, double now) {
+    int64_t sec = (int64_t)now;
+    KTermMetricSeries* s = KTerm_Metrics_Get(m, name, kind, sec);
+    if (!s) return;
+    KTermMetricBucket* b = KTerm_Metrics_Bucket(s, sec);
+    if (value < 0) {
+        b->lost++;
+        return;
+    }
+    if (b->count == 0 || value < b->min) b->min = value;
+    if (b->count == 0 || value > b->max) b->max = value;
+    b->count++;
+    b->sum += value;
+
+    if (s->hist) {
+        int64_t slice = sec / KTERM_NET_METRICS_HIST_SEC;
+        KTermMetricHist* h = &s->hist[slice % KTERM_NET_METRICS_HIST_SLICES];
+        if (h->slice != slice) {
+            memset(h->counts, 0, sizeof(h->counts));
+            h->slice = slice;
+        }
+        h->counts[KTerm_Metrics_HdrIndex((uint64_t)(value * 1000.0 + 0.5))]++;
+    }
+}
+
+static bool KTerm_Metrics_QueryAt(KTermMetricsStore* m, const char* name, int window_sec, double now, KTermMetricsSummary* out) {
+    KTermMetricSeries* s = m ? KTerm_Metrics_Find(m, name) : NULL;
+    if (!s || !out) return false;
+    memset(out, 0, sizeof(*out));
+    out->kind = s->kind;
+
+    if (window_sec < 1) window_sec = 1;
+    if (window_sec > KTERM_NET_METRICS_HORIZON) window_sec = KTERM_NET_METRICS_HORIZON;
+    int64_t sec = (int64_t)now;
+    int64_t from = sec - window_sec + 1;
+    out->window_sec = (int)(sec - (from > s->first_sec ? from : s->first_sec) + 1);
+    if (out->window_sec < 1) out->window_sec = 1;
+
+    for (int64_t t = from; t <= sec; t++) {
+        const KTermMetricBucket* b = &s->buckets[t % KTERM_NET_METRICS_HORIZON];
+        if (b->sec != t) continue;
+        out->lost += b->lost;
+        if (b->count == 0) continue;
+        if (out->samples == 0 || b->min < out->min) out->min = b->min;
+        if (out->samples == 0 || b->max > out->max) out->max = b->max;
+        out->samples += b->count;
+        out->total += b->sum;
+    }
+    if (out->samples) out->mean = out->total / (double)out->samples;
+    out->rate = (s->kind == KTERM_METRIC_COUNTER ? out->total : (double)out->samples) / out->window_sec;
+
+    if (s->hist && out->samples) {
+        // Merge the slices overlapping the window
+        uint32_t merged[KTERM_NET_METRICS_HDR_COUNTS] = {0};
+        uint64_t total = 0;
+        for (int64_t slice = from / KTERM_NET_METRICS_HIST_SEC; slice <= sec / KTERM_NET_METRICS_HIST_SEC; slice++) {
+            const KTermMetricHist* h = &s->hist[slice % KTERM_NET_METRICS_HIST_SLICES];
+            if (h->slice != slice) continue;
+            for (int i = 0; i < KTERM_NET_METRICS_HDR_COUNTS; i++) {
+                merged[i] += h->counts[i];
+                total += h->counts[i];
+            }
+        }
+        const double pct[4] = { 50.0, 90.0, 99.0, 99.9 };
+        double* dst[4] = { &out->p50, &out->p90, &out->p99, &out->p999 };
+        uint64_t seen = 0;
+        int i = 0;
+        for (int p = 0; p < 4 && total; p++) {
+            uint64_t target = (uint64_t)ceil(pct[p] / 100.0 * (double)total);
+            if (target < 1) target = 1;
+            while (i < KTERM_NET_METRICS_HDR_COUNTS - 1 && seen + merged[i] < target) seen += merged[i++];
+            double v = (double)KTerm_Metrics_HdrValue(i) / 1000.0;
+            *dst[p] = v > out->max ? out->max : v;
+        }
+    }
+    return true;
+}
+
+// Bytes of one flow over the window, from its own ring (packet time)
+static bool PacketDiag_FlowRate(KTermPacketDiagContext* ctx, uint32_t flow_id, int window_sec, KTermMetricsSummary* out) {
+    double newest = 0;
+    bool found = false;
+    for (int w = 0; w < PacketDiag_ShardCount(ctx); w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        if (sh->last_ts > newest) newest = sh->last_ts;
+        PacketDiag_UnlockShard(ctx, sh);
+    }
+
+    int slots = (window_sec + KTERM_PACKETDIAG_FLOW_RATE_SEC - 1) / KTERM_PACKETDIAG_FLOW_RATE_SEC;
+    if (slots < 1) slots = 1;
+    if (slots > KTERM_PACKETDIAG_FLOW_RATE_SLOTS) slots = KTERM_PACKETDIAG_FLOW_RATE_SLOTS;
+    uint32_t now_period = (uint32_t)(newest / KTERM_PACKETDIAG_FLOW_RATE_SEC);
+
+    memset(out, 0, sizeof(*out));
+    out->kind = KTERM_METRIC_COUNTER;
+    out->window_sec = slots * KTERM_PACKETDIAG_FLOW_RATE_SEC;
+    for (int w = 0; w < PacketDiag_ShardCount(ctx) && !found; w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        for (uint32_t i = 0; i < sh->flows.used; i++) {
+            const PacketDiagFlow* f = &sh->flows.pool[i];
+            if (!flow_id || f->id != flow_id) continue;
+            for (int k = 0; k < slots; k++) {
+                uint32_t period = now_period - (uint32_t)k;
+                // Slots older than the newest packet of the flow, and not yet overwritten
+                if (period > f->rate_period || f->rate_period - period >= KTERM_PACKETDIAG_FLOW_RATE_SLOTS) continue;
+                uint32_t bytes = f->rate_bytes[period % KTERM_PACKETDIAG_FLOW_RATE_SLOTS];
+                out->total += bytes;
+                if (bytes) out->samples++;
+            }
+            found = true;
+            break;
+        }
+        PacketDiag_UnlockShard(ctx, sh);
+    }
+    out->rate = out->total / out->window_sec;
+    return found;
+}
+
+#ifdef KTERM_ENABLE_PACKETDIAG
+// Once a second, turns the PacketDiag totals into per-second counters
+static void KTerm_Metrics_SamplePacketDiag(KTermMetricsStore* m, KTermPacketDiagContext* ctx, double now) {
+    if (now - m->pd_last < 1.0) return;
+    uint64_t bytes = 0, packets = 0;
+    for (int w = 0; w < PacketDiag_ShardCount(ctx); w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        bytes += sh->stats.total_bytes;
+        packets += sh->stats.total_packets;
+        PacketDiag_UnlockShard(ctx, sh);
+    }
+    if (m->pd_last > 0 && bytes >= m->pd_bytes && packets >= m->pd_packets) {
+        KTerm_Metrics_RecordAt(m, "packetdiag:bytes", KTERM_METRIC_COUNTER, (double)(bytes - m->pd_bytes), now);
+        KTerm_Metrics_RecordAt(m, "packetdiag:packets", KTERM_METRIC_COUNTER, (double)(packets - m->pd_packets), now);
+    }
+    m->pd_last = now;
+    m->pd_bytes = bytes;
+    m->pd_packets = packets;
+}
+#endif // KTERM_ENABLE_PACKETDIAG
+
+static KTermMetricsStore* KTerm_Net_Metrics(KTermSession* session) {
+    KTermNetSession* net = KTerm_Net_CreateContext(session);
+    if (!net) return NULL;
+    if (!net->metrics) net->metrics = (KTermMetricsStore*)calloc(1, sizeof(KTermMetricsStore));
+    return net->metrics;
+}
+
+void KTerm_Net_Metrics_Record(KTerm* term, KTermSession* session, const char* series, double ms) {
+    (void)term;
+    KTermMetricsStore* m = KTerm_Net_Metrics(session);
+    if (m && series) KTerm_Metrics_RecordAt(m, series, KTERM_METRIC_LATENCY, ms < 0 ? 0 : ms, KTerm_GetTime());
+}
+
+void KTerm_Net_Metrics_RecordLoss(KTerm* term, KTermSession* session, const char* series) {
+    (void)term;
+    KTermMetricsStore* m = KTerm_Net_Metrics(session);
+    if (m && series) KTerm_Metrics_RecordAt(m, series, KTERM_METRIC_LATENCY, -1.0, KTerm_GetTime());
+}
+
+void KTerm_Net_Metrics_Add(KTerm* term, KTermSession* session, const char* series, double amount) {
+    (void)term;
+    KTermMetricsStore* m = KTerm_Net_Metrics(session);
+    if (m && series && amount >= 0) KTerm_Metrics_RecordAt(m, series, KTERM_METRIC_COUNTER, amount, KTerm_GetTime());
+}
+
+bool KTerm_Net_Metrics_Query(KTerm* term, KTermSession* session, const char* series, int window_sec, KTermMetricsSummary* out) {
+    (void)term;
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    if (!net || !series || !out) return false;
+    if (strncmp(series, "flow:", 5) == 0) {
+        return net->packetdiag && PacketDiag_FlowRate(net->packetdiag, (uint32_t)strtoul(series + 5, NULL, 10), window_sec, out);
+    }
+    return KTerm_Metrics_QueryAt(net->metrics, series, window_sec, KTerm_GetTime(), out);
+}
+
+// ICMP probes of every kind feed one "icmp:<address>" series per destination
+static void KTerm_Net_Metrics_Icmp(KTerm* term, KTermSession* session, const struct sockaddr_in* addr, bool received, double rtt) {
+    char series[64] = "icmp:";
+    inet_ntop(AF_INET, &addr->sin_addr, series + 5, sizeof(series) - 5);
+    if (received) KTerm_Net_Metrics_Record(term, session, series, rtt);
+    else KTerm_Net_Metrics_RecordLoss(term, session, series);
+}
+
+int KTerm_Net_Metrics_List(KTerm* term, KTermSession* session, char* out, size_t max) {
+    (void)term;
+    if (!out || max == 0) return 0;
+    out[0] = '\0';
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    if (!net || !net->metrics) return 0;
+    size_t offset = 0;
+    for (int i = 0; i < net->metrics->count; i++) {
+        int n = snprintf(out + offset, max - offset, "%s|", net->metrics->series[i]->name);
+        if (n < 0 || offset + n >= max) { out[offset] = '\0'; break; }
+        offset += n;
+    }
+    return net->metrics->count;
+}
+
+void KTerm_Net_FreeTraceroute(KTermTracerouteContext* ctx) {
+    if (!ctx) return;
+    KTerm_Net_ResolveCancel(ctx->dns_req_id);
+    if (ctx->hops) {
+        for (int i = 0; i < ctx->max_hops; i++) KTerm_Net_IcmpCancel(ctx->hops[i].probe_id);
+        free(ctx->hops);
+    }
+#ifdef _WIN32
+    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
+    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+#endif
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreeResponseTime(KTermResponseTimeContext* ctx) {
+    if (!ctx) return;
+    KTerm_Net_IcmpCancel(ctx->probe_id);
+#ifdef _WIN32
+    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
+    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+#endif
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreePortScan(KTermPortScanContext* ctx) {
+    if (!ctx) return;
+    KTerm_Net_ResolveCancel(ctx->dns_req_id);
+    if (ctx->probes) {
+        for (int i = 0; i < ctx->in_flight; i++) {
+            if (IS_VALID_SOCKET(ctx->probes[i].fd)) CLOSE_SOCKET(ctx->probes[i].fd);
+        }
+        free(ctx->probes);
+    }
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreeWhois(KTermWhoisContext* ctx) {
+    if (!ctx) return;
+    KTerm_Net_ResolveCancel(ctx->dns_req_id);
+    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+static void KTerm_Speedtest_JoinWorkers(KTermSpeedtestContext* st);
+
+void KTerm_Net_FreeSpeedtest(KTermSpeedtestContext* ctx) {
+    if (!ctx) return;
+    KTerm_Speedtest_JoinWorkers(ctx);
+    for(int i=0; i<ctx->num_streams; i++) {
+        if (IS_VALID_SOCKET(ctx->streams[i].fd)) CLOSE_SOCKET(ctx->streams[i].fd);
+    }
+    if (IS_VALID_SOCKET(ctx->config_fd)) CLOSE_SOCKET(ctx->config_fd);
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreeHttpProbe(KTermHttpProbeContext* ctx) {
+    if (!ctx) return;
+    for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) {
+        KTerm_Net_ResolveCancel(ctx->pool[i].dns_req_id);
+        if (ctx->pool[i].state != 0 && IS_VALID_SOCKET(ctx->pool[i].fd)) CLOSE_SOCKET(ctx->pool[i].fd);
+    }
+    free(ctx->reqs);
+    free(ctx);
+}
+
+void KTerm_Net_FreeMtuProbe(KTermMtuProbeContext* ctx) {
+    if (!ctx) return;
+    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
+#ifdef _WIN32
+    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
+    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+#endif
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreeFragTest(KTermFragTestContext* ctx) {
+    if (!ctx) return;
+    if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
+#ifdef _WIN32
+    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
+    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+#endif
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreePingExt(KTermPingExtContext* ctx) {
+    if (!ctx) return;
+    KTerm_Net_IcmpCancel(ctx->probe_id);
+#ifdef _WIN32
+    if (ctx->icmp_handle != INVALID_HANDLE_VALUE) IcmpCloseHandle(ctx->icmp_handle);
+    if (ctx->icmp_event) CloseHandle(ctx->icmp_event);
+#endif
+    if (ctx->user_data && ctx->free_user_data) free(ctx->user_data);
+    free(ctx);
+}
+
+void KTerm_Net_FreePacketDiag(KTermPacketDiagContext* ctx) {
+    if (!ctx) return;
+    if (ctx->running) {
+        // Should have been stopped, but just in case
+        ctx->running = false;
+        // Handle closing in Stop
+    }
+
+    // Cleanup Flows and worker rings (workers are joined in Stop)
+    for (int w = 0; w < KTERM_PACKETDIAG_MAX_WORKERS; w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_FlowTableFree(&sh->flows);
+        free(sh->ring);
+        sh->ring = NULL;
+        for (int r = 0; r < KTERM_PACKETDIAG_REASM_SLOTS; r++) {
+            free(sh->reasm[r].data);
+            sh->reasm[r].data = NULL;
+        }
+        if (w < ctx->worker_count) {
+#ifndef _WIN32
+            pthread_mutex_destroy(&sh->mutex);
+#else
+            DeleteCriticalSection(&sh->mutex);
+#endif
+        }
+    }
+
+#ifndef _WIN32
+    pthread_mutex_destroy(&ctx->mutex);
+#else
+    DeleteCriticalSection(&ctx->mutex);
+#endif
+
+    // Recording and replay files (threads are joined in Stop)
+    if (ctx->record_ring) {
+        if (ctx->record_fd >= 0) close(ctx->record_fd);
+        free(ctx->record_ring);
+    }
+    if (ctx->replay.f) fclose(ctx->replay.f);
+    free(ctx->replay.buf);
+    if (ctx->follow_file) fclose(ctx->follow_file);
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+    if (ctx->tpacket) PacketDiag_TPacketClose(ctx);
+#endif
+
+    // Handle is closed in Stop
+    free(ctx);
+}
+
+static void KTerm_Net_DestroyContext(KTermSession* session) {
     if (!session || !session->user_data) return;
     KTermNetSession* net = (KTermNetSession*)session->user_data;
 
@@ -1192,6 +3379,9 @@ static void KTerm_Net_DestroyContext(KTermSession* session) {
         KTerm_Net_FreePacketDiag(net->packetdiag);
         net->packetdiag = NULL;
     }
+    if (net->metrics) { KTerm_Metrics_Free(net->metrics); net->metrics = NULL; }
+
+    KTerm_Net_ResolveCancel(net->dns_req_id);
 
     if (net->security.close) {
         net->security.close(net->security.ctx);
@@ -1233,6 +3423,19 @@ static void KTerm_Net_DestroyContext(KTermSession* session) {
     session->user_data = NULL;
 }
 
+// Session table lookups (slots are allocated on demand and may be NULL)
+static int KTerm_Net_SessionIndex(KTerm* term, KTermSession* session) {
+    for (int i = 0; i < term->session_capacity; i++) {
+        if (term->sessions[i] == session) return i;
+    }
+    return -1;
+}
+
+static KTermSession* KTerm_Net_SessionAt(KTerm* term, int index) {
+    if (index < 0 || index >= term->session_capacity) return NULL;
+    return term->sessions[index];
+}
+
 static void KTerm_Net_Log(KTerm* term, int session_idx, const char* msg) {
     KTerm_WriteCharToSession(term, session_idx, '\r');
     KTerm_WriteCharToSession(term, session_idx, '\n');
@@ -1242,7 +3445,7 @@ static void KTerm_Net_Log(KTerm* term, int session_idx, const char* msg) {
 }
 
 static void KTerm_Net_TriggerError(KTerm* term, KTermSession* session, KTermNetSession* net, const char* msg) {
-    KTerm_Net_Log(term, (int)(session - term->sessions), msg);
+    KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), msg);
     if (net) snprintf(net->last_error, sizeof(net->last_error), "%s", msg);
 
     // Retry Logic for Connection Errors
@@ -1256,7 +3459,7 @@ static void KTerm_Net_TriggerError(KTerm* term, KTermSession* session, KTermNetS
             }
             char retry_msg[64];
             snprintf(retry_msg, sizeof(retry_msg), "Retrying (%d/%d)...", net->retry_count, net->max_retries);
-            KTerm_Net_Log(term, (int)(session - term->sessions), retry_msg);
+            KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), retry_msg);
 
             // Reset start time to give retry a fresh window
             net->connect_start_time = time(NULL);
@@ -1270,6 +3473,43 @@ static void KTerm_Net_TriggerError(KTerm* term, KTermSession* session, KTermNetS
     }
 }
 
+// Accounts one finished probe (reply or loss) and moves on to the next send.
+static void KTerm_PingExt_Record(KTerm* term, KTermSession* session, KTermPingExtContext* ctx, bool received, double rtt) {
+    KTerm_Net_Metrics_Icmp(term, session, &ctx->dest_addr, received, rtt);
+    if (received) {
+        ctx->received++;
+        if (rtt < ctx->rtt_min) ctx->rtt_min = rtt;
+        if (rtt > ctx->rtt_max) ctx->rtt_max = rtt;
+        ctx->rtt_sum += rtt;
+        ctx->rtt_sq_sum += (rtt * rtt);
+
+        if (rtt <= 10) ctx->h_0_10++;
+        else if (rtt <= 20) ctx->h_10_20++;
+        else if (rtt <= 50) ctx->h_20_50++;
+        else if (rtt <= 100) ctx->h_50_100++;
+        else ctx->h_100_plus++;
+
+        if (ctx->graph && ctx->graph_idx < 63) ctx->graph_buf[ctx->graph_idx++] = '.';
+    } else {
+        if (ctx->graph && ctx->graph_idx < 63) ctx->graph_buf[ctx->graph_idx++] = 'X';
+    }
+    ctx->state = 3; // Next
+}
+
+#ifdef __linux__
+static void KTerm_Net_OnPingExtEcho(KTerm* term, KTermSession* session, const KTermIcmpResult* result, void* user_data) {
+    KTermPingExtContext* ctx = (KTermPingExtContext*)user_data;
+    ctx->probe_id = 0;
+    gettimeofday(&ctx->last_complete_time, NULL);
+    if (result->error[0]) {
+        ctx->state = 5; // DONE
+        if (ctx->callback) { KTermPingExtResult r = {0}; r.done = true; r.sent = ctx->sent; r.lost = ctx->sent; ctx->callback(term, session, &r, ctx->user_data); }
+        return;
+    }
+    KTerm_PingExt_Record(term, session, ctx, result->success && result->reached, result->rtt_ms);
+}
+#endif
+
 static void KTerm_Net_ProcessPingExt(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->ping_ext) return;
@@ -1279,14 +3519,7 @@ static void KTerm_Net_ProcessPingExt(KTerm* term, KTermSession* session) {
 
     if (ctx->state == 2) { // SOCKET
 #ifdef __linux__
-        ctx->sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
-        ctx->is_raw = false;
-        if (ctx->sockfd < 0) {
-             ctx->sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-             ctx->is_raw = true;
-        }
-        if (ctx->sockfd < 0) { ctx->state = 5; if(ctx->callback){ KTermPingExtResult r={0}; r.done=true; ctx->callback(term, session, &r, ctx->user_data); } return; }
-        fcntl(ctx->sockfd, F_SETFL, fcntl(ctx->sockfd, F_GETFL, 0) | O_NONBLOCK);
+        // Nothing to open: probes share the ICMP engine's socket
 #elif defined(_WIN32)
         ctx->icmp_handle = IcmpCreateFile();
         if (ctx->icmp_handle == INVALID_HANDLE_VALUE) { ctx->state = 5; return; }
@@ -1345,21 +3578,11 @@ static void KTerm_Net_ProcessPingExt(KTerm* term, KTermSession* session) {
 
         // Send Packet
 #ifdef __linux__
-        int payload_len = ctx->size;
-        if (payload_len < 8) payload_len = 8;
-        char* packet = (char*)calloc(1, payload_len);
-        struct icmphdr* icmp = (struct icmphdr*)packet;
-        icmp->type = ICMP_ECHO;
-        icmp->code = 0;
-        icmp->un.echo.id = htons(getpid() & 0xFFFF);
-        icmp->un.echo.sequence = htons(ctx->sent + 1);
-        if (ctx->is_raw) icmp->checksum = KTerm_Checksum(packet, payload_len);
-
         gettimeofday(&ctx->probe_start_time, NULL);
-        sendto(ctx->sockfd, packet, payload_len, 0, (struct sockaddr*)&ctx->dest_addr, sizeof(ctx->dest_addr));
-        free(packet);
+        ctx->probe_id = KTerm_Net_IcmpEcho(term, session, &ctx->dest_addr, sizeof(ctx->dest_addr), 0, ctx->size, 1000, KTerm_Net_OnPingExtEcho, ctx);
         ctx->sent++;
-        ctx->state = 4; // WAIT
+        if (ctx->probe_id) ctx->state = 4; // WAIT
+        else KTerm_PingExt_Record(term, session, ctx, false, 0); // Engine full: count as loss
 #elif defined(_WIN32)
         int payload_len = ctx->size;
         void* payload = calloc(1, payload_len > 0 ? payload_len : 1);
@@ -1392,74 +3615,25 @@ static void KTerm_Net_ProcessPingExt(KTerm* term, KTermSession* session) {
 #endif
     }
     else if (ctx->state == 4) { // WAIT
-        bool received = false;
-        double rtt = 0;
-        bool timeout = false;
-
-#ifdef __linux__
-        char buf[1024];
-        struct sockaddr_in r_addr;
-        socklen_t addr_len = sizeof(r_addr);
-        int n = recvfrom(ctx->sockfd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*)&r_addr, &addr_len);
-        if (n > 0) {
-             struct icmphdr* icmp = NULL;
-             if (ctx->is_raw) {
-                 if (n >= 20) icmp = (struct icmphdr*)(buf + 20);
-             } else {
-                 icmp = (struct icmphdr*)buf;
-             }
-             if (icmp && icmp->type == ICMP_ECHOREPLY) {
-                 struct timeval now; gettimeofday(&now, NULL);
-                 rtt = (now.tv_sec - ctx->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - ctx->probe_start_time.tv_usec) / 1000.0;
-                 received = true;
-                 ctx->last_complete_time = now;
-             }
-        } else {
-             struct timeval now; gettimeofday(&now, NULL);
-             if ((now.tv_sec - ctx->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - ctx->probe_start_time.tv_usec) / 1000.0 > 1000.0) {
-                 timeout = true;
-                 ctx->last_complete_time = now;
-             }
-        }
-#elif defined(_WIN32)
+#ifdef _WIN32
         if (WaitForSingleObject(ctx->icmp_event, 0) == WAIT_OBJECT_0) {
              PICMP_ECHO_REPLY reply = (PICMP_ECHO_REPLY)ctx->reply_buffer;
+             ctx->last_complete_time.tv_sec = (long)GetTickCount();
              if (reply->Status == IP_SUCCESS) {
-                 rtt = (double)reply->RoundTripTime;
+                 double rtt = (double)reply->RoundTripTime;
                  if (rtt < 1.0) rtt = 1.0;
-                 received = true;
+                 KTerm_PingExt_Record(term, session, ctx, true, rtt);
              } else {
-                 timeout = true; // Error reply treated as loss for now
+                 KTerm_PingExt_Record(term, session, ctx, false, 0); // Error reply treated as loss for now
              }
-             ctx->last_complete_time.tv_sec = (long)GetTickCount();
         } else {
              if (GetTickCount() - (DWORD)ctx->probe_start_time.tv_sec > 1000) {
-                 timeout = true;
                  ctx->last_complete_time.tv_sec = (long)GetTickCount();
+                 KTerm_PingExt_Record(term, session, ctx, false, 0);
              }
         }
 #endif
-
-        if (received) {
-            ctx->received++;
-            if (rtt < ctx->rtt_min) ctx->rtt_min = rtt;
-            if (rtt > ctx->rtt_max) ctx->rtt_max = rtt;
-            ctx->rtt_sum += rtt;
-            ctx->rtt_sq_sum += (rtt * rtt);
-
-            if (rtt <= 10) ctx->h_0_10++;
-            else if (rtt <= 20) ctx->h_10_20++;
-            else if (rtt <= 50) ctx->h_20_50++;
-            else if (rtt <= 100) ctx->h_50_100++;
-            else ctx->h_100_plus++;
-
-            if (ctx->graph && ctx->graph_idx < 63) ctx->graph_buf[ctx->graph_idx++] = '.';
-
-            ctx->state = 3; // Next
-        } else if (timeout) {
-            if (ctx->graph && ctx->graph_idx < 63) ctx->graph_buf[ctx->graph_idx++] = 'X';
-            ctx->state = 3; // Next
-        }
+        // Linux: completed by KTerm_Net_OnPingExtEcho
     }
 }
 
@@ -1475,7 +3649,7 @@ static int KTerm_Net_GetLocalMTU(struct sockaddr_in* dest_addr) {
             mtu = ifRow.dwMtu;
         }
     }
-#else
+#elif defined(IFNAMSIZ) // struct ifreq is hidden in strict POSIX builds
     socket_t s = socket(AF_INET, SOCK_DGRAM, 0);
     if (IS_VALID_SOCKET(s)) {
         if (connect(s, (struct sockaddr*)dest_addr, sizeof(*dest_addr)) == 0) {
@@ -1505,6 +3679,8 @@ static int KTerm_Net_GetLocalMTU(struct sockaddr_in* dest_addr) {
         }
         CLOSE_SOCKET(s);
     }
+#else
+    (void)dest_addr;
 #endif
     return mtu > 0 ? mtu : 1500;
 }
@@ -1804,7 +3980,7 @@ static void KTerm_Net_ProcessFragTest(KTerm* term, KTermSession* session) {
 }
 
 static void KTerm_Net_ProcessFrame(KTerm* term, KTermSession* session, KTermNetSession* net, uint8_t type, const char* payload, size_t len) {
-    int target_idx = (net->target_session_index != -1) ? net->target_session_index : (int)(session - term->sessions);
+    int target_idx = (net->target_session_index != -1) ? net->target_session_index : KTerm_Net_SessionIndex(term, session);
 
     if (type == KTERM_PKT_DATA) {
         bool handled = false;
@@ -1819,7 +3995,7 @@ static void KTerm_Net_ProcessFrame(KTerm* term, KTermSession* session, KTermNetS
         uint32_t w = ((uint8_t)payload[0] << 24) | ((uint8_t)payload[1] << 16) | ((uint8_t)payload[2] << 8) | (uint8_t)payload[3];
         uint32_t h = ((uint8_t)payload[4] << 24) | ((uint8_t)payload[5] << 16) | ((uint8_t)payload[6] << 8) | (uint8_t)payload[7];
         KTerm_Resize(term, (int)w, (int)h);
-        KTerm_Net_Log(term, (int)(session - term->sessions), "Remote Resize Request Applied");
+        KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), "Remote Resize Request Applied");
     }
     else if (type == KTERM_PKT_GATEWAY) {
         // Inject Gateway Command
@@ -1838,17 +4014,18 @@ static void KTerm_Net_ProcessFrame(KTerm* term, KTermSession* session, KTermNetS
     }
     else if (type == KTERM_PKT_ATTACH && len >= 1) {
         int new_session_id = (unsigned char)payload[0];
-        if (new_session_id >= 0 && new_session_id < 4) {
+        if (new_session_id >= 0 && new_session_id < term->session_capacity) {
             net->target_session_index = new_session_id;
             char msg[64];
             snprintf(msg, sizeof(msg), "Attached to Session %d", new_session_id);
-            KTerm_Net_Log(term, (int)(session - term->sessions), msg);
+            KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), msg);
         }
     }
     else if (type == KTERM_PKT_AUDIO_VOICE) {
 #ifndef KTERM_DISABLE_VOICE
-        KTermSession* target_session = &term->sessions[target_idx];
-        KTerm_Voice_ProcessPlayback(target_session, payload, len);
+        KTermSession* target_session = KTerm_Net_SessionAt(term, target_idx);
+        // Each connection is its own origin, so its talkers get their own mixer sources
+        if (target_session) KTerm_Voice_ProcessPlaybackFrom(target_session, (uint32_t)KTerm_Net_SessionIndex(term, session), payload, len);
 #endif
     }
     else if (type == KTERM_PKT_AUDIO_COMMAND) {
@@ -1943,6 +4120,10 @@ void KTerm_Net_Connect(KTerm* term, KTermSession* session, const char* host, int
     if (password) strncpy(net->password, password, sizeof(net->password)-1);
     else net->password[0] = '\0';
 
+    KTerm_Net_ResolveCancel(net->dns_req_id);
+    net->dns_req_id = 0;
+    net->dns_state = 0;
+
     net->state = KTERM_NET_STATE_RESOLVING;
     net->is_server = false;
     net->tx_head = 0; net->tx_tail = 0;
@@ -1950,7 +4131,7 @@ void KTerm_Net_Connect(KTerm* term, KTermSession* session, const char* host, int
 #ifndef KTERM_DISABLE_TELNET
     net->telnet_state = TELNET_STATE_NORMAL;
 #endif
-    net->target_session_index = (int)(session - term->sessions);
+    net->target_session_index = KTerm_Net_SessionIndex(term, session);
 
     // Hardening Init
     net->connect_start_time = time(NULL);
@@ -1978,7 +4159,7 @@ void KTerm_Net_Listen(KTerm* term, KTermSession* session, int port) {
     net->listener_fd = INVALID_SOCKET;
     net->is_server = true;
     net->port = port;
-    net->target_session_index = (int)(session - term->sessions);
+    net->target_session_index = KTerm_Net_SessionIndex(term, session);
 
     net->listener_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (!IS_VALID_SOCKET(net->listener_fd)) { KTerm_Net_TriggerError(term, session, net, "Socket Creation Failed"); return; }
@@ -2010,7 +4191,7 @@ void KTerm_Net_Listen(KTerm* term, KTermSession* session, int port) {
 #endif
 
     net->state = KTERM_NET_STATE_LISTENING;
-    KTerm_Net_Log(term, (int)(session - term->sessions), "Listening...");
+    KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), "Listening...");
 }
 
 
@@ -2050,8 +4231,9 @@ void KTerm_Net_DumpConnections(KTerm* term, char* buffer, size_t max_len) {
     buffer[0] = '\0';
     size_t offset = 0;
 
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTermSession* session = &term->sessions[i];
+    for (int i = 0; i < term->session_capacity; i++) {
+        KTermSession* session = term->sessions[i];
+        if (!session) continue;
         KTermNetSession* net = KTerm_Net_GetContext(session);
         if (!net) continue;
 
@@ -2076,7 +4258,7 @@ void KTerm_Net_DumpConnections(KTerm* term, char* buffer, size_t max_len) {
             if (offset >= max_len) return;
         }
         if (net->port_scan) {
-            int n = snprintf(buffer + offset, max_len - offset, "[%d:SCAN] HOST=%s;PORT=%d;STATE=%d|", i, net->port_scan->host, net->port_scan->current_port, net->port_scan->state);
+            int n = snprintf(buffer + offset, max_len - offset, "[%d:SCAN] HOST=%s;DONE=%d;INFLIGHT=%d;OPEN=%d;STATE=%d|", i, net->port_scan->host, net->port_scan->scanned, net->port_scan->in_flight, net->port_scan->open_count, net->port_scan->state);
             if (n > 0) offset += n;
             if (offset >= max_len) return;
         }
@@ -2086,7 +4268,9 @@ void KTerm_Net_DumpConnections(KTerm* term, char* buffer, size_t max_len) {
             if (offset >= max_len) return;
         }
         if (net->http_probe) {
-            int n = snprintf(buffer + offset, max_len - offset, "[%d:HTTP] HOST=%s;STATE=%d|", i, net->http_probe->host, net->http_probe->state);
+            int conns = 0;
+            for (int c = 0; c < KTERM_NET_HTTP_POOL_SIZE; c++) if (net->http_probe->pool[c].state != 0) conns++;
+            int n = snprintf(buffer + offset, max_len - offset, "[%d:HTTP] PENDING=%d;CONNS=%d|", i, net->http_probe->pending, conns);
             if (n > 0) offset += n;
             if (offset >= max_len) return;
         }
@@ -2165,7 +4349,7 @@ intptr_t KTerm_Net_GetSocket(KTerm* term, KTermSession* session) {
 
 void KTerm_Net_SetTargetSession(KTerm* term, KTermSession* session, int target_idx) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
-    if (net && target_idx >= 0 && target_idx < 4) {
+    if (net && KTerm_AcquireSession(term, target_idx)) { // Bounds-checks against KTERM_SESSION_LIMIT
         net->target_session_index = target_idx;
     }
 }
@@ -2203,6 +4387,40 @@ static unsigned short KTerm_Checksum(void *b, int len) {
     return result;
 }
 
+#ifdef __linux__
+static void KTerm_Net_OnResponseTimeEcho(KTerm* term, KTermSession* session, const KTermIcmpResult* result, void* user_data) {
+    KTermResponseTimeContext* rt = (KTermResponseTimeContext*)user_data;
+    rt->probe_id = 0;
+    gettimeofday(&rt->last_complete_time, NULL);
+
+    if (result->error[0]) {
+        rt->state = 4;
+        ResponseTimeResult res = {0};
+        res.sent = rt->sent_count;
+        res.received = rt->recv_count;
+        res.lost = rt->count; // All lost/failed
+        if (rt->callback) rt->callback(term, session, &res, rt->user_data);
+        return;
+    }
+
+    if (result->success && result->reached) {
+        double rtt = result->rtt_ms;
+        if (rt->recv_count == 0) {
+            rt->rtt_min = rtt;
+            rt->rtt_max = rtt;
+        } else {
+            if (rtt < rt->rtt_min) rt->rtt_min = rtt;
+            if (rtt > rt->rtt_max) rt->rtt_max = rtt;
+        }
+        rt->rtt_sum += rtt;
+        rt->rtt_sq_sum += (rtt * rtt);
+        rt->recv_count++;
+    }
+    KTerm_Net_Metrics_Icmp(term, session, &rt->dest_addr, result->success && result->reached, result->rtt_ms);
+    rt->state = 2; // Next Probe (timeouts and ICMP errors count as loss)
+}
+#endif
+
 static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->response_time) return;
@@ -2211,7 +4429,7 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
     if (rt->state == 4) return; // DONE
 
 #ifdef __linux__
-    // Linux Implementation using RAW/DGRAM Socket (ICMP)
+    // Linux Implementation using the shared ICMP engine (replies arrive via KTerm_Net_OnResponseTimeEcho)
     if (rt->state == 2) { // SEND
         if (rt->sent_count >= rt->count) {
              rt->state = 4; // DONE
@@ -2242,23 +4460,9 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
             if (elapsed < rt->interval_ms) return;
         }
 
-        struct icmphdr icmp_hdr;
-        memset(&icmp_hdr, 0, sizeof(icmp_hdr));
-        icmp_hdr.type = ICMP_ECHO;
-        icmp_hdr.code = 0;
-        icmp_hdr.un.echo.id = htons(getpid() & 0xFFFF);
-        icmp_hdr.un.echo.sequence = htons(rt->sent_count + 1);
-        icmp_hdr.checksum = 0;
-
-        if (rt->is_raw) {
-            icmp_hdr.checksum = KTerm_Checksum(&icmp_hdr, sizeof(icmp_hdr));
-        }
-
-        gettimeofday(&rt->probe_start_time, NULL);
-
-        if (sendto(rt->sockfd, &icmp_hdr, sizeof(icmp_hdr), 0, (struct sockaddr*)&rt->dest_addr, sizeof(rt->dest_addr)) < 0) {
-             // Handle error (e.g. Permission Denied)
-             // Retry or fail?
+        rt->probe_start_time = now;
+        rt->probe_id = KTerm_Net_IcmpEcho(term, session, &rt->dest_addr, sizeof(rt->dest_addr), 0, 8, rt->timeout_ms, KTerm_Net_OnResponseTimeEcho, rt);
+        if (!rt->probe_id) {
              rt->state = 4;
              ResponseTimeResult res = {0};
              res.sent = rt->sent_count;
@@ -2270,62 +4474,6 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
         rt->sent_count++;
         rt->state = 3; // WAIT
     }
-    else if (rt->state == 3) { // WAIT
-        char buf[1024];
-        struct sockaddr_in r_addr;
-        socklen_t addr_len = sizeof(r_addr);
-
-        // Non-blocking recv
-        int n = recvfrom(rt->sockfd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*)&r_addr, &addr_len);
-        if (n > 0) {
-            struct icmphdr* icmp_hdr = NULL;
-
-            if (rt->is_raw) {
-                // SOCK_RAW includes IP header
-                if (n >= 20) { // Min IP header
-                    int ip_len = (buf[0] & 0x0F) * 4;
-                    if (n >= ip_len + (int)sizeof(struct icmphdr)) {
-                        icmp_hdr = (struct icmphdr*)(buf + ip_len);
-                    }
-                }
-            } else {
-                // SOCK_DGRAM strips IP header
-                if (n >= (int)sizeof(struct icmphdr)) {
-                    icmp_hdr = (struct icmphdr*)buf;
-                }
-            }
-
-            if (icmp_hdr && icmp_hdr->type == ICMP_ECHOREPLY) {
-                 // Success
-                 struct timeval now;
-                 gettimeofday(&now, NULL);
-                 double rtt = (now.tv_sec - rt->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - rt->probe_start_time.tv_usec) / 1000.0;
-
-                 if (rt->recv_count == 0) {
-                     rt->rtt_min = rtt;
-                     rt->rtt_max = rtt;
-                 } else {
-                     if (rtt < rt->rtt_min) rt->rtt_min = rtt;
-                     if (rtt > rt->rtt_max) rt->rtt_max = rtt;
-                 }
-                 rt->rtt_sum += rtt;
-                 rt->rtt_sq_sum += (rtt * rtt);
-                 rt->recv_count++;
-
-                 rt->last_complete_time = now;
-                 rt->state = 2; // Next Probe
-            }
-        } else {
-             struct timeval now;
-             gettimeofday(&now, NULL);
-             double elapsed = (now.tv_sec - rt->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - rt->probe_start_time.tv_usec) / 1000.0;
-             if (elapsed > rt->timeout_ms) {
-                 // Timeout
-                 rt->last_complete_time = now;
-                 rt->state = 2; // Next Probe
-             }
-        }
-    }
 #elif defined(_WIN32)
     if (rt->state == 2) { // SEND
         if (rt->sent_count >= rt->count) {
@@ -2409,6 +4557,7 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
                  rt->rtt_sq_sum += (rtt * rtt);
                  rt->recv_count++;
              }
+             KTerm_Net_Metrics_Icmp(term, session, &rt->dest_addr, reply->Status == IP_SUCCESS, reply->RoundTripTime < 1 ? 1.0 : (double)reply->RoundTripTime);
 
              rt->last_complete_time.tv_sec = (long)GetTickCount();
              rt->state = 2; // Next Probe
@@ -2417,6 +4566,7 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
              DWORD now = GetTickCount();
              if (now - (DWORD)rt->probe_start_time.tv_sec > (DWORD)rt->timeout_ms + 100) { // +100 grace
                  rt->last_complete_time.tv_sec = (long)GetTickCount();
+                 KTerm_Net_Metrics_Icmp(term, session, &rt->dest_addr, false, 0);
                  rt->state = 2; // Next Probe (Timeout treated as loss)
              }
         }
@@ -2432,6 +4582,41 @@ static void KTerm_Net_ProcessResponseTime(KTerm* term, KTermSession* session) {
 #endif
 }
 
+#ifdef __linux__
+static void KTerm_Net_OnTracerouteEcho(KTerm* term, KTermSession* session, const KTermIcmpResult* result, void* user_data) {
+    (void)term; (void)session;
+    KTermTracerouteContext* tr = (KTermTracerouteContext*)user_data;
+    int hop = result->ttl;
+    if (hop < 1 || hop > tr->max_hops) return;
+    KTermTraceHop* h = &tr->hops[hop - 1];
+    h->probe_id = 0;
+    if (result->success) {
+        h->status = 1;
+        h->reached = result->reached;
+        h->rtt_ms = result->rtt_ms;
+        snprintf(h->ip, sizeof(h->ip), "%s", result->from);
+        if (h->reached && (tr->reached_hop == 0 || hop < tr->reached_hop)) tr->reached_hop = hop;
+    } else {
+        h->status = 2; // TIMEOUT (or send failure)
+    }
+}
+
+// Ends a round: drops probes for hops beyond the destination and loops or finishes.
+static void KTerm_Net_TracerouteEndRound(KTermTracerouteContext* tr) {
+    for (int i = 0; i < tr->max_hops; i++) {
+        KTerm_Net_IcmpCancel(tr->hops[i].probe_id);
+        tr->hops[i].probe_id = 0;
+    }
+    if (tr->continuous) {
+        tr->current_ttl = 1;
+        tr->state = 5; // WAIT_LOOP
+        gettimeofday(&tr->probe_start_time, NULL);
+    } else {
+        tr->state = 4; // DONE
+    }
+}
+#endif
+
 static void KTerm_Net_ProcessTraceroute(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->traceroute) return;
@@ -2440,111 +4625,43 @@ static void KTerm_Net_ProcessTraceroute(KTerm* term, KTermSession* session) {
     if (tr->state == 4) return; // DONE
 
 #ifdef __linux__
-    // Linux Implementation using IP_RECVERR
-    if (tr->state == 1) { // RESOLVE
-        // Done in Start (blocking for now)
-        tr->state = 2;
-    }
+    // Linux Implementation: every hop of a round is probed at once through the ICMP engine
+    // (one TTL-tagged echo per hop, flushed in a single sendmmsg), then reported in hop order.
+    if (tr->state == 1) return; // RESOLVE (completed by KTerm_Net_OnTracerouteResolved)
 
     if (tr->state == 2) { // SEND
-        if (tr->current_ttl > tr->max_hops) {
-             if (tr->continuous) {
-                 tr->current_ttl = 1;
-                 tr->state = 5; // WAIT_LOOP
-                 gettimeofday(&tr->probe_start_time, NULL);
-                 return;
-             }
-             tr->state = 4; // DONE
-             // Optional: Callback with hop=0 to signal finish?
-             return;
+        if (!tr->hops) {
+            tr->hops = (KTermTraceHop*)calloc(tr->max_hops, sizeof(KTermTraceHop));
+            if (!tr->hops) {
+                if (tr->callback) tr->callback(term, session, 0, "ERR;OUT_OF_MEMORY", 0, true, tr->user_data);
+                tr->state = 4;
+                return;
+            }
         }
-
-        int ttl = tr->current_ttl;
-        if (setsockopt(tr->sockfd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) < 0) {
-             // Handle error
+        memset(tr->hops, 0, tr->max_hops * sizeof(KTermTraceHop));
+        tr->next_report = 1;
+        tr->reached_hop = 0;
+        for (int hop = 1; hop <= tr->max_hops; hop++) {
+            tr->hops[hop - 1].probe_id = KTerm_Net_IcmpEcho(term, session, &tr->dest_addr, sizeof(tr->dest_addr), hop, 64, tr->timeout_ms, KTerm_Net_OnTracerouteEcho, tr);
+            if (!tr->hops[hop - 1].probe_id) tr->hops[hop - 1].status = 2; // Engine full: report as lost
         }
-
-        struct sockaddr_in dest = tr->dest_addr;
-        dest.sin_port = htons(33434 + tr->current_ttl);
-
         gettimeofday(&tr->probe_start_time, NULL);
-        if (sendto(tr->sockfd, "probe", 5, 0, (struct sockaddr*)&dest, sizeof(dest)) < 0) {
-             // Handle error
-        }
         tr->state = 3; // WAIT
     }
     else if (tr->state == 3) { // WAIT
-        char msg_control[1024];
-        struct iovec iov;
-        char buf[512];
-        struct msghdr msg = {0};
-        struct sockaddr_in r_addr;
-
-        iov.iov_base = buf;
-        iov.iov_len = sizeof(buf);
-        msg.msg_name = &r_addr;
-        msg.msg_namelen = sizeof(r_addr);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = msg_control;
-        msg.msg_controllen = sizeof(msg_control);
-
-        bool got_reply = false;
-        bool reached = false;
-        char ip_str[INET_ADDRSTRLEN] = {0};
-
-        int n = recvmsg(tr->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
-        if (n >= 0) {
-            struct cmsghdr *cmsg;
-            for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-                if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) {
-                    struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
-                    struct sockaddr_in *offender = (struct sockaddr_in *)SO_EE_OFFENDER(ee);
-                    inet_ntop(AF_INET, &offender->sin_addr, ip_str, sizeof(ip_str));
-
-                    if (ee->ee_origin == SO_EE_ORIGIN_ICMP) {
-                         if (ee->ee_type == ICMP_TIME_EXCEEDED || ee->ee_type == ICMP_DEST_UNREACH) {
-                             got_reply = true;
-                             if (ee->ee_type == ICMP_DEST_UNREACH) reached = true;
-                         }
-                    }
-                }
-            }
-        }
-
-        if (got_reply) {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            double rtt = (now.tv_sec - tr->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - tr->probe_start_time.tv_usec) / 1000.0;
-
-            if (tr->callback) {
-                tr->callback(term, session, tr->current_ttl, ip_str, rtt, reached, tr->user_data);
-            }
-
-            if (reached) {
-                if (tr->continuous) {
-                    tr->current_ttl = 1;
-                    tr->state = 5; // WAIT_LOOP
-                    gettimeofday(&tr->probe_start_time, NULL);
-                } else {
-                    tr->state = 4; // DONE
-                }
+        int last = tr->reached_hop ? tr->reached_hop : tr->max_hops;
+        while (tr->next_report <= last) {
+            KTermTraceHop* h = &tr->hops[tr->next_report - 1];
+            if (h->status == 0) return; // Hop still in flight
+            tr->current_ttl = tr->next_report++;
+            if (h->status == 1) {
+                if (tr->callback) tr->callback(term, session, tr->current_ttl, h->ip, h->rtt_ms, h->reached, tr->user_data);
             } else {
-                tr->current_ttl++;
-                tr->state = 2; // SEND next
+                if (tr->callback) tr->callback(term, session, tr->current_ttl, "*", 0, false, tr->user_data);
             }
-        } else {
-             struct timeval now;
-             gettimeofday(&now, NULL);
-             double elapsed = (now.tv_sec - tr->probe_start_time.tv_sec) * 1000.0 + (now.tv_usec - tr->probe_start_time.tv_usec) / 1000.0;
-             if (elapsed > tr->timeout_ms) {
-                 if (tr->callback) {
-                     tr->callback(term, session, tr->current_ttl, "*", 0, false, tr->user_data);
-                 }
-                 tr->current_ttl++;
-                 tr->state = 2;
-             }
+            last = tr->reached_hop ? tr->reached_hop : tr->max_hops;
         }
+        KTerm_Net_TracerouteEndRound(tr);
     }
     else if (tr->state == 5) { // WAIT_LOOP
         struct timeval now;
@@ -2648,105 +4765,139 @@ static void KTerm_Net_ProcessTraceroute(KTerm* term, KTermSession* session) {
 #endif
 }
 
+// Returns the next port from ports_str (expanding "a-b" ranges), or 0 when exhausted.
+static int KTerm_Net_PortScanNextPort(KTermPortScanContext* ps) {
+    if (ps->retry_port) {
+        int port = ps->retry_port;
+        ps->retry_port = 0;
+        return port;
+    }
+    for (;;) {
+        if (ps->range_next > 0 && ps->range_next <= ps->range_end) {
+            return ps->range_next++;
+        }
+        ps->range_next = 0;
+
+        while (ps->ports_ptr && (*ps->ports_ptr == ',' || *ps->ports_ptr == ' ')) ps->ports_ptr++;
+        if (!ps->ports_ptr || !*ps->ports_ptr) { ps->ports_ptr = NULL; return 0; }
+
+        char* endp = NULL;
+        long lo = strtol(ps->ports_ptr, &endp, 10);
+        long hi = lo;
+        if (endp && *endp == '-') hi = strtol(endp + 1, &endp, 10);
+
+        char* next = strchr(ps->ports_ptr, ',');
+        ps->ports_ptr = next ? next + 1 : NULL;
+
+        if (lo < 1) lo = 1;
+        if (hi > 65535) hi = 65535;
+        if (lo <= hi) { ps->range_next = (int)lo; ps->range_end = (int)hi; }
+    }
+}
+
+static void KTerm_Net_PortScanComplete(KTerm* term, KTermSession* session, KTermPortScanContext* ps, int idx, int status) {
+    PortScanProbe* p = &ps->probes[idx];
+    int port = p->port;
+    if (IS_VALID_SOCKET(p->fd)) CLOSE_SOCKET(p->fd);
+    // Swap-remove keeps the active set dense for poll()
+    ps->probes[idx] = ps->probes[--ps->in_flight];
+    ps->scanned++;
+    if (status == 1) ps->open_count++;
+    if (ps->callback) ps->callback(term, session, ps->host, port, status, ps->user_data);
+}
+
 static void KTerm_Net_ProcessPortScan(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->port_scan) return;
     KTermPortScanContext* ps = net->port_scan;
 
-    // NEXT Port Logic
-    if (ps->state == 2) {
-        // Iterate to next port
-        while (ps->ports_ptr && *ps->ports_ptr) {
-             // Skip delimiters
-             if (*ps->ports_ptr == ',' || *ps->ports_ptr == ' ') {
-                 ps->ports_ptr++;
-                 continue;
-             }
+    if (ps->state == 3) return; // RESOLVE (completed by KTerm_Net_OnPortScanResolved)
 
-             // Found number
-             ps->current_port = atoi(ps->ports_ptr);
+    double now = KTerm_GetTime();
 
-             // Move ptr
-             char* next = strchr(ps->ports_ptr, ',');
-             if (next) {
-                 ps->ports_ptr = next + 1;
-             } else {
-                 ps->ports_ptr = NULL; // End
-             }
+    // 1. Launch new connects up to the window and the rate budget
+    if (ps->rate_per_sec > 0) {
+        ps->tokens += (now - ps->last_refill) * ps->rate_per_sec;
+        if (ps->tokens > ps->rate_per_sec) ps->tokens = ps->rate_per_sec; // Burst of at most 1s
+        ps->last_refill = now;
+    }
+    while (ps->state == 1 && ps->in_flight < ps->window) {
+        if (ps->rate_per_sec > 0 && ps->tokens < 1.0) break;
+        int port = KTerm_Net_PortScanNextPort(ps);
+        if (port == 0) break;
+        if (ps->rate_per_sec > 0) ps->tokens -= 1.0;
 
-             if (ps->current_port > 0 && ps->current_port < 65536) {
-                 // Start Connect
-                 ps->state = 1; // CONNECTING
-
-                 if (IS_VALID_SOCKET(ps->sockfd)) CLOSE_SOCKET(ps->sockfd);
-                 ps->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-                 if (!IS_VALID_SOCKET(ps->sockfd)) {
-                     // Fail this port?
-                     if (ps->callback) ps->callback(term, session, ps->host, ps->current_port, 0, ps->user_data);
-                     ps->state = 2; // Next
-                     return;
-                 }
+        socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (!IS_VALID_SOCKET(fd)) {
+            // Out of descriptors says nothing about the port: put it back and retry next tick
+            if (ps->rate_per_sec > 0) ps->tokens += 1.0;
+            if (++ps->retry_count <= KTERM_NET_PORTSCAN_SOCKET_RETRIES) {
+                ps->retry_port = port;
+            } else {
+                ps->retry_count = 0;
+                ps->scanned++;
+                if (ps->callback) ps->callback(term, session, ps->host, port, 2, ps->user_data);
+            }
+            break;
+        }
+        ps->retry_count = 0;
+
+        PortScanProbe* p = &ps->probes[ps->in_flight++];
+        p->port = port;
+        p->start_time = now;
+        p->fd = fd;
 
-                 // Non-blocking
 #ifdef _WIN32
-                 u_long mode = 1; ioctlsocket(ps->sockfd, FIONBIO, &mode);
+        u_long mode = 1; ioctlsocket(p->fd, FIONBIO, &mode);
 #else
-                 fcntl(ps->sockfd, F_SETFL, fcntl(ps->sockfd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL, 0) | O_NONBLOCK);
 #endif
 
-                 ps->dest_addr.sin_port = htons(ps->current_port);
-                 connect(ps->sockfd, (struct sockaddr*)&ps->dest_addr, sizeof(ps->dest_addr));
+        struct sockaddr_in dest = ps->dest_addr;
+        dest.sin_port = htons((uint16_t)port);
+        if (connect(p->fd, (struct sockaddr*)&dest, sizeof(dest)) == 0) {
+            KTerm_Net_PortScanComplete(term, session, ps, ps->in_flight - 1, 1); // Immediate (loopback)
+        } else {
+#ifdef _WIN32
+            if (WSAGetLastError() != WSAEWOULDBLOCK)
+#else
+            if (errno != EINPROGRESS)
+#endif
+                KTerm_Net_PortScanComplete(term, session, ps, ps->in_flight - 1, 0); // Refused synchronously
+        }
+    }
+
+    // 2. Harvest completions (single poll over the whole window, no FD_SETSIZE limit)
+    if (ps->in_flight > 0) {
+        KT_POLLFD pfds[KTERM_NET_PORTSCAN_MAX_WINDOW];
+        int count = ps->in_flight;
+        for (int i = 0; i < count; i++) {
+            pfds[i].fd = ps->probes[i].fd;
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+        }
+        if (KT_POLL(pfds, count, 0) > 0) {
+            // Walk backwards so swap-remove does not disturb unvisited entries
+            for (int i = count - 1; i >= 0; i--) {
+                if (!pfds[i].revents) continue;
+                int opt = 0; socklen_t len = sizeof(opt);
+                int status = (getsockopt(ps->probes[i].fd, SOL_SOCKET, SO_ERROR, (char*)&opt, &len) == 0 && opt == 0 && !(pfds[i].revents & (POLLERR | POLLHUP))) ? 1 : 0;
+                KTerm_Net_PortScanComplete(term, session, ps, i, status);
+            }
+        }
 
-                 gettimeofday(&ps->start_time, NULL);
-                 return; // Wait for next tick
-             }
+        // 3. Expire probes past the per-port timeout
+        for (int i = ps->in_flight - 1; i >= 0; i--) {
+            if ((now - ps->probes[i].start_time) * 1000.0 > ps->timeout_ms) {
+                KTerm_Net_PortScanComplete(term, session, ps, i, 0);
+            }
         }
+    }
 
+    if (!ps->ports_ptr && ps->range_next == 0 && ps->retry_port == 0 && ps->in_flight == 0) {
         // Done
-        if (ps->user_data) free(ps->user_data);
-        free(ps);
+        KTerm_Net_FreePortScan(ps);
         net->port_scan = NULL;
-        return;
-    }
-    else if (ps->state == 1) { // CONNECTING
-        fd_set wfds; struct timeval tv = {0, 0};
-        FD_ZERO(&wfds);
-#ifndef _WIN32
-        if (ps->sockfd >= FD_SETSIZE) {
-            // Trigger error, fd is too high for select()
-            ps->callback(term, session, NULL, -1, 0, ps->user_data); // Report error? Or just skip
-            KTerm_Net_FreePortScan(net->port_scan);
-            net->port_scan = NULL;
-            return;
-        }
-#endif
-        FD_SET(ps->sockfd, &wfds);
-
-        int res = select(ps->sockfd + 1, NULL, &wfds, NULL, &tv);
-        if (res > 0) {
-            int opt = 0; socklen_t len = sizeof(opt);
-            if (getsockopt(ps->sockfd, SOL_SOCKET, SO_ERROR, (char*)&opt, &len) == 0 && opt == 0) {
-                // Connected
-                if (ps->callback) ps->callback(term, session, ps->host, ps->current_port, 1, ps->user_data);
-                CLOSE_SOCKET(ps->sockfd); ps->sockfd = INVALID_SOCKET;
-                ps->state = 2; // Next
-            } else {
-                // Error / Refused
-                if (ps->callback) ps->callback(term, session, ps->host, ps->current_port, 0, ps->user_data);
-                CLOSE_SOCKET(ps->sockfd); ps->sockfd = INVALID_SOCKET;
-                ps->state = 2; // Next
-            }
-        } else {
-            // Check timeout
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            double elapsed = (now.tv_sec - ps->start_time.tv_sec) * 1000.0 + (now.tv_usec - ps->start_time.tv_usec) / 1000.0;
-            if (elapsed > ps->timeout_ms) {
-                if (ps->callback) ps->callback(term, session, ps->host, ps->current_port, 0, ps->user_data);
-                CLOSE_SOCKET(ps->sockfd); ps->sockfd = INVALID_SOCKET;
-                ps->state = 2; // Next
-            }
-        }
     }
 }
 
@@ -2755,7 +4906,7 @@ static void KTerm_Net_ProcessWhois(KTerm* term, KTermSession* session) {
     if (!net || !net->whois) return;
     KTermWhoisContext* ctx = net->whois;
 
-    if (ctx->state == 4) return; // DONE
+    if (ctx->state == 5) return; // RESOLVE (completed by KTerm_Net_OnWhoisResolved)
 
     if (ctx->state == 1) { // CONNECTING
         fd_set wfds; struct timeval tv = {0, 0};
@@ -2831,10 +4982,7 @@ static void KTerm_Net_ProcessWhois(KTerm* term, KTermSession* session) {
     }
 
     if (ctx->state == 4) {
-        if (IS_VALID_SOCKET(ctx->sockfd)) CLOSE_SOCKET(ctx->sockfd);
-        ctx->sockfd = INVALID_SOCKET;
-        if (ctx->user_data) free(ctx->user_data);
-        free(ctx);
+        KTerm_Net_FreeWhois(ctx);
         net->whois = NULL;
     }
 }
@@ -2842,14 +4990,32 @@ static void KTerm_Net_ProcessWhois(KTerm* term, KTermSession* session) {
 void KTerm_Net_Init(KTerm* term) {
     if (!term) return;
     KTerm_SetOutputSink(term, KTerm_Net_Sink, term);
+    KTerm_Net_RunOnce(&kterm_protocol_index_once, KTerm_Net_BuildProtocolIndex);
 #ifdef _WIN32
     WSADATA wsaData;
     WSAStartup(MAKEWORD(2, 2), &wsaData);
 #endif
 }
 
+static void KTerm_Net_OnConnectResolved(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    (void)term; (void)user_data;
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    if (!net) return;
+    net->dns_req_id = 0;
+    if (result->success) {
+        memset(&net->resolved_addr, 0, sizeof(net->resolved_addr));
+        memcpy(&net->resolved_addr, result->addr, result->addr_len);
+        net->resolved_len = (socklen_t)result->addr_len;
+        net->dns_state = 2;
+    } else {
+        snprintf(net->dns_error, sizeof(net->dns_error), "%s", result->error);
+        net->dns_state = 3;
+    }
+}
+
 static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
-    KTermSession* session = &term->sessions[session_idx];
+    KTermSession* session = KTerm_Net_SessionAt(term, session_idx);
+    if (!session) return;
     KTermNetSession* net = KTerm_Net_GetContext(session);
 
     // Process Async Traceroute if active
@@ -2968,7 +5134,7 @@ static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
         // For now, hardcode widely compatible default or use "xterm-256color".
         if (ssh_channel_request_pty(net->ssh_channel) != SSH_OK) {
              // Non-fatal, but logged
-             KTerm_Net_Log(term, (int)(session - term->sessions), "PTY Request Failed");
+             KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), "PTY Request Failed");
         }
 
         // Send environment variables (e.g., TERM) if supported
@@ -2982,20 +5148,32 @@ static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
         if (net->callbacks.on_connect) net->callbacks.on_connect(term, session);
 #else
         // ... (Standard Client Connect Logic) ...
-        struct addrinfo hints, *res;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_socktype = SOCK_STREAM;
-        char port_str[16];
-        snprintf(port_str, sizeof(port_str), "%d", net->port);
-        int gai_err = getaddrinfo(net->host, port_str, &hints, &res);
-        if (gai_err != 0) {
+        // DNS runs off-thread; the frame loop only polls for completion.
+        if (net->dns_state == 0) {
+            KTermResolveResult cached;
+            if (KTerm_Net_ResolveCached(net->host, KTERM_RESOLVE_ANY, &cached)) {
+                KTerm_Net_OnConnectResolved(term, session, &cached, NULL);
+            } else {
+                net->dns_req_id = KTerm_Net_ResolveAsync(term, session, net->host, KTERM_RESOLVE_ANY, KTerm_Net_OnConnectResolved, NULL);
+                if (!net->dns_req_id) { KTerm_Net_TriggerError(term, session, net, "DNS Failed: Resolver busy"); return; }
+                net->dns_state = 1; // PENDING
+            }
+        }
+        if (net->dns_state == 1) return;
+        if (net->dns_state == 3) {
             char err_buf[256];
-            snprintf(err_buf, sizeof(err_buf), "DNS Failed: %s", gai_strerror(gai_err));
+            snprintf(err_buf, sizeof(err_buf), "%s", net->dns_error);
+            net->dns_state = 0;
             KTerm_Net_TriggerError(term, session, net, err_buf); return;
         }
-        net->socket_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-        if (!IS_VALID_SOCKET(net->socket_fd)) { KTerm_Net_TriggerError(term, session, net, "Socket Failed"); freeaddrinfo(res); return; }
+        net->dns_state = 0; // Consume result (retries re-resolve through the cache)
+
+        struct sockaddr_storage addr = net->resolved_addr;
+        if (addr.ss_family == AF_INET6) ((struct sockaddr_in6*)&addr)->sin6_port = htons((uint16_t)net->port);
+        else ((struct sockaddr_in*)&addr)->sin_port = htons((uint16_t)net->port);
+
+        net->socket_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+        if (!IS_VALID_SOCKET(net->socket_fd)) { KTerm_Net_TriggerError(term, session, net, "Socket Failed"); return; }
 #ifdef _WIN32
         u_long mode = 1; ioctlsocket(net->socket_fd, FIONBIO, &mode);
 #else
@@ -3007,7 +5185,7 @@ static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
             if (net->keep_alive_idle > 0) { int idle = net->keep_alive_idle; setsockopt(net->socket_fd, IPPROTO_TCP, TCP_KEEPIDLE, (const char*)&idle, sizeof(idle)); }
 #endif
         }
-        if (connect(net->socket_fd, res->ai_addr, res->ai_addrlen) == 0) {
+        if (connect(net->socket_fd, (struct sockaddr*)&addr, net->resolved_len) == 0) {
             if (net->security.handshake) { net->state = KTERM_NET_STATE_HANDSHAKE; }
             else { net->state = KTERM_NET_STATE_CONNECTED; if (net->callbacks.on_connect) net->callbacks.on_connect(term, session); }
         } else {
@@ -3019,7 +5197,6 @@ static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
                 net->state = KTERM_NET_STATE_CONNECTING;
             else { KTerm_Net_TriggerError(term, session, net, "Connection Failed"); CLOSE_SOCKET(net->socket_fd); net->socket_fd = INVALID_SOCKET; }
         }
-        freeaddrinfo(res);
 #endif
     }
     else if (net->state == KTERM_NET_STATE_CONNECTING) {
@@ -3417,9 +5594,11 @@ static void KTerm_Net_ProcessSession(KTerm* term, int session_idx) {
 
 void KTerm_Net_Process(KTerm* term) {
     if (!term) return;
-    for (int i = 0; i < 4; i++) {
+    KTerm_Net_ProcessResolver();
+    for (int i = 0; i < term->session_capacity; i++) {
         KTerm_Net_ProcessSession(term, i);
     }
+    KTerm_Net_ProcessIcmp();
 }
 
 // --- Utilities Implementation ---
@@ -3466,18 +5645,22 @@ void KTerm_Net_GetLocalIP(char* buffer, size_t max_len) {
 bool KTerm_Net_Resolve(const char* host, char* output_ip, size_t max_len) {
     if (!host || !output_ip || max_len == 0) return false;
 
-    struct addrinfo hints, *res;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET; // IPv4 for now
-    hints.ai_socktype = SOCK_STREAM;
-
-    if (getaddrinfo(host, NULL, &hints, &res) == 0) {
-        struct sockaddr_in* addr = (struct sockaddr_in*)res->ai_addr;
-        inet_ntop(AF_INET, &addr->sin_addr, output_ip, max_len);
-        freeaddrinfo(res);
-        return true;
-    }
-    return false;
+    // Cache / literal fast path (shared with the async resolver)
+    KTermResolveResult r;
+    if (!KTerm_Net_ResolveCached(host, KTERM_RESOLVE_IPV4, &r)) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = 0;
+        char err[64];
+        bool ok = KTerm_Dns_SystemLookup(host, KTERM_RESOLVE_IPV4, &addr, &addr_len, err, sizeof(err));
+        KTerm_Dns_Init();
+        KT_DNS_LOCK();
+        KTerm_Dns_CacheStore(host, KTERM_RESOLVE_IPV4, !ok, &addr, addr_len, ok ? KTERM_NET_DNS_DEFAULT_TTL : KTERM_NET_DNS_NEGATIVE_TTL, KTerm_GetTime());
+        KT_DNS_UNLOCK();
+        KTerm_Dns_FillResult(&r, host, ok, &addr, addr_len, KTERM_NET_DNS_DEFAULT_TTL, false, ok ? NULL : err);
+    }
+    if (!r.success) return false;
+    snprintf(output_ip, max_len, "%s", r.ip);
+    return true;
 }
 
 void KTerm_Net_Ping(const char* host, char* output, size_t max_len) {
@@ -3516,6 +5699,33 @@ void KTerm_Net_Ping(const char* host, char* output, size_t max_len) {
 #undef KT_PCLOSE
 }
 
+static void KTerm_Net_OnTracerouteResolved(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    KTermTracerouteContext* tr = (KTermTracerouteContext*)user_data;
+    tr->dns_req_id = 0;
+    if (result->success) {
+        memcpy(&tr->dest_addr, result->addr, sizeof(tr->dest_addr));
+        tr->state = 2; // SEND
+    } else {
+        if (tr->callback) tr->callback(term, session, 0, "ERR;DNS_FAILED", 0, true, tr->user_data);
+        tr->state = 4; // DONE
+    }
+}
+
+// Resolves from cache when possible, otherwise parks the context in RESOLVE (state 1).
+static bool KTerm_Net_TracerouteResolve(KTerm* term, KTermSession* session, KTermTracerouteContext* tr) {
+    KTermResolveResult r;
+    if (KTerm_Net_ResolveCached(tr->host, KTERM_RESOLVE_IPV4, &r)) {
+        if (!r.success) return false;
+        memcpy(&tr->dest_addr, r.addr, sizeof(tr->dest_addr));
+        tr->state = 2; // SEND
+        return true;
+    }
+    tr->dns_req_id = KTerm_Net_ResolveAsync(term, session, tr->host, KTERM_RESOLVE_IPV4, KTerm_Net_OnTracerouteResolved, tr);
+    if (!tr->dns_req_id) return false;
+    tr->state = 1; // RESOLVE
+    return true;
+}
+
 void KTerm_Net_Traceroute(KTerm* term, KTermSession* session, const char* host, int max_hops, int timeout_ms, KTermTracerouteCallback cb, void* user_data, const char* tag) {
     KTerm_Net_TracerouteContinuous(term, session, host, max_hops, timeout_ms, false, cb, user_data, tag);
 }
@@ -3539,6 +5749,7 @@ void KTerm_Net_TracerouteContinuous(KTerm* term, KTermSession* session, const ch
     KTermTracerouteContext* tr = net->traceroute;
     strncpy(tr->host, host, sizeof(tr->host)-1);
     tr->max_hops = (max_hops > 0) ? max_hops : 30;
+    if (tr->max_hops > 255) tr->max_hops = 255; // TTL is 8 bits
     tr->timeout_ms = (timeout_ms > 0) ? timeout_ms : 2000;
     tr->continuous = continuous;
     tr->callback = cb;
@@ -3562,58 +5773,14 @@ void KTerm_Net_TracerouteContinuous(KTerm* term, KTermSession* session, const ch
     tr->current_ttl = 1;
 
 #ifdef __linux__
-    // Setup UDP Socket
-    if (inet_pton(AF_INET, host, &tr->dest_addr.sin_addr) == 1) {
-        tr->dest_addr.sin_family = AF_INET;
-    } else {
-        struct addrinfo hints = {0}, *res;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_DGRAM;
-
-        if (getaddrinfo(host, "33434", &hints, &res) != 0) {
-            if (cb) cb(term, session, 0, "ERR;DNS_FAILED", 0, true, tr->user_data);
-            if (tr->user_data) free(tr->user_data);
-            free(tr); net->traceroute = NULL;
-            return;
-        }
-        tr->dest_addr = *(struct sockaddr_in*)res->ai_addr;
-        freeaddrinfo(res);
-    }
-
-    tr->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (!IS_VALID_SOCKET(tr->sockfd)) {
-        if (cb) cb(term, session, 0, "ERR;SOCKET_FAILED", 0, true, tr->user_data);
-        if (tr->user_data) free(tr->user_data);
-        free(tr); net->traceroute = NULL;
+    // Probes go through the shared ICMP engine (opened on first use)
+    if (!KTerm_Net_TracerouteResolve(term, session, tr)) {
+        if (cb) cb(term, session, 0, "ERR;DNS_FAILED", 0, true, tr->user_data);
+        KTerm_Net_FreeTraceroute(tr); net->traceroute = NULL;
         return;
     }
-
-    int on = 1;
-    setsockopt(tr->sockfd, SOL_IP, IP_RECVERR, &on, sizeof(on));
-
-    // Set non-blocking
-    fcntl(tr->sockfd, F_SETFL, fcntl(tr->sockfd, F_GETFL, 0) | O_NONBLOCK);
-
-    tr->state = 2; // Ready to SEND
 #elif defined(_WIN32)
     // Windows Implementation
-    if (inet_pton(AF_INET, host, &tr->dest_addr.sin_addr) == 1) {
-        tr->dest_addr.sin_family = AF_INET;
-    } else {
-        struct addrinfo hints = {0}, *res;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_INET;
-        if (getaddrinfo(host, NULL, &hints, &res) != 0) {
-             if (cb) cb(term, session, 0, "ERR;DNS_FAILED", 0, true, tr->user_data);
-             if (tr->user_data) free(tr->user_data);
-             free(tr); net->traceroute = NULL;
-             return;
-        }
-        tr->dest_addr = *(struct sockaddr_in*)res->ai_addr;
-        freeaddrinfo(res);
-    }
-
     tr->icmp_handle = IcmpCreateFile();
     if (tr->icmp_handle == INVALID_HANDLE_VALUE) {
          if (cb) cb(term, session, 0, "ERR;ICMP_CREATE_FAILED", 0, true, tr->user_data);
@@ -3622,7 +5789,12 @@ void KTerm_Net_TracerouteContinuous(KTerm* term, KTermSession* session, const ch
          return;
     }
     tr->icmp_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-    tr->state = 2; // SEND
+
+    if (!KTerm_Net_TracerouteResolve(term, session, tr)) {
+        if (cb) cb(term, session, 0, "ERR;DNS_FAILED", 0, true, tr->user_data);
+        KTerm_Net_FreeTraceroute(tr); net->traceroute = NULL;
+        return;
+    }
 #else
     if (cb) cb(term, session, 0, "ERR;UNSUPPORTED_PLATFORM", 0, true, tr->user_data);
     if (tr->user_data) free(tr->user_data);
@@ -3651,11 +5823,17 @@ bool KTerm_Net_ResponseTime(KTerm* term, KTermSession* session, const char* host
     rt->interval_ms = (interval_ms > 0) ? interval_ms : 1000;
     rt->timeout_ms = (timeout_ms > 0) ? timeout_ms : 2000;
     rt->callback = cb;
-    rt->user_data = user_data;
-    rt->free_user_data = true; // Default
+    if (tag) {
+        strncpy(rt->req_tag, tag, sizeof(rt->req_tag)-1);
+        rt->user_data = rt->req_tag;
+        rt->free_user_data = false;
+    } else {
+        rt->user_data = user_data;
+        rt->free_user_data = free_user_data;
+    }
 
 #ifdef __linux__
-    // Setup Socket (Try DGRAM ICMP first, requires ping_group_range)
+    // Resolve the target (requires an IPv4 address)
     if (inet_pton(AF_INET, host, &rt->dest_addr.sin_addr) != 1) {
         struct addrinfo hints = {0}, *res;
         memset(&hints, 0, sizeof(hints));
@@ -3672,23 +5850,7 @@ bool KTerm_Net_ResponseTime(KTerm* term, KTermSession* session, const char* host
     }
     rt->dest_addr.sin_family = AF_INET;
 
-    // Try creating PROT_ICMP socket (unprivileged ping)
-    rt->sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
-    rt->is_raw = false;
-    if (rt->sockfd < 0) {
-         // Fallback to RAW if root?
-         rt->sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-         rt->is_raw = true;
-         if (rt->sockfd < 0) {
-             // Failed
-             free(rt); net->response_time = NULL;
-             return false;
-         }
-    }
-
-    // Set non-blocking
-    fcntl(rt->sockfd, F_SETFL, fcntl(rt->sockfd, F_GETFL, 0) | O_NONBLOCK);
-
+    // Probes go through the shared ICMP engine; no per-test socket
     rt->state = 2; // SEND
 
 #elif defined(_WIN32)
@@ -3719,9 +5881,32 @@ bool KTerm_Net_ResponseTime(KTerm* term, KTermSession* session, const char* host
 }
 
 bool KTerm_Net_PacketDiag_Follow(KTerm* term, KTermSession* session, uint32_t flow_id) {
+    return KTerm_Net_PacketDiag_FollowEx(term, session, flow_id, NULL, NULL, NULL);
+}
+
+bool KTerm_Net_PacketDiag_FollowEx(KTerm* term, KTermSession* session, uint32_t flow_id, const char* path, KTermPacketDiagStreamCallback cb, void* user_data) {
+    (void)term;
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->packetdiag) return false;
-    net->packetdiag->follow_flow_id = flow_id;
+    KTermPacketDiagContext* ctx = net->packetdiag;
+
+    FILE* f = NULL;
+    if (flow_id && path && path[0]) {
+        f = fopen(path, "wb");
+        if (!f) return false;
+    }
+
+    // Sinks are used by the workers under their shard lock
+    for (int w = 0; w < PacketDiag_ShardCount(ctx); w++) PacketDiag_LockShard(ctx, &ctx->shards[w]);
+    FILE* old = ctx->follow_file;
+    ctx->follow_file = f;
+    ctx->follow_cb = flow_id ? cb : NULL;
+    ctx->follow_user = user_data;
+    atomic_store(&ctx->follow_peer_id, 0);
+    atomic_store(&ctx->follow_flow_id, flow_id);
+    for (int w = PacketDiag_ShardCount(ctx) - 1; w >= 0; w--) PacketDiag_UnlockShard(ctx, &ctx->shards[w]);
+
+    if (old) fclose(old);
     return true;
 }
 
@@ -3731,65 +5916,215 @@ bool KTerm_Net_PacketDiag_GetStats(KTerm* term, KTermSession* session, char* out
     if (!net || !net->packetdiag) return false;
     KTermPacketDiagContext* ctx = net->packetdiag;
 
-    snprintf(out, max, "PKTS=%llu;BYTES=%llu;TCP=%llu;UDP=%llu;ICMP=%llu;OTHER=%llu",
-        (unsigned long long)ctx->stats.total_packets,
-        (unsigned long long)ctx->stats.total_bytes,
-        (unsigned long long)ctx->stats.tcp_packets,
-        (unsigned long long)ctx->stats.udp_packets,
-        (unsigned long long)ctx->stats.icmp_packets,
-        (unsigned long long)ctx->stats.other_packets);
+    PacketDiagStats total = {0};
+    uint64_t flows = 0, evicted = 0;
+    for (int w = 0; w < PacketDiag_ShardCount(ctx); w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        flows += sh->flows.count;
+        evicted += sh->flows.evicted;
+        total.total_packets += sh->stats.total_packets;
+        total.total_bytes += sh->stats.total_bytes;
+        total.tcp_packets += sh->stats.tcp_packets;
+        total.udp_packets += sh->stats.udp_packets;
+        total.icmp_packets += sh->stats.icmp_packets;
+        total.other_packets += sh->stats.other_packets;
+        total.stream_gaps += sh->stats.stream_gaps;
+        PacketDiag_UnlockShard(ctx, sh);
+    }
+
+    snprintf(out, max, "PKTS=%llu;BYTES=%llu;TCP=%llu;UDP=%llu;ICMP=%llu;OTHER=%llu;FLOWS=%llu;EVICTED=%llu;GAPS=%llu",
+        (unsigned long long)total.total_packets,
+        (unsigned long long)total.total_bytes,
+        (unsigned long long)total.tcp_packets,
+        (unsigned long long)total.udp_packets,
+        (unsigned long long)total.icmp_packets,
+        (unsigned long long)total.other_packets,
+        (unsigned long long)flows,
+        (unsigned long long)evicted,
+        (unsigned long long)total.stream_gaps);
     return true;
 }
 
-bool KTerm_Net_PacketDiag_GetFlows(KTerm* term, KTermSession* session, char* out, size_t max) {
+bool KTerm_Net_PacketDiag_GetFlowsPage(KTerm* term, KTermSession* session, uint64_t cursor, int limit, char* out, size_t max, uint64_t* next_cursor) {
     (void)term;
+    if (next_cursor) *next_cursor = 0;
     KTermNetSession* net = KTerm_Net_GetContext(session);
-    if (!net || !net->packetdiag) return false;
+    if (!net || !net->packetdiag || !out || max == 0) return false;
     KTermPacketDiagContext* ctx = net->packetdiag;
+    if (limit <= 0) limit = 10;
 
     out[0] = '\0';
     size_t offset = 0;
     int count = 0;
 
-#ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
-#else
-    EnterCriticalSection(&ctx->mutex);
-#endif
-
-    for (int i = 0; i < 256; i++) {
-        PacketDiagFlow* flow = ctx->flow_table[i];
-        while (flow) {
-            char src[16], dst[16];
-            struct in_addr sa = { .s_addr = flow->key.src_ip };
-            struct in_addr da = { .s_addr = flow->key.dst_ip };
-            inet_ntop(AF_INET, &sa, src, sizeof(src));
-            inet_ntop(AF_INET, &da, dst, sizeof(dst));
+    // Cursor = worker << 32 | pool index. Pool records do not move, so a walk stays stable
+    // while flows come and go (new flows may or may not be seen, evicted ones are skipped).
+    int w = (int)(cursor >> 32);
+    uint32_t i = (uint32_t)cursor;
+    for (; w < PacketDiag_ShardCount(ctx); w++, i = 0) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        for (; i < sh->flows.used; i++) {
+            PacketDiagFlow* flow = &sh->flows.pool[i];
+            if (!flow->id) continue;
+            if (count >= limit) break;
+
+            char src[INET6_ADDRSTRLEN + 2], dst[INET6_ADDRSTRLEN + 2];
+            PacketDiag_FormatFlowAddr(&flow->key, true, src, sizeof(src));
+            PacketDiag_FormatFlowAddr(&flow->key, false, dst, sizeof(dst));
 
             int n = snprintf(out + offset, max - offset, "ID=%u;%s:%d->%s:%d;PKTS=%llu|",
-                flow->id, src, ntohs(flow->key.src_port), dst, ntohs(flow->key.dst_port),
+                flow->id, src, flow->key.src_port, dst, flow->key.dst_port,
                 (unsigned long long)flow->stats.packets);
+            if (n < 0 || offset + n >= max) {
+                if (count == 0) {
+                    // A lone entry wider than the buffer would pin the cursor forever;
+                    // hand it out truncated and move past it
+                    if (n < 0) out[offset] = '\0';
+                    i++;
+                } else {
+                    out[offset] = '\0'; // Resume here next page
+                }
+                count = limit;
+                break;
+            }
+            offset += n;
+            count++;
+        }
+        bool more = i < sh->flows.used;
+        PacketDiag_UnlockShard(ctx, sh);
+        if (more) {
+            if (next_cursor) *next_cursor = ((uint64_t)w << 32) | i;
+            break;
+        }
+    }
 
-            if (n > 0) offset += n;
-            if (offset >= max) break;
+    return true;
+}
 
-            count++;
-            if (count >= 10) break;
+bool KTerm_Net_PacketDiag_GetFlows(KTerm* term, KTermSession* session, char* out, size_t max) {
+    return KTerm_Net_PacketDiag_GetFlowsPage(term, session, 0, 10, out, max, NULL);
+}
 
-            flow = flow->next;
-        }
-        if (offset >= max || count >= 10) break;
+static int PacketDiag_FormatAuthTags(const KTermProtocolDef* pdef, char* out, size_t max) {
+    int pos = 0;
+    if (!pdef || !pdef->supports_auth) return 0;
+    pos += snprintf(out + pos, max - pos, " \x1B[33m[Auth]\x1B[0m");
+    if (pdef->plaintext_auth && pos < (int)max) pos += snprintf(out + pos, max - pos, " \x1B[31m[PLAIN]\x1B[0m");
+    if (pdef->high_bruteforce_risk && pos < (int)max) pos += snprintf(out + pos, max - pos, " \x1B[31m[BRUTE]\x1B[0m");
+    if (pdef->high_relay_risk && pos < (int)max) pos += snprintf(out + pos, max - pos, " \x1B[31m[RELAY]\x1B[0m");
+    if (pdef->auth_notes && *pdef->auth_notes && pos < (int)max) {
+        pos += snprintf(out + pos, max - pos, " \x1B[90m(%s)\x1B[0m", pdef->auth_notes);
+    }
+    return pos;
+}
+
+int KTerm_Net_PacketDiag_FormatEvent(const KTermPacketDiagEvent* ev, char* out, size_t max) {
+    if (!ev || !out || max == 0) return 0;
+    int pos = 0;
+#define PD_APPEND(...) do { if (pos < (int)max) pos += snprintf(out + pos, max - pos, __VA_ARGS__); } while (0)
+
+    if (ev->kind == KTERM_PACKETDIAG_EVENT_STREAM) {
+        PD_APPEND("%s[STREAM] %d bytes:%s %s\r\n", ANSI_CYAN, ev->length, ANSI_RESET, ev->info);
+        return pos < (int)max ? pos : (int)max - 1;
     }
 
+    // [Timestamp] [VLAN] Src -> Dst Proto Info
+    struct tm tm_info;
+    time_t ts_sec = (time_t)ev->ts_sec;
 #ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
+    localtime_r(&ts_sec, &tm_info);
 #else
-    LeaveCriticalSection(&ctx->mutex);
+    localtime_s(&tm_info, &ts_sec);
 #endif
+    char time_str[32];
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", &tm_info);
+    PD_APPEND("%s[%s.%06ld]%s ", ANSI_GRAY, time_str, (long)ev->ts_usec, ANSI_RESET);
+
+    if (ev->vlan_count == 1) PD_APPEND("%sVLAN %u%s ", ANSI_GRAY, ev->vlan[0], ANSI_RESET);
+    else if (ev->vlan_count > 1) PD_APPEND("%sVLAN %u.%u%s ", ANSI_GRAY, ev->vlan[0], ev->vlan[1], ANSI_RESET);
+
+    int af = ev->family == 6 ? AF_INET6 : AF_INET;
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    inet_ntop(af, ev->src_ip, src, sizeof(src));
+    inet_ntop(af, ev->dst_ip, dst, sizeof(dst));
+    PD_APPEND("%s%s \xE2\x86\x92 %s%s ", ANSI_BLUE, src, dst, ANSI_RESET);
+
+    if (ev->flags & KTERM_PACKETDIAG_EVENT_F_REASSEMBLED) PD_APPEND("%s[Reassembled %d]%s ", ANSI_GRAY, ev->length, ANSI_RESET);
+
+    const KTermProtocolDef* pdef = ev->protocol;
+    if (ev->flags & KTERM_PACKETDIAG_EVENT_F_FRAGMENT) {
+        PD_APPEND("%sFRAG%s id=0x%X off=%u%s", ANSI_GRAY, ANSI_RESET, ev->frag_id, ev->frag_offset,
+                  (ev->flags & KTERM_PACKETDIAG_EVENT_F_MF) ? " MF" : "");
+    } else if (ev->proto == 6) {
+        char flag_str[32] = "";
+        if (ev->tcp_flags & 0x02) strcat(flag_str, "SYN ");
+        if (ev->tcp_flags & 0x10) strcat(flag_str, "ACK ");
+        if (ev->tcp_flags & 0x01) strcat(flag_str, "FIN ");
+        if (ev->tcp_flags & 0x04) strcat(flag_str, "RST ");
+        if (ev->tcp_flags & 0x08) strcat(flag_str, "PSH ");
+        if (pdef) {
+            PD_APPEND("%sTCP%s %d\xE2\x86\x92%d %s[%s]%s %s", ANSI_GREEN, ANSI_RESET, ev->src_port, ev->dst_port,
+                      pdef->ansi_color, pdef->short_name, ANSI_RESET, flag_str);
+            if (pos < (int)max) pos += PacketDiag_FormatAuthTags(pdef, out + pos, max - pos);
+        } else {
+            PD_APPEND("%sTCP%s %d\xE2\x86\x92%d %s", ANSI_GREEN, ANSI_RESET, ev->src_port, ev->dst_port, flag_str);
+        }
+    } else if (ev->proto == 17) {
+        if (pdef) {
+            PD_APPEND("%sUDP%s %d\xE2\x86\x92%d %s[%s]%s", ANSI_CYAN, ANSI_RESET, ev->src_port, ev->dst_port,
+                      pdef->ansi_color, pdef->short_name, ANSI_RESET);
+            if (pos < (int)max) pos += PacketDiag_FormatAuthTags(pdef, out + pos, max - pos);
+        } else {
+            PD_APPEND("%sUDP%s %d\xE2\x86\x92%d Len=%d", ANSI_CYAN, ANSI_RESET, ev->src_port, ev->dst_port, ev->length);
+        }
+    } else if (ev->proto == 1) {
+        PD_APPEND("%sICMP%s", ANSI_MAGENTA, ANSI_RESET);
+    } else if (ev->proto == 58) {
+        PD_APPEND("%sICMPv6%s Type=%d Code=%d", ANSI_MAGENTA, ANSI_RESET, ev->icmp_type, ev->icmp_code);
+    } else {
+        PD_APPEND("Proto=%d", ev->proto);
+    }
+
+    if (ev->info[0]) {
+        const char* color = ev->info_color ? ev->info_color : "";
+        PD_APPEND("%s%s%s%s", color, ev->info, (ev->flags & KTERM_PACKETDIAG_EVENT_F_HEURISTIC) ? "?" : "", ANSI_RESET);
+    }
+    PD_APPEND("\r\n");
+#undef PD_APPEND
+    return pos < (int)max ? pos : (int)max - 1;
+}
 
+// Pops the oldest pending event across the worker rings (ids are the capture sequence number)
+static bool PacketDiag_NextEvent(KTermPacketDiagContext* ctx, KTermPacketDiagEvent* out) {
+    const uint32_t mask = KTERM_PACKETDIAG_EVENT_SLOTS - 1;
+    PacketDiagShard* best = NULL;
+    uint32_t best_tail = 0;
+    for (int i = 0; i < PacketDiag_ShardCount(ctx); i++) {
+        PacketDiagShard* sh = &ctx->shards[i];
+        uint32_t tail = atomic_load_explicit(&sh->ev_tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&sh->ev_head, memory_order_acquire)) continue;
+        if (!best || sh->events[tail & mask].id < best->events[best_tail & mask].id) {
+            best = sh;
+            best_tail = tail;
+        }
+    }
+    if (!best) return false;
+    *out = best->events[best_tail & mask];
+    atomic_store_explicit(&best->ev_tail, best_tail + 1, memory_order_release);
     return true;
 }
 
+int KTerm_Net_PacketDiag_PollEvents(KTerm* term, KTermSession* session, KTermPacketDiagEvent* out, int max) {
+    (void)term;
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    if (!net || !net->packetdiag || !out) return 0;
+    int n = 0;
+    while (n < max && PacketDiag_NextEvent(net->packetdiag, &out[n])) n++;
+    return n;
+}
+
 bool KTerm_Net_PingExt(KTerm* term, KTermSession* session, const char* host, int count, int interval_ms, int size, bool graph, KTermPingExtCallback cb, void* user_data, const char* tag) {
     if (!term || !session || !host) return false;
 
@@ -3836,7 +6171,6 @@ bool KTerm_Net_PingExt(KTerm* term, KTermSession* session, const char* host, int
     freeaddrinfo(res);
 
     ctx->state = 2; // SOCKET
-    ctx->sockfd = INVALID_SOCKET;
 
     return true;
 }
@@ -3860,6 +6194,236 @@ static void KTerm_Speedtest_LatencyCB(KTerm* term, KTermSession* session, const
     }
 }
 
+// Applies socket buffer sizing (and RX timestamping for download streams) before connect,
+// so the negotiated TCP window scale can cover the requested buffer.
+static void KTerm_Speedtest_TuneSocket(KTermSpeedtestContext* st, socket_t fd, bool upload) {
+    if (st->sock_buf_bytes > 0) {
+        int sz = st->sock_buf_bytes;
+        setsockopt(fd, SOL_SOCKET, upload ? SO_SNDBUF : SO_RCVBUF, (const char*)&sz, sizeof(sz));
+    }
+#if defined(__linux__) && defined(SO_TIMESTAMPING) && defined(SCM_TIMESTAMPING)
+    if (!upload && st->kernel_timestamps) {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    }
+#else
+    (void)upload;
+#endif
+}
+
+#ifndef _WIN32
+static void* KTerm_Speedtest_Worker(void* arg) {
+#else
+static DWORD WINAPI KTerm_Speedtest_Worker(LPVOID arg) {
+#endif
+    SpeedtestStream* s = (SpeedtestStream*)arg;
+    KTermSpeedtestContext* st = s->owner;
+    size_t chunk = (size_t)st->chunk_bytes;
+    char* buf = (char*)malloc(chunk);
+    if (buf && s->upload) memset(buf, 'X', chunk);
+
+#if defined(__linux__) && defined(SO_TIMESTAMPING) && defined(SCM_TIMESTAMPING)
+    char cbuf[256];
+    struct iovec iov;
+    struct msghdr msg;
+#endif
+
+    KT_POLLFD pfd;
+    pfd.fd = s->fd;
+    pfd.events = s->upload ? POLLOUT : POLLIN;
+
+    while (buf && !atomic_load(&st->stop_workers)) {
+        pfd.revents = 0;
+        int pr = KT_POLL(&pfd, 1, 50); // Short wait so stop requests are honoured promptly
+        if (pr < 0) break;
+        if (pr == 0) continue;
+
+        int n;
+        if (s->upload) {
+#ifdef MSG_NOSIGNAL
+            n = (int)send(s->fd, buf, chunk, KTERM_MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+            n = (int)send(s->fd, buf, (int)chunk, KTERM_MSG_DONTWAIT);
+#endif
+        } else {
+#if defined(__linux__) && defined(SO_TIMESTAMPING) && defined(SCM_TIMESTAMPING)
+            iov.iov_base = buf; iov.iov_len = chunk;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov; msg.msg_iovlen = 1;
+            msg.msg_control = cbuf; msg.msg_controllen = sizeof(cbuf);
+            n = (int)recvmsg(s->fd, &msg, MSG_DONTWAIT);
+            if (n > 0 && st->kernel_timestamps) {
+                for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+                    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+                        struct scm_timestamping* tss = (struct scm_timestamping*)CMSG_DATA(c);
+                        double ts = (double)tss->ts[0].tv_sec + (double)tss->ts[0].tv_nsec / 1e9;
+                        if (ts > 0) {
+                            // Bytes of the first read arrived at or before ts_first
+                            if (s->ts_first == 0) s->ts_first = ts;
+                            else s->ts_bytes += (uint64_t)n;
+                            s->ts_last = ts;
+                        }
+                    }
+                }
+            }
+#else
+            n = (int)recv(s->fd, buf, (int)chunk, KTERM_MSG_DONTWAIT);
+#endif
+        }
+
+        if (n > 0) {
+            atomic_fetch_add_explicit(&s->bytes, (uint64_t)n, memory_order_relaxed);
+        } else if (n == 0) {
+            break; // Peer closed
+        } else {
+#ifdef _WIN32
+            if (WSAGetLastError() != WSAEWOULDBLOCK) break;
+#else
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
+#endif
+        }
+    }
+
+    free(buf);
+    atomic_store(&s->worker_done, true);
+#ifndef _WIN32
+    return NULL;
+#else
+    return 0;
+#endif
+}
+
+static void KTerm_Speedtest_JoinWorkers(KTermSpeedtestContext* st) {
+    if (!st->workers_running) return;
+    atomic_store(&st->stop_workers, true);
+    for (int i = 0; i < st->num_streams; i++) {
+        SpeedtestStream* s = &st->streams[i];
+        if (!s->worker_started) continue;
+#ifndef _WIN32
+        pthread_join(s->thread, NULL);
+#else
+        WaitForSingleObject(s->thread, INFINITE);
+        CloseHandle(s->thread);
+#endif
+        s->worker_started = false;
+    }
+    st->workers_running = false;
+}
+
+// Drives RUN_DL (phase 1) / RUN_UL (phase 2) when streams run on worker threads.
+// The frame loop only aggregates counters and reports at report_interval.
+static void KTerm_Speedtest_RunThreaded(KTerm* term, KTermSession* session, KTermSpeedtestContext* st, int phase) {
+    double now = KTerm_GetTime();
+
+    if (!st->workers_running) {
+        atomic_store(&st->stop_workers, false);
+        for (int i = 0; i < st->num_streams; i++) {
+            SpeedtestStream* s = &st->streams[i];
+            if (!s->connected || !IS_VALID_SOCKET(s->fd)) continue;
+            s->owner = st;
+            s->upload = (phase == 2);
+            s->ts_first = s->ts_last = 0;
+            s->ts_bytes = 0;
+            atomic_store(&s->worker_done, false);
+#ifndef _WIN32
+            s->worker_started = (pthread_create(&s->thread, NULL, KTerm_Speedtest_Worker, s) == 0);
+#else
+            s->thread = CreateThread(NULL, 0, KTerm_Speedtest_Worker, s, 0, NULL);
+            s->worker_started = (s->thread != NULL);
+#endif
+        }
+        st->workers_running = true;
+        st->phase_start_time = now;
+        st->last_report = now;
+        return;
+    }
+
+    uint64_t total = 0;
+    bool all_done = true;
+    for (int i = 0; i < st->num_streams; i++) {
+        total += atomic_load_explicit(&st->streams[i].bytes, memory_order_relaxed);
+        if (st->streams[i].worker_started && !atomic_load(&st->streams[i].worker_done)) all_done = false;
+    }
+
+    double elapsed = now - st->phase_start_time;
+    double mbps = (elapsed > 0) ? ((double)total * 8.0) / (elapsed * 1000000.0) : 0;
+    if (phase == 1) st->dl_mbps = mbps; else st->ul_mbps = mbps;
+
+    bool finished = all_done || elapsed >= st->duration_sec;
+
+    if (!finished && now - st->last_report >= st->report_interval) {
+        // Fixed cadence; resync instead of bursting if the frame loop stalled
+        st->last_report += st->report_interval;
+        if (now - st->last_report >= st->report_interval) st->last_report = now;
+        if (st->callback) {
+            SpeedtestResult res = {0};
+            res.dl_mbps = st->dl_mbps;
+            res.ul_mbps = st->ul_mbps;
+            res.phase = phase;
+            if (phase == 1) { res.dl_bytes = total; res.dl_progress = elapsed / st->duration_sec; }
+            else { res.dl_bytes = st->dl_bytes; res.ul_bytes = total; res.ul_progress = elapsed / st->duration_sec; }
+            if (res.dl_progress > 1.0) res.dl_progress = 1.0;
+            if (res.ul_progress > 1.0) res.ul_progress = 1.0;
+            st->callback(term, session, &res, st->user_data);
+        }
+    }
+
+    if (!finished) return;
+
+    KTerm_Speedtest_JoinWorkers(st);
+
+    // Recount after join so bytes landed between the check and the stop are included
+    total = 0;
+    for (int i = 0; i < st->num_streams; i++) total += st->streams[i].bytes;
+    elapsed = KTerm_GetTime() - st->phase_start_time;
+    if (elapsed > 0) mbps = ((double)total * 8.0) / (elapsed * 1000000.0);
+
+    if (phase == 1) {
+        st->dl_mbps = mbps;
+        st->dl_bytes = total;
+        if (st->kernel_timestamps) {
+            // Kernel stamps exclude connect/scheduling latency: bytes after the first segment over first..last arrival
+            double first = 0, last = 0;
+            uint64_t ts_total = 0;
+            for (int i = 0; i < st->num_streams; i++) {
+                SpeedtestStream* s = &st->streams[i];
+                if (s->ts_first == 0 || s->ts_last <= s->ts_first) continue;
+                if (first == 0 || s->ts_first < first) first = s->ts_first;
+                if (s->ts_last > last) last = s->ts_last;
+                ts_total += s->ts_bytes;
+            }
+            if (last > first && ts_total > 0) {
+                st->dl_mbps = ((double)ts_total * 8.0) / ((last - first) * 1000000.0);
+                st->kernel_timed = true;
+            }
+        }
+
+        for (int i = 0; i < st->num_streams; i++) {
+            if (IS_VALID_SOCKET(st->streams[i].fd)) { CLOSE_SOCKET(st->streams[i].fd); st->streams[i].fd = INVALID_SOCKET; }
+            st->streams[i].connected = false;
+            st->streams[i].bytes = 0;
+        }
+        st->connected_count = 0;
+        st->state = 4; // CONNECT_UL
+        st->start_time = KTerm_GetTime();
+    } else {
+        st->ul_mbps = mbps;
+        st->state = 6; // DONE
+        if (st->callback) {
+            SpeedtestResult res = {0};
+            res.dl_mbps = st->dl_mbps;
+            res.ul_mbps = st->ul_mbps;
+            res.jitter_ms = st->jitter_ms;
+            res.dl_bytes = st->dl_bytes;
+            res.ul_bytes = total;
+            res.kernel_timed = st->kernel_timed;
+            res.phase = 3;
+            res.done = true;
+            st->callback(term, session, &res, st->user_data);
+        }
+    }
+}
+
 void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (!net || !net->speedtest) return;
@@ -4027,6 +6591,7 @@ void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
                   if (st->streams[i].fd != INVALID_SOCKET) continue;
                   st->streams[i].fd = socket(AF_INET, SOCK_STREAM, 0);
                   if (IS_VALID_SOCKET(st->streams[i].fd)) {
+                      KTerm_Speedtest_TuneSocket(st, st->streams[i].fd, false);
 #ifdef _WIN32
                       u_long mode = 1; ioctlsocket(st->streams[i].fd, FIONBIO, &mode);
 #else
@@ -4096,6 +6661,9 @@ void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
              st->phase_start_time = KTerm_GetTime();
         }
     }
+    else if (st->state == 3 && st->threaded) { // RUN_DL (worker threads)
+        KTerm_Speedtest_RunThreaded(term, session, st, 1);
+    }
     else if (st->state == 3) { // RUN_DL
         // Read data
         char buf[16384];
@@ -4160,6 +6728,7 @@ void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
                    if (st->streams[i].fd != INVALID_SOCKET) continue;
                    st->streams[i].fd = socket(AF_INET, SOCK_STREAM, 0);
                    if (IS_VALID_SOCKET(st->streams[i].fd)) {
+                       KTerm_Speedtest_TuneSocket(st, st->streams[i].fd, true);
 #ifdef _WIN32
                        u_long mode = 1; ioctlsocket(st->streams[i].fd, FIONBIO, &mode);
 #else
@@ -4223,6 +6792,9 @@ void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
              st->phase_start_time = KTerm_GetTime();
         }
     }
+    else if (st->state == 5 && st->threaded) { // RUN_UL (worker threads)
+        KTerm_Speedtest_RunThreaded(term, session, st, 2);
+    }
     else if (st->state == 5) { // RUN_UL
         // Send data
         char chunk[8192]; // Dummy data
@@ -4299,6 +6871,10 @@ void KTerm_Net_ProcessSpeedtest(KTerm* term, KTermSession* session) {
 }
 
 bool KTerm_Net_Speedtest(KTerm* term, KTermSession* session, const char* host, int port, int streams, const char* path, KTermSpeedtestCallback cb, void* user_data, const char* tag) {
+    return KTerm_Net_SpeedtestEx(term, session, host, port, streams, path, NULL, cb, user_data, tag);
+}
+
+bool KTerm_Net_SpeedtestEx(KTerm* term, KTermSession* session, const char* host, int port, int streams, const char* path, const KTermSpeedtestOptions* opts, KTermSpeedtestCallback cb, void* user_data, const char* tag) {
     if (!term || !session) return false;
 
     KTermNetSession* net = KTerm_Net_CreateContext(session);
@@ -4326,7 +6902,16 @@ bool KTerm_Net_Speedtest(KTerm* term, KTermSession* session, const char* host, i
         st->user_data = user_data;
         st->free_user_data = false;
     }
-    st->duration_sec = 5.0; // Fixed duration for now
+    st->duration_sec = (opts && opts->duration_sec > 0) ? opts->duration_sec : 5.0;
+
+    if (opts) {
+        st->threaded = opts->threaded;
+        st->kernel_timestamps = opts->kernel_timestamps;
+        st->sock_buf_bytes = opts->sock_buf_bytes;
+        if (st->sock_buf_bytes <= 0 && st->threaded) st->sock_buf_bytes = 4 * 1024 * 1024;
+        st->chunk_bytes = (opts->chunk_bytes > 0) ? opts->chunk_bytes : 256 * 1024;
+        st->report_interval = 1.0 / ((opts->report_hz > 0) ? opts->report_hz : 10);
+    }
 
     if (path && path[0]) {
         strncpy(st->dl_path, path, sizeof(st->dl_path)-1);
@@ -4378,53 +6963,156 @@ bool KTerm_Net_Speedtest(KTerm* term, KTermSession* session, const char* host, i
 
 // --- Heuristics & Auth Detection ---
 
-static void* KTerm_Memmem(const void* haystack, size_t haystack_len, const void* needle, size_t needle_len) {
-    if (haystack_len < needle_len || !needle_len || !haystack_len) return NULL;
-    const char* h = (const char*)haystack;
-    const char* n = (const char*)needle;
-    for (size_t i = 0; i <= haystack_len - needle_len; i++) {
-        if (memcmp(h + i, n, needle_len) == 0) return (void*)(h + i);
-    }
-    return NULL;
-}
+// What a signature needs from kterm_protocols[] to be worth looking for
+typedef enum {
+    KTERM_AUTH_NEEDS_AUTH = 0,   // A row that supports auth
+    KTERM_AUTH_NEEDS_PLAINTEXT,  // A row with plaintext credentials
+    KTERM_AUTH_NEEDS_NTLM,
+    KTERM_AUTH_NEEDS_KERBEROS
+} KTermAuthNeed;
 
 typedef struct {
     const char* sig;
     const char* proto;
     bool is_risk;
+    const char* row;   // kterm_protocols[] short name the signature belongs to, NULL = any row
+    KTermAuthNeed need;
 } KTermAuthSig;
 
+// Earlier rows win when a payload matches several
 static const KTermAuthSig kterm_auth_sigs[] = {
-    { "SSH-", "SSH", false },
-    { "NTLMSSP", "NTLM", true },
-    { "KRB5", "Kerberos", false }, // Rough signature
-    { "Basic ", "HTTP-Basic", true }, // Cleartext!
-    { "Authorization: Basic", "HTTP-Basic", true },
-    { "user ", "FTP/Pop3", true }, // Generic cleartext user command
-    { "pass ", "FTP/Pop3", true },
-    { "USER ", "FTP/Pop3", true },
-    { "PASS ", "FTP/Pop3", true },
-    { "Action: Login", "AMI", true }, // Asterisk Manager
-    { "RTSP/1.0 401 Unauthorized", "RTSP", false },
-    { "SIP/2.0 401 Unauthorized", "SIP", false },
-    { NULL, NULL, false }
+    { "SSH-", "SSH", false, "SSH", KTERM_AUTH_NEEDS_AUTH },
+    { "NTLMSSP", "NTLM", true, NULL, KTERM_AUTH_NEEDS_NTLM },
+    { "KRB5", "Kerberos", false, NULL, KTERM_AUTH_NEEDS_KERBEROS }, // Rough signature
+    { "Basic ", "HTTP-Basic", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT }, // Cleartext!
+    { "Authorization: Basic", "HTTP-Basic", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT },
+    { "user ", "FTP/Pop3", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT }, // Generic cleartext user command
+    { "pass ", "FTP/Pop3", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT },
+    { "USER ", "FTP/Pop3", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT },
+    { "PASS ", "FTP/Pop3", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT },
+    { "Action: Login", "AMI", true, NULL, KTERM_AUTH_NEEDS_PLAINTEXT }, // Asterisk Manager
+    { "RTSP/1.0 401 Unauthorized", "RTSP", false, "RTSP", KTERM_AUTH_NEEDS_AUTH },
+    { "SIP/2.0 401 Unauthorized", "SIP", false, "SIP", KTERM_AUTH_NEEDS_AUTH },
+    { NULL, NULL, false, NULL, KTERM_AUTH_NEEDS_AUTH }
 };
 
-static bool KTerm_Net_ScanPayloadForAuth(const unsigned char* payload, int len, char* out_proto, char* out_user, bool* out_risk) {
-    if (!payload || len < 4) return false;
-
-    for (int i = 0; kterm_auth_sigs[i].sig != NULL; i++) {
-        if (KTerm_Memmem(payload, len, kterm_auth_sigs[i].sig, strlen(kterm_auth_sigs[i].sig))) {
-            if (out_proto) strcpy(out_proto, kterm_auth_sigs[i].proto);
-            if (out_risk) *out_risk = kterm_auth_sigs[i].is_risk;
-            // Attempt to grab user? (Too complex for simple heuristic, just flag it)
-            if (out_user) out_user[0] = '\0';
-            return true;
+// All signatures are matched in one pass by an Aho-Corasick automaton compiled once into a dense
+// DFA over byte classes (bytes that appear in no signature share class 0). The state is a single
+// byte, so a TCP direction carries partial matches across segments in PacketDiagStream.
+#define KTERM_AUTH_AC_STATES 256
+#define KTERM_AUTH_AC_CLASSES 64
+#define KTERM_AUTH_AC_NONE 0xFF
+
+static struct {
+    uint8_t byte_class[256];
+    uint8_t next[KTERM_AUTH_AC_STATES][KTERM_AUTH_AC_CLASSES];
+    uint8_t match[KTERM_AUTH_AC_STATES]; // Best kterm_auth_sigs[] row ending here, KTERM_AUTH_AC_NONE if none
+    int states;
+} kterm_auth_ac;
+static KTermNetOnce kterm_auth_ac_once = KTERM_NET_ONCE_INIT;
+
+static bool KTerm_Net_AuthSigWanted(const KTermAuthSig* s) {
+    for (int i = 0; kterm_protocols[i].short_name; i++) {
+        const KTermProtocolDef* p = &kterm_protocols[i];
+        if (s->row && strcmp(p->short_name, s->row) != 0) continue;
+        switch (s->need) {
+            case KTERM_AUTH_NEEDS_AUTH: if (p->supports_auth) return true; break;
+            case KTERM_AUTH_NEEDS_PLAINTEXT: if (p->plaintext_auth) return true; break;
+            case KTERM_AUTH_NEEDS_NTLM: if (p->supports_ntlm) return true; break;
+            case KTERM_AUTH_NEEDS_KERBEROS: if (p->supports_kerberos) return true; break;
         }
     }
     return false;
 }
 
+static void KTerm_Net_BuildAuthAutomaton(void) {
+    int classes = 1;
+    uint8_t fail[KTERM_AUTH_AC_STATES] = {0};
+    memset(kterm_auth_ac.next, 0, sizeof(kterm_auth_ac.next));
+    memset(kterm_auth_ac.match, KTERM_AUTH_AC_NONE, sizeof(kterm_auth_ac.match));
+    kterm_auth_ac.states = 1;
+
+    // Trie. Transitions stored as 0 are "missing" until the fail links fill them in; the
+    // root never has an edge back to itself, so 0 is unambiguous.
+    for (int i = 0; kterm_auth_sigs[i].sig; i++) {
+        if (!KTerm_Net_AuthSigWanted(&kterm_auth_sigs[i])) continue;
+        int st = 0;
+        for (const unsigned char* c = (const unsigned char*)kterm_auth_sigs[i].sig; *c; c++) {
+            if (!kterm_auth_ac.byte_class[*c]) {
+                if (classes >= KTERM_AUTH_AC_CLASSES) return; // Table outgrew the automaton: no auth scanning
+                kterm_auth_ac.byte_class[*c] = (uint8_t)classes++;
+            }
+            uint8_t k = kterm_auth_ac.byte_class[*c];
+            if (!kterm_auth_ac.next[st][k]) {
+                if (kterm_auth_ac.states >= KTERM_AUTH_AC_STATES - 1) return;
+                kterm_auth_ac.next[st][k] = (uint8_t)kterm_auth_ac.states++;
+            }
+            st = kterm_auth_ac.next[st][k];
+        }
+        if (kterm_auth_ac.match[st] == KTERM_AUTH_AC_NONE) kterm_auth_ac.match[st] = (uint8_t)i;
+    }
+
+    // Breadth-first: fail links, inherited matches and the missing transitions
+    uint8_t queue[KTERM_AUTH_AC_STATES];
+    int qh = 0, qt = 0;
+    for (int k = 0; k < classes; k++) {
+        if (kterm_auth_ac.next[0][k]) queue[qt++] = kterm_auth_ac.next[0][k];
+    }
+    while (qh < qt) {
+        int st = queue[qh++];
+        uint8_t inherited = kterm_auth_ac.match[fail[st]];
+        if (inherited < kterm_auth_ac.match[st]) kterm_auth_ac.match[st] = inherited;
+        for (int k = 0; k < classes; k++) {
+            uint8_t to = kterm_auth_ac.next[st][k];
+            if (to) {
+                fail[to] = kterm_auth_ac.next[fail[st]][k];
+                queue[qt++] = to;
+            } else {
+                kterm_auth_ac.next[st][k] = kterm_auth_ac.next[fail[st]][k];
+            }
+        }
+    }
+}
+
+// Runs the automaton over one payload from *state and leaves the state for the next segment.
+// Returns the best signature matched (lowest kterm_auth_sigs[] row), or NULL.
+static const KTermAuthSig* KTerm_Net_AuthScan(uint8_t* state, const unsigned char* payload, int len) {
+    KTerm_Net_RunOnce(&kterm_auth_ac_once, KTerm_Net_BuildAuthAutomaton);
+    const uint8_t* cls = kterm_auth_ac.byte_class;
+    uint8_t st = *state;
+    uint8_t best = KTERM_AUTH_AC_NONE;
+    for (int i = 0; i < len; i++) {
+        // At the root, skip runs of bytes that start no signature
+        if (st == 0) {
+            while (i < len && !kterm_auth_ac.next[0][cls[payload[i]]]) i++;
+            if (i == len) break;
+        }
+        st = kterm_auth_ac.next[st][cls[payload[i]]];
+        if (kterm_auth_ac.match[st] < best) {
+            best = kterm_auth_ac.match[st];
+            if (best == 0) break;
+        }
+    }
+    *state = st;
+    return best == KTERM_AUTH_AC_NONE ? NULL : &kterm_auth_sigs[best];
+}
+
+static void KTerm_Net_AuthReport(const KTermAuthSig* sig, char* out_proto, char* out_user, bool* out_risk) {
+    if (out_proto) strcpy(out_proto, sig->proto);
+    if (out_risk) *out_risk = sig->is_risk;
+    // Attempt to grab user? (Too complex for simple heuristic, just flag it)
+    if (out_user) out_user[0] = '\0';
+}
+
+static bool KTerm_Net_ScanPayloadForAuth(const unsigned char* payload, int len, char* out_proto, char* out_user, bool* out_risk) {
+    if (!payload || len < 4) return false;
+    uint8_t state = 0;
+    const KTermAuthSig* sig = KTerm_Net_AuthScan(&state, payload, len);
+    if (!sig) return false;
+    KTerm_Net_AuthReport(sig, out_proto, out_user, out_risk);
+    return true;
+}
+
 static const KTermProtocolDef* PacketDiag_IdentifyProtocol(uint16_t src_port, uint16_t dst_port, bool is_udp) {
     const KTermProtocolDef* p_src = KTerm_Net_IdentifyProtocol(src_port, is_udp);
     const KTermProtocolDef* p_dst = KTerm_Net_IdentifyProtocol(dst_port, is_udp);
@@ -4538,46 +7226,578 @@ static void PacketDiag_ParseHTTP(const unsigned char* data, int len, char* out,
         return;
     }
 
-    if (strncmp(prefix, "HTTP/", 5) == 0) {
-        int eol = 0;
-        for(int i=0; i<len && i<64; i++) {
-            if (data[i] == '\r' || data[i] == '\n') { eol = i; break; }
-        }
-        if (eol > 0) {
-            char line[65];
-            memcpy(line, data, eol);
-            line[eol] = '\0';
-            snprintf(out, max_len, " %s", line);
+    if (strncmp(prefix, "HTTP/", 5) == 0) {
+        int eol = 0;
+        for(int i=0; i<len && i<64; i++) {
+            if (data[i] == '\r' || data[i] == '\n') { eol = i; break; }
+        }
+        if (eol > 0) {
+            char line[65];
+            memcpy(line, data, eol);
+            line[eol] = '\0';
+            snprintf(out, max_len, " %s", line);
+        }
+    }
+}
+
+static void PacketDiag_WriteToBuffer(KTermPacketDiagContext* ctx, const char* fmt, ...) {
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+#ifndef _WIN32
+    pthread_mutex_lock(&ctx->mutex);
+#else
+    EnterCriticalSection(&ctx->mutex);
+#endif
+
+    for (int i = 0; buf[i]; i++) {
+        ctx->out_buf[ctx->buf_head] = buf[i];
+        ctx->buf_head = (ctx->buf_head + 1) % 65536;
+        if (ctx->buf_head == ctx->buf_tail) ctx->buf_tail = (ctx->buf_tail + 1) % 65536; // Drop oldest
+    }
+
+#ifndef _WIN32
+    pthread_mutex_unlock(&ctx->mutex);
+#else
+    LeaveCriticalSection(&ctx->mutex);
+#endif
+}
+
+// Single producer (the shard's worker), single consumer (KTerm_Net_ProcessPacketDiag).
+// New events are dropped rather than overwriting unread ones when the UI falls behind.
+static void PacketDiag_ShardPush(PacketDiagShard* sh, const KTermPacketDiagEvent* ev) {
+    uint32_t head = atomic_load_explicit(&sh->ev_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&sh->ev_tail, memory_order_acquire);
+    if (head - tail >= KTERM_PACKETDIAG_EVENT_SLOTS) {
+        atomic_fetch_add_explicit(&sh->ev_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    sh->events[head & (KTERM_PACKETDIAG_EVENT_SLOTS - 1)] = *ev;
+    atomic_store_explicit(&sh->ev_head, head + 1, memory_order_release);
+}
+
+// --- Layered Dissection ---
+// Link -> Network -> Transport -> Application, all as pointers into the captured buffer.
+
+typedef struct {
+    // Link
+    uint16_t ethertype;
+    uint16_t vlan[2]; // Outer tag first
+    int vlan_count;
+    // Network
+    const uint8_t* l3;
+    int l3_len;
+    int family;        // 4 or 6
+    const uint8_t* src;
+    const uint8_t* dst;
+    uint8_t proto;     // Upper-layer protocol after any IPv6 extension headers
+    // Fragmentation
+    bool fragment;
+    bool more_fragments;
+    uint32_t frag_offset; // Bytes
+    uint32_t frag_id;
+    // Transport (the fragment's payload until reassembled)
+    const uint8_t* l4;
+    int l4_len;
+    int l4_wire_len;   // As declared by the IP header, more than l4_len when the snaplen cut it short
+} PacketDiagLayers;
+
+static bool PacketDiag_DissectLink(int link_type, const uint8_t* pkt, int caplen, PacketDiagLayers* L) {
+    int off = 0;
+    uint16_t type = 0;
+    switch (link_type) {
+        case PACKETDIAG_LINK_SLL: // 16-byte header, protocol at 14
+            if (caplen < 16) return false;
+            type = (uint16_t)((pkt[14] << 8) | pkt[15]);
+            off = 16;
+            break;
+        case PACKETDIAG_LINK_SLL2: // 20-byte header, protocol first
+            if (caplen < 20) return false;
+            type = (uint16_t)((pkt[0] << 8) | pkt[1]);
+            off = 20;
+            break;
+        case PACKETDIAG_LINK_RAW:
+            if (caplen < 1) return false;
+            type = (pkt[0] >> 4) == 6 ? 0x86DD : 0x0800;
+            break;
+        case PACKETDIAG_LINK_NULL: // Family is in host order of the capturing machine; use the IP version instead
+            if (caplen < 5) return false;
+            type = (pkt[4] >> 4) == 6 ? 0x86DD : 0x0800;
+            off = 4;
+            break;
+        default: // Ethernet
+            if (caplen < 14) return false;
+            type = (uint16_t)((pkt[12] << 8) | pkt[13]);
+            off = 14;
+            break;
+    }
+
+    // 802.1Q / 802.1ad (QinQ) tags
+    while ((type == 0x8100 || type == 0x88A8 || type == 0x9100) && caplen >= off + 4) {
+        if (L->vlan_count < 2) L->vlan[L->vlan_count] = (uint16_t)(((pkt[off] << 8) | pkt[off + 1]) & 0x0FFF);
+        L->vlan_count++;
+        type = (uint16_t)((pkt[off + 2] << 8) | pkt[off + 3]);
+        off += 4;
+    }
+
+    L->ethertype = type;
+    L->l3 = pkt + off;
+    L->l3_len = caplen - off;
+    return type == 0x0800 || type == 0x86DD;
+}
+
+static bool PacketDiag_DissectNetwork(PacketDiagLayers* L) {
+    const uint8_t* ip = L->l3;
+    int len = L->l3_len;
+    if (len < 1) return false;
+    int version = ip[0] >> 4;
+
+    if (L->ethertype == 0x0800 && version == 4) {
+        if (len < 20) return false;
+        int header_len = (ip[0] & 0x0F) * 4;
+        if (header_len < 20 || len < header_len) return false;
+        int total = (ip[2] << 8) | ip[3];
+        if (total >= header_len && total < len) len = total; // Drop link-layer padding
+
+        uint16_t off = (uint16_t)((ip[6] << 8) | ip[7]);
+        L->family = 4;
+        L->src = ip + 12;
+        L->dst = ip + 16;
+        L->proto = ip[9];
+        L->more_fragments = (off & 0x2000) != 0;
+        L->frag_offset = (uint32_t)(off & 0x1FFF) * 8;
+        L->fragment = L->more_fragments || L->frag_offset != 0;
+        L->frag_id = (uint32_t)((ip[4] << 8) | ip[5]);
+        L->l4 = ip + header_len;
+        L->l4_len = len - header_len;
+        L->l4_wire_len = total > len ? total - header_len : L->l4_len;
+        return true;
+    }
+
+    if (L->ethertype == 0x86DD && version == 6) {
+        if (len < 40) return false;
+        int payload_len = (ip[4] << 8) | ip[5];
+        if (payload_len > 0 && 40 + payload_len < len) len = 40 + payload_len; // 0 = jumbogram
+
+        L->family = 6;
+        L->src = ip + 8;
+        L->dst = ip + 24;
+        uint8_t next = ip[6];
+        int off = 40;
+
+        // Walk extension headers to the upper-layer protocol
+        for (int guard = 0; guard < 8 && len >= off + 8; guard++) {
+            if (next == 0 || next == 43 || next == 60 || next == 135 || next == 139 || next == 140) {
+                // Hop-by-Hop, Routing, Destination Options, Mobility, HIP, Shim6: length in 8-octet units
+                next = ip[off];
+                off += (ip[off + 1] + 1) * 8;
+            } else if (next == 51) {
+                // AH: length in 4-octet units
+                next = ip[off];
+                off += (ip[off + 1] + 2) * 4;
+            } else if (next == 44) {
+                uint16_t fo = (uint16_t)((ip[off + 2] << 8) | ip[off + 3]);
+                L->frag_offset = fo & 0xFFF8;
+                L->more_fragments = (fo & 0x1) != 0;
+                L->fragment = L->more_fragments || L->frag_offset != 0; // Atomic fragments are whole
+                L->frag_id = ((uint32_t)ip[off + 4] << 24) | ((uint32_t)ip[off + 5] << 16) | ((uint32_t)ip[off + 6] << 8) | ip[off + 7];
+                next = ip[off];
+                off += 8;
+                if (L->fragment) break; // The rest belongs to the fragmentable part
+            } else {
+                break;
+            }
+        }
+        if (off > len) return false;
+
+        L->proto = next;
+        L->l4 = ip + off;
+        L->l4_len = len - off;
+        L->l4_wire_len = (payload_len > 0 && 40 + payload_len > len) ? 40 + payload_len - off : L->l4_len;
+        return true;
+    }
+
+    return false;
+}
+
+// Feeds one fragment into the worker's reassembly slots. Returns true, with L->l4 pointing at the
+// complete upper-layer payload, once every 8-byte block up to the last fragment has been seen.
+static bool PacketDiag_Reassemble(PacketDiagShard* sh, PacketDiagLayers* L, double now) {
+    int alen = L->family == 6 ? 16 : 4;
+    PacketDiagReasm* slot = NULL;
+    PacketDiagReasm* spare = NULL;
+    for (int i = 0; i < KTERM_PACKETDIAG_REASM_SLOTS; i++) {
+        PacketDiagReasm* r = &sh->reasm[i];
+        if (r->active && now - r->first_seen > KTERM_PACKETDIAG_REASM_TIMEOUT) r->active = false;
+        if (r->active && r->family == L->family && r->proto == L->proto && r->id == L->frag_id &&
+            memcmp(r->src, L->src, alen) == 0 && memcmp(r->dst, L->dst, alen) == 0) {
+            slot = r;
+            break;
+        }
+        // Prefer a free slot, otherwise recycle the oldest datagram
+        if (!spare || (spare->active && (!r->active || r->first_seen < spare->first_seen))) spare = r;
+    }
+
+    if (!slot) {
+        slot = spare;
+        if (!slot->data) slot->data = (uint8_t*)malloc(65536);
+        if (!slot->data) return false;
+        slot->active = true;
+        slot->family = (uint8_t)L->family;
+        slot->proto = L->proto;
+        memcpy(slot->src, L->src, alen);
+        memcpy(slot->dst, L->dst, alen);
+        slot->id = L->frag_id;
+        slot->first_seen = now;
+        slot->total_len = -1;
+        slot->blocks = 0;
+        memset(slot->map, 0, sizeof(slot->map));
+    }
+
+    uint32_t end = L->frag_offset + (uint32_t)L->l4_len;
+    if (end > 65535) {
+        slot->active = false;
+        return false;
+    }
+    memcpy(slot->data + L->frag_offset, L->l4, L->l4_len);
+    for (uint32_t b = L->frag_offset / 8; b < (end + 7) / 8; b++) {
+        if (!(slot->map[b >> 3] & (1u << (b & 7)))) {
+            slot->map[b >> 3] |= (uint8_t)(1u << (b & 7));
+            slot->blocks++;
+        }
+    }
+    if (!L->more_fragments) slot->total_len = (int)end;
+
+    if (slot->total_len >= 0 && slot->blocks == ((uint32_t)slot->total_len + 7) / 8) {
+        slot->active = false; // Buffer stays valid until the slot is reused
+        L->l4 = slot->data;
+        L->l4_len = slot->total_len;
+        L->l4_wire_len = slot->total_len;
+        return true;
+    }
+    return false;
+}
+
+// --- TCP Stream Reassembly ---
+// Each flow is one direction, so each has its own reassembler. Where segments overlap the bytes
+// seen first win, both against data already handed on and against queued segments. When a
+// direction's queue or the shared budget (stream_mem) is full, the oldest hole is given up on:
+// its length is reported as missing and the queued data behind it is handed on.
+
+// Where the bytes of one packet go, collected for its STREAM event
+typedef struct {
+    KTermPacketDiagContext* ctx;
+    PacketDiagShard* sh;
+    PacketDiagFlow* flow;
+    bool followed;
+    int bytes;                // Handed on while processing this packet, holes included
+    int preview_len;
+    char preview[33];
+} PacketDiagStreamSink;
+
+static int32_t PacketDiag_SeqDiff(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b);
+}
+
+// data == NULL: a hole of len bytes
+static void PacketDiag_StreamDeliver(PacketDiagStreamSink* k, PacketDiagStream* s, const uint8_t* data, int len) {
+    PacketDiagFlow* flow = k->flow;
+    if (len <= 0) return;
+
+    if (!data) {
+        s->auth_state = 0;
+        k->sh->stats.stream_gaps++;
+    } else if (flow->key.proto == 6 && !flow->auth_detected) {
+        const KTermAuthSig* sig = KTerm_Net_AuthScan(&s->auth_state, data, len);
+        if (sig) {
+            KTerm_Net_AuthReport(sig, flow->auth_proto, flow->auth_user, &flow->auth_risk);
+            flow->auth_detected = true;
+        }
+    }
+
+    if (k->followed) {
+        KTermPacketDiagContext* ctx = k->ctx;
+        if (ctx->follow_cb) {
+            ctx->follow_cb(ctx->term, KTerm_Net_SessionAt(ctx->term, ctx->session_index), flow->id, s->offset, data, len, ctx->follow_user);
+        }
+        if (ctx->follow_file && data) fwrite(data, 1, (size_t)len, ctx->follow_file);
+        for (int i = 0; data && i < len && k->preview_len < (int)sizeof(k->preview) - 1; i++) {
+            unsigned char c = data[i];
+            k->preview[k->preview_len++] = (c >= 32 && c < 127) ? (char)c : '.';
+        }
+        k->bytes += len;
+    }
+    s->offset += (uint64_t)len;
+}
+
+// Hands on the queued segments that have become contiguous
+static void PacketDiag_StreamFlush(PacketDiagStreamSink* k, PacketDiagStream* s) {
+    while (s->ooo && s->ooo->seq == s->next_seq) {
+        PacketDiagSegment* seg = s->ooo;
+        s->ooo = seg->next;
+        PacketDiag_StreamDeliver(k, s, seg->data, (int)seg->len);
+        PacketDiag_StreamDeliver(k, s, NULL, (int)(seg->span - seg->len));
+        s->next_seq += seg->span;
+        s->ooo_bytes -= seg->len;
+        atomic_fetch_sub(&k->ctx->stream_mem, seg->len);
+        free(seg);
+    }
+}
+
+// Gives up on the hole in front of the queue
+static void PacketDiag_StreamSkipHole(PacketDiagStreamSink* k, PacketDiagStream* s) {
+    if (!s->ooo) return;
+    PacketDiag_StreamDeliver(k, s, NULL, PacketDiag_SeqDiff(s->ooo->seq, s->next_seq));
+    s->next_seq = s->ooo->seq;
+    PacketDiag_StreamFlush(k, s);
+}
+
+// One TCP segment: `len` captured bytes of the `span` it covers in sequence space
+static void PacketDiag_StreamSegment(PacketDiagStreamSink* k, PacketDiagStream* s, uint32_t seq, uint8_t tcp_flags, const uint8_t* data, uint32_t len, uint32_t span) {
+    KTermPacketDiagContext* ctx = k->ctx;
+    if (tcp_flags & 0x02) { // SYN takes one sequence number
+        if (!s->synced) {
+            s->next_seq = seq + 1;
+            s->synced = true;
+        }
+        seq++;
+    }
+    if (span == 0) return;
+    if (!s->synced) {
+        s->next_seq = seq;
+        s->synced = true;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        // Retransmitted bytes we already handed on
+        int32_t behind = PacketDiag_SeqDiff(s->next_seq, seq);
+        if (behind > 0) {
+            if ((uint32_t)behind >= span) return;
+            uint32_t cut = (uint32_t)behind < len ? (uint32_t)behind : len;
+            seq += (uint32_t)behind;
+            span -= (uint32_t)behind;
+            data += cut;
+            len -= cut;
+        }
+        if (pass || seq == s->next_seq) break;
+
+        // This one has to wait: make room first
+        while (s->ooo && (s->ooo_bytes + len > KTERM_PACKETDIAG_STREAM_FLOW_BYTES ||
+                          atomic_load(&ctx->stream_mem) + len > ctx->stream_mem_max)) {
+            PacketDiag_StreamSkipHole(k, s);
+        }
+        if (!s->ooo && atomic_load(&ctx->stream_mem) + len > ctx->stream_mem_max && PacketDiag_SeqDiff(seq, s->next_seq) > 0) {
+            // Nowhere to queue it: give up on the hole now rather than stall
+            PacketDiag_StreamDeliver(k, s, NULL, PacketDiag_SeqDiff(seq, s->next_seq));
+            s->next_seq = seq;
+        }
+    }
+
+    PacketDiagSegment** link = &s->ooo;
+    while (span > 0) {
+        while (*link && PacketDiag_SeqDiff((*link)->seq + (*link)->span, seq) <= 0) link = &(*link)->next;
+        PacketDiagSegment* next = *link;
+        uint32_t piece = span;
+        if (next) {
+            int32_t d = PacketDiag_SeqDiff(next->seq, seq);
+            if (d <= 0) {
+                // Already queued
+                piece = next->seq + next->span - seq;
+                if (piece > span) piece = span;
+                uint32_t cut = piece < len ? piece : len;
+                seq += piece; span -= piece; data += cut; len -= cut;
+                continue;
+            }
+            if ((uint32_t)d < piece) piece = (uint32_t)d;
+        }
+        uint32_t piece_len = piece < len ? piece : len;
+
+        if (seq == s->next_seq) {
+            PacketDiag_StreamDeliver(k, s, data, (int)piece_len);
+            PacketDiag_StreamDeliver(k, s, NULL, (int)(piece - piece_len));
+            s->next_seq += piece;
+        } else if (atomic_load(&ctx->stream_mem) + piece_len > ctx->stream_mem_max) {
+            break; // No room anywhere; the hole is skipped once later data needs the space
+        } else {
+            PacketDiagSegment* seg = (PacketDiagSegment*)malloc(sizeof(PacketDiagSegment) + piece_len);
+            if (!seg) break;
+            seg->seq = seq;
+            seg->span = piece;
+            seg->len = piece_len;
+            memcpy(seg->data, data, piece_len);
+            seg->next = next;
+            *link = seg;
+            link = &seg->next;
+            s->ooo_bytes += piece_len;
+            atomic_fetch_add(&ctx->stream_mem, piece_len);
+        }
+        seq += piece; span -= piece; data += piece_len; len -= piece_len;
+    }
+    PacketDiag_StreamFlush(k, s);
+}
+
+// Direction-independent address hash: both halves of a conversation, and every fragment of a
+// datagram (which carry no ports), land on the same worker. Each flow is owned by one thread.
+static uint32_t PacketDiag_ShardHash(int link_type, const uint8_t* pkt, int caplen) {
+    PacketDiagLayers L;
+    memset(&L, 0, sizeof(L));
+    if (!PacketDiag_DissectLink(link_type, pkt, caplen, &L)) return 0;
+
+    uint32_t h = 0;
+    int words = 0, src_off = 0, dst_off = 0;
+    if (L.ethertype == 0x0800 && L.l3_len >= 20) { words = 1; src_off = 12; dst_off = 16; }
+    else if (L.ethertype == 0x86DD && L.l3_len >= 40) { words = 4; src_off = 8; dst_off = 24; }
+    for (int i = 0; i < words; i++) {
+        uint32_t a, b;
+        memcpy(&a, L.l3 + src_off + 4 * i, 4);
+        memcpy(&b, L.l3 + dst_off + 4 * i, 4);
+        h = (h * 0x9E3779B1u) + (a ^ b);
+    }
+    h ^= h >> 16; h *= 0x7FEB352Du; h ^= h >> 15;
+    return h;
+}
+
+// Application dissectors are attached to kterm_protocols[] entries by short name; the per-port
+// index is derived from that table so new protocol rows pick up their parser automatically.
+typedef void (*PacketDiagAppParser)(const unsigned char* data, int len, char* out, int max_len);
+
+typedef struct {
+    const char* short_name;
+    bool udp;
+    PacketDiagAppParser parse;
+    const char* color;
+} PacketDiagAppDissector;
+
+static const PacketDiagAppDissector packetdiag_app_dissectors[] = {
+    { "HTTP",    false, PacketDiag_ParseHTTP, ANSI_YELLOW },
+    { "HTTPS",   false, PacketDiag_ParseHTTP, ANSI_YELLOW },
+    { "RTP",     true,  PacketDiag_ParseRTP,  ANSI_MAGENTA },
+    { "Dante-M", true,  PacketDiag_ParseRTP,  ANSI_MAGENTA },
+    { "Dante-U", true,  PacketDiag_ParseRTP,  ANSI_MAGENTA },
+    { "PTP-Evt", true,  PacketDiag_ParsePTP,  ANSI_CYAN },
+    { "PTP-Gen", true,  PacketDiag_ParsePTP,  ANSI_CYAN },
+    { "DNS",     true,  PacketDiag_ParseDNS,  ANSI_YELLOW },
+    { "mDNS",    true,  PacketDiag_ParseDNS,  ANSI_YELLOW },
+    { NULL,      false, NULL,                 NULL }
+};
+
+// Well-known alternates that are not rows of kterm_protocols[]
+static const struct { uint16_t port; const char* short_name; bool udp; } packetdiag_app_aliases[] = {
+    { 8080, "HTTP", false },
+    { 0,    NULL,   false }
+};
+
+// Payload heuristics for UDP ports without a dissector
+static bool PacketDiag_LooksLikeRTP(const unsigned char* data, int len) {
+    return len > 12 && (data[0] & 0xC0) == 0x80; // Version 2
+}
+
+static const struct { bool (*match)(const unsigned char*, int); PacketDiagAppParser parse; } packetdiag_app_heuristics[] = {
+    { PacketDiag_LooksLikeRTP, PacketDiag_ParseRTP },
+    { NULL, NULL }
+};
+
+static uint8_t packetdiag_app_index[2][65536]; // [udp][port] -> dissector index + 1
+static KTermNetOnce packetdiag_app_index_once = KTERM_NET_ONCE_INIT;
+
+static int PacketDiag_FindAppDissector(const char* short_name, bool udp) {
+    for (int i = 0; packetdiag_app_dissectors[i].short_name; i++) {
+        if (packetdiag_app_dissectors[i].udp == udp && strcmp(packetdiag_app_dissectors[i].short_name, short_name) == 0) return i;
+    }
+    return -1;
+}
+
+// Follows the protocol index, so a port dissects as whatever KTerm_Net_QueryProtocol reports.
+static void PacketDiag_BuildAppIndex(void) {
+    KTerm_Net_RunOnce(&kterm_protocol_index_once, KTerm_Net_BuildProtocolIndex);
+    for (int t = 0; t < 2; t++) {
+        uint8_t by_row[256] = {0};
+        for (int i = 0; kterm_protocols[i].short_name; i++) {
+            by_row[i + 1] = (uint8_t)(PacketDiag_FindAppDissector(kterm_protocols[i].short_name, t == 1) + 1);
         }
+        for (uint32_t port = 0; port < 65536; port++) packetdiag_app_index[t][port] = by_row[kterm_protocol_index[t][port]];
+    }
+    for (int i = 0; packetdiag_app_aliases[i].short_name; i++) {
+        int d = PacketDiag_FindAppDissector(packetdiag_app_aliases[i].short_name, packetdiag_app_aliases[i].udp);
+        if (d >= 0) packetdiag_app_index[packetdiag_app_aliases[i].udp ? 1 : 0][packetdiag_app_aliases[i].port] = (uint8_t)(d + 1);
     }
 }
 
-static void PacketDiag_WriteToBuffer(KTermPacketDiagContext* ctx, const char* fmt, ...) {
-    char buf[1024];
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
+static const PacketDiagAppDissector* PacketDiag_AppDissectorFor(bool udp, uint16_t sport, uint16_t dport) {
+    // Lower port first: usually the server side
+    uint16_t lo = sport < dport ? sport : dport;
+    uint16_t hi = sport < dport ? dport : sport;
+    uint8_t d = packetdiag_app_index[udp ? 1 : 0][lo];
+    if (!d) d = packetdiag_app_index[udp ? 1 : 0][hi];
+    return d ? &packetdiag_app_dissectors[d - 1] : NULL;
+}
 
-#ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
-#else
-    EnterCriticalSection(&ctx->mutex);
+// --- PCAP-NG Recording (producer side) ---
+
+#if defined(O_DIRECT) && !defined(_WIN32)
+#define KTERM_O_DIRECT O_DIRECT
+#elif defined(__linux__) && defined(__O_DIRECT)
+// glibc only exposes O_DIRECT under _GNU_SOURCE; the flag itself is always there.
+#define KTERM_O_DIRECT __O_DIRECT
 #endif
 
-    for (int i = 0; buf[i]; i++) {
-        ctx->out_buf[ctx->buf_head] = buf[i];
-        ctx->buf_head = (ctx->buf_head + 1) % 65536;
-        if (ctx->buf_head == ctx->buf_tail) ctx->buf_tail = (ctx->buf_tail + 1) % 65536; // Drop oldest
-    }
+// pcap files use LINKTYPE_ values, which only differ from DLT_ for raw IP
+#define KTERM_LINKTYPE_RAW 101
 
+static void PacketDiag_Backoff(void) {
 #ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
+    struct timespec nap = {0, 100000};
+    nanosleep(&nap, NULL);
 #else
-    LeaveCriticalSection(&ctx->mutex);
+    Sleep(0);
 #endif
 }
 
+static void PacketDiag_RecordPut(KTermPacketDiagContext* ctx, uint64_t* pos, const void* data, size_t len) {
+    const uint8_t* src = (const uint8_t*)data;
+    while (len > 0) {
+        size_t off = (size_t)(*pos & (KTERM_PACKETDIAG_RECORD_BYTES - 1));
+        size_t n = KTERM_PACKETDIAG_RECORD_BYTES - off;
+        if (n > len) n = len;
+        if (src) memcpy(ctx->record_ring + off, src, n);
+        else memset(ctx->record_ring + off, 0, n);
+        if (src) src += n;
+        *pos += n;
+        len -= n;
+    }
+}
+
+// Appends one Enhanced Packet Block. Live capture never waits for the disk (the packet is
+// counted in record_dropped instead); replay waits so the recording is complete.
+static void PacketDiag_RecordPacket(KTermPacketDiagContext* ctx, const struct pcap_pkthdr* h, const uint8_t* pkt) {
+    uint32_t caplen = h->caplen;
+    uint32_t total = 32 + ((caplen + 3) & ~3u);
+    if (total > KTERM_PACKETDIAG_RECORD_BYTES / 2) { atomic_fetch_add(&ctx->record_dropped, 1); return; }
+
+    uint64_t head = atomic_load_explicit(&ctx->record_head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ctx->record_tail, memory_order_acquire) + total > KTERM_PACKETDIAG_RECORD_BYTES) {
+        if (!ctx->offline || atomic_load(&ctx->record_failed) || !ctx->running) {
+            atomic_fetch_add_explicit(&ctx->record_dropped, 1, memory_order_relaxed);
+            return;
+        }
+        PacketDiag_Backoff();
+    }
+
+    uint64_t ts = (uint64_t)h->ts.tv_sec * 1000000u + (uint64_t)h->ts.tv_usec;
+    uint32_t epb[7] = { 6, total, 0, (uint32_t)(ts >> 32), (uint32_t)ts, caplen, h->len };
+    PacketDiag_RecordPut(ctx, &head, epb, sizeof(epb));
+    PacketDiag_RecordPut(ctx, &head, pkt, caplen);
+    PacketDiag_RecordPut(ctx, &head, NULL, ((caplen + 3) & ~3u) - caplen);
+    PacketDiag_RecordPut(ctx, &head, &total, 4);
+    atomic_store_explicit(&ctx->record_head, head, memory_order_release);
+    atomic_fetch_add_explicit(&ctx->record_packets, 1, memory_order_relaxed);
+}
+
+static void PacketDiag_Dissect(KTermPacketDiagContext* ctx, PacketDiagShard* sh, const CapturedPacket* cp);
+
 static void PacketDiag_PacketHandler(u_char *user, const struct pcap_pkthdr *pkthdr, const u_char *pkt) {
     KTermPacketDiagContext* ctx = (KTermPacketDiagContext*)user;
     if (!ctx || !ctx->running) return;
@@ -4585,363 +7805,1328 @@ static void PacketDiag_PacketHandler(u_char *user, const struct pcap_pkthdr *pkt
 
     ctx->captured_count++;
     if (ctx->count > 0 && ctx->captured_count > ctx->count) {
-        pcap_breakloop(ctx->handle);
+        if (ctx->handle) pcap_breakloop(ctx->handle);
         return;
     }
 
-    // Store Packet in Ring (Thread-Safe)
+    if (ctx->record_ring && !atomic_load_explicit(&ctx->record_failed, memory_order_relaxed)) PacketDiag_RecordPacket(ctx, pkthdr, pkt);
+
+    // Capture thread: no locks, no formatting. Copy into the owning worker's ring and return to pcap.
+    CapturedPacket local;
+    CapturedPacket* cp = &local;
+    PacketDiagShard* sh = &ctx->shards[0];
+    uint32_t head = 0;
+    if (ctx->worker_count > 0) {
+        sh = &ctx->shards[PacketDiag_ShardHash(ctx->link_type, pkt, (int)pkthdr->caplen) % (uint32_t)ctx->worker_count];
+        head = atomic_load_explicit(&sh->ring_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(&sh->ring_tail, memory_order_acquire);
+        // Replay is paced by the workers instead of losing packets
+        while (ctx->offline && head - tail >= KTERM_PACKETDIAG_RING_SLOTS && ctx->running) {
+            PacketDiag_Backoff();
+            tail = atomic_load_explicit(&sh->ring_tail, memory_order_acquire);
+        }
+        if (head - tail >= KTERM_PACKETDIAG_RING_SLOTS) {
+            atomic_fetch_add_explicit(&sh->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        cp = &sh->ring[head & (KTERM_PACKETDIAG_RING_SLOTS - 1)];
+    }
+
+    int copy_len = pkthdr->caplen;
+    if (copy_len > (int)sizeof(cp->data)) copy_len = (int)sizeof(cp->data);
+    cp->ts = pkthdr->ts;
+    cp->len = copy_len;
+    cp->wire_len = pkthdr->len;
+    cp->id = (uint64_t)(ctx->captured_count - 1);
+    memcpy(cp->data, pkt, copy_len);
+
+    if (ctx->worker_count > 0) {
+        atomic_store_explicit(&sh->ring_head, head + 1, memory_order_release);
+    } else {
+        PacketDiag_Dissect(ctx, sh, cp);
+    }
+}
+
+static void PacketDiag_Dissect(KTermPacketDiagContext* ctx, PacketDiagShard* sh, const CapturedPacket* cp) {
+    // Keep for GetDetail
+    PacketDiag_LockShard(ctx, sh);
+    sh->history[sh->history_count % KTERM_PACKETDIAG_HISTORY] = *cp;
+    sh->history_count++;
+    PacketDiag_UnlockShard(ctx, sh);
+
+    KTerm_Net_RunOnce(&packetdiag_app_index_once, PacketDiag_BuildAppIndex);
+
+    PacketDiagLayers L;
+    memset(&L, 0, sizeof(L));
+    if (!PacketDiag_DissectLink(ctx->link_type, cp->data, cp->len, &L)) return;
+    if (!PacketDiag_DissectNetwork(&L)) return;
+
+    if (L.fragment) {
+        // Detected Fragmentation (lock only on the rare first hit)
+        if (!atomic_load(&ctx->trigger_mtu_probe)) {
+            char dst[INET6_ADDRSTRLEN];
+            inet_ntop(L.family == 6 ? AF_INET6 : AF_INET, L.dst, dst, sizeof(dst));
 #ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
+            pthread_mutex_lock(&ctx->mutex);
 #else
-    EnterCriticalSection(&ctx->mutex);
+            EnterCriticalSection(&ctx->mutex);
 #endif
-    int idx = ctx->ring_head;
-    ctx->packet_ring[idx].ts = pkthdr->ts;
-    int copy_len = pkthdr->caplen;
-    if (copy_len > 1500) copy_len = 1500;
-    ctx->packet_ring[idx].len = copy_len;
-    memcpy(ctx->packet_ring[idx].data, pkt, copy_len);
-    ctx->ring_head = (ctx->ring_head + 1) % 128;
-    ctx->ring_count++; // Increment total processed count
+            if (!atomic_load(&ctx->trigger_mtu_probe)) {
+                strncpy(ctx->last_frag_ip, dst, sizeof(ctx->last_frag_ip) - 1);
+                ctx->last_frag_ip[sizeof(ctx->last_frag_ip) - 1] = '\0';
+                atomic_store(&ctx->trigger_mtu_probe, true);
+            }
 #ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
+            pthread_mutex_unlock(&ctx->mutex);
 #else
-    LeaveCriticalSection(&ctx->mutex);
+            LeaveCriticalSection(&ctx->mutex);
 #endif
+        }
+    }
+
+    double now = (double)cp->ts.tv_sec + (double)cp->ts.tv_usec / 1000000.0;
+    bool reassembled = L.fragment && PacketDiag_Reassemble(sh, &L, now);
+    bool have_l4 = !L.fragment || reassembled;
+    int proto = L.proto;
+
+    KTermPacketDiagEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.id = cp->id;
+    ev.ts_sec = (int64_t)cp->ts.tv_sec;
+    ev.ts_usec = (int32_t)cp->ts.tv_usec;
+    ev.wire_len = cp->wire_len;
+    ev.family = (uint8_t)L.family;
+    ev.proto = (uint8_t)proto;
+    ev.vlan_count = (uint8_t)L.vlan_count;
+    ev.vlan[0] = L.vlan[0];
+    ev.vlan[1] = L.vlan[1];
+    memcpy(ev.src_ip, L.src, L.family == 6 ? 16 : 4);
+    memcpy(ev.dst_ip, L.dst, L.family == 6 ? 16 : 4);
+    if (L.fragment) {
+        ev.frag_id = L.frag_id;
+        ev.frag_offset = L.frag_offset;
+        if (L.more_fragments) ev.flags |= KTERM_PACKETDIAG_EVENT_F_MF;
+    }
+    if (reassembled) {
+        ev.flags |= KTERM_PACKETDIAG_EVENT_F_REASSEMBLED;
+        ev.length = L.l4_len;
+    }
+
+    // Protocol Specifics
+    uint16_t src_port = 0;
+    uint16_t dst_port = 0;
+    const unsigned char* flow_payload = NULL;
+    int flow_payload_len = 0;
+    const unsigned char* tcp_data = NULL;
+    uint32_t tcp_seq = 0, tcp_span = 0;
+
+    if (!have_l4) {
+        ev.flags |= KTERM_PACKETDIAG_EVENT_F_FRAGMENT;
+    } else if (proto == 6) { // TCP
+        const unsigned char* tcp = L.l4;
+        int tcp_len = L.l4_len;
+        if (tcp_len >= 20) {
+            src_port = (uint16_t)((tcp[0] << 8) | tcp[1]);
+            dst_port = (uint16_t)((tcp[2] << 8) | tcp[3]);
+            ev.tcp_flags = tcp[13];
+            ev.protocol = PacketDiag_IdentifyProtocol(src_port, dst_port, false);
+
+            int data_off = (tcp[12] >> 4) * 4;
+            if (data_off >= 20 && data_off < tcp_len) {
+                flow_payload = tcp + data_off;
+                flow_payload_len = tcp_len - data_off;
+            }
+            if (data_off >= 20 && data_off <= tcp_len) {
+                tcp_data = tcp + data_off;
+                tcp_seq = ((uint32_t)tcp[4] << 24) | ((uint32_t)tcp[5] << 16) | ((uint32_t)tcp[6] << 8) | tcp[7];
+                int span = L.l4_wire_len - data_off;
+                tcp_span = (uint32_t)(span > flow_payload_len ? span : flow_payload_len);
+            }
+        }
+    } else if (proto == 17) { // UDP
+        const unsigned char* udp = L.l4;
+        if (L.l4_len >= 8) {
+            src_port = (uint16_t)((udp[0] << 8) | udp[1]);
+            dst_port = (uint16_t)((udp[2] << 8) | udp[3]);
+            int len = (udp[4] << 8) | udp[5];
+            if (!reassembled) ev.length = len;
+
+            // Payload, bounded by what was captured
+            int payload_len = len - 8;
+            if (payload_len > L.l4_len - 8) payload_len = L.l4_len - 8;
+            if (payload_len > 0) {
+                flow_payload = udp + 8;
+                flow_payload_len = payload_len;
+            }
+
+            ev.protocol = PacketDiag_IdentifyProtocol(src_port, dst_port, true);
+        }
+    } else if (proto == 1 || proto == 58) { // ICMP, ICMPv6
+        if (L.l4_len >= 2) {
+            ev.icmp_type = L.l4[0];
+            ev.icmp_code = L.l4[1];
+        }
+    }
+    ev.src_port = src_port;
+    ev.dst_port = dst_port;
+
+    // Application layer: port dispatch from kterm_protocols[], then payload heuristics (UDP)
+    if (flow_payload_len > 0) {
+        bool udp = (proto == 17);
+        const PacketDiagAppDissector* app = PacketDiag_AppDissectorFor(udp, src_port, dst_port);
+        if (app) {
+            app->parse(flow_payload, flow_payload_len, ev.info, sizeof(ev.info));
+            ev.info_color = app->color;
+        } else if (udp) {
+            for (int i = 0; packetdiag_app_heuristics[i].match; i++) {
+                if (!packetdiag_app_heuristics[i].match(flow_payload, flow_payload_len)) continue;
+                packetdiag_app_heuristics[i].parse(flow_payload, flow_payload_len, ev.info, sizeof(ev.info));
+                if (ev.info[0]) {
+                    ev.info_color = ANSI_GRAY;
+                    ev.flags |= KTERM_PACKETDIAG_EVENT_F_HEURISTIC;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Update Stats & Flows
+    PacketDiagFlowKey key;
+    memset(&key, 0, sizeof(key));
+    bool has_key = false;
+    PacketDiagStreamSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.ctx = ctx;
+    sink.sh = sh;
+
+    if (src_port > 0 || dst_port > 0) {
+        has_key = true;
+        memcpy(key.src_ip, L.src, L.family == 6 ? 16 : 4);
+        memcpy(key.dst_ip, L.dst, L.family == 6 ? 16 : 4);
+        key.family = (uint8_t)L.family;
+        key.proto = (uint8_t)proto;
+        key.src_port = src_port;
+        key.dst_port = dst_port;
+    }
+
+    PacketDiag_LockShard(ctx, sh);
+
+    // Update Stats
+    if (now > sh->last_ts) sh->last_ts = now;
+    sh->stats.total_packets++;
+    sh->stats.total_bytes += cp->wire_len;
+    if (proto == 6) sh->stats.tcp_packets++;
+    else if (proto == 17) sh->stats.udp_packets++;
+    else if (proto == 1 || proto == 58) sh->stats.icmp_packets++;
+    else sh->stats.other_packets++;
+
+    // Update Flow
+    PacketDiagFlowTable* ft = &sh->flows;
+    if (has_key && !ft->pool) PacketDiag_FlowTableInit(ft, PacketDiag_ShardFlowCapacity(ctx));
+    if (has_key && ft->pool) {
+        PacketDiag_FlowExpire(ctx, ft, now);
+
+        uint32_t hash = (uint32_t)PacketDiag_FlowKeyHash(ctx->flow_hash_key, &key);
+        PacketDiagFlow* flow = PacketDiag_FlowLookup(ft, &key, hash);
+        if (flow) PacketDiag_FlowTouch(ft, flow);
+        else flow = PacketDiag_FlowInsert(ctx, ft, &key, hash);
+
+        if (flow) {
+            flow->last_seen = now;
+            flow->stats.packets++;
+            flow->stats.bytes += cp->wire_len;
+            PacketDiag_FlowRateAdd(flow, now, cp->wire_len);
+
+            // Stream Follow covers both directions; the reverse flow lives on the same worker
+            uint32_t follow = atomic_load(&ctx->follow_flow_id);
+            if (follow && flow->id == follow) {
+                PacketDiagFlowKey rev = key;
+                memcpy(rev.src_ip, key.dst_ip, sizeof(rev.src_ip));
+                memcpy(rev.dst_ip, key.src_ip, sizeof(rev.dst_ip));
+                rev.src_port = key.dst_port;
+                rev.dst_port = key.src_port;
+                PacketDiagFlow* peer = PacketDiag_FlowLookup(ft, &rev, (uint32_t)PacketDiag_FlowKeyHash(ctx->flow_hash_key, &rev));
+                atomic_store(&ctx->follow_peer_id, peer ? peer->id : 0);
+            }
+            sink.flow = flow;
+            sink.followed = follow && (flow->id == follow || flow->id == atomic_load(&ctx->follow_peer_id));
+
+            // TCP is reassembled while auth is being looked for (the first KTERM_PACKETDIAG_STREAM_SCAN
+            // bytes) or while followed, so signatures split across segments are still found
+            bool reassemble = tcp_data && (sink.followed || (!flow->auth_detected && !flow->stream_done));
+            if (reassemble && !flow->stream && (tcp_span > 0 || (ev.tcp_flags & 0x02))) {
+                flow->stream = (PacketDiagStream*)calloc(1, sizeof(PacketDiagStream));
+            }
+            if (tcp_data && flow->stream) {
+                PacketDiag_StreamSegment(&sink, flow->stream, tcp_seq, ev.tcp_flags, tcp_data, (uint32_t)flow_payload_len, tcp_span);
+                if (!sink.followed && (flow->auth_detected || flow->stream->offset >= KTERM_PACKETDIAG_STREAM_SCAN)) {
+                    flow->stream_done = true;
+                    PacketDiag_StreamFree(ctx, flow->stream);
+                    flow->stream = NULL;
+                }
+            } else if (flow_payload_len > 0) {
+                // Deep Inspection for Auth, one packet at a time
+                if (!flow->auth_detected) {
+                     if (KTerm_Net_ScanPayloadForAuth(flow_payload, flow_payload_len, flow->auth_proto, flow->auth_user, &flow->auth_risk)) {
+                         flow->auth_detected = true;
+                     }
+                }
+                // Followed datagrams are handed on whole
+                if (sink.followed && !tcp_data) {
+                    if (!flow->stream) flow->stream = (PacketDiagStream*)calloc(1, sizeof(PacketDiagStream));
+                    if (flow->stream) PacketDiag_StreamDeliver(&sink, flow->stream, flow_payload, flow_payload_len);
+                }
+            }
+
+            // Jitter calc (Inter-Arrival Variance)
+            if (flow->stats.last_jitter_ts > 0) {
+                double delta = now - flow->stats.last_jitter_ts;
+                if (delta < 0) delta = 0;
+
+                if (flow->stats.packets > 2) {
+                    double diff = delta - flow->stats.prev_delta;
+                    if (diff < 0) diff = -diff;
+                    flow->stats.jitter += (diff - flow->stats.jitter) / 16.0;
+                }
+                flow->stats.prev_delta = delta;
+            }
+            flow->stats.last_jitter_ts = now;
+        }
+    }
 
-    // Basic Dissection (Ethernet)
-    // Assuming Ethernet for simplicity (DLT_EN10MB)
-    // Offset 14 bytes
-    if (pkthdr->caplen < 14) return;
+    PacketDiag_UnlockShard(ctx, sh);
 
-    const unsigned char* ip_header = pkt + 14;
-    int ip_len = pkthdr->caplen - 14;
+    // Published outside the lock
+    PacketDiag_ShardPush(sh, &ev);
+    if (sink.bytes > 0) {
+        // What the followed conversation gained in order, which may be nothing or several segments
+        ev.kind = KTERM_PACKETDIAG_EVENT_STREAM;
+        ev.length = sink.bytes;
+        ev.info_color = NULL;
+        ev.flags &= (uint8_t)~KTERM_PACKETDIAG_EVENT_F_HEURISTIC;
+        memcpy(ev.info, sink.preview, (size_t)sink.preview_len);
+        ev.info[sink.preview_len] = '\0';
+        PacketDiag_ShardPush(sh, &ev);
+    }
+}
 
-    // Check IP version (v4=0x40)
-    int version = (ip_header[0] >> 4);
-    if (version != 4) return; // Only IPv4 for this demo
 
-    // Frag Check
-    uint16_t off = (ip_header[6] << 8) | ip_header[7];
-    if ((off & 0x3FFF) != 0) {
-        // Detected Fragmentation
 #ifndef _WIN32
-        pthread_mutex_lock(&ctx->mutex);
+static void* PacketDiag_Worker(void* arg) {
 #else
-        EnterCriticalSection(&ctx->mutex);
+static DWORD WINAPI PacketDiag_Worker(LPVOID arg) {
 #endif
-        if (!ctx->trigger_mtu_probe) {
-             struct in_addr da;
-             memcpy(&da, ip_header + 16, 4);
-             inet_ntop(AF_INET, &da, ctx->last_frag_ip, sizeof(ctx->last_frag_ip));
-             ctx->trigger_mtu_probe = true;
-        }
+    PacketDiagShard* sh = (PacketDiagShard*)arg;
+    KTermPacketDiagContext* ctx = sh->ctx;
+
+    while (!atomic_load(&sh->stop)) {
+        uint32_t tail = atomic_load_explicit(&sh->ring_tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&sh->ring_head, memory_order_acquire);
+        if (tail == head) {
 #ifndef _WIN32
-        pthread_mutex_unlock(&ctx->mutex);
+            struct timespec idle = {0, 1000000};
+            nanosleep(&idle, NULL);
 #else
-        LeaveCriticalSection(&ctx->mutex);
+            Sleep(1);
 #endif
+            continue;
+        }
+        while (tail != head) {
+            PacketDiag_Dissect(ctx, sh, &sh->ring[tail & (KTERM_PACKETDIAG_RING_SLOTS - 1)]);
+            tail++;
+            atomic_store_explicit(&sh->ring_tail, tail, memory_order_release);
+        }
     }
+    return 0;
+}
 
-    int header_len = (ip_header[0] & 0x0F) * 4;
-    if (ip_len < header_len) return;
+#ifndef _WIN32
+static void* PacketDiag_Thread(void* arg) {
+#else
+static DWORD WINAPI PacketDiag_Thread(LPVOID arg) {
+#endif
+    KTermPacketDiagContext* ctx = (KTermPacketDiagContext*)arg;
+    if (!ctx) return 0;
 
-    // Proto
-    int proto = ip_header[9];
+    pcap_loop(ctx->handle, ctx->count > 0 ? ctx->count : -1, PacketDiag_PacketHandler, (u_char*)ctx);
 
-    // Src/Dst
-    char src[INET_ADDRSTRLEN], dst[INET_ADDRSTRLEN];
-    struct in_addr sa, da;
-    memcpy(&sa, ip_header + 12, 4);
-    memcpy(&da, ip_header + 16, 4);
-    inet_ntop(AF_INET, &sa, src, sizeof(src));
-    inet_ntop(AF_INET, &da, dst, sizeof(dst));
+    ctx->running = false;
 
-    // Prepare Output Buffer
-    // [Timestamp] Src -> Dst Proto Info
+    // Notify stopped
+    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Stopped.%s\r\n", ANSI_YELLOW, ANSI_RESET);
 
-    // Timestamp
-    struct tm* tm_info = localtime(&pkthdr->ts.tv_sec);
-    char time_str[32];
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", tm_info);
+    return 0;
+}
 
-    char out[1024];
-    int pos = 0;
+// --- Native Capture (AF_PACKET, TPACKET_V3) ---
 
-    // Timestamp (Gray)
-    pos += snprintf(out + pos, sizeof(out) - pos, "%s[%s.%06ld]%s ", ANSI_GRAY, time_str, (long)pkthdr->ts.tv_usec, ANSI_RESET);
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
 
-    // IP Flow (Blue)
-    pos += snprintf(out + pos, sizeof(out) - pos, "%s%s \xE2\x86\x92 %s%s ", ANSI_BLUE, src, dst, ANSI_RESET);
+// Filter compiler: the common tcpdump primitives, compiled to classic BPF so the kernel drops
+// unwanted packets before they are copied into the ring.
+//   expr      := term { (or | "||") term }
+//   term      := factor { (and | "&&") factor }
+//   factor    := (not | "!") factor | "(" expr ")" | primitive
+//   primitive := ip | ip6 | arp | tcp | udp | icmp | icmp6
+//              | [tcp | udp] [src | dst] port N
+//              | [ip | ip6] [src | dst] [host] ADDR
+//              | [src | dst] net A.B.C.D[/LEN]
+// Ports are read from the fixed IPv6 header and from unfragmented (or first-fragment) IPv4.
+enum { PD_BPF_AND, PD_BPF_OR, PD_BPF_NOT, PD_BPF_ETHERTYPE, PD_BPF_CMP, PD_BPF_PORT4 };
 
-    // Protocol Specifics
-    uint16_t src_port = 0;
-    uint16_t dst_port = 0;
-    const unsigned char* flow_payload = NULL;
-    int flow_payload_len = 0;
+typedef struct {
+    uint8_t kind;
+    uint8_t size;      // PD_BPF_CMP: BPF_B, BPF_H or BPF_W
+    int16_t a, b;      // Children
+    uint32_t off;      // From the network header (PD_BPF_PORT4: from the transport header)
+    uint32_t mask;
+    uint32_t value;
+} PacketDiagBpfNode;
 
-    if (proto == 6) { // TCP
-        const unsigned char* tcp = ip_header + header_len;
-        int tcp_len = ip_len - header_len;
-        if (tcp_len >= 20) {
-            int sport = (tcp[0] << 8) | tcp[1];
-            int dport = (tcp[2] << 8) | tcp[3];
-            src_port = sport; dst_port = dport;
-            int flags = tcp[13];
-
-            char flag_str[32] = "";
-            if (flags & 0x02) strcat(flag_str, "SYN ");
-            if (flags & 0x10) strcat(flag_str, "ACK ");
-            if (flags & 0x01) strcat(flag_str, "FIN ");
-            if (flags & 0x04) strcat(flag_str, "RST ");
-            if (flags & 0x08) strcat(flag_str, "PSH ");
-
-            const KTermProtocolDef* pdef = PacketDiag_IdentifyProtocol(sport, dport, false);
-
-            if (pdef) {
-                pos += snprintf(out + pos, sizeof(out) - pos, "%sTCP%s %d\xE2\x86\x92%d %s[%s]%s %s",
-                                ANSI_GREEN, ANSI_RESET, sport, dport, pdef->ansi_color, pdef->short_name, ANSI_RESET, flag_str);
-
-                if (pdef->supports_auth) {
-                    if (pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[33m[Auth]\x1B[0m");
-                    if (pdef->plaintext_auth && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[PLAIN]\x1B[0m");
-                    if (pdef->high_bruteforce_risk && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[BRUTE]\x1B[0m");
-                    if (pdef->high_relay_risk && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[RELAY]\x1B[0m");
-                    if (pdef->auth_notes && *pdef->auth_notes && pos < sizeof(out)) {
-                        pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[90m(%s)\x1B[0m", pdef->auth_notes);
-                    }
-                }
-            } else {
-                pos += snprintf(out + pos, sizeof(out) - pos, "%sTCP%s %d\xE2\x86\x92%d %s", ANSI_GREEN, ANSI_RESET, sport, dport, flag_str);
-            }
+typedef struct {
+    const char* p;
+    char tok[64];      // Lookahead
+    bool raw;          // Raw IP link: no Ethernet header, version nibble instead of EtherType
+    uint32_t link_len;
+    PacketDiagBpfNode nodes[256];
+    int node_count;
+    struct sock_filter insns[KTERM_PACKETDIAG_BPF_MAX];
+    int jt_label[KTERM_PACKETDIAG_BPF_MAX]; // Label ids until resolved, -1 = none
+    int jf_label[KTERM_PACKETDIAG_BPF_MAX];
+    int count;
+    int labels[KTERM_PACKETDIAG_BPF_MAX];   // Label id -> instruction index
+    int label_count;
+    char err[96];
+} PacketDiagBpfCompiler;
 
-            const unsigned char* payload = tcp + (tcp[12] >> 4) * 4;
-            int payload_len = tcp_len - ((tcp[12] >> 4) * 4);
-            int cap_remain = pkthdr->caplen - (int)(payload - pkt);
-            if (cap_remain < payload_len) payload_len = cap_remain;
+static void PacketDiag_BpfFail(PacketDiagBpfCompiler* c, const char* what) {
+    if (!c->err[0]) snprintf(c->err, sizeof(c->err), "%s near '%s'", what, c->tok);
+}
 
-            if (payload_len > 0) {
-                flow_payload = payload;
-                flow_payload_len = payload_len;
-            }
+static void PacketDiag_BpfAdvance(PacketDiagBpfCompiler* c) {
+    while (*c->p == ' ' || *c->p == '\t') c->p++;
+    int n = 0;
+    if (*c->p == '(' || *c->p == ')' || *c->p == '!') {
+        c->tok[n++] = *c->p++;
+    } else if ((c->p[0] == '&' && c->p[1] == '&') || (c->p[0] == '|' && c->p[1] == '|')) {
+        c->tok[n++] = *c->p++;
+        c->tok[n++] = *c->p++;
+    } else {
+        while (*c->p && (isalnum((unsigned char)*c->p) || strchr(".:/_-", *c->p)) && n < (int)sizeof(c->tok) - 1) c->tok[n++] = *c->p++;
+        if (n == 0 && *c->p) {
+            c->tok[n++] = *c->p++;
+            c->tok[n] = '\0';
+            PacketDiag_BpfFail(c, "Unexpected character");
+            return;
+        }
+    }
+    c->tok[n] = '\0';
+}
 
-            const char* pname = pdef ? pdef->short_name : NULL;
-            if ((pname && (strcmp(pname, "HTTP") == 0 || strcmp(pname, "HTTPS") == 0)) || sport == 80 || dport == 80 || sport == 8080 || dport == 8080) {
-                // Parse HTTP
-                if (payload_len > 0) {
-                    char http_info[256] = "";
-                    PacketDiag_ParseHTTP(payload, payload_len, http_info, sizeof(http_info));
-                    if (http_info[0]) pos += snprintf(out + pos, sizeof(out) - pos, "%s%s%s", ANSI_YELLOW, http_info, ANSI_RESET);
-                }
+static bool PacketDiag_BpfIs(const PacketDiagBpfCompiler* c, const char* word) {
+    return strcmp(c->tok, word) == 0;
+}
+
+static int PacketDiag_BpfNode(PacketDiagBpfCompiler* c, int kind, int a, int b) {
+    if (a < 0 || (b < 0 && kind != PD_BPF_NOT)) return -1;
+    if (c->node_count >= (int)(sizeof(c->nodes) / sizeof(c->nodes[0]))) { PacketDiag_BpfFail(c, "Filter too long"); return -1; }
+    PacketDiagBpfNode* n = &c->nodes[c->node_count];
+    memset(n, 0, sizeof(*n));
+    n->kind = (uint8_t)kind;
+    n->a = (int16_t)a;
+    n->b = (int16_t)b;
+    return c->node_count++;
+}
+
+static int PacketDiag_BpfLeaf(PacketDiagBpfCompiler* c, int kind, int size, uint32_t off, uint32_t mask, uint32_t value) {
+    int i = PacketDiag_BpfNode(c, kind, 0, 0);
+    if (i < 0) return -1;
+    c->nodes[i].size = (uint8_t)size;
+    c->nodes[i].off = off;
+    c->nodes[i].mask = mask;
+    c->nodes[i].value = value;
+    return i;
+}
+
+static int PacketDiag_BpfEther(PacketDiagBpfCompiler* c, uint16_t type) {
+    return PacketDiag_BpfLeaf(c, PD_BPF_ETHERTYPE, 0, 0, 0, type);
+}
+
+static int PacketDiag_BpfByte(PacketDiagBpfCompiler* c, uint32_t off, uint32_t value) {
+    return PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_B, off, 0xFF, value);
+}
+
+// src -> a, dst -> b, either -> a or b
+static int PacketDiag_BpfDir(PacketDiagBpfCompiler* c, int dir, int src, int dst) {
+    if (dir == 1) return src;
+    if (dir == 2) return dst;
+    return PacketDiag_BpfNode(c, PD_BPF_OR, src, dst);
+}
+
+// IPv4 protocol / IPv6 next header, for tcp, udp, icmp and icmp6 (0 = TCP or UDP)
+static int PacketDiag_BpfTransport(PacketDiagBpfCompiler* c, int family, int proto) {
+    int v4 = -1, v6 = -1;
+    if (family != 6) {
+        int p = proto ? PacketDiag_BpfByte(c, 9, (uint32_t)proto)
+                      : PacketDiag_BpfNode(c, PD_BPF_OR, PacketDiag_BpfByte(c, 9, 6), PacketDiag_BpfByte(c, 9, 17));
+        v4 = PacketDiag_BpfNode(c, PD_BPF_AND, PacketDiag_BpfEther(c, 0x0800), p);
+    }
+    if (family != 4) {
+        int p = proto ? PacketDiag_BpfByte(c, 6, (uint32_t)proto)
+                      : PacketDiag_BpfNode(c, PD_BPF_OR, PacketDiag_BpfByte(c, 6, 6), PacketDiag_BpfByte(c, 6, 17));
+        v6 = PacketDiag_BpfNode(c, PD_BPF_AND, PacketDiag_BpfEther(c, 0x86DD), p);
+    }
+    if (family == 4) return v4;
+    if (family == 6) return v6;
+    return PacketDiag_BpfNode(c, PD_BPF_OR, v4, v6);
+}
+
+static int PacketDiag_BpfPort(PacketDiagBpfCompiler* c, int proto, int dir, uint16_t port) {
+    // IPv4: only the first fragment carries ports, the header length comes from the IHL
+    int p4 = PacketDiag_BpfTransport(c, 4, proto);
+    int first = PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_H, 6, 0x1FFF, 0);
+    int ports4 = PacketDiag_BpfDir(c, dir, PacketDiag_BpfLeaf(c, PD_BPF_PORT4, BPF_H, 0, 0xFFFF, port),
+                                           PacketDiag_BpfLeaf(c, PD_BPF_PORT4, BPF_H, 2, 0xFFFF, port));
+    int v4 = PacketDiag_BpfNode(c, PD_BPF_AND, p4, PacketDiag_BpfNode(c, PD_BPF_AND, first, ports4));
+    int p6 = PacketDiag_BpfTransport(c, 6, proto);
+    int ports6 = PacketDiag_BpfDir(c, dir, PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_H, 40, 0xFFFF, port),
+                                           PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_H, 42, 0xFFFF, port));
+    int v6 = PacketDiag_BpfNode(c, PD_BPF_AND, p6, ports6);
+    return PacketDiag_BpfNode(c, PD_BPF_OR, v4, v6);
+}
+
+// IPv4 address (or prefix) match; IPv6 addresses compare as four words
+static int PacketDiag_BpfHost(PacketDiagBpfCompiler* c, int family, int dir, const char* text, bool net) {
+    char addr[64];
+    strncpy(addr, text, sizeof(addr) - 1);
+    addr[sizeof(addr) - 1] = '\0';
+    int prefix = -1;
+    char* slash = strchr(addr, '/');
+    if (slash) {
+        *slash = '\0';
+        prefix = atoi(slash + 1);
+    }
+
+    uint8_t a4[4], a6[16];
+    if (family != 6 && inet_pton(AF_INET, addr, a4) == 1) {
+        if (prefix < 0) prefix = 32;
+        if (prefix > 32 || (!net && prefix != 32)) { PacketDiag_BpfFail(c, "Bad prefix"); return -1; }
+        uint32_t mask = prefix ? 0xFFFFFFFFu << (32 - prefix) : 0;
+        uint32_t value = ((uint32_t)a4[0] << 24 | (uint32_t)a4[1] << 16 | (uint32_t)a4[2] << 8 | a4[3]) & mask;
+        int m = PacketDiag_BpfDir(c, dir, PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_W, 12, mask, value),
+                                          PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_W, 16, mask, value));
+        return PacketDiag_BpfNode(c, PD_BPF_AND, PacketDiag_BpfEther(c, 0x0800), m);
+    }
+    if (family != 4 && !net && prefix < 0 && inet_pton(AF_INET6, addr, a6) == 1) {
+        int side[2];
+        for (int s = 0; s < 2; s++) {
+            side[s] = -1;
+            for (int w = 0; w < 4; w++) {
+                uint32_t value = (uint32_t)a6[w * 4] << 24 | (uint32_t)a6[w * 4 + 1] << 16 | (uint32_t)a6[w * 4 + 2] << 8 | a6[w * 4 + 3];
+                int leaf = PacketDiag_BpfLeaf(c, PD_BPF_CMP, BPF_W, (s ? 24u : 8u) + (uint32_t)w * 4, 0xFFFFFFFFu, value);
+                side[s] = side[s] < 0 ? leaf : PacketDiag_BpfNode(c, PD_BPF_AND, side[s], leaf);
             }
         }
-    } else if (proto == 17) { // UDP
-        const unsigned char* udp = ip_header + header_len;
-        if (ip_len - header_len >= 8) {
-            int sport = (udp[0] << 8) | udp[1];
-            int dport = (udp[2] << 8) | udp[3];
-            src_port = sport; dst_port = dport;
-            int len = (udp[4] << 8) | udp[5];
+        return PacketDiag_BpfNode(c, PD_BPF_AND, PacketDiag_BpfEther(c, 0x86DD), PacketDiag_BpfDir(c, dir, side[0], side[1]));
+    }
+    PacketDiag_BpfFail(c, "Bad address");
+    return -1;
+}
 
-            // Payload
-            const unsigned char* payload = udp + 8;
-            int payload_len = len - 8;
-            // Safer calculation against captured length
-            int cap_remain = pkthdr->caplen - (int)(payload - pkt);
-            if (cap_remain < payload_len) payload_len = cap_remain;
+static int PacketDiag_BpfPrimitive(PacketDiagBpfCompiler* c) {
+    int family = 0, proto = -1; // proto -1: no transport qualifier
+    if (PacketDiag_BpfIs(c, "arp")) {
+        PacketDiag_BpfAdvance(c);
+        return PacketDiag_BpfEther(c, 0x0806);
+    }
+    if (PacketDiag_BpfIs(c, "ip")) family = 4;
+    else if (PacketDiag_BpfIs(c, "ip6")) family = 6;
+    else if (PacketDiag_BpfIs(c, "tcp")) proto = 6;
+    else if (PacketDiag_BpfIs(c, "udp")) proto = 17;
+    else if (PacketDiag_BpfIs(c, "icmp")) { family = 4; proto = 1; }
+    else if (PacketDiag_BpfIs(c, "icmp6")) { family = 6; proto = 58; }
+    bool qualified = family || proto >= 0;
+    if (qualified) PacketDiag_BpfAdvance(c);
+
+    int dir = 0;
+    if (PacketDiag_BpfIs(c, "src")) dir = 1;
+    else if (PacketDiag_BpfIs(c, "dst")) dir = 2;
+    if (dir) PacketDiag_BpfAdvance(c);
+
+    if (PacketDiag_BpfIs(c, "port")) {
+        if (family || proto == 1 || proto == 58) { PacketDiag_BpfFail(c, "port needs tcp or udp"); return -1; }
+        PacketDiag_BpfAdvance(c);
+        char* end = NULL;
+        long port = strtol(c->tok, &end, 10);
+        if (!c->tok[0] || *end || port < 0 || port > 65535) { PacketDiag_BpfFail(c, "Bad port"); return -1; }
+        PacketDiag_BpfAdvance(c);
+        return PacketDiag_BpfPort(c, proto < 0 ? 0 : proto, dir, (uint16_t)port);
+    }
+    bool net = PacketDiag_BpfIs(c, "net");
+    if (net || PacketDiag_BpfIs(c, "host")) {
+        if (proto >= 0) { PacketDiag_BpfFail(c, "host/net takes ip or ip6"); return -1; }
+        PacketDiag_BpfAdvance(c);
+    } else if (!dir && !strchr(c->tok, '.') && !strchr(c->tok, ':')) {
+        // Bare protocol
+        if (!qualified) { PacketDiag_BpfFail(c, "Unknown primitive"); return -1; }
+        if (proto < 0) return PacketDiag_BpfEther(c, family == 6 ? 0x86DD : 0x0800);
+        return PacketDiag_BpfTransport(c, family, proto);
+    }
+    if (proto >= 0) { PacketDiag_BpfFail(c, "host/net takes ip or ip6"); return -1; }
+    int node = PacketDiag_BpfHost(c, family, dir, c->tok, net);
+    PacketDiag_BpfAdvance(c);
+    return node;
+}
 
-            if (payload_len > 0) {
-                flow_payload = payload;
-                flow_payload_len = payload_len;
-            }
+static int PacketDiag_BpfExpr(PacketDiagBpfCompiler* c);
+
+static int PacketDiag_BpfFactor(PacketDiagBpfCompiler* c) {
+    if (PacketDiag_BpfIs(c, "not") || PacketDiag_BpfIs(c, "!")) {
+        PacketDiag_BpfAdvance(c);
+        return PacketDiag_BpfNode(c, PD_BPF_NOT, PacketDiag_BpfFactor(c), -1);
+    }
+    if (PacketDiag_BpfIs(c, "(")) {
+        PacketDiag_BpfAdvance(c);
+        int e = PacketDiag_BpfExpr(c);
+        if (!PacketDiag_BpfIs(c, ")")) { PacketDiag_BpfFail(c, "Missing ')'"); return -1; }
+        PacketDiag_BpfAdvance(c);
+        return e;
+    }
+    return PacketDiag_BpfPrimitive(c);
+}
 
-            const KTermProtocolDef* pdef = PacketDiag_IdentifyProtocol(sport, dport, true);
+static int PacketDiag_BpfTerm(PacketDiagBpfCompiler* c) {
+    int a = PacketDiag_BpfFactor(c);
+    while (a >= 0 && (PacketDiag_BpfIs(c, "and") || PacketDiag_BpfIs(c, "&&"))) {
+        PacketDiag_BpfAdvance(c);
+        a = PacketDiag_BpfNode(c, PD_BPF_AND, a, PacketDiag_BpfFactor(c));
+    }
+    return a;
+}
 
-            if (pdef) {
-                pos += snprintf(out + pos, sizeof(out) - pos, "%sUDP%s %d\xE2\x86\x92%d %s[%s]%s", ANSI_CYAN, ANSI_RESET, sport, dport, pdef->ansi_color, pdef->short_name, ANSI_RESET);
+static int PacketDiag_BpfExpr(PacketDiagBpfCompiler* c) {
+    int a = PacketDiag_BpfTerm(c);
+    while (a >= 0 && (PacketDiag_BpfIs(c, "or") || PacketDiag_BpfIs(c, "||"))) {
+        PacketDiag_BpfAdvance(c);
+        a = PacketDiag_BpfNode(c, PD_BPF_OR, a, PacketDiag_BpfTerm(c));
+    }
+    return a;
+}
 
-                if (pdef->supports_auth) {
-                    if (pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[33m[Auth]\x1B[0m");
-                    if (pdef->plaintext_auth && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[PLAIN]\x1B[0m");
-                    if (pdef->high_bruteforce_risk && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[BRUTE]\x1B[0m");
-                    if (pdef->high_relay_risk && pos < sizeof(out)) pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[31m[RELAY]\x1B[0m");
-                    if (pdef->auth_notes && *pdef->auth_notes && pos < sizeof(out)) {
-                        pos += snprintf(out + pos, sizeof(out) - pos, " \x1B[90m(%s)\x1B[0m", pdef->auth_notes);
-                    }
-                }
+static int PacketDiag_BpfLabel(PacketDiagBpfCompiler* c) {
+    if (c->label_count >= KTERM_PACKETDIAG_BPF_MAX) { PacketDiag_BpfFail(c, "Filter too long"); return 0; }
+    c->labels[c->label_count] = -1;
+    return c->label_count++;
+}
+
+static void PacketDiag_BpfEmit(PacketDiagBpfCompiler* c, uint16_t code, uint32_t k, int jt, int jf) {
+    if (c->count >= KTERM_PACKETDIAG_BPF_MAX) { PacketDiag_BpfFail(c, "Filter too long"); return; }
+    struct sock_filter* f = &c->insns[c->count];
+    f->code = code;
+    f->jt = f->jf = 0;
+    f->k = k;
+    c->jt_label[c->count] = jt;
+    c->jf_label[c->count] = jf;
+    c->count++;
+}
+
+// Short-circuit code generation: every node jumps to `t` when it matches and `f` otherwise.
+// Labels are only ever placed after the code that references them, so all jumps are forward.
+static void PacketDiag_BpfGen(PacketDiagBpfCompiler* c, int i, int t, int f) {
+    const PacketDiagBpfNode* n = &c->nodes[i];
+    int l;
+    switch (n->kind) {
+        case PD_BPF_AND:
+            l = PacketDiag_BpfLabel(c);
+            PacketDiag_BpfGen(c, n->a, l, f);
+            c->labels[l] = c->count;
+            PacketDiag_BpfGen(c, n->b, t, f);
+            break;
+        case PD_BPF_OR:
+            l = PacketDiag_BpfLabel(c);
+            PacketDiag_BpfGen(c, n->a, t, l);
+            c->labels[l] = c->count;
+            PacketDiag_BpfGen(c, n->b, t, f);
+            break;
+        case PD_BPF_NOT:
+            PacketDiag_BpfGen(c, n->a, f, t);
+            break;
+        case PD_BPF_ETHERTYPE:
+            if (!c->raw) {
+                PacketDiag_BpfEmit(c, BPF_LD | BPF_H | BPF_ABS, 12, -1, -1);
+                PacketDiag_BpfEmit(c, BPF_JMP | BPF_JEQ | BPF_K, n->value, t, f);
+            } else if (n->value == 0x0800 || n->value == 0x86DD) {
+                PacketDiag_BpfEmit(c, BPF_LD | BPF_B | BPF_ABS, 0, -1, -1);
+                PacketDiag_BpfEmit(c, BPF_ALU | BPF_AND | BPF_K, 0xF0, -1, -1);
+                PacketDiag_BpfEmit(c, BPF_JMP | BPF_JEQ | BPF_K, n->value == 0x0800 ? 0x40 : 0x60, t, f);
             } else {
-                pos += snprintf(out + pos, sizeof(out) - pos, "%sUDP%s %d\xE2\x86\x92%d Len=%d", ANSI_CYAN, ANSI_RESET, sport, dport, len);
+                PacketDiag_BpfEmit(c, BPF_JMP | BPF_JA, 0, f, -1); // No ARP on a raw IP link
             }
+            break;
+        case PD_BPF_CMP: {
+            uint32_t full = n->size == BPF_B ? 0xFFu : n->size == BPF_H ? 0xFFFFu : 0xFFFFFFFFu;
+            PacketDiag_BpfEmit(c, (uint16_t)(BPF_LD | n->size | BPF_ABS), c->link_len + n->off, -1, -1);
+            if (n->mask != full) PacketDiag_BpfEmit(c, BPF_ALU | BPF_AND | BPF_K, n->mask, -1, -1);
+            PacketDiag_BpfEmit(c, BPF_JMP | BPF_JEQ | BPF_K, n->value, t, f);
+            break;
+        }
+        case PD_BPF_PORT4:
+            PacketDiag_BpfEmit(c, BPF_LDX | BPF_B | BPF_MSH, c->link_len, -1, -1); // X = IPv4 header length
+            PacketDiag_BpfEmit(c, BPF_LD | BPF_H | BPF_IND, c->link_len + n->off, -1, -1);
+            PacketDiag_BpfEmit(c, BPF_JMP | BPF_JEQ | BPF_K, n->value, t, f);
+            break;
+    }
+}
+
+// Compiles `expr` (empty = everything) into prog->filter (caller frees). Accepted packets are
+// truncated to snaplen by the program's return value.
+static bool PacketDiag_CompileFilter(const char* expr, bool raw, uint32_t snaplen, struct sock_fprog* prog, char* err, size_t err_len) {
+    PacketDiagBpfCompiler* c = (PacketDiagBpfCompiler*)calloc(1, sizeof(PacketDiagBpfCompiler));
+    if (!c) { snprintf(err, err_len, "Out of memory"); return false; }
+    c->p = expr ? expr : "";
+    c->raw = raw;
+    c->link_len = raw ? 0 : 14;
+    PacketDiag_BpfAdvance(c);
+
+    int accept = PacketDiag_BpfLabel(c);
+    int reject = PacketDiag_BpfLabel(c);
+    if (c->tok[0]) {
+        int root = PacketDiag_BpfExpr(c);
+        if (c->tok[0] && !c->err[0]) PacketDiag_BpfFail(c, "Unexpected token");
+        if (root >= 0 && !c->err[0]) PacketDiag_BpfGen(c, root, accept, reject);
+    }
+    c->labels[accept] = c->count;
+    PacketDiag_BpfEmit(c, BPF_RET | BPF_K, snaplen, -1, -1);
+    c->labels[reject] = c->count;
+    PacketDiag_BpfEmit(c, BPF_RET | BPF_K, 0, -1, -1);
+
+    // Resolve labels into relative offsets
+    for (int i = 0; i < c->count && !c->err[0]; i++) {
+        struct sock_filter* f = &c->insns[i];
+        if (f->code == (BPF_JMP | BPF_JA)) {
+            f->k = (uint32_t)(c->labels[c->jt_label[i]] - (i + 1));
+        } else if (c->jt_label[i] >= 0) {
+            int jt = c->labels[c->jt_label[i]] - (i + 1);
+            int jf = c->labels[c->jf_label[i]] - (i + 1);
+            if (jt < 0 || jf < 0 || jt > 255 || jf > 255) { snprintf(c->err, sizeof(c->err), "Filter too long"); break; }
+            f->jt = (uint8_t)jt;
+            f->jf = (uint8_t)jf;
+        }
+    }
+
+    bool ok = !c->err[0];
+    if (ok) {
+        prog->len = (unsigned short)c->count;
+        prog->filter = (struct sock_filter*)malloc((size_t)c->count * sizeof(struct sock_filter));
+        if (prog->filter) memcpy(prog->filter, c->insns, (size_t)c->count * sizeof(struct sock_filter));
+        else { ok = false; snprintf(err, err_len, "Out of memory"); }
+    } else {
+        snprintf(err, err_len, "%s", c->err);
+    }
+    free(c);
+    return ok;
+}
 
-            const char* pname = pdef ? pdef->short_name : NULL;
+static void PacketDiag_TPacketClose(KTermPacketDiagContext* ctx) {
+    if (ctx->tp_map) munmap(ctx->tp_map, ctx->tp_map_len);
+    ctx->tp_map = NULL;
+    if (ctx->tp_fd >= 0) close(ctx->tp_fd);
+    ctx->tp_fd = -1;
+}
 
-            // Parsing Logic
-            if ((pname && (strstr(pname, "Dante") || strstr(pname, "RTP"))) || dport == 4321 || sport == 4321) {
-                if (payload_len > 0) {
-                    char rtp_info[256] = "";
-                    PacketDiag_ParseRTP(payload, payload_len, rtp_info, sizeof(rtp_info));
-                    if (rtp_info[0]) pos += snprintf(out + pos, sizeof(out) - pos, "%s%s%s", ANSI_MAGENTA, rtp_info, ANSI_RESET);
-                }
-            }
-            else if ((pname && strstr(pname, "PTP")) || dport == 319 || dport == 320 || sport == 319 || sport == 320) {
-                if (payload_len > 0) {
-                    char ptp_info[256] = "";
-                    PacketDiag_ParsePTP(payload, payload_len, ptp_info, sizeof(ptp_info));
-                    if (ptp_info[0]) pos += snprintf(out + pos, sizeof(out) - pos, "%s%s%s", ANSI_CYAN, ptp_info, ANSI_RESET);
-                }
-            }
-            else if ((pname && (strcmp(pname, "DNS") == 0 || strcmp(pname, "mDNS") == 0)) || dport == 53 || sport == 53) {
-                if (payload_len > 0) {
-                    char dns_info[256] = "";
-                    PacketDiag_ParseDNS(payload, payload_len, dns_info, sizeof(dns_info));
-                    if (dns_info[0]) pos += snprintf(out + pos, sizeof(out) - pos, "%s%s%s", ANSI_YELLOW, dns_info, ANSI_RESET);
-                }
-            }
-            else {
-                // Heuristic RTP check
-                if (payload_len > 12 && (payload[0] & 0xC0) == 0x80) { // Version 2
-                     // Maybe RTP? Check PT < 128?
-                     if ((payload[1] & 0x7F) < 128) {
-                         char rtp_info[256] = "";
-                         PacketDiag_ParseRTP(payload, payload_len, rtp_info, sizeof(rtp_info));
-                         if (rtp_info[0]) pos += snprintf(out + pos, sizeof(out) - pos, "%s%s?%s", ANSI_GRAY, rtp_info, ANSI_RESET);
-                     }
-                }
+// Opens an AF_PACKET socket on `iface` with the compiled filter and a mapped TPACKET_V3 ring
+static bool PacketDiag_TPacketOpen(KTermPacketDiagContext* ctx, const char* iface, char* err, size_t err_len) {
+    unsigned int ifindex = if_nametoindex(iface);
+    if (ifindex == 0) { snprintf(err, err_len, "No such interface"); return false; }
+
+    // Protocol 0 until bound: nothing is queued before the filter is in place
+    ctx->tp_fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (ctx->tp_fd < 0) { snprintf(err, err_len, "socket: %s", strerror(errno)); return false; }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, iface, sizeof(ifr.ifr_name) - 1);
+    if (ioctl(ctx->tp_fd, SIOCGIFHWADDR, &ifr) < 0) { snprintf(err, err_len, "SIOCGIFHWADDR: %s", strerror(errno)); goto fail; }
+    ctx->tp_loopback = (ifr.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK);
+    switch (ifr.ifr_hwaddr.sa_family) {
+        case ARPHRD_LOOPBACK: // lo frames carry an all-zero Ethernet header
+        case ARPHRD_ETHER: ctx->dlt = DLT_EN10MB; break;
+        case ARPHRD_NONE: ctx->dlt = DLT_RAW; break; // tun and friends
+        default: snprintf(err, err_len, "Unsupported link type %d", ifr.ifr_hwaddr.sa_family); goto fail;
+    }
+
+    struct sock_fprog prog = {0};
+    if (!PacketDiag_CompileFilter(ctx->filter_exp, ctx->dlt == DLT_RAW, (uint32_t)ctx->snaplen, &prog, err, err_len)) goto fail;
+    int rc = setsockopt(ctx->tp_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+    free(prog.filter);
+    if (rc < 0) { snprintf(err, err_len, "SO_ATTACH_FILTER: %s", strerror(errno)); goto fail; }
+
+    int version = TPACKET_V3;
+    if (setsockopt(ctx->tp_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        snprintf(err, err_len, "TPACKET_V3: %s", strerror(errno));
+        goto fail;
+    }
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = KTERM_PACKETDIAG_TPACKET_BLOCK;
+    req.tp_block_nr = KTERM_PACKETDIAG_TPACKET_BLOCKS;
+    req.tp_frame_size = 2048; // Only used to size the ring, V3 packs frames back to back
+    req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+    req.tp_retire_blk_tov = ctx->timeout_ms > 0 && ctx->timeout_ms < 100 ? (unsigned int)ctx->timeout_ms : 100; // ms until a partial block is handed over
+    if (setsockopt(ctx->tp_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        snprintf(err, err_len, "PACKET_RX_RING: %s", strerror(errno));
+        goto fail;
+    }
+    ctx->tp_block_nr = req.tp_block_nr;
+    ctx->tp_map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+    void* map = mmap(NULL, ctx->tp_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->tp_fd, 0);
+    if (map == MAP_FAILED) { snprintf(err, err_len, "mmap: %s", strerror(errno)); goto fail; }
+    ctx->tp_map = (uint8_t*)map;
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = (int)ifindex;
+    if (bind(ctx->tp_fd, (struct sockaddr*)&sll, sizeof(sll)) < 0) { snprintf(err, err_len, "bind: %s", strerror(errno)); goto fail; }
+
+    if (ctx->promisc) {
+        struct packet_mreq mr;
+        memset(&mr, 0, sizeof(mr));
+        mr.mr_ifindex = (int)ifindex;
+        mr.mr_type = PACKET_MR_PROMISC;
+        setsockopt(ctx->tp_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)); // Best effort, dropped with the socket
+    }
+    return true;
+
+fail:
+    PacketDiag_TPacketClose(ctx);
+    return false;
+}
+
+// Fills `hdr` for one ring frame and returns its bytes. The kernel strips the 802.1Q tag into
+// tp_vlan_tci; it is put back (as libpcap does) via `scratch` so the dissector and the recording
+// see the frame as it was on the wire.
+static const uint8_t* PacketDiag_TPacketFrame(const KTermPacketDiagContext* ctx, const struct tpacket3_hdr* h, uint8_t* scratch, size_t scratch_len, struct pcap_pkthdr* hdr) {
+    const uint8_t* frame = (const uint8_t*)h + h->tp_mac;
+    hdr->ts.tv_sec = h->tp_sec;
+    hdr->ts.tv_usec = h->tp_nsec / 1000;
+    hdr->caplen = h->tp_snaplen;
+    hdr->len = h->tp_len;
+#ifdef TP_STATUS_VLAN_VALID
+    if (scratch && ctx->dlt == DLT_EN10MB && (h->tp_status & TP_STATUS_VLAN_VALID) && h->tp_snaplen >= 12 && scratch_len > 16) {
+        uint16_t tpid = ETH_P_8021Q;
+#ifdef TP_STATUS_VLAN_TPID_VALID
+        if ((h->tp_status & TP_STATUS_VLAN_TPID_VALID) && h->hv1.tp_vlan_tpid) tpid = h->hv1.tp_vlan_tpid;
+#endif
+        uint16_t tci = (uint16_t)h->hv1.tp_vlan_tci;
+        size_t len = h->tp_snaplen;
+        if (len + 4 > scratch_len) len = scratch_len - 4;
+        memcpy(scratch, frame, 12);
+        scratch[12] = (uint8_t)(tpid >> 8); scratch[13] = (uint8_t)tpid;
+        scratch[14] = (uint8_t)(tci >> 8);  scratch[15] = (uint8_t)tci;
+        memcpy(scratch + 16, frame + 12, len - 12);
+        hdr->caplen = (uint32_t)len + 4;
+        hdr->len = h->tp_len + 4;
+        return scratch;
+    }
+#else
+    (void)ctx; (void)scratch; (void)scratch_len;
+#endif
+    return frame;
+}
+
+// Stands in for pcap_loop: hands each retired block's packets to the handler in place, then
+// returns the block to the kernel. One poll() per block rather than a syscall per packet.
+static void* PacketDiag_TPacketThread(void* arg) {
+    KTermPacketDiagContext* ctx = (KTermPacketDiagContext*)arg;
+    size_t vlan_len = (size_t)(ctx->snaplen > 0 ? ctx->snaplen : 65535) + 4;
+    uint8_t* vlan_buf = (uint8_t*)malloc(vlan_len); // Without it tagged frames go through untagged
+    struct pollfd pfd;
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = ctx->tp_fd;
+    pfd.events = POLLIN | POLLERR;
+    uint32_t block = 0;
+
+    while (ctx->running) {
+        if (ctx->count > 0 && ctx->captured_count >= ctx->count) break;
+        struct tpacket_block_desc* bd = (struct tpacket_block_desc*)(ctx->tp_map + (size_t)block * KTERM_PACKETDIAG_TPACKET_BLOCK);
+        if (!(((volatile struct tpacket_hdr_v1*)&bd->hdr.bh1)->block_status & TP_STATUS_USER)) {
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        atomic_thread_fence(memory_order_acquire);
+
+        const uint8_t* p = (const uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt;
+        for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+            const struct tpacket3_hdr* h = (const struct tpacket3_hdr*)p;
+            const struct sockaddr_ll* from = (const struct sockaddr_ll*)(p + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            if (!(ctx->tp_loopback && from->sll_pkttype == PACKET_OUTGOING)) {
+                struct pcap_pkthdr hdr;
+                const uint8_t* frame = PacketDiag_TPacketFrame(ctx, h, vlan_buf, vlan_len, &hdr);
+                PacketDiag_PacketHandler((u_char*)ctx, &hdr, frame);
             }
+            p += h->tp_next_offset;
         }
-    } else if (proto == 1) { // ICMP
-        pos += snprintf(out + pos, sizeof(out) - pos, "%sICMP%s", ANSI_MAGENTA, ANSI_RESET);
-    } else {
-        pos += snprintf(out + pos, sizeof(out) - pos, "Proto=%d", proto);
+
+        atomic_thread_fence(memory_order_release);
+        ((volatile struct tpacket_hdr_v1*)&bd->hdr.bh1)->block_status = TP_STATUS_KERNEL;
+        block = (block + 1) % ctx->tp_block_nr;
     }
 
-    // Update Stats & Flows
-    PacketDiagFlowKey key = {0};
-    bool has_key = false;
-    char stream_out_buf[512] = {0};
+    free(vlan_buf);
+    ctx->running = false;
+    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Stopped.%s\r\n", ANSI_YELLOW, ANSI_RESET);
+    return 0;
+}
+
+#endif // KTERM_PACKETDIAG_HAVE_TPACKET
 
-    // Only track IPv4 flows for now (already checked version=4 earlier)
-    if (src_port > 0 || dst_port > 0) {
-        has_key = true;
-        memcpy(&key.src_ip, &sa, 4);
-        memcpy(&key.dst_ip, &da, 4);
-        key.proto = proto;
-        key.src_port = src_port;
-        key.dst_port = dst_port;
+// --- PCAP-NG Recording (writer thread) ---
+
+static bool PacketDiag_RecordWrite(KTermPacketDiagContext* ctx, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(ctx->record_fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Recording to %s failed: %s%s\r\n", ANSI_RED, ctx->record_path, strerror(errno), ANSI_RESET);
+            atomic_store(&ctx->record_failed, true);
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
     }
+    return true;
+}
 
 #ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
+static void* PacketDiag_RecordThread(void* arg) {
 #else
-    EnterCriticalSection(&ctx->mutex);
+static DWORD WINAPI PacketDiag_RecordThread(LPVOID arg) {
+#endif
+    KTermPacketDiagContext* ctx = (KTermPacketDiagContext*)arg;
+    // O_DIRECT needs block-aligned buffers and lengths; the unaligned tail waits for more data
+    size_t align = ctx->record_direct ? 4096 : 1;
+    uint8_t* stage = NULL;
+#ifndef _WIN32
+    if (posix_memalign((void**)&stage, 4096, KTERM_PACKETDIAG_RECORD_CHUNK) != 0) stage = NULL;
+#else
+    stage = (uint8_t*)malloc(KTERM_PACKETDIAG_RECORD_CHUNK);
+#endif
+    if (!stage) {
+        atomic_store(&ctx->record_failed, true);
+        return 0;
+    }
+
+    size_t staged = 0;
+    while (!atomic_load(&ctx->record_failed)) {
+        uint64_t tail = atomic_load_explicit(&ctx->record_tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ctx->record_head, memory_order_acquire);
+        size_t n = (size_t)(head - tail);
+        if (n > KTERM_PACKETDIAG_RECORD_CHUNK - staged) n = KTERM_PACKETDIAG_RECORD_CHUNK - staged;
+        if (n == 0 && staged < align) {
+            if (atomic_load(&ctx->record_stop)) break;
+#ifndef _WIN32
+            struct timespec idle = {0, 1000000};
+            nanosleep(&idle, NULL);
+#else
+            Sleep(1);
 #endif
+            continue;
+        }
 
-    // Update Global Stats
-    ctx->stats.total_packets++;
-    ctx->stats.total_bytes += pkthdr->len;
-    if (proto == 6) ctx->stats.tcp_packets++;
-    else if (proto == 17) ctx->stats.udp_packets++;
-    else if (proto == 1) ctx->stats.icmp_packets++;
-    else ctx->stats.other_packets++;
+        for (size_t done = 0; done < n; ) {
+            size_t off = (size_t)((tail + done) & (KTERM_PACKETDIAG_RECORD_BYTES - 1));
+            size_t part = KTERM_PACKETDIAG_RECORD_BYTES - off;
+            if (part > n - done) part = n - done;
+            memcpy(stage + staged + done, ctx->record_ring + off, part);
+            done += part;
+        }
+        staged += n;
+        atomic_store_explicit(&ctx->record_tail, tail + n, memory_order_release);
 
-    // Update Flow
-    if (has_key) {
-        uint8_t hash = (key.src_ip ^ key.dst_ip ^ key.src_port ^ key.dst_port ^ key.proto) & 0xFF;
-        PacketDiagFlow* flow = ctx->flow_table[hash];
-        while (flow) {
-            if (memcmp(&flow->key, &key, sizeof(key)) == 0) break;
-            flow = flow->next;
-        }
-        if (!flow && ctx->next_flow_id < 1024) {
-            flow = (PacketDiagFlow*)calloc(1, sizeof(PacketDiagFlow));
-            if (flow) {
-                flow->key = key;
-                flow->id = ++ctx->next_flow_id;
-                flow->next = ctx->flow_table[hash];
-                ctx->flow_table[hash] = flow;
-            }
+        size_t out = staged - staged % align;
+        if (out > 0) {
+            if (!PacketDiag_RecordWrite(ctx, stage, out)) break;
+            memmove(stage, stage + out, staged - out);
+            staged -= out;
         }
+    }
 
-        if (flow) {
-            flow->stats.packets++;
-            flow->stats.bytes += pkthdr->len;
+    // Final partial block goes out without O_DIRECT
+    if (staged > 0 && !atomic_load(&ctx->record_failed)) {
+#ifdef KTERM_O_DIRECT
+        if (ctx->record_direct) fcntl(ctx->record_fd, F_SETFL, fcntl(ctx->record_fd, F_GETFL) & ~KTERM_O_DIRECT);
+#endif
+        PacketDiag_RecordWrite(ctx, stage, staged);
+    }
+    free(stage);
+    return 0;
+}
 
-            // Deep Inspection for Auth
-            if (!flow->auth_detected && flow_payload && flow_payload_len > 0) {
-                 if (KTerm_Net_ScanPayloadForAuth(flow_payload, flow_payload_len, flow->auth_proto, flow->auth_user, &flow->auth_risk)) {
-                     flow->auth_detected = true;
-                 }
-            }
+// Opens the file, queues the Section Header and Interface Description blocks and starts the writer.
+static bool PacketDiag_StartRecording(KTermPacketDiagContext* ctx) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    ctx->record_fd = -1;
+#ifdef KTERM_O_DIRECT
+    if (ctx->record_direct) {
+        ctx->record_fd = open(ctx->record_path, flags | KTERM_O_DIRECT, 0644);
+        if (ctx->record_fd < 0) {
+            // tmpfs and some network filesystems refuse O_DIRECT
+            PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] O_DIRECT unavailable for %s, using buffered writes%s\r\n", ANSI_YELLOW, ctx->record_path, ANSI_RESET);
+        }
+    }
+#endif
+    if (ctx->record_fd < 0) {
+        ctx->record_direct = false;
+        ctx->record_fd = open(ctx->record_path, flags, 0644);
+    }
+    if (ctx->record_fd < 0) return false;
 
-            // Jitter calc (Inter-Arrival Variance)
-            double now = (double)pkthdr->ts.tv_sec + (double)pkthdr->ts.tv_usec / 1000000.0;
-            if (flow->stats.last_jitter_ts > 0) {
-                double delta = now - flow->stats.last_jitter_ts;
-                if (delta < 0) delta = 0;
+    ctx->record_ring = (uint8_t*)malloc(KTERM_PACKETDIAG_RECORD_BYTES);
+    if (!ctx->record_ring) {
+        close(ctx->record_fd);
+        ctx->record_fd = -1;
+        return false;
+    }
 
-                if (flow->stats.packets > 2) {
-                    double diff = delta - flow->stats.prev_delta;
-                    if (diff < 0) diff = -diff;
-                    flow->stats.jitter += (diff - flow->stats.jitter) / 16.0;
-                }
-                flow->stats.prev_delta = delta;
-            }
-            flow->stats.last_jitter_ts = now;
+    // Written in host byte order; readers use the byte-order magic
+    uint64_t pos = 0;
+    uint32_t shb[7] = { 0x0A0D0D0A, 28, 0x1A2B3C4D, 0, 0xFFFFFFFFu, 0xFFFFFFFFu, 28 }; // Section length unknown
+    uint16_t version[2] = { 1, 0 };
+    memcpy(&shb[3], version, 4);
+    PacketDiag_RecordPut(ctx, &pos, shb, sizeof(shb));
 
-            // Stream Follow
-            if (ctx->follow_flow_id == flow->id) {
-                if (flow_payload_len > 0) {
-                    // Append to stream buffer
-                    if (flow->stream.buf_len + flow_payload_len < (int)sizeof(flow->stream.buffer)) {
-                        memcpy(flow->stream.buffer + flow->stream.buf_len, flow_payload, flow_payload_len);
-                        flow->stream.buf_len += flow_payload_len;
-                    }
+    uint16_t link[2] = { (uint16_t)(ctx->dlt == DLT_RAW ? KTERM_LINKTYPE_RAW : ctx->dlt), 0 };
+    uint32_t idb[5] = { 1, 20, 0, (uint32_t)ctx->snaplen, 20 }; // Microsecond stamps (default if_tsresol)
+    memcpy(&idb[2], link, 4);
+    PacketDiag_RecordPut(ctx, &pos, idb, sizeof(idb));
+    atomic_store(&ctx->record_head, pos);
 
-                    // Format Output (Buffered to avoid deadlock)
-                    int so_len = snprintf(stream_out_buf, sizeof(stream_out_buf), "\r\n%s[STREAM] %d bytes:%s ", ANSI_CYAN, flow_payload_len, ANSI_RESET);
-                    for(int i=0; i<flow_payload_len && i<32 && so_len < (int)sizeof(stream_out_buf)-10; i++) {
-                        unsigned char c = flow_payload[i];
-                        if (c >= 32 && c < 127) so_len += snprintf(stream_out_buf + so_len, sizeof(stream_out_buf) - so_len, "%c", c);
-                        else so_len += snprintf(stream_out_buf + so_len, sizeof(stream_out_buf) - so_len, ".");
-                    }
-                    snprintf(stream_out_buf + so_len, sizeof(stream_out_buf) - so_len, "\r\n");
-                }
-            }
-        }
-    }
+#ifndef _WIN32
+    if (pthread_create(&ctx->record_thread, NULL, PacketDiag_RecordThread, ctx) != 0) return false;
+#else
+    ctx->record_thread = CreateThread(NULL, 0, PacketDiag_RecordThread, ctx, 0, NULL);
+    if (ctx->record_thread == NULL) return false;
+#endif
+    ctx->record_started = true;
+    return true;
+}
 
+// Called once no thread can produce packets any more; drains the ring and closes the file.
+static void PacketDiag_StopRecording(KTermPacketDiagContext* ctx) {
+    if (ctx->record_started) {
+        atomic_store(&ctx->record_stop, true);
 #ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
+        pthread_join(ctx->record_thread, NULL);
 #else
-    LeaveCriticalSection(&ctx->mutex);
+        WaitForSingleObject(ctx->record_thread, INFINITE);
+        CloseHandle(ctx->record_thread);
 #endif
+        ctx->record_started = false;
+    }
+    if (ctx->record_ring && ctx->record_fd >= 0) {
+        close(ctx->record_fd);
+        ctx->record_fd = -1;
+    }
+}
+
+// --- Offline Replay ---
+
+static uint16_t PacketDiag_Rd16(const uint8_t* p, bool swap) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+static uint32_t PacketDiag_Rd32(const uint8_t* p, bool swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    if (swap) v = (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+    return v;
+}
+
+static bool PacketDiag_ReplayFill(PacketDiagReplayReader* r, size_t len) {
+    if (len > (64u << 20)) return false; // Corrupt length
+    if (len > r->buf_size) {
+        uint8_t* nb = (uint8_t*)realloc(r->buf, len);
+        if (!nb) return false;
+        r->buf = nb;
+        r->buf_size = len;
+    }
+    return fread(r->buf, 1, len, r->f) == len;
+}
+
+static void PacketDiag_ReplayClose(PacketDiagReplayReader* r) {
+    if (r->f) fclose(r->f);
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
+
+// PCAP-NG: if_tsresol (option 9) sets the timestamp unit of an Interface Description Block
+static void PacketDiag_ReplayAddInterface(PacketDiagReplayReader* r, const uint8_t* body, size_t len) {
+    if (len < 8) return;
+    int dlt = PacketDiag_Rd16(body, r->swap);
+    if (r->dlt < 0) r->dlt = dlt;
+    uint64_t units = 1000000;
+    for (size_t off = 8; off + 4 <= len; ) {
+        uint16_t code = PacketDiag_Rd16(body + off, r->swap);
+        uint16_t olen = PacketDiag_Rd16(body + off + 2, r->swap);
+        if (code == 0 || off + 4 + olen > len) break;
+        if (code == 9 && olen >= 1) {
+            uint8_t v = body[off + 4];
+            int e = v & 0x7F;
+            units = 1;
+            for (int i = 0; i < e && units < (1ULL << 60); i++) units *= (v & 0x80) ? 2 : 10;
+        }
+        off += 4 + ((olen + 3u) & ~3u);
+    }
+    if (r->if_count < KTERM_PACKETDIAG_REPLAY_IFACES) r->if_units[r->if_count] = units;
+    r->if_count++;
+}
+
+static void PacketDiag_ReplayStamp(PacketDiagReplayReader* r, uint32_t ifid, uint32_t hi, uint32_t lo, struct timeval* tv) {
+    uint64_t units = (ifid < KTERM_PACKETDIAG_REPLAY_IFACES && r->if_units[ifid]) ? r->if_units[ifid] : 1000000;
+    uint64_t ts = ((uint64_t)hi << 32) | lo;
+    tv->tv_sec = (time_t)(ts / units);
+    tv->tv_usec = (long)((double)(ts % units) * 1000000.0 / (double)units);
+}
 
-    if (stream_out_buf[0]) {
-        PacketDiag_WriteToBuffer(ctx, "%s", stream_out_buf);
+// Returns 1 with a packet, 0 at end of file, -1 on a corrupt or truncated file.
+static int PacketDiag_ReplayNext(PacketDiagReplayReader* r, struct pcap_pkthdr* h, const uint8_t** data) {
+    if (!r->pcapng) {
+        uint8_t rec[16];
+        size_t got = fread(rec, 1, sizeof(rec), r->f);
+        if (got == 0) return 0;
+        if (got != sizeof(rec)) return -1;
+        uint32_t caplen = PacketDiag_Rd32(rec + 8, r->swap);
+        if (!PacketDiag_ReplayFill(r, caplen)) return -1;
+        h->ts.tv_sec = (time_t)PacketDiag_Rd32(rec, r->swap);
+        h->ts.tv_usec = (long)PacketDiag_Rd32(rec + 4, r->swap);
+        if (r->nsec) h->ts.tv_usec /= 1000;
+        h->caplen = caplen;
+        h->len = PacketDiag_Rd32(rec + 12, r->swap);
+        *data = r->buf;
+        return 1;
+    }
+
+    for (;;) {
+        uint8_t bh[8];
+        size_t got = fread(bh, 1, sizeof(bh), r->f);
+        if (got == 0) return 0;
+        if (got != sizeof(bh)) return -1;
+        uint32_t type = PacketDiag_Rd32(bh, r->swap); // 0x0A0D0D0A reads the same either way
+        uint32_t total = PacketDiag_Rd32(bh + 4, r->swap);
+        if (type == 0x0A0D0D0A) {
+            // New section: byte order may change
+            uint8_t magic[4];
+            if (fread(magic, 1, 4, r->f) != 4) return -1;
+            uint32_t m;
+            memcpy(&m, magic, 4);
+            if (m != 0x1A2B3C4Du && m != 0x4D3C2B1Au) return -1;
+            r->swap = (m == 0x4D3C2B1Au);
+            total = PacketDiag_Rd32(bh + 4, r->swap);
+            if (total < 28 || (total & 3) || !PacketDiag_ReplayFill(r, total - 12)) return -1;
+            r->if_count = 0;
+            continue;
+        }
+        if (total < 12 || (total & 3) || !PacketDiag_ReplayFill(r, total - 8)) return -1;
+        const uint8_t* b = r->buf;
+        size_t blen = total - 12; // Body without the trailing length
+
+        if (type == 1) {
+            PacketDiag_ReplayAddInterface(r, b, blen);
+        } else if (type == 6 && blen >= 20) { // Enhanced Packet Block
+            uint32_t caplen = PacketDiag_Rd32(b + 12, r->swap);
+            if (20 + (size_t)caplen > blen) return -1;
+            PacketDiag_ReplayStamp(r, PacketDiag_Rd32(b, r->swap), PacketDiag_Rd32(b + 4, r->swap), PacketDiag_Rd32(b + 8, r->swap), &h->ts);
+            h->caplen = caplen;
+            h->len = PacketDiag_Rd32(b + 16, r->swap);
+            r->last_ts = h->ts;
+            *data = b + 20;
+            return 1;
+        } else if (type == 3 && blen >= 4) { // Simple Packet Block
+            uint32_t len = PacketDiag_Rd32(b, r->swap);
+            h->caplen = (len < blen - 4) ? len : (uint32_t)(blen - 4);
+            h->len = len;
+            h->ts = r->last_ts;
+            *data = b + 4;
+            return 1;
+        } else if (type == 2 && blen >= 20) { // Obsolete Packet Block
+            uint32_t caplen = PacketDiag_Rd32(b + 12, r->swap);
+            if (20 + (size_t)caplen > blen) return -1;
+            PacketDiag_ReplayStamp(r, PacketDiag_Rd16(b, r->swap), PacketDiag_Rd32(b + 4, r->swap), PacketDiag_Rd32(b + 8, r->swap), &h->ts);
+            h->caplen = caplen;
+            h->len = PacketDiag_Rd32(b + 16, r->swap);
+            r->last_ts = h->ts;
+            *data = b + 20;
+            return 1;
+        }
+        // Statistics, name resolution, custom blocks: skipped
     }
+}
 
-    pos += snprintf(out + pos, sizeof(out) - pos, "\r\n");
+// Reads the file header (and, for PCAP-NG, blocks up to the first interface) to learn the link type.
+static bool PacketDiag_ReplayOpen(PacketDiagReplayReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    r->dlt = -1;
+    r->f = fopen(path, "rb");
+    if (!r->f) return false;
+    setvbuf(r->f, NULL, _IOFBF, KTERM_PACKETDIAG_RECORD_CHUNK);
+
+    uint8_t hdr[24];
+    if (fread(hdr, 1, 4, r->f) != 4) { PacketDiag_ReplayClose(r); return false; }
+    uint32_t magic;
+    memcpy(&magic, hdr, 4);
+
+    if (magic == 0x0A0D0D0A) {
+        r->pcapng = true;
+        if (fread(hdr + 4, 1, 8, r->f) != 8) { PacketDiag_ReplayClose(r); return false; }
+        uint32_t bom;
+        memcpy(&bom, hdr + 8, 4);
+        if (bom == 0x4D3C2B1Au) r->swap = true;
+        else if (bom != 0x1A2B3C4Du) { PacketDiag_ReplayClose(r); return false; }
+        uint32_t total = PacketDiag_Rd32(hdr + 4, r->swap);
+        if (total < 28 || (total & 3) || !PacketDiag_ReplayFill(r, total - 12)) { PacketDiag_ReplayClose(r); return false; }
+        // Peek the next block for the interface; packets follow it
+        long mark = ftell(r->f);
+        uint8_t bh[8];
+        if (fread(bh, 1, 8, r->f) == 8 && PacketDiag_Rd32(bh, r->swap) == 1) {
+            uint32_t len = PacketDiag_Rd32(bh + 4, r->swap);
+            if (len >= 20 && !(len & 3) && PacketDiag_ReplayFill(r, len - 8)) PacketDiag_ReplayAddInterface(r, r->buf, len - 12);
+            else fseek(r->f, mark, SEEK_SET);
+        } else {
+            fseek(r->f, mark, SEEK_SET);
+        }
+        if (r->dlt < 0) r->dlt = DLT_EN10MB;
+        return true;
+    }
 
-    // Output
-    PacketDiag_WriteToBuffer(ctx, "%s", out);
+    if (magic == 0xA1B2C3D4u || magic == 0xA1B23C4Du) r->swap = false;
+    else if (magic == 0xD4C3B2A1u || magic == 0x4D3CB2A1u) r->swap = true;
+    else { PacketDiag_ReplayClose(r); return false; }
+    r->nsec = (magic == 0xA1B23C4Du || magic == 0x4D3CB2A1u);
+    if (fread(hdr + 4, 1, 20, r->f) != 20) { PacketDiag_ReplayClose(r); return false; }
+    r->dlt = (int)(PacketDiag_Rd32(hdr + 20, r->swap) & 0x0FFFFFFF); // Upper bits carry FCS info
+    return true;
 }
 
 #ifndef _WIN32
-static void* PacketDiag_Thread(void* arg) {
+static void* PacketDiag_ReplayThread(void* arg) {
 #else
-static DWORD WINAPI PacketDiag_Thread(LPVOID arg) {
+static DWORD WINAPI PacketDiag_ReplayThread(LPVOID arg) {
 #endif
     KTermPacketDiagContext* ctx = (KTermPacketDiagContext*)arg;
-    if (!ctx) return 0;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    int rc = 0;
+    while (ctx->running) {
+        if (ctx->count > 0 && ctx->captured_count >= ctx->count) break;
+        if (ctx->paused) {
+            PacketDiag_Backoff();
+            continue;
+        }
+        struct pcap_pkthdr hdr;
+        const uint8_t* data = NULL;
+        rc = PacketDiag_ReplayNext(&ctx->replay, &hdr, &data);
+        if (rc <= 0) break;
+        PacketDiag_PacketHandler((u_char*)ctx, &hdr, data);
+    }
+
+    gettimeofday(&end, NULL);
+    ctx->replay_seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_usec - start.tv_usec) / 1000000.0;
+    atomic_store(&ctx->replay_done, true);
+    ctx->running = false;
 
-    pcap_loop(ctx->handle, ctx->count > 0 ? ctx->count : -1, PacketDiag_PacketHandler, (u_char*)ctx);
+    if (rc < 0) PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] %s is truncated or corrupt%s\r\n", ANSI_RED, ctx->replay_path, ANSI_RESET);
+    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Replay finished: %d packets in %.3fs (%.0f pkt/s)%s\r\n", ANSI_YELLOW,
+                             ctx->captured_count, ctx->replay_seconds,
+                             ctx->replay_seconds > 0 ? ctx->captured_count / ctx->replay_seconds : 0.0, ANSI_RESET);
+    return 0;
+}
 
-    ctx->running = false;
+static uint64_t PacketDiag_EventsLost(KTermPacketDiagContext* ctx) {
+    uint64_t lost = 0;
+    for (int i = 0; i < PacketDiag_ShardCount(ctx); i++) lost += atomic_load_explicit(&ctx->shards[i].ev_dropped, memory_order_relaxed);
+    return lost;
+}
 
-    // Notify stopped
-    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Stopped.%s\r\n", ANSI_YELLOW, ANSI_RESET);
+// One line per second while events are being held back: rate and the busiest protocols.
+static int PacketDiag_FormatSummary(KTermPacketDiagContext* ctx, double elapsed, uint64_t lost, char* out, size_t max) {
+    static const char* l4_names[4] = { "TCP", "UDP", "ICMP", "Other" };
+    const int rows = (int)(sizeof(kterm_protocols) / sizeof(kterm_protocols[0]));
+    if (elapsed <= 0) elapsed = 1.0;
+    int pos = snprintf(out, max, "%s[PacketDiag] %.0f pkt/s, %llu shown, %llu lost:%s",
+                       ANSI_YELLOW, (double)(ctx->window_events + lost) / elapsed,
+                       (unsigned long long)ctx->window_shown, (unsigned long long)lost, ANSI_RESET);
+    for (int i = 0; i < 4 && pos < (int)max; i++) {
+        if (ctx->window_l4[i]) pos += snprintf(out + pos, max - pos, " %s %u", l4_names[i], ctx->window_l4[i]);
+    }
+    // Top five application protocols
+    for (int k = 0; k < 5 && pos < (int)max; k++) {
+        int top = -1;
+        for (int r = 0; r < rows; r++) {
+            if (ctx->window_proto[r] && (top < 0 || ctx->window_proto[r] > ctx->window_proto[top])) top = r;
+        }
+        if (top < 0) break;
+        pos += snprintf(out + pos, max - pos, "%s %s%s%s %u", k == 0 ? " |" : "",
+                        kterm_protocols[top].ansi_color, kterm_protocols[top].short_name, ANSI_RESET, ctx->window_proto[top]);
+        ctx->window_proto[top] = 0;
+    }
+    if (pos < (int)max) pos += snprintf(out + pos, max - pos, "\r\n");
+    return pos < (int)max ? pos : (int)max - 1;
+}
 
-    return 0;
+// Drains the event rings in capture order. Lines are written while the token bucket allows and never
+// more than one screen per pass (anything beyond would scroll off unseen); the rest are only counted.
+static void PacketDiag_Render(KTerm* term, KTermPacketDiagContext* ctx) {
+    double now = KTerm_GetTime();
+    int burst = term->height > 0 ? term->height : 24;
+    if (ctx->render_last == 0) {
+        ctx->render_last = ctx->summary_start = now;
+        ctx->line_tokens = burst;
+        ctx->window_lost_base = PacketDiag_EventsLost(ctx);
+    }
+    ctx->line_tokens += (now - ctx->render_last) * ctx->lines_per_sec;
+    if (ctx->line_tokens > burst) ctx->line_tokens = burst;
+    ctx->render_last = now;
+
+    char text[16384];
+    size_t len = 0;
+    int lines = 0;
+    KTermPacketDiagEvent ev;
+    while (PacketDiag_NextEvent(ctx, &ev)) {
+        if (ev.kind == KTERM_PACKETDIAG_EVENT_PACKET) {
+            ctx->window_events++;
+            int l4 = ev.proto == 6 ? 0 : ev.proto == 17 ? 1 : (ev.proto == 1 || ev.proto == 58) ? 2 : 3;
+            ctx->window_l4[l4]++;
+            if (ev.protocol) ctx->window_proto[ev.protocol - kterm_protocols]++;
+        }
+        if (ctx->line_tokens < 1.0 || lines >= burst || sizeof(text) - len < 512) continue;
+        ctx->line_tokens -= 1.0;
+        lines++;
+        if (ev.kind == KTERM_PACKETDIAG_EVENT_PACKET) ctx->window_shown++;
+        len += (size_t)KTerm_Net_PacketDiag_FormatEvent(&ev, text + len, sizeof(text) - len);
+    }
+
+    if (now - ctx->summary_start >= 1.0) {
+        uint64_t lost_total = PacketDiag_EventsLost(ctx);
+        uint64_t lost = lost_total - ctx->window_lost_base;
+        if ((ctx->window_events > ctx->window_shown || lost > 0) && sizeof(text) - len >= 512) {
+            len += (size_t)PacketDiag_FormatSummary(ctx, now - ctx->summary_start, lost, text + len, sizeof(text) - len);
+        }
+        ctx->summary_start = now;
+        ctx->window_events = ctx->window_shown = 0;
+        ctx->window_lost_base = lost_total;
+        memset(ctx->window_l4, 0, sizeof(ctx->window_l4));
+        memset(ctx->window_proto, 0, sizeof(ctx->window_proto));
+    }
+
+    if (len > 0) KTerm_WriteToSession(term, ctx->session_index, text, len);
 }
 
 void KTerm_Net_ProcessPacketDiag(KTerm* term, KTermSession* session) {
@@ -4949,36 +9134,48 @@ void KTerm_Net_ProcessPacketDiag(KTerm* term, KTermSession* session) {
     if (!net || !net->packetdiag) return;
     KTermPacketDiagContext* ctx = net->packetdiag;
 
-#ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
-#else
-    EnterCriticalSection(&ctx->mutex);
-#endif
+    KTermMetricsStore* metrics = KTerm_Net_Metrics(session);
+    if (metrics) KTerm_Metrics_SamplePacketDiag(metrics, ctx, KTerm_GetTime());
 
     // Check MTU Trigger
-    bool trigger = ctx->trigger_mtu_probe;
+    bool trigger = false;
     char target_ip[64];
-    if (trigger) {
+    if (atomic_load(&ctx->trigger_mtu_probe)) {
+#ifndef _WIN32
+        pthread_mutex_lock(&ctx->mutex);
+#else
+        EnterCriticalSection(&ctx->mutex);
+#endif
         strncpy(target_ip, ctx->last_frag_ip, sizeof(target_ip)-1);
         target_ip[sizeof(target_ip)-1] = '\0';
-        ctx->trigger_mtu_probe = false;
+        atomic_store(&ctx->trigger_mtu_probe, false);
+        trigger = true;
+#ifndef _WIN32
+        pthread_mutex_unlock(&ctx->mutex);
+#else
+        LeaveCriticalSection(&ctx->mutex);
+#endif
     }
 
+    // Control messages (Started/Stopped)
+#ifndef _WIN32
+    pthread_mutex_lock(&ctx->mutex);
+#else
+    EnterCriticalSection(&ctx->mutex);
+#endif
     while (ctx->buf_head != ctx->buf_tail) {
-        char c = ctx->out_buf[ctx->buf_tail];
-        ctx->buf_tail = (ctx->buf_tail + 1) % 65536;
-        KTerm_WriteCharToSession(term, ctx->session_index, c);
-
-        // Limit processing per frame to avoid blocking UI if flood
-        // But we are locked, so we should be fast. WriteChar pushes to queue.
+        int end = ctx->buf_head > ctx->buf_tail ? ctx->buf_head : 65536;
+        KTerm_WriteToSession(term, ctx->session_index, ctx->out_buf + ctx->buf_tail, (size_t)(end - ctx->buf_tail));
+        ctx->buf_tail = end % 65536;
     }
-
 #ifndef _WIN32
     pthread_mutex_unlock(&ctx->mutex);
 #else
     LeaveCriticalSection(&ctx->mutex);
 #endif
 
+    if (ctx->render) PacketDiag_Render(term, ctx);
+
     if (trigger) {
         if (!net->mtu_probe) {
              char msg[128];
@@ -4989,11 +9186,95 @@ void KTerm_Net_ProcessPacketDiag(KTerm* term, KTermSession* session) {
     }
 }
 
+static void PacketDiag_SeedFlowHash(KTermPacketDiagContext* ctx) {
+#ifndef _WIN32
+    // The key keeps remote hosts from steering flows into one probe chain, so it has to
+    // come from the OS entropy pool rather than anything a peer could guess
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0) {
+        size_t got = 0;
+        while (got < sizeof(ctx->flow_hash_key)) {
+            ssize_t n = read(fd, (char*)ctx->flow_hash_key + got, sizeof(ctx->flow_hash_key) - got);
+            if (n > 0) got += (size_t)n;
+            else if (n < 0 && errno == EINTR) continue;
+            else break;
+        }
+        close(fd);
+        if (got == sizeof(ctx->flow_hash_key)) return;
+    }
+#endif
+    // Fallback when no entropy device is available
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint64_t x = ((uint64_t)tv.tv_sec << 20) ^ (uint64_t)tv.tv_usec ^ (uint64_t)(uintptr_t)ctx;
+    for (int i = 0; i < 2; i++) {
+        // splitmix64
+        x += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        ctx->flow_hash_key[i] = z ^ (z >> 31);
+    }
+}
+
+static int PacketDiag_DefaultWorkers(void) {
+#ifndef _WIN32
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    long cpus = (long)si.dwNumberOfProcessors;
+#endif
+    // Leave a core for the capture thread
+    long n = cpus - 1;
+    if (n > 4) n = 4;
+    if (n < 1) n = 1;
+    return (int)n;
+}
+
+static void PacketDiag_StopWorkers(KTermPacketDiagContext* ctx) {
+    for (int i = 0; i < ctx->worker_count; i++) {
+        PacketDiagShard* sh = &ctx->shards[i];
+        if (!sh->thread) continue;
+        atomic_store(&sh->stop, true);
+#ifndef _WIN32
+        pthread_join(sh->thread, NULL);
+#else
+        WaitForSingleObject(sh->thread, INFINITE);
+        CloseHandle(sh->thread);
+#endif
+        sh->thread = 0;
+    }
+}
+
+static bool PacketDiag_StartWorkers(KTermPacketDiagContext* ctx) {
+    for (int i = 0; i < ctx->worker_count; i++) {
+        ctx->shards[i].ctx = ctx;
+#ifndef _WIN32
+        pthread_mutex_init(&ctx->shards[i].mutex, NULL);
+#else
+        InitializeCriticalSection(&ctx->shards[i].mutex);
+#endif
+    }
+    for (int i = 0; i < ctx->worker_count; i++) {
+        PacketDiagShard* sh = &ctx->shards[i];
+        sh->ring = (CapturedPacket*)calloc(KTERM_PACKETDIAG_RING_SLOTS, sizeof(CapturedPacket));
+        if (!sh->ring) return false;
+#ifndef _WIN32
+        if (pthread_create(&sh->thread, NULL, PacketDiag_Worker, sh) != 0) { sh->thread = 0; return false; }
+#else
+        sh->thread = CreateThread(NULL, 0, PacketDiag_Worker, sh, 0, NULL);
+        if (sh->thread == NULL) return false;
+#endif
+    }
+    return true;
+}
+
 #endif // KTERM_ENABLE_PACKETDIAG
 
 bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char* params) {
 #ifndef KTERM_ENABLE_PACKETDIAG
-    KTerm_Net_Log(term, (int)(session - term->sessions), "PacketDiag not enabled in build.");
+    KTerm_Net_Log(term, KTerm_Net_SessionIndex(term, session), "PacketDiag not enabled in build.");
     return false;
 #else
     if (!term || !session) return false;
@@ -5002,16 +9283,31 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
     if (!net) net = KTerm_Net_CreateContext(session);
 
     // Stop if already running
-    if (net->packetdiag) KTerm_Net_PacketDiag_Stop(term, session);
+    if (net->packetdiag) {
+        KTerm_Net_PacketDiag_Stop(term, session);
+        KTerm_Net_FreePacketDiag(net->packetdiag);
+        net->packetdiag = NULL;
+    }
 
     net->packetdiag = (KTermPacketDiagContext*)calloc(1, sizeof(KTermPacketDiagContext));
     KTermPacketDiagContext* ctx = net->packetdiag;
 
     ctx->term = term;
-    ctx->session_index = (int)(session - term->sessions);
+    ctx->session_index = KTerm_Net_SessionIndex(term, session);
     ctx->snaplen = 65535;
     ctx->promisc = 1;
     ctx->timeout_ms = 1000;
+    ctx->worker_count = PacketDiag_DefaultWorkers();
+    ctx->flow_idle_sec = KTERM_PACKETDIAG_FLOW_IDLE_SEC;
+    ctx->stream_mem_max = KTERM_PACKETDIAG_STREAM_MEM;
+    ctx->record_fd = -1;
+    ctx->tp_fd = -1;
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+    ctx->tpacket = KTERM_PACKETDIAG_DEFAULT_TPACKET;
+#endif
+    ctx->render = true;
+    ctx->lines_per_sec = KTERM_PACKETDIAG_LINES_PER_SEC;
+    PacketDiag_SeedFlowHash(ctx);
 
 #ifndef _WIN32
     pthread_mutex_init(&ctx->mutex, NULL);
@@ -5021,8 +9317,11 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
 
     // Defaults
     const char* iface = NULL;
+    bool backend_set = false; // backend= given: no silent fallback
 
-    // Parse params: interface=x;filter=y;snaplen=z;count=c;promisc=p
+    // Parse params: interface=x;filter=y;snaplen=z;count=c;promisc=p;workers=n;flows=n;flow_idle=s;
+    //               file=path (replay);record=path;record_direct=1;lines=n;render=0;backend=pcap|tpacket;
+    //               stream_mem=MB
     // Use a simple parser or strtok (careful with non-reentrant)
     // Note: params is const, need copy
     if (params) {
@@ -5051,11 +9350,42 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
                     strncpy(ctx->filter_exp, val, sizeof(ctx->filter_exp)-1);
                 }
             } else if (strncmp(token, "snaplen=", 8) == 0) {
-                ctx->snaplen = atoi(token+8);
+                // auto: just the headers the dissector reads
+                ctx->snaplen = strcmp(token+8, "auto") == 0 ? KTERM_PACKETDIAG_AUTO_SNAPLEN : atoi(token+8);
             } else if (strncmp(token, "count=", 6) == 0) {
                 ctx->count = atoi(token+6);
             } else if (strncmp(token, "promisc=", 8) == 0) {
                 ctx->promisc = atoi(token+8);
+            } else if (strncmp(token, "workers=", 8) == 0) {
+                // 0 = dissect inline on the capture thread
+                ctx->worker_count = atoi(token+8);
+                if (ctx->worker_count < 0) ctx->worker_count = 0;
+                if (ctx->worker_count > KTERM_PACKETDIAG_MAX_WORKERS) ctx->worker_count = KTERM_PACKETDIAG_MAX_WORKERS;
+            } else if (strncmp(token, "flows=", 6) == 0) {
+                long n = atol(token+6);
+                if (n < 0) n = 0;
+                if (n > (long)KTERM_PACKETDIAG_MAX_FLOWS) n = (long)KTERM_PACKETDIAG_MAX_FLOWS;
+                ctx->flow_capacity = (uint32_t)n;
+            } else if (strncmp(token, "flow_idle=", 10) == 0) {
+                ctx->flow_idle_sec = atoi(token+10);
+            } else if (strncmp(token, "stream_mem=", 11) == 0) {
+                // 0 = never queue out-of-order data, every hole is skipped
+                long mb = atol(token+11);
+                ctx->stream_mem_max = mb > 0 ? (uint64_t)mb << 20 : 0;
+            } else if (strncmp(token, "file=", 5) == 0) {
+                strncpy(ctx->replay_path, token+5, sizeof(ctx->replay_path)-1);
+            } else if (strncmp(token, "record=", 7) == 0) {
+                strncpy(ctx->record_path, token+7, sizeof(ctx->record_path)-1);
+            } else if (strncmp(token, "record_direct=", 14) == 0) {
+                ctx->record_direct = atoi(token+14) != 0;
+            } else if (strncmp(token, "lines=", 6) == 0) {
+                ctx->lines_per_sec = atoi(token+6);
+                if (ctx->lines_per_sec < 1) ctx->lines_per_sec = 1;
+            } else if (strncmp(token, "render=", 7) == 0) {
+                ctx->render = atoi(token+7) != 0;
+            } else if (strncmp(token, "backend=", 8) == 0) {
+                ctx->tpacket = strcmp(token+8, "tpacket") == 0;
+                backend_set = true;
             }
 #ifndef _WIN32
             token = strtok_r(NULL, ";", &saveptr);
@@ -5065,48 +9395,36 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
         }
     }
 
-    char errbuf[PCAP_ERRBUF_SIZE];
-
-    // Find device if not specified
-    if (!iface || !iface[0]) {
-        pcap_if_t* alldevs;
-        if (pcap_findalldevs(&alldevs, errbuf) == -1) {
-            KTerm_Net_Log(term, ctx->session_index, "Failed to find devices");
-            free(ctx); net->packetdiag = NULL;
-            return false;
-        }
-        if (alldevs) {
-            strncpy(ctx->dev, alldevs->name, sizeof(ctx->dev)-1);
-            iface = ctx->dev;
-            pcap_freealldevs(alldevs);
-        } else {
-            KTerm_Net_Log(term, ctx->session_index, "No devices found");
-            free(ctx); net->packetdiag = NULL;
-            return false;
-        }
-    }
-
-    // Open
-    ctx->handle = pcap_open_live(iface, ctx->snaplen, ctx->promisc, ctx->timeout_ms, errbuf);
-    if (!ctx->handle) {
-        char msg[256];
-        snprintf(msg, sizeof(msg), "Failed to open %s: %s", iface, errbuf);
-        KTerm_Net_Log(term, ctx->session_index, msg);
+    bool native = false;
+    if (ctx->tpacket && !ctx->replay_path[0]) {
+        char err[160] = "not built with KTERM_PACKETDIAG_TPACKET";
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+        if (!iface || !iface[0] || strcmp(iface, "any") == 0) snprintf(err, sizeof(err), "needs a named interface");
+        else native = PacketDiag_TPacketOpen(ctx, iface, err, sizeof(err));
+#endif
+        if (!native) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "TPACKET_V3 capture unavailable (%s)%s", err, backend_set ? "" : ", using libpcap");
+            KTerm_Net_Log(term, ctx->session_index, msg);
+            ctx->tpacket = false;
+            if (backend_set) {
 #ifndef _WIN32
-        pthread_mutex_destroy(&ctx->mutex);
+                pthread_mutex_destroy(&ctx->mutex);
 #else
-        DeleteCriticalSection(&ctx->mutex);
+                DeleteCriticalSection(&ctx->mutex);
 #endif
-        free(ctx); net->packetdiag = NULL;
-        return false;
+                free(ctx); net->packetdiag = NULL;
+                return false;
+            }
+        }
     }
 
-    // Filter
-    if (ctx->filter_exp[0]) {
-        struct bpf_program fp;
-        if (pcap_compile(ctx->handle, &fp, ctx->filter_exp, 0, 0) == -1) {
-            KTerm_Net_Log(term, ctx->session_index, "Bad Filter Expression");
-            pcap_close(ctx->handle);
+    if (ctx->replay_path[0]) {
+        // Offline: no pcap handle, a reader thread feeds the same pipeline
+        if (!PacketDiag_ReplayOpen(&ctx->replay, ctx->replay_path)) {
+            char msg[320];
+            snprintf(msg, sizeof(msg), "Failed to read capture file %s", ctx->replay_path);
+            KTerm_Net_Log(term, ctx->session_index, msg);
 #ifndef _WIN32
             pthread_mutex_destroy(&ctx->mutex);
 #else
@@ -5115,9 +9433,38 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
             free(ctx); net->packetdiag = NULL;
             return false;
         }
-        if (pcap_setfilter(ctx->handle, &fp) == -1) {
-            KTerm_Net_Log(term, ctx->session_index, "Failed to set filter");
-            pcap_close(ctx->handle);
+        ctx->offline = true;
+        ctx->dlt = ctx->replay.dlt;
+        iface = ctx->replay_path;
+        if (ctx->filter_exp[0]) KTerm_Net_Log(term, ctx->session_index, "filter= is ignored when replaying a file");
+    } else if (!native) {
+        char errbuf[PCAP_ERRBUF_SIZE];
+
+        // Find device if not specified
+        if (!iface || !iface[0]) {
+            pcap_if_t* alldevs;
+            if (pcap_findalldevs(&alldevs, errbuf) == -1) {
+                KTerm_Net_Log(term, ctx->session_index, "Failed to find devices");
+                free(ctx); net->packetdiag = NULL;
+                return false;
+            }
+            if (alldevs) {
+                strncpy(ctx->dev, alldevs->name, sizeof(ctx->dev)-1);
+                iface = ctx->dev;
+                pcap_freealldevs(alldevs);
+            } else {
+                KTerm_Net_Log(term, ctx->session_index, "No devices found");
+                free(ctx); net->packetdiag = NULL;
+                return false;
+            }
+        }
+
+        // Open
+        ctx->handle = pcap_open_live(iface, ctx->snaplen, ctx->promisc, ctx->timeout_ms, errbuf);
+        if (!ctx->handle) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "Failed to open %s: %s", iface, errbuf);
+            KTerm_Net_Log(term, ctx->session_index, msg);
 #ifndef _WIN32
             pthread_mutex_destroy(&ctx->mutex);
 #else
@@ -5126,31 +9473,103 @@ bool KTerm_Net_PacketDiag_Start(KTerm* term, KTermSession* session, const char*
             free(ctx); net->packetdiag = NULL;
             return false;
         }
+
+        // Filter
+        if (ctx->filter_exp[0]) {
+            struct bpf_program fp;
+            if (pcap_compile(ctx->handle, &fp, ctx->filter_exp, 0, 0) == -1) {
+                KTerm_Net_Log(term, ctx->session_index, "Bad Filter Expression");
+                pcap_close(ctx->handle);
+#ifndef _WIN32
+                pthread_mutex_destroy(&ctx->mutex);
+#else
+                DeleteCriticalSection(&ctx->mutex);
+#endif
+                free(ctx); net->packetdiag = NULL;
+                return false;
+            }
+            if (pcap_setfilter(ctx->handle, &fp) == -1) {
+                KTerm_Net_Log(term, ctx->session_index, "Failed to set filter");
+                pcap_close(ctx->handle);
+#ifndef _WIN32
+                pthread_mutex_destroy(&ctx->mutex);
+#else
+                DeleteCriticalSection(&ctx->mutex);
+#endif
+                free(ctx); net->packetdiag = NULL;
+                return false;
+            }
+        }
+
+        ctx->dlt = pcap_datalink(ctx->handle);
+    }
+
+    // Link layer decides where the network header starts
+    switch (ctx->dlt) {
+        case DLT_EN10MB: ctx->link_type = PACKETDIAG_LINK_ETHERNET; break;
+        case DLT_LINUX_SLL: ctx->link_type = PACKETDIAG_LINK_SLL; break;
+        case DLT_LINUX_SLL2: ctx->link_type = PACKETDIAG_LINK_SLL2; break;
+        case KTERM_LINKTYPE_RAW:
+        case DLT_RAW:
+        case DLT_IPV4:
+        case DLT_IPV6: ctx->link_type = PACKETDIAG_LINK_RAW; break;
+        case DLT_NULL:
+        case DLT_LOOP: ctx->link_type = PACKETDIAG_LINK_NULL; break;
+        default:
+            ctx->link_type = PACKETDIAG_LINK_ETHERNET;
+            KTerm_Net_Log(term, ctx->session_index, "Unknown link type, assuming Ethernet");
+            break;
     }
+    KTerm_Net_RunOnce(&packetdiag_app_index_once, PacketDiag_BuildAppIndex);
 
     ctx->running = true;
 
-    // Spawn Thread
-#ifndef _WIN32
-    if (pthread_create(&ctx->thread, NULL, PacketDiag_Thread, ctx) != 0) {
-        KTerm_Net_Log(term, ctx->session_index, "Failed to create thread");
-        pcap_close(ctx->handle);
-        pthread_mutex_destroy(&ctx->mutex);
-        free(ctx); net->packetdiag = NULL;
+    // Dissector workers first so the capture thread never sees an unconsumed ring
+    if (!PacketDiag_StartWorkers(ctx)) {
+        KTerm_Net_Log(term, ctx->session_index, "Failed to start dissector workers");
+        PacketDiag_StopWorkers(ctx);
+        if (ctx->handle) pcap_close(ctx->handle);
+        ctx->handle = NULL;
+        KTerm_Net_FreePacketDiag(ctx); net->packetdiag = NULL;
+        return false;
+    }
+
+    if (ctx->record_path[0] && !PacketDiag_StartRecording(ctx)) {
+        char msg[320];
+        snprintf(msg, sizeof(msg), "Failed to record to %s", ctx->record_path);
+        KTerm_Net_Log(term, ctx->session_index, msg);
+        PacketDiag_StopWorkers(ctx);
+        PacketDiag_StopRecording(ctx);
+        if (ctx->handle) pcap_close(ctx->handle);
+        ctx->handle = NULL;
+        KTerm_Net_FreePacketDiag(ctx); net->packetdiag = NULL;
         return false;
     }
+
+    // Spawn Capture Thread (or the file reader / ring walker standing in for it)
+#ifndef _WIN32
+    void* (*capture)(void*) = ctx->offline ? PacketDiag_ReplayThread : PacketDiag_Thread;
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+    if (ctx->tpacket) capture = PacketDiag_TPacketThread;
+#endif
+    if (pthread_create(&ctx->thread, NULL, capture, ctx) != 0) {
 #else
-    ctx->thread = CreateThread(NULL, 0, PacketDiag_Thread, ctx, 0, NULL);
+    ctx->thread = CreateThread(NULL, 0, ctx->offline ? PacketDiag_ReplayThread : PacketDiag_Thread, ctx, 0, NULL);
     if (ctx->thread == NULL) {
+#endif
         KTerm_Net_Log(term, ctx->session_index, "Failed to create thread");
-        pcap_close(ctx->handle);
-        DeleteCriticalSection(&ctx->mutex);
-        free(ctx); net->packetdiag = NULL;
+        PacketDiag_StopWorkers(ctx);
+        PacketDiag_StopRecording(ctx);
+        if (ctx->handle) pcap_close(ctx->handle);
+        ctx->handle = NULL;
+        KTerm_Net_FreePacketDiag(ctx); net->packetdiag = NULL;
         return false;
     }
-#endif
+    ctx->thread_started = true;
 
-    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Started on %s%s\r\n", ANSI_GREEN, iface, ANSI_RESET);
+    PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] %s %s%s%s\r\n", ANSI_GREEN, ctx->offline ? "Replaying" : "Started on", iface,
+                             ctx->tpacket ? " (TPACKET_V3)" : "", ANSI_RESET);
+    if (ctx->record_started) PacketDiag_WriteToBuffer(ctx, "%s[PacketDiag] Recording to %s%s%s\r\n", ANSI_GREEN, ctx->record_path, ctx->record_direct ? " (O_DIRECT)" : "", ANSI_RESET);
     return true;
 #endif
 }
@@ -5161,23 +9580,28 @@ void KTerm_Net_PacketDiag_Stop(KTerm* term, KTermSession* session) {
     KTermNetSession* net = KTerm_Net_GetContext(session);
     if (net && net->packetdiag) {
         KTermPacketDiagContext* ctx = net->packetdiag;
-        if (ctx->running && ctx->handle) {
-            pcap_breakloop(ctx->handle);
-            // Join thread
+        if (ctx->thread_started) {
+            // The capture thread may already have left pcap_loop (count= reached); join it regardless
+            if (ctx->handle) pcap_breakloop(ctx->handle);
+            if (ctx->offline || ctx->tpacket) ctx->running = false; // Ends the replay / ring loop
 #ifndef _WIN32
             pthread_join(ctx->thread, NULL);
-            pthread_mutex_destroy(&ctx->mutex);
 #else
             WaitForSingleObject(ctx->thread, INFINITE);
             CloseHandle(ctx->thread);
-            DeleteCriticalSection(&ctx->mutex);
 #endif
-            ctx->running = false;
+            ctx->thread_started = false;
         }
+        PacketDiag_StopWorkers(ctx);
+        PacketDiag_StopRecording(ctx);
+        ctx->running = false;
         if (ctx->handle) {
             pcap_close(ctx->handle);
             ctx->handle = NULL;
         }
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+        if (ctx->tpacket) PacketDiag_TPacketClose(ctx);
+#endif
     }
 #endif
 }
@@ -5191,9 +9615,36 @@ void KTerm_Net_PacketDiag_GetStatus(KTerm* term, KTermSession* session, char* bu
 #ifdef _WIN32
         warn = ";WARN=WIN_RESTRICTED";
 #endif
-        snprintf(buffer, max_len, "RUNNING;CAPTURED=%d%s%s",
-                 net->packetdiag->captured_count,
-                 net->packetdiag->paused ? ";PAUSED" : "",
+        KTermPacketDiagContext* ctx = net->packetdiag;
+        uint64_t dropped = 0;
+        for (int i = 0; i < ctx->worker_count; i++) dropped += atomic_load(&ctx->shards[i].dropped);
+        char extra[160] = "";
+        int n = 0;
+        if (ctx->record_ring) {
+            n += snprintf(extra + n, sizeof(extra) - n, ";RECORDED=%llu;REC_DROPPED=%llu%s",
+                          (unsigned long long)atomic_load(&ctx->record_packets),
+                          (unsigned long long)atomic_load(&ctx->record_dropped),
+                          atomic_load(&ctx->record_failed) ? ";REC_FAILED" : "");
+        }
+        if (ctx->offline && n < (int)sizeof(extra)) {
+            n += snprintf(extra + n, sizeof(extra) - n, ";REPLAY=%s", atomic_load(&ctx->replay_done) ? "DONE" : "RUNNING");
+        }
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+        if (ctx->tpacket && ctx->tp_fd >= 0 && n < (int)sizeof(extra)) {
+            // Reading the kernel counters resets them
+            struct tpacket_stats_v3 st;
+            socklen_t len = sizeof(st);
+            if (getsockopt(ctx->tp_fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) ctx->tp_drops += st.tp_drops;
+            snprintf(extra + n, sizeof(extra) - n, ";BACKEND=TPACKET;KDROPS=%llu", (unsigned long long)ctx->tp_drops);
+        }
+#endif
+        snprintf(buffer, max_len, "RUNNING;CAPTURED=%d;WORKERS=%d;DROPPED=%llu;EV_DROPPED=%llu%s%s%s",
+                 ctx->captured_count,
+                 ctx->worker_count,
+                 (unsigned long long)dropped,
+                 (unsigned long long)PacketDiag_EventsLost(ctx),
+                 extra,
+                 ctx->paused ? ";PAUSED" : "",
                  warn);
     } else {
         snprintf(buffer, max_len, "STOPPED");
@@ -5226,8 +9677,8 @@ bool KTerm_Net_PacketDiag_SetFilter(KTerm* term, KTermSession* session, const ch
     // Reconstruct params
     KTermPacketDiagContext* ctx = net->packetdiag;
     char params[512];
-    snprintf(params, sizeof(params), "interface=%s;filter=%s;snaplen=%d;count=%d;promisc=%d;timeout=%d",
-             ctx->dev, filter, ctx->snaplen, ctx->count, ctx->promisc, ctx->timeout_ms);
+    snprintf(params, sizeof(params), "interface=%s;filter=%s;snaplen=%d;count=%d;promisc=%d;timeout=%d;backend=%s",
+             ctx->dev, filter, ctx->snaplen, ctx->count, ctx->promisc, ctx->timeout_ms, ctx->tpacket ? "tpacket" : "pcap");
 
     // Restart (Start handles stop/restart)
     return KTerm_Net_PacketDiag_Start(term, session, params);
@@ -5241,33 +9692,24 @@ bool KTerm_Net_PacketDiag_GetDetail(KTerm* term, KTermSession* session, int pack
 
     if (packet_id < 0) return false;
 
-#ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
-#else
-    EnterCriticalSection(&ctx->mutex);
-#endif
-
-    int total = ctx->ring_count;
-    if (packet_id >= total || (total > 128 && packet_id < total - 128)) {
-#ifndef _WIN32
-        pthread_mutex_unlock(&ctx->mutex);
-#else
-        LeaveCriticalSection(&ctx->mutex);
-#endif
-        return false;
+    // Each worker keeps its own recent packets; packet ids are capture sequence numbers
+    CapturedPacket pkt;
+    bool found = false;
+    for (int w = 0; w < PacketDiag_ShardCount(ctx) && !found; w++) {
+        PacketDiagShard* sh = &ctx->shards[w];
+        PacketDiag_LockShard(ctx, sh);
+        uint64_t n = sh->history_count < KTERM_PACKETDIAG_HISTORY ? sh->history_count : KTERM_PACKETDIAG_HISTORY;
+        for (uint64_t k = 0; k < n; k++) {
+            const CapturedPacket* h = &sh->history[(sh->history_count - 1 - k) % KTERM_PACKETDIAG_HISTORY];
+            if (h->id == (uint64_t)packet_id) {
+                pkt = *h; // Copy under lock
+                found = true;
+                break;
+            }
+        }
+        PacketDiag_UnlockShard(ctx, sh);
     }
-
-    int idx = (ctx->ring_head - total + packet_id);
-    while (idx < 0) idx += 128;
-    idx %= 128;
-
-    CapturedPacket pkt = ctx->packet_ring[idx]; // Copy under lock
-
-#ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
-#else
-    LeaveCriticalSection(&ctx->mutex);
-#endif
+    if (!found) return false;
 
     int pos = 0;
     pos += snprintf(out + pos, max - pos, "PACKET %d (Len=%d)\r\n", packet_id, pkt.len);
@@ -5296,6 +9738,37 @@ bool KTerm_Net_PacketDiag_GetDetail(KTerm* term, KTermSession* session, int pack
     return true;
 }
 
+static bool KTerm_Net_WhoisConnect(KTermWhoisContext* ctx, const KTermResolveResult* r) {
+    memcpy(&ctx->dest_addr, r->addr, sizeof(ctx->dest_addr));
+    ctx->dest_addr.sin_port = htons(43); // Default whois port
+
+    ctx->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!IS_VALID_SOCKET(ctx->sockfd)) return false;
+
+#ifdef _WIN32
+    u_long mode = 1; ioctlsocket(ctx->sockfd, FIONBIO, &mode);
+#else
+    fcntl(ctx->sockfd, F_SETFL, fcntl(ctx->sockfd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    connect(ctx->sockfd, (struct sockaddr*)&ctx->dest_addr, sizeof(ctx->dest_addr));
+    gettimeofday(&ctx->start_time, NULL); // Connect timeout starts after DNS
+    ctx->state = 1; // CONNECTING
+    return true;
+}
+
+static void KTerm_Net_OnWhoisResolved(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    KTermWhoisContext* ctx = (KTermWhoisContext*)user_data;
+    ctx->dns_req_id = 0;
+    if (!result->success) {
+        if (ctx->callback) ctx->callback(term, session, "ERR;DNS_FAILED", 0, true, ctx->user_data);
+        ctx->state = 4; // DONE (cleaned up on next tick)
+    } else if (!KTerm_Net_WhoisConnect(ctx, result)) {
+        if (ctx->callback) ctx->callback(term, session, "ERR;SOCKET_FAILED", 0, true, ctx->user_data);
+        ctx->state = 4;
+    }
+}
+
 bool KTerm_Net_Whois(KTerm* term, KTermSession* session, const char* host, const char* query, KTermWhoisCallback cb, void* user_data, const char* tag) {
     if (!term || !session || !host || !query) return false;
 
@@ -5324,48 +9797,47 @@ bool KTerm_Net_Whois(KTerm* term, KTermSession* session, const char* host, const
         ctx->free_user_data = false;
     }
     ctx->timeout_ms = 5000;
+    ctx->sockfd = INVALID_SOCKET;
     gettimeofday(&ctx->start_time, NULL);
-    
-    // Resolve host
-    // Optimistic: Check if it's already an IP address to avoid blocking getaddrinfo
-    if (inet_pton(AF_INET, host, &ctx->dest_addr.sin_addr) == 1) {
-        ctx->dest_addr.sin_family = AF_INET;
-        ctx->dest_addr.sin_port = htons(43);
-    } else {
-        // Fallback to blocking DNS
-        struct addrinfo hints, *res;
-        memset(&hints, 0, sizeof(hints));
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
 
-        // Default whois port 43
-        if (getaddrinfo(host, "43", &hints, &res) != 0) {
+    // Resolve host (literal/cached immediately, otherwise off-thread)
+    KTermResolveResult r;
+    if (KTerm_Net_ResolveCached(host, KTERM_RESOLVE_IPV4, &r)) {
+        if (!r.success || !KTerm_Net_WhoisConnect(ctx, &r)) {
             free(ctx); net->whois = NULL;
             return false;
         }
-        ctx->dest_addr = *(struct sockaddr_in*)res->ai_addr;
-        freeaddrinfo(res);
-    }
-
-    ctx->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (!IS_VALID_SOCKET(ctx->sockfd)) {
-        free(ctx); net->whois = NULL;
-        return false;
+    } else {
+        ctx->dns_req_id = KTerm_Net_ResolveAsync(term, session, host, KTERM_RESOLVE_IPV4, KTerm_Net_OnWhoisResolved, ctx);
+        if (!ctx->dns_req_id) {
+            free(ctx); net->whois = NULL;
+            return false;
+        }
+        ctx->state = 5; // RESOLVE
     }
 
-#ifdef _WIN32
-    u_long mode = 1; ioctlsocket(ctx->sockfd, FIONBIO, &mode);
-#else
-    fcntl(ctx->sockfd, F_SETFL, fcntl(ctx->sockfd, F_GETFL, 0) | O_NONBLOCK);
-#endif
-
-    connect(ctx->sockfd, (struct sockaddr*)&ctx->dest_addr, sizeof(ctx->dest_addr));
-    ctx->state = 1; // CONNECTING
-
     return true;
 }
 
+static void KTerm_Net_OnPortScanResolved(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    KTermPortScanContext* ps = (KTermPortScanContext*)user_data;
+    ps->dns_req_id = 0;
+    if (result->success) {
+        memcpy(&ps->dest_addr, result->addr, sizeof(ps->dest_addr));
+    } else {
+        // Port -1 signals an aborted scan
+        if (ps->callback) ps->callback(term, session, ps->host, -1, 0, ps->user_data);
+        ps->ports_ptr = NULL; // Nothing left to scan; freed on next tick
+    }
+    ps->last_refill = KTerm_GetTime();
+    ps->state = 1; // SCANNING
+}
+
 bool KTerm_Net_PortScan(KTerm* term, KTermSession* session, const char* host, const char* ports, int timeout_ms, KTermPortScanCallback cb, void* user_data, const char* tag) {
+    return KTerm_Net_PortScanEx(term, session, host, ports, timeout_ms, 0, 0, cb, user_data, tag);
+}
+
+bool KTerm_Net_PortScanEx(KTerm* term, KTermSession* session, const char* host, const char* ports, int timeout_ms, int window, int rate_per_sec, KTermPortScanCallback cb, void* user_data, const char* tag) {
     if (!term || !session || !host || !ports) return false;
 
     KTermNetSession* net = KTerm_Net_CreateContext(session);
@@ -5385,8 +9857,18 @@ bool KTerm_Net_PortScan(KTerm* term, KTermSession* session, const char* host, co
     strncpy(ps->ports_str, ports, sizeof(ps->ports_str)-1);
     ps->ports_ptr = ps->ports_str; // Start
     ps->timeout_ms = (timeout_ms > 0) ? timeout_ms : 1000;
+    ps->window = (window > 0) ? window : KTERM_NET_PORTSCAN_WINDOW;
+    if (ps->window > KTERM_NET_PORTSCAN_MAX_WINDOW) ps->window = KTERM_NET_PORTSCAN_MAX_WINDOW;
+    ps->rate_per_sec = (rate_per_sec > 0) ? rate_per_sec : 0;
+    ps->tokens = (ps->rate_per_sec > 0) ? 1.0 : 0.0;
     ps->callback = cb;
 
+    ps->probes = (PortScanProbe*)calloc(ps->window, sizeof(PortScanProbe));
+    if (!ps->probes) {
+        free(ps); net->port_scan = NULL;
+        return false;
+    }
+
     if (tag) {
         strncpy(ps->req_tag, tag, sizeof(ps->req_tag)-1);
         ps->user_data = ps->req_tag;
@@ -5396,312 +9878,572 @@ bool KTerm_Net_PortScan(KTerm* term, KTermSession* session, const char* host, co
         ps->free_user_data = false;
     }
 
-    // Pre-resolve host (blocking, but just once)
-    struct addrinfo hints, *res;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    if (getaddrinfo(host, NULL, &hints, &res) != 0) {
-        free(ps); net->port_scan = NULL;
-        return false;
-    }
-    ps->dest_addr = *(struct sockaddr_in*)res->ai_addr;
-    freeaddrinfo(res);
+    ps->last_refill = KTerm_GetTime();
 
-    ps->state = 2; // Ready for Next
-    ps->sockfd = INVALID_SOCKET;
+    // Resolve host once (from cache when possible, otherwise off-thread)
+    KTermResolveResult r;
+    if (KTerm_Net_ResolveCached(host, KTERM_RESOLVE_IPV4, &r)) {
+        if (!r.success) {
+            KTerm_Net_FreePortScan(ps); net->port_scan = NULL;
+            return false;
+        }
+        memcpy(&ps->dest_addr, r.addr, sizeof(ps->dest_addr));
+        ps->state = 1; // SCANNING
+    } else {
+        ps->dns_req_id = KTerm_Net_ResolveAsync(term, session, host, KTERM_RESOLVE_IPV4, KTerm_Net_OnPortScanResolved, ps);
+        if (!ps->dns_req_id) {
+            KTerm_Net_FreePortScan(ps); net->port_scan = NULL;
+            return false;
+        }
+        ps->state = 3; // RESOLVE
+    }
 
     return true;
 }
 
-void KTerm_Net_ProcessHttpProbe(KTerm* term, KTermSession* session) {
-    KTermNetSession* net = KTerm_Net_GetContext(session);
-    if (!net || !net->http_probe) return;
-    KTermHttpProbeContext* ctx = net->http_probe;
-
-    if (ctx->state == 6) return; // DONE
-
-    if (ctx->state == 2) { // CONNECT
-        fd_set wfds; struct timeval tv = {0, 0};
-        FD_ZERO(&wfds);
-#ifndef _WIN32
-        if (ctx->sockfd >= FD_SETSIZE) {
-            ctx->state = 6; // Fail
-            return;
-        }
-#endif
-        FD_SET(ctx->sockfd, &wfds);
+// --- HTTP Probe Engine (keep-alive pool + pipelining) ---
 
-        int res = select(ctx->sockfd + 1, NULL, &wfds, NULL, &tv);
-        if (res > 0) {
-            int opt = 0; socklen_t len = sizeof(opt);
-            if (getsockopt(ctx->sockfd, SOL_SOCKET, SO_ERROR, (char*)&opt, &len) == 0 && opt == 0) {
-                // Connected
-                ctx->connect_ms = (KTerm_GetTime() - ctx->connect_start_time) * 1000.0;
-                ctx->state = 3; // SEND
-            } else {
-                // Fail
-                if (ctx->callback) {
-                    KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Connect Failed");
-                    ctx->callback(term, session, &r, ctx->user_data);
-                }
-                ctx->state = 6;
-            }
-        } else {
-            // Timeout check (5s fixed for now)
-            if (KTerm_GetTime() - ctx->connect_start_time > 5.0) {
-                if (ctx->callback) {
-                    KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Connect Timeout");
-                    ctx->callback(term, session, &r, ctx->user_data);
-                }
-                ctx->state = 6;
-            }
+static const char* KTerm_Http_FindHeader(const char* hdr, const char* name) {
+    size_t nlen = strlen(name);
+    const char* line = strstr(hdr, "\r\n");
+    while (line) {
+        line += 2;
+        if (line[0] == '\r') return NULL; // End of headers
+        size_t i = 0;
+        while (i < nlen && line[i] && tolower((unsigned char)line[i]) == name[i]) i++;
+        if (i == nlen && line[i] == ':') {
+            const char* v = line + i + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            return v;
         }
+        line = strstr(line, "\r\n");
     }
-    else if (ctx->state == 3) { // SEND
-        char req[2048];
-        snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: KTerm/%s\r\nConnection: close\r\n\r\n", ctx->path, ctx->host, KTERM_VERSION_STRING);
+    return NULL;
+}
 
-        ctx->request_start_time = KTerm_GetTime();
-        ssize_t sent = send(ctx->sockfd, req, strlen(req), 0);
-        if (sent > 0) {
-            ctx->state = 4; // WAIT_HEAD
-        } else {
-             if (ctx->callback) {
-                 KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Send Failed");
-                 ctx->callback(term, session, &r, ctx->user_data);
-             }
-             ctx->state = 6;
-        }
+static bool KTerm_Http_ValueHas(const char* v, const char* token) {
+    // Case-insensitive substring search bounded by the header line
+    size_t tlen = strlen(token);
+    for (; v && *v && *v != '\r'; v++) {
+        size_t i = 0;
+        while (i < tlen && v[i] && tolower((unsigned char)v[i]) == token[i]) i++;
+        if (i == tlen) return true;
     }
-    else if (ctx->state == 4) { // WAIT_HEAD
-        // Check for readability
-        fd_set rfds; struct timeval tv = {0, 0};
-        FD_ZERO(&rfds);
-#ifndef _WIN32
-        if (ctx->sockfd >= FD_SETSIZE) {
-            ctx->state = 6; // Fail
-            return;
-        }
-#endif
-        FD_SET(ctx->sockfd, &rfds);
+    return false;
+}
 
-        if (select(ctx->sockfd + 1, &rfds, NULL, NULL, &tv) > 0) {
-            ctx->first_byte_time = KTerm_GetTime();
-            ctx->ttfb_ms = (ctx->first_byte_time - ctx->request_start_time) * 1000.0;
-            ctx->state = 5; // READ_BODY
-        } else {
-             if (KTerm_GetTime() - ctx->request_start_time > 5.0) {
-                 if (ctx->callback) {
-                     KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Response Timeout");
-                     ctx->callback(term, session, &r, ctx->user_data);
-                 }
-                 ctx->state = 6;
-             }
-        }
-    }
-    else if (ctx->state == 5) { // READ_BODY
-        char buf[4096];
-        ssize_t n = recv(ctx->sockfd, buf, sizeof(buf), KTERM_MSG_DONTWAIT);
-        if (n > 0) {
-            ctx->size_bytes += n;
-            // Parse Headers if not fully done or if body separator not found yet
-            char* body_start = strstr(ctx->buffer, "\r\n\r\n");
-            if (!body_start) {
-                // Append to internal small buffer for parsing
-                if (ctx->buffer_len < (int)sizeof(ctx->buffer) - 1) {
-                    int space = sizeof(ctx->buffer) - ctx->buffer_len - 1;
-                    int copy = (n < space) ? n : space;
-                    memcpy(ctx->buffer + ctx->buffer_len, buf, copy);
-                    ctx->buffer_len += copy;
-                    ctx->buffer[ctx->buffer_len] = '\0';
-
-                    if (ctx->status_code == 0 && strncmp(ctx->buffer, "HTTP/", 5) == 0) {
-                        char* space1 = strchr(ctx->buffer, ' ');
-                        if (space1) {
-                            ctx->status_code = atoi(space1 + 1);
-                        }
-                    }
+static bool KTerm_Http_ParseUrl(const char* url, char* host, size_t host_size, int* port, char* path, size_t path_size) {
+    const char* p = url;
+    if (strncmp(p, "http://", 7) == 0) p += 7;
+    else if (strncmp(p, "https://", 8) == 0) p += 8; // Raw TCP only; TLS endpoints will report errors
 
-                    // Look for Content-Length (Case-insensitive approximation: check common cases)
-                    if (ctx->content_length == 0) {
-                        char* cl = strstr(ctx->buffer, "Content-Length: ");
-                        if (!cl) cl = strstr(ctx->buffer, "content-length: ");
-                        if (!cl) cl = strstr(ctx->buffer, "Content-length: ");
-                        if (cl) {
-                            ctx->content_length = strtoull(cl + 16, NULL, 10);
-                        }
-                    }
+    const char* slash = strchr(p, '/');
+    const char* colon = strchr(p, ':');
+    if (colon && slash && colon > slash) colon = NULL;
 
-                    // Update body_start check after append
-                    body_start = strstr(ctx->buffer, "\r\n\r\n");
-                }
-            }
+    size_t host_len = colon ? (size_t)(colon - p) : (slash ? (size_t)(slash - p) : strlen(p));
+    if (host_len == 0) return false;
+    if (host_len >= host_size) host_len = host_size - 1;
+    memcpy(host, p, host_len);
+    host[host_len] = '\0';
 
-            // Check if done based on content length (Keep-Alive support)
-            if (ctx->content_length > 0 && body_start) {
-                uint64_t header_size = (uint64_t)(body_start - ctx->buffer) + 4;
-                if (ctx->size_bytes >= header_size + ctx->content_length) {
-                    n = 0; // Trigger done
-                }
-            }
+    *port = colon ? atoi(colon + 1) : 80;
+    if (*port <= 0 || *port > 65535) *port = 80;
 
-        }
+    snprintf(path, path_size, "%s", slash ? slash : "/");
+    return true;
+}
 
-        if (n == 0) {
-            // Done
-            double end_time = KTerm_GetTime();
+static void KTerm_Http_CloseConn(KTermHttpConn* c) {
+    KTerm_Net_ResolveCancel(c->dns_req_id);
+    if (IS_VALID_SOCKET(c->fd)) CLOSE_SOCKET(c->fd);
+    memset(c, 0, sizeof(*c));
+    c->fd = INVALID_SOCKET;
+}
 
-            KTermHttpProbeResult r = {0};
-            r.status_code = ctx->status_code;
-            r.dns_ms = ctx->dns_ms;
-            r.connect_ms = ctx->connect_ms;
-            r.ttfb_ms = ctx->ttfb_ms;
-            r.download_ms = (end_time - ctx->first_byte_time) * 1000.0;
-            r.total_ms = (end_time - ctx->start_time) * 1000.0;
-            r.size_bytes = ctx->size_bytes;
-            r.speed_mbps = 0;
-            if (r.download_ms > 0) {
-                r.speed_mbps = ((double)ctx->size_bytes * 8.0) / (r.download_ms * 1000.0);
-            }
+static void KTerm_Http_Complete(KTerm* term, KTermSession* session, KTermHttpProbeContext* ctx, int req_idx, KTermHttpProbeResult* r) {
+    KTermHttpRequest* req = &ctx->reqs[req_idx];
+    req->state = 2; // DONE
+    ctx->pending--;
+
+    int remaining = 0;
+    for (int i = 0; i < ctx->req_count; i++) {
+        if (ctx->reqs[i].state != 2 && ctx->reqs[i].batch_id == req->batch_id) remaining++;
+    }
+    r->index = req->batch_index;
+    r->remaining = remaining;
 
-            if (ctx->callback) ctx->callback(term, session, &r, ctx->user_data);
-            ctx->state = 6;
+    char series[64];
+    snprintf(series, sizeof(series), "http:%.58s", req->host);
+    if (r->error) KTerm_Net_Metrics_RecordLoss(term, session, series);
+    else KTerm_Net_Metrics_Record(term, session, series, r->total_ms);
 
+    KTermHttpProbeCallback cb = req->callback;
+    void* ud = req->req_tag[0] ? (void*)req->req_tag : req->user_data;
+    if (cb) cb(term, session, r, ud); // May append requests (reqs can move)
+}
+
+static void KTerm_Http_Fail(KTerm* term, KTermSession* session, KTermHttpProbeContext* ctx, int req_idx, const char* msg) {
+    KTermHttpProbeResult r = {0};
+    r.error = true;
+    snprintf(r.error_msg, sizeof(r.error_msg), "%s", msg);
+    KTerm_Http_Complete(term, session, ctx, req_idx, &r);
+}
+
+// Drops a connection. On a reused or pipelined connection, requests that never saw a
+// response byte are re-queued once (stale keep-alive, server that does not pipeline);
+// everything else fails with msg.
+static void KTerm_Http_DropConn(KTerm* term, KTermSession* session, KTermHttpProbeContext* ctx, KTermHttpConn* c, const char* msg) {
+    int pipe[KTERM_NET_HTTP_PIPELINE_MAX];
+    int count = c->pipe_count;
+    bool head_started = (c->resp_bytes > 0);
+    bool was_pipelined = (count > 1);
+    bool was_reused = (c->served > 0);
+    memcpy(pipe, c->pipe, sizeof(int) * count);
+    KTerm_Http_CloseConn(c);
+
+    for (int i = 0; i < count; i++) {
+        KTermHttpRequest* req = &ctx->reqs[pipe[i]];
+        bool retry = (was_reused || was_pipelined) && req->retries == 0 && !(i == 0 && head_started);
+        if (retry) {
+            req->state = 0; // QUEUED
+            req->retries++;
+            if (was_pipelined) req->no_pipeline = true;
+            if (pipe[i] < ctx->first_queued) ctx->first_queued = pipe[i];
         } else {
-             #ifdef _WIN32
-             if (WSAGetLastError() != WSAEWOULDBLOCK)
-             #else
-             if (errno != EAGAIN && errno != EWOULDBLOCK)
-             #endif
-             {
-                 // Error
-                 if (ctx->callback) {
-                     KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Read Error");
-                     ctx->callback(term, session, &r, ctx->user_data);
-                 }
-                 ctx->state = 6;
-             }
+            KTerm_Http_Fail(term, session, ctx, pipe[i], msg);
         }
+    }
+}
 
-        // Read Timeout (10s total from first byte)
-        if (ctx->state == 5 && (KTerm_GetTime() - ctx->first_byte_time > 10.0)) {
-             if (ctx->callback) {
-                 KTermHttpProbeResult r = {0}; r.error = true; snprintf(r.error_msg, sizeof(r.error_msg), "Read Timeout");
-                 ctx->callback(term, session, &r, ctx->user_data);
-             }
-             ctx->state = 6;
-        }
+static void KTerm_Http_OnResolved(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    (void)term; (void)session;
+    KTermHttpConn* c = (KTermHttpConn*)user_data;
+    c->dns_req_id = 0;
+    c->dns_ms = (KTerm_GetTime() - c->open_time) * 1000.0;
+    if (result->success) {
+        memcpy(&c->addr, result->addr, result->addr_len);
+        c->addr_len = (socklen_t)result->addr_len;
+        if (c->addr.ss_family == AF_INET6) ((struct sockaddr_in6*)&c->addr)->sin6_port = htons((uint16_t)c->port);
+        else ((struct sockaddr_in*)&c->addr)->sin_port = htons((uint16_t)c->port);
+        c->state = 2; // CONNECT (socket opened on next tick)
+    } else {
+        c->state = 5; // FAILED (reported on next tick)
     }
+}
+
+static bool KTerm_Http_StartConnect(KTermHttpConn* c) {
+    c->fd = socket(((struct sockaddr*)&c->addr)->sa_family, SOCK_STREAM, 0);
+    if (!IS_VALID_SOCKET(c->fd)) return false;
+#ifdef _WIN32
+    u_long mode = 1; ioctlsocket(c->fd, FIONBIO, &mode);
+#else
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    c->connect_start = KTerm_GetTime();
+    connect(c->fd, (struct sockaddr*)&c->addr, c->addr_len);
+    return true;
+}
 
-    if (ctx->state == 6) {
-        if (IS_VALID_SOCKET(ctx->sockfd)) {
-             CLOSE_SOCKET(ctx->sockfd);
-             ctx->sockfd = INVALID_SOCKET;
+// Appends GET requests for assigned-but-unsent pipe entries to the output buffer.
+static void KTerm_Http_QueueRequests(KTermHttpProbeContext* ctx, KTermHttpConn* c) {
+    double now = KTerm_GetTime();
+    while (c->sent_count < c->pipe_count) {
+        KTermHttpRequest* req = &ctx->reqs[c->pipe[c->sent_count]];
+        char line[1536];
+        int n;
+        if (c->port == 80) {
+            n = snprintf(line, sizeof(line), "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: KTerm/%s\r\nConnection: keep-alive\r\n\r\n", req->path, c->host, KTERM_VERSION_STRING);
+        } else {
+            n = snprintf(line, sizeof(line), "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: KTerm/%s\r\nConnection: keep-alive\r\n\r\n", req->path, c->host, c->port, KTERM_VERSION_STRING);
         }
+        if (n <= 0 || n >= (int)sizeof(line)) n = (int)sizeof(line) - 1;
+        if (c->out_len + n > (int)sizeof(c->out)) break; // Flush first
+        memcpy(c->out + c->out_len, line, n);
+        c->out_len += n;
+        req->sent_time = now;
+        req->pipelined = (c->sent_count > 0);
+        c->sent_count++;
     }
 }
 
-bool KTerm_Net_HttpProbe(KTerm* term, KTermSession* session, const char* url, KTermHttpProbeCallback cb, void* user_data, const char* tag) {
-    if (!term || !session || !url) return false;
-
-    KTermNetSession* net = KTerm_Net_CreateContext(session);
-    if (!net) return false;
+static void KTerm_Http_Flush(KTermHttpConn* c) {
+    while (c->out_off < c->out_len) {
+#ifdef MSG_NOSIGNAL
+        int n = (int)send(c->fd, c->out + c->out_off, c->out_len - c->out_off, KTERM_MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+        int n = (int)send(c->fd, c->out + c->out_off, c->out_len - c->out_off, KTERM_MSG_DONTWAIT);
+#endif
+        if (n <= 0) break; // Retry when writable
+        c->out_off += n;
+    }
+    if (c->out_off >= c->out_len) c->out_off = c->out_len = 0;
+}
 
-    if (net->http_probe) {
-        KTerm_Net_FreeHttpProbe(net->http_probe);
-        net->http_probe = NULL;
+static void KTerm_Http_ResponseDone(KTerm* term, KTermSession* session, KTermHttpProbeContext* ctx, KTermHttpConn* c) {
+    double now = KTerm_GetTime();
+    int req_idx = c->pipe[0];
+    KTermHttpRequest* req = &ctx->reqs[req_idx];
+
+    KTermHttpProbeResult r = {0};
+    r.status_code = c->status;
+    r.reused = req->reused;
+    r.pipelined = req->pipelined;
+    if (!req->reused) {
+        r.dns_ms = c->dns_ms;
+        r.connect_ms = c->connect_ms;
+    }
+    // Server time for this response: from when it became head-of-line (pipelining) to its first byte
+    double ready = (req->sent_time > c->head_ready) ? req->sent_time : c->head_ready;
+    r.ttfb_ms = (c->resp_first - ready) * 1000.0;
+    r.download_ms = (now - c->resp_first) * 1000.0;
+    r.total_ms = (now - req->start_time) * 1000.0;
+    r.size_bytes = c->resp_bytes;
+    if (r.download_ms > 0) r.speed_mbps = ((double)r.size_bytes * 8.0) / (r.download_ms * 1000.0);
+
+    // Pop head-of-line and reset the framer for the next response
+    memmove(c->pipe, c->pipe + 1, sizeof(int) * (c->pipe_count - 1));
+    c->pipe_count--;
+    c->sent_count--;
+    c->served++;
+    c->pstate = 0;
+    c->hdr_len = 0;
+    c->resp_bytes = 0;
+    c->head_ready = now;
+    c->last_activity = now;
+    if (c->pipe_count == 0) {
+        if (c->close_after) {
+            KTerm_Http_CloseConn(c);
+        } else {
+            c->state = 3; // IDLE
+            c->idle_since = now;
+        }
     }
 
-    net->http_probe = (KTermHttpProbeContext*)calloc(1, sizeof(KTermHttpProbeContext));
-    if (!net->http_probe) return false;
+    KTerm_Http_Complete(term, session, ctx, req_idx, &r);
+}
 
-    KTermHttpProbeContext* ctx = net->http_probe;
-    ctx->callback = cb;
+// Incremental HTTP/1.1 response framer (Content-Length, chunked, or until close).
+// Returns false on a protocol error.
+static bool KTerm_Http_Feed(KTerm* term, KTermSession* session, KTermHttpProbeContext* ctx, KTermHttpConn* c, const char* data, int len) {
+    int pos = 0;
+    while (pos < len && c->state == 4 && c->pipe_count > 0) {
+        if (c->resp_bytes == 0 && c->pstate == 0 && c->hdr_len == 0) c->resp_first = KTerm_GetTime();
+
+        if (c->pstate == 0) { // HEAD
+            int old = c->hdr_len;
+            int space = (int)sizeof(c->hdr) - 1 - old;
+            if (space <= 0) return false; // Header too large
+            int take = (len - pos < space) ? len - pos : space;
+            memcpy(c->hdr + old, data + pos, take);
+            c->hdr_len += take;
+            c->hdr[c->hdr_len] = '\0';
+
+            char* end = strstr(c->hdr + (old > 3 ? old - 3 : 0), "\r\n\r\n");
+            if (!end) { pos += take; c->resp_bytes += take; continue; }
+
+            int head_len = (int)(end - c->hdr) + 4;
+            int used = head_len - old;
+            pos += used;
+            c->resp_bytes += used;
+            c->hdr[head_len] = '\0';
+
+            if (strncmp(c->hdr, "HTTP/", 5) != 0) return false;
+            const char* sp = strchr(c->hdr, ' ');
+            c->status = sp ? atoi(sp + 1) : 0;
+            if (c->status >= 100 && c->status < 200) { // Interim (100 Continue): wait for the final response
+                c->hdr_len = 0;
+                continue;
+            }
 
-    if (tag) {
-        strncpy(ctx->req_tag, tag, sizeof(ctx->req_tag)-1);
-        ctx->user_data = ctx->req_tag;
-        ctx->free_user_data = false;
-    } else {
-        ctx->user_data = user_data;
-        ctx->free_user_data = false;
+            const char* conn_hdr = KTerm_Http_FindHeader(c->hdr, "connection");
+            bool http10 = strncmp(c->hdr, "HTTP/1.0", 8) == 0;
+            c->close_after = conn_hdr ? KTerm_Http_ValueHas(conn_hdr, "close") : http10;
+            if (http10 && conn_hdr && KTerm_Http_ValueHas(conn_hdr, "keep-alive")) c->close_after = false;
+
+            const char* te = KTerm_Http_FindHeader(c->hdr, "transfer-encoding");
+            const char* cl = KTerm_Http_FindHeader(c->hdr, "content-length");
+            if (c->status == 204 || c->status == 304) {
+                KTerm_Http_ResponseDone(term, session, ctx, c);
+            } else if (te && KTerm_Http_ValueHas(te, "chunked")) {
+                c->pstate = 2; c->line_len = 0;
+            } else if (cl) {
+                c->remaining = strtoull(cl, NULL, 10);
+                c->pstate = 1;
+                if (c->remaining == 0) KTerm_Http_ResponseDone(term, session, ctx, c);
+            } else {
+                c->pstate = 6; // Body delimited by close
+                c->close_after = true;
+            }
+        }
+        else if (c->pstate == 1 || c->pstate == 3 || c->pstate == 4) { // LENGTH / CHUNK_DATA / CHUNK_CRLF
+            int take = (uint64_t)(len - pos) < c->remaining ? len - pos : (int)c->remaining;
+            pos += take;
+            c->resp_bytes += take;
+            c->remaining -= take;
+            if (c->remaining == 0) {
+                if (c->pstate == 1) KTerm_Http_ResponseDone(term, session, ctx, c);
+                else if (c->pstate == 3) { c->pstate = 4; c->remaining = 2; }
+                else { c->pstate = 2; c->line_len = 0; }
+            }
+        }
+        else if (c->pstate == 2 || c->pstate == 5) { // CHUNK_SIZE / TRAILER (line based)
+            char ch = data[pos++];
+            c->resp_bytes++;
+            if (ch == '\n') {
+                c->line[c->line_len] = '\0';
+                if (c->pstate == 2) {
+                    uint64_t size = strtoull(c->line, NULL, 16);
+                    c->line_len = 0;
+                    if (size == 0) c->pstate = 5;
+                    else { c->pstate = 3; c->remaining = size; }
+                } else {
+                    bool empty = (c->line_len == 0);
+                    c->line_len = 0;
+                    if (empty) KTerm_Http_ResponseDone(term, session, ctx, c);
+                }
+            } else if (ch != '\r' && c->line_len < (int)sizeof(c->line) - 1) {
+                c->line[c->line_len++] = ch;
+            }
+        }
+        else { // UNTIL_CLOSE
+            c->resp_bytes += len - pos;
+            pos = len;
+        }
     }
-    ctx->sockfd = INVALID_SOCKET;
-
-    // Parse URL
-    const char* p = url;
-    if (strncmp(p, "http://", 7) == 0) p += 7;
-    else if (strncmp(p, "https://", 8) == 0) p += 8; // We don't support SSL in this lightweight probe yet? Or assume raw?
-    // Note: This probe uses raw sockets, so HTTPS will fail or return garbage unless we use SSL context.
-    // Ideally we should reject HTTPS or use KTerm's security layer if configured.
-    // For now, assume HTTP or raw TCP.
+    return true;
+}
 
-    const char* slash = strchr(p, '/');
-    const char* colon = strchr(p, ':');
+// Picks a connection for host:port with pipeline room, or opens a new one. Returns NULL if limits are hit.
+static KTermHttpConn* KTerm_Http_AcquireConn(KTermHttpProbeContext* ctx, const KTermHttpRequest* req) {
+    KTermHttpConn* best = NULL;
+    KTermHttpConn* free_slot = NULL;
+    int host_conns = 0, total = 0;
+    int depth = req->no_pipeline ? 1 : ctx->pipeline_depth;
+
+    for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) {
+        KTermHttpConn* c = &ctx->pool[i];
+        if (c->state == 0) { if (!free_slot) free_slot = c; continue; }
+        total++;
+        if (c->port != req->port || strcmp(c->host, req->host) != 0) continue;
+        host_conns++;
+        if (c->state == 5 || c->close_after || c->no_pipeline) continue;
+        if (c->pipe_count >= depth) continue;
+        if (req->no_pipeline && c->pipe_count > 0) continue;
+        if (!best || c->pipe_count < best->pipe_count) best = c;
+    }
+    // Prefer an idle keep-alive connection, then a fresh one, then pipelining behind in-flight requests
+    if (best && best->pipe_count == 0) return best;
+    if (free_slot && host_conns < ctx->per_host && total < ctx->max_connections) {
+        KTermHttpConn* c = free_slot;
+        memset(c, 0, sizeof(*c));
+        c->fd = INVALID_SOCKET;
+        snprintf(c->host, sizeof(c->host), "%s", req->host);
+        c->port = req->port;
+        c->open_time = KTerm_GetTime();
+        c->state = 1; // RESOLVE
+        return c;
+    }
+    return best;
+}
 
-    int host_len = 0;
-    if (slash) {
-        host_len = (int)(slash - p);
-        if (colon && colon < slash) host_len = (int)(colon - p);
-    } else {
-        host_len = strlen(p);
-        if (colon) host_len = (int)(colon - p);
-    }
+void KTerm_Net_ProcessHttpProbe(KTerm* term, KTermSession* session) {
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    if (!net || !net->http_probe) return;
+    KTermHttpProbeContext* ctx = net->http_probe;
+    double now = KTerm_GetTime();
+
+    // 1. Dispatch queued requests onto pooled connections
+    for (int i = ctx->first_queued; i < ctx->req_count; i++) {
+        if (ctx->reqs[i].state != 0) { if (i == ctx->first_queued) ctx->first_queued++; continue; }
+        KTermHttpConn* c = KTerm_Http_AcquireConn(ctx, &ctx->reqs[i]);
+        if (!c) continue; // Host at its limit; later requests may target other hosts
+        KTermHttpRequest* req = &ctx->reqs[i];
+        req->state = 1; // ASSIGNED
+        req->reused = (c->served > 0 || c->pipe_count > 0 || c->state == 3);
+        req->start_time = req->reused ? now : c->open_time;
+        if (req->no_pipeline) c->no_pipeline = true;
+        if (c->state == 3) { c->state = 4; c->head_ready = now; c->last_activity = now; }
+        c->pipe[c->pipe_count++] = i;
+    }
+
+    // 2. Advance connection setup and gather sockets to poll
+    KT_POLLFD pfds[KTERM_NET_HTTP_POOL_SIZE];
+    int map[KTERM_NET_HTTP_POOL_SIZE];
+    int count = 0;
+    for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) {
+        KTermHttpConn* c = &ctx->pool[i];
+        if (c->state == 1 && !c->dns_req_id) {
+            KTermResolveResult rr;
+            if (KTerm_Net_ResolveCached(c->host, KTERM_RESOLVE_ANY, &rr)) {
+                KTerm_Http_OnResolved(term, session, &rr, c);
+            } else {
+                c->dns_req_id = KTerm_Net_ResolveAsync(term, session, c->host, KTERM_RESOLVE_ANY, KTerm_Http_OnResolved, c);
+                if (!c->dns_req_id) c->state = 5;
+            }
+        }
+        if (c->state == 5) { KTerm_Http_DropConn(term, session, ctx, c, "DNS Failed"); continue; }
+        if (c->state == 2 && !IS_VALID_SOCKET(c->fd) && !KTerm_Http_StartConnect(c)) {
+            KTerm_Http_DropConn(term, session, ctx, c, "Connect Failed");
+            continue;
+        }
+        if (c->state == 4 && c->sent_count < c->pipe_count) KTerm_Http_QueueRequests(ctx, c);
+        if (c->state == 4 && c->out_len > 0) KTerm_Http_Flush(c);
+
+        if (c->state < 2 || !IS_VALID_SOCKET(c->fd)) continue;
+        pfds[count].fd = c->fd;
+        pfds[count].events = (c->state == 2 || c->out_len > 0) ? POLLOUT : POLLIN;
+        pfds[count].revents = 0;
+        map[count++] = i;
+    }
+
+    // 3. One poll over every pooled socket
+    if (count > 0 && KT_POLL(pfds, count, 0) > 0) {
+        for (int k = 0; k < count; k++) {
+            KTermHttpConn* c = &ctx->pool[map[k]];
+            if (!pfds[k].revents || c->state == 0) continue;
+
+            if (c->state == 2) { // CONNECT
+                int opt = 0; socklen_t olen = sizeof(opt);
+                if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (char*)&opt, &olen) == 0 && opt == 0 && !(pfds[k].revents & POLLERR)) {
+                    c->connect_ms = (KTerm_GetTime() - c->connect_start) * 1000.0;
+                    c->state = 4; // ACTIVE
+                    c->head_ready = c->last_activity = KTerm_GetTime();
+                    KTerm_Http_QueueRequests(ctx, c);
+                    KTerm_Http_Flush(c);
+                } else {
+                    KTerm_Http_DropConn(term, session, ctx, c, "Connect Failed");
+                }
+                continue;
+            }
 
-    if (host_len >= (int)sizeof(ctx->host)) host_len = sizeof(ctx->host) - 1;
-    strncpy(ctx->host, p, host_len);
-    ctx->host[host_len] = '\0';
+            if (c->state == 3) { // IDLE: readable means the server closed (or sent garbage)
+                KTerm_Http_CloseConn(c);
+                continue;
+            }
 
-    if (colon && (!slash || colon < slash)) {
-        ctx->port = atoi(colon + 1);
-    } else {
-        ctx->port = 80;
+            if (!(pfds[k].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+            char buf[16384];
+            for (int iter = 0; iter < 16 && c->state == 4; iter++) {
+                int n = (int)recv(c->fd, buf, sizeof(buf), KTERM_MSG_DONTWAIT);
+                if (n > 0) {
+                    c->last_activity = KTerm_GetTime();
+                    if (!KTerm_Http_Feed(term, session, ctx, c, buf, n)) {
+                        KTerm_Http_DropConn(term, session, ctx, c, "Bad Response");
+                    }
+                    continue;
+                }
+                if (n == 0) {
+                    if (c->pstate == 6 && c->pipe_count > 0) KTerm_Http_ResponseDone(term, session, ctx, c);
+                    if (c->state != 0) KTerm_Http_DropConn(term, session, ctx, c, "Connection Closed");
+                } else {
+#ifdef _WIN32
+                    if (WSAGetLastError() != WSAEWOULDBLOCK)
+#else
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+#endif
+                        KTerm_Http_DropConn(term, session, ctx, c, "Read Error");
+                }
+                break;
+            }
+        }
     }
 
-    if (slash) {
-        strncpy(ctx->path, slash, sizeof(ctx->path)-1);
-    } else {
-        strcpy(ctx->path, "/");
+    // 4. Timeouts and idle reaping
+    now = KTerm_GetTime();
+    for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) {
+        KTermHttpConn* c = &ctx->pool[i];
+        if (c->state == 2 && IS_VALID_SOCKET(c->fd) && now - c->connect_start > 5.0) {
+            KTerm_Http_DropConn(term, session, ctx, c, "Connect Timeout");
+        } else if (c->state == 4 && now - c->last_activity > 10.0) {
+            KTerm_Http_DropConn(term, session, ctx, c, c->resp_bytes ? "Read Timeout" : "Response Timeout");
+        } else if (c->state == 3 && now - c->idle_since > KTERM_NET_HTTP_IDLE_SEC) {
+            KTerm_Http_CloseConn(c);
+        }
     }
 
-    ctx->start_time = KTerm_GetTime();
-
-    // DNS
-    ctx->dns_start_time = KTerm_GetTime();
-    struct addrinfo hints, *res;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    char port_str[16]; snprintf(port_str, sizeof(port_str), "%d", ctx->port);
-
-    if (getaddrinfo(ctx->host, port_str, &hints, &res) != 0) {
-        free(ctx); net->http_probe = NULL;
-        return false;
+    // 5. Compact finished requests; drop the engine once nothing is pending or pooled
+    if (ctx->pending == 0) {
+        ctx->req_count = 0;
+        ctx->first_queued = 0;
+        bool any_conn = false;
+        for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) if (ctx->pool[i].state != 0) any_conn = true;
+        if (!any_conn) {
+            KTerm_Net_FreeHttpProbe(ctx);
+            net->http_probe = NULL;
+        }
     }
-    ctx->dest_addr = *(struct sockaddr_in*)res->ai_addr;
-    freeaddrinfo(res);
+}
 
-    ctx->dns_ms = (KTerm_GetTime() - ctx->dns_start_time) * 1000.0;
+static KTermHttpProbeContext* KTerm_Http_GetEngine(KTermNetSession* net) {
+    if (net->http_probe) return net->http_probe;
+    KTermHttpProbeContext* ctx = (KTermHttpProbeContext*)calloc(1, sizeof(KTermHttpProbeContext));
+    if (!ctx) return NULL;
+    for (int i = 0; i < KTERM_NET_HTTP_POOL_SIZE; i++) ctx->pool[i].fd = INVALID_SOCKET;
+    ctx->max_connections = 16;
+    ctx->per_host = 4;
+    ctx->pipeline_depth = 4;
+    net->http_probe = ctx;
+    return ctx;
+}
 
-    // Connect
-    ctx->sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (!IS_VALID_SOCKET(ctx->sockfd)) {
-        free(ctx); net->http_probe = NULL;
-        return false;
-    }
+static bool KTerm_Http_Enqueue(KTermHttpProbeContext* ctx, const char* url, int batch_id, int batch_index, KTermHttpProbeCallback cb, void* user_data, const char* tag) {
+    if (ctx->req_count == ctx->req_cap) {
+        int cap = ctx->req_cap ? ctx->req_cap * 2 : 16;
+        KTermHttpRequest* reqs = (KTermHttpRequest*)realloc(ctx->reqs, sizeof(KTermHttpRequest) * cap);
+        if (!reqs) return false;
+        ctx->reqs = reqs;
+        ctx->req_cap = cap;
+    }
+    KTermHttpRequest* req = &ctx->reqs[ctx->req_count];
+    memset(req, 0, sizeof(*req));
+    if (!KTerm_Http_ParseUrl(url, req->host, sizeof(req->host), &req->port, req->path, sizeof(req->path))) return false;
+    req->batch_id = batch_id;
+    req->batch_index = batch_index;
+    req->callback = cb;
+    req->user_data = user_data;
+    if (tag) strncpy(req->req_tag, tag, sizeof(req->req_tag)-1);
+    ctx->req_count++;
+    ctx->pending++;
+    return true;
+}
 
-    #ifdef _WIN32
-    u_long mode = 1; ioctlsocket(ctx->sockfd, FIONBIO, &mode);
-    #else
-    fcntl(ctx->sockfd, F_SETFL, fcntl(ctx->sockfd, F_GETFL, 0) | O_NONBLOCK);
-    #endif
+bool KTerm_Net_HttpProbe(KTerm* term, KTermSession* session, const char* url, KTermHttpProbeCallback cb, void* user_data, const char* tag) {
+    const char* urls[1] = { url };
+    if (!url) return false;
+    return KTerm_Net_HttpProbeBatch(term, session, urls, 1, NULL, cb, user_data, tag);
+}
 
-    ctx->connect_start_time = KTerm_GetTime();
-    connect(ctx->sockfd, (struct sockaddr*)&ctx->dest_addr, sizeof(ctx->dest_addr));
+bool KTerm_Net_HttpProbeBatch(KTerm* term, KTermSession* session, const char* const* urls, int count, const KTermHttpProbeOptions* opts, KTermHttpProbeCallback cb, void* user_data, const char* tag) {
+    if (!term || !session || !urls || count <= 0) return false;
 
-    ctx->state = 2; // CONNECT
+    KTermNetSession* net = KTerm_Net_CreateContext(session);
+    if (!net) return false;
 
+    KTermHttpProbeContext* ctx = KTerm_Http_GetEngine(net);
+    if (!ctx) return false;
+
+    if (opts) {
+        if (opts->max_connections > 0) ctx->max_connections = opts->max_connections > KTERM_NET_HTTP_POOL_SIZE ? KTERM_NET_HTTP_POOL_SIZE : opts->max_connections;
+        if (opts->per_host > 0) ctx->per_host = opts->per_host;
+        if (opts->pipeline_depth > 0) ctx->pipeline_depth = opts->pipeline_depth > KTERM_NET_HTTP_PIPELINE_MAX ? KTERM_NET_HTTP_PIPELINE_MAX : opts->pipeline_depth;
+    }
+
+    int batch_id = ++ctx->next_batch_id;
+    int start = ctx->req_count;
+    for (int i = 0; i < count; i++) {
+        if (!urls[i] || !KTerm_Http_Enqueue(ctx, urls[i], batch_id, i, cb, user_data, tag)) {
+            // Roll back this batch so no partial callbacks fire
+            ctx->pending -= ctx->req_count - start;
+            ctx->req_count = start;
+            if (ctx->pending == 0 && ctx->req_count == 0) {
+                bool any_conn = false;
+                for (int k = 0; k < KTERM_NET_HTTP_POOL_SIZE; k++) if (ctx->pool[k].state != 0) any_conn = true;
+                if (!any_conn) { KTerm_Net_FreeHttpProbe(ctx); net->http_probe = NULL; }
+            }
+            return false;
+        }
+    }
     return true;
 }
 
@@ -5815,41 +10557,28 @@ bool KTerm_Net_ScanAuthFlows(KTerm* term, KTermSession* session, char* out, size
     size_t offset = 0;
     int count = 0;
 
-#ifndef _WIN32
-    pthread_mutex_lock(&ctx->mutex);
-#else
-    EnterCriticalSection(&ctx->mutex);
-#endif
+    for (int w = 0; w < PacketDiag_ShardCount(ctx) && offset < max; w++) {
+    PacketDiagShard* sh = &ctx->shards[w];
+    PacketDiag_LockShard(ctx, sh);
+    for (uint32_t i = 0; i < sh->flows.used; i++) {
+        PacketDiagFlow* flow = &sh->flows.pool[i];
+        if (flow->id && flow->auth_detected) {
+            char src[INET6_ADDRSTRLEN + 2], dst[INET6_ADDRSTRLEN + 2];
+            PacketDiag_FormatFlowAddr(&flow->key, true, src, sizeof(src));
+            PacketDiag_FormatFlowAddr(&flow->key, false, dst, sizeof(dst));
+
+            int n = snprintf(out + offset, max - offset,
+                "ID=%u;%s:%d->%s:%d;PROTO=%s;RISK=%d|",
+                flow->id, src, flow->key.src_port, dst, flow->key.dst_port,
+                flow->auth_proto, flow->auth_risk);
 
-    for (int i = 0; i < 256; i++) {
-        PacketDiagFlow* flow = ctx->flow_table[i];
-        while (flow) {
-            if (flow->auth_detected) {
-                char src[16], dst[16];
-                struct in_addr sa = { .s_addr = flow->key.src_ip };
-                struct in_addr da = { .s_addr = flow->key.dst_ip };
-                inet_ntop(AF_INET, &sa, src, sizeof(src));
-                inet_ntop(AF_INET, &da, dst, sizeof(dst));
-
-                int n = snprintf(out + offset, max - offset,
-                    "ID=%u;%s:%d->%s:%d;PROTO=%s;RISK=%d|",
-                    flow->id, src, flow->key.src_port, dst, flow->key.dst_port,
-                    flow->auth_proto, flow->auth_risk);
-
-                if (n > 0) offset += n;
-                if (offset >= max) break;
-                count++;
-            }
-            flow = flow->next;
+            if (n > 0) offset += n;
+            if (offset >= max) break;
+            count++;
         }
-        if (offset >= max) break;
     }
-
-#ifndef _WIN32
-    pthread_mutex_unlock(&ctx->mutex);
-#else
-    LeaveCriticalSection(&ctx->mutex);
-#endif
+    PacketDiag_UnlockShard(ctx, sh);
+    }
 
     if (count == 0) snprintf(out, max, "NO_AUTH_DETECTED");
     return true;
@@ -77,10 +77,12 @@ typedef struct {
 } KTermOp;
 
 // Operation Queue (Ring Buffer)
-#define KTERM_OP_QUEUE_SIZE 16384
+#define KTERM_OP_QUEUE_SIZE 16384    // Maximum ops pending
+#define KTERM_OP_QUEUE_INITIAL 256   // Ring allocated by the first op, doubled as bursts need
 
 typedef struct {
-    KTermOp ops[KTERM_OP_QUEUE_SIZE];
+    KTermOp* ops;
+    int capacity;
     int head;
     int tail;
     int count;
@@ -92,6 +94,7 @@ typedef struct KTermSession_T KTermSession; // Assuming struct name match
 
 // Function Prototypes
 void KTerm_InitOpQueue(KTermOpQueue* queue);
+void KTerm_FreeOpQueue(KTermOpQueue* queue);
 bool KTerm_QueueOp(KTermSession* session, KTermOp op);
 bool KTerm_IsOpQueueFull(KTermOpQueue* queue);
 // FlushOps will be declared in kterm.h to avoid circular dependency issues with KTermSession definition
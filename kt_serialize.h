@@ -7,15 +7,66 @@
 extern "C" {
 #endif
 
-// Serialize the session state (grid, cursor, scrollback) to a newly allocated buffer.
+// Serialize the session state (grid, scrollback, cursor, modes, charsets, tab stops,
+// SGR state, titles, Sixel and Kitty images) to a newly allocated buffer.
 // Returns true on success, false on failure.
 // The caller is responsible for freeing *out_buf using KTerm_Free.
 bool KTerm_SerializeSession(KTermSession* session, void** out_buf, size_t* out_len);
 
+// As KTerm_SerializeSession, but flushes pending grid ops first and also stores the
+// terminal palette.
+bool KTerm_SerializeSessionEx(KTerm* term, KTermSession* session, void** out_buf, size_t* out_len);
+
 // Restore session state from a buffer.
-// Returns true on success, false on failure.
+// If the snapshot was taken at other dimensions, the session takes the snapshot's
+// dimensions and a resize back to its own is queued (applied by the next KTerm_FlushOps).
+// Returns true on success, false on failure. On failure the session is unchanged.
 bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len);
 
+// As KTerm_DeserializeSession, but also restores the palette and applies the resize
+// immediately.
+bool KTerm_DeserializeSessionEx(KTerm* term, KTermSession* session, const void* buf, size_t len);
+
+// Incremental checkpoint chain state. The writer and each reader keep one, zero-initialised;
+// zeroing it again makes the writer's next checkpoint a keyframe.
+typedef struct {
+    uint64_t sequence;       // Position in the chain (0 = no keyframe yet)
+    uint32_t epoch;          // Session grid epoch the chain was built on (writer)
+    uint32_t generation;     // Rows stamped at or after this changed since the last checkpoint (writer)
+    uint32_t main_scrolled;  // Scroll counts of each screen at the last checkpoint (writer)
+    uint32_t alt_scrolled;
+    uint32_t meta_hash;      // Encodings of the state last sent (writer)
+    uint32_t tabs_hash;
+    uint32_t title_hash;
+    uint32_t palette_hash;
+} KTermCheckpoint;
+
+// Write the changes since the previous checkpoint taken with `cp`: rows written since then
+// (found from per-row generation stamps, so the cost follows the amount of change, not the
+// grid size), scrolls, and cursor, mode, tab, title and palette state when it changed.
+// The first checkpoint, and the first after a resize, restore or scrollback clear, is a
+// keyframe holding a full snapshot; Sixel and Kitty images only travel in keyframes.
+// `term` may be NULL, in which case pending ops are not flushed and the palette is skipped.
+// The caller frees *out_buf using KTerm_Free.
+bool KTerm_CheckpointSession(KTerm* term, KTermSession* session, KTermCheckpoint* cp, void** out_buf, size_t* out_len);
+
+// Apply a checkpoint to a mirror session. A keyframe replaces the session's state and size;
+// a delta must be the next one in the chain tracked by `cp`. Returns false, leaving the
+// session unchanged, on a damaged or out-of-order checkpoint.
+bool KTerm_ApplySessionCheckpoint(KTerm* term, KTermSession* session, KTermCheckpoint* cp, const void* buf, size_t len);
+
+// Write a snapshot file whose main screen and scrollback are stored exactly as the ring
+// buffer sits in memory, for KTerm_MapSession. Everything else is stored as in
+// KTerm_SerializeSessionEx. `term` may be NULL (no flush, no palette).
+bool KTerm_SaveSessionMapped(KTerm* term, KTermSession* session, const char* path);
+
+// Restore a file written by KTerm_SaveSessionMapped without reading its grid: the main
+// screen and scrollback are mapped copy-on-write and paged in from the file only when
+// first drawn, scrolled back to or written. The file must come from a build with the same
+// cell layout and MAX_SCROLLBACK_LINES, and must not be truncated while mapped.
+// Returns false, leaving the session unchanged, if the file does not match.
+bool KTerm_MapSession(KTerm* term, KTermSession* session, const char* path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,9 +79,20 @@ bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len
 #include <stdlib.h>
 #include <string.h>
 
-#define KTERM_SERIALIZE_MAGIC "KTERM_SES_V1"
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#define KTERM_SERIALIZE_MAGIC "KTERM_SES_V2"
+#define KTERM_SERIALIZE_MAGIC_V1 "KTERM_SES_V1"
 #define KTERM_SERIALIZE_MAGIC_LEN 12
 
+// Version 1: this header followed by raw screen_buffer and alt_buffer memory
 typedef struct {
     char magic[KTERM_SERIALIZE_MAGIC_LEN];
     int cols;
@@ -45,52 +107,7 @@ typedef struct {
     // Add more metadata as needed
 } KTermSessionHeader;
 
-bool KTerm_SerializeSession(KTermSession* session, void** out_buf, size_t* out_len) {
-    if (!session || !out_buf || !out_len) return false;
-
-    // Calculate size
-    size_t header_size = sizeof(KTermSessionHeader);
-    size_t screen_size = session->buffer_height * session->cols * sizeof(EnhancedTermChar);
-    size_t alt_size = session->rows * session->cols * sizeof(EnhancedTermChar);
-    // Tab stops could be added here
-
-    size_t total_size = header_size + screen_size + alt_size;
-
-    *out_buf = KTerm_Malloc(total_size);
-    if (!*out_buf) return false;
-
-    *out_len = total_size;
-    unsigned char* ptr = (unsigned char*)*out_buf;
-
-    // Header
-    KTermSessionHeader header;
-    memset(&header, 0, sizeof(header));
-    strncpy(header.magic, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN);
-    header.cols = session->cols;
-    header.rows = session->rows;
-    header.buffer_height = session->buffer_height;
-    header.screen_head = session->screen_head;
-    header.view_offset = session->view_offset;
-    header.cursor_x = session->cursor.x;
-    header.cursor_y = session->cursor.y;
-    header.scroll_top = session->scroll_top;
-    header.scroll_bottom = session->scroll_bottom;
-
-    memcpy(ptr, &header, header_size);
-    ptr += header_size;
-
-    // Screen Buffer
-    memcpy(ptr, session->screen_buffer, screen_size);
-    ptr += screen_size;
-
-    // Alt Buffer
-    memcpy(ptr, session->alt_buffer, alt_size);
-    ptr += alt_size;
-
-    return true;
-}
-
-bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len) {
+static bool KTerm_DeserializeSessionV1(KTermSession* session, const void* buf, size_t len) {
     if (!session || !buf) return false;
 
     const unsigned char* ptr = (const unsigned char*)buf;
@@ -101,7 +118,7 @@ bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len
     KTermSessionHeader header;
     memcpy(&header, ptr, sizeof(KTermSessionHeader));
 
-    if (strncmp(header.magic, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) != 0) {
+    if (strncmp(header.magic, KTERM_SERIALIZE_MAGIC_V1, KTERM_SERIALIZE_MAGIC_LEN) != 0) {
         return false; // Invalid magic
     }
 
@@ -169,8 +186,1731 @@ bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len
         for(int i=0; i<session->rows; i++) session->row_dirty[i] = KTERM_DIRTY_FRAMES;
     }
     session->dirty_rect = (KTermRect){0, 0, session->cols, session->rows};
+    KTerm_ResetRowGenerations(session);
+    KTerm_DropHistoryReflow(session);
+
+    return true;
+}
+
+// --- Version 2: Tagged Snapshot ---
+//
+// After the 12-byte magic, a snapshot is a list of chunks: a four-character tag, a
+// 32-bit little-endian payload length and the payload, ending with an "END " chunk.
+// Readers skip tags they do not know and ignore bytes left at the end of a chunk, so
+// chunks and trailing fields can be added without a new magic. Integers are LEB128
+// varints; signed values are zigzag encoded.
+//
+// Grids are stored oldest row first (scrollback, then the screen). Each row is one of:
+//   0                   blank row
+//   1 <distance>        same cells as the row <distance> rows earlier
+//   2 <used> <runs...>  the cells before the trailing blanks, as runs
+// A run header is (count << 2) | (fill << 1) | attr. With attr set the run's attributes
+// follow; otherwise the previous run's apply (blank attributes at the start of a row).
+// A fill run stores one character for all count cells instead of count characters.
+
+#define KTERM_SNAP_TAG(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define KTERM_SNAP_META KTERM_SNAP_TAG('M', 'E', 'T', 'A') // Cursor, margins, modes, SGR, charsets
+#define KTERM_SNAP_GRID KTERM_SNAP_TAG('G', 'R', 'I', 'D') // Main screen and scrollback
+#define KTERM_SNAP_ALTG KTERM_SNAP_TAG('A', 'L', 'T', 'G') // Alternate screen
+#define KTERM_SNAP_TABS KTERM_SNAP_TAG('T', 'A', 'B', 'S')
+#define KTERM_SNAP_TITL KTERM_SNAP_TAG('T', 'I', 'T', 'L')
+#define KTERM_SNAP_PALT KTERM_SNAP_TAG('P', 'A', 'L', 'T') // Terminal palette (Ex only)
+#define KTERM_SNAP_SIXL KTERM_SNAP_TAG('S', 'I', 'X', 'L')
+#define KTERM_SNAP_KITY KTERM_SNAP_TAG('K', 'I', 'T', 'Y')
+#define KTERM_SNAP_END  KTERM_SNAP_TAG('E', 'N', 'D', ' ')
+
+#define KTERM_SNAP_ROW_BLANK 0
+#define KTERM_SNAP_ROW_COPY  1
+#define KTERM_SNAP_ROW_CELLS 2
+
+#define KTERM_SNAP_MIN_FILL     4   // Shorter repeats are cheaper as literal characters
+#define KTERM_SNAP_COPY_WINDOW  256 // Furthest row a copy may refer to; less than any ring height
+#define KTERM_SNAP_MAX_DIM      8192
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t capacity;
+    bool failed;
+} KTermSnapWriter;
+
+typedef struct {
+    const unsigned char* data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} KTermSnapReader;
+
+static const EnhancedTermChar kterm_snap_blank = {
+    .ch = ' ',
+    .fg_color = {.color_mode = 0, .value.index = COLOR_WHITE},
+    .bg_color = {.color_mode = 0, .value.index = COLOR_BLACK},
+};
+
+static bool KTerm_Snap_Reserve(KTermSnapWriter* w, size_t extra) {
+    if (w->failed) return false;
+    if (w->len + extra <= w->capacity) return true;
+    size_t capacity = w->capacity ? w->capacity : 4096;
+    while (capacity < w->len + extra) capacity *= 2;
+    unsigned char* data = (unsigned char*)KTerm_Realloc(w->data, capacity);
+    if (!data) {
+        w->failed = true;
+        return false;
+    }
+    w->data = data;
+    w->capacity = capacity;
+    return true;
+}
+
+static void KTerm_Snap_PutBytes(KTermSnapWriter* w, const void* src, size_t n) {
+    if (n == 0 || !KTerm_Snap_Reserve(w, n)) return;
+    memcpy(w->data + w->len, src, n);
+    w->len += n;
+}
+
+static void KTerm_Snap_PutU8(KTermSnapWriter* w, uint8_t v) {
+    KTerm_Snap_PutBytes(w, &v, 1);
+}
+
+static void KTerm_Snap_PutU32(KTermSnapWriter* w, uint32_t v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    KTerm_Snap_PutBytes(w, b, 4);
+}
+
+static void KTerm_Snap_PutVarint(KTermSnapWriter* w, uint64_t v) {
+    unsigned char b[10];
+    int n = 0;
+    do {
+        b[n] = (unsigned char)(v & 0x7F);
+        v >>= 7;
+        if (v) b[n] |= 0x80;
+        n++;
+    } while (v);
+    KTerm_Snap_PutBytes(w, b, (size_t)n);
+}
+
+static void KTerm_Snap_PutInt(KTermSnapWriter* w, int64_t v) {
+    KTerm_Snap_PutVarint(w, v < 0 ? ~((uint64_t)v << 1) : ((uint64_t)v << 1));
+}
+
+static void KTerm_Snap_PutString(KTermSnapWriter* w, const char* s, size_t max) {
+    const char* end = (const char*)memchr(s, '\0', max);
+    size_t n = end ? (size_t)(end - s) : max;
+    KTerm_Snap_PutVarint(w, n);
+    KTerm_Snap_PutBytes(w, s, n);
+}
+
+// Returns the offset of the length field, patched by KTerm_Snap_EndChunk
+static size_t KTerm_Snap_BeginChunk(KTermSnapWriter* w, uint32_t tag) {
+    KTerm_Snap_PutU32(w, tag);
+    size_t at = w->len;
+    KTerm_Snap_PutU32(w, 0);
+    return at;
+}
+
+static void KTerm_Snap_EndChunk(KTermSnapWriter* w, size_t at) {
+    if (w->failed) return;
+    size_t n = w->len - at - 4;
+    if (n > UINT32_MAX) {
+        w->failed = true;
+        return;
+    }
+    w->data[at] = (unsigned char)n;
+    w->data[at + 1] = (unsigned char)(n >> 8);
+    w->data[at + 2] = (unsigned char)(n >> 16);
+    w->data[at + 3] = (unsigned char)(n >> 24);
+}
+
+static const unsigned char* KTerm_Snap_GetBytes(KTermSnapReader* r, size_t n) {
+    if (r->failed || n > r->len - r->pos) {
+        r->failed = true;
+        return NULL;
+    }
+    const unsigned char* p = r->data + r->pos;
+    r->pos += n;
+    return p;
+}
+
+static uint8_t KTerm_Snap_GetU8(KTermSnapReader* r) {
+    const unsigned char* p = KTerm_Snap_GetBytes(r, 1);
+    return p ? p[0] : 0;
+}
+
+static uint32_t KTerm_Snap_GetU32(KTermSnapReader* r) {
+    const unsigned char* p = KTerm_Snap_GetBytes(r, 4);
+    if (!p) return 0;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t KTerm_Snap_GetVarint(KTermSnapReader* r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = KTerm_Snap_GetU8(r);
+        if (r->failed) return 0;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->failed = true;
+    return 0;
+}
+
+static int64_t KTerm_Snap_GetInt(KTermSnapReader* r) {
+    uint64_t v = KTerm_Snap_GetVarint(r);
+    return (v & 1) ? -(int64_t)(v >> 1) - 1 : (int64_t)(v >> 1);
+}
+
+// Reads a signed value and fails the reader if it lies outside [lo, hi]
+static int KTerm_Snap_GetRange(KTermSnapReader* r, int lo, int hi) {
+    int64_t v = KTerm_Snap_GetInt(r);
+    if (v < lo || v > hi) {
+        r->failed = true;
+        return lo;
+    }
+    return (int)v;
+}
+
+// Session geometry can lag a per-session resize (DECSTR and DECLRMM reset the right margin
+// from the terminal width), so positions are pulled into the grid rather than refused
+static int KTerm_Snap_GetClamped(KTermSnapReader* r, int lo, int hi) {
+    int64_t v = KTerm_Snap_GetInt(r);
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return (int)v;
+}
+
+static bool KTerm_Snap_GetBool(KTermSnapReader* r) {
+    return KTerm_Snap_GetRange(r, 0, 1) != 0;
+}
+
+static void KTerm_Snap_GetString(KTermSnapReader* r, char* out, size_t max) {
+    size_t n = (size_t)KTerm_Snap_GetVarint(r);
+    const unsigned char* p = KTerm_Snap_GetBytes(r, n);
+    if (!p) return;
+    if (n >= max) n = max - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+}
+
+// --- Cells ---
+
+static void KTerm_Snap_PutColor(KTermSnapWriter* w, const ExtendedKTermColor* c) {
+    KTerm_Snap_PutU8(w, (uint8_t)c->color_mode);
+    if (c->color_mode == 0) {
+        KTerm_Snap_PutInt(w, c->value.index);
+    } else {
+        unsigned char rgba[4] = { c->value.rgb.r, c->value.rgb.g, c->value.rgb.b, c->value.rgb.a };
+        KTerm_Snap_PutBytes(w, rgba, 4);
+    }
+}
+
+static void KTerm_Snap_GetColor(KTermSnapReader* r, ExtendedKTermColor* c) {
+    memset(c, 0, sizeof(*c));
+    c->color_mode = KTerm_Snap_GetU8(r);
+    if (c->color_mode == 0) {
+        c->value.index = KTerm_Snap_GetRange(r, -1, 255);
+    } else {
+        const unsigned char* rgba = KTerm_Snap_GetBytes(r, 4);
+        if (rgba) c->value.rgb = (RGB_KTermColor){ rgba[0], rgba[1], rgba[2], rgba[3] };
+    }
+}
+
+static bool KTerm_Snap_SameAttr(const EnhancedTermChar* a, const EnhancedTermChar* b) {
+    return ((a->flags ^ b->flags) & ~KTERM_FLAG_DIRTY) == 0 &&
+           memcmp(&a->fg_color, &b->fg_color, sizeof(ExtendedKTermColor)) == 0 &&
+           memcmp(&a->bg_color, &b->bg_color, sizeof(ExtendedKTermColor)) == 0 &&
+           memcmp(&a->ul_color, &b->ul_color, sizeof(ExtendedKTermColor)) == 0 &&
+           memcmp(&a->st_color, &b->st_color, sizeof(ExtendedKTermColor)) == 0;
+}
+
+static bool KTerm_Snap_IsBlank(const EnhancedTermChar* cell) {
+    return cell->ch == ' ' && KTerm_Snap_SameAttr(cell, &kterm_snap_blank);
+}
+
+static void KTerm_Snap_PutRun(KTermSnapWriter* w, const EnhancedTermChar* cells, int count, bool fill, bool attr) {
+    KTerm_Snap_PutVarint(w, ((uint64_t)count << 2) | (fill ? 2 : 0) | (attr ? 1 : 0));
+    if (attr) {
+        KTerm_Snap_PutVarint(w, cells->flags & ~KTERM_FLAG_DIRTY);
+        KTerm_Snap_PutColor(w, &cells->fg_color);
+        KTerm_Snap_PutColor(w, &cells->bg_color);
+        KTerm_Snap_PutColor(w, &cells->ul_color);
+        KTerm_Snap_PutColor(w, &cells->st_color);
+    }
+    if (fill) {
+        KTerm_Snap_PutVarint(w, cells->ch);
+    } else {
+        for (int i = 0; i < count; i++) KTerm_Snap_PutVarint(w, cells[i].ch);
+    }
+}
+
+static void KTerm_Snap_PutRow(KTermSnapWriter* w, const EnhancedTermChar* row, int cols) {
+    int used = cols;
+    while (used > 0 && KTerm_Snap_IsBlank(&row[used - 1])) used--;
+    if (used == 0) {
+        KTerm_Snap_PutU8(w, KTERM_SNAP_ROW_BLANK);
+        return;
+    }
+
+    KTerm_Snap_PutU8(w, KTERM_SNAP_ROW_CELLS);
+    KTerm_Snap_PutVarint(w, (uint64_t)used);
+    const EnhancedTermChar* attr = &kterm_snap_blank;
+    int x = 0;
+    while (x < used) {
+        int end = x + 1;
+        while (end < used && KTerm_Snap_SameAttr(&row[end], &row[x])) end++;
+        bool new_attr = !KTerm_Snap_SameAttr(&row[x], attr);
+        attr = &row[x];
+
+        // Split the attribute run into literal stretches and fills
+        int lit = x;
+        int i = x;
+        while (i < end) {
+            int rep = 1;
+            while (i + rep < end && row[i + rep].ch == row[i].ch) rep++;
+            if (rep >= KTERM_SNAP_MIN_FILL) {
+                if (i > lit) {
+                    KTerm_Snap_PutRun(w, &row[lit], i - lit, false, new_attr);
+                    new_attr = false;
+                }
+                KTerm_Snap_PutRun(w, &row[i], rep, true, new_attr);
+                new_attr = false;
+                lit = i + rep;
+            }
+            i += rep;
+        }
+        if (end > lit) KTerm_Snap_PutRun(w, &row[lit], end - lit, false, new_attr);
+        x = end;
+    }
+}
+
+// Decodes one row (after its opcode) into row[0..cols), which must already hold blanks
+static void KTerm_Snap_GetRowCells(KTermSnapReader* r, EnhancedTermChar* row, int cols) {
+    uint64_t used = KTerm_Snap_GetVarint(r);
+    if (used == 0 || used > (uint64_t)cols) {
+        r->failed = true;
+        return;
+    }
+    EnhancedTermChar attr = kterm_snap_blank;
+    int x = 0;
+    while (!r->failed && (uint64_t)x < used) {
+        uint64_t header = KTerm_Snap_GetVarint(r);
+        uint64_t count = header >> 2;
+        if (count == 0 || count > used - (uint64_t)x) {
+            r->failed = true;
+            return;
+        }
+        if (header & 1) {
+            attr.flags = (uint32_t)KTerm_Snap_GetVarint(r);
+            KTerm_Snap_GetColor(r, &attr.fg_color);
+            KTerm_Snap_GetColor(r, &attr.bg_color);
+            KTerm_Snap_GetColor(r, &attr.ul_color);
+            KTerm_Snap_GetColor(r, &attr.st_color);
+        }
+        attr.flags |= KTERM_FLAG_DIRTY;
+        unsigned int ch = (header & 2) ? (unsigned int)KTerm_Snap_GetVarint(r) : 0;
+        for (uint64_t i = 0; i < count; i++) {
+            row[x] = attr;
+            row[x].ch = (header & 2) ? ch : (unsigned int)KTerm_Snap_GetVarint(r);
+            x++;
+        }
+    }
+}
+
+static uint32_t KTerm_Snap_Hash(const unsigned char* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// Writes `count` rows of a ring buffer, starting at logical row first_y relative to head.
+// Rows whose encoding matches a recent row are written as a copy of it.
+static void KTerm_Snap_PutGrid(KTermSnapWriter* w, const EnhancedTermChar* buf, int head, int height, int cols, int first_y, int count) {
+    KTerm_Snap_PutVarint(w, (uint64_t)cols);
+    KTerm_Snap_PutVarint(w, (uint64_t)count);
+
+    int slots = 64;
+    while (slots < count * 2) slots *= 2;
+    int* table = (int*)KTerm_Malloc((size_t)slots * sizeof(int));
+    size_t* row_off = (size_t*)KTerm_Malloc((size_t)count * sizeof(size_t));
+    size_t* row_len = (size_t*)KTerm_Malloc((size_t)count * sizeof(size_t));
+    uint32_t* row_hash = (uint32_t*)KTerm_Malloc((size_t)count * sizeof(uint32_t));
+    KTermSnapWriter scratch = {0};
+    if (!table || !row_off || !row_len || !row_hash) {
+        w->failed = true;
+        goto done;
+    }
+    for (int i = 0; i < slots; i++) table[i] = -1;
+
+    for (int k = 0; k < count && !w->failed; k++) {
+        int idx = (head + first_y + k) % height;
+        if (idx < 0) idx += height;
+        scratch.len = 0;
+        KTerm_Snap_PutRow(&scratch, &buf[(size_t)idx * cols], cols);
+        if (scratch.failed) {
+            w->failed = true;
+            break;
+        }
+        if (scratch.len == 1) { // Blank rows are already one byte
+            KTerm_Snap_PutU8(w, KTERM_SNAP_ROW_BLANK);
+            continue;
+        }
+
+        uint32_t hash = KTerm_Snap_Hash(scratch.data, scratch.len);
+        int slot = (int)(hash & (uint32_t)(slots - 1));
+        while (table[slot] >= 0) {
+            int prev = table[slot];
+            if (row_hash[prev] == hash && row_len[prev] == scratch.len &&
+                memcmp(w->data + row_off[prev], scratch.data, scratch.len) == 0) break;
+            slot = (slot + 1) & (slots - 1);
+        }
+
+        int prev = table[slot];
+        row_hash[k] = hash;
+        row_len[k] = scratch.len;
+        if (prev >= 0 && k - prev <= KTERM_SNAP_COPY_WINDOW) {
+            row_off[k] = row_off[prev]; // Later copies point at the nearest occurrence
+            KTerm_Snap_PutU8(w, KTERM_SNAP_ROW_COPY);
+            KTerm_Snap_PutVarint(w, (uint64_t)(k - prev));
+        } else {
+            row_off[k] = w->len;
+            KTerm_Snap_PutBytes(w, scratch.data, scratch.len);
+        }
+        table[slot] = k;
+    }
+
+done:
+    if (scratch.data) KTerm_Free(scratch.data);
+    if (table) KTerm_Free(table);
+    if (row_off) KTerm_Free(row_off);
+    if (row_len) KTerm_Free(row_len);
+    if (row_hash) KTerm_Free(row_hash);
+}
+
+// Decodes a grid chunk into a ring of `height` rows so that its last `rows` rows land at
+// indices 0..rows-1 and earlier rows wrap to the end. Returns the number of rows read.
+static int KTerm_Snap_GetGrid(KTermSnapReader* r, EnhancedTermChar* buf, int height, int rows, int cols) {
+    if (KTerm_Snap_GetVarint(r) != (uint64_t)cols) {
+        r->failed = true;
+        return 0;
+    }
+    uint64_t count = KTerm_Snap_GetVarint(r);
+    if (r->failed || count < (uint64_t)rows || count > (uint64_t)INT32_MAX) {
+        r->failed = true;
+        return 0;
+    }
+    int n = (int)count;
+    for (int k = 0; k < n && !r->failed; k++) {
+        int idx = (k - (n - rows)) % height;
+        if (idx < 0) idx += height;
+        EnhancedTermChar* row = &buf[(size_t)idx * cols];
+        for (int x = 0; x < cols; x++) {
+            row[x] = kterm_snap_blank;
+            row[x].flags = KTERM_FLAG_DIRTY;
+        }
+        switch (KTerm_Snap_GetU8(r)) {
+            case KTERM_SNAP_ROW_BLANK:
+                break;
+            case KTERM_SNAP_ROW_COPY: {
+                uint64_t d = KTerm_Snap_GetVarint(r);
+                if (d == 0 || d > (uint64_t)k || d > KTERM_SNAP_COPY_WINDOW || d >= (uint64_t)height) {
+                    r->failed = true;
+                    break;
+                }
+                int src = (idx - (int)d) % height;
+                if (src < 0) src += height;
+                memcpy(row, &buf[(size_t)src * cols], (size_t)cols * sizeof(EnhancedTermChar));
+                break;
+            }
+            case KTERM_SNAP_ROW_CELLS:
+                KTerm_Snap_GetRowCells(r, row, cols);
+                break;
+            default:
+                r->failed = true;
+                break;
+        }
+    }
+    return n;
+}
+
+// --- Session State ---
+
+// gl/gr point into a CharsetState's own g0..g3; snapshots store the slot number
+static int KTerm_Snap_CharsetSlot(const CharsetState* base, const CharacterSet* p) {
+    if (p == &base->g1) return 1;
+    if (p == &base->g2) return 2;
+    if (p == &base->g3) return 3;
+    return 0;
+}
+
+static CharacterSet* KTerm_Snap_CharsetPtr(CharsetState* base, int slot) {
+    switch (slot) {
+        case 1: return &base->g1;
+        case 2: return &base->g2;
+        case 3: return &base->g3;
+        default: return &base->g0;
+    }
+}
+
+static void KTerm_Snap_PutCharset(KTermSnapWriter* w, const CharsetState* cs, const CharsetState* base) {
+    KTerm_Snap_PutU8(w, (uint8_t)cs->g0);
+    KTerm_Snap_PutU8(w, (uint8_t)cs->g1);
+    KTerm_Snap_PutU8(w, (uint8_t)cs->g2);
+    KTerm_Snap_PutU8(w, (uint8_t)cs->g3);
+    KTerm_Snap_PutU8(w, (uint8_t)KTerm_Snap_CharsetSlot(base, cs->gl));
+    KTerm_Snap_PutU8(w, (uint8_t)KTerm_Snap_CharsetSlot(base, cs->gr));
+    KTerm_Snap_PutU8(w, cs->single_shift_2);
+    KTerm_Snap_PutU8(w, cs->single_shift_3);
+}
+
+// Decodes a charset; gl/gr are returned as slot numbers to be resolved once it is in place
+static void KTerm_Snap_GetCharset(KTermSnapReader* r, CharsetState* cs, int* gl, int* gr) {
+    CharacterSet* g[4] = { &cs->g0, &cs->g1, &cs->g2, &cs->g3 };
+    for (int i = 0; i < 4; i++) {
+        uint8_t v = KTerm_Snap_GetU8(r);
+        if (v >= CHARSET_COUNT) r->failed = true;
+        *g[i] = (CharacterSet)v;
+    }
+    *gl = KTerm_Snap_GetU8(r) & 3;
+    *gr = KTerm_Snap_GetU8(r) & 3;
+    cs->single_shift_2 = KTerm_Snap_GetU8(r) != 0;
+    cs->single_shift_3 = KTerm_Snap_GetU8(r) != 0;
+}
+
+typedef struct {
+    int cols, rows;
+    int view_offset, saved_view_offset;
+    EnhancedCursor cursor;
+    int scroll_top, scroll_bottom;
+    int left_margin, right_margin;
+    int lines_per_page;
+    DECModes dec_modes;
+    ANSIModes ansi_modes;
+    ExtendedKTermColor fg, bg, ul, st;
+    uint32_t attributes;
+    CharsetState charset;
+    int gl, gr;
+    bool saved_cursor_valid;
+    SavedCursorState saved_cursor;
+    int saved_gl, saved_gr;
+    VTLevel level;
+    VTFeatures features;
+    MouseTrackingMode mouse_mode;
+    bool mouse_enabled, focus_tracking, sgr_mode;
+    bool bracketed_paste;
+    KTermHomeMode home_mode;
+    bool skip_protect;
+    bool enable_wide_chars;
+    uint32_t conceal_char_code;
+} KTermSnapMeta;
+
+static void KTerm_Snap_PutMeta(KTermSnapWriter* w, const KTermSession* s) {
+    KTerm_Snap_PutInt(w, s->cols);
+    KTerm_Snap_PutInt(w, s->rows);
+    KTerm_Snap_PutInt(w, s->view_offset);
+    KTerm_Snap_PutInt(w, s->saved_view_offset);
+    KTerm_Snap_PutInt(w, s->cursor.x);
+    KTerm_Snap_PutInt(w, s->cursor.y);
+    KTerm_Snap_PutInt(w, s->cursor.visible);
+    KTerm_Snap_PutInt(w, s->cursor.blink_enabled);
+    KTerm_Snap_PutInt(w, s->cursor.shape);
+    KTerm_Snap_PutColor(w, &s->cursor.color);
+    KTerm_Snap_PutInt(w, s->scroll_top);
+    KTerm_Snap_PutInt(w, s->scroll_bottom);
+    KTerm_Snap_PutInt(w, s->left_margin);
+    KTerm_Snap_PutInt(w, s->right_margin);
+    KTerm_Snap_PutInt(w, s->lines_per_page);
+    KTerm_Snap_PutU32(w, s->dec_modes);
+    KTerm_Snap_PutInt(w, s->ansi_modes.insert_replace);
+    KTerm_Snap_PutInt(w, s->ansi_modes.line_feed_new_line);
+    KTerm_Snap_PutColor(w, &s->current_fg);
+    KTerm_Snap_PutColor(w, &s->current_bg);
+    KTerm_Snap_PutColor(w, &s->current_ul_color);
+    KTerm_Snap_PutColor(w, &s->current_st_color);
+    KTerm_Snap_PutU32(w, s->current_attributes);
+    KTerm_Snap_PutCharset(w, &s->charset, &s->charset);
+    KTerm_Snap_PutInt(w, s->saved_cursor_valid);
+    KTerm_Snap_PutInt(w, s->saved_cursor.x);
+    KTerm_Snap_PutInt(w, s->saved_cursor.y);
+    KTerm_Snap_PutInt(w, s->saved_cursor.origin_mode);
+    KTerm_Snap_PutInt(w, s->saved_cursor.auto_wrap_mode);
+    KTerm_Snap_PutColor(w, &s->saved_cursor.fg_color);
+    KTerm_Snap_PutColor(w, &s->saved_cursor.bg_color);
+    KTerm_Snap_PutU32(w, s->saved_cursor.attributes);
+    KTerm_Snap_PutCharset(w, &s->saved_cursor.charset, &s->charset); // DECSC copies pointers into the live charset
+    KTerm_Snap_PutInt(w, s->conformance.level);
+    KTerm_Snap_PutU32(w, s->conformance.features);
+    KTerm_Snap_PutInt(w, s->mouse.mode);
+    KTerm_Snap_PutInt(w, s->mouse.enabled);
+    KTerm_Snap_PutInt(w, s->mouse.focus_tracking);
+    KTerm_Snap_PutInt(w, s->mouse.sgr_mode);
+    KTerm_Snap_PutInt(w, s->bracketed_paste.enabled);
+    KTerm_Snap_PutInt(w, s->home_mode);
+    KTerm_Snap_PutInt(w, s->skip_protect);
+    KTerm_Snap_PutInt(w, s->enable_wide_chars);
+    KTerm_Snap_PutVarint(w, s->conceal_char_code);
+}
+
+static void KTerm_Snap_GetMeta(KTermSnapReader* r, KTermSnapMeta* m) {
+    memset(m, 0, sizeof(*m));
+    m->cols = KTerm_Snap_GetRange(r, 1, KTERM_SNAP_MAX_DIM);
+    m->rows = KTerm_Snap_GetRange(r, 1, KTERM_SNAP_MAX_DIM);
+    m->view_offset = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    m->saved_view_offset = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    m->cursor.x = KTerm_Snap_GetClamped(r, 0, m->cols); // x == cols while a wrap is pending
+    m->cursor.y = KTerm_Snap_GetClamped(r, 0, m->rows - 1);
+    m->cursor.visible = KTerm_Snap_GetBool(r);
+    m->cursor.blink_enabled = KTerm_Snap_GetBool(r);
+    m->cursor.shape = (CursorShape)KTerm_Snap_GetRange(r, CURSOR_BLOCK, CURSOR_BAR_BLINK);
+    KTerm_Snap_GetColor(r, &m->cursor.color);
+    m->scroll_top = KTerm_Snap_GetClamped(r, 0, m->rows - 1);
+    m->scroll_bottom = KTerm_Snap_GetClamped(r, 0, m->rows - 1);
+    m->left_margin = KTerm_Snap_GetClamped(r, 0, m->cols - 1);
+    m->right_margin = KTerm_Snap_GetClamped(r, 0, m->cols - 1);
+    m->lines_per_page = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    m->dec_modes = KTerm_Snap_GetU32(r);
+    m->ansi_modes.insert_replace = KTerm_Snap_GetBool(r);
+    m->ansi_modes.line_feed_new_line = KTerm_Snap_GetBool(r);
+    KTerm_Snap_GetColor(r, &m->fg);
+    KTerm_Snap_GetColor(r, &m->bg);
+    KTerm_Snap_GetColor(r, &m->ul);
+    KTerm_Snap_GetColor(r, &m->st);
+    m->attributes = KTerm_Snap_GetU32(r);
+    KTerm_Snap_GetCharset(r, &m->charset, &m->gl, &m->gr);
+    m->saved_cursor_valid = KTerm_Snap_GetBool(r);
+    m->saved_cursor.x = KTerm_Snap_GetClamped(r, 0, m->cols);
+    m->saved_cursor.y = KTerm_Snap_GetClamped(r, 0, m->rows - 1);
+    m->saved_cursor.origin_mode = KTerm_Snap_GetBool(r);
+    m->saved_cursor.auto_wrap_mode = KTerm_Snap_GetBool(r);
+    KTerm_Snap_GetColor(r, &m->saved_cursor.fg_color);
+    KTerm_Snap_GetColor(r, &m->saved_cursor.bg_color);
+    m->saved_cursor.attributes = KTerm_Snap_GetU32(r);
+    KTerm_Snap_GetCharset(r, &m->saved_cursor.charset, &m->saved_gl, &m->saved_gr);
+    m->level = (VTLevel)KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    m->features = KTerm_Snap_GetU32(r);
+    m->mouse_mode = (MouseTrackingMode)KTerm_Snap_GetRange(r, MOUSE_TRACKING_OFF, MOUSE_TRACKING_PIXEL);
+    m->mouse_enabled = KTerm_Snap_GetBool(r);
+    m->focus_tracking = KTerm_Snap_GetBool(r);
+    m->sgr_mode = KTerm_Snap_GetBool(r);
+    m->bracketed_paste = KTerm_Snap_GetBool(r);
+    m->home_mode = (KTermHomeMode)KTerm_Snap_GetRange(r, HOME_MODE_ABSOLUTE, HOME_MODE_LAST_FOCUSED);
+    m->skip_protect = KTerm_Snap_GetBool(r);
+    m->enable_wide_chars = KTerm_Snap_GetBool(r);
+    m->conceal_char_code = (uint32_t)KTerm_Snap_GetVarint(r);
+}
+
+// Applies everything in a decoded META chunk except the dimensions, the screen modes
+// (which decide the buffer layout) and the scrollback offsets
+static void KTerm_Snap_ApplyMeta(KTermSession* session, const KTermSnapMeta* meta) {
+    session->cursor.x = meta->cursor.x;
+    session->cursor.y = meta->cursor.y;
+    session->cursor.visible = meta->cursor.visible;
+    session->cursor.blink_enabled = meta->cursor.blink_enabled;
+    session->cursor.shape = meta->cursor.shape;
+    session->cursor.color = meta->cursor.color;
+    session->scroll_top = meta->scroll_top;
+    session->scroll_bottom = meta->scroll_bottom;
+    session->left_margin = meta->left_margin;
+    session->right_margin = meta->right_margin;
+    session->lines_per_page = meta->lines_per_page;
+    session->ansi_modes = meta->ansi_modes;
+    session->current_fg = meta->fg;
+    session->current_bg = meta->bg;
+    session->current_ul_color = meta->ul;
+    session->current_st_color = meta->st;
+    session->current_attributes = meta->attributes;
+    session->charset = meta->charset;
+    session->charset.gl = KTerm_Snap_CharsetPtr(&session->charset, meta->gl);
+    session->charset.gr = KTerm_Snap_CharsetPtr(&session->charset, meta->gr);
+    session->saved_cursor_valid = meta->saved_cursor_valid;
+    session->saved_cursor = meta->saved_cursor;
+    session->saved_cursor.charset.gl = KTerm_Snap_CharsetPtr(&session->charset, meta->saved_gl);
+    session->saved_cursor.charset.gr = KTerm_Snap_CharsetPtr(&session->charset, meta->saved_gr);
+    session->conformance.level = meta->level;
+    session->conformance.features = meta->features;
+    session->mouse.mode = meta->mouse_mode;
+    session->mouse.enabled = meta->mouse_enabled;
+    session->mouse.focus_tracking = meta->focus_tracking;
+    session->mouse.sgr_mode = meta->sgr_mode;
+    session->bracketed_paste.enabled = meta->bracketed_paste;
+    session->home_mode = meta->home_mode;
+    session->skip_protect = meta->skip_protect;
+    session->enable_wide_chars = meta->enable_wide_chars;
+    session->conceal_char_code = meta->conceal_char_code;
+}
+
+static void KTerm_Snap_PutTabs(KTermSnapWriter* w, const KTermSession* s) {
+    KTerm_Snap_PutInt(w, s->tab_stops.default_width);
+    int n = s->tab_stops.capacity < s->cols ? s->tab_stops.capacity : s->cols;
+    KTerm_Snap_PutInt(w, n);
+    for (int i = 0; i < n; i += 8) {
+        uint8_t bits = 0;
+        for (int b = 0; b < 8 && i + b < n; b++) {
+            if (s->tab_stops.stops[i + b]) bits |= (uint8_t)(1 << b);
+        }
+        KTerm_Snap_PutU8(w, bits);
+    }
+}
+
+// Decodes tab stops into stops[0..cols), which must be zeroed; returns the default width
+static int KTerm_Snap_GetTabs(KTermSnapReader* r, bool* stops, int cols) {
+    int tab_width = KTerm_Snap_GetRange(r, 1, KTERM_SNAP_MAX_DIM);
+    int n = KTerm_Snap_GetRange(r, 0, cols);
+    for (int i = 0; i < n && !r->failed; i += 8) {
+        uint8_t bits = KTerm_Snap_GetU8(r);
+        for (int b = 0; b < 8 && i + b < n; b++) stops[i + b] = (bits >> b) & 1;
+    }
+    return tab_width;
+}
+
+// Takes ownership of stops, which has one entry per column
+static void KTerm_Snap_SetTabs(KTermSession* session, bool* stops, int cols, int tab_width) {
+    if (session->tab_stops.stops) KTerm_Free(session->tab_stops.stops);
+    session->tab_stops.stops = stops;
+    session->tab_stops.capacity = cols;
+    session->tab_stops.default_width = tab_width;
+    session->tab_stops.count = 0;
+    for (int i = 0; i < cols; i++) {
+        if (stops[i]) session->tab_stops.count++;
+    }
+}
+
+static void KTerm_Snap_PutTitles(KTermSnapWriter* w, const KTermSession* s) {
+    KTerm_Snap_PutString(w, s->title.window_title, MAX_TITLE_LENGTH);
+    KTerm_Snap_PutString(w, s->title.icon_title, MAX_TITLE_LENGTH);
+}
+
+static void KTerm_Snap_SetTitles(KTermSession* session, const char* window_title, const char* icon_title) {
+    memcpy(session->title.window_title, window_title, MAX_TITLE_LENGTH);
+    memcpy(session->title.icon_title, icon_title, MAX_TITLE_LENGTH);
+    session->title.title_changed = true;
+    session->title.icon_changed = true;
+}
+
+// --- Graphics ---
+
+static void KTerm_Snap_PutPalette(KTermSnapWriter* w, const RGB_KTermColor* palette) {
+    for (int i = 0; i < 256; i++) {
+        unsigned char rgba[4] = { palette[i].r, palette[i].g, palette[i].b, palette[i].a };
+        KTerm_Snap_PutBytes(w, rgba, 4);
+    }
+}
+
+static void KTerm_Snap_GetPalette(KTermSnapReader* r, RGB_KTermColor* palette) {
+    const unsigned char* p = KTerm_Snap_GetBytes(r, 256 * 4);
+    if (!p) return;
+    for (int i = 0; i < 256; i++) palette[i] = (RGB_KTermColor){ p[i * 4], p[i * 4 + 1], p[i * 4 + 2], p[i * 4 + 3] };
+}
+
+static void KTerm_Snap_PutSixel(KTermSnapWriter* w, const KTermSession* s) {
+    const SixelGraphics* sx = &s->sixel;
+    KTerm_Snap_PutInt(w, sx->width);
+    KTerm_Snap_PutInt(w, sx->height);
+    KTerm_Snap_PutInt(w, sx->x);
+    KTerm_Snap_PutInt(w, sx->y);
+    KTerm_Snap_PutInt(w, sx->active);
+    KTerm_Snap_PutInt(w, sx->scrolling);
+    KTerm_Snap_PutInt(w, sx->transparent_bg);
+    KTerm_Snap_PutInt(w, s->screen_head - sx->logical_start_row); // Rows scrolled since the image was drawn
+    KTerm_Snap_PutPalette(w, sx->palette);
+    KTerm_Snap_PutVarint(w, sx->strip_count);
+    for (size_t i = 0; i < sx->strip_count; i++) {
+        KTerm_Snap_PutVarint(w, sx->strips[i].x);
+        KTerm_Snap_PutVarint(w, sx->strips[i].y);
+        KTerm_Snap_PutVarint(w, sx->strips[i].pattern);
+        KTerm_Snap_PutVarint(w, sx->strips[i].color_index);
+    }
+}
+
+typedef struct {
+    int width, height, x, y;
+    bool active, scrolling, transparent_bg;
+    int scrolled;
+    RGB_KTermColor palette[256];
+    GPUSixelStrip* strips;
+    size_t strip_count;
+} KTermSnapSixel;
+
+static void KTerm_Snap_GetSixel(KTermSnapReader* r, KTermSnapSixel* sx) {
+    sx->width = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    sx->height = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+    sx->x = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+    sx->y = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+    sx->active = KTerm_Snap_GetBool(r);
+    sx->scrolling = KTerm_Snap_GetBool(r);
+    sx->transparent_bg = KTerm_Snap_GetBool(r);
+    sx->scrolled = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+    KTerm_Snap_GetPalette(r, sx->palette);
+    uint64_t count = KTerm_Snap_GetVarint(r);
+    if (r->failed || count > (r->len - r->pos) / 4) { // Each strip takes at least four bytes
+        r->failed = true;
+        return;
+    }
+    if (count == 0) return;
+    sx->strips = (GPUSixelStrip*)KTerm_Malloc((size_t)count * sizeof(GPUSixelStrip));
+    if (!sx->strips) {
+        r->failed = true;
+        return;
+    }
+    sx->strip_count = (size_t)count;
+    for (size_t i = 0; i < sx->strip_count; i++) {
+        sx->strips[i].x = (uint32_t)KTerm_Snap_GetVarint(r);
+        sx->strips[i].y = (uint32_t)KTerm_Snap_GetVarint(r);
+        sx->strips[i].pattern = (uint32_t)KTerm_Snap_GetVarint(r);
+        sx->strips[i].color_index = (uint32_t)KTerm_Snap_GetVarint(r);
+    }
+}
+
+static int KTerm_Snap_KittyImageCount(const KittyGraphics* kitty) {
+    int n = 0;
+    for (int i = 0; i < kitty->image_count; i++) {
+        if (kitty->images[i].complete) n++;
+    }
+    return n;
+}
+
+// Stores completed images with their frames; textures are recreated on the next render
+static void KTerm_Snap_PutKitty(KTermSnapWriter* w, const KTermSession* s) {
+    const KittyGraphics* kitty = &s->kitty;
+    KTerm_Snap_PutVarint(w, (uint64_t)KTerm_Snap_KittyImageCount(kitty));
+    for (int i = 0; i < kitty->image_count; i++) {
+        const KittyImageBuffer* img = &kitty->images[i];
+        if (!img->complete) continue;
+        KTerm_Snap_PutVarint(w, img->id);
+        KTerm_Snap_PutInt(w, img->x);
+        KTerm_Snap_PutInt(w, img->y);
+        KTerm_Snap_PutInt(w, img->z_index);
+        KTerm_Snap_PutInt(w, (s->screen_head - img->start_row + s->buffer_height) % s->buffer_height);
+        KTerm_Snap_PutInt(w, img->visible);
+        KTerm_Snap_PutInt(w, img->current_frame);
+        KTerm_Snap_PutVarint(w, (uint64_t)img->frame_count);
+        for (int f = 0; f < img->frame_count; f++) {
+            const KittyFrame* frame = &img->frames[f];
+            size_t size = frame->data ? frame->size : 0;
+            KTerm_Snap_PutInt(w, frame->width);
+            KTerm_Snap_PutInt(w, frame->height);
+            KTerm_Snap_PutInt(w, frame->delay_ms);
+            KTerm_Snap_PutVarint(w, size);
+            KTerm_Snap_PutBytes(w, frame->data, size);
+        }
+    }
+}
+
+static void KTerm_Snap_FreeKittyImages(KittyImageBuffer* images, int count) {
+    if (!images) return;
+    for (int k = 0; k < count; k++) {
+        if (!images[k].frames) continue;
+        for (int f = 0; f < images[k].frame_count; f++) {
+            if (images[k].frames[f].data) KTerm_Free(images[k].frames[f].data);
+            if (images[k].frames[f].texture.slot_index != 0) KTerm_DestroyTexture(&images[k].frames[f].texture);
+        }
+        KTerm_Free(images[k].frames);
+    }
+    KTerm_Free(images);
+}
+
+// Each image and frame takes at least this many bytes, which bounds counts before allocating
+#define KTERM_SNAP_KITTY_MIN_BYTES 4
+
+static KittyImageBuffer* KTerm_Snap_GetKitty(KTermSnapReader* r, int* out_count, size_t* out_bytes) {
+    *out_count = 0;
+    *out_bytes = 0;
+    uint64_t count = KTerm_Snap_GetVarint(r);
+    if (r->failed || count == 0 || count > (r->len - r->pos) / KTERM_SNAP_KITTY_MIN_BYTES) {
+        if (count) r->failed = true;
+        return NULL;
+    }
+    KittyImageBuffer* images = (KittyImageBuffer*)KTerm_Calloc((size_t)count, sizeof(KittyImageBuffer));
+    if (!images) {
+        r->failed = true;
+        return NULL;
+    }
+    int n = 0;
+    size_t bytes = 0;
+    for (; n < (int)count && !r->failed; n++) {
+        KittyImageBuffer* img = &images[n];
+        img->id = (uint32_t)KTerm_Snap_GetVarint(r);
+        img->x = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+        img->y = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+        img->z_index = KTerm_Snap_GetRange(r, INT32_MIN, INT32_MAX);
+        img->start_row = KTerm_Snap_GetRange(r, 0, INT32_MAX); // Rows scrolled; made absolute on commit
+        img->visible = KTerm_Snap_GetBool(r);
+        img->current_frame = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+        img->complete = true;
+        uint64_t frames = KTerm_Snap_GetVarint(r);
+        if (r->failed || frames > (r->len - r->pos) / KTERM_SNAP_KITTY_MIN_BYTES) {
+            r->failed = true;
+            break;
+        }
+        if (frames == 0) continue;
+        img->frames = (KittyFrame*)KTerm_Calloc((size_t)frames, sizeof(KittyFrame));
+        if (!img->frames) {
+            r->failed = true;
+            break;
+        }
+        img->frame_capacity = (int)frames;
+        for (int f = 0; f < (int)frames && !r->failed; f++) {
+            KittyFrame* frame = &img->frames[f];
+            frame->width = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+            frame->height = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+            frame->delay_ms = KTerm_Snap_GetRange(r, 0, INT32_MAX);
+            size_t size = (size_t)KTerm_Snap_GetVarint(r);
+            const unsigned char* data = KTerm_Snap_GetBytes(r, size);
+            img->frame_count = f + 1;
+            if (!data || size == 0) continue;
+            frame->data = (unsigned char*)KTerm_Malloc(size);
+            if (!frame->data) {
+                r->failed = true;
+                break;
+            }
+            memcpy(frame->data, data, size);
+            frame->size = size;
+            frame->capacity = size;
+            bytes += size;
+        }
+        if (img->current_frame >= img->frame_count) img->current_frame = 0;
+    }
+    if (r->failed) {
+        KTerm_Snap_FreeKittyImages(images, (int)count); // Unread entries are still zeroed
+        return NULL;
+    }
+    *out_count = n;
+    *out_bytes = bytes;
+    return images;
+}
+
+// --- Snapshot ---
 
+// Without main_grid the GRID chunk is left out (mapped snapshots store it separately)
+static bool KTerm_SerializeSessionV2(KTerm* term, KTermSession* session, bool main_grid, void** out_buf, size_t* out_len) {
+    if (!session || !out_buf || !out_len || !session->screen_buffer) return false;
+    if (term) KTerm_FlushOps(term, session);
+    KTerm_ReflowHistory(session, MAX_SCROLLBACK_LINES); // Scrollback still deferred by a resize
+
+    KTermSnapWriter w = {0};
+    KTerm_Snap_PutBytes(&w, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN);
+
+    size_t at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_META);
+    KTerm_Snap_PutMeta(&w, session);
+    KTerm_Snap_EndChunk(&w, at);
+
+    // While the alternate screen is up the two buffers are swapped
+    bool alt_active = (session->dec_modes & KTERM_MODE_ALTSCREEN) != 0;
+    const EnhancedTermChar* main_buf = alt_active ? session->alt_buffer : session->screen_buffer;
+    int main_head = alt_active ? session->alt_screen_head : session->screen_head;
+    int main_height = alt_active ? session->rows + MAX_SCROLLBACK_LINES : session->buffer_height;
+    const EnhancedTermChar* alt_buf = alt_active ? session->screen_buffer : session->alt_buffer;
+    int alt_head = alt_active ? session->screen_head : session->alt_screen_head;
+    int alt_height = alt_active ? session->buffer_height : session->rows;
+
+    int history = session->history_rows_populated;
+    if (history > main_height - session->rows) history = main_height - session->rows;
+    if (history < 0) history = 0;
+
+    if (main_buf && main_grid) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_GRID);
+        KTerm_Snap_PutGrid(&w, main_buf, main_head, main_height, session->cols, -history, history + session->rows);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+    if (alt_buf) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_ALTG);
+        KTerm_Snap_PutGrid(&w, alt_buf, alt_head, alt_height, session->cols, 0, session->rows);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+
+    if (session->tab_stops.stops) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_TABS);
+        KTerm_Snap_PutTabs(&w, session);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+
+    at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_TITL);
+    KTerm_Snap_PutTitles(&w, session);
+    KTerm_Snap_EndChunk(&w, at);
+
+    if (term) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_PALT);
+        KTerm_Snap_PutPalette(&w, term->color_palette);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+
+    if (session->sixel.strips && session->sixel.strip_count > 0) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_SIXL);
+        KTerm_Snap_PutSixel(&w, session);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+
+    if (session->kitty.images && KTerm_Snap_KittyImageCount(&session->kitty) > 0) {
+        at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_KITY);
+        KTerm_Snap_PutKitty(&w, session);
+        KTerm_Snap_EndChunk(&w, at);
+    }
+
+    at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_END);
+    KTerm_Snap_EndChunk(&w, at);
+
+    if (w.failed) {
+        if (w.data) KTerm_Free(w.data);
+        return false;
+    }
+    *out_buf = w.data;
+    *out_len = w.len;
     return true;
 }
 
+// A main grid supplied in place of a GRID chunk: a ring of rows + MAX_SCROLLBACK_LINES rows
+// in a mapped snapshot, which the session releases through `release`
+typedef struct {
+    EnhancedTermChar* cells;
+    int head;
+    int history;
+    void* map;
+    size_t map_len;
+    void (*release)(void* map, size_t len);
+} KTermSnapMappedGrid;
+
+// With keep_size set, a session whose dimensions differ from the snapshot's is resized
+// back to its own afterwards; otherwise it keeps the snapshot's.
+static bool KTerm_DeserializeSessionV2(KTerm* term, KTermSession* session, const unsigned char* data, size_t len, bool keep_size, const KTermSnapMappedGrid* mapped) {
+    // Locate the chunks; only the first of each known tag is used
+    KTermSnapReader meta_r = {0}, grid_r = {0}, alt_r = {0}, tabs_r = {0}, title_r = {0}, pal_r = {0}, sixel_r = {0}, kitty_r = {0};
+    KTermSnapReader r = { data, len, KTERM_SERIALIZE_MAGIC_LEN, false };
+    bool ended = false;
+    while (!ended) {
+        uint32_t tag = KTerm_Snap_GetU32(&r);
+        uint32_t n = KTerm_Snap_GetU32(&r);
+        const unsigned char* payload = KTerm_Snap_GetBytes(&r, n);
+        if (r.failed) return false;
+        KTermSnapReader chunk = { payload, n, 0, false };
+        KTermSnapReader* slot = NULL;
+        switch (tag) {
+            case KTERM_SNAP_META: slot = &meta_r; break;
+            case KTERM_SNAP_GRID: slot = &grid_r; break;
+            case KTERM_SNAP_ALTG: slot = &alt_r; break;
+            case KTERM_SNAP_TABS: slot = &tabs_r; break;
+            case KTERM_SNAP_TITL: slot = &title_r; break;
+            case KTERM_SNAP_PALT: slot = &pal_r; break;
+            case KTERM_SNAP_SIXL: slot = &sixel_r; break;
+            case KTERM_SNAP_KITY: slot = &kitty_r; break;
+            case KTERM_SNAP_END: ended = true; break;
+            default: break;
+        }
+        if (slot && !slot->data) *slot = chunk;
+    }
+    if (!meta_r.data || (!grid_r.data && !mapped)) return false;
+
+    // Decode everything into new storage first so that a bad snapshot leaves the session alone
+    KTermSnapMeta meta;
+    KTerm_Snap_GetMeta(&meta_r, &meta);
+    if (meta_r.failed) return false;
+
+    int cols = meta.cols;
+    int rows = meta.rows;
+    int main_height = rows + MAX_SCROLLBACK_LINES;
+    EnhancedTermChar* main_buf = mapped ? mapped->cells : (EnhancedTermChar*)KTerm_Calloc((size_t)main_height * cols, sizeof(EnhancedTermChar));
+    EnhancedTermChar* alt_buf = (EnhancedTermChar*)KTerm_Calloc((size_t)rows * cols, sizeof(EnhancedTermChar));
+    uint8_t* row_dirty = (uint8_t*)KTerm_Calloc((size_t)rows, sizeof(uint8_t));
+    bool* stops = (bool*)KTerm_Calloc((size_t)cols, sizeof(bool));
+    KTermSnapSixel sixel;
+    memset(&sixel, 0, sizeof(sixel));
+    KittyImageBuffer* images = NULL;
+    int image_count = 0;
+    size_t image_bytes = 0;
+    bool ok = main_buf && alt_buf && row_dirty && stops;
+
+    int history = 0;
+    if (ok && mapped) {
+        history = mapped->history;
+    } else if (ok) {
+        for (size_t i = 0; i < (size_t)main_height * cols; i++) {
+            main_buf[i] = kterm_snap_blank;
+            main_buf[i].flags = KTERM_FLAG_DIRTY;
+        }
+        int n = KTerm_Snap_GetGrid(&grid_r, main_buf, main_height, rows, cols);
+        history = n - rows;
+        if (history > MAX_SCROLLBACK_LINES) history = MAX_SCROLLBACK_LINES; // Older rows were overwritten
+        ok = !grid_r.failed;
+    }
+    if (ok) {
+        for (size_t i = 0; i < (size_t)rows * cols; i++) {
+            alt_buf[i] = kterm_snap_blank;
+            alt_buf[i].flags = KTERM_FLAG_DIRTY;
+        }
+        if (alt_r.data) {
+            if (KTerm_Snap_GetGrid(&alt_r, alt_buf, rows, rows, cols) != rows) alt_r.failed = true;
+            ok = !alt_r.failed;
+        }
+    }
+
+    int tab_width = session->tab_stops.default_width > 0 ? session->tab_stops.default_width : 8;
+    if (ok && tabs_r.data) {
+        tab_width = KTerm_Snap_GetTabs(&tabs_r, stops, cols);
+        ok = !tabs_r.failed;
+    } else if (ok) {
+        for (int i = tab_width; i < cols; i += tab_width) stops[i] = true;
+    }
+
+    char window_title[MAX_TITLE_LENGTH] = {0};
+    char icon_title[MAX_TITLE_LENGTH] = {0};
+    if (ok && title_r.data) {
+        KTerm_Snap_GetString(&title_r, window_title, sizeof(window_title));
+        KTerm_Snap_GetString(&title_r, icon_title, sizeof(icon_title));
+        ok = !title_r.failed;
+    }
+
+    RGB_KTermColor palette[256];
+    if (ok && pal_r.data && term) {
+        KTerm_Snap_GetPalette(&pal_r, palette);
+        ok = !pal_r.failed;
+    }
+    if (ok && sixel_r.data) {
+        KTerm_Snap_GetSixel(&sixel_r, &sixel);
+        ok = !sixel_r.failed;
+    }
+    if (ok && kitty_r.data) {
+        images = KTerm_Snap_GetKitty(&kitty_r, &image_count, &image_bytes);
+        ok = !kitty_r.failed;
+    }
+
+    if (!ok) {
+        if (main_buf && !mapped) KTerm_Free(main_buf);
+        if (alt_buf) KTerm_Free(alt_buf);
+        if (row_dirty) KTerm_Free(row_dirty);
+        if (stops) KTerm_Free(stops);
+        if (sixel.strips) KTerm_Free(sixel.strips);
+        return false;
+    }
+
+    // Commit. Queued grid ops were aimed at the old contents, so they are dropped.
+    KTERM_MUTEX_LOCK(session->op_queue_lock);
+    session->op_queue.head = 0;
+    session->op_queue.tail = 0;
+    session->op_queue.count = 0;
+    KTERM_MUTEX_UNLOCK(session->op_queue_lock);
+
+    int want_cols = session->cols;
+    int want_rows = session->rows;
+
+    KTerm_DropHistoryReflow(session);
+    KTerm_FreeGrid(session, session->screen_buffer);
+    KTerm_FreeGrid(session, session->alt_buffer);
+    if (mapped) {
+        session->grid_map = mapped->map;
+        session->grid_map_len = mapped->map_len;
+        session->grid_map_release = mapped->release;
+    }
+    if (session->row_dirty) KTerm_Free(session->row_dirty);
+
+    session->cols = cols;
+    session->rows = rows;
+    session->dec_modes = meta.dec_modes;
+    if (meta.dec_modes & KTERM_MODE_ALTSCREEN) {
+        session->screen_buffer = alt_buf;
+        session->alt_buffer = main_buf;
+        session->buffer_height = rows;
+        session->view_offset = 0;
+    } else {
+        session->screen_buffer = main_buf;
+        session->alt_buffer = alt_buf;
+        session->buffer_height = main_height;
+        session->view_offset = meta.view_offset > history ? history : meta.view_offset;
+    }
+    int main_head = mapped ? mapped->head : 0;
+    session->screen_head = (meta.dec_modes & KTERM_MODE_ALTSCREEN) ? 0 : main_head;
+    session->alt_screen_head = (meta.dec_modes & KTERM_MODE_ALTSCREEN) ? main_head : 0;
+    session->history_rows_populated = history;
+    session->saved_view_offset = meta.saved_view_offset > history ? history : meta.saved_view_offset;
+    session->row_dirty = row_dirty;
+    for (int i = 0; i < rows; i++) session->row_dirty[i] = KTERM_DIRTY_FRAMES;
+    session->dirty_rect = (KTermRect){0, 0, cols, rows};
+    KTerm_ResetRowGenerations(session);
+
+    KTerm_Snap_ApplyMeta(session, &meta);
+    KTerm_Snap_SetTabs(session, stops, cols, tab_width);
+    if (title_r.data) KTerm_Snap_SetTitles(session, window_title, icon_title);
+
+    if (pal_r.data && term) memcpy(term->color_palette, palette, sizeof(palette));
+
+    if (sixel_r.data) {
+        SixelGraphics* sx = &session->sixel;
+        if (sx->strips) KTerm_Free(sx->strips);
+        sx->strips = sixel.strips;
+        sx->strip_count = sixel.strip_count;
+        sx->strip_capacity = sixel.strip_count;
+        sx->width = sixel.width;
+        sx->height = sixel.height;
+        sx->x = sixel.x;
+        sx->y = sixel.y;
+        sx->active = sixel.active;
+        sx->scrolling = sixel.scrolling;
+        sx->transparent_bg = sixel.transparent_bg;
+        sx->logical_start_row = session->screen_head - sixel.scrolled;
+        memcpy(sx->palette, sixel.palette, sizeof(sx->palette));
+        sx->dirty = true;
+    }
+
+    if (kitty_r.data) {
+        KTerm_Snap_FreeKittyImages(session->kitty.images, session->kitty.image_count);
+        for (int i = 0; i < image_count; i++) {
+            images[i].start_row = ((session->screen_head - images[i].start_row) % session->buffer_height + session->buffer_height) % session->buffer_height;
+        }
+        session->kitty.images = images;
+        session->kitty.image_count = image_count;
+        session->kitty.image_capacity = image_count;
+        session->kitty.current_memory_usage = image_bytes;
+        session->kitty.active_upload = NULL;
+    }
+
+    // A snapshot from another geometry goes through the normal resize path
+    if (keep_size && want_cols > 0 && want_rows > 0 && (want_cols != cols || want_rows != rows)) {
+        KTerm_QueueResize(session, want_cols, want_rows, true);
+        if (term) KTerm_FlushOps(term, session);
+    }
+    return true;
+}
+
+// --- Incremental Checkpoints ---
+//
+// A checkpoint starts with its own 12-byte magic and uses the snapshot chunk layout. CKPT
+// holds the sequence number and a keyframe flag. A keyframe carries a complete snapshot in
+// SNAP. A delta carries META, TABS, TITL and PALT only when their encoding changed, then an
+// MROW (main screen) or AROW (alternate screen) chunk for each screen that changed:
+//   <cols> <scrolled> <count>, then count times <y> <row>
+// The reader first replays `scrolled` full-screen scrolls on the ring, then replaces each
+// listed row. y is relative to the top of the screen (negative in scrollback) and rows use
+// the grid encoding above without copies.
+
+#define KTERM_CHECKPOINT_MAGIC "KTERM_CKP_V1"
+#define KTERM_SNAP_CKPT KTERM_SNAP_TAG('C', 'K', 'P', 'T')
+#define KTERM_SNAP_SNAP KTERM_SNAP_TAG('S', 'N', 'A', 'P')
+#define KTERM_SNAP_MROW KTERM_SNAP_TAG('M', 'R', 'O', 'W')
+#define KTERM_SNAP_AROW KTERM_SNAP_TAG('A', 'R', 'O', 'W')
+
+// One screen's ring buffer and its checkpoint tracking, wherever the swap left them
+typedef struct {
+    EnhancedTermChar* buf;
+    uint32_t** gen;
+    int* head;
+    uint32_t* scrolled;
+    int height;
+} KTermSnapRing;
+
+static KTermSnapRing KTerm_Snap_GetRing(KTermSession* s, bool alt) {
+    KTermSnapRing ring;
+    if (alt == ((s->dec_modes & KTERM_MODE_ALTSCREEN) != 0)) {
+        ring.buf = s->screen_buffer;
+        ring.gen = &s->row_generation;
+        ring.head = &s->screen_head;
+        ring.scrolled = &s->rows_scrolled;
+        ring.height = s->buffer_height;
+    } else {
+        ring.buf = s->alt_buffer;
+        ring.gen = &s->alt_row_generation;
+        ring.head = &s->alt_screen_head;
+        ring.scrolled = &s->alt_rows_scrolled;
+        ring.height = alt ? s->rows : s->rows + MAX_SCROLLBACK_LINES;
+    }
+    return ring;
+}
+
+static int KTerm_Snap_RingIndex(const KTermSnapRing* ring, int y) {
+    int idx = (*ring->head + y) % ring->height;
+    return idx < 0 ? idx + ring->height : idx;
+}
+
+// Swaps the screens as KTerm_SwapScreenBuffer does, for a session without a KTerm
+static void KTerm_Snap_SwapRings(KTermSession* s, bool to_alt) {
+    EnhancedTermChar* buf = s->screen_buffer;
+    s->screen_buffer = s->alt_buffer;
+    s->alt_buffer = buf;
+    int head = s->screen_head;
+    s->screen_head = s->alt_screen_head;
+    s->alt_screen_head = head;
+    uint32_t* gen = s->row_generation;
+    s->row_generation = s->alt_row_generation;
+    s->alt_row_generation = gen;
+    uint32_t scrolled = s->rows_scrolled;
+    s->rows_scrolled = s->alt_rows_scrolled;
+    s->alt_rows_scrolled = scrolled;
+    s->buffer_height = to_alt ? s->rows : s->rows + MAX_SCROLLBACK_LINES;
+}
+
+// Only rows that were on screen since the last checkpoint can have changed: the screen
+// itself and the `scrolled` rows pushed into scrollback.
+static void KTerm_Snap_PutRingDelta(KTermSnapWriter* w, uint32_t tag, const KTermSnapRing* ring, int cols, int rows, int history, uint32_t scrolled, uint32_t since) {
+    const uint32_t* gen = *ring->gen;
+    int first = (uint32_t)history < scrolled ? -history : -(int)scrolled;
+    int count = 0;
+    for (int y = first; y < rows; y++) {
+        if (gen[KTerm_Snap_RingIndex(ring, y)] >= since) count++;
+    }
+    if (count == 0 && scrolled == 0) return;
+
+    size_t at = KTerm_Snap_BeginChunk(w, tag);
+    KTerm_Snap_PutVarint(w, (uint64_t)cols);
+    KTerm_Snap_PutVarint(w, scrolled);
+    KTerm_Snap_PutVarint(w, (uint64_t)count);
+    for (int y = first; y < rows; y++) {
+        int idx = KTerm_Snap_RingIndex(ring, y);
+        if (gen[idx] < since) continue;
+        KTerm_Snap_PutInt(w, y);
+        KTerm_Snap_PutRow(w, &ring->buf[(size_t)idx * cols], cols);
+    }
+    KTerm_Snap_EndChunk(w, at);
+}
+
+// Reads a ring delta. Without commit it only validates, decoding rows into scratch.
+// history is the session's scrollback count for the main screen, NULL for the alternate.
+static bool KTerm_Snap_ApplyRingDelta(KTermSnapReader r, KTermSession* session, const KTermSnapRing* ring, int* history, bool commit, EnhancedTermChar* scratch) {
+    int cols = session->cols;
+    int rows = session->rows;
+    if (KTerm_Snap_GetVarint(&r) != (uint64_t)cols) return false;
+    uint64_t scrolled = KTerm_Snap_GetVarint(&r);
+    uint64_t count = KTerm_Snap_GetVarint(&r);
+    if (r.failed || count > (uint64_t)ring->height) return false;
+
+    uint32_t* gen = *ring->gen;
+    if (commit) {
+        int n = scrolled < (uint64_t)ring->height ? (int)scrolled : ring->height;
+        for (int i = 0; i < n; i++) {
+            *ring->head = (*ring->head + 1) % ring->height;
+            int idx = KTerm_Snap_RingIndex(ring, rows - 1);
+            for (int x = 0; x < cols; x++) {
+                ring->buf[(size_t)idx * cols + x] = kterm_snap_blank;
+                ring->buf[(size_t)idx * cols + x].flags = KTERM_FLAG_DIRTY;
+            }
+            if (gen) gen[idx] = session->grid_generation;
+            if (history && *history < ring->height - rows) (*history)++;
+        }
+        *ring->scrolled += (uint32_t)scrolled;
+    }
+
+    for (uint64_t k = 0; k < count; k++) {
+        int y = KTerm_Snap_GetRange(&r, rows - ring->height, rows - 1);
+        if (r.failed) return false;
+        int idx = KTerm_Snap_RingIndex(ring, y);
+        EnhancedTermChar* row = commit ? &ring->buf[(size_t)idx * cols] : scratch;
+        for (int x = 0; x < cols; x++) {
+            row[x] = kterm_snap_blank;
+            row[x].flags = KTERM_FLAG_DIRTY;
+        }
+        switch (KTerm_Snap_GetU8(&r)) {
+            case KTERM_SNAP_ROW_BLANK:
+                break;
+            case KTERM_SNAP_ROW_CELLS:
+                KTerm_Snap_GetRowCells(&r, row, cols);
+                break;
+            default:
+                r.failed = true;
+                break;
+        }
+        if (r.failed) return false;
+        if (commit && gen) gen[idx] = session->grid_generation;
+    }
+    return true;
+}
+
+// Records the hash of a state encoding and, for deltas, appends it when it changed
+static void KTerm_Snap_PutStateChunk(KTermSnapWriter* w, KTermSnapWriter* body, uint32_t tag, uint32_t* hash, bool emit) {
+    if (body->failed) {
+        w->failed = true;
+        return;
+    }
+    uint32_t h = KTerm_Snap_Hash(body->data, body->len);
+    if (emit && h != *hash) {
+        size_t at = KTerm_Snap_BeginChunk(w, tag);
+        KTerm_Snap_PutBytes(w, body->data, body->len);
+        KTerm_Snap_EndChunk(w, at);
+    }
+    *hash = h;
+    body->len = 0;
+}
+
+bool KTerm_CheckpointSession(KTerm* term, KTermSession* session, KTermCheckpoint* cp, void** out_buf, size_t* out_len) {
+    if (!session || !cp || !out_buf || !out_len || !session->screen_buffer || !session->alt_buffer) return false;
+    if (term) KTerm_FlushOps(term, session);
+    KTerm_ReflowHistory(session, MAX_SCROLLBACK_LINES); // Bumps the epoch if it rewraps anything
+
+    KTermSnapRing main_ring = KTerm_Snap_GetRing(session, false);
+    KTermSnapRing alt_ring = KTerm_Snap_GetRing(session, true);
+    bool keyframe = cp->sequence == 0 || cp->epoch != session->grid_epoch || !*main_ring.gen || !*alt_ring.gen;
+    if (keyframe) {
+        // Start tracking; nothing is stamped yet, so every row dates from before this keyframe
+        if (!*main_ring.gen) *main_ring.gen = (uint32_t*)KTerm_Calloc((size_t)main_ring.height, sizeof(uint32_t));
+        if (!*alt_ring.gen) *alt_ring.gen = (uint32_t*)KTerm_Calloc((size_t)alt_ring.height, sizeof(uint32_t));
+        if (!*main_ring.gen || !*alt_ring.gen) return false;
+    }
+
+    KTermCheckpoint next = *cp;
+    next.sequence = keyframe ? 1 : cp->sequence + 1;
+
+    KTermSnapWriter w = {0};
+    KTermSnapWriter body = {0};
+    KTerm_Snap_PutBytes(&w, KTERM_CHECKPOINT_MAGIC, KTERM_SERIALIZE_MAGIC_LEN);
+    size_t at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_CKPT);
+    KTerm_Snap_PutVarint(&w, next.sequence);
+    KTerm_Snap_PutInt(&w, keyframe);
+    KTerm_Snap_EndChunk(&w, at);
+
+    if (keyframe) {
+        void* snap = NULL;
+        size_t snap_len = 0;
+        if (KTerm_SerializeSessionV2(term, session, true, &snap, &snap_len)) {
+            at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_SNAP);
+            KTerm_Snap_PutBytes(&w, snap, snap_len);
+            KTerm_Snap_EndChunk(&w, at);
+            KTerm_Free(snap);
+        } else {
+            w.failed = true;
+        }
+    }
+
+    // Keyframes already hold this state; they only record what was sent
+    KTerm_Snap_PutMeta(&body, session);
+    KTerm_Snap_PutStateChunk(&w, &body, KTERM_SNAP_META, &next.meta_hash, !keyframe);
+    if (session->tab_stops.stops) {
+        KTerm_Snap_PutTabs(&body, session);
+        KTerm_Snap_PutStateChunk(&w, &body, KTERM_SNAP_TABS, &next.tabs_hash, !keyframe);
+    }
+    KTerm_Snap_PutTitles(&body, session);
+    KTerm_Snap_PutStateChunk(&w, &body, KTERM_SNAP_TITL, &next.title_hash, !keyframe);
+    if (term) {
+        KTerm_Snap_PutPalette(&body, term->color_palette);
+        KTerm_Snap_PutStateChunk(&w, &body, KTERM_SNAP_PALT, &next.palette_hash, !keyframe);
+    }
+    if (body.data) KTerm_Free(body.data);
+
+    if (!keyframe) {
+        int history = session->history_rows_populated;
+        if (history > main_ring.height - session->rows) history = main_ring.height - session->rows;
+        if (history < 0) history = 0;
+        KTerm_Snap_PutRingDelta(&w, KTERM_SNAP_MROW, &main_ring, session->cols, session->rows, history, *main_ring.scrolled - cp->main_scrolled, cp->generation);
+        KTerm_Snap_PutRingDelta(&w, KTERM_SNAP_AROW, &alt_ring, session->cols, session->rows, 0, *alt_ring.scrolled - cp->alt_scrolled, cp->generation);
+    }
+
+    at = KTerm_Snap_BeginChunk(&w, KTERM_SNAP_END);
+    KTerm_Snap_EndChunk(&w, at);
+
+    if (w.failed) {
+        if (w.data) KTerm_Free(w.data);
+        return false;
+    }
+
+    // Rows written from now on carry a stamp newer than anything this checkpoint covered
+    session->grid_generation++;
+    next.generation = session->grid_generation;
+    next.epoch = session->grid_epoch;
+    next.main_scrolled = *main_ring.scrolled;
+    next.alt_scrolled = *alt_ring.scrolled;
+    *cp = next;
+
+    *out_buf = w.data;
+    *out_len = w.len;
+    return true;
+}
+
+bool KTerm_ApplySessionCheckpoint(KTerm* term, KTermSession* session, KTermCheckpoint* cp, const void* buf, size_t len) {
+    if (!session || !cp || !buf || len < KTERM_SERIALIZE_MAGIC_LEN) return false;
+    if (memcmp(buf, KTERM_CHECKPOINT_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) != 0) return false;
+
+    KTermSnapReader ckpt_r = {0}, snap_r = {0}, meta_r = {0}, tabs_r = {0}, title_r = {0}, pal_r = {0}, main_r = {0}, alt_r = {0};
+    KTermSnapReader r = { (const unsigned char*)buf, len, KTERM_SERIALIZE_MAGIC_LEN, false };
+    bool ended = false;
+    while (!ended) {
+        uint32_t tag = KTerm_Snap_GetU32(&r);
+        uint32_t n = KTerm_Snap_GetU32(&r);
+        const unsigned char* payload = KTerm_Snap_GetBytes(&r, n);
+        if (r.failed) return false;
+        KTermSnapReader chunk = { payload, n, 0, false };
+        KTermSnapReader* slot = NULL;
+        switch (tag) {
+            case KTERM_SNAP_CKPT: slot = &ckpt_r; break;
+            case KTERM_SNAP_SNAP: slot = &snap_r; break;
+            case KTERM_SNAP_META: slot = &meta_r; break;
+            case KTERM_SNAP_TABS: slot = &tabs_r; break;
+            case KTERM_SNAP_TITL: slot = &title_r; break;
+            case KTERM_SNAP_PALT: slot = &pal_r; break;
+            case KTERM_SNAP_MROW: slot = &main_r; break;
+            case KTERM_SNAP_AROW: slot = &alt_r; break;
+            case KTERM_SNAP_END: ended = true; break;
+            default: break;
+        }
+        if (slot && !slot->data) *slot = chunk;
+    }
+    if (!ckpt_r.data) return false;
+
+    uint64_t sequence = KTerm_Snap_GetVarint(&ckpt_r);
+    bool keyframe = KTerm_Snap_GetBool(&ckpt_r);
+    if (ckpt_r.failed || sequence == 0) return false;
+
+    if (keyframe) {
+        if (!snap_r.data || snap_r.len < KTERM_SERIALIZE_MAGIC_LEN ||
+            memcmp(snap_r.data, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) != 0) return false;
+        if (!KTerm_DeserializeSessionV2(term, session, snap_r.data, snap_r.len, false, NULL)) return false;
+        cp->sequence = sequence;
+        return true;
+    }
+    if (cp->sequence == 0 || sequence != cp->sequence + 1) return false;
+    if (!session->screen_buffer || !session->alt_buffer) return false;
+
+    // Validate everything before touching the session
+    int cols = session->cols;
+    int rows = session->rows;
+    KTermSnapMeta meta;
+    if (meta_r.data) {
+        KTerm_Snap_GetMeta(&meta_r, &meta);
+        if (meta_r.failed || meta.cols != cols || meta.rows != rows) return false;
+    }
+
+    char window_title[MAX_TITLE_LENGTH] = {0};
+    char icon_title[MAX_TITLE_LENGTH] = {0};
+    if (title_r.data) {
+        KTerm_Snap_GetString(&title_r, window_title, sizeof(window_title));
+        KTerm_Snap_GetString(&title_r, icon_title, sizeof(icon_title));
+        if (title_r.failed) return false;
+    }
+
+    RGB_KTermColor palette[256];
+    if (pal_r.data && term) {
+        KTerm_Snap_GetPalette(&pal_r, palette);
+        if (pal_r.failed) return false;
+    }
+
+    EnhancedTermChar* scratch = (EnhancedTermChar*)KTerm_Malloc((size_t)cols * sizeof(EnhancedTermChar));
+    bool* stops = tabs_r.data ? (bool*)KTerm_Calloc((size_t)cols, sizeof(bool)) : NULL;
+    bool ok = scratch && (stops || !tabs_r.data);
+    int tab_width = 0;
+    if (ok && tabs_r.data) {
+        tab_width = KTerm_Snap_GetTabs(&tabs_r, stops, cols);
+        ok = !tabs_r.failed;
+    }
+
+    // Screen heights do not depend on which one is active
+    KTermSnapRing main_ring = KTerm_Snap_GetRing(session, false);
+    KTermSnapRing alt_ring = KTerm_Snap_GetRing(session, true);
+    if (ok && main_r.data) ok = KTerm_Snap_ApplyRingDelta(main_r, session, &main_ring, NULL, false, scratch);
+    if (ok && alt_r.data) ok = KTerm_Snap_ApplyRingDelta(alt_r, session, &alt_ring, NULL, false, scratch);
+    if (scratch) KTerm_Free(scratch);
+    if (!ok) {
+        if (stops) KTerm_Free(stops);
+        return false;
+    }
+
+    // Commit
+    if (meta_r.data) {
+        bool to_alt = (meta.dec_modes & KTERM_MODE_ALTSCREEN) != 0;
+        if (to_alt != ((session->dec_modes & KTERM_MODE_ALTSCREEN) != 0)) KTerm_Snap_SwapRings(session, to_alt);
+        session->dec_modes = meta.dec_modes;
+        KTerm_Snap_ApplyMeta(session, &meta);
+    }
+    if (stops) KTerm_Snap_SetTabs(session, stops, cols, tab_width);
+    if (title_r.data) KTerm_Snap_SetTitles(session, window_title, icon_title);
+    if (pal_r.data && term) memcpy(term->color_palette, palette, sizeof(palette));
+
+    main_ring = KTerm_Snap_GetRing(session, false);
+    alt_ring = KTerm_Snap_GetRing(session, true);
+    if (main_r.data) KTerm_Snap_ApplyRingDelta(main_r, session, &main_ring, &session->history_rows_populated, true, NULL);
+    if (alt_r.data) KTerm_Snap_ApplyRingDelta(alt_r, session, &alt_ring, NULL, true, NULL);
+
+    int history = (session->dec_modes & KTERM_MODE_ALTSCREEN) ? 0 : session->history_rows_populated;
+    if (meta_r.data) {
+        session->view_offset = meta.view_offset > history ? history : meta.view_offset;
+        session->saved_view_offset = meta.saved_view_offset > session->history_rows_populated ? session->history_rows_populated : meta.saved_view_offset;
+    } else if (session->view_offset > history) {
+        session->view_offset = history;
+    }
+
+    for (int i = 0; i < rows; i++) session->row_dirty[i] = KTERM_DIRTY_FRAMES;
+    session->dirty_rect = (KTermRect){0, 0, cols, rows};
+    cp->sequence = sequence;
+    return true;
+}
+
+// --- Mapped Snapshots ---
+//
+// A mapped snapshot file is a fixed header, a V2 snapshot without its GRID chunk, and
+// then, from the next 4 KiB boundary, the main ring buffer's cells in memory order. The
+// ring keeps its head, so restoring maps the cells and points screen_buffer at them.
+
+#define KTERM_MAPPED_MAGIC "KTERM_MAP_V1"
+#define KTERM_MAPPED_ALIGN 4096
+#define KTERM_MAPPED_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[KTERM_SERIALIZE_MAGIC_LEN];
+    uint32_t byte_order;
+    uint32_t cell_size;     // sizeof(EnhancedTermChar)
+    int32_t cols;
+    int32_t rows;
+    int32_t height;         // rows + MAX_SCROLLBACK_LINES
+    int32_t head;
+    int32_t history;
+    uint32_t reserved;
+    uint64_t state_offset;
+    uint64_t state_len;
+    uint64_t grid_offset;
+    uint64_t grid_len;
+} KTermMappedHeader;
+
+static void KTerm_Snap_ReleaseMap(void* map, size_t len) {
+#ifdef _WIN32
+    (void)len;
+    UnmapViewOfFile(map);
+#else
+    munmap(map, len);
+#endif
+}
+
+// Maps a whole file copy-on-write; writes through the mapping never reach the file
+static void* KTerm_Snap_MapFile(const char* path, size_t* out_len) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER size;
+    void* map = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && (uint64_t)size.QuadPart <= (uint64_t)SIZE_MAX) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping) {
+            map = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping); // The view keeps the mapping alive
+        }
+        *out_len = (size_t)size.QuadPart;
+    }
+    CloseHandle(file);
+    return map;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* map = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= (uint64_t)SIZE_MAX) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        *out_len = (size_t)st.st_size;
+    }
+    close(fd); // The mapping keeps the file open
+    return map;
+#endif
+}
+
+bool KTerm_SaveSessionMapped(KTerm* term, KTermSession* session, const char* path) {
+    if (!session || !path || !session->screen_buffer || !session->alt_buffer) return false;
+
+    void* state = NULL;
+    size_t state_len = 0;
+    if (!KTerm_SerializeSessionV2(term, session, false, &state, &state_len)) return false;
+
+    KTermSnapRing ring = KTerm_Snap_GetRing(session, false);
+    int history = session->history_rows_populated;
+    if (history > ring.height - session->rows) history = ring.height - session->rows;
+    if (history < 0) history = 0;
+
+    KTermMappedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KTERM_MAPPED_MAGIC, KTERM_SERIALIZE_MAGIC_LEN);
+    header.byte_order = KTERM_MAPPED_BYTE_ORDER;
+    header.cell_size = (uint32_t)sizeof(EnhancedTermChar);
+    header.cols = session->cols;
+    header.rows = session->rows;
+    header.height = ring.height;
+    header.head = *ring.head;
+    header.history = history;
+    header.state_offset = sizeof(header);
+    header.state_len = state_len;
+    header.grid_offset = (header.state_offset + state_len + KTERM_MAPPED_ALIGN - 1) / KTERM_MAPPED_ALIGN * KTERM_MAPPED_ALIGN;
+    header.grid_len = (uint64_t)ring.height * session->cols * sizeof(EnhancedTermChar);
+
+    static const unsigned char zeros[KTERM_MAPPED_ALIGN] = {0};
+    size_t pad = (size_t)(header.grid_offset - header.state_offset - state_len);
+    FILE* f = fopen(path, "wb");
+    bool ok = f != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(state, 1, state_len, f) == state_len &&
+             fwrite(zeros, 1, pad, f) == pad &&
+             fwrite(ring.buf, 1, (size_t)header.grid_len, f) == (size_t)header.grid_len;
+        if (fclose(f) != 0) ok = false;
+    }
+    KTerm_Free(state);
+    return ok;
+}
+
+bool KTerm_MapSession(KTerm* term, KTermSession* session, const char* path) {
+    if (!session || !path) return false;
+    size_t map_len = 0;
+    unsigned char* map = (unsigned char*)KTerm_Snap_MapFile(path, &map_len);
+    if (!map) return false;
+
+    // Only the header and state pages are read here
+    KTermMappedHeader header;
+    bool ok = map_len >= sizeof(header);
+    if (ok) {
+        memcpy(&header, map, sizeof(header));
+        ok = memcmp(header.magic, KTERM_MAPPED_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) == 0 &&
+             header.byte_order == KTERM_MAPPED_BYTE_ORDER &&
+             header.cell_size == sizeof(EnhancedTermChar) &&
+             header.cols >= 1 && header.cols <= KTERM_SNAP_MAX_DIM &&
+             header.rows >= 1 && header.rows <= KTERM_SNAP_MAX_DIM &&
+             header.height == header.rows + MAX_SCROLLBACK_LINES &&
+             header.head >= 0 && header.head < header.height &&
+             header.history >= 0 && header.history <= header.height - header.rows &&
+             header.state_offset >= sizeof(header) && header.state_len <= map_len &&
+             header.state_offset <= map_len - header.state_len &&
+             header.state_len >= KTERM_SERIALIZE_MAGIC_LEN &&
+             header.grid_offset % KTERM_MAPPED_ALIGN == 0 &&
+             header.grid_len == (uint64_t)header.height * (uint64_t)header.cols * sizeof(EnhancedTermChar) &&
+             header.grid_len <= map_len && header.grid_offset <= map_len - header.grid_len;
+    }
+    const unsigned char* state = ok ? map + header.state_offset : NULL;
+    if (ok) ok = memcmp(state, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) == 0;
+
+    if (ok) {
+        KTermSnapMappedGrid grid;
+        grid.cells = (EnhancedTermChar*)(map + header.grid_offset);
+        grid.head = header.head;
+        grid.history = header.history;
+        grid.map = map;
+        grid.map_len = map_len;
+        grid.release = KTerm_Snap_ReleaseMap;
+        // The snapshot's META must describe the same grid as the header
+        KTermSnapReader r = { state, (size_t)header.state_len, KTERM_SERIALIZE_MAGIC_LEN, false };
+        KTermSnapMeta meta;
+        ok = false;
+        while (!r.failed) {
+            uint32_t tag = KTerm_Snap_GetU32(&r);
+            uint32_t n = KTerm_Snap_GetU32(&r);
+            const unsigned char* payload = KTerm_Snap_GetBytes(&r, n);
+            if (r.failed || tag == KTERM_SNAP_END) break;
+            if (tag == KTERM_SNAP_META) {
+                KTermSnapReader meta_r = { payload, n, 0, false };
+                KTerm_Snap_GetMeta(&meta_r, &meta);
+                ok = !meta_r.failed && meta.cols == header.cols && meta.rows == header.rows;
+                break;
+            }
+        }
+        if (ok) ok = KTerm_DeserializeSessionV2(term, session, state, (size_t)header.state_len, true, &grid);
+    }
+    if (!ok) KTerm_Snap_ReleaseMap(map, map_len);
+    return ok;
+}
+
+bool KTerm_SerializeSession(KTermSession* session, void** out_buf, size_t* out_len) {
+    return KTerm_SerializeSessionV2(NULL, session, true, out_buf, out_len);
+}
+
+bool KTerm_SerializeSessionEx(KTerm* term, KTermSession* session, void** out_buf, size_t* out_len) {
+    return KTerm_SerializeSessionV2(term, session, true, out_buf, out_len);
+}
+
+bool KTerm_DeserializeSessionEx(KTerm* term, KTermSession* session, const void* buf, size_t len) {
+    if (!session || !buf || len < KTERM_SERIALIZE_MAGIC_LEN) return false;
+    if (memcmp(buf, KTERM_SERIALIZE_MAGIC_V1, KTERM_SERIALIZE_MAGIC_LEN) == 0) {
+        return KTerm_DeserializeSessionV1(session, buf, len);
+    }
+    if (memcmp(buf, KTERM_SERIALIZE_MAGIC, KTERM_SERIALIZE_MAGIC_LEN) != 0) return false; // Invalid magic
+    return KTerm_DeserializeSessionV2(term, session, (const unsigned char*)buf, len, true, NULL);
+}
+
+bool KTerm_DeserializeSession(KTermSession* session, const void* buf, size_t len) {
+    return KTerm_DeserializeSessionEx(NULL, session, buf, len);
+}
+
 #endif // KTERM_SERIALIZE_IMPLEMENTATION
@@ -23,6 +23,36 @@ typedef struct KTermVoiceContext KTermVoiceContext;
 // Callback for sending packets
 typedef void (*KTermVoiceSendCallback)(void* user_data, const void* data, size_t len);
 
+// Voice packets start with a 16-byte header: Format(1) + Channels(1) + Rate(1) + Seq(2) + TS(8) +
+// Source(1) + Pad(2). Source tells apart the talkers multiplexed on one connection.
+#define KTERM_VOICE_HEADER_SIZE 16
+#define KTERM_VOICE_MAX_FRAME 1024 // Most samples a packet may carry
+#ifndef KTERM_VOICE_MAX_GAIN
+#define KTERM_VOICE_MAX_GAIN 16.0f // Highest linear gain the mixer applies (+24 dB); larger values are clamped
+#endif
+
+// Payload formats (header byte 0)
+#define KTERM_VOICE_FORMAT_PCM_F32 0 // Raw 32-bit float samples
+#define KTERM_VOICE_FORMAT_ADPCM   1 // IMA ADPCM, 4 bits per sample
+#define KTERM_VOICE_FORMAT_OPUS    2 // Opus (only with KTERM_USE_OPUS)
+
+// Sample rates (header byte 2)
+#define KTERM_VOICE_RATE_44100 0
+#define KTERM_VOICE_RATE_48000 1
+
+// A payload codec. encode returns the bytes written and decode the samples written, or -1
+// on error. Sample counts and capacities cover all channels (interleaved floats), not frames.
+// create/destroy manage per-stream state and may be NULL for stateless codecs.
+typedef struct {
+    uint8_t format;        // Header format byte
+    const char* name;      // Name accepted by KTerm_Voice_SetCodec and `ext;voice;codec`
+    int frame_samples;     // Samples captured into each packet (<= KTERM_VOICE_MAX_FRAME)
+    void* (*create)(int sample_rate, int channels, bool encoder);
+    void (*destroy)(void* state, bool encoder);
+    int (*encode)(void* state, const float* in, int samples, uint8_t* out, int capacity);
+    int (*decode)(void* state, const uint8_t* in, int len, float* out, int capacity);
+} KTermVoiceCodec;
+
 // --- API ---
 
 // Enable/Disable voice capture/playback on a specific session
@@ -37,12 +67,41 @@ int KTerm_Voice_Command(const char* command_text);
 // Global controls (Push-to-Talk / Mute)
 void KTerm_Voice_SetGlobalMute(bool mute);
 
+// Codecs: PCM ("pcm") and ADPCM ("adpcm") are built in, plus "opus" with KTERM_USE_OPUS.
+// Registering a codec with an existing format byte replaces it. SetCodec selects what a
+// session sends; every registered format is accepted on receive.
+int KTerm_Voice_RegisterCodec(const KTermVoiceCodec* codec);
+int KTerm_Voice_SetCodec(KTermSession* session, const char* name);
+
+// Keyword spotting. A template is enrolled from a recording (any rate; WAV files may be PCM16
+// or float, mono or stereo) and matched against every utterance the VAD segments. When one
+// matches, `command` is typed into the session, or fed to it as output when it starts with
+// ESC P (so a DCS GATE sequence runs a Gateway command).
+int KTerm_Voice_AddKeyword(KTermSession* session, const float* samples, int count, int sample_rate, const char* command);
+int KTerm_Voice_AddKeywordWav(KTermSession* session, const char* wav_path, const char* command);
+void KTerm_Voice_ClearKeywords(KTermSession* session);
+
+// Mixer. Every remote talker is a source with its own jitter buffer and resampler; a session
+// hears the sum of its sources, scaled by their gains and the master gain, then limited.
+// Source ids are `(origin << 8) | header source byte` as given to ProcessPlaybackFrom.
+// Gains must be finite and >= 0; values above KTERM_VOICE_MAX_GAIN are clamped to it.
+int KTerm_Voice_SetSourceGain(KTermSession* session, uint32_t source_id, float gain);
+int KTerm_Voice_SetMasterGain(KTermSession* session, float gain);
+int KTerm_Voice_GetSourceCount(KTermSession* session); // Sources heard recently
+
 // Helper for testing/debugging
 KTermVoiceContext* KTerm_Voice_GetContext(KTermSession* session);
 
+// Stops voice on the session, frees its analysis state and codecs, and unbinds the context.
+// Called by KTerm when the session is torn down.
+void KTerm_Voice_Destroy(KTermSession* session);
+
 // Integration functions (called by KTerm/Net)
 void KTerm_Voice_ProcessCapture(KTerm* term, KTermSession* session, KTermVoiceSendCallback send_cb, void* user_data);
 void KTerm_Voice_ProcessPlayback(KTermSession* session, const void* data, size_t len);
+// As above for packets from a given origin (e.g. connection), so talkers on different
+// connections that use the same source byte are mixed as different sources
+void KTerm_Voice_ProcessPlaybackFrom(KTermSession* session, uint32_t origin, const void* data, size_t len);
 
 // Internal Helper (exposed for Net integration)
 void KTerm_Voice_InjectCommand(KTerm* term, const char* cmd);
@@ -57,11 +116,89 @@ void KTerm_Voice_InjectCommand(KTerm* term, const char* cmd);
 #ifndef KTERM_VOICE_IMPLEMENTATION_GUARD
 #define KTERM_VOICE_IMPLEMENTATION_GUARD
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <math.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifdef KTERM_USE_OPUS
+#include <opus/opus.h>
+#endif
 
 #define VOICE_BUFFER_SIZE 65536 // Power of 2
+#define KTERM_VOICE_MAX_CODECS 8
+#define KTERM_VOICE_JITTER_SLOTS 16   // Packets held for reordering (power of 2)
+#define KTERM_VOICE_MAX_DELAY_MS 200  // Upper bound of the adaptive playout delay
+#define KTERM_VOICE_MAX_PLAYOUT (2 * KTERM_VOICE_MAX_FRAME) // Samples of one frame after resampling
+#define KTERM_VOICE_MAX_SOURCES 8     // Talkers mixed per session
+#define KTERM_VOICE_SOURCE_RING 16384 // Per-source playout ring, ~340 ms at 48 kHz (power of 2)
+#define KTERM_VOICE_SOURCE_TIMEOUT_US 5000000 // A source silent this long gives up its slot
+#define KTERM_VOICE_LIMIT_CEILING 1.0f       // Peak the limiter holds the mix under (0 dBFS)
+
+typedef struct {
+    float samples[KTERM_VOICE_MAX_FRAME];
+    int count;
+    uint16_t seq;
+    bool filled;
+} KTermVoiceJitterSlot;
+
+// Network -> playback reordering (main thread). Packets are released to the playback ring in
+// sequence order; a gap is waited on while the ring still has audio to play and concealed
+// once it is about to run dry.
+typedef struct {
+    KTermVoiceJitterSlot slots[KTERM_VOICE_JITTER_SLOTS];
+    bool started;
+    uint16_t next_seq;      // Next sequence number due for playout
+    int held;               // Filled slots
+
+    // Interarrival jitter (RFC 3550 6.4.1) from sender timestamps vs arrival, in microseconds
+    double jitter_us;
+    int64_t last_transit;
+    int frame;              // Samples per packet last received
+    int target;             // Playout delay kept in the playback ring, in samples
+
+    // Loss concealment: the last frame played, repeated with a fade over consecutive losses
+    float last[KTERM_VOICE_MAX_PLAYOUT];
+    int last_count;
+    int concealed_run;
+
+    // Statistics
+    uint32_t received;
+    uint32_t lost;           // Gaps concealed
+    uint32_t late;           // Packets that arrived after their slot was played or concealed
+    uint32_t dropped_samples;   // Drift correction: samples removed (sender clock fast)
+    uint32_t inserted_samples;  // Drift correction: samples added (sender clock slow)
+    uint32_t overruns;          // Samples that did not fit the playback ring
+} KTermVoiceJitter;
+
+// One remote talker. The main thread decodes, reorders and resamples its packets into the
+// ring; the audio thread drains every source's ring into the mix.
+typedef struct {
+    float ring[KTERM_VOICE_SOURCE_RING];
+    atomic_uint_fast32_t head;           // Write index, free-running (Main Thread)
+    atomic_uint_fast32_t tail;           // Read index, free-running (Audio Thread)
+    atomic_uint_fast32_t playout_target; // Ring level playback waits for before (re)starting
+    _Atomic float gain;
+    bool primed;                         // Audio thread only
+
+    // Main thread only
+    bool in_use;
+    uint32_t id;
+    uint64_t last_seen;
+    KTermVoiceJitter jitter;
+    void* decoder_states[KTERM_VOICE_MAX_CODECS]; // By registry slot
+    uint8_t decoder_channels[KTERM_VOICE_MAX_CODECS]; // Channel count each state was created for
+
+    // Resampler from the stream rate to the output rate (4-point cubic, continuous across packets)
+    int rate;
+    float history[3];
+    double phase;
+} KTermVoiceSource;
 
 struct KTermVoiceContext {
     // Capture Ring Buffer (Mic -> Network)
@@ -69,10 +206,12 @@ struct KTermVoiceContext {
     atomic_uint_fast32_t capture_head; // Write index (Audio Thread)
     atomic_uint_fast32_t capture_tail; // Read index (Main Thread)
 
-    // Playback Ring Buffer (Network -> Speaker)
-    float playback_buffer[VOICE_BUFFER_SIZE];
-    atomic_uint_fast32_t playback_head; // Write index (Main Thread)
-    atomic_uint_fast32_t playback_tail; // Read index (Audio Thread)
+    // Playback mixer (Network -> Speaker). Slots below source_count may hold audio.
+    KTermVoiceSource sources[KTERM_VOICE_MAX_SOURCES];
+    atomic_int source_count;
+    _Atomic float master_gain;
+    float limiter_gain;                // Audio thread only
+    atomic_uint_fast32_t limited_frames; // Output buffers the limiter turned down
 
     bool enabled;
     bool muted;
@@ -83,15 +222,23 @@ struct KTermVoiceContext {
 
     uint16_t sequence;
 
+    // Codec the capture side sends with
+    const KTermVoiceCodec* codec;
+    void* encoder_state;
+
     KTermSession* session;
     KTerm* term;
 
-    // VAD State
+    // VAD State. energy_level is the RMS of the last captured frame (VU meter); vad_active
+    // and vad_start_time are published by the analysis worker.
     float energy_level;
-    bool vad_active;
-    float vad_threshold;
+    atomic_bool vad_active;
+    float vad_threshold;       // Minimum frame RMS counted as speech
     uint64_t vad_start_time;
 
+    // Feature pipeline, VAD and keyword spotter (allocated on first use)
+    struct KTermVoiceAnalysis* analysis;
+
     char target[256];
 };
 
@@ -136,6 +283,987 @@ KTermVoiceContext* KTerm_Voice_GetContext(KTermSession* session) {
     return NULL;
 }
 
+// --- Codecs ---
+
+// Raw float PCM (format 0), in host byte order as always
+static int KTerm_Voice_PcmEncode(void* state, const float* in, int samples, uint8_t* out, int capacity) {
+    (void)state;
+    int bytes = samples * (int)sizeof(float);
+    if (bytes > capacity) return -1;
+    memcpy(out, in, bytes);
+    return bytes;
+}
+
+static int KTerm_Voice_PcmDecode(void* state, const uint8_t* in, int len, float* out, int capacity) {
+    (void)state;
+    int samples = len / (int)sizeof(float);
+    if (samples > capacity) samples = capacity;
+    memcpy(out, in, samples * sizeof(float));
+    return samples;
+}
+
+// IMA ADPCM (format 1). Each payload starts with the predictor (int16, big endian) and step
+// index the packet was encoded from, followed by two 4-bit codes per byte (low nibble first),
+// so a packet decodes on its own and a lost one does not corrupt the next. 256 samples take
+// 132 bytes instead of 1024.
+static const int16_t kterm_adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t kterm_adpcm_index_shift[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+typedef struct {
+    int predictor;
+    int index;
+} KTermVoiceAdpcmState;
+
+// Applies one 4-bit code to the predictor and step index (shared by encoder and decoder)
+static void KTerm_Voice_AdpcmApply(KTermVoiceAdpcmState* st, int code) {
+    int step = kterm_adpcm_steps[st->index];
+    int diff = step >> 3;
+    if (code & 4) diff += step;
+    if (code & 2) diff += step >> 1;
+    if (code & 1) diff += step >> 2;
+    st->predictor += (code & 8) ? -diff : diff;
+    if (st->predictor > 32767) st->predictor = 32767;
+    if (st->predictor < -32768) st->predictor = -32768;
+    st->index += kterm_adpcm_index_shift[code];
+    if (st->index < 0) st->index = 0;
+    if (st->index > 88) st->index = 88;
+}
+
+static void* KTerm_Voice_AdpcmCreate(int sample_rate, int channels, bool encoder) {
+    (void)sample_rate; (void)channels;
+    // Decoding needs no state: each packet carries its own
+    if (!encoder) return NULL;
+    return calloc(1, sizeof(KTermVoiceAdpcmState));
+}
+
+static void KTerm_Voice_AdpcmDestroy(void* state, bool encoder) {
+    (void)encoder;
+    free(state);
+}
+
+static int KTerm_Voice_AdpcmEncode(void* state, const float* in, int samples, uint8_t* out, int capacity) {
+    KTermVoiceAdpcmState scratch = {0, 0};
+    KTermVoiceAdpcmState* st = state ? (KTermVoiceAdpcmState*)state : &scratch;
+    if (4 + (samples + 1) / 2 > capacity) return -1;
+
+    out[0] = (uint8_t)((st->predictor >> 8) & 0xFF);
+    out[1] = (uint8_t)(st->predictor & 0xFF);
+    out[2] = (uint8_t)st->index;
+    out[3] = 0;
+
+    for (int i = 0; i < samples; i++) {
+        float f = in[i];
+        if (f > 1.0f) f = 1.0f;
+        if (f < -1.0f) f = -1.0f;
+        int diff = (int)lrintf(f * 32767.0f) - st->predictor;
+        int step = kterm_adpcm_steps[st->index];
+        int code = 0;
+        if (diff < 0) { code = 8; diff = -diff; }
+        if (diff >= step) { code |= 4; diff -= step; }
+        step >>= 1;
+        if (diff >= step) { code |= 2; diff -= step; }
+        step >>= 1;
+        if (diff >= step) code |= 1;
+        KTerm_Voice_AdpcmApply(st, code);
+
+        uint8_t* byte = &out[4 + i / 2];
+        if (i & 1) *byte |= (uint8_t)(code << 4);
+        else *byte = (uint8_t)code;
+    }
+    return 4 + (samples + 1) / 2;
+}
+
+static int KTerm_Voice_AdpcmDecode(void* state, const uint8_t* in, int len, float* out, int capacity) {
+    (void)state;
+    if (len < 4 || in[2] > 88) return -1;
+    KTermVoiceAdpcmState st;
+    st.predictor = (int16_t)((in[0] << 8) | in[1]);
+    st.index = in[2];
+
+    int samples = (len - 4) * 2;
+    if (samples > capacity) samples = capacity;
+    for (int i = 0; i < samples; i++) {
+        int code = (in[4 + i / 2] >> ((i & 1) ? 4 : 0)) & 0x0F;
+        KTerm_Voice_AdpcmApply(&st, code);
+        out[i] = (float)st.predictor / 32768.0f;
+    }
+    return samples;
+}
+
+#ifdef KTERM_USE_OPUS
+typedef struct {
+    OpusDecoder* decoder;
+    int channels;
+} KTermVoiceOpusDecoder;
+
+// Opus (format 2) in 10 ms frames
+static void* KTerm_Voice_OpusCreate(int sample_rate, int channels, bool encoder) {
+    int err = 0;
+    if (encoder) {
+        OpusEncoder* enc = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &err);
+        if (err != OPUS_OK) return NULL;
+        opus_encoder_ctl(enc, OPUS_SET_BITRATE(24000));
+        return enc;
+    }
+    // opus_decode_float counts in frames, so the decoder remembers its channel count
+    KTermVoiceOpusDecoder* dec = (KTermVoiceOpusDecoder*)calloc(1, sizeof(KTermVoiceOpusDecoder));
+    if (!dec) return NULL;
+    dec->channels = channels;
+    dec->decoder = opus_decoder_create(sample_rate, channels, &err);
+    if (err != OPUS_OK || !dec->decoder) {
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+static void KTerm_Voice_OpusDestroy(void* state, bool encoder) {
+    if (encoder) {
+        opus_encoder_destroy((OpusEncoder*)state);
+    } else {
+        opus_decoder_destroy(((KTermVoiceOpusDecoder*)state)->decoder);
+        free(state);
+    }
+}
+
+static int KTerm_Voice_OpusEncode(void* state, const float* in, int samples, uint8_t* out, int capacity) {
+    if (!state) return -1;
+    int bytes = opus_encode_float((OpusEncoder*)state, in, samples, out, capacity);
+    return (bytes < 0) ? -1 : bytes;
+}
+
+static int KTerm_Voice_OpusDecode(void* state, const uint8_t* in, int len, float* out, int capacity) {
+    if (!state) return -1;
+    KTermVoiceOpusDecoder* dec = (KTermVoiceOpusDecoder*)state;
+    int frames = opus_decode_float(dec->decoder, in, len, out, capacity / dec->channels, 0);
+    return (frames < 0) ? -1 : frames * dec->channels;
+}
+#endif
+
+static const KTermVoiceCodec kterm_voice_codec_pcm = {
+    KTERM_VOICE_FORMAT_PCM_F32, "pcm", 256, NULL, NULL, KTerm_Voice_PcmEncode, KTerm_Voice_PcmDecode
+};
+
+static const KTermVoiceCodec kterm_voice_codec_adpcm = {
+    KTERM_VOICE_FORMAT_ADPCM, "adpcm", 256, KTerm_Voice_AdpcmCreate, KTerm_Voice_AdpcmDestroy,
+    KTerm_Voice_AdpcmEncode, KTerm_Voice_AdpcmDecode
+};
+
+#ifdef KTERM_USE_OPUS
+static const KTermVoiceCodec kterm_voice_codec_opus = {
+    KTERM_VOICE_FORMAT_OPUS, "opus", 480, KTerm_Voice_OpusCreate, KTerm_Voice_OpusDestroy,
+    KTerm_Voice_OpusEncode, KTerm_Voice_OpusDecode
+};
+#endif
+
+static const KTermVoiceCodec* g_voice_codecs[KTERM_VOICE_MAX_CODECS];
+static int g_voice_codec_count = 0;
+
+static void KTerm_Voice_RegisterBuiltinCodecs(void) {
+    if (g_voice_codec_count > 0) return;
+    g_voice_codecs[g_voice_codec_count++] = &kterm_voice_codec_pcm;
+    g_voice_codecs[g_voice_codec_count++] = &kterm_voice_codec_adpcm;
+#ifdef KTERM_USE_OPUS
+    g_voice_codecs[g_voice_codec_count++] = &kterm_voice_codec_opus;
+#endif
+}
+
+// Returns the codec for a header format byte and its registry slot, or NULL
+static const KTermVoiceCodec* KTerm_Voice_FindCodec(uint8_t format, int* slot) {
+    KTerm_Voice_RegisterBuiltinCodecs();
+    for (int i = 0; i < g_voice_codec_count; i++) {
+        if (g_voice_codecs[i]->format == format) {
+            if (slot) *slot = i;
+            return g_voice_codecs[i];
+        }
+    }
+    return NULL;
+}
+
+int KTerm_Voice_RegisterCodec(const KTermVoiceCodec* codec) {
+    if (!codec || !codec->name || !codec->encode || !codec->decode) return SITUATION_FAILURE;
+    if (codec->frame_samples <= 0 || codec->frame_samples > KTERM_VOICE_MAX_FRAME) return SITUATION_FAILURE;
+
+    int slot = -1;
+    if (KTerm_Voice_FindCodec(codec->format, &slot)) {
+        g_voice_codecs[slot] = codec;
+        return SITUATION_SUCCESS;
+    }
+    if (g_voice_codec_count >= KTERM_VOICE_MAX_CODECS) return SITUATION_FAILURE;
+    g_voice_codecs[g_voice_codec_count++] = codec;
+    return SITUATION_SUCCESS;
+}
+
+static void KTerm_Voice_DestroyState(const KTermVoiceCodec* codec, void* state, bool encoder) {
+    if (codec && state && codec->destroy) codec->destroy(state, encoder);
+}
+
+static void KTerm_Voice_ReleaseDecoders(KTermVoiceSource* src) {
+    for (int i = 0; i < KTERM_VOICE_MAX_CODECS; i++) {
+        if (src->decoder_states[i]) {
+            KTerm_Voice_DestroyState(i < g_voice_codec_count ? g_voice_codecs[i] : NULL, src->decoder_states[i], false);
+            src->decoder_states[i] = NULL;
+        }
+        src->decoder_channels[i] = 0;
+    }
+}
+
+// Frees the codec states of a context (on disable)
+static void KTerm_Voice_ReleaseCodecs(KTermVoiceContext* ctx) {
+    KTerm_Voice_DestroyState(ctx->codec, ctx->encoder_state, true);
+    ctx->encoder_state = NULL;
+    for (int i = 0; i < KTERM_VOICE_MAX_SOURCES; i++) KTerm_Voice_ReleaseDecoders(&ctx->sources[i]);
+}
+
+int KTerm_Voice_SetCodec(KTermSession* session, const char* name) {
+    if (!session || !name) return SITUATION_FAILURE;
+    KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
+    if (!ctx) return SITUATION_FAILURE;
+
+    KTerm_Voice_RegisterBuiltinCodecs();
+    for (int i = 0; i < g_voice_codec_count; i++) {
+        const char* a = g_voice_codecs[i]->name;
+        const char* b = name;
+        while (*a && *b && tolower((unsigned char)*a) == tolower((unsigned char)*b)) { a++; b++; }
+        if (*a || *b) continue;
+
+        if (ctx->codec != g_voice_codecs[i]) {
+            KTerm_Voice_DestroyState(ctx->codec, ctx->encoder_state, true);
+            ctx->encoder_state = NULL;
+            ctx->codec = g_voice_codecs[i];
+        }
+        return SITUATION_SUCCESS;
+    }
+    return SITUATION_FAILURE;
+}
+
+// --- Speech Analysis ---
+// ProcessCapture hands every captured frame to a per-session worker thread. The worker
+// decimates to 16 kHz, computes a spectrum and MFCCs every 10 ms, runs the VAD on them and
+// matches each finished utterance against the enrolled keywords (DTW over MFCC frames).
+
+#define KTERM_VOICE_KWS_DECIM 3            // 48 kHz capture -> 16 kHz analysis
+#define KTERM_VOICE_FIR_TAPS 32
+#define KTERM_VOICE_FRAME_LEN 400          // 25 ms window
+#define KTERM_VOICE_FRAME_HOP 160          // 10 ms hop
+#define KTERM_VOICE_FFT_SIZE 512
+#define KTERM_VOICE_FFT_BINS (KTERM_VOICE_FFT_SIZE / 2 + 1)
+#define KTERM_VOICE_MEL_BANDS 26
+#define KTERM_VOICE_MFCC 12                // c1..c12
+#define KTERM_VOICE_FLAT_LO 10             // Flatness measured over bins 10..128 (~300-4000 Hz)
+#define KTERM_VOICE_FLAT_HI 128
+#define KTERM_VOICE_MAX_KEYWORDS 8
+#define KTERM_VOICE_KEYWORD_FRAMES 200     // 2 s
+#define KTERM_VOICE_UTTERANCE_FRAMES 300   // Longer speech is matched in pieces
+#define KTERM_VOICE_HISTORY_FRAMES 512     // Power of 2, > utterance + preroll
+#define KTERM_VOICE_ANALYSIS_RING 16384    // Samples queued for the worker (power of 2)
+#define KTERM_VOICE_VAD_ONSET 3            // Speech frames before the VAD opens
+#define KTERM_VOICE_VAD_HANGOVER 20        // Non-speech frames before it closes
+#define KTERM_VOICE_VAD_PREROLL 2          // Frames before the onset kept with the utterance
+#ifndef KTERM_VOICE_KWS_THRESHOLD
+#define KTERM_VOICE_KWS_THRESHOLD 9.0f     // Largest normalised DTW distance accepted as a match
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define KTERM_VOICE_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KTERM_VOICE_NEON 1
+#endif
+
+// Vector kernels (SSE / NEON, scalar tail and fallback)
+static float KTerm_Voice_Dot(const float* a, const float* b, int n) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(KTERM_VOICE_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(KTERM_VOICE_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    float lanes[4];
+    vst1q_f32(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+static float KTerm_Voice_SquaredDistance(const float* a, const float* b, int n) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(KTERM_VOICE_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(KTERM_VOICE_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc = vmlaq_f32(acc, d, d);
+    }
+    float lanes[4];
+    vst1q_f32(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; i++) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+// out = a * b (may alias a)
+static void KTerm_Voice_Mul(float* out, const float* a, const float* b, int n) {
+    int i = 0;
+#if defined(KTERM_VOICE_SSE)
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#elif defined(KTERM_VOICE_NEON)
+    for (; i + 4 <= n; i += 4) vst1q_f32(out + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+#endif
+    for (; i < n; i++) out[i] = a[i] * b[i];
+}
+
+// out = re^2 + im^2
+static void KTerm_Voice_Power(float* out, const float* re, const float* im, int n) {
+    int i = 0;
+#if defined(KTERM_VOICE_SSE)
+    for (; i + 4 <= n; i += 4) {
+        __m128 r = _mm_loadu_ps(re + i), m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+#elif defined(KTERM_VOICE_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t r = vld1q_f32(re + i), m = vld1q_f32(im + i);
+        vst1q_f32(out + i, vmlaq_f32(vmulq_f32(r, r), m, m));
+    }
+#endif
+    for (; i < n; i++) out[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+// One radix-2 FFT butterfly run: a' = a + w*b, b' = a - w*b over n consecutive elements
+static void KTerm_Voice_Butterfly(float* ar, float* ai, float* br, float* bi, const float* wr, const float* wi, int n) {
+    int j = 0;
+#if defined(KTERM_VOICE_SSE)
+    for (; j + 4 <= n; j += 4) {
+        __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+        __m128 cr = _mm_loadu_ps(wr + j), ci = _mm_loadu_ps(wi + j);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+        __m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+        _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+        _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+        _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+        _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+    }
+#elif defined(KTERM_VOICE_NEON)
+    for (; j + 4 <= n; j += 4) {
+        float32x4_t xr = vld1q_f32(br + j), xi = vld1q_f32(bi + j);
+        float32x4_t cr = vld1q_f32(wr + j), ci = vld1q_f32(wi + j);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(xr, cr), xi, ci);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(xr, ci), xi, cr);
+        float32x4_t yr = vld1q_f32(ar + j), yi = vld1q_f32(ai + j);
+        vst1q_f32(ar + j, vaddq_f32(yr, tr));
+        vst1q_f32(ai + j, vaddq_f32(yi, ti));
+        vst1q_f32(br + j, vsubq_f32(yr, tr));
+        vst1q_f32(bi + j, vsubq_f32(yi, ti));
+    }
+#endif
+    for (; j < n; j++) {
+        float tr = br[j] * wr[j] - bi[j] * wi[j];
+        float ti = br[j] * wi[j] + bi[j] * wr[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+    }
+}
+
+// Shared tables, built once on the first Enable / enrollment
+static struct {
+    bool ready;
+    float fir[KTERM_VOICE_FIR_TAPS];                   // Anti-alias low-pass for the decimator
+    float window[KTERM_VOICE_FRAME_LEN];               // Hamming
+    float tw_re[KTERM_VOICE_FFT_SIZE - 1];             // Twiddles of the stage with half-size h at [h - 1]
+    float tw_im[KTERM_VOICE_FFT_SIZE - 1];
+    uint16_t bitrev[KTERM_VOICE_FFT_SIZE];
+    float mel[KTERM_VOICE_MEL_BANDS][KTERM_VOICE_FFT_BINS];
+    float dct[KTERM_VOICE_MFCC][KTERM_VOICE_MEL_BANDS];
+    float deemphasis[KTERM_VOICE_FFT_BINS];            // Undoes the pre-emphasis gain for flatness
+} g_voice_dsp;
+
+static void KTerm_Voice_InitDsp(void) {
+    if (g_voice_dsp.ready) return;
+    const double pi = 3.14159265358979323846;
+
+    // Blackman-windowed sinc at 7 kHz (of 48 kHz), unity DC gain
+    double fc = 7000.0 / 48000.0, total = 0.0;
+    for (int i = 0; i < KTERM_VOICE_FIR_TAPS; i++) {
+        double t = i - (KTERM_VOICE_FIR_TAPS - 1) / 2.0;
+        double sinc = 2.0 * fc * sin(2.0 * pi * fc * t) / (2.0 * pi * fc * t);
+        double w = 0.42 - 0.5 * cos(2.0 * pi * i / (KTERM_VOICE_FIR_TAPS - 1)) + 0.08 * cos(4.0 * pi * i / (KTERM_VOICE_FIR_TAPS - 1));
+        g_voice_dsp.fir[i] = (float)(sinc * w);
+        total += sinc * w;
+    }
+    for (int i = 0; i < KTERM_VOICE_FIR_TAPS; i++) g_voice_dsp.fir[i] = (float)(g_voice_dsp.fir[i] / total);
+
+    for (int i = 0; i < KTERM_VOICE_FRAME_LEN; i++) {
+        g_voice_dsp.window[i] = (float)(0.54 - 0.46 * cos(2.0 * pi * i / (KTERM_VOICE_FRAME_LEN - 1)));
+    }
+
+    for (int h = 1; h < KTERM_VOICE_FFT_SIZE; h <<= 1) {
+        for (int j = 0; j < h; j++) {
+            g_voice_dsp.tw_re[h - 1 + j] = (float)cos(pi * j / h);
+            g_voice_dsp.tw_im[h - 1 + j] = (float)-sin(pi * j / h);
+        }
+    }
+    for (int i = 0; i < KTERM_VOICE_FFT_SIZE; i++) {
+        int r = 0;
+        for (int b = 1, v = i; b < KTERM_VOICE_FFT_SIZE; b <<= 1, v >>= 1) r = (r << 1) | (v & 1);
+        g_voice_dsp.bitrev[i] = (uint16_t)r;
+    }
+
+    // Triangular mel bands between 60 and 7600 Hz
+    double mel_lo = 2595.0 * log10(1.0 + 60.0 / 700.0), mel_hi = 2595.0 * log10(1.0 + 7600.0 / 700.0);
+    double edges[KTERM_VOICE_MEL_BANDS + 2];
+    for (int i = 0; i < KTERM_VOICE_MEL_BANDS + 2; i++) {
+        double mel = mel_lo + (mel_hi - mel_lo) * i / (KTERM_VOICE_MEL_BANDS + 1);
+        edges[i] = 700.0 * (pow(10.0, mel / 2595.0) - 1.0) * KTERM_VOICE_FFT_SIZE / 16000.0; // In bins
+    }
+    for (int m = 0; m < KTERM_VOICE_MEL_BANDS; m++) {
+        for (int b = 0; b < KTERM_VOICE_FFT_BINS; b++) {
+            double w = 0.0;
+            if (b > edges[m] && b <= edges[m + 1]) w = (b - edges[m]) / (edges[m + 1] - edges[m]);
+            else if (b > edges[m + 1] && b < edges[m + 2]) w = (edges[m + 2] - b) / (edges[m + 2] - edges[m + 1]);
+            g_voice_dsp.mel[m][b] = (float)w;
+        }
+    }
+    for (int c = 0; c < KTERM_VOICE_MFCC; c++) {
+        for (int m = 0; m < KTERM_VOICE_MEL_BANDS; m++) {
+            g_voice_dsp.dct[c][m] = (float)cos(pi * (c + 1) * (m + 0.5) / KTERM_VOICE_MEL_BANDS);
+        }
+    }
+    for (int b = 0; b < KTERM_VOICE_FFT_BINS; b++) {
+        double w = 2.0 * pi * b / KTERM_VOICE_FFT_SIZE;
+        g_voice_dsp.deemphasis[b] = (float)(1.0 / (1.0 + 0.97 * 0.97 - 2.0 * 0.97 * cos(w)));
+    }
+    g_voice_dsp.ready = true;
+}
+
+static void KTerm_Voice_Fft(float* re, float* im) {
+    for (int i = 0; i < KTERM_VOICE_FFT_SIZE; i++) {
+        int j = g_voice_dsp.bitrev[i];
+        if (j > i) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int h = 1; h < KTERM_VOICE_FFT_SIZE; h <<= 1) {
+        const float* wr = g_voice_dsp.tw_re + h - 1;
+        const float* wi = g_voice_dsp.tw_im + h - 1;
+        for (int k = 0; k < KTERM_VOICE_FFT_SIZE; k += 2 * h) {
+            KTerm_Voice_Butterfly(re + k, im + k, re + k + h, im + k + h, wr, wi, h);
+        }
+    }
+}
+
+typedef struct {
+    float energy_db;                // Frame level in dBFS
+    float flatness;                 // Spectral flatness, 0 (tonal) .. 1 (white noise)
+    float mfcc[KTERM_VOICE_MFCC];
+} KTermVoiceFeatures;
+
+static void KTerm_Voice_Analyze(const float* frame, KTermVoiceFeatures* out) {
+    float re[KTERM_VOICE_FFT_SIZE], im[KTERM_VOICE_FFT_SIZE], power[KTERM_VOICE_FFT_BINS];
+
+    out->energy_db = 10.0f * log10f(KTerm_Voice_Dot(frame, frame, KTERM_VOICE_FRAME_LEN) / KTERM_VOICE_FRAME_LEN + 1e-10f);
+
+    // Pre-emphasis, window, zero padding
+    re[0] = frame[0];
+    for (int i = 1; i < KTERM_VOICE_FRAME_LEN; i++) re[i] = frame[i] - 0.97f * frame[i - 1];
+    KTerm_Voice_Mul(re, re, g_voice_dsp.window, KTERM_VOICE_FRAME_LEN);
+    memset(re + KTERM_VOICE_FRAME_LEN, 0, (KTERM_VOICE_FFT_SIZE - KTERM_VOICE_FRAME_LEN) * sizeof(float));
+    memset(im, 0, sizeof(im));
+    KTerm_Voice_Fft(re, im);
+    KTerm_Voice_Power(power, re, im, KTERM_VOICE_FFT_BINS);
+
+    // Geometric over arithmetic mean of the (de-emphasised) speech band
+    double log_sum = 0.0, sum = 0.0;
+    for (int b = KTERM_VOICE_FLAT_LO; b <= KTERM_VOICE_FLAT_HI; b++) {
+        double p = (double)power[b] * g_voice_dsp.deemphasis[b] + 1e-12;
+        log_sum += log(p);
+        sum += p;
+    }
+    int bins = KTERM_VOICE_FLAT_HI - KTERM_VOICE_FLAT_LO + 1;
+    out->flatness = (float)(exp(log_sum / bins) / (sum / bins));
+
+    float bands[KTERM_VOICE_MEL_BANDS];
+    for (int m = 0; m < KTERM_VOICE_MEL_BANDS; m++) {
+        bands[m] = logf(KTerm_Voice_Dot(g_voice_dsp.mel[m], power, KTERM_VOICE_FFT_BINS) + 1e-8f);
+    }
+    for (int c = 0; c < KTERM_VOICE_MFCC; c++) {
+        out->mfcc[c] = KTerm_Voice_Dot(g_voice_dsp.dct[c], bands, KTERM_VOICE_MEL_BANDS);
+    }
+}
+
+// Streaming 48 kHz -> features; shared by the live worker and keyword enrollment
+typedef struct {
+    float line[2 * KTERM_VOICE_FIR_TAPS]; // Decimator delay line, mirrored so the taps read contiguously
+    int pos;
+    int phase;
+    float frame[KTERM_VOICE_FRAME_LEN];   // 16 kHz samples of the frame being filled
+    int fill;
+} KTermVoiceFrontEnd;
+
+// Consumes samples until a frame completes (setting *ready and *out) or the input runs out;
+// returns the number consumed
+static int KTerm_Voice_FrontEndFeed(KTermVoiceFrontEnd* fe, const float* in, int count, KTermVoiceFeatures* out, bool* ready) {
+    *ready = false;
+    for (int i = 0; i < count; i++) {
+        fe->line[fe->pos] = fe->line[fe->pos + KTERM_VOICE_FIR_TAPS] = in[i];
+        fe->pos = (fe->pos + 1) % KTERM_VOICE_FIR_TAPS;
+        if (++fe->phase < KTERM_VOICE_KWS_DECIM) continue;
+        fe->phase = 0;
+
+        fe->frame[fe->fill++] = KTerm_Voice_Dot(fe->line + fe->pos, g_voice_dsp.fir, KTERM_VOICE_FIR_TAPS);
+        if (fe->fill == KTERM_VOICE_FRAME_LEN) {
+            KTerm_Voice_Analyze(fe->frame, out);
+            memmove(fe->frame, fe->frame + KTERM_VOICE_FRAME_HOP, (KTERM_VOICE_FRAME_LEN - KTERM_VOICE_FRAME_HOP) * sizeof(float));
+            fe->fill = KTERM_VOICE_FRAME_LEN - KTERM_VOICE_FRAME_HOP;
+            *ready = true;
+            return i + 1;
+        }
+    }
+    return count;
+}
+
+typedef struct {
+    char command[256];
+    int frames;
+    float mfcc[KTERM_VOICE_KEYWORD_FRAMES][KTERM_VOICE_MFCC];
+} KTermVoiceKeyword;
+
+typedef struct KTermVoiceAnalysis {
+    // Raw capture samples, ProcessCapture -> worker (free-running indices)
+    float ring[KTERM_VOICE_ANALYSIS_RING];
+    atomic_uint_fast32_t head;
+    atomic_uint_fast32_t tail;
+
+    // Worker state
+    KTermVoiceFrontEnd fe;
+    float noise_floor_db;
+    int speech_run;
+    int silence_run;
+    bool in_speech;
+    uint32_t frame_index;
+    uint32_t utterance_start;
+    uint32_t last_speech;
+    float history[KTERM_VOICE_HISTORY_FRAMES][KTERM_VOICE_MFCC];
+    float utterance[KTERM_VOICE_UTTERANCE_FRAMES][KTERM_VOICE_MFCC];
+
+    // Enrolled keywords, shared with the main thread
+    kterm_mutex_t lock;
+    KTermVoiceKeyword keywords[KTERM_VOICE_MAX_KEYWORDS];
+    int keyword_count;
+    atomic_int pending_keyword; // Index + 1 of a match the main thread has not run yet
+
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    bool thread_started;
+    atomic_bool running;
+
+    // Statistics
+    atomic_uint_fast64_t busy_us;           // Time the worker spent processing
+    atomic_uint_fast64_t samples_processed;
+    atomic_uint_fast32_t overruns;          // Samples dropped because the worker fell behind
+    atomic_uint_fast32_t matches;
+} KTermVoiceAnalysis;
+
+static KTermVoiceAnalysis* KTerm_Voice_GetAnalysis(KTermVoiceContext* ctx) {
+    if (!ctx->analysis) {
+        KTerm_Voice_InitDsp();
+        ctx->analysis = (KTermVoiceAnalysis*)calloc(1, sizeof(KTermVoiceAnalysis));
+        if (ctx->analysis) KTERM_MUTEX_INIT(ctx->analysis->lock);
+    }
+    return ctx->analysis;
+}
+
+// Cepstral mean normalisation: removes the channel (microphone, room) from the frames
+static void KTerm_Voice_NormalizeCepstra(float (*mfcc)[KTERM_VOICE_MFCC], int frames) {
+    float mean[KTERM_VOICE_MFCC] = {0};
+    for (int t = 0; t < frames; t++) {
+        for (int c = 0; c < KTERM_VOICE_MFCC; c++) mean[c] += mfcc[t][c];
+    }
+    for (int c = 0; c < KTERM_VOICE_MFCC; c++) mean[c] /= frames;
+    for (int t = 0; t < frames; t++) {
+        for (int c = 0; c < KTERM_VOICE_MFCC; c++) mfcc[t][c] -= mean[c];
+    }
+}
+
+// Dynamic time warping distance, normalised by the path length bound (n + m)
+static float KTerm_Voice_Dtw(const float (*a)[KTERM_VOICE_MFCC], int n, const float (*b)[KTERM_VOICE_MFCC], int m) {
+    float rows[2][KTERM_VOICE_KEYWORD_FRAMES + 1];
+    float* prev = rows[0];
+    float* cur = rows[1];
+    prev[0] = 0.0f;
+    for (int j = 1; j <= m; j++) prev[j] = INFINITY;
+    for (int i = 1; i <= n; i++) {
+        cur[0] = INFINITY;
+        for (int j = 1; j <= m; j++) {
+            float best = prev[j - 1];
+            if (prev[j] < best) best = prev[j];
+            if (cur[j - 1] < best) best = cur[j - 1];
+            cur[j] = best + sqrtf(KTerm_Voice_SquaredDistance(a[i - 1], b[j - 1], KTERM_VOICE_MFCC));
+        }
+        float* t = prev; prev = cur; cur = t;
+    }
+    return prev[m] / (float)(n + m);
+}
+
+static void KTerm_Voice_MatchUtterance(KTermVoiceAnalysis* a) {
+    int n = (int)(a->last_speech - a->utterance_start) + 1;
+    if (n < KTERM_VOICE_VAD_ONSET) return;
+    if (n > KTERM_VOICE_UTTERANCE_FRAMES) n = KTERM_VOICE_UTTERANCE_FRAMES;
+    for (int t = 0; t < n; t++) {
+        memcpy(a->utterance[t], a->history[(a->utterance_start + t) & (KTERM_VOICE_HISTORY_FRAMES - 1)], sizeof(a->utterance[t]));
+    }
+    KTerm_Voice_NormalizeCepstra(a->utterance, n);
+
+    int best = -1;
+    float best_distance = KTERM_VOICE_KWS_THRESHOLD;
+    KTERM_MUTEX_LOCK(a->lock);
+    for (int k = 0; k < a->keyword_count; k++) {
+        int m = a->keywords[k].frames;
+        if (n > 2 * m || m > 2 * n) continue; // Too different in length to be the same word
+        float d = KTerm_Voice_Dtw((const float (*)[KTERM_VOICE_MFCC])a->utterance, n, (const float (*)[KTERM_VOICE_MFCC])a->keywords[k].mfcc, m);
+        if (d < best_distance) {
+            best_distance = d;
+            best = k;
+        }
+    }
+    KTERM_MUTEX_UNLOCK(a->lock);
+
+    if (best >= 0) {
+        atomic_fetch_add_explicit(&a->matches, 1, memory_order_relaxed);
+        atomic_store_explicit(&a->pending_keyword, best + 1, memory_order_release);
+    }
+}
+
+// Energy above an adaptive noise floor, a tonal (non-flat) spectrum, an onset of a few frames
+// and a hangover that bridges pauses between syllables
+static void KTerm_Voice_VadStep(KTermVoiceContext* ctx, KTermVoiceAnalysis* a, const KTermVoiceFeatures* f) {
+    if (f->energy_db < a->noise_floor_db) a->noise_floor_db = f->energy_db;
+    else a->noise_floor_db += 0.002f * (f->energy_db - a->noise_floor_db);
+
+    float min_db = 20.0f * log10f(ctx->vad_threshold + 1e-6f);
+    bool speech = f->energy_db > a->noise_floor_db + 9.0f && f->energy_db > min_db && f->flatness < 0.35f;
+
+    uint32_t index = a->frame_index++;
+    memcpy(a->history[index & (KTERM_VOICE_HISTORY_FRAMES - 1)], f->mfcc, sizeof(f->mfcc));
+    if (speech) {
+        a->speech_run++;
+        a->silence_run = 0;
+        a->last_speech = index;
+    } else {
+        a->silence_run++;
+        a->speech_run = 0;
+    }
+
+    if (!a->in_speech) {
+        if (a->speech_run >= KTERM_VOICE_VAD_ONSET) {
+            uint32_t lead = KTERM_VOICE_VAD_ONSET - 1 + KTERM_VOICE_VAD_PREROLL;
+            a->in_speech = true;
+            a->utterance_start = (index >= lead) ? index - lead : 0;
+            ctx->vad_start_time = KTerm_Voice_GetMicroseconds();
+            atomic_store_explicit(&ctx->vad_active, true, memory_order_release);
+        }
+    } else if (a->silence_run >= KTERM_VOICE_VAD_HANGOVER || index - a->utterance_start + 1 >= KTERM_VOICE_UTTERANCE_FRAMES) {
+        a->in_speech = false;
+        atomic_store_explicit(&ctx->vad_active, false, memory_order_release);
+        KTerm_Voice_MatchUtterance(a);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI KTerm_Voice_AnalysisWorker(LPVOID arg) {
+#else
+static void* KTerm_Voice_AnalysisWorker(void* arg) {
+#endif
+    KTermVoiceContext* ctx = (KTermVoiceContext*)arg;
+    KTermVoiceAnalysis* a = ctx->analysis;
+    float block[1024];
+
+    while (atomic_load_explicit(&a->running, memory_order_acquire)) {
+        uint32_t head = (uint32_t)atomic_load_explicit(&a->head, memory_order_acquire);
+        uint32_t tail = (uint32_t)atomic_load_explicit(&a->tail, memory_order_relaxed);
+        uint32_t count = head - tail;
+        if (count == 0) {
+#ifdef _WIN32
+            Sleep(5);
+#else
+            struct timespec idle = {0, 5000000};
+            nanosleep(&idle, NULL);
+#endif
+            continue;
+        }
+        if (count > 1024) count = 1024;
+
+        uint64_t start = KTerm_Voice_GetMicroseconds();
+        for (uint32_t i = 0; i < count; i++) block[i] = a->ring[(tail + i) & (KTERM_VOICE_ANALYSIS_RING - 1)];
+        atomic_store_explicit(&a->tail, tail + count, memory_order_release);
+
+        int done = 0;
+        while (done < (int)count) {
+            KTermVoiceFeatures features;
+            bool ready;
+            done += KTerm_Voice_FrontEndFeed(&a->fe, block + done, (int)count - done, &features, &ready);
+            if (ready) KTerm_Voice_VadStep(ctx, a, &features);
+        }
+        atomic_fetch_add_explicit(&a->busy_us, KTerm_Voice_GetMicroseconds() - start, memory_order_relaxed);
+        atomic_fetch_add_explicit(&a->samples_processed, count, memory_order_relaxed);
+    }
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static void KTerm_Voice_StartAnalysis(KTermVoiceContext* ctx) {
+    KTermVoiceAnalysis* a = KTerm_Voice_GetAnalysis(ctx);
+    if (!a || a->thread_started) return;
+
+    atomic_store(&a->head, 0);
+    atomic_store(&a->tail, 0);
+    memset(&a->fe, 0, sizeof(a->fe));
+    a->noise_floor_db = -60.0f;
+    a->speech_run = 0;
+    a->silence_run = 0;
+    a->in_speech = false;
+    a->frame_index = 0;
+    atomic_store(&a->pending_keyword, 0);
+    atomic_store(&a->running, true);
+#ifdef _WIN32
+    a->thread = CreateThread(NULL, 0, KTerm_Voice_AnalysisWorker, ctx, 0, NULL);
+    a->thread_started = (a->thread != NULL);
+#else
+    a->thread_started = (pthread_create(&a->thread, NULL, KTerm_Voice_AnalysisWorker, ctx) == 0);
+#endif
+}
+
+static void KTerm_Voice_StopAnalysis(KTermVoiceContext* ctx) {
+    KTermVoiceAnalysis* a = ctx->analysis;
+    if (!a || !a->thread_started) return;
+    atomic_store(&a->running, false);
+#ifdef _WIN32
+    WaitForSingleObject(a->thread, INFINITE);
+    CloseHandle(a->thread);
+#else
+    pthread_join(a->thread, NULL);
+#endif
+    a->thread_started = false;
+    atomic_store(&ctx->vad_active, false);
+}
+
+// Main thread: hand a captured frame to the worker
+static void KTerm_Voice_AnalysisPush(KTermVoiceContext* ctx, const float* samples, int count) {
+    KTermVoiceAnalysis* a = ctx->analysis;
+    if (!a || !a->thread_started) return;
+    uint32_t head = (uint32_t)atomic_load_explicit(&a->head, memory_order_relaxed);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&a->tail, memory_order_acquire);
+    uint32_t space = KTERM_VOICE_ANALYSIS_RING - (head - tail);
+    if ((uint32_t)count > space) {
+        atomic_fetch_add_explicit(&a->overruns, (uint32_t)count - space, memory_order_relaxed);
+        count = (int)space;
+    }
+    for (int i = 0; i < count; i++) a->ring[(head + i) & (KTERM_VOICE_ANALYSIS_RING - 1)] = samples[i];
+    atomic_store_explicit(&a->head, head + count, memory_order_release);
+}
+
+// Main thread: run the command of a keyword the worker recognised
+static void KTerm_Voice_DispatchKeyword(KTerm* term, KTermVoiceContext* ctx) {
+    KTermVoiceAnalysis* a = ctx->analysis;
+    if (!a || !term) return;
+    int pending = atomic_exchange_explicit(&a->pending_keyword, 0, memory_order_acquire);
+    if (!pending) return;
+
+    char command[256] = {0};
+    KTERM_MUTEX_LOCK(a->lock);
+    if (pending <= a->keyword_count) memcpy(command, a->keywords[pending - 1].command, sizeof(command));
+    KTERM_MUTEX_UNLOCK(a->lock);
+    if (!command[0]) return;
+
+    if (command[0] == '\x1B' && command[1] == 'P') {
+        // A DCS sequence (e.g. DCS GATE) is parsed as session output so the Gateway runs it
+        if (ctx->session) KTerm_WriteToSession(term, ctx->session->index, command, strlen(command));
+    } else {
+        KTerm_Voice_InjectCommand(term, command);
+    }
+}
+
+int KTerm_Voice_AddKeyword(KTermSession* session, const float* samples, int count, int sample_rate, const char* command) {
+    if (!session || !samples || count <= 0 || sample_rate <= 0 || !command) return SITUATION_FAILURE;
+    size_t command_len = strlen(command);
+    if (command_len == 0 || command_len >= sizeof(((KTermVoiceKeyword*)0)->command)) return SITUATION_FAILURE;
+    KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
+    if (!ctx) return SITUATION_FAILURE;
+    KTermVoiceAnalysis* a = KTerm_Voice_GetAnalysis(ctx);
+    if (!a) return SITUATION_FAILURE;
+
+    // Resample (linearly) to the 48 kHz the front end expects, plus a window of silence so
+    // the last frames complete
+    int total = (int)((int64_t)count * 48000 / sample_rate);
+    int max_frames = (total / KTERM_VOICE_KWS_DECIM) / KTERM_VOICE_FRAME_HOP + 4;
+    KTermVoiceFeatures* frames = (KTermVoiceFeatures*)malloc((size_t)max_frames * sizeof(KTermVoiceFeatures));
+    if (!frames) return SITUATION_FAILURE;
+
+    KTermVoiceFrontEnd fe;
+    memset(&fe, 0, sizeof(fe));
+    int frame_count = 0;
+    float chunk[256];
+    int pad = KTERM_VOICE_FRAME_LEN * KTERM_VOICE_KWS_DECIM;
+    for (int t = 0; t < total + pad; ) {
+        int n = 0;
+        for (; n < 256 && t < total + pad; n++, t++) {
+            if (t >= total) { chunk[n] = 0.0f; continue; }
+            double pos = (double)t * sample_rate / 48000.0;
+            int i0 = (int)pos;
+            float frac = (float)(pos - i0);
+            float s0 = samples[i0];
+            float s1 = (i0 + 1 < count) ? samples[i0 + 1] : s0;
+            chunk[n] = s0 + (s1 - s0) * frac;
+        }
+        int done = 0;
+        while (done < n) {
+            bool ready;
+            done += KTerm_Voice_FrontEndFeed(&fe, chunk + done, n - done, &frames[frame_count], &ready);
+            if (ready && frame_count < max_frames - 1) frame_count++;
+        }
+    }
+
+    // Trim to the frames within 25 dB of the loudest
+    float peak = -200.0f;
+    for (int t = 0; t < frame_count; t++) if (frames[t].energy_db > peak) peak = frames[t].energy_db;
+    int first = 0, last = frame_count - 1;
+    while (first < frame_count && frames[first].energy_db < peak - 25.0f) first++;
+    while (last > first && frames[last].energy_db < peak - 25.0f) last--;
+    int length = last - first + 1;
+
+    int result = SITUATION_FAILURE;
+    KTERM_MUTEX_LOCK(a->lock);
+    if (frame_count > 0 && length >= KTERM_VOICE_VAD_ONSET && length <= KTERM_VOICE_KEYWORD_FRAMES && a->keyword_count < KTERM_VOICE_MAX_KEYWORDS) {
+        KTermVoiceKeyword* kw = &a->keywords[a->keyword_count];
+        memcpy(kw->command, command, command_len + 1);
+        kw->frames = length;
+        for (int t = 0; t < length; t++) memcpy(kw->mfcc[t], frames[first + t].mfcc, sizeof(kw->mfcc[t]));
+        KTerm_Voice_NormalizeCepstra(kw->mfcc, length);
+        a->keyword_count++;
+        result = SITUATION_SUCCESS;
+    }
+    KTERM_MUTEX_UNLOCK(a->lock);
+    free(frames);
+    return result;
+}
+
+static uint32_t KTerm_Voice_ReadLE(const uint8_t* p, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Minimal RIFF/WAVE reader: PCM16 or 32-bit float, mono or stereo (mixed down)
+int KTerm_Voice_AddKeywordWav(KTermSession* session, const char* wav_path, const char* command) {
+    if (!session || !wav_path || !command) return SITUATION_FAILURE;
+    FILE* f = fopen(wav_path, "rb");
+    if (!f) return SITUATION_FAILURE;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 44 || size > 16 * 1024 * 1024) { fclose(f); return SITUATION_FAILURE; }
+    uint8_t* data = (uint8_t*)malloc((size_t)size);
+    if (!data) { fclose(f); return SITUATION_FAILURE; }
+    size_t got = fread(data, 1, (size_t)size, f);
+    fclose(f);
+    if (got != (size_t)size || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        free(data);
+        return SITUATION_FAILURE;
+    }
+
+    int format = 0, channels = 0, rate = 0, bits = 0;
+    const uint8_t* pcm = NULL;
+    uint32_t pcm_size = 0;
+    for (size_t pos = 12; pos + 8 <= (size_t)size; ) {
+        uint32_t len = KTerm_Voice_ReadLE(data + pos + 4, 4);
+        const uint8_t* body = data + pos + 8;
+        if (len > (size_t)size - pos - 8) len = (uint32_t)((size_t)size - pos - 8);
+        if (memcmp(data + pos, "fmt ", 4) == 0 && len >= 16) {
+            format = (int)KTerm_Voice_ReadLE(body, 2);
+            channels = (int)KTerm_Voice_ReadLE(body + 2, 2);
+            rate = (int)KTerm_Voice_ReadLE(body + 4, 4);
+            bits = (int)KTerm_Voice_ReadLE(body + 14, 2);
+            if (format == 0xFFFE && len >= 26) format = (int)KTerm_Voice_ReadLE(body + 24, 2); // WAVE_FORMAT_EXTENSIBLE
+        } else if (memcmp(data + pos, "data", 4) == 0) {
+            pcm = body;
+            pcm_size = len;
+        }
+        pos += 8 + len + (len & 1);
+    }
+
+    int result = SITUATION_FAILURE;
+    bool pcm16 = (format == 1 && bits == 16), float32 = (format == 3 && bits == 32);
+    if (pcm && (pcm16 || float32) && (channels == 1 || channels == 2) && rate > 0) {
+        int stride = channels * bits / 8;
+        int count = (int)(pcm_size / (uint32_t)stride);
+        float* samples = (float*)malloc((size_t)(count > 0 ? count : 1) * sizeof(float));
+        if (samples && count > 0) {
+            for (int i = 0; i < count; i++) {
+                float sum = 0.0f;
+                for (int c = 0; c < channels; c++) {
+                    const uint8_t* s = pcm + (size_t)i * stride + c * (bits / 8);
+                    if (pcm16) {
+                        sum += (int16_t)KTerm_Voice_ReadLE(s, 2) / 32768.0f;
+                    } else {
+                        uint32_t u = KTerm_Voice_ReadLE(s, 4);
+                        float v;
+                        memcpy(&v, &u, sizeof(v));
+                        sum += v;
+                    }
+                }
+                samples[i] = sum / channels;
+            }
+            result = KTerm_Voice_AddKeyword(session, samples, count, rate, command);
+        }
+        free(samples);
+    }
+    free(data);
+    return result;
+}
+
+void KTerm_Voice_ClearKeywords(KTermSession* session) {
+    KTermVoiceContext* ctx = session ? KTerm_Voice_GetContext(session) : NULL;
+    if (!ctx || !ctx->analysis) return;
+    KTERM_MUTEX_LOCK(ctx->analysis->lock);
+    ctx->analysis->keyword_count = 0;
+    KTERM_MUTEX_UNLOCK(ctx->analysis->lock);
+    atomic_store(&ctx->analysis->pending_keyword, 0);
+}
+
 // Audio Capture Callback (Audio Thread)
 static void KTerm_Voice_CaptureCallback(void* user_data, float* buffer, int frames) {
     KTermVoiceContext* ctx = (KTermVoiceContext*)user_data;
@@ -166,38 +1294,67 @@ static void KTerm_Voice_CaptureCallback(void* user_data, float* buffer, int fram
     atomic_store_explicit(&ctx->capture_head, (head + samples) % VOICE_BUFFER_SIZE, memory_order_release);
 }
 
+// Adds one source's next `frames` samples into the mix, if it has them
+static void KTerm_Voice_MixSource(KTermVoiceSource* src, float* mix, int frames) {
+    uint32_t tail = (uint32_t)atomic_load_explicit(&src->tail, memory_order_relaxed);
+    uint32_t head = (uint32_t)atomic_load_explicit(&src->head, memory_order_acquire);
+    uint32_t available = head - tail;
+
+    // Playout starts (and restarts after an underrun) once the jitter buffer's target delay
+    // is queued, so arrival jitter is absorbed by the ring instead of heard as gaps
+    if (!src->primed) {
+        if (available == 0 || available < (uint32_t)atomic_load_explicit(&src->playout_target, memory_order_relaxed)) return;
+        src->primed = true;
+    }
+    if (available < (uint32_t)frames) {
+        src->primed = false; // Underrun: this talker drops out of the mix until refilled
+        return;
+    }
+
+    float gain = atomic_load_explicit(&src->gain, memory_order_relaxed);
+    for (int i = 0; i < frames; i++) mix[i] += gain * src->ring[(tail + i) & (KTERM_VOICE_SOURCE_RING - 1)];
+    atomic_store_explicit(&src->tail, tail + frames, memory_order_release);
+}
+
 // Audio Playback Callback (Audio Thread)
 static void KTerm_Voice_PlaybackCallback(void* user_data, float* buffer, int frames) {
     KTermVoiceContext* ctx = (KTermVoiceContext*)user_data;
-    int samples = frames * ctx->channels;
-
     if (!ctx || !ctx->enabled) {
-        memset(buffer, 0, samples * sizeof(float));
+        memset(buffer, 0, frames * (ctx ? ctx->channels : 1) * sizeof(float));
         return;
     }
 
-    uint32_t tail = atomic_load_explicit(&ctx->playback_tail, memory_order_relaxed);
-    uint32_t head = atomic_load_explicit(&ctx->playback_head, memory_order_acquire);
-
-    uint32_t available;
-    if (head >= tail) available = head - tail;
-    else available = VOICE_BUFFER_SIZE - (tail - head);
-
-    if (available < (uint32_t)samples) {
-        // Underrun
-        memset(buffer, 0, samples * sizeof(float));
-        return;
-    }
+    float mix[1024];
+    for (int done = 0; done < frames; ) {
+        int n = (frames - done < 1024) ? frames - done : 1024;
+        memset(mix, 0, n * sizeof(float));
+        int count = atomic_load_explicit(&ctx->source_count, memory_order_acquire);
+        for (int s = 0; s < count; s++) KTerm_Voice_MixSource(&ctx->sources[s], mix, n);
+
+        // Limiter: the gain drops at once to keep the block's peak under the ceiling and
+        // recovers by about 1 dB per block, ramped across the block to avoid clicks
+        float master = atomic_load_explicit(&ctx->master_gain, memory_order_relaxed);
+        float peak = 0.0f;
+        for (int i = 0; i < n; i++) {
+            float a = fabsf(mix[i] * master);
+            if (a > peak) peak = a;
+        }
+        float from = ctx->limiter_gain;
+        float to = from * 1.12f;
+        if (to > 1.0f) to = 1.0f;
+        if (peak * to > KTERM_VOICE_LIMIT_CEILING) {
+            to = KTERM_VOICE_LIMIT_CEILING / peak;
+            if (from > to) from = to;
+            atomic_fetch_add_explicit(&ctx->limited_frames, 1, memory_order_relaxed);
+        }
+        ctx->limiter_gain = to;
 
-    uint32_t chunk1 = VOICE_BUFFER_SIZE - tail;
-    if ((uint32_t)samples <= chunk1) {
-        memcpy(buffer, &ctx->playback_buffer[tail], samples * sizeof(float));
-    } else {
-        memcpy(buffer, &ctx->playback_buffer[tail], chunk1 * sizeof(float));
-        memcpy(buffer + chunk1, &ctx->playback_buffer[0], (samples - chunk1) * sizeof(float));
+        for (int i = 0; i < n; i++) {
+            float g = master * ((from == to) ? to : from + (to - from) * (float)i / (float)n);
+            for (int c = 0; c < ctx->channels; c++) buffer[(done + i) * ctx->channels + c] = mix[i] * g;
+        }
+        done += n;
     }
-
-    atomic_store_explicit(&ctx->playback_tail, (tail + samples) % VOICE_BUFFER_SIZE, memory_order_release);
 }
 
 int KTerm_Voice_Enable(KTermSession* session, bool enable) {
@@ -210,14 +1367,24 @@ int KTerm_Voice_Enable(KTermSession* session, bool enable) {
             ctx->channels = 1;
             atomic_store(&ctx->capture_head, 0);
             atomic_store(&ctx->capture_tail, 0);
-            atomic_store(&ctx->playback_head, 0);
-            atomic_store(&ctx->playback_tail, 0);
             ctx->enabled = true;
             ctx->muted = false;
-            ctx->vad_active = false;
+            atomic_store(&ctx->vad_active, false);
             ctx->energy_level = 0.0f;
             ctx->vad_threshold = 0.05f; // Default threshold
             ctx->vad_start_time = 0;
+            if (!ctx->codec) ctx->codec = KTerm_Voice_FindCodec(KTERM_VOICE_FORMAT_PCM_F32, NULL);
+            for (int i = 0; i < KTERM_VOICE_MAX_SOURCES; i++) {
+                KTermVoiceSource* src = &ctx->sources[i];
+                atomic_store(&src->head, 0);
+                atomic_store(&src->tail, 0);
+                src->primed = false;
+                src->in_use = false;
+            }
+            atomic_store(&ctx->source_count, 0);
+            atomic_store(&ctx->master_gain, 1.0f);
+            ctx->limiter_gain = 1.0f;
+            KTerm_Voice_StartAnalysis(ctx);
 
             SituationStartAudioCaptureEx(KTerm_Voice_CaptureCallback, ctx, ctx->sample_rate, ctx->channels);
             SituationStartAudioPlayback(KTerm_Voice_PlaybackCallback, ctx, ctx->sample_rate, ctx->channels);
@@ -227,11 +1394,31 @@ int KTerm_Voice_Enable(KTermSession* session, bool enable) {
             SituationStopAudioCapture();
             SituationStopAudioPlayback();
             ctx->enabled = false;
+            KTerm_Voice_StopAnalysis(ctx);
+            KTerm_Voice_ReleaseCodecs(ctx);
         }
     }
     return SITUATION_SUCCESS;
 }
 
+void KTerm_Voice_Destroy(KTermSession* session) {
+    if (!session) return;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        KTermVoiceContext* ctx = &g_voice_contexts[i];
+        if (ctx->session != session) continue;
+
+        KTerm_Voice_Enable(session, false);
+        KTerm_Voice_StopAnalysis(ctx);
+        KTerm_Voice_ReleaseCodecs(ctx);
+        if (ctx->analysis) {
+            KTERM_MUTEX_DESTROY(ctx->analysis->lock);
+            free(ctx->analysis);
+        }
+        memset(ctx, 0, sizeof(*ctx));
+        return;
+    }
+}
+
 int KTerm_Voice_SetTarget(KTermSession* session, const char* remote_id_or_ip) {
     if (!session) return SITUATION_FAILURE;
     KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
@@ -308,6 +1495,12 @@ void KTerm_Voice_ProcessCapture(KTerm* term, KTermSession* session, KTermVoiceSe
 
     ctx->term = term;
 
+    const KTermVoiceCodec* codec = ctx->codec ? ctx->codec : KTerm_Voice_FindCodec(KTERM_VOICE_FORMAT_PCM_F32, NULL);
+    if (!codec) return;
+    if (codec->create && !ctx->encoder_state) {
+        ctx->encoder_state = codec->create(ctx->sample_rate, ctx->channels, true);
+    }
+
     uint32_t head = atomic_load_explicit(&ctx->capture_head, memory_order_acquire);
     uint32_t tail = atomic_load_explicit(&ctx->capture_tail, memory_order_relaxed);
 
@@ -315,18 +1508,17 @@ void KTerm_Voice_ProcessCapture(KTerm* term, KTermSession* session, KTermVoiceSe
     if (head >= tail) available = head - tail;
     else available = VOICE_BUFFER_SIZE - (tail - head);
 
-    const int CHUNK_SIZE = 256;
-    // Header size: Format(1) + Channels(1) + Rate(1) + Seq(2) + TS(8) + Pad(3) = 16 bytes
-    const int HEADER_SIZE = 16;
-    const int PACKET_SIZE = HEADER_SIZE + (CHUNK_SIZE * sizeof(float));
+    const int CHUNK_SIZE = codec->frame_samples;
+    const int HEADER_SIZE = KTERM_VOICE_HEADER_SIZE;
 
-    while (available >= CHUNK_SIZE) {
-        uint8_t packet[PACKET_SIZE];
+    while (available >= (uint32_t)CHUNK_SIZE) {
+        uint8_t packet[KTERM_VOICE_HEADER_SIZE + KTERM_VOICE_MAX_FRAME * sizeof(float)];
+        float audio_payload[KTERM_VOICE_MAX_FRAME];
 
         // 1. Fill Header
-        packet[0] = 0; // Format: PCM Float
+        packet[0] = codec->format;
         packet[1] = (uint8_t)ctx->channels;
-        packet[2] = (ctx->sample_rate == 48000) ? 1 : 0;
+        packet[2] = (ctx->sample_rate == 44100) ? KTERM_VOICE_RATE_44100 : KTERM_VOICE_RATE_48000;
 
         uint16_t seq = ctx->sequence++;
         packet[3] = (seq >> 8) & 0xFF;
@@ -342,11 +1534,11 @@ void KTerm_Voice_ProcessCapture(KTerm* term, KTermSession* session, KTermVoiceSe
         packet[11] = (ts >> 8) & 0xFF;
         packet[12] = ts & 0xFF;
 
-        // Padding
-        packet[13] = 0; packet[14] = 0; packet[15] = 0;
+        // Source (this context's slot) and padding
+        packet[13] = (uint8_t)(ctx - g_voice_contexts);
+        packet[14] = 0; packet[15] = 0;
 
-        // 2. Fill Audio Data
-        float* audio_payload = (float*)(packet + HEADER_SIZE);
+        // 2. Take the frame out of the capture ring
         uint32_t chunk1 = VOICE_BUFFER_SIZE - tail;
         if ((uint32_t)CHUNK_SIZE <= chunk1) {
             memcpy(audio_payload, &ctx->capture_buffer[tail], CHUNK_SIZE * sizeof(float));
@@ -355,79 +1547,334 @@ void KTerm_Voice_ProcessCapture(KTerm* term, KTermSession* session, KTermVoiceSe
             memcpy(audio_payload + chunk1, &ctx->capture_buffer[0], (CHUNK_SIZE - chunk1) * sizeof(float));
         }
 
-        // VAD Analysis
-        float sum_sq = 0.0f;
-        for(int i=0; i<CHUNK_SIZE; i++) {
-            float s = audio_payload[i];
-            sum_sq += s * s;
-        }
-        float rms = sqrtf(sum_sq / CHUNK_SIZE);
-        ctx->energy_level = rms;
-
-        if (rms > ctx->vad_threshold) {
-            if (!ctx->vad_active) {
-                ctx->vad_active = true;
-                ctx->vad_start_time = ts;
-            }
-        } else {
-            if (ctx->vad_active) {
-                // Hangover or just stop
-                ctx->vad_active = false;
-                // Here we could check duration (ts - start_time) and trigger a command
-                // For now, we leave the infrastructure ready for the Keyword Spotter integration
-            }
-        }
+        // Level for the VU meter; speech detection runs on the analysis worker
+        ctx->energy_level = sqrtf(KTerm_Voice_Dot(audio_payload, audio_payload, CHUNK_SIZE) / CHUNK_SIZE);
+        KTerm_Voice_AnalysisPush(ctx, audio_payload, CHUNK_SIZE);
 
-        if (send_cb) send_cb(user_data, packet, PACKET_SIZE);
+        // 3. Encode the payload
+        int payload = codec->encode(ctx->encoder_state, audio_payload, CHUNK_SIZE, packet + HEADER_SIZE, (int)(sizeof(packet) - HEADER_SIZE));
+        if (payload >= 0 && send_cb) send_cb(user_data, packet, HEADER_SIZE + payload);
 
         tail = (tail + CHUNK_SIZE) % VOICE_BUFFER_SIZE;
         atomic_store_explicit(&ctx->capture_tail, tail, memory_order_release);
         available -= CHUNK_SIZE;
     }
+
+    KTerm_Voice_DispatchKeyword(term, ctx);
+}
+
+// Samples queued in a source's playout ring (main thread view)
+static uint32_t KTerm_Voice_SourceLevel(KTermVoiceSource* src) {
+    uint32_t head = (uint32_t)atomic_load_explicit(&src->head, memory_order_relaxed);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&src->tail, memory_order_acquire);
+    return head - tail;
+}
+
+// Appends samples to a source's ring; what does not fit is counted as overrun
+static void KTerm_Voice_SourceWrite(KTermVoiceSource* src, const float* buffer, int samples) {
+    uint32_t head = (uint32_t)atomic_load_explicit(&src->head, memory_order_relaxed);
+    uint32_t free_space = KTERM_VOICE_SOURCE_RING - KTerm_Voice_SourceLevel(src);
+
+    if ((uint32_t)samples > free_space) {
+        src->jitter.overruns += samples - free_space;
+        samples = (int)free_space;
+    }
+    if (samples <= 0) return;
+
+    uint32_t start = head & (KTERM_VOICE_SOURCE_RING - 1);
+    uint32_t chunk1 = KTERM_VOICE_SOURCE_RING - start;
+    if ((uint32_t)samples <= chunk1) {
+        memcpy(&src->ring[start], buffer, samples * sizeof(float));
+    } else {
+        memcpy(&src->ring[start], buffer, chunk1 * sizeof(float));
+        memcpy(&src->ring[0], buffer + chunk1, (samples - chunk1) * sizeof(float));
+    }
+
+    atomic_store_explicit(&src->head, head + samples, memory_order_release);
+}
+
+// Converts a frame from the source's rate to the output rate with 4-point (Catmull-Rom)
+// interpolation. The last three input samples and the read position carry over, so packet
+// boundaries are seamless. Returns the samples written.
+static int KTerm_Voice_Resample(KTermVoiceSource* src, int out_rate, const float* in, int count, float* out, int capacity) {
+    if (src->rate == out_rate) {
+        if (count > capacity) count = capacity;
+        memcpy(out, in, count * sizeof(float));
+        return count;
+    }
+
+    float x[3 + KTERM_VOICE_MAX_FRAME];
+    memcpy(x, src->history, sizeof(src->history));
+    memcpy(x + 3, in, count * sizeof(float));
+    int total = count + 3;
+    double step = (double)src->rate / (double)out_rate;
+    double t = src->phase;
+    int n = 0;
+    while (n < capacity) {
+        int i = (int)t;
+        if (i + 2 >= total) break;
+        float f = (float)(t - i);
+        float y0 = x[i - 1], y1 = x[i], y2 = x[i + 1], y3 = x[i + 2];
+        out[n++] = y1 + 0.5f * f * ((y2 - y0) + f * ((2.0f * y0 - 5.0f * y1 + 4.0f * y2 - y3) + f * (3.0f * (y1 - y2) + y3 - y0)));
+        t += step;
+    }
+    memcpy(src->history, x + total - 3, sizeof(src->history));
+    src->phase = t - count;
+    return n;
+}
+
+// Plays one frame out of the jitter buffer. Sender and receiver clocks drift apart, which
+// shows as the ring level creeping away from the target delay; a frame well above it loses
+// one sample and one well below gains one, blended at the middle of the frame so that the
+// correction (about 0.4% at 256 samples per packet) is inaudible.
+static void KTerm_Voice_JitterPlay(KTermVoiceContext* ctx, KTermVoiceSource* src, const float* frame, int frame_count) {
+    KTermVoiceJitter* jb = &src->jitter;
+    float pcm[KTERM_VOICE_MAX_PLAYOUT];
+    float out[KTERM_VOICE_MAX_PLAYOUT + 1];
+    int count = KTerm_Voice_Resample(src, ctx->sample_rate, frame, frame_count, pcm, KTERM_VOICE_MAX_PLAYOUT);
+    int n = count;
+    int mid = count / 2;
+    uint32_t level = KTerm_Voice_SourceLevel(src);
+
+    if (count >= 4 && level > (uint32_t)(jb->target + 2 * jb->frame)) {
+        memcpy(out, pcm, mid * sizeof(float));
+        out[mid] = 0.5f * (pcm[mid] + pcm[mid + 1]);
+        memcpy(out + mid + 1, pcm + mid + 2, (count - mid - 2) * sizeof(float));
+        n = count - 1;
+        jb->dropped_samples++;
+    } else if (count >= 4 && level > 0 && level < (uint32_t)(jb->target / 2)) {
+        memcpy(out, pcm, mid * sizeof(float));
+        out[mid] = 0.5f * (pcm[mid - 1] + pcm[mid]);
+        memcpy(out + mid + 1, pcm + mid, (count - mid) * sizeof(float));
+        n = count + 1;
+        jb->inserted_samples++;
+    } else {
+        memcpy(out, pcm, count * sizeof(float));
+    }
+    KTerm_Voice_SourceWrite(src, out, n);
+
+    memcpy(jb->last, pcm, count * sizeof(float));
+    jb->last_count = count;
+    jb->concealed_run = 0;
+}
+
+// Fills in for a lost packet by repeating the last frame, fading out over three losses
+static void KTerm_Voice_JitterConceal(KTermVoiceSource* src) {
+    KTermVoiceJitter* jb = &src->jitter;
+    int count = jb->last_count ? jb->last_count : jb->frame;
+    if (count <= 0) return;
+
+    float out[KTERM_VOICE_MAX_PLAYOUT];
+    float g0 = 1.0f - jb->concealed_run / 3.0f;
+    float g1 = 1.0f - (jb->concealed_run + 1) / 3.0f;
+    if (g0 < 0.0f) g0 = 0.0f;
+    if (g1 < 0.0f) g1 = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float g = g0 + (g1 - g0) * (float)i / (float)count;
+        out[i] = jb->last_count ? jb->last[i] * g : 0.0f;
+    }
+    KTerm_Voice_SourceWrite(src, out, count);
+    jb->concealed_run++;
+    jb->lost++;
+}
+
+// Releases frames in sequence order. A missing packet is waited for while later ones are held
+// and the ring still has a frame to play; after that it is concealed and skipped.
+static void KTerm_Voice_JitterDrain(KTermVoiceContext* ctx, KTermVoiceSource* src) {
+    KTermVoiceJitter* jb = &src->jitter;
+    while (jb->held > 0) {
+        KTermVoiceJitterSlot* slot = &jb->slots[jb->next_seq & (KTERM_VOICE_JITTER_SLOTS - 1)];
+        if (slot->filled && slot->seq == jb->next_seq) {
+            KTerm_Voice_JitterPlay(ctx, src, slot->samples, slot->count);
+            slot->filled = false;
+            jb->held--;
+        } else {
+            if (KTerm_Voice_SourceLevel(src) >= (uint32_t)jb->frame) break;
+            KTerm_Voice_JitterConceal(src);
+        }
+        jb->next_seq++;
+    }
+}
+
+static void KTerm_Voice_JitterPush(KTermVoiceContext* ctx, KTermVoiceSource* src, uint16_t seq, uint64_t ts, const float* pcm, int count) {
+    KTermVoiceJitter* jb = &src->jitter;
+
+    // Adapt the playout delay to the measured jitter: one frame plus four times the mean
+    // deviation of the transit time (all in output samples)
+    int64_t transit = (int64_t)(KTerm_Voice_GetMicroseconds() - ts);
+    if (jb->received > 0) {
+        int64_t delta = transit - jb->last_transit;
+        if (delta < 0) delta = -delta;
+        jb->jitter_us += ((double)delta - jb->jitter_us) / 16.0;
+    }
+    jb->last_transit = transit;
+    jb->received++;
+    jb->frame = (int)((int64_t)count * ctx->sample_rate / src->rate);
+
+    int max_delay = ctx->sample_rate * KTERM_VOICE_MAX_DELAY_MS / 1000;
+    int target = jb->frame + (int)(4.0 * jb->jitter_us * ctx->sample_rate / 1000000.0);
+    if (target > max_delay) target = max_delay;
+    if (target < jb->frame) target = jb->frame;
+    jb->target = target;
+    atomic_store_explicit(&src->playout_target, (uint_fast32_t)target, memory_order_relaxed);
+
+    if (!jb->started) {
+        jb->started = true;
+        jb->next_seq = seq;
+    }
+
+    int16_t ahead = (int16_t)(seq - jb->next_seq);
+    if (ahead < 0 && ahead >= -KTERM_VOICE_JITTER_SLOTS) {
+        jb->late++;
+        return;
+    }
+    if (ahead >= KTERM_VOICE_JITTER_SLOTS || ahead < 0) {
+        // Too far ahead to wait for the gap (long outage), or too far behind to be a late
+        // packet (sender restarted its sequence): start over
+        for (int i = 0; i < KTERM_VOICE_JITTER_SLOTS; i++) jb->slots[i].filled = false;
+        jb->held = 0;
+        jb->next_seq = seq;
+    }
+
+    KTermVoiceJitterSlot* slot = &jb->slots[seq & (KTERM_VOICE_JITTER_SLOTS - 1)];
+    if (slot->filled) return; // Duplicate
+    memcpy(slot->samples, pcm, count * sizeof(float));
+    slot->count = count;
+    slot->seq = seq;
+    slot->filled = true;
+    jb->held++;
+
+    KTerm_Voice_JitterDrain(ctx, src);
+}
+
+// Finds the mixer slot of a source, claiming a free one (or one silent for longer than the
+// timeout) for a new talker. NULL when the room is full.
+static KTermVoiceSource* KTerm_Voice_FindSource(KTermVoiceContext* ctx, uint32_t id, int rate, uint64_t now) {
+    int count = atomic_load_explicit(&ctx->source_count, memory_order_relaxed);
+    int reuse = -1;
+    for (int i = 0; i < count; i++) {
+        KTermVoiceSource* src = &ctx->sources[i];
+        if (src->in_use && src->id == id) {
+            src->last_seen = now;
+            return src;
+        }
+        if (reuse < 0 && (!src->in_use || now - src->last_seen > KTERM_VOICE_SOURCE_TIMEOUT_US)) reuse = i;
+    }
+    if (reuse < 0) {
+        if (count >= KTERM_VOICE_MAX_SOURCES) return NULL;
+        reuse = count;
+    }
+
+    // A reused slot's ring has long been drained by the audio thread, so only the main
+    // thread's state is reset; the indices keep running
+    KTermVoiceSource* src = &ctx->sources[reuse];
+    KTerm_Voice_ReleaseDecoders(src);
+    memset(&src->jitter, 0, sizeof(src->jitter));
+    src->in_use = true;
+    src->id = id;
+    src->last_seen = now;
+    src->rate = rate;
+    memset(src->history, 0, sizeof(src->history));
+    src->phase = 1.0;
+    atomic_store_explicit(&src->gain, 1.0f, memory_order_relaxed);
+    atomic_store_explicit(&src->playout_target, 0, memory_order_relaxed);
+    if (reuse == count) atomic_store_explicit(&ctx->source_count, count + 1, memory_order_release);
+    return src;
+}
+
+int KTerm_Voice_SetSourceGain(KTermSession* session, uint32_t source_id, float gain) {
+    KTermVoiceContext* ctx = session ? KTerm_Voice_GetContext(session) : NULL;
+    if (!ctx || !isfinite(gain) || gain < 0.0f) return SITUATION_FAILURE;
+    if (gain > KTERM_VOICE_MAX_GAIN) gain = KTERM_VOICE_MAX_GAIN;
+    int count = atomic_load_explicit(&ctx->source_count, memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (ctx->sources[i].in_use && ctx->sources[i].id == source_id) {
+            atomic_store_explicit(&ctx->sources[i].gain, gain, memory_order_relaxed);
+            return SITUATION_SUCCESS;
+        }
+    }
+    return SITUATION_FAILURE;
+}
+
+int KTerm_Voice_SetMasterGain(KTermSession* session, float gain) {
+    KTermVoiceContext* ctx = session ? KTerm_Voice_GetContext(session) : NULL;
+    if (!ctx || !isfinite(gain) || gain < 0.0f) return SITUATION_FAILURE;
+    if (gain > KTERM_VOICE_MAX_GAIN) gain = KTERM_VOICE_MAX_GAIN;
+    atomic_store_explicit(&ctx->master_gain, gain, memory_order_relaxed);
+    return SITUATION_SUCCESS;
+}
+
+int KTerm_Voice_GetSourceCount(KTermSession* session) {
+    KTermVoiceContext* ctx = session ? KTerm_Voice_GetContext(session) : NULL;
+    if (!ctx || !ctx->enabled) return 0;
+    uint64_t now = KTerm_Voice_GetMicroseconds();
+    int active = 0;
+    int count = atomic_load_explicit(&ctx->source_count, memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (ctx->sources[i].in_use && now - ctx->sources[i].last_seen <= KTERM_VOICE_SOURCE_TIMEOUT_US) active++;
+    }
+    return active;
 }
 
 // Process Playback (Main Thread)
-void KTerm_Voice_ProcessPlayback(KTermSession* session, const void* data, size_t len) {
+void KTerm_Voice_ProcessPlaybackFrom(KTermSession* session, uint32_t origin, const void* data, size_t len) {
     KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
     if (!ctx || !ctx->enabled) return;
 
-    if (len < 16) return; // Header size check
+    if (len < KTERM_VOICE_HEADER_SIZE) return; // Header size check
 
     const uint8_t* packet = (const uint8_t*)data;
     uint8_t format = packet[0];
-    // uint8_t channels = packet[1]; // TODO: Validate/Resample if needed
-    // uint8_t rate = packet[2];     // TODO: Validate/Resample if needed
-    // uint16_t seq = (packet[3] << 8) | packet[4];
-    // uint64_t ts = ...;
+    uint8_t channels = packet[1];
+    int rate;
+    if (packet[2] == KTERM_VOICE_RATE_44100) rate = 44100;
+    else if (packet[2] == KTERM_VOICE_RATE_48000) rate = 48000;
+    else return; // Unknown rate
+    if (channels != 1 && channels != 2) return;
+    uint16_t seq = (uint16_t)((packet[3] << 8) | packet[4]);
+    uint64_t ts = 0;
+    for (int i = 0; i < 8; i++) ts = (ts << 8) | packet[5 + i];
+    uint32_t id = (origin << 8) | packet[13];
+
+    int slot = 0;
+    const KTermVoiceCodec* codec = KTerm_Voice_FindCodec(format, &slot);
+    if (!codec) return; // Unknown format
+
+    KTermVoiceSource* src = KTerm_Voice_FindSource(ctx, id, rate, KTerm_Voice_GetMicroseconds());
+    if (!src) return; // Every slot has a live talker
+    if (src->rate != rate) {
+        // The talker switched rates: restart its resampler
+        src->rate = rate;
+        memset(src->history, 0, sizeof(src->history));
+        src->phase = 1.0;
+    }
 
-    if (format != 0) return; // Only PCM Float supported for now
+    if (codec->create && src->decoder_states[slot] && src->decoder_channels[slot] != channels) {
+        // The talker switched between mono and stereo: the decoder is sized for the old layout
+        KTerm_Voice_DestroyState(codec, src->decoder_states[slot], false);
+        src->decoder_states[slot] = NULL;
+    }
+    if (codec->create && !src->decoder_states[slot]) {
+        src->decoder_states[slot] = codec->create(rate, channels, false);
+        src->decoder_channels[slot] = channels;
+    }
 
-    const float* buffer = (const float*)(packet + 16);
-    int samples = (len - 16) / sizeof(float);
+    float buffer[KTERM_VOICE_MAX_FRAME];
+    int samples = codec->decode(src->decoder_states[slot], packet + KTERM_VOICE_HEADER_SIZE, (int)(len - KTERM_VOICE_HEADER_SIZE), buffer, KTERM_VOICE_MAX_FRAME);
 
     if (samples <= 0) return;
 
-    uint32_t head = atomic_load_explicit(&ctx->playback_head, memory_order_relaxed);
-    uint32_t tail = atomic_load_explicit(&ctx->playback_tail, memory_order_acquire);
-
-    uint32_t free_space;
-    if (head >= tail) free_space = VOICE_BUFFER_SIZE - (head - tail) - 1;
-    else free_space = (tail - head) - 1;
-
-    if ((uint32_t)samples > free_space) {
-        // Drop/Overrun
-        return;
+    // The mix is mono; stereo talkers are folded down
+    if (channels == 2) {
+        samples /= 2;
+        for (int i = 0; i < samples; i++) buffer[i] = 0.5f * (buffer[2 * i] + buffer[2 * i + 1]);
     }
 
-    uint32_t chunk1 = VOICE_BUFFER_SIZE - head;
-    if ((uint32_t)samples <= chunk1) {
-        memcpy(&ctx->playback_buffer[head], buffer, samples * sizeof(float));
-    } else {
-        memcpy(&ctx->playback_buffer[head], buffer, chunk1 * sizeof(float));
-        memcpy(&ctx->playback_buffer[0], buffer + chunk1, (samples - chunk1) * sizeof(float));
-    }
+    KTerm_Voice_JitterPush(ctx, src, seq, ts, buffer, samples);
+}
 
-    atomic_store_explicit(&ctx->playback_head, (head + samples) % VOICE_BUFFER_SIZE, memory_order_release);
+void KTerm_Voice_ProcessPlayback(KTermSession* session, const void* data, size_t len) {
+    KTerm_Voice_ProcessPlaybackFrom(session, 0, data, len);
 }
 
 #endif // KTERM_VOICE_IMPLEMENTATION_GUARD
@@ -57,8 +57,8 @@
 // --- Version Macros ---
 #define KTERM_VERSION_MAJOR 2
 #define KTERM_VERSION_MINOR 7
-#define KTERM_VERSION_PATCH 13
-#define KTERM_VERSION_STRING "2.7.13"
+#define KTERM_VERSION_PATCH 38
+#define KTERM_VERSION_STRING "2.7.38"
 
 // --- DLL Export/Import ---
 #if defined(_WIN32)
@@ -139,10 +139,23 @@ KTERM_API void KTerm_Free(void* ptr);
 #define DEFAULT_CHAR_HEIGHT 10
 #define DEFAULT_WINDOW_SCALE 1 // Scale factor for the window and font rendering
 #define DEFAULT_WINDOW_WIDTH (DEFAULT_TERM_WIDTH * DEFAULT_CHAR_WIDTH * DEFAULT_WINDOW_SCALE)
-#define MAX_SESSIONS 4
+#define MAX_SESSIONS 4 // Initial session table slots; the table grows on demand
+#ifndef KTERM_SESSION_LIMIT
+#define KTERM_SESSION_LIMIT 1024 // Highest session index + 1
+#endif
+#ifndef KTERM_GATEWAY_SESSION_LIMIT
+#define KTERM_GATEWAY_SESSION_LIMIT 16 // Gateway commands may only create sessions below this index
+#endif
 #define DEFAULT_WINDOW_HEIGHT (DEFAULT_TERM_HEIGHT * DEFAULT_CHAR_HEIGHT * DEFAULT_WINDOW_SCALE)
 #define MAX_ESCAPE_PARAMS 32
 #define MAX_COMMAND_BUFFER 262144 // General purpose buffer for commands, OSC, DCS etc.
+#define KTERM_ESCAPE_INLINE_SIZE 1024 // Per-session escape buffer; longer string sequences move to a heap arena
+#ifndef KTERM_STRING_SEQUENCE_LIMIT
+#define KTERM_STRING_SEQUENCE_LIMIT (1024 * 1024) // Largest OSC/DCS/APC/PM/SOS string collected whole
+#endif
+#ifndef KTERM_CLIPBOARD_LIMIT
+#define KTERM_CLIPBOARD_LIMIT MAX_COMMAND_BUFFER // Largest decoded OSC 52 write; longer ones are discarded
+#endif
 #define MAX_TAB_STOPS 256 // Max columns for tab stops, ensure it's >= DEFAULT_TERM_WIDTH
 #define MAX_TITLE_LENGTH 256
 #define MAX_RECT_OPERATIONS 16
@@ -449,6 +462,7 @@ typedef struct {
 #define KTERM_ATTR_UL_STYLE_DOTTED    (4 << 20)
 #define KTERM_ATTR_UL_STYLE_DASHED    (5 << 20)
 #define KTERM_ATTR_SUBSCRIPT          (1 << 23) // SGR 74
+#define KTERM_FLAG_WRAPPED            (1 << 24) // Set on a row's last cell when the row wraps onto the next (reflow)
 
 // Relocated Private Entries
 #define KTERM_ATTR_PROTECTED          (1 << 28) // DECSCA (Was 16)
@@ -881,8 +895,8 @@ typedef struct {
     int kitty_keyboard_stack[16]; // Stack for push/pop
     int kitty_keyboard_stack_depth;
 
-    // Event Buffer
-    KTermKeyEvent buffer[KEY_EVENT_BUFFER_SIZE];
+    // Event Buffer (KEY_EVENT_BUFFER_SIZE events, allocated by the first queued event)
+    KTermKeyEvent* buffer;
     atomic_int buffer_head;
     atomic_int buffer_tail;
 
@@ -1192,8 +1206,19 @@ KTERM_API void KTerm_Destroy(KTerm* term);
 KTERM_API void KTerm_SetActiveSession(KTerm* term, int index);
 KTERM_API void KTerm_SetSplitScreen(KTerm* term, bool active, int row, int top_idx, int bot_idx);
 KTERM_API void KTerm_WriteCharToSession(KTerm* term, int session_index, unsigned char ch);
+KTERM_API size_t KTerm_WriteToSession(KTerm* term, int session_index, const void* data, size_t length); // Returns bytes queued
 KTERM_API void KTerm_SetResponseEnabled(KTerm* term, int session_index, bool enable);
 KTERM_API bool KTerm_InitSession(KTerm* term, int index);
+// Sessions 0..MAX_SESSIONS-1 exist after Init; higher ones are allocated on first use. GetSession
+// returns NULL for an index that was never used; AcquireSession creates the session
+// (index < KTERM_SESSION_LIMIT) and OpenSession takes the first session that is not open,
+// returning its index or -1. Call both from the thread that runs KTerm_Update.
+// WriteToSession, WriteCharToSession and SetResponseEnabled may be called from any thread but only
+// reach sessions that already exist.
+KTERM_API KTermSession* KTerm_GetSession(KTerm* term, int index);
+KTERM_API KTermSession* KTerm_AcquireSession(KTerm* term, int index);
+KTERM_API int KTerm_OpenSession(KTerm* term);
+KTERM_API int KTerm_GetSessionCount(KTerm* term); // Sessions allocated so far
 
 // KTerm lifecycle
 KTERM_API bool KTerm_Init(KTerm* term);
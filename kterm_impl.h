@@ -116,8 +116,39 @@ typedef struct {
     bool initialized;
 } KTermRawDumpState;
 
+// Streaming string-sequence handler. Once an OSC/DCS header names a handler that can take its
+// payload in pieces, the parser passes the payload to write() in chunks of at most
+// KTERM_ESCAPE_INLINE_SIZE bytes instead of collecting it, then calls end() at the terminator.
+// end() also runs with complete == false if the sequence is abandoned.
+typedef struct KTermStringSink_T {
+    void (*write)(KTerm* term, KTermSession* session, struct KTermStringSink_T* sink, const char* data, size_t len);
+    void (*end)(KTerm* term, KTermSession* session, struct KTermStringSink_T* sink, bool complete);
+    int target;             // Session index the payload is delivered to
+    int mode;               // Handler-specific (encoding, query flag)
+    char selector;          // OSC 52 selection
+    uint32_t bits;          // Partial base64 / hex group
+    int bit_count;
+    unsigned char* data;    // Decoded bytes, for handlers that need the whole payload at the end
+    size_t len;
+    size_t capacity;
+} KTermStringSink;
+
+// Rows of a main-screen ring buffer, as logical rows relative to its screen top. Scrollback
+// waiting to be rewrapped after a resize is the range [oldest, next] of the previous ring.
+typedef struct {
+    EnhancedTermChar* buffer;
+    int cols;
+    int height;
+    int head;       // Physical row of logical row 0
+    int next;       // Newest row still to rewrap (negative)
+    int oldest;     // Oldest row still to rewrap
+    bool rewrap;    // false: rows keep their breaks and are clipped to the new width
+} KTermReflowSource;
+
 typedef struct KTermSession_T {
 
+    int index;                             // Slot in term->sessions
+
     KTermRawDumpState raw_dump;
 
     // Operation Queue for Grid Mutations
@@ -145,6 +176,24 @@ typedef struct KTermSession_T {
     int lines_per_page; // DECSLPP (Logical Page Height)
 
     uint8_t* row_dirty; // Tracks dirty state of the VIEWPORT rows (0..rows-1)
+
+    // Incremental checkpoint tracking (kt_serialize.h). The generation arrays are indexed by
+    // physical ring row and allocated by the first checkpoint; NULL means untracked.
+    uint32_t* row_generation;              // Last grid_generation that wrote each row of screen_buffer
+    uint32_t* alt_row_generation;          // Same for alt_buffer (swapped with it)
+    uint32_t rows_scrolled;                // Full-screen scrolls of screen_buffer's ring
+    uint32_t alt_rows_scrolled;            // Same for alt_buffer (swapped with it)
+    uint32_t grid_generation;              // Current stamp, advanced by each checkpoint
+    uint32_t grid_epoch;                   // Bumped when the grid is reallocated or rewritten wholesale
+
+    // Mapped snapshot (kt_serialize.h) backing one of the grids instead of the heap, or NULL
+    void* grid_map;
+    size_t grid_map_len;
+    void (*grid_map_release)(void* map, size_t len);
+
+    // Scrollback from before the last resize, rewrapped into the ring only as it is scrolled
+    // into view (KTerm_ReflowHistory). reflow.buffer is NULL when nothing is waiting.
+    KTermReflowSource reflow;
     // EnhancedTermChar saved_screen[term->height][term->width]; // For DECSEL/DECSED if implemented
 
     // Enhanced cursor
@@ -308,8 +357,11 @@ typedef struct KTermSession_T {
 
     VTParseState parse_state;
     VTParseState saved_parse_state;
-    char escape_buffer[MAX_COMMAND_BUFFER];
+    char* escape_buffer;                   // escape_inline, or a heap arena while a long string sequence is collected
     int escape_pos;
+    int escape_capacity;
+    char escape_inline[KTERM_ESCAPE_INLINE_SIZE];
+    KTermStringSink string_sink;           // Streaming handler for the current OSC/DCS payload, if any
     int escape_params[MAX_ESCAPE_PARAMS];
     char escape_separators[MAX_ESCAPE_PARAMS];
     int param_count;
@@ -374,11 +426,63 @@ static inline EnhancedTermChar* GetActiveScreenCell(KTermSession* session, int y
     return &GetActiveScreenRow(session, y)[x];
 }
 
+// Marks logical row y of the active screen as changed: redraws it and stamps it for
+// incremental checkpoints. Use row_dirty directly for redraws that change no content.
+static inline void KTerm_MarkRowDirty(KTermSession* session, int y) {
+    if (y >= 0 && y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+    if (session->row_generation) {
+        int idx = (session->screen_head + y) % session->buffer_height;
+        if (idx < 0) idx += session->buffer_height;
+        session->row_generation[idx] = session->grid_generation;
+    }
+}
+
+// Drops checkpoint tracking after the grid is reallocated or rewritten wholesale, so that
+// the next checkpoint is a full keyframe.
+static void KTerm_ResetRowGenerations(KTermSession* session) {
+    if (session->row_generation) {
+        KTerm_Free(session->row_generation);
+        session->row_generation = NULL;
+    }
+    if (session->alt_row_generation) {
+        KTerm_Free(session->alt_row_generation);
+        session->alt_row_generation = NULL;
+    }
+    session->rows_scrolled = 0;
+    session->alt_rows_scrolled = 0;
+    session->grid_epoch++;
+}
+
+// Releases a screen or alternate grid, which may live in a mapped snapshot
+static void KTerm_FreeGrid(KTermSession* session, EnhancedTermChar* grid) {
+    if (!grid) return;
+    unsigned char* p = (unsigned char*)grid;
+    unsigned char* map = (unsigned char*)session->grid_map;
+    if (map && p >= map && p < map + session->grid_map_len) {
+        if (session->grid_map_release) session->grid_map_release(session->grid_map, session->grid_map_len);
+        session->grid_map = NULL;
+        session->grid_map_len = 0;
+        session->grid_map_release = NULL;
+        return;
+    }
+    KTerm_Free(grid);
+}
+
+// Discards scrollback still waiting to be rewrapped after a resize
+static void KTerm_DropHistoryReflow(KTermSession* session) {
+    if (session->reflow.buffer) KTerm_FreeGrid(session, session->reflow.buffer);
+    memset(&session->reflow, 0, sizeof(session->reflow));
+}
+
 // Render structures moved to kt_composite_sit.h
 
 typedef struct KTerm_T {
     KTermConfig config;
-    KTermSession sessions[MAX_SESSIONS];
+    KTermSession** sessions;   // Grows on demand up to KTERM_SESSION_LIMIT, NULL = slot never used
+    int session_capacity;
+    int* live_sessions;        // Indices of the allocated sessions, in creation order
+    int live_session_count;
+    kterm_mutex_t session_table_lock; // Held while the table grows or a slot is filled, and by cross-thread lookups
     KTermLayout* layout;
     int width;
     int height;
@@ -514,8 +618,6 @@ typedef struct KTerm_T {
 
     VTParseState parse_state;
     VTParseState saved_parse_state;
-    char escape_buffer[MAX_COMMAND_BUFFER];
-    int escape_pos;
     int escape_params[MAX_ESCAPE_PARAMS];
     char escape_separators[MAX_ESCAPE_PARAMS];
     int param_count;
@@ -589,7 +691,7 @@ typedef struct KTerm_T {
 
 // Internal forward declares
 static unsigned int KTerm_CalculateRectChecksum(KTerm *term, int top, int left, int bottom, int right);
-#define GET_SESSION(term) (&(term)->sessions[(term)->active_session])
+#define GET_SESSION(term) ((term)->sessions[(term)->active_session])
 
 // =============================================================================
 // IMPLEMENTATION BEGINS HERE
@@ -604,6 +706,7 @@ void KTerm_QueueInsertLines(KTermSession* session, int count, bool respect_prote
 void KTerm_QueueDeleteLines(KTermSession* session, int count, bool respect_protected);
 void KTerm_QueueScrollRegion(KTermSession* session, KTermRect rect, int dy);
 void KTerm_QueueResize(KTermSession* session, int cols, int rows, bool reflow);
+void KTerm_ReflowHistory(KTermSession* session, int lines);
 
 // Internal Forward Declarations
 void KTerm_CopyRectangle(KTerm* term, VTRectangle src, int dest_x, int dest_y);
@@ -1430,6 +1533,20 @@ void KTerm_InitInputState(KTerm* term, KTermSession* session) {
     }
 }
 
+// Resets the per-session modes that KTerm_InitSession leaves alone: conformance level, tab
+// stops, charsets and keyboard state. Only session 0 is open by default in the multiplexer.
+static void KTerm_InitSessionModes(KTerm* term, KTermSession* session) {
+    // Context switch to use existing helper functions
+    int saved = term->active_session;
+    term->active_session = session->index;
+    KTerm_InitVTConformance(term, session);
+    KTerm_InitTabStops(term, session);
+    KTerm_InitCharacterSets(term, session);
+    KTerm_InitInputState(term, session);
+    term->active_session = saved;
+    session->session_open = (session->index == 0);
+}
+
 KTerm* KTerm_Create(KTermConfig config) {
     KTerm* term = (KTerm*)KTerm_Calloc(1, sizeof(KTerm));
     if (!term) return NULL;
@@ -1588,11 +1705,11 @@ void KTerm_ResetGraphics(KTerm* term, KTermSession* session, GraphicsResetFlags
     // ReGIS and Kitty are per-session. Tektronix is still global (for now).
 
     if (flags & GRAPHICS_RESET_KITTY && term->kitty_target_session >= 0) {
-        s = &term->sessions[term->kitty_target_session];
+        s = KTerm_GetSession(term, term->kitty_target_session);
     } else if (flags & GRAPHICS_RESET_REGIS && term->regis_target_session >= 0) {
-        s = &term->sessions[term->regis_target_session];
+        s = KTerm_GetSession(term, term->regis_target_session);
     } else if (flags & GRAPHICS_RESET_TEK && term->tektronix_target_session >= 0) {
-        s = &term->sessions[term->tektronix_target_session];
+        s = KTerm_GetSession(term, term->tektronix_target_session);
     }
     if (!s) s = session;  // Fallback
 
@@ -1616,8 +1733,8 @@ void KTerm_ResetGraphics(KTerm* term, KTermSession* session, GraphicsResetFlags
     }
     if (flags == GRAPHICS_RESET_ALL || (flags & GRAPHICS_RESET_SIXEL)) {
         KTermSession* sixel_s = session;
-        if (term->sixel_target_session >= 0 && term->sixel_target_session < MAX_SESSIONS) {
-            sixel_s = &term->sessions[term->sixel_target_session];
+        if (KTerm_GetSession(term, term->sixel_target_session)) {
+            sixel_s = KTerm_GetSession(term, term->sixel_target_session);
         }
         KTerm_InitSixelGraphics(term, sixel_s);
     }
@@ -1636,11 +1753,6 @@ bool KTerm_Init(KTerm* term) {
     if (term->width == 0) term->width = DEFAULT_TERM_WIDTH;
     if (term->height == 0) term->height = DEFAULT_TERM_HEIGHT;
 
-    // Initialize Session Locks (Phase 3) - Done once per terminal lifetime
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTERM_MUTEX_INIT(term->sessions[i].lock);
-    }
-
     // Default Font - IBM 8x8 in 10x10 cells
     term->char_width = 10;   // IBM font cell width
     term->char_height = 10;  // IBM font cell height
@@ -1673,26 +1785,23 @@ bool KTerm_Init(KTerm* term) {
     term->kitty_target_session = -1;
     term->sixel_target_session = -1;
 
-    // Init sessions
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (!KTerm_InitSession(term, i)) return false;
-        KTermSession* session = &term->sessions[i];
-
-        // Context switch to use existing helper functions
-        int saved = term->active_session;
-        term->active_session = i;
-
-        KTerm_InitVTConformance(term, session);
-        KTerm_InitTabStops(term, session);
-        KTerm_InitCharacterSets(term, session);
-        KTerm_InitInputState(term, session);
-
-        // Only the first session is active by default in the multiplexer
-        if (i > 0) {
-            term->sessions[i].session_open = false;
+    // Init sessions: the classic MAX_SESSIONS exist up front, higher indices are allocated on first use.
+    // On RIS the sessions that already exist are reset in place so that pointers stay valid.
+    if (term->sessions) {
+        for (int i = 0; i < term->live_session_count; i++) {
+            int index = term->live_sessions[i];
+            if (!KTerm_InitSession(term, index)) return false;
+            KTerm_InitSessionModes(term, term->sessions[index]);
+        }
+    } else {
+        term->session_capacity = MAX_SESSIONS;
+        term->sessions = (KTermSession**)KTerm_Calloc(term->session_capacity, sizeof(KTermSession*));
+        term->live_sessions = (int*)KTerm_Calloc(term->session_capacity, sizeof(int));
+        if (!term->sessions || !term->live_sessions) return false;
+        KTERM_MUTEX_INIT(term->session_table_lock);
+        for (int i = 0; i < MAX_SESSIONS; i++) {
+            if (!KTerm_AcquireSession(term, i)) return false;
         }
-
-        term->active_session = saved;
     }
     term->active_session = 0;
 
@@ -1757,13 +1866,85 @@ static void _KTermAssertMainThread(KTerm* term, const char* file, int line) {
 
 
 
+// --- Escape Buffer ---
+// Control sequences are collected in session->escape_inline. A string sequence that outgrows it
+// moves to a heap arena, doubled up to KTERM_STRING_SEQUENCE_LIMIT and freed once dispatched.
+// OSC/DCS payloads with a streaming handler (see KTermStringSink) never reach the arena.
+
+#define KTERM_STRING_HEADER_MAX 256 // Longest OSC/DCS header checked for a streaming handler
+
+static bool KTerm_OpenStringSink(KTerm* term, KTermSession* session, VTParseState type);
+
+static void KTerm_CloseStringSink(KTerm* term, KTermSession* session, bool complete) {
+    KTermStringSink* sink = &session->string_sink;
+    if (!sink->write) return;
+    if (complete && session->escape_pos > 0) sink->write(term, session, sink, session->escape_buffer, (size_t)session->escape_pos);
+    if (sink->end) sink->end(term, session, sink, complete);
+    if (sink->data) KTerm_Free(sink->data);
+    memset(sink, 0, sizeof(*sink));
+}
+
+static void KTerm_ResetEscapeBuffer(KTerm* term, KTermSession* session) {
+    KTerm_CloseStringSink(term, session, false);
+    if (session->escape_buffer && session->escape_buffer != session->escape_inline) {
+        KTerm_Free(session->escape_buffer);
+    }
+    session->escape_buffer = session->escape_inline;
+    session->escape_capacity = KTERM_ESCAPE_INLINE_SIZE;
+    session->escape_pos = 0;
+    session->escape_buffer[0] = '\0';
+}
+
+// Appends to a string sequence, moving it to the arena when the inline buffer is full.
+// Returns false once KTERM_STRING_SEQUENCE_LIMIT is reached.
+static bool KTerm_AppendEscapeChar(KTermSession* session, unsigned char ch) {
+    if (session->escape_pos + 1 >= session->escape_capacity) {
+        if (session->escape_capacity >= KTERM_STRING_SEQUENCE_LIMIT) return false;
+        int capacity = session->escape_capacity * 2;
+        if (capacity > KTERM_STRING_SEQUENCE_LIMIT) capacity = KTERM_STRING_SEQUENCE_LIMIT;
+        char* arena;
+        if (session->escape_buffer == session->escape_inline) {
+            arena = (char*)KTerm_Malloc((size_t)capacity);
+            if (arena) memcpy(arena, session->escape_inline, (size_t)session->escape_pos);
+        } else {
+            arena = (char*)KTerm_Realloc(session->escape_buffer, (size_t)capacity);
+        }
+        if (!arena) return false;
+        session->escape_buffer = arena;
+        session->escape_capacity = capacity;
+    }
+    session->escape_buffer[session->escape_pos++] = (char)ch;
+    return true;
+}
+
+// Passes one payload byte to the active sink, flushing whenever the inline buffer fills.
+static void KTerm_StreamStringChar(KTerm* term, KTermSession* session, unsigned char ch, VTParseState state) {
+    if (ch == '\x1B') {
+        session->saved_parse_state = state;
+        session->parse_state = PARSE_STRING_TERMINATOR;
+        return;
+    }
+    if (ch == '\a') {
+        KTerm_DispatchSequence(term, session, state);
+        session->parse_state = VT_PARSE_NORMAL;
+        return;
+    }
+    session->escape_buffer[session->escape_pos++] = (char)ch;
+    if (session->escape_pos >= KTERM_ESCAPE_INLINE_SIZE - 1) {
+        session->string_sink.write(term, session, &session->string_sink, session->escape_buffer, (size_t)session->escape_pos);
+        session->escape_pos = 0;
+    }
+}
+
 void KTerm_DispatchSequence(KTerm* term, KTermSession* session, VTParseState type) {
-    // Ensure buffer is null-terminated
-    if (session->escape_pos < MAX_COMMAND_BUFFER) {
-        session->escape_buffer[session->escape_pos] = '\0';
-    } else {
-        session->escape_buffer[MAX_COMMAND_BUFFER - 1] = '\0';
+    if (session->string_sink.write) {
+        KTerm_CloseStringSink(term, session, true);
+        KTerm_ResetEscapeBuffer(term, session);
+        return;
     }
+
+    // Ensure buffer is null-terminated
+    session->escape_buffer[session->escape_pos] = '\0';
     KTERM_DEBUG_PRINT("DCS Command: %s\n", session->escape_buffer);
 
     switch (type) {
@@ -1775,14 +1956,17 @@ void KTerm_DispatchSequence(KTerm* term, KTermSession* session, VTParseState typ
         case PARSE_KITTY:
             {
                 KTermSession* target = session;
-                if (term->kitty_target_session >= 0 && term->kitty_target_session < MAX_SESSIONS) {
-                    target = &term->sessions[term->kitty_target_session];
+                if (KTerm_GetSession(term, term->kitty_target_session)) {
+                    target = KTerm_GetSession(term, term->kitty_target_session);
                 }
                 KTerm_ExecuteKittyCommand(term, target);
             }
             break;
         default: break;
     }
+
+    // Return the arena, if the string needed one
+    KTerm_ResetEscapeBuffer(term, session);
 }
 
 // String terminator handler for ESC P, ESC _, ESC ^, ESC X
@@ -1811,7 +1995,7 @@ void KTerm_ProcessStringTerminator(KTerm* term, KTermSession* session, unsigned
 }
 
 void KTerm_ProcessCharsetCommand(KTerm* term, KTermSession* session, unsigned char ch) {
-    if (session->escape_pos < MAX_COMMAND_BUFFER) {
+    if (session->escape_pos < KTERM_ESCAPE_INLINE_SIZE - 1) {
         session->escape_buffer[session->escape_pos++] = ch;
     }
 
@@ -1899,17 +2083,14 @@ void KTerm_ExecuteSOSCommand(KTerm* term, KTermSession* session) {
 // Generic string processor for APC, PM, SOS
 void KTerm_ProcessGenericStringChar(KTerm* term, KTermSession* session, unsigned char ch, VTParseState next_state_on_escape) {
     (void)next_state_on_escape;
-    if ((size_t)session->escape_pos < sizeof(session->escape_buffer) - 1) {
-        if (ch == '\x1B') {
-            session->saved_parse_state = session->parse_state;
-            session->parse_state = PARSE_STRING_TERMINATOR;
-            return;
-        }
-
-        session->escape_buffer[session->escape_pos++] = ch;
+    if (ch == '\x1B') {
+        session->saved_parse_state = session->parse_state;
+        session->parse_state = PARSE_STRING_TERMINATOR;
+        return;
+    }
 
-        // BEL is not a standard terminator for these, ST is.
-    } else { // Buffer overflow
+    // BEL is not a standard terminator for these, ST is.
+    if (!KTerm_AppendEscapeChar(session, ch)) { // Buffer overflow
         KTerm_DispatchSequence(term, session, session->parse_state);
         session->parse_state = VT_PARSE_NORMAL;
         session->escape_pos = 0;
@@ -1924,8 +2105,8 @@ void KTerm_ProcessAPCChar(KTerm* term, KTermSession* session, unsigned char ch)
     if (session->escape_pos == 0 && ch == 'G') {
          // Determine Target
          KTermSession* target_session = session;
-         if (term->kitty_target_session >= 0 && term->kitty_target_session < MAX_SESSIONS) {
-             target_session = &term->sessions[term->kitty_target_session];
+         if (KTerm_GetSession(term, term->kitty_target_session)) {
+             target_session = KTerm_GetSession(term, term->kitty_target_session);
          }
 
          session->parse_state = PARSE_KITTY;
@@ -2251,6 +2432,8 @@ void ExecuteDECSCPP(KTerm* term, KTermSession* session) {
              }
              // Mark all rows dirty
              for(int r=0; r<session->rows; r++) session->row_dirty[r] = KTERM_DIRTY_FRAMES;
+             KTerm_ResetRowGenerations(session);
+             KTerm_DropHistoryReflow(session);
         }
     }
 }
@@ -2273,8 +2456,8 @@ void KTerm_ProcessChar(KTerm* term, KTermSession* session, unsigned char ch) {
         case PARSE_TEKTRONIX:
             {
                 KTermSession* target = session;
-                if (term->tektronix_target_session != -1 && term->tektronix_target_session >= 0 && term->tektronix_target_session < MAX_SESSIONS) {
-                    target = &term->sessions[term->tektronix_target_session];
+                if (KTerm_GetSession(term, term->tektronix_target_session)) {
+                    target = KTerm_GetSession(term, term->tektronix_target_session);
                 }
                 ProcessTektronixChar(term, target, ch);
             }
@@ -2282,8 +2465,8 @@ void KTerm_ProcessChar(KTerm* term, KTermSession* session, unsigned char ch) {
         case PARSE_REGIS:
             {
                 KTermSession* target = session;
-                if (term->regis_target_session != -1 && term->regis_target_session >= 0 && term->regis_target_session < MAX_SESSIONS) {
-                    target = &term->sessions[term->regis_target_session];
+                if (KTerm_GetSession(term, term->regis_target_session)) {
+                    target = KTerm_GetSession(term, term->regis_target_session);
                 }
                 ProcessReGISChar(term, target, ch);
             }
@@ -2291,8 +2474,8 @@ void KTerm_ProcessChar(KTerm* term, KTermSession* session, unsigned char ch) {
         case PARSE_KITTY:
             {
                 KTermSession* target = session;
-                if (term->kitty_target_session != -1 && term->kitty_target_session >= 0 && term->kitty_target_session < MAX_SESSIONS) {
-                    target = &term->sessions[term->kitty_target_session];
+                if (KTerm_GetSession(term, term->kitty_target_session)) {
+                    target = KTerm_GetSession(term, term->kitty_target_session);
                 }
                 KTerm_ProcessKittyChar(term, target, ch);
             }
@@ -2943,7 +3126,7 @@ void ExecuteDECERA(KTerm* term, KTermSession* session) {
         for (int x = left; x <= right; x++) {
             KTerm_ClearCell(term, GetActiveScreenCell(session, y, x));
         }
-        session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, y);
     }
 }
 
@@ -2994,46 +3177,76 @@ void ExecuteDECSERA(KTerm* term, KTermSession* session) {
                 KTerm_ClearCell(term, cell);
             }
         }
-        session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, y);
     }
 }
 
 void KTerm_ProcessOSCChar(KTerm* term, KTermSession* session, unsigned char ch) {
-    // Phase 7.2: Harden Escape Buffers (Bounds Check)
-    if ((size_t)session->escape_pos < sizeof(session->escape_buffer) - 1) {
-        if (ch == '\x1B') {
-            session->saved_parse_state = PARSE_OSC;
-            session->parse_state = PARSE_STRING_TERMINATOR;
-            return;
-        }
+    if (session->string_sink.write) {
+        KTerm_StreamStringChar(term, session, ch, PARSE_OSC);
+        return;
+    }
 
-        session->escape_buffer[session->escape_pos++] = ch;
+    if (ch == '\x1B') {
+        session->saved_parse_state = PARSE_OSC;
+        session->parse_state = PARSE_STRING_TERMINATOR;
+        return;
+    }
 
-        if (ch == '\a') {
-            session->escape_pos--; // exclude BEL
-            KTerm_DispatchSequence(term, session, PARSE_OSC);
-            session->parse_state = VT_PARSE_NORMAL;
-            session->escape_pos = 0;
-        }
-    } else {
+    if (ch == '\a') {
+        KTerm_DispatchSequence(term, session, PARSE_OSC);
+        session->parse_state = VT_PARSE_NORMAL;
+        return;
+    }
+
+    // Phase 7.2: Harden Escape Buffers (Bounds Check)
+    if (!KTerm_AppendEscapeChar(session, ch)) {
         KTerm_DispatchSequence(term, session, PARSE_OSC);
         session->parse_state = VT_PARSE_NORMAL;
-        session->escape_pos = 0;
         KTerm_LogUnsupportedSequence(term, "OSC sequence too long, truncated");
+        return;
+    }
+
+    // A header such as "52;c;" may hand the rest of the payload to a streaming handler
+    if (ch == ';' && session->escape_pos <= KTERM_STRING_HEADER_MAX) {
+        KTerm_OpenStringSink(term, session, PARSE_OSC);
     }
 }
 
 void KTerm_ProcessDCSChar(KTerm* term, KTermSession* session, unsigned char ch) {
+    if (session->string_sink.write) {
+        KTerm_StreamStringChar(term, session, ch, PARSE_DCS);
+        return;
+    }
+
+    if (ch == '\x1B') {
+        session->saved_parse_state = PARSE_DCS;
+        session->parse_state = PARSE_STRING_TERMINATOR;
+        return;
+    }
+
+    if (ch == '\a') { // Non-standard, but some terminals accept BEL for DCS
+        KTerm_DispatchSequence(term, session, PARSE_DCS);
+        session->parse_state = VT_PARSE_NORMAL;
+        return;
+    }
+
     // Phase 7.2: Harden Escape Buffers (Bounds Check)
-    if ((size_t)session->escape_pos < sizeof(session->escape_buffer) - 1) {
-        if (ch == '\x1B') {
-            session->saved_parse_state = PARSE_DCS;
-            session->parse_state = PARSE_STRING_TERMINATOR;
-            return;
-        }
+    if (!KTerm_AppendEscapeChar(session, ch)) { // Buffer overflow
+        KTerm_DispatchSequence(term, session, PARSE_DCS);
+        session->parse_state = VT_PARSE_NORMAL;
+        KTerm_LogUnsupportedSequence(term, "DCS sequence too long, truncated");
+        return;
+    }
 
-        session->escape_buffer[session->escape_pos++] = ch;
+    // A header such as "GATE;KTERM;1;PIPE;VT;B64;" may hand the rest of the payload to a streaming handler
+    if (ch == ';' && session->escape_pos <= KTERM_STRING_HEADER_MAX) {
+        KTerm_OpenStringSink(term, session, PARSE_DCS);
+        return;
+    }
 
+    // Only 'q' (Sixel) and 'p' (ReGIS) can end a protocol header
+    if (ch == 'q' || ch == 'p') {
         // Ensure this is not DECRQSS ($q)
         bool is_decrqss = (session->escape_pos >= 2 && session->escape_buffer[session->escape_pos - 2] == '$');
 
@@ -3053,8 +3266,8 @@ void KTerm_ProcessDCSChar(KTerm* term, KTermSession* session, unsigned char ch)
             // Sixel Graphics command
             // Determine Target Session
             KTermSession* target_session = session;
-            if (term->sixel_target_session >= 0 && term->sixel_target_session < MAX_SESSIONS) {
-                target_session = &term->sessions[term->sixel_target_session];
+            if (KTerm_GetSession(term, term->sixel_target_session)) {
+                target_session = KTerm_GetSession(term, term->sixel_target_session);
             }
 
             KTerm_ParseCSIParams(term, session->escape_buffer, target_session->sixel.params, MAX_ESCAPE_PARAMS);
@@ -3115,18 +3328,6 @@ void KTerm_ProcessDCSChar(KTerm* term, KTermSession* session, unsigned char ch)
             session->escape_pos = 0;
             return;
         }
-
-        if (ch == '\a') { // Non-standard, but some terminals accept BEL for DCS
-            session->escape_pos--; // exclude BEL
-            KTerm_DispatchSequence(term, session, PARSE_DCS);
-            session->parse_state = VT_PARSE_NORMAL;
-            session->escape_pos = 0;
-        }
-    } else { // Buffer overflow
-        KTerm_DispatchSequence(term, session, PARSE_DCS);
-        session->parse_state = VT_PARSE_NORMAL;
-        session->escape_pos = 0;
-        KTerm_LogUnsupportedSequence(term, "DCS sequence too long, truncated");
     }
 }
 
@@ -3414,7 +3615,7 @@ void KTerm_InitCompute(KTerm* term) {
             }
             KTerm_Free(shader_body);
         } else {
-             if (term->sessions[0].options.debug_sequences) KTerm_LogUnsupportedSequence(term, "Failed to load vector shader");
+             if (term->sessions[0]->options.debug_sequences) KTerm_LogUnsupportedSequence(term, "Failed to load vector shader");
         }
     }
 
@@ -3439,7 +3640,7 @@ void KTerm_InitCompute(KTerm* term) {
             }
             KTerm_Free(shader_body);
         } else {
-             if (term->sessions[0].options.debug_sequences) KTerm_LogUnsupportedSequence(term, "Failed to load sixel shader");
+             if (term->sessions[0]->options.debug_sequences) KTerm_LogUnsupportedSequence(term, "Failed to load sixel shader");
         }
     }
 
@@ -4033,6 +4234,8 @@ static void KTerm_ScrollUpRegion_Internal(KTerm* term, KTermSession* session, in
             for (int x = 0; x < term->width; x++) {
                 KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, bottom, x));
             }
+            KTerm_MarkRowDirty(session, bottom);
+            session->rows_scrolled++;
         }
         // Invalidate all viewport rows because the data under them has shifted
         for (int y = 0; y < term->height; y++) {
@@ -4049,14 +4252,14 @@ static void KTerm_ScrollUpRegion_Internal(KTerm* term, KTermSession* session, in
                 *GetActiveScreenCell(session, y, x) = *GetActiveScreenCell(session, y + 1, x);
                 GetActiveScreenCell(session, y, x)->flags |= KTERM_FLAG_DIRTY;
             }
-            session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, y);
         }
 
         // Clear bottom line of the region
         for (int x = session->left_margin; x <= session->right_margin; x++) {
             KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, bottom, x));
         }
-        session->row_dirty[bottom] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, bottom);
     }
 }
 
@@ -4082,14 +4285,14 @@ static void KTerm_ScrollDownRegion_Internal(KTerm* term, KTermSession* session,
                 *GetActiveScreenCell(session, y, x) = *GetActiveScreenCell(session, y - 1, x);
                 GetActiveScreenCell(session, y, x)->flags |= KTERM_FLAG_DIRTY;
             }
-            session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, y);
         }
 
         // Clear top line
         for (int x = session->left_margin; x <= session->right_margin; x++) {
             KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, top, x));
         }
-        session->row_dirty[top] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, top);
     }
 }
 
@@ -4118,7 +4321,7 @@ static void KTerm_InsertLinesAt_Internal(KTerm* term, KTermSession* session, int
                 *GetActiveScreenCell(session, y, x) = *GetActiveScreenCell(session, y - count, x);
                 GetActiveScreenCell(session, y, x)->flags |= KTERM_FLAG_DIRTY;
             }
-            session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, y);
     }
     }
 
@@ -4127,7 +4330,7 @@ static void KTerm_InsertLinesAt_Internal(KTerm* term, KTermSession* session, int
         for (int x = session->left_margin; x <= session->right_margin; x++) {
             KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, y, x));
         }
-        session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, y);
     }
 }
 
@@ -4164,7 +4367,7 @@ void KTerm_SetCellDirect(KTerm* term, int x, int y, EnhancedTermChar c) {
     if (cell) {
         *cell = c;
         cell->flags |= KTERM_FLAG_DIRTY;
-        if (y >= 0 && y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        if (y >= 0 && y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 }
 
@@ -4179,7 +4382,7 @@ void KTerm_MarkRegionDirty(KTerm* term, KTermRect rect) {
     if (bottom >= session->rows) bottom = session->rows - 1;
 
     for (int y = top; y <= bottom; y++) {
-        session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        KTerm_MarkRowDirty(session, y);
     }
 
     // Merge into dirty rect
@@ -4234,7 +4437,7 @@ static void KTerm_InsertCharactersAt_Internal(KTerm* term, KTermSession* session
     for (int x = col; x < col + count && x <= session->right_margin; x++) {
         KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, row, x));
     }
-    session->row_dirty[row] = KTERM_DIRTY_FRAMES;
+    KTerm_MarkRowDirty(session, row);
 }
 
 void KTerm_InsertCharactersAt(KTerm* term, int row, int col, int count) {
@@ -4258,7 +4461,7 @@ static void KTerm_DeleteCharactersAt_Internal(KTerm* term, KTermSession* session
             KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, row, x));
         }
     }
-    session->row_dirty[row] = KTERM_DIRTY_FRAMES;
+    KTerm_MarkRowDirty(session, row);
 }
 
 void KTerm_DeleteCharactersAt(KTerm* term, int row, int col, int count) {
@@ -4358,6 +4561,15 @@ void KTerm_InsertCharacterAtCursor(KTerm* term, unsigned int ch) {
     KTerm_InsertCharacterAtCursor_Internal(term, session, ch, width);
 }
 
+// Marks row y as continuing on the next one, so a resize can rewrap it. Queued so that it
+// lands after the row's last character. Rows wrapped inside side margins are not marked.
+static void KTerm_QueueSoftWrap(KTermSession* session, int y) {
+    if (session->left_margin != 0 || session->right_margin != session->cols - 1) return;
+    KTermRect rect = {session->cols - 1, y, 1, 1};
+    ExtendedKTermColor empty_color = {0};
+    KTerm_QueueSetAttrRect(session, rect, KTERM_FLAG_WRAPPED, KTERM_FLAG_WRAPPED, 0, false, empty_color, false, empty_color);
+}
+
 // =============================================================================
 // COMPREHENSIVE CHARACTER PROCESSING
 // =============================================================================
@@ -4470,6 +4682,7 @@ void KTerm_ProcessNormalChar(KTerm* term, KTermSession* session, unsigned char c
     if ((session->dec_modes & KTERM_MODE_DECAWM)) {
         if (session->cursor.x + width - 1 > session->right_margin) {
             // Auto-wrap to next line
+            KTerm_QueueSoftWrap(session, session->cursor.y);
             session->cursor.x = session->left_margin;
             session->cursor.y++;
 
@@ -4614,31 +4827,31 @@ void KTerm_ProcessEscapeChar(KTerm* term, KTermSession* session, unsigned char c
         // OSC - Operating System Command
         case ']':
             session->parse_state = PARSE_OSC;
-            session->escape_pos = 0;
+            KTerm_ResetEscapeBuffer(term, session);
             break;
 
         // DCS - Device Control String
         case 'P':
             session->parse_state = PARSE_DCS;
-            session->escape_pos = 0;
+            KTerm_ResetEscapeBuffer(term, session);
             break;
 
         // APC - Application Program Command
         case '_':
             session->parse_state = PARSE_APC;
-            session->escape_pos = 0;
+            KTerm_ResetEscapeBuffer(term, session);
             break;
 
         // PM - Privacy Message
         case '^':
             session->parse_state = PARSE_PM;
-            session->escape_pos = 0;
+            KTerm_ResetEscapeBuffer(term, session);
             break;
 
         // SOS - Start of String
         case 'X':
             session->parse_state = PARSE_SOS;
-            session->escape_pos = 0;
+            KTerm_ResetEscapeBuffer(term, session);
             break;
 
         // Character set selection
@@ -4824,7 +5037,7 @@ bool KTerm_WriteChar(KTerm* term, unsigned char ch) {
 
 size_t KTerm_PushInput(KTerm* term, const void* data, size_t length) {
     if (!term || !data) return 0;
-    KTermSession* session = &term->sessions[term->active_session];
+    KTermSession* session = GET_SESSION(term);
     return KTerm_InputQueue_Push(&session->input_queue, data, length);
 }
 
@@ -5108,8 +5321,8 @@ void KTerm_CopySelectionToClipboard(KTerm* term) {
 }
 
 void KTerm_WriteRawGraphics(KTerm* term, int session_index, const char* data, size_t len) {
-    if (session_index < 0 || session_index >= MAX_SESSIONS || !data) return;
-    KTermSession* session = &term->sessions[session_index];
+    KTermSession* session = KTerm_GetSession(term, session_index);
+    if (!session || !data) return;
 
     // Flush pending input to ensure correct ordering (Text before Graphics)
     unsigned char buf[1024];
@@ -5173,6 +5386,14 @@ void KTerm_SwapScreenBuffer(KTerm* term) {
     GET_SESSION(term)->screen_head = GET_SESSION(term)->alt_screen_head;
     GET_SESSION(term)->alt_screen_head = temp_head;
 
+    // Checkpoint tracking follows its buffer
+    uint32_t* temp_gen = session->row_generation;
+    session->row_generation = session->alt_row_generation;
+    session->alt_row_generation = temp_gen;
+    uint32_t temp_scrolled = session->rows_scrolled;
+    session->rows_scrolled = session->alt_rows_scrolled;
+    session->alt_rows_scrolled = temp_scrolled;
+
     if ((session->dec_modes & KTERM_MODE_ALTSCREEN)) {
         // Switching BACK to Main Screen
         GET_SESSION(term)->buffer_height = term->height + MAX_SCROLLBACK_LINES;
@@ -5256,10 +5477,7 @@ static void KTerm_ProcessEventsInternal(KTerm* term, KTermSession* session) {
         for (size_t i = 0; i < count; i++) {
             // Raw Dump Mirroring
             if (session->raw_dump.raw_dump_mirror_active) {
-                KTermSession* target_sess = NULL;
-                if (session->raw_dump.raw_dump_target_session_id >= 0 && session->raw_dump.raw_dump_target_session_id < MAX_SESSIONS) {
-                    target_sess = &term->sessions[session->raw_dump.raw_dump_target_session_id];
-                }
+                KTermSession* target_sess = KTerm_GetSession(term, session->raw_dump.raw_dump_target_session_id);
 
                 if (target_sess) {
                     // Check if we need one-time init (Clear/Reset)
@@ -5367,8 +5585,8 @@ void KTerm_ReportError(KTerm* term, KTermErrorLevel level, KTermErrorSource sour
         // Fallback: Print to stderr if level is ERROR or FATAL, or if generic debugging is on
         bool debug = false;
         // Basic check to see if session 0 might be initialized
-        if (term->sessions[0].screen_buffer) {
-             debug = term->sessions[0].status.debugging;
+        if (term->sessions && term->sessions[0] && term->sessions[0]->screen_buffer) {
+             debug = term->sessions[0]->status.debugging;
         }
 
         if (level >= KTERM_LOG_ERROR || debug) {
@@ -5799,6 +6017,7 @@ static void ExecuteED_Internal(KTerm* term, KTermSession* session, bool private_
                     KTerm_ClearCell_Internal(session, cell);
                 }
             }
+            for (int y = session->cursor.y; y < session->rows; y++) KTerm_MarkRowDirty(session, y);
             break;
 
         case 1: // Clear from beginning of screen to cursor
@@ -5816,6 +6035,7 @@ static void ExecuteED_Internal(KTerm* term, KTermSession* session, bool private_
                 if (private_mode && (cell->flags & KTERM_ATTR_PROTECTED)) continue;
                 KTerm_ClearCell(term, cell);
             }
+            for (int y = 0; y <= session->cursor.y; y++) KTerm_MarkRowDirty(session, y);
             break;
 
         case 2: // Clear entire screen
@@ -5825,6 +6045,7 @@ static void ExecuteED_Internal(KTerm* term, KTermSession* session, bool private_
                     if (private_mode && (cell->flags & KTERM_ATTR_PROTECTED)) continue;
                     KTerm_ClearCell(term, cell);
                 }
+                KTerm_MarkRowDirty(session, y);
             }
             if (session->conformance.level == VT_LEVEL_ANSI_SYS) {
                 session->cursor.x = 0;
@@ -5839,6 +6060,8 @@ static void ExecuteED_Internal(KTerm* term, KTermSession* session, bool private_
             }
             // Mark all rows dirty
             for(int r=0; r<session->rows; r++) session->row_dirty[r] = KTERM_DIRTY_FRAMES;
+            KTerm_ResetRowGenerations(session); // Scrollback changed too
+            KTerm_DropHistoryReflow(session);
             break;
 
         default:
@@ -5880,6 +6103,7 @@ static void ExecuteEL_Internal(KTerm* term, KTermSession* session, bool private_
             KTerm_LogUnsupportedSequence(term, "Unknown EL parameter");
             break;
     }
+    KTerm_MarkRowDirty(session, session->cursor.y);
 }
 void ExecuteEL(KTerm* term, bool private_mode) { ExecuteEL_Internal(term, GET_SESSION(term), private_mode); }
 
@@ -5890,6 +6114,7 @@ static void ExecuteECH_Internal(KTerm* term, KTermSession* session) { // Erase C
     for (int i = 0; i < n && session->cursor.x + i < session->cols; i++) {
         KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, session->cursor.y, session->cursor.x + i));
     }
+    KTerm_MarkRowDirty(session, session->cursor.y);
 }
 void ExecuteECH(KTerm* term, KTermSession* session) {
     if (!session) session = GET_SESSION(term); ExecuteECH_Internal(term, session); }
@@ -5938,6 +6163,7 @@ void ExecuteREP(KTerm* term, KTermSession* session) {
         for (int i = 0; i < n; i++) {
             if ((session->dec_modes & KTERM_MODE_DECAWM)) {
                 if (session->cursor.x + width - 1 > session->right_margin) {
+                    KTerm_QueueSoftWrap(session, session->cursor.y);
                     session->cursor.x = session->left_margin;
                     session->cursor.y++;
                     if (session->cursor.y > session->scroll_bottom) {
@@ -6313,7 +6539,7 @@ static void KTerm_SetModeInternal(KTerm* term, KTermSession* session, int mode,
                             for (int x = 0; x < cols; x++) {
                                 KTerm_ClearCell(term, GetScreenCell(session, y, x));
                             }
-                            session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+                            KTerm_MarkRowDirty(session, y);
     }
 
                         // 2. Reset Margins
@@ -6978,9 +7204,7 @@ static void ExecuteDSR(KTerm* term, KTermSession* session) {
             }
             case 30: { // Session State (ActiveID ; Count ; Region)
                 char response[64];
-                int id = 0;
-                for(int i=0; i<MAX_SESSIONS; i++) if(&term->sessions[i] == session) id = i;
-                snprintf(response, sizeof(response), "\x1B[?30;%d;%d;%d;%dn", id + 1, MAX_SESSIONS, session->cols, session->rows);
+                snprintf(response, sizeof(response), "\x1B[?30;%d;%d;%d;%dn", session->index + 1, term->live_session_count, session->cols, session->rows);
                 KTerm_QueueSessionResponse(term, session, response);
                 break;
             }
@@ -6997,14 +7221,15 @@ static void ExecuteDSR(KTerm* term, KTermSession* session) {
 
                 int limit = session->conformance.max_session_count;
                 if (limit == 0) limit = 1;
-                if (limit > MAX_SESSIONS) limit = MAX_SESSIONS;
+                if (limit > KTERM_SESSION_LIMIT) limit = KTERM_SESSION_LIMIT;
 
                 char response[MAX_COMMAND_BUFFER];
                 int offset = snprintf(response, sizeof(response), "\x1BP$p");
                 for (int i = 0; i < limit; i++) {
                     int seq = i + 1;
                     int status = 1; // Not open
-                    if (term->sessions[i].session_open) {
+                    KTermSession* s = KTerm_GetSession(term, i);
+                    if (s && s->session_open) {
                         status = (i == term->active_session) ? 2 : 3;
                     }
                     int attr = 0;
@@ -7700,11 +7925,11 @@ void ExecuteDECSN(KTerm* term, KTermSession* session) {
     // If param is omitted (0 returned by KTerm_GetCSIParam if 0 is default), VT520 DECSN usually defaults to 1.
     if (session_id == 0) session_id = 1;
 
-    // Use max_session_count from features if set, otherwise default to MAX_SESSIONS (or 1 if single session)
+    // Use max_session_count from features if set, otherwise default to 1 (single session)
     // Actually we should rely on max_session_count. If 0 (uninitialized safety), default to 1.
     int limit = session->conformance.max_session_count;
     if (limit == 0) limit = 1;
-    if (limit > MAX_SESSIONS) limit = MAX_SESSIONS;
+    if (limit > KTERM_SESSION_LIMIT) limit = KTERM_SESSION_LIMIT;
 
     if (session_id >= 1 && session_id <= limit) {
         // Respect Multi-Session Mode Lock
@@ -7718,7 +7943,8 @@ void ExecuteDECSN(KTerm* term, KTermSession* session) {
             return;
         }
 
-        if (term->sessions[session_id - 1].session_open) {
+        KTermSession* target = KTerm_GetSession(term, session_id - 1);
+        if (target && target->session_open) {
             KTerm_SetActiveSession(term, session_id - 1);
         } else {
             if (session->options.debug_sequences) {
@@ -7825,7 +8051,7 @@ void KTerm_ProcessCSIChar(KTerm* term, KTermSession* session, unsigned char ch)
     } else if (ch >= 0x20 && ch <= 0x3F) {
         // Accumulate intermediate characters (e.g., digits, ';', '?')
         // Phase 7.2: Harden Escape Buffers (Bounds Check)
-        if (session->escape_pos < MAX_COMMAND_BUFFER - 1) {
+        if (session->escape_pos < KTERM_ESCAPE_INLINE_SIZE - 1) {
             session->escape_buffer[session->escape_pos++] = ch;
             session->escape_buffer[session->escape_pos] = '\0';
         } else {
@@ -7835,7 +8061,7 @@ void KTerm_ProcessCSIChar(KTerm* term, KTermSession* session, unsigned char ch)
         }
     } else if (ch == '$') {
         // Handle multi-byte CSI sequences (e.g., CSI $ q, CSI $ u)
-        if (session->escape_pos < MAX_COMMAND_BUFFER - 1) {
+        if (session->escape_pos < KTERM_ESCAPE_INLINE_SIZE - 1) {
             session->escape_buffer[session->escape_pos++] = ch;
             session->escape_buffer[session->escape_pos] = '\0';
         } else {
@@ -8275,7 +8501,7 @@ void ProcessForegroundKTermColorCommand(KTerm* term, KTermSession* session, cons
         // Query foreground color
         char response[64];
         ExtendedKTermColor fg = GET_SESSION(term)->current_fg;
-        if (fg.color_mode == 0 && fg.value.index < 16) {
+        if (fg.color_mode == 0 && fg.value.index >= 0 && fg.value.index < 16) {
             RGB_KTermColor c = term->color_palette[fg.value.index];
             snprintf(response, sizeof(response), "\x1B]10;rgb:%02x/%02x/%02x\x1B\\", c.r, c.g, c.b);
         } else if (fg.color_mode == 1) {
@@ -8302,7 +8528,7 @@ void ProcessBackgroundKTermColorCommand(KTerm* term, KTermSession* session, cons
         // Query background color
         char response[64];
         ExtendedKTermColor bg = GET_SESSION(term)->current_bg;
-        if (bg.color_mode == 0 && bg.value.index < 16) {
+        if (bg.color_mode == 0 && bg.value.index >= 0 && bg.value.index < 16) {
             RGB_KTermColor c = term->color_palette[bg.value.index];
             snprintf(response, sizeof(response), "\x1B]11;rgb:%02x/%02x/%02x\x1B\\", c.r, c.g, c.b);
         } else if (bg.color_mode == 1) {
@@ -8329,7 +8555,7 @@ void ProcessCursorKTermColorCommand(KTerm* term, KTermSession* session, const ch
         // Query cursor color
         char response[64];
         ExtendedKTermColor cursor_color = GET_SESSION(term)->cursor.color;
-        if (cursor_color.color_mode == 0 && cursor_color.value.index < 16) {
+        if (cursor_color.color_mode == 0 && cursor_color.value.index >= 0 && cursor_color.value.index < 16) {
             RGB_KTermColor c = term->color_palette[cursor_color.value.index];
             snprintf(response, sizeof(response), "\x1B]12;rgb:%02x/%02x/%02x\x1B\\", c.r, c.g, c.b);
         } else if (cursor_color.color_mode == 1) {
@@ -8468,6 +8694,90 @@ void ProcessClipboardCommand(KTerm* term, KTermSession* session, const char* dat
     }
 }
 
+// OSC 52 streaming handler. The base64 payload is decoded as it arrives, so a large clipboard
+// copy never sits in the escape buffer. A payload of just "?" is a query. A write that decodes
+// to more than KTERM_CLIPBOARD_LIMIT bytes is dropped whole rather than set truncated.
+enum { KTERM_CLIPBOARD_SINK_EMPTY = 0, KTERM_CLIPBOARD_SINK_SET, KTERM_CLIPBOARD_SINK_QUERY, KTERM_CLIPBOARD_SINK_DISCARD };
+
+static bool KTerm_StringSinkReserve(KTermStringSink* sink, size_t extra) {
+    if (sink->len + extra <= sink->capacity) return true;
+    size_t capacity = sink->capacity ? sink->capacity : 256;
+    while (capacity < sink->len + extra) capacity *= 2;
+    unsigned char* data = (unsigned char*)KTerm_Realloc(sink->data, capacity);
+    if (!data) return false;
+    sink->data = data;
+    sink->capacity = capacity;
+    return true;
+}
+
+static void KTerm_ClipboardSinkWrite(KTerm* term, KTermSession* session, KTermStringSink* sink, const char* data, size_t len) {
+    (void)term; (void)session;
+    bool keep = (sink->selector == 'c' || sink->selector == '0');
+    for (size_t i = 0; i < len; i++) {
+        if (sink->mode == KTERM_CLIPBOARD_SINK_EMPTY) {
+            sink->mode = (data[i] == '?') ? KTERM_CLIPBOARD_SINK_QUERY : KTERM_CLIPBOARD_SINK_SET;
+        }
+        if (sink->mode != KTERM_CLIPBOARD_SINK_SET || !keep) continue;
+
+        int c = Base64Val(data[i]);
+        if (c == -1) continue; // Skip whitespace/invalid
+        sink->bits = (sink->bits << 6) | (uint32_t)c;
+        sink->bit_count += 6;
+        if (sink->bit_count >= 8) {
+            sink->bit_count -= 8;
+            if (sink->len >= KTERM_CLIPBOARD_LIMIT || !KTerm_StringSinkReserve(sink, 1)) {
+                sink->mode = KTERM_CLIPBOARD_SINK_DISCARD;
+                KTerm_Free(sink->data);
+                sink->data = NULL;
+                sink->len = sink->capacity = 0;
+                return;
+            }
+            sink->data[sink->len++] = (unsigned char)((sink->bits >> sink->bit_count) & 0xFF);
+        }
+    }
+}
+
+static void KTerm_ClipboardSinkEnd(KTerm* term, KTermSession* session, KTermStringSink* sink, bool complete) {
+    if (!complete) return;
+    if (sink->mode == KTERM_CLIPBOARD_SINK_QUERY) {
+        char query[4] = { sink->selector, ';', '?', '\0' };
+        ProcessClipboardCommand(term, session, query);
+    } else if (sink->mode == KTERM_CLIPBOARD_SINK_SET && (sink->selector == 'c' || sink->selector == '0') && KTerm_StringSinkReserve(sink, 1)) {
+        sink->data[sink->len] = '\0';
+        KTerm_SetClipboardText((const char*)sink->data);
+    }
+}
+
+static bool KTerm_OpenClipboardSink(KTermSession* session, const char* header, size_t len) {
+    // "52;<Pc>;" with a single-character selection, as ProcessClipboardCommand reads it
+    if (len < 4 || strncmp(header, "52;", 3) != 0 || header[len - 1] != ';') return false;
+    if (memchr(header + 3, ';', len - 4) != NULL) return false;
+    KTermStringSink* sink = &session->string_sink;
+    sink->write = KTerm_ClipboardSinkWrite;
+    sink->end = KTerm_ClipboardSinkEnd;
+    sink->selector = header[3];
+    return true;
+}
+
+// Called at each ';' of an OSC/DCS header; installs a streaming handler if one claims it.
+static bool KTerm_OpenStringSink(KTerm* term, KTermSession* session, VTParseState type) {
+    const char* header = session->escape_buffer;
+    size_t len = (size_t)session->escape_pos;
+    bool opened = false;
+    if (type == PARSE_OSC) {
+        opened = KTerm_OpenClipboardSink(session, header, len);
+    }
+#ifdef KTERM_ENABLE_GATEWAY
+    else if (type == PARSE_DCS) {
+        opened = KTerm_Gateway_OpenStringSink(term, session, header, len);
+    }
+#else
+    (void)term;
+#endif
+    if (opened) session->escape_pos = 0; // The header is consumed; only payload is buffered from here
+    return opened;
+}
+
 void KTerm_ExecuteOSCCommand(KTerm* term, KTermSession* session) {
     StreamScanner scanner = { .ptr = session->escape_buffer, .len = strlen(session->escape_buffer), .pos = 0 };
 
@@ -9289,7 +9599,7 @@ void KTerm_ProcessHashChar(KTerm* term, KTermSession* session, unsigned char ch)
                 cell->flags &= ~KTERM_ATTR_DOUBLE_HEIGHT_BOT;
                 cell->flags |= (KTERM_ATTR_DOUBLE_HEIGHT_TOP | KTERM_ATTR_DOUBLE_WIDTH | KTERM_FLAG_DIRTY);
             }
-            session->row_dirty[session->cursor.y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, session->cursor.y);
             break;
 
         case '4': // DECDHL - Double-height line, bottom half
@@ -9298,7 +9608,7 @@ void KTerm_ProcessHashChar(KTerm* term, KTermSession* session, unsigned char ch)
                 cell->flags &= ~KTERM_ATTR_DOUBLE_HEIGHT_TOP;
                 cell->flags |= (KTERM_ATTR_DOUBLE_HEIGHT_BOT | KTERM_ATTR_DOUBLE_WIDTH | KTERM_FLAG_DIRTY);
             }
-            session->row_dirty[session->cursor.y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, session->cursor.y);
             break;
 
         case '5': // DECSWL - Single-width single-height line
@@ -9307,7 +9617,7 @@ void KTerm_ProcessHashChar(KTerm* term, KTermSession* session, unsigned char ch)
                 cell->flags &= ~(KTERM_ATTR_DOUBLE_HEIGHT_TOP | KTERM_ATTR_DOUBLE_HEIGHT_BOT | KTERM_ATTR_DOUBLE_WIDTH);
                 cell->flags |= KTERM_FLAG_DIRTY;
             }
-            session->row_dirty[session->cursor.y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, session->cursor.y);
             break;
 
         case '6': // DECDWL - Double-width single-height line
@@ -9316,7 +9626,7 @@ void KTerm_ProcessHashChar(KTerm* term, KTermSession* session, unsigned char ch)
                 cell->flags &= ~(KTERM_ATTR_DOUBLE_HEIGHT_TOP | KTERM_ATTR_DOUBLE_HEIGHT_BOT);
                 cell->flags |= (KTERM_ATTR_DOUBLE_WIDTH | KTERM_FLAG_DIRTY);
             }
-            session->row_dirty[session->cursor.y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, session->cursor.y);
             break;
 
         case '8': // DECALN - Screen Alignment Pattern
@@ -9330,6 +9640,7 @@ void KTerm_ProcessHashChar(KTerm* term, KTermSession* session, unsigned char ch)
                     // Reset attributes
                     cell->flags = KTERM_FLAG_DIRTY;
                 }
+                KTerm_MarkRowDirty(session, y);
             }
             session->cursor.x = 0;
             session->cursor.y = 0;
@@ -10762,6 +11073,7 @@ void KTerm_ProcessVT52Char(KTerm* term, KTermSession* session, unsigned char ch)
                         KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, y, x));
                     }
                 }
+                for (int y = session->cursor.y; y < term->height; y++) KTerm_MarkRowDirty(session, y);
                 session->parse_state = VT_PARSE_NORMAL;
                 break;
 
@@ -10769,6 +11081,7 @@ void KTerm_ProcessVT52Char(KTerm* term, KTermSession* session, unsigned char ch)
                 for (int x = session->cursor.x; x < term->width; x++) {
                     KTerm_ClearCell_Internal(session, GetActiveScreenCell(session, session->cursor.y, x));
                 }
+                KTerm_MarkRowDirty(session, session->cursor.y);
                 session->parse_state = VT_PARSE_NORMAL;
                 break;
 
@@ -10881,8 +11194,8 @@ void KTerm_ProcessSixelChar(KTerm* term, KTermSession* session, unsigned char ch
 
     // Determine Target Session
     KTermSession* target_session = session;
-    if (term->sixel_target_session >= 0 && term->sixel_target_session < MAX_SESSIONS) {
-        target_session = &term->sessions[term->sixel_target_session];
+    if (KTerm_GetSession(term, term->sixel_target_session)) {
+        target_session = KTerm_GetSession(term, term->sixel_target_session);
     }
 
     // 1. Check for digits across all states that consume them
@@ -11786,8 +12099,9 @@ void KTerm_Update(KTerm* term) {
     int saved_session = term->active_session;
 
     // Process all sessions
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTermSession* session = &term->sessions[i];
+    for (int n = 0; n < term->live_session_count; n++) {
+        int i = term->live_sessions[n];
+        KTermSession* session = term->sessions[i];
 
         KTERM_MUTEX_LOCK(session->lock); // Lock Session (Phase 3)
 
@@ -11803,6 +12117,9 @@ void KTerm_Update(KTerm* term) {
         // Flush queued operations to the grid
         KTerm_FlushOps(term, session);
 
+        // Rewrap any scrollback a resize left behind that the view now reaches
+        KTerm_ReflowHistory(session, session->view_offset);
+
         KTERM_MUTEX_UNLOCK(session->lock); // Unlock Session (Phase 3)
 
         // Update timers and bells for this session
@@ -12116,12 +12433,31 @@ void KTerm_Draw(KTerm* term) {
 // --- Lifecycle Management ---
 
 static void KTerm_CleanupSession(KTermSession* session) {
+#ifndef KTERM_DISABLE_VOICE
+    KTerm_Voice_Destroy(session);
+#endif
+    KTerm_FreeOpQueue(&session->op_queue);
+    if (session->string_sink.data) {
+        KTerm_Free(session->string_sink.data);
+        session->string_sink.data = NULL;
+    }
+    if (session->escape_buffer && session->escape_buffer != session->escape_inline) {
+        KTerm_Free(session->escape_buffer);
+    }
+    session->escape_buffer = session->escape_inline;
+    session->escape_capacity = KTERM_ESCAPE_INLINE_SIZE;
+    if (session->input.buffer) {
+        KTerm_Free(session->input.buffer);
+        session->input.buffer = NULL;
+    }
+
+    KTerm_DropHistoryReflow(session);
     if (session->screen_buffer) {
-        KTerm_Free(session->screen_buffer);
+        KTerm_FreeGrid(session, session->screen_buffer);
         session->screen_buffer = NULL;
     }
     if (session->alt_buffer) {
-        KTerm_Free(session->alt_buffer);
+        KTerm_FreeGrid(session, session->alt_buffer);
         session->alt_buffer = NULL;
     }
 
@@ -12134,6 +12470,7 @@ static void KTerm_CleanupSession(KTermSession* session) {
         KTerm_Free(session->row_dirty);
         session->row_dirty = NULL;
     }
+    KTerm_ResetRowGenerations(session);
 
     // Free Kitty Graphics resources per session
     if (session->kitty.images) {
@@ -12251,8 +12588,8 @@ void KTerm_Cleanup(KTerm* term) {
     KTermCompositor_Cleanup(&term->compositor);
 
     // Free session buffers
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTerm_CleanupSession(&term->sessions[i]);
+    for (int n = 0; n < term->live_session_count; n++) {
+        KTerm_CleanupSession(term->sessions[term->live_sessions[n]]);
     }
 
     // Free Vector Engine resources
@@ -12268,12 +12605,21 @@ void KTerm_Cleanup(KTerm* term) {
         term->row_scratch_buffer = NULL;
     }
 
-    KTerm_ClearEvents(term); // Ensure input pipeline is empty and reset
+    if (term->sessions && term->sessions[term->active_session]) KTerm_ClearEvents(term); // Ensure input pipeline is empty and reset
 
-    // Destroy Locks (Phase 3)
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        KTERM_MUTEX_DESTROY(term->sessions[i].lock);
+    // Destroy Locks (Phase 3) and the sessions themselves
+    for (int n = 0; n < term->live_session_count; n++) {
+        KTermSession* session = term->sessions[term->live_sessions[n]];
+        KTERM_MUTEX_DESTROY(session->lock);
+        KTerm_Free(session);
     }
+    KTerm_Free(term->sessions);
+    KTerm_Free(term->live_sessions);
+    term->sessions = NULL;
+    term->live_sessions = NULL;
+    term->session_capacity = 0;
+    term->live_session_count = 0;
+    KTERM_MUTEX_DESTROY(term->session_table_lock);
     KTERM_MUTEX_DESTROY(term->lock);
 
     if (term->layout) {
@@ -12369,26 +12715,49 @@ int main(void) {
 // OP QUEUE & FLUSHING
 // =============================================================================
 
+// Keeps the ring (if any) so a re-initialised session does not reallocate it
 void KTerm_InitOpQueue(KTermOpQueue* queue) {
     queue->head = 0;
     queue->tail = 0;
     queue->count = 0;
 }
 
+void KTerm_FreeOpQueue(KTermOpQueue* queue) {
+    if (queue->ops) KTerm_Free(queue->ops);
+    queue->ops = NULL;
+    queue->capacity = 0;
+    KTerm_InitOpQueue(queue);
+}
+
 bool KTerm_IsOpQueueFull(KTermOpQueue* queue) {
     return queue->count >= KTERM_OP_QUEUE_SIZE;
 }
 
+// Doubles the ring, unrolling pending ops to the front. Caller holds op_queue_lock.
+static bool KTerm_GrowOpQueue(KTermOpQueue* queue) {
+    int capacity = queue->capacity ? queue->capacity * 2 : KTERM_OP_QUEUE_INITIAL;
+    if (capacity > KTERM_OP_QUEUE_SIZE) capacity = KTERM_OP_QUEUE_SIZE;
+    KTermOp* ops = (KTermOp*)KTerm_Malloc(capacity * sizeof(KTermOp));
+    if (!ops) return false;
+    for (int i = 0; i < queue->count; i++) ops[i] = queue->ops[(queue->head + i) % queue->capacity];
+    if (queue->ops) KTerm_Free(queue->ops);
+    queue->ops = ops;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = queue->count % capacity;
+    return true;
+}
+
 bool KTerm_QueueOp(KTermSession* session, KTermOp op) {
     if (!session) return false;
     KTermOpQueue* queue = &session->op_queue;
     KTERM_MUTEX_LOCK(session->op_queue_lock);
-    if (KTerm_IsOpQueueFull(queue)) {
+    if (KTerm_IsOpQueueFull(queue) || (queue->count == queue->capacity && !KTerm_GrowOpQueue(queue))) {
         KTERM_MUTEX_UNLOCK(session->op_queue_lock);
         return false;
     }
     queue->ops[queue->tail] = op;
-    queue->tail = (queue->tail + 1) % KTERM_OP_QUEUE_SIZE;
+    queue->tail = (queue->tail + 1) % queue->capacity;
     queue->count++;
     KTERM_MUTEX_UNLOCK(session->op_queue_lock);
     return true;
@@ -12486,6 +12855,22 @@ void KTerm_QueueScrollRegion(KTermSession* session, KTermRect rect, int dy) {
 }
 
 void KTerm_QueueResize(KTermSession* session, int cols, int rows, bool reflow) {
+    // A resize still waiting in the queue is superseded rather than applied: window drags
+    // queue many per frame, and each applied one rebuilds the screen.
+    KTermOpQueue* queue = &session->op_queue;
+    KTERM_MUTEX_LOCK(session->op_queue_lock);
+    if (queue->count > 0) {
+        KTermOp* last = &queue->ops[(queue->tail + queue->capacity - 1) % queue->capacity];
+        if (last->type == KTERM_OP_RESIZE_GRID) {
+            last->u.resize.new_width = cols;
+            last->u.resize.new_height = rows;
+            last->u.resize.reflow_scrollback = reflow;
+            KTERM_MUTEX_UNLOCK(session->op_queue_lock);
+            return;
+        }
+    }
+    KTERM_MUTEX_UNLOCK(session->op_queue_lock);
+
     KTermOp op;
     op.type = KTERM_OP_RESIZE_GRID;
     op.u.resize.new_width = cols;
@@ -12616,6 +13001,130 @@ size_t KTerm_InputQueue_Pop(KTermInputQueue* queue, void* buffer, size_t max_len
     return to_read;
 }
 
+// --- Resize Reflow ---
+//
+// Rows that wrapped automatically carry KTERM_FLAG_WRAPPED on their last cell, so a run of
+// them is one logical line that a resize can rewrap to the new width. The screen, plus the
+// line continuing into its top row, is rewrapped when the resize is applied. Scrollback
+// stays in the previous ring and is rewrapped newest line first as it is scrolled into view.
+
+static inline EnhancedTermChar* KTerm_Reflow_Row(const KTermReflowSource* ring, int y) {
+    int idx = (ring->head + y) % ring->height;
+    if (idx < 0) idx += ring->height;
+    return &ring->buffer[(size_t)idx * ring->cols];
+}
+
+static inline bool KTerm_Reflow_IsWrapped(const KTermReflowSource* ring, int y) {
+    return ring->rewrap && (KTerm_Reflow_Row(ring, y)[ring->cols - 1].flags & KTERM_FLAG_WRAPPED);
+}
+
+static bool KTerm_Reflow_IsBlank(const EnhancedTermChar* cell) {
+    return (cell->ch == ' ' || cell->ch == 0) && !(cell->flags & (KTERM_ATTR_REVERSE | KTERM_ATTR_UNDERLINE)) &&
+           cell->bg_color.color_mode == 0 && cell->bg_color.value.index == COLOR_BLACK;
+}
+
+// Cells of row y up to its last non-blank one
+static int KTerm_Reflow_RowLength(const KTermReflowSource* ring, int y) {
+    const EnhancedTermChar* row = KTerm_Reflow_Row(ring, y);
+    int len = ring->cols;
+    while (len > 0 && KTerm_Reflow_IsBlank(&row[len - 1])) len--;
+    return len;
+}
+
+static void KTerm_Reflow_Put(KTermReflowSource* dst, int y, int min_y, int x, const EnhancedTermChar* cell) {
+    if (!dst || y < min_y) return;
+    EnhancedTermChar* out = &KTerm_Reflow_Row(dst, y)[x];
+    *out = *cell;
+    out->flags = (out->flags & ~KTERM_FLAG_WRAPPED) | KTERM_FLAG_DIRTY;
+}
+
+// Lays out the first `len` cells of the logical line starting at src row `first` at `cols`
+// columns and returns the number of rows it takes. With dst, the rows are written to dst
+// rows y, y + 1, ..., skipping any above min_y. *cursor, a cell offset into the line, is
+// replaced by the offset it moves to.
+static int KTerm_Reflow_Layout(KTermSession* session, const KTermReflowSource* src, int first, int len,
+                               KTermReflowSource* dst, int cols, int y, int min_y, int* cursor) {
+    EnhancedTermChar blank = {
+        .ch = ' ',
+        .fg_color = {.color_mode = 0, .value.index = COLOR_WHITE},
+        .bg_color = {.color_mode = 0, .value.index = COLOR_BLACK},
+        .flags = KTERM_FLAG_DIRTY
+    };
+    int from = cursor ? *cursor : -1;
+    bool placed = false;
+    int p = 0;
+    for (int i = 0; i < len; i++) {
+        int sx = i % src->cols;
+        const EnhancedTermChar* row = KTerm_Reflow_Row(src, first + i / src->cols);
+        bool wide = session->enable_wide_chars && KTerm_wcwidth(row[sx].ch) == 2;
+        if (src->rewrap) {
+            // Padding left at the end of a row by a wide character that did not fit
+            if (sx == src->cols - 1 && i + 1 < len && KTerm_Reflow_IsBlank(&row[sx]) && session->enable_wide_chars &&
+                KTerm_wcwidth(KTerm_Reflow_Row(src, first + i / src->cols + 1)[0].ch) == 2) {
+                if (i == from) { *cursor = p; placed = true; }
+                continue;
+            }
+            if (wide && cols > 1 && p % cols == cols - 1) {
+                KTerm_Reflow_Put(dst, y + p / cols, min_y, p % cols, &blank);
+                p++;
+            }
+        } else if (p == cols) {
+            break; // Clipped
+        }
+        if (i == from) { *cursor = p; placed = true; }
+        KTerm_Reflow_Put(dst, y + p / cols, min_y, p % cols, &row[sx]);
+        p++;
+    }
+    if (from >= 0 && !placed) *cursor = p;
+
+    int n = (p + cols - 1) / cols;
+    if (n < 1) n = 1;
+    if (dst) {
+        for (; p < n * cols; p++) KTerm_Reflow_Put(dst, y + p / cols, min_y, p % cols, &blank);
+        for (int k = 0; k < n - 1; k++) {
+            if (y + k >= min_y) KTerm_Reflow_Row(dst, y + k)[cols - 1].flags |= KTERM_FLAG_WRAPPED;
+        }
+    }
+    return n;
+}
+
+// Rewraps whole logical lines from the newest end of src onto the oldest end of the main
+// screen's scrollback until it holds `lines` rows. Returns false once the scrollback is full,
+// as anything left in src is then older than every row kept.
+static bool KTerm_Reflow_Pull(KTermSession* session, KTermReflowSource* src, int lines) {
+    bool alt = (session->dec_modes & KTERM_MODE_ALTSCREEN) != 0;
+    KTermReflowSource dst = {
+        alt ? session->alt_buffer : session->screen_buffer, session->cols, session->rows + MAX_SCROLLBACK_LINES,
+        alt ? session->alt_screen_head : session->screen_head, 0, 0, true
+    };
+    while (src->next >= src->oldest && session->history_rows_populated < lines) {
+        int populated = session->history_rows_populated;
+        if (populated >= MAX_SCROLLBACK_LINES) break;
+        int first = src->next;
+        while (first > src->oldest && KTerm_Reflow_IsWrapped(src, first - 1)) first--;
+        int len = (src->next - first) * src->cols + KTerm_Reflow_RowLength(src, src->next);
+        int n = KTerm_Reflow_Layout(session, src, first, len, NULL, dst.cols, 0, 0, NULL);
+        KTerm_Reflow_Layout(session, src, first, len, &dst, dst.cols, -(populated + n), -MAX_SCROLLBACK_LINES, NULL);
+        session->history_rows_populated = (populated + n < MAX_SCROLLBACK_LINES) ? populated + n : MAX_SCROLLBACK_LINES;
+        src->next = first - 1;
+    }
+    return session->history_rows_populated < MAX_SCROLLBACK_LINES;
+}
+
+// Rewraps scrollback left at its old width by a resize until at least `lines` rows of it
+// are in the ring (or none is left). KTerm_Update calls this for the current view_offset.
+void KTerm_ReflowHistory(KTermSession* session, int lines) {
+    if (!session || !session->reflow.buffer) return;
+    int before = session->history_rows_populated;
+    if (!KTerm_Reflow_Pull(session, &session->reflow, lines) || session->reflow.next < session->reflow.oldest) {
+        KTerm_DropHistoryReflow(session);
+    }
+    if (session->history_rows_populated != before) {
+        for (int r = 0; r < session->rows; r++) session->row_dirty[r] = KTERM_DIRTY_FRAMES;
+        KTerm_ResetRowGenerations(session); // Rows appeared behind any checkpoint chain
+    }
+}
+
 static void KTerm_ApplyResizeOp(KTerm* term, KTermSession* session, KTermOp* op) {
     int cols = op->u.resize.new_width;
     int rows = op->u.resize.new_height;
@@ -12627,15 +13136,33 @@ static void KTerm_ApplyResizeOp(KTerm* term, KTermSession* session, KTermOp* op)
 
     int old_cols = session->cols;
     int old_rows = session->rows;
+    bool alt = (session->dec_modes & KTERM_MODE_ALTSCREEN) != 0;
 
     // Calculate new dimensions
     int new_buffer_height = rows + MAX_SCROLLBACK_LINES;
 
-    // --- Screen Buffer Resize & Content Preservation (Viewport) ---
+    // The main screen's ring (alt_buffer while the alternate screen is active). Its
+    // scrollback is not copied here; only the rows that end up on screen are written.
+    KTermReflowSource old = {
+        alt ? session->alt_buffer : session->screen_buffer, old_cols, old_rows + MAX_SCROLLBACK_LINES,
+        alt ? session->alt_screen_head : session->screen_head, -1, -session->history_rows_populated,
+        op->u.resize.reflow_scrollback
+    };
+
+    // Rewrap from the start of the line that continues into the top row down to the last
+    // row with content (or the cursor)
+    int first = 0;
+    while (first > old.oldest && KTerm_Reflow_IsWrapped(&old, first - 1)) first--;
+    int last = alt ? 0 : session->cursor.y;
+    if (last >= old_rows) last = old_rows - 1;
+    for (int y = old_rows - 1; y > last; y--) {
+        if (KTerm_Reflow_RowLength(&old, y) > 0) { last = y; break; }
+    }
+
+    // Allocate everything before committing changes to avoid partial failure
     EnhancedTermChar* new_screen_buffer = (EnhancedTermChar*)KTerm_Calloc(new_buffer_height * cols, sizeof(EnhancedTermChar));
     if (!new_screen_buffer) return;
 
-    // Allocate new aux buffers before committing changes to avoid partial failure
     uint8_t* new_row_dirty = (uint8_t*)KTerm_Calloc(rows, sizeof(uint8_t));
     if (!new_row_dirty) {
         KTerm_Free(new_screen_buffer);
@@ -12649,6 +13176,15 @@ static void KTerm_ApplyResizeOp(KTerm* term, KTermSession* session, KTermOp* op)
         return;
     }
 
+    // New logical row of each old row in [first, old_rows), before the shift below
+    int* row_map = (int*)KTerm_Malloc((old_rows - first) * sizeof(int));
+    if (!row_map) {
+        KTerm_Free(new_screen_buffer);
+        KTerm_Free(new_row_dirty);
+        KTerm_Free(new_alt_buffer);
+        return;
+    }
+
     // Default char for initialization
     EnhancedTermChar default_char = {
         .ch = ' ',
@@ -12657,146 +13193,149 @@ static void KTerm_ApplyResizeOp(KTerm* term, KTermSession* session, KTermOp* op)
         .flags = KTERM_FLAG_DIRTY
     };
 
-    // Copy visible viewport AND history from old buffer
-    int copy_rows = (old_rows < rows) ? old_rows : rows;
-    int copy_cols = (old_cols < cols) ? old_cols : cols;
-
-    // Optimize: Only copy populated history
-    int start_y = -session->history_rows_populated;
-    if (start_y < -MAX_SCROLLBACK_LINES) start_y = -MAX_SCROLLBACK_LINES;
-
-    // Initialize new buffer (Optimized: Only init areas not covered by copy)
-    // 1. Initialize Gap (Rows that will not be touched by copy loop)
-    // The copy loop covers:
-    //   Viewport: [0, copy_rows)
-    //   History:  [new_buffer_height + start_y, new_buffer_height)
-    // So the gap is [copy_rows, new_buffer_height + start_y)
-
-    int history_start_idx = new_buffer_height + start_y;
-    // Safety clamp
-    if (history_start_idx < copy_rows) history_start_idx = copy_rows;
-
-    for (int r = copy_rows; r < history_start_idx; r++) {
-        for (int c = 0; c < cols; c++) {
-            new_screen_buffer[r * cols + c] = default_char;
-        }
-    }
-
-    // 2. Initialize Right Margin for Copied Rows (if expanded horizontally)
-    if (cols > copy_cols) {
-        // For Viewport rows [0, copy_rows)
-        for (int r = 0; r < copy_rows; r++) {
-            for (int c = copy_cols; c < cols; c++) {
-                new_screen_buffer[r * cols + c] = default_char;
+    // --- Screen Rewrap ---
+    // Pass 0 counts the rows each line takes and follows the cursor; pass 1 writes them,
+    // moved up by `shift` so that the bottom lands on screen and the rest in scrollback.
+    KTermReflowSource dst = { new_screen_buffer, cols, new_buffer_height, 0, 0, 0, true };
+    int out_rows = 0, shift = 0;
+    int cursor_row = 0, cursor_col = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        out_rows = 0;
+        for (int a = first; a <= last; ) {
+            int b = a;
+            while (b < last && KTerm_Reflow_IsWrapped(&old, b)) b++;
+            int len = (b - a) * old_cols + KTerm_Reflow_RowLength(&old, b);
+            int cursor = -1;
+            if (!alt && session->cursor.y >= a && session->cursor.y <= b) {
+                cursor = (session->cursor.y - a) * old_cols + session->cursor.x;
+                int total = (b - a + 1) * old_cols;
+                if (len <= cursor) len = (cursor < total) ? cursor + 1 : total;
+            }
+            if (pass == 0) {
+                int n = KTerm_Reflow_Layout(session, &old, a, len, NULL, cols, 0, 0, cursor >= 0 ? &cursor : NULL);
+                for (int r = a; r <= b; r++) {
+                    int k = old.rewrap ? ((r - a) * old_cols) / cols : 0;
+                    row_map[r - first] = out_rows + (k < n ? k : n - 1);
+                }
+                if (cursor >= 0) {
+                    cursor_row = out_rows + cursor / cols;
+                    cursor_col = cursor % cols;
+                    if (cursor_col == 0 && cursor > 0 && cursor / cols >= n) {
+                        cursor_row--; // Pending wrap at the end of the line
+                        cursor_col = cols;
+                    }
+                }
+                out_rows += n;
+            } else {
+                out_rows += KTerm_Reflow_Layout(session, &old, a, len, &dst, cols, out_rows - shift, -MAX_SCROLLBACK_LINES, NULL);
             }
+            a = b + 1;
         }
-
-        // For History rows [history_start_idx, new_buffer_height)
-        for (int r = history_start_idx; r < new_buffer_height; r++) {
-            for (int c = copy_cols; c < cols; c++) {
-                new_screen_buffer[r * cols + c] = default_char;
-            }
+        if (pass == 0) {
+            for (int r = last + 1; r < old_rows; r++) row_map[r - first] = out_rows + (r - last - 1);
+            shift = (out_rows > rows) ? out_rows - rows : 0;
         }
     }
+    for (int r = out_rows - shift; r < rows; r++) {
+        for (int c = 0; c < cols; c++) new_screen_buffer[r * cols + c] = default_char;
+    }
+    int history = (shift < MAX_SCROLLBACK_LINES) ? shift : MAX_SCROLLBACK_LINES;
 
-    // Iterate from oldest history line to bottom of visible viewport
-    for (int y = start_y; y < copy_rows; y++) {
-        // Get pointer to source row in ring buffer (relative to active head)
-        EnhancedTermChar* src_row_ptr = GetActiveScreenRow(session, y);
-
-        // Calculate Destination Row Index in new linear buffer (Head=0)
-        // Viewport (y>=0) -> [0, copy_rows-1]
-        // History (y<0)   -> [new_buffer_height + y]
-        int dst_row_idx;
-        if (y >= 0) dst_row_idx = y;
-        else dst_row_idx = new_buffer_height + y;
-
-        // Safety check
-        if (dst_row_idx >= 0 && dst_row_idx < new_buffer_height) {
-            EnhancedTermChar* dst_row_ptr = &new_screen_buffer[dst_row_idx * cols];
-
-            // Copy row content (up to min width)
+    // --- Alternate Screen (clipped, not rewrapped) ---
+    for (int k = 0; k < rows * cols; k++) new_alt_buffer[k] = default_char;
+    if (alt) {
+        int copy_rows = (old_rows < rows) ? old_rows : rows;
+        int copy_cols = (old_cols < cols) ? old_cols : cols;
+        for (int y = 0; y < copy_rows; y++) {
+            EnhancedTermChar* src_row_ptr = GetActiveScreenRow(session, y);
             for (int x = 0; x < copy_cols; x++) {
-                dst_row_ptr[x] = src_row_ptr[x];
-                dst_row_ptr[x].flags |= KTERM_FLAG_DIRTY; // Force redraw
+                new_alt_buffer[y * cols + x] = src_row_ptr[x];
+                new_alt_buffer[y * cols + x].flags |= KTERM_FLAG_DIRTY;
             }
         }
     }
 
     // --- Remap Kitty Image start_row ---
     if (session->kitty.images) {
-        int old_head = session->screen_head;
-        int old_height = session->buffer_height;
-        int history = session->history_rows_populated;
-
         for (int k = 0; k < session->kitty.image_count; k++) {
             KittyImageBuffer* img = &session->kitty.images[k];
 
-            // Calculate logical offset from the old top-left (screen_head)
-            // Range: 0 to old_height-1
-            // 0 = Top of visible screen, old_height-1 = Bottom of history (one line above top)
-            int offset = (img->start_row - old_head + old_height) % old_height;
-
-            int logical_y = 0;
+            // Logical row in the old main ring: 0 = top of screen, negative = scrollback
+            int offset = ((img->start_row - old.head) % old.height + old.height) % old.height;
+            int logical_y = (offset < old_rows) ? offset : offset - old.height;
 
-            if (offset < old_rows) {
-                // Visible region (0 to old_rows-1)
-                logical_y = offset;
-            } else if (offset >= old_height - history) {
-                // History region (negative Y mapped to end of buffer logic)
-                logical_y = offset - old_height;
+            int new_y;
+            if (logical_y >= first) {
+                new_y = row_map[logical_y - first] - shift;
+            } else if (logical_y >= old.oldest && cols == old_cols && old.rewrap) {
+                // Left for later rewrapping; at the same width it lands in the same place
+                new_y = logical_y - first - history;
             } else {
-                // Image is in the "discarded" history gap. Mark invisible.
+                // Image is in the discarded history gap, or in scrollback that will be rewrapped
                 img->visible = false;
                 continue;
             }
-
-            // Safety check for deep history aliasing
-            if (logical_y < 0 && -logical_y >= new_buffer_height) {
+            if (new_y >= rows || new_y < -MAX_SCROLLBACK_LINES) {
                 img->visible = false;
                 continue;
             }
-
-            // Calculate NEW absolute index in the NEW buffer (Head=0)
-            int new_start_row;
-            if (logical_y >= 0) {
-                new_start_row = logical_y;
-            } else {
-                new_start_row = new_buffer_height + logical_y;
-            }
-
-            // Clamp
-            if (new_start_row < 0) new_start_row += new_buffer_height;
-            new_start_row %= new_buffer_height;
-
-            img->start_row = new_start_row;
+            img->start_row = (new_y + new_buffer_height) % new_buffer_height;
         }
     }
+    KTerm_Free(row_map);
 
     // Commit changes
-    if (session->screen_buffer) KTerm_Free(session->screen_buffer);
-    session->screen_buffer = new_screen_buffer;
+    EnhancedTermChar* old_main = old.buffer;
+    KTerm_FreeGrid(session, alt ? session->screen_buffer : session->alt_buffer);
+    if (alt) {
+        session->screen_buffer = new_alt_buffer;
+        session->alt_buffer = new_screen_buffer;
+        session->buffer_height = rows;
+    } else {
+        session->screen_buffer = new_screen_buffer;
+        session->alt_buffer = new_alt_buffer;
+        session->buffer_height = new_buffer_height;
+    }
 
     if (session->row_dirty) KTerm_Free(session->row_dirty);
     session->row_dirty = new_row_dirty;
     for (int r = 0; r < rows; r++) session->row_dirty[r] = KTERM_DIRTY_FRAMES;
 
-    if (session->alt_buffer) KTerm_Free(session->alt_buffer);
-    session->alt_buffer = new_alt_buffer;
-    for (int k = 0; k < rows * cols; k++) session->alt_buffer[k] = default_char;
     session->alt_screen_head = 0;
+    session->history_rows_populated = history;
+    KTerm_ResetRowGenerations(session);
 
     session->cols = cols;
     session->rows = rows;
-    session->buffer_height = new_buffer_height;
 
     // Reset ring buffer state
     session->screen_head = 0;
     session->view_offset = 0;
     session->saved_view_offset = 0;
 
+    // --- Scrollback: kept in the old ring until it is scrolled into view ---
+    old.next = first - 1;
+    if (!session->reflow.buffer) {
+        if (old.next >= old.oldest && history < MAX_SCROLLBACK_LINES) {
+            session->reflow = old;
+            old_main = NULL;
+        }
+    } else if (!KTerm_Reflow_Pull(session, &old, MAX_SCROLLBACK_LINES)) {
+        // Scrollback rewrapped since the previous resize is newer than what that resize left
+        // behind, so it is rewrapped now and the older rows stay deferred
+        KTerm_DropHistoryReflow(session);
+    }
+    if (old_main) KTerm_FreeGrid(session, old_main);
+
     // Clamp cursor
-    if (session->cursor.x >= cols) session->cursor.x = cols - 1;
+    if (!alt) {
+        session->cursor.y = cursor_row - shift;
+        session->cursor.x = cursor_col;
+        if (session->cursor.y < 0) session->cursor.y = 0;
+        if (session->cursor.x > cols) session->cursor.x = cols;
+    } else if (session->cursor.x >= cols) {
+        session->cursor.x = cols - 1;
+    }
     if (session->cursor.y >= rows) session->cursor.y = rows - 1;
 
     // Reset margins
@@ -12829,12 +13368,8 @@ static void KTerm_ApplyResizeOp(KTerm* term, KTermSession* session, KTermOp* op)
     // Force full dirty
     session->dirty_rect = (KTermRect){0, 0, cols, rows};
 
-    // Calculate index using pointer arithmetic
-    ptrdiff_t idx = session - term->sessions;
-    if (idx >= 0 && idx < MAX_SESSIONS) {
-        if (term->session_resize_callback) {
-            term->session_resize_callback(term, (int)idx, cols, rows);
-        }
+    if (term->session_resize_callback) {
+        term->session_resize_callback(term, session->index, cols, rows);
     }
 }
 
@@ -12855,7 +13390,7 @@ static void KTerm_ApplyFillRectOp(KTermSession* session, KTermOp* op) {
                 cell->flags |= KTERM_FLAG_DIRTY;
             }
         }
-        if (y >= 0 && y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        if (y >= 0 && y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
     if (session->dirty_rect.w == 0) {
@@ -12900,7 +13435,7 @@ static void KTerm_ApplyFillRectMaskedOp(KTermSession* session, KTermOp* op) {
                 cell->flags |= KTERM_FLAG_DIRTY;
             }
         }
-        if (y >= 0 && y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        if (y >= 0 && y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
     // Update Dirty Rect
@@ -12955,7 +13490,7 @@ static void KTerm_ApplyCopyRectOp(KTermSession* session, KTermOp* op) {
             }
         }
         if (dest_y + y >= 0 && dest_y + y < session->rows) {
-            session->row_dirty[dest_y + y] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, dest_y + y);
         }
     }
     KTerm_Free(temp);
@@ -12978,7 +13513,7 @@ static void KTerm_ApplyCopyRectOp(KTermSession* session, KTermOp* op) {
                 }
             }
             if (src.y + y >= 0 && src.y + y < session->rows) {
-                session->row_dirty[src.y + y] = KTERM_DIRTY_FRAMES;
+                KTerm_MarkRowDirty(session, src.y + y);
             }
         }
     }
@@ -13043,7 +13578,7 @@ static void KTerm_ApplySetAttrRectOp(KTermSession* session, KTermOp* op) {
                 cell->flags = new_flags | KTERM_FLAG_DIRTY;
             }
         }
-        if (y >= 0 && y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+        if (y >= 0 && y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
     // Update dirty rect
@@ -13087,7 +13622,7 @@ static void KTerm_ApplyVerticalOp(KTermSession *session, KTermOp *op) {
                      dst->flags |= KTERM_FLAG_DIRTY;
                  }
              }
-             if (y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+             if (y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
         // Clear inserted lines at top
@@ -13096,7 +13631,7 @@ static void KTerm_ApplyVerticalOp(KTermSession *session, KTermOp *op) {
                  EnhancedTermChar* cell = GetActiveScreenCell(session, y, x);
                  if (cell) KTerm_ClearCell_Internal(session, cell);
              }
-             if (y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+             if (y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
     } else { // DELETE: Shift Up
@@ -13110,7 +13645,7 @@ static void KTerm_ApplyVerticalOp(KTermSession *session, KTermOp *op) {
                      dst->flags |= KTERM_FLAG_DIRTY;
                  }
             }
-             if (y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+             if (y < session->rows) KTerm_MarkRowDirty(session, y);
     }
 
         // Clear bottom lines
@@ -13119,7 +13654,7 @@ static void KTerm_ApplyVerticalOp(KTermSession *session, KTermOp *op) {
                  EnhancedTermChar* cell = GetActiveScreenCell(session, y, x);
                  if (cell) KTerm_ClearCell_Internal(session, cell);
              }
-             if (y < session->rows) session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+             if (y < session->rows) KTerm_MarkRowDirty(session, y);
     }
     }
 
@@ -13164,9 +13699,12 @@ static void KTerm_ApplyScrollOp(KTermSession* session, KTermOp* op) {
                 for (int c = 0; c < session->cols; c++) {
                     KTerm_ClearCell_Internal(session, &row_ptr[c]);
                 }
+                if (session->row_generation) session->row_generation[new_row_idx] = session->grid_generation;
+                session->rows_scrolled++;
 
                 screen_head++;
                 if (screen_head >= buffer_height) screen_head = 0;
+                if (session->history_rows_populated < buffer_height - rows) session->history_rows_populated++;
                 if (session->view_offset > 0) session->view_offset++;
             }
             session->screen_head = screen_head;
@@ -13181,7 +13719,7 @@ static void KTerm_ApplyScrollOp(KTermSession* session, KTermOp* op) {
                             dst->flags |= KTERM_FLAG_DIRTY;
                         }
                     }
-                     session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+                     KTerm_MarkRowDirty(session, y);
     }
                 for (int x = x_start; x <= x_end; x++) {
                     EnhancedTermChar* cell = GetActiveScreenCell(session, bottom, x);
@@ -13190,7 +13728,7 @@ static void KTerm_ApplyScrollOp(KTermSession* session, KTermOp* op) {
                         cell->flags |= KTERM_FLAG_DIRTY;
                     }
                 }
-                session->row_dirty[bottom] = KTERM_DIRTY_FRAMES;
+                KTerm_MarkRowDirty(session, bottom);
             }
         }
     } else { // Scroll Down
@@ -13204,7 +13742,7 @@ static void KTerm_ApplyScrollOp(KTermSession* session, KTermOp* op) {
                         dst->flags |= KTERM_FLAG_DIRTY;
                     }
                 }
-                session->row_dirty[y] = KTERM_DIRTY_FRAMES;
+                KTerm_MarkRowDirty(session, y);
     }
             for (int x = x_start; x <= x_end; x++) {
                 EnhancedTermChar* cell = GetActiveScreenCell(session, top, x);
@@ -13213,7 +13751,7 @@ static void KTerm_ApplyScrollOp(KTermSession* session, KTermOp* op) {
                     cell->flags |= KTERM_FLAG_DIRTY;
                 }
             }
-            session->row_dirty[top] = KTERM_DIRTY_FRAMES;
+            KTerm_MarkRowDirty(session, top);
         }
     }
 
@@ -13249,7 +13787,7 @@ void KTerm_FlushOps(KTerm* term, KTermSession* session) {
                     EnhancedTermChar* cell = GetActiveScreenCell(session, op->u.set_cell.y, op->u.set_cell.x);
                     if (cell) {
                         *cell = op->u.set_cell.cell;
-                        if (op->u.set_cell.y < session->rows) session->row_dirty[op->u.set_cell.y] = KTERM_DIRTY_FRAMES;
+                        if (op->u.set_cell.y < session->rows) KTerm_MarkRowDirty(session, op->u.set_cell.y);
 
                         int x = op->u.set_cell.x;
                         int y = op->u.set_cell.y;
@@ -13291,7 +13829,7 @@ void KTerm_FlushOps(KTerm* term, KTermSession* session) {
                 break;
         }
 
-        queue->head = (queue->head + 1) % KTERM_OP_QUEUE_SIZE;
+        queue->head = (queue->head + 1) % queue->capacity;
         queue->count--;
     }
     KTERM_MUTEX_UNLOCK(session->op_queue_lock);
@@ -13396,7 +13934,7 @@ static void KTerm_ResetSessionDefaults(KTerm* term, KTermSession* session) {
     session->programmable_keys.count = 0;
     session->programmable_keys.capacity = 0;
 
-    ptrdiff_t index = session - term->sessions;
+    int index = session->index;
     snprintf(session->title.terminal_name, sizeof(session->title.terminal_name), "Session %d", (int)index + 1);
     snprintf(session->title.window_title, sizeof(session->title.window_title), "KTerm Session %d", (int)index + 1);
     snprintf(session->title.icon_title, sizeof(session->title.icon_title), "Term %d", (int)index + 1);
@@ -13413,7 +13951,7 @@ static void KTerm_ResetSessionDefaults(KTerm* term, KTermSession* session) {
     session->VTperformance.adaptive_processing = true;
 
     session->parse_state = VT_PARSE_NORMAL;
-    session->escape_pos = 0;
+    KTerm_ResetEscapeBuffer(term, session);
     session->param_count = 0;
 
     session->options.conformance_checking = true;
@@ -13455,7 +13993,8 @@ static void KTerm_ResetSessionDefaults(KTerm* term, KTermSession* session) {
 }
 
 bool KTerm_InitSession(KTerm* term, int index) {
-    KTermSession* session = &term->sessions[index];
+    KTermSession* session = KTerm_GetSession(term, index);
+    if (!session) return false;
 
     session->last_cursor_y = -1;
 
@@ -13496,14 +14035,15 @@ bool KTerm_InitSession(KTerm* term, int index) {
     session->view_offset = 0;
     session->saved_view_offset = 0;
 
-    if (session->screen_buffer) KTerm_Free(session->screen_buffer);
+    KTerm_DropHistoryReflow(session);
+    if (session->screen_buffer) KTerm_FreeGrid(session, session->screen_buffer);
     session->screen_buffer = (EnhancedTermChar*)KTerm_Calloc(session->buffer_height * session->cols, sizeof(EnhancedTermChar));
     if (!session->screen_buffer) {
         KTerm_ReportError(term, KTERM_LOG_FATAL, KTERM_SOURCE_SYSTEM, "Failed to allocate screen buffer for session %d", index);
         return false;
     }
 
-    if (session->alt_buffer) KTerm_Free(session->alt_buffer);
+    if (session->alt_buffer) KTerm_FreeGrid(session, session->alt_buffer);
     // Alt buffer is typically fixed size (no scrollback)
     session->alt_buffer = (EnhancedTermChar*)KTerm_Calloc(session->rows * session->cols, sizeof(EnhancedTermChar));
     if (!session->alt_buffer) {
@@ -13537,6 +14077,7 @@ bool KTerm_InitSession(KTerm* term, int index) {
     for (int y = 0; y < session->rows; y++) {
         session->row_dirty[y] = KTERM_DIRTY_FRAMES;
     }
+    KTerm_ResetRowGenerations(session);
 
     KTerm_ResetSessionDefaults(term, session);
 
@@ -13546,21 +14087,105 @@ bool KTerm_InitSession(KTerm* term, int index) {
     return true;
 }
 
-void KTerm_SetResponseEnabled(KTerm* term, int session_index, bool enable) {
-    if (session_index >= 0 && session_index < MAX_SESSIONS) {
-        term->sessions[session_index].response_enabled = enable;
+KTermSession* KTerm_GetSession(KTerm* term, int index) {
+    if (!term || index < 0 || index >= term->session_capacity) return NULL;
+    return term->sessions[index];
+}
+
+int KTerm_GetSessionCount(KTerm* term) {
+    return term ? term->live_session_count : 0;
+}
+
+// Doubles the session table (slot pointers and the live index list) until index fits.
+static bool KTerm_GrowSessionTable(KTerm* term, int index) {
+    int capacity = term->session_capacity ? term->session_capacity : MAX_SESSIONS;
+    while (capacity <= index) capacity *= 2;
+    if (capacity > KTERM_SESSION_LIMIT) capacity = KTERM_SESSION_LIMIT;
+
+    KTermSession** sessions = (KTermSession**)KTerm_Realloc(term->sessions, capacity * sizeof(KTermSession*));
+    if (!sessions) return false;
+    term->sessions = sessions;
+    int* live = (int*)KTerm_Realloc(term->live_sessions, capacity * sizeof(int));
+    if (!live) return false;
+    term->live_sessions = live;
+    memset(term->sessions + term->session_capacity, 0, (capacity - term->session_capacity) * sizeof(KTermSession*));
+    term->session_capacity = capacity;
+    return true;
+}
+
+// Looks up an existing session from a thread other than the one running KTerm_Update. The table
+// lock keeps the slot array from being reallocated under the read and hides half-built sessions.
+static KTermSession* KTerm_GetSessionShared(KTerm* term, int index) {
+    if (!term || !term->sessions || index < 0) return NULL;
+    KTERM_MUTEX_LOCK(term->session_table_lock);
+    KTermSession* session = (index < term->session_capacity) ? term->sessions[index] : NULL;
+    KTERM_MUTEX_UNLOCK(term->session_table_lock);
+    return session;
+}
+
+KTermSession* KTerm_AcquireSession(KTerm* term, int index) {
+    if (!term || index < 0 || index >= KTERM_SESSION_LIMIT) return NULL;
+    if (index < term->session_capacity && term->sessions[index]) return term->sessions[index];
+
+    KTERM_MUTEX_LOCK(term->session_table_lock);
+    if (index >= term->session_capacity && !KTerm_GrowSessionTable(term, index)) {
+        KTERM_MUTEX_UNLOCK(term->session_table_lock);
+        return NULL;
+    }
+
+    KTermSession* session = (KTermSession*)KTerm_Calloc(1, sizeof(KTermSession));
+    if (!session) {
+        KTERM_MUTEX_UNLOCK(term->session_table_lock);
+        return NULL;
+    }
+    session->index = index;
+    KTERM_MUTEX_INIT(session->lock);
+    term->sessions[index] = session;
+    if (!KTerm_InitSession(term, index)) {
+        KTerm_CleanupSession(session);
+        KTERM_MUTEX_DESTROY(session->lock);
+        KTerm_Free(session);
+        term->sessions[index] = NULL;
+        KTERM_MUTEX_UNLOCK(term->session_table_lock);
+        return NULL;
     }
+
+    KTerm_InitSessionModes(term, session);
+    term->live_sessions[term->live_session_count++] = index;
+    KTERM_MUTEX_UNLOCK(term->session_table_lock);
+    return session;
+}
+
+int KTerm_OpenSession(KTerm* term) {
+    if (!term) return -1;
+    int index = -1;
+    for (int i = 0; i < term->session_capacity && index < 0; i++) {
+        if (!term->sessions[i] || !term->sessions[i]->session_open) index = i;
+    }
+    if (index < 0) index = term->session_capacity;
+
+    // A closed session is reset, as if it had just been created
+    if (term->sessions && index < term->session_capacity && term->sessions[index] && !KTerm_InitSession(term, index)) return -1;
+    KTermSession* session = KTerm_AcquireSession(term, index);
+    if (!session) return -1;
+    session->session_open = true;
+    return index;
+}
+
+void KTerm_SetResponseEnabled(KTerm* term, int session_index, bool enable) {
+    KTermSession* session = KTerm_GetSessionShared(term, session_index);
+    if (session) session->response_enabled = enable;
 }
 
 void KTerm_SetActiveSession(KTerm* term, int index) {
-    if (index >= 0 && index < MAX_SESSIONS) {
+    if (KTerm_AcquireSession(term, index)) {
         // Only switch if actually changing
         if (term->active_session != index) {
             term->active_session = index;
             term->pending_session_switch = index;
 
             // Force redraw of the newly active session
-            KTermSession* new_session = &term->sessions[index];
+            KTermSession* new_session = term->sessions[index];
             for(int y = 0; y < term->height; y++) {
                 if (y < new_session->rows) {
                     new_session->row_dirty[y] = KTERM_DIRTY_FRAMES;
@@ -13584,29 +14209,37 @@ void KTerm_SetSplitScreen(KTerm* term, bool active, int row, int top_idx, int bo
     term->split_screen_active = active;
     if (active) {
         term->split_row = row;
-        if (top_idx >= 0 && top_idx < MAX_SESSIONS) term->session_top = top_idx;
-        if (bot_idx >= 0 && bot_idx < MAX_SESSIONS) term->session_bottom = bot_idx;
+        if (KTerm_AcquireSession(term, top_idx)) term->session_top = top_idx;
+        if (KTerm_AcquireSession(term, bot_idx)) term->session_bottom = bot_idx;
 
         // Invalidate both sessions to force redraw
         for(int y=0; y<term->height; y++) {
-            term->sessions[term->session_top].row_dirty[y] = KTERM_DIRTY_FRAMES;
-            term->sessions[term->session_bottom].row_dirty[y] = KTERM_DIRTY_FRAMES;
+            term->sessions[term->session_top]->row_dirty[y] = KTERM_DIRTY_FRAMES;
+            term->sessions[term->session_bottom]->row_dirty[y] = KTERM_DIRTY_FRAMES;
         }
     } else {
         // Invalidate active session
          for(int y=0; y<term->height; y++) {
-            term->sessions[term->active_session].row_dirty[y] = KTERM_DIRTY_FRAMES;
+            GET_SESSION(term)->row_dirty[y] = KTERM_DIRTY_FRAMES;
         }
     }
 }
 
 
 void KTerm_WriteCharToSession(KTerm* term, int session_index, unsigned char ch) {
-    if (session_index >= 0 && session_index < MAX_SESSIONS) {
-        KTerm_WriteCharToSessionInternal(term, &term->sessions[session_index], ch);
+    KTermSession* session = KTerm_GetSessionShared(term, session_index);
+    if (session) {
+        KTerm_WriteCharToSessionInternal(term, session, ch);
     }
 }
 
+size_t KTerm_WriteToSession(KTerm* term, int session_index, const void* data, size_t length) {
+    if (!term || !data) return 0;
+    KTermSession* session = KTerm_GetSessionShared(term, session_index);
+    if (!session) return 0;
+    return KTerm_InputQueue_Push(&session->input_queue, data, length);
+}
+
 // Helper to resize a specific session
 // Phase 3: The caller MUST hold session->lock if calling this function.
 
@@ -13719,17 +14352,19 @@ static void KTerm_ResizeSession_Internal(KTerm* term, KTermSession* session, int
     }
 
     // Commit changes
-    if (session->screen_buffer) KTerm_Free(session->screen_buffer);
+    KTerm_DropHistoryReflow(session);
+    if (session->screen_buffer) KTerm_FreeGrid(session, session->screen_buffer);
     session->screen_buffer = new_screen_buffer;
 
     if (session->row_dirty) KTerm_Free(session->row_dirty);
     session->row_dirty = new_row_dirty;
     for (int r = 0; r < rows; r++) session->row_dirty[r] = KTERM_DIRTY_FRAMES;
 
-    if (session->alt_buffer) KTerm_Free(session->alt_buffer);
+    if (session->alt_buffer) KTerm_FreeGrid(session, session->alt_buffer);
     session->alt_buffer = new_alt_buffer;
     for (int k = 0; k < rows * cols; k++) session->alt_buffer[k] = default_char;
     session->alt_screen_head = 0;
+    KTerm_ResetRowGenerations(session);
 
     session->cols = cols;
     session->rows = rows;
@@ -13772,8 +14407,8 @@ static void KTerm_ResizeSession_Internal(KTerm* term, KTermSession* session, int
 }
 }
 static void KTerm_ResizeSession(KTerm* term, int session_index, int cols, int rows) {
-    if (session_index < 0 || session_index >= MAX_SESSIONS) return;
-    KTermSession* session = &term->sessions[session_index];
+    KTermSession* session = KTerm_GetSession(term, session_index);
+    if (!session) return;
 
     KTerm_QueueResize(session, cols, rows, true);
 
@@ -13783,23 +14418,10 @@ static void KTerm_ResizeSession(KTerm* term, int session_index, int cols, int ro
 KTermPane* KTerm_SplitPane(KTerm* term, KTermPane* target_pane, KTermPaneType split_type, float ratio) {
     if (!term->layout) return NULL;
 
-    // Find a free session for the new pane
-    int new_session_idx = -1;
-    for (int i = 0; i < MAX_SESSIONS; i++) {
-        if (!term->sessions[i].session_open) {
-             new_session_idx = i;
-             break;
-        }
-    }
-
+    // Take a free (or new) session for the new pane
+    int new_session_idx = KTerm_OpenSession(term);
     if (new_session_idx == -1) return NULL;
 
-    // Initialize the new session
-    if (!KTerm_InitSession(term, new_session_idx)) {
-        return NULL;
-    }
-    term->sessions[new_session_idx].session_open = true;
-
     return KTermLayout_Split(term->layout, target_pane, split_type, ratio, new_session_idx, KTerm_LayoutResizeCallback, term);
 }
 
@@ -13811,9 +14433,8 @@ void KTerm_ClosePane(KTerm* term, KTermPane* pane) {
     KTermLayout_Close(term->layout, pane, KTerm_LayoutResizeCallback, term);
 
     // Close session
-    if (session_idx >= 0 && session_idx < MAX_SESSIONS) {
-        term->sessions[session_idx].session_open = false;
-    }
+    KTermSession* closed = KTerm_GetSession(term, session_idx);
+    if (closed) closed->session_open = false;
 
     // Update active session if needed
     if (term->layout->focused && term->layout->focused->session_index >= 0) {
@@ -13853,8 +14474,8 @@ void KTerm_Resize(KTerm* term, int cols, int rows) {
     } else {
         // Fallback for initialization or if tree is missing (should verify)
         // Resize all active sessions to full size (legacy behavior)
-        for(int i=0; i<MAX_SESSIONS; i++) {
-             KTerm_ResizeSession(term, i, cols, rows);
+        for(int n=0; n<term->live_session_count; n++) {
+             KTerm_ResizeSession(term, term->live_sessions[n], cols, rows);
         }
     }
 
@@ -14226,14 +14847,24 @@ void KTerm_QueueInputEvent(KTerm* term, KTermKeyEvent event) {
 
     // Route input to the focused pane's session if available
     if (term->layout && term->layout->focused && term->layout->focused->type == PANE_LEAF && term->layout->focused->session_index >= 0) {
-        session = &term->sessions[term->layout->focused->session_index];
-    } else {
+        session = KTerm_AcquireSession(term, term->layout->focused->session_index);
+    }
+    if (!session) {
         // Fallback to legacy active session
         session = GET_SESSION(term);
     }
 
     int next_head = (session->input.buffer_head + 1) % KEY_EVENT_BUFFER_SIZE;
 
+    // The consumer only reads the buffer once buffer_head moves, so it is published with the first event
+    if (!session->input.buffer) {
+        session->input.buffer = (KTermKeyEvent*)KTerm_Malloc(KEY_EVENT_BUFFER_SIZE * sizeof(KTermKeyEvent));
+        if (!session->input.buffer) {
+            session->input.dropped_events++;
+            return;
+        }
+    }
+
     if (next_head != session->input.buffer_tail) {
         session->input.buffer[session->input.buffer_head] = event;
         atomic_store_explicit(&session->input.buffer_head, next_head, memory_order_release);
@@ -14417,7 +15048,7 @@ bool KTerm_ProcessEvent(KTerm* term, KTermSession* session, const KTermEvent* ev
              break;
 
         case KTERM_EVENT_RESIZE:
-            KTerm_ResizeSession(term, (int)(session - term->sessions), event->resize.w, event->resize.h);
+            KTerm_ResizeSession(term, session->index, event->resize.w, event->resize.h);
             return true;
 
         case KTERM_EVENT_FOCUS:
@@ -1425,7 +1425,7 @@ int main(int argc, char** argv) {
     if (!term) return 1;
 
     KTerm_Net_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // Register Extension
     KTerm_RegisterGatewayExtension(term, "automate", KTerm_Ext_Automate);
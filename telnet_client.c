@@ -251,7 +251,7 @@ int main(int argc, char** argv) {
 
     // 3. Network Setup
     KTerm_Net_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // Store initial size
     client_state.term_width = config.width;
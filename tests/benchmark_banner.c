@@ -52,7 +52,7 @@ int main() {
         return 1;
     }
     KTerm_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     printf("Running Banner Benchmark...\n");
     benchmark_banner_generation(term, session);
@@ -99,7 +99,7 @@ int main() {
         return 1;
     }
     KTerm_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     printf("Running Diagnostics Benchmarks...\n");
     benchmark_speedtest_rendering(term, session);
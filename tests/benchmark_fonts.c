@@ -22,7 +22,7 @@ int main() {
         return 1;
     }
     KTerm_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     printf("Running Font Listing Benchmark...\n");
 
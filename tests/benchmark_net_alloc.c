@@ -23,12 +23,14 @@ struct KTermSession_T {
 };
 
 struct KTerm_T {
-    KTermSession sessions[MAX_SESSIONS];
+    KTermSession* sessions[MAX_SESSIONS];
+    int session_capacity;
     void (*response_callback)(KTerm* term, const char* data, int len);
 };
 
 // Forward Declarations of Mocks
 void KTerm_WriteCharToSession(KTerm* term, int session_idx, unsigned char c);
+KTermSession* KTerm_AcquireSession(KTerm* term, int index);
 void KTerm_WriteString(KTerm* term, const char* str);
 void KTerm_Resize(KTerm* term, int w, int h);
 void KTerm_SetOutputSink(KTerm* term, void (*sink)(void*, KTermSession*, const char*, size_t), void* user_data);
@@ -42,6 +44,7 @@ void KTerm_SetOutputSink(KTerm* term, void (*sink)(void*, KTermSession*, const c
 
 // Mock Implementations
 void KTerm_WriteCharToSession(KTerm* term, int session_idx, unsigned char c) {}
+KTermSession* KTerm_AcquireSession(KTerm* term, int index) { return (index >= 0 && index < term->session_capacity) ? term->sessions[index] : NULL; }
 void KTerm_WriteString(KTerm* term, const char* str) {}
 void KTerm_Resize(KTerm* term, int w, int h) {}
 void KTerm_SetOutputSink(KTerm* term, void (*sink)(void*, KTermSession*, const char*, size_t), void* user_data) {}
@@ -56,7 +59,10 @@ int main() {
 
     // Setup minimal session context for GetContext
     KTerm term = {0};
-    KTermSession* session = &term.sessions[0];
+    KTermSession session0 = {0};
+    KTermSession* session = &session0;
+    term.sessions[0] = session;
+    term.session_capacity = 1;
     session->user_data = calloc(1, sizeof(KTermNetSession)); // Mock NetSession
 
     for (int i = 0; i < ITERATIONS; i++) {
@@ -4,6 +4,8 @@
 #define KTERM_TESTING
 #define KTERM_ENABLE_PACKETDIAG
 #define KTERM_USE_BUNDLED_PCAP
+#define KTERM_PACKETDIAG_TPACKET
+#define KTERM_PACKETDIAG_DEFAULT_TPACKET 0 // The other tests drive the mocked libpcap path
 
 #include "../kterm.h"
 #include "test_utilities.h"
@@ -118,6 +120,746 @@ void test_packetdiag_control(KTerm* term, KTermSession* session) {
     KTerm_Net_DestroyContext(session);
 }
 
+void test_packetdiag_workers(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag Worker Pool...\n");
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=3")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    if (ctx->worker_count != 3) { fprintf(stderr, "Expected 3 workers, got %d\n", ctx->worker_count); exit(1); }
+
+    // The mock pcap_loop returns immediately; act as the capture thread from here
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+
+    // 64 UDP flows x 10 packets, Ethernet + IPv4 + UDP
+    uint8_t pkt[64] = {0};
+    pkt[12] = 0x08;
+    pkt[14] = 0x45; pkt[23] = 17;
+    pkt[26] = 10; pkt[29] = 1;
+    pkt[30] = 10; pkt[33] = 2;
+    pkt[39] = 30;                      // UDP len: 8 + 22 payload
+    struct pcap_pkthdr hdr = {0};
+    hdr.caplen = hdr.len = sizeof(pkt);
+    for (int i = 0; i < 640; i++) {
+        int f = i % 64;
+        pkt[29] = (uint8_t)(1 + f);             // Workers are picked by address pair
+        pkt[34] = 0x30; pkt[35] = (uint8_t)f;  // sport 12288 + f
+        pkt[36] = 0x13; pkt[37] = 0x88;        // dport 5000
+        PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+    }
+
+    char buf[512] = {0};
+    for (int t = 0; t < 2000; t++) {
+        KTerm_Net_PacketDiag_GetStats(term, session, buf, sizeof(buf));
+        if (strncmp(buf, "PKTS=640;", 9) == 0) break;
+        usleep(1000);
+    }
+    if (strncmp(buf, "PKTS=640;", 9) != 0 || !strstr(buf, "UDP=640")) { fprintf(stderr, "Workers did not dissect all packets: %s\n", buf); exit(1); }
+
+    // Flows are spread over workers, each flow owned by exactly one
+    int busy = 0, flows = 0;
+    for (int w = 0; w < ctx->worker_count; w++) {
+        int n = (int)ctx->shards[w].flows.count;
+        if (n) busy++;
+        flows += n;
+    }
+    if (flows != 64 || busy < 2) { fprintf(stderr, "Flow sharding wrong: %d flows on %d workers\n", flows, busy); exit(1); }
+
+    if (!KTerm_Net_PacketDiag_GetDetail(term, session, 639, buf, sizeof(buf)) || !strstr(buf, "PACKET 639")) {
+        fprintf(stderr, "Detail lookup across workers failed\n"); exit(1);
+    }
+    KTerm_Net_PacketDiag_GetStatus(term, session, buf, sizeof(buf));
+    if (!strstr(buf, "WORKERS=3;DROPPED=0")) { fprintf(stderr, "Bad status: %s\n", buf); exit(1); }
+
+    KTerm_Net_ProcessPacketDiag(term, session);
+    for (int w = 0; w < ctx->worker_count; w++) {
+        if (atomic_load(&ctx->shards[w].ev_head) != atomic_load(&ctx->shards[w].ev_tail)) { fprintf(stderr, "Event ring not drained\n"); exit(1); }
+    }
+
+    KTerm_Net_DestroyContext(session);
+}
+
+void test_packetdiag_flow_table(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag Flow Table...\n");
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;flows=1000;flow_idle=30")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+
+    uint8_t pkt[64] = {0};
+    pkt[12] = 0x08;
+    pkt[14] = 0x45; pkt[23] = 6;
+    pkt[26] = 10;
+    pkt[30] = 10; pkt[33] = 2;
+    pkt[46] = 0x50;
+    struct pcap_pkthdr hdr = {0};
+    hdr.caplen = hdr.len = sizeof(pkt);
+    hdr.ts.tv_sec = 1000;
+
+    // 5000 distinct TCP flows into a 1000-flow table: the oldest are recycled, none are ignored
+    for (int i = 0; i < 5000; i++) {
+        pkt[27] = (uint8_t)(i >> 8); pkt[28] = (uint8_t)i; pkt[29] = 1;
+        pkt[34] = 0x40; pkt[35] = (uint8_t)(i & 0x3F);
+        pkt[36] = 0x01; pkt[37] = 0xBB;
+        PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+    }
+    PacketDiagFlowTable* ft = &ctx->shards[0].flows;
+    if (ft->count != 1000 || ft->evicted != 4000) { fprintf(stderr, "Expected 1000 flows / 4000 evicted, got %u / %llu\n", ft->count, (unsigned long long)ft->evicted); exit(1); }
+
+    // Every surviving flow is still reachable through the index
+    for (uint32_t i = 0; i < ft->used; i++) {
+        PacketDiagFlow* f = &ft->pool[i];
+        if (f->id && PacketDiag_FlowLookup(ft, &f->key, f->hash) != f) { fprintf(stderr, "Lookup lost flow %u\n", f->id); exit(1); }
+    }
+
+    // Paging visits each flow exactly once
+    char buf[4096];
+    uint64_t cursor = 0;
+    int seen = 0, pages = 0;
+    do {
+        if (!KTerm_Net_PacketDiag_GetFlowsPage(term, session, cursor, 64, buf, sizeof(buf), &cursor)) { fprintf(stderr, "Page failed\n"); exit(1); }
+        for (char* p = buf; (p = strstr(p, "ID=")) != NULL; p += 3) seen++;
+        pages++;
+    } while (cursor && pages < 100);
+    if (seen != 1000) { fprintf(stderr, "Paging saw %d flows\n", seen); exit(1); }
+
+    // A buffer too small for a single entry still makes progress
+    char tiny[8];
+    cursor = 0; pages = 0;
+    do {
+        if (!KTerm_Net_PacketDiag_GetFlowsPage(term, session, cursor, 64, tiny, sizeof(tiny), &cursor)) { fprintf(stderr, "Tiny page failed\n"); exit(1); }
+        pages++;
+    } while (cursor && pages < 2000);
+    if (pages != 1000) { fprintf(stderr, "Tiny paging took %d pages\n", pages); exit(1); }
+
+    // Idle flows expire as packet time moves on
+    hdr.ts.tv_sec += 60;
+    for (int i = 0; i < 100; i++) PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+    if (ft->count >= 1000) { fprintf(stderr, "Idle flows not expired (%u)\n", ft->count); exit(1); }
+
+    KTerm_Net_DestroyContext(session);
+}
+
+// Formats the pending events into a string (no terminal involved)
+static void packetdiag_take_output(KTerm* term, KTermSession* session, char* out, size_t max) {
+    KTermPacketDiagEvent ev[16];
+    int count = KTerm_Net_PacketDiag_PollEvents(term, session, ev, 16);
+    size_t n = 0;
+    out[0] = '\0';
+    for (int i = 0; i < count && n + 1 < max; i++) n += (size_t)KTerm_Net_PacketDiag_FormatEvent(&ev[i], out + n, max - n);
+}
+
+void test_packetdiag_layers(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag Layered Dissection...\n");
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+
+    struct pcap_pkthdr hdr = {0};
+    hdr.ts.tv_sec = 1000;
+    char out[4096];
+
+    // QinQ (S-tag 200, C-tag 100) + IPv6 + Hop-by-Hop + UDP 5353 -> 53
+    uint8_t v6[14 + 8 + 40 + 8 + 8 + 12] = {0};
+    int o = 12;
+    v6[o++] = 0x88; v6[o++] = 0xA8; v6[o++] = 0x00; v6[o++] = 200;
+    v6[o++] = 0x81; v6[o++] = 0x00; v6[o++] = 0x00; v6[o++] = 100;
+    v6[o++] = 0x86; v6[o++] = 0xDD;
+    uint8_t* ip6 = v6 + o;
+    ip6[0] = 0x60; ip6[5] = 8 + 8 + 12; ip6[6] = 0; ip6[7] = 64; // Next: Hop-by-Hop
+    ip6[8] = 0x20; ip6[9] = 0x01; ip6[10] = 0x0D; ip6[11] = 0xB8; ip6[23] = 1;
+    ip6[24] = 0x20; ip6[25] = 0x01; ip6[26] = 0x0D; ip6[27] = 0xB8; ip6[39] = 2;
+    ip6[40] = 17; ip6[41] = 0;                                      // Hop-by-Hop -> UDP, 8 bytes
+    uint8_t* udp6 = ip6 + 48;
+    udp6[0] = 0x14; udp6[1] = 0xE9; udp6[3] = 53; udp6[5] = 8 + 12;
+    hdr.caplen = hdr.len = sizeof(v6);
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, v6);
+    packetdiag_take_output(term, session, out, sizeof(out));
+    if (!strstr(out, "VLAN 200.100") || !strstr(out, "2001:db8::1") || !strstr(out, "UDP") || !strstr(out, "[DNS]")) {
+        fprintf(stderr, "IPv6/QinQ dissection wrong: %s\n", out); exit(1);
+    }
+
+    // Linux cooked v2 + IPv4 + TCP with an HTTP request
+    ctx->link_type = PACKETDIAG_LINK_SLL2;
+    const char* req = "GET /index HTTP/1.1\r\n";
+    uint8_t sll[20 + 20 + 20 + 32] = {0};
+    sll[0] = 0x08;
+    uint8_t* ip4 = sll + 20;
+    ip4[0] = 0x45; ip4[3] = (uint8_t)(20 + 20 + strlen(req)); ip4[9] = 6;
+    ip4[12] = 192; ip4[13] = 168; ip4[15] = 1; ip4[16] = 192; ip4[17] = 168; ip4[19] = 2;
+    uint8_t* tcp = ip4 + 20;
+    tcp[0] = 0xC0; tcp[1] = 0x01; tcp[3] = 80; tcp[12] = 0x50; tcp[13] = 0x18;
+    memcpy(tcp + 20, req, strlen(req));
+    hdr.caplen = hdr.len = sizeof(sll);
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, sll);
+    packetdiag_take_output(term, session, out, sizeof(out));
+    if (!strstr(out, "192.168.0.1") || !strstr(out, "[HTTP]") || !strstr(out, "GET /index")) {
+        fprintf(stderr, "SLL2 dissection wrong: %s\n", out); exit(1);
+    }
+
+    // IPv4 UDP datagram (8 + 24 bytes) in two fragments, reassembled before dissection
+    ctx->link_type = PACKETDIAG_LINK_ETHERNET;
+    uint8_t frag[14 + 20 + 16] = {0};
+    frag[12] = 0x08;
+    ip4 = frag + 14;
+    ip4[0] = 0x45; ip4[3] = 20 + 16; ip4[5] = 0x42; ip4[9] = 17;
+    ip4[12] = 10; ip4[15] = 7; ip4[16] = 10; ip4[19] = 8;
+    hdr.caplen = hdr.len = sizeof(frag);
+
+    memset(ip4 + 20, 'x', 16);
+    ip4[6] = 0x20; ip4[7] = 0;                       // MF, offset 0
+    ip4[20] = 0x30; ip4[21] = 0x39; ip4[22] = 0x30; ip4[23] = 0x3A; ip4[24] = 0; ip4[25] = 32; ip4[26] = 0; ip4[27] = 0;
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, frag);
+    packetdiag_take_output(term, session, out, sizeof(out));
+    if (!strstr(out, "FRAG") || !strstr(out, "MF") || !atomic_load(&ctx->trigger_mtu_probe)) { fprintf(stderr, "First fragment wrong: %s\n", out); exit(1); }
+
+    memset(ip4 + 20, 'y', 16);
+    ip4[6] = 0x00; ip4[7] = 2;                       // Last, offset 16
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, frag);
+    packetdiag_take_output(term, session, out, sizeof(out));
+    if (!strstr(out, "[Reassembled 32]") || !strstr(out, "12345\xE2\x86\x92" "12346")) { fprintf(stderr, "Reassembly wrong: %s\n", out); exit(1); }
+
+    // IPv6 flows are tracked and printed with bracketed addresses
+    char buf[1024];
+    uint64_t next = 0;
+    KTerm_Net_PacketDiag_GetFlowsPage(term, session, 0, 10, buf, sizeof(buf), &next);
+    if (!strstr(buf, "[2001:db8::1]:5353->[2001:db8::2]:53") || !strstr(buf, "10.0.0.7:12345->10.0.0.8:12346")) {
+        fprintf(stderr, "Flow listing wrong: %s\n", buf); exit(1);
+    }
+
+    KTerm_Net_DestroyContext(session);
+}
+
+void test_packetdiag_record_replay(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag Record/Replay...\n");
+    const char* path = "/tmp/kterm_packetdiag_test.pcapng";
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;record=/tmp/kterm_packetdiag_test.pcapng")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+
+    // 90 UDP packets over 10 flows, then an SSH banner on a non-standard port
+    uint8_t pkt[80] = {0};
+    pkt[12] = 0x08;
+    pkt[14] = 0x45; pkt[23] = 17;
+    pkt[26] = 10; pkt[30] = 10; pkt[33] = 2;
+    pkt[39] = 8 + 10;
+    struct pcap_pkthdr hdr = {0};
+    hdr.caplen = 14 + 20 + 8 + 10;
+    hdr.len = 60;
+    hdr.ts.tv_sec = 1700000000;
+    for (int i = 0; i < 90; i++) {
+        pkt[29] = (uint8_t)(1 + i % 10);
+        pkt[34] = 0x30; pkt[35] = (uint8_t)(i % 10);
+        pkt[36] = 0x13; pkt[37] = 0x88;
+        hdr.ts.tv_usec = i * 1000;
+        PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+    }
+    memset(pkt + 14, 0, sizeof(pkt) - 14);
+    pkt[14] = 0x45; pkt[23] = 6;
+    pkt[26] = 10; pkt[29] = 1; pkt[30] = 10; pkt[33] = 2;
+    pkt[34] = 0x30; pkt[35] = 0x39; pkt[36] = 0x08; pkt[37] = 0xAE;
+    pkt[46] = 0x50;
+    memcpy(pkt + 54, "SSH-2.0-Test\r\n", 14);
+    hdr.caplen = hdr.len = sizeof(pkt);
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+
+    char live[512], replay[512], buf[4096];
+    KTerm_Net_PacketDiag_GetStats(term, session, live, sizeof(live));
+    KTerm_Net_PacketDiag_Stop(term, session);
+    KTerm_Net_PacketDiag_GetStatus(term, session, buf, sizeof(buf));
+    if (!strstr(buf, "RECORDED=91;REC_DROPPED=0")) { fprintf(stderr, "Bad record status: %s\n", buf); exit(1); }
+
+    // SHB (28) + IDB (20) + 90 x EPB(52 -> 84) + EPB(80 -> 112)
+    FILE* f = fopen(path, "rb");
+    if (!f) { fprintf(stderr, "No recording\n"); exit(1); }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    if (size != 28 + 20 + 90 * 84 + 112) { fprintf(stderr, "Recording is %ld bytes\n", size); exit(1); }
+
+    // Replay through workers: same stats, flows and auth detection as live
+    if (!KTerm_Net_PacketDiag_Start(term, session, "file=/tmp/kterm_packetdiag_test.pcapng;workers=2")) { fprintf(stderr, "Replay start failed\n"); exit(1); }
+    ctx = net->packetdiag;
+    for (int t = 0; t < 2000; t++) {
+        KTerm_Net_PacketDiag_GetStats(term, session, replay, sizeof(replay));
+        KTerm_Net_PacketDiag_GetStatus(term, session, buf, sizeof(buf));
+        if (strstr(buf, "REPLAY=DONE") && strcmp(replay, live) == 0) break;
+        usleep(1000);
+    }
+    if (strcmp(replay, live) != 0) { fprintf(stderr, "Replay stats differ:\n  live   %s\n  replay %s\n", live, replay); exit(1); }
+    if (!KTerm_Net_ScanAuthFlows(term, session, buf, sizeof(buf)) || !strstr(buf, "PROTO=SSH")) { fprintf(stderr, "Replay missed auth: %s\n", buf); exit(1); }
+    KTerm_Net_DestroyContext(session);
+
+    // Classic big-endian pcap, raw IPv6 link type
+    uint8_t v6[40 + 8 + 4] = {0};
+    v6[0] = 0x60; v6[5] = 12; v6[6] = 17; v6[7] = 64;
+    v6[8] = 0xFE; v6[9] = 0x80; v6[23] = 1;
+    v6[24] = 0xFE; v6[25] = 0x80; v6[39] = 2;
+    v6[40] = 0x04; v6[41] = 0x00; v6[42] = 0x04; v6[43] = 0x01; v6[45] = 12;
+    const uint8_t ghdr[24] = { 0xA1, 0xB2, 0xC3, 0xD4, 0, 2, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0, 0, 0, 101 };
+    const uint8_t rhdr[16] = { 0x65, 0x53, 0xF1, 0x00, 0, 0, 0, 5, 0, 0, 0, sizeof(v6), 0, 0, 0, sizeof(v6) };
+    f = fopen(path, "wb");
+    fwrite(ghdr, 1, sizeof(ghdr), f);
+    for (int i = 0; i < 3; i++) { fwrite(rhdr, 1, sizeof(rhdr), f); fwrite(v6, 1, sizeof(v6), f); }
+    fclose(f);
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "file=/tmp/kterm_packetdiag_test.pcapng;workers=0")) { fprintf(stderr, "Classic replay start failed\n"); exit(1); }
+    ctx = KTerm_Net_GetContext(session)->packetdiag;
+    for (int t = 0; t < 2000 && !atomic_load(&ctx->replay_done); t++) usleep(1000);
+    KTerm_Net_PacketDiag_Stop(term, session);
+    KTerm_Net_PacketDiag_GetStats(term, session, buf, sizeof(buf));
+    if (ctx->link_type != PACKETDIAG_LINK_RAW || strncmp(buf, "PKTS=3;", 7) != 0 || !strstr(buf, "UDP=3")) { fprintf(stderr, "Classic replay wrong: %s\n", buf); exit(1); }
+    KTerm_Net_PacketDiag_GetFlowsPage(term, session, 0, 10, buf, sizeof(buf), NULL);
+    if (!strstr(buf, "[fe80::1]:1024->[fe80::2]:1025")) { fprintf(stderr, "Classic replay flows wrong: %s\n", buf); exit(1); }
+
+    KTerm_Net_DestroyContext(session);
+    remove(path);
+
+    // Host output cannot start a recording
+    write_sequence(term, "\x1BPGATE;KTERM;1;EXT;net;packetdiag;interface=eth0;workers=0;record=/tmp/kterm_packetdiag_test.pcapng\x1B\\");
+    if (KTerm_Net_GetContext(session) && KTerm_Net_GetContext(session)->packetdiag) { fprintf(stderr, "Gateway started a recording\n"); exit(1); }
+    if (access(path, F_OK) == 0) { fprintf(stderr, "Gateway created a capture file\n"); exit(1); }
+}
+
+void test_packetdiag_render(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag Rate-Limited Rendering...\n");
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;lines=10")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+    KTerm_Net_ProcessPacketDiag(term, session);
+    KTerm_InputQueue_Clear(&session->input_queue);
+
+    // A DNS flood larger than the event ring: the overflow is counted, not queued
+    uint8_t pkt[14 + 20 + 8 + 12] = {0};
+    pkt[12] = 0x08;
+    pkt[14] = 0x45; pkt[17] = 20 + 8 + 12; pkt[23] = 17;
+    pkt[26] = 10; pkt[29] = 1; pkt[30] = 10; pkt[33] = 2;
+    pkt[34] = 0xC0; pkt[37] = 53; pkt[39] = 8 + 12;
+    struct pcap_pkthdr hdr = {0};
+    hdr.caplen = hdr.len = sizeof(pkt);
+    hdr.ts.tv_sec = 1000;
+    const int flood = KTERM_PACKETDIAG_EVENT_SLOTS + 500;
+    for (int i = 0; i < flood; i++) PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+
+    char status[256];
+    KTerm_Net_PacketDiag_GetStatus(term, session, status, sizeof(status));
+    if (!strstr(status, ";EV_DROPPED=500")) { fprintf(stderr, "Bad status: %s\n", status); exit(1); }
+
+    // One pass renders at most a screenful, however much is queued
+    static char text[65536];
+    KTerm_Net_ProcessPacketDiag(term, session);
+    if (atomic_load(&ctx->shards[0].ev_head) != atomic_load(&ctx->shards[0].ev_tail)) { fprintf(stderr, "Event ring not drained\n"); exit(1); }
+    size_t n = KTerm_InputQueue_Pop(&session->input_queue, text, sizeof(text) - 1);
+    text[n] = '\0';
+    int lines = 0;
+    for (char* p = text; (p = strstr(p, "[DNS]")) != NULL; p++) lines++;
+    if (lines < 1 || lines > term->height) { fprintf(stderr, "Rendered %d lines for a %d-row screen\n", lines, term->height); exit(1); }
+
+    // The rest shows up in the once-a-second summary
+    ctx->summary_start -= 2.0;
+    KTerm_Net_ProcessPacketDiag(term, session);
+    n = KTerm_InputQueue_Pop(&session->input_queue, text, sizeof(text) - 1);
+    text[n] = '\0';
+    char expect[64];
+    snprintf(expect, sizeof(expect), "UDP %d", KTERM_PACKETDIAG_EVENT_SLOTS);
+    if (!strstr(text, "pkt/s") || !strstr(text, "500 lost") || !strstr(text, expect) || !strstr(text, "DNS")) {
+        fprintf(stderr, "Summary wrong: %s\n", text); exit(1);
+    }
+
+    // render=0 leaves the events to the embedder
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;render=0")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    ctx = KTerm_Net_GetContext(session)->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+    for (int i = 0; i < 3; i++) PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+    KTerm_Net_ProcessPacketDiag(term, session);
+    KTermPacketDiagEvent ev[4];
+    if (KTerm_Net_PacketDiag_PollEvents(term, session, ev, 4) != 3 || ev[2].id != 2 || ev[0].dst_port != 53 ||
+        !ev[0].protocol || strcmp(ev[0].protocol->short_name, "DNS") != 0) {
+        fprintf(stderr, "PollEvents wrong\n"); exit(1);
+    }
+    KTerm_InputQueue_Clear(&session->input_queue);
+
+    KTerm_Net_DestroyContext(session);
+}
+
+// Ethernet + IPv4 + TCP 10.9.0.a:sport -> 10.9.0.b:dport carrying len of wire_len payload bytes
+static void packetdiag_tcp(KTermPacketDiagContext* ctx, uint8_t a, uint8_t b, uint16_t sport, uint16_t dport, uint32_t seq, uint8_t flags, const char* data, int len, int wire_len) {
+    uint8_t pkt[14 + 40 + 1500] = {0};
+    pkt[12] = 0x08;
+    uint8_t* ip = pkt + 14;
+    ip[0] = 0x45; ip[2] = (uint8_t)((40 + wire_len) >> 8); ip[3] = (uint8_t)(40 + wire_len); ip[9] = 6;
+    ip[12] = 10; ip[13] = 9; ip[15] = a; ip[16] = 10; ip[17] = 9; ip[19] = b;
+    uint8_t* tcp = ip + 20;
+    tcp[0] = (uint8_t)(sport >> 8); tcp[1] = (uint8_t)sport; tcp[2] = (uint8_t)(dport >> 8); tcp[3] = (uint8_t)dport;
+    tcp[4] = (uint8_t)(seq >> 24); tcp[5] = (uint8_t)(seq >> 16); tcp[6] = (uint8_t)(seq >> 8); tcp[7] = (uint8_t)seq;
+    tcp[12] = 0x50; tcp[13] = flags;
+    if (len > 0) memcpy(tcp + 20, data, len);
+    struct pcap_pkthdr hdr = {0};
+    hdr.ts.tv_sec = 1000;
+    hdr.caplen = (uint32_t)(14 + 40 + len);
+    hdr.len = (uint32_t)(14 + 40 + wire_len);
+    PacketDiag_PacketHandler((u_char*)ctx, &hdr, pkt);
+}
+
+typedef struct {
+    char data[1024];
+    int len;
+    int holes;
+    uint32_t flows[2];
+} PacketDiagFollowLog;
+
+static void packetdiag_follow_cb(KTerm* term, KTermSession* session, uint32_t flow_id, uint64_t offset, const uint8_t* data, int len, void* user_data) {
+    (void)term; (void)session; (void)offset;
+    PacketDiagFollowLog* log = (PacketDiagFollowLog*)user_data;
+    if (!log->flows[0]) log->flows[0] = flow_id;
+    else if (log->flows[0] != flow_id) log->flows[1] = flow_id;
+    if (!data) { log->holes += len; return; }
+    if (log->len + len < (int)sizeof(log->data)) {
+        memcpy(log->data + log->len, data, len);
+        log->len += len;
+    }
+}
+
+static uint32_t packetdiag_first_flow_id(KTermPacketDiagContext* ctx) {
+    PacketDiagFlowTable* ft = &ctx->shards[0].flows;
+    for (uint32_t i = 0; i < ft->used; i++) if (ft->pool[i].id) return ft->pool[i].id;
+    return 0;
+}
+
+void test_packetdiag_tcp_stream(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag TCP Reassembly...\n");
+    const char* path = "/tmp/kterm_packetdiag_follow.bin";
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;render=0")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermNetSession* net = KTerm_Net_GetContext(session);
+    KTermPacketDiagContext* ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+
+    // Handshake, then follow the client direction
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 999, 0x02, NULL, 0, 0);
+    packetdiag_tcp(ctx, 2, 1, 8080, 40000, 4999, 0x12, NULL, 0, 0);
+    uint32_t fid = packetdiag_first_flow_id(ctx);
+    PacketDiagFollowLog log;
+    memset(&log, 0, sizeof(log));
+    if (!KTerm_Net_PacketDiag_FollowEx(term, session, fid, path, packetdiag_follow_cb, &log)) { fprintf(stderr, "Follow failed\n"); exit(1); }
+
+    // A request whose auth header is split across segments that arrive out of order,
+    // with an overlapping retransmission carrying different bytes
+    const char* req = "GET / HTTP/1.1\r\nAuthorization: Basic dXNlcjpwYXNz\r\n\r\n";
+    int cut1 = 33, cut2 = 40, total = (int)strlen(req);
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000 + cut2, 0x18, req + cut2, total - cut2, total - cut2);
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000, 0x18, req, cut1, cut1);
+    char bad[16];
+    memset(bad, '#', sizeof(bad));
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000 + cut1 - 4, 0x18, bad, 4, 4);    // Already handed on
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000 + cut2 + 2, 0x18, bad, 6, 6);    // Inside the queued tail
+    if (ctx->shards[0].flows.pool[fid - 1].auth_detected) { fprintf(stderr, "Auth found before the hole filled\n"); exit(1); }
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000 + cut1, 0x18, req + cut1, cut2 - cut1, cut2 - cut1);
+    if (log.len != total || memcmp(log.data, req, total) != 0 || log.holes) {
+        fprintf(stderr, "Reassembled request wrong (%d bytes): %.*s\n", log.len, log.len, log.data); exit(1);
+    }
+    if (atomic_load(&ctx->stream_mem) != 0) { fprintf(stderr, "Queue not released\n"); exit(1); }
+
+    char buf[1024];
+    KTerm_Net_ScanAuthFlows(term, session, buf, sizeof(buf));
+    if (!strstr(buf, "10.9.0.1:40000->10.9.0.2:8080;PROTO=HTTP-Basic")) { fprintf(stderr, "Split auth missed: %s\n", buf); exit(1); }
+
+    // The reverse direction is followed too
+    const char* resp = "HTTP/1.1 200 OK\r\n\r\n";
+    packetdiag_tcp(ctx, 2, 1, 8080, 40000, 5000, 0x18, resp, (int)strlen(resp), (int)strlen(resp));
+    if (log.len != total + (int)strlen(resp) || memcmp(log.data + total, resp, strlen(resp)) != 0 || !log.flows[1]) {
+        fprintf(stderr, "Reverse direction not followed\n"); exit(1);
+    }
+    KTermPacketDiagEvent ev[16];
+    int n = KTerm_Net_PacketDiag_PollEvents(term, session, ev, 16);
+    int stream_bytes = 0;
+    for (int i = 0; i < n; i++) if (ev[i].kind == KTERM_PACKETDIAG_EVENT_STREAM) stream_bytes += ev[i].length;
+    if (stream_bytes != log.len) { fprintf(stderr, "Stream events carry %d bytes\n", stream_bytes); exit(1); }
+
+    // Snaplen cut the payload short: the missing tail is a hole, the stream goes on
+    packetdiag_tcp(ctx, 2, 1, 8080, 40000, 5000 + (uint32_t)strlen(resp), 0x18, "abcd", 4, 100);
+    packetdiag_tcp(ctx, 2, 1, 8080, 40000, 5100 + (uint32_t)strlen(resp), 0x18, "efgh", 4, 4);
+    if (log.holes != 96 || memcmp(log.data + log.len - 8, "abcdefgh", 8) != 0) { fprintf(stderr, "Truncated segment wrong (%d)\n", log.holes); exit(1); }
+
+    // Stopping the follow closes the file: both directions, in order, holes left out
+    KTerm_Net_PacketDiag_Follow(term, session, 0);
+    FILE* f = fopen(path, "rb");
+    char file[1024];
+    size_t flen = f ? fread(file, 1, sizeof(file), f) : 0;
+    if (f) fclose(f);
+    if ((int)flen != log.len || memcmp(file, log.data, flen) != 0) { fprintf(stderr, "Follow file wrong (%zu bytes)\n", flen); exit(1); }
+    unlink(path);
+
+    // Host output cannot open the file sink
+    write_sequence(term, "\x1BPGATE;KTERM;1;EXT;net;packetdiag_follow;1;file=/tmp/kterm_packetdiag_follow.bin\x1B\\");
+    if (access(path, F_OK) == 0) { fprintf(stderr, "Gateway opened a follow file\n"); exit(1); }
+
+    // Per-direction cap: a hole that never fills is given up on once 256 KB queue behind it
+    char chunk[1400];
+    memset(chunk, 'z', sizeof(chunk));
+    packetdiag_tcp(ctx, 3, 4, 40001, 9000, 0, 0x02, NULL, 0, 0);
+    for (int i = 1; i <= 200; i++) packetdiag_tcp(ctx, 3, 4, 40001, 9000, 1 + (uint32_t)i * 1400, 0x10, chunk, 1400, 1400);
+    KTerm_Net_PacketDiag_GetStats(term, session, buf, sizeof(buf));
+    if (!strstr(buf, "GAPS=2") || atomic_load(&ctx->stream_mem) > KTERM_PACKETDIAG_STREAM_FLOW_BYTES) {
+        fprintf(stderr, "Per-flow cap not enforced: %s, %llu queued\n", buf, (unsigned long long)atomic_load(&ctx->stream_mem)); exit(1);
+    }
+    KTerm_Net_DestroyContext(session);
+
+    // stream_mem=0: nothing is queued, holes are skipped as soon as later data arrives
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;render=0;stream_mem=0")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    net = KTerm_Net_GetContext(session);
+    ctx = net->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+    memset(&log, 0, sizeof(log));
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 999, 0x02, NULL, 0, 0);
+    KTerm_Net_PacketDiag_FollowEx(term, session, packetdiag_first_flow_id(ctx), NULL, packetdiag_follow_cb, &log);
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1010, 0x18, "0123456789", 10, 10);
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000, 0x18, "abcdefghij", 10, 10);
+    if (log.holes != 10 || log.len != 10 || memcmp(log.data, "0123456789", 10) != 0 || atomic_load(&ctx->stream_mem) != 0) {
+        fprintf(stderr, "stream_mem=0 wrong: %d holes, %.*s\n", log.holes, log.len, log.data); exit(1);
+    }
+    KTerm_Net_DestroyContext(session);
+}
+
+// Reference for the auth automaton: the lowest signature row found anywhere in the payload
+static int packetdiag_auth_naive(const unsigned char* p, int len) {
+    for (int i = 0; kterm_auth_sigs[i].sig; i++) {
+        int n = (int)strlen(kterm_auth_sigs[i].sig);
+        for (int j = 0; j + n <= len; j++) {
+            if (memcmp(p + j, kterm_auth_sigs[i].sig, n) == 0) return i;
+        }
+    }
+    return -1;
+}
+
+void test_packetdiag_auth_automaton(void) {
+    printf("  Testing PacketDiag Auth Automaton...\n");
+
+    // Every signature on its own, embedded in noise
+    for (int i = 0; kterm_auth_sigs[i].sig; i++) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "xx%sxx", kterm_auth_sigs[i].sig);
+        uint8_t st = 0;
+        const KTermAuthSig* sig = KTerm_Net_AuthScan(&st, (const unsigned char*)buf, (int)strlen(buf));
+        if (!sig || sig - kterm_auth_sigs != packetdiag_auth_naive((const unsigned char*)buf, (int)strlen(buf))) {
+            fprintf(stderr, "Signature %s missed\n", kterm_auth_sigs[i].sig); exit(1);
+        }
+    }
+
+    // Random payloads over the signature alphabet agree with the naive search
+    const char alpha[] = "SHNTLMKRB5asicuerpUPAo:n /1.04zhG-";
+    uint32_t seed = 12345;
+    for (int round = 0; round < 20000; round++) {
+        unsigned char buf[48];
+        int len = 4 + (int)(seed % 44);
+        for (int i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345u;
+            buf[i] = (unsigned char)alpha[(seed >> 16) % (sizeof(alpha) - 1)];
+        }
+        uint8_t st = 0;
+        const KTermAuthSig* sig = KTerm_Net_AuthScan(&st, buf, len);
+        int want = packetdiag_auth_naive(buf, len);
+        if ((sig ? (int)(sig - kterm_auth_sigs) : -1) != want) { fprintf(stderr, "Automaton disagrees on %.*s\n", len, buf); exit(1); }
+    }
+
+    // The state carries a partial match across segments, one byte at a time
+    const char* req = "GET / HTTP/1.1\r\nAuthorization: Basic dXNlcjpwYXNz\r\n";
+    uint8_t st = 0;
+    const KTermAuthSig* sig = NULL;
+    for (int i = 0; req[i] && !sig; i++) sig = KTerm_Net_AuthScan(&st, (const unsigned char*)req + i, 1);
+    if (!sig || strcmp(sig->proto, "HTTP-Basic") != 0) { fprintf(stderr, "Split signature missed\n"); exit(1); }
+
+    char proto[32] = {0}, user[32] = {0};
+    bool risk = false;
+    if (KTerm_Net_ScanPayloadForAuth((const unsigned char*)"GET / HTTP/1.1\r\nHost: x\r\n\r\n", 27, proto, user, &risk)) { fprintf(stderr, "False positive\n"); exit(1); }
+    if (!KTerm_Net_ScanPayloadForAuth((const unsigned char*)"NTLMSSP\0\x01", 9, proto, user, &risk) || strcmp(proto, "NTLM") != 0 || !risk) { fprintf(stderr, "NTLM missed\n"); exit(1); }
+}
+
+void test_net_metrics(KTerm* term, KTermSession* session) {
+    printf("  Testing Time-Series Metrics...\n");
+
+    // HDR counters: every value maps to a counter whose top is within 1/32 above it
+    uint64_t probe[] = { 0, 1, 63, 64, 65, 1000, 4095, 123456, 99999999, 0xFFFFFFFFULL };
+    for (size_t i = 0; i < sizeof(probe) / sizeof(probe[0]); i++) {
+        int idx = KTerm_Metrics_HdrIndex(probe[i]);
+        uint64_t top = KTerm_Metrics_HdrValue(idx);
+        if (idx < 0 || idx >= KTERM_NET_METRICS_HDR_COUNTS || top < probe[i] || (double)(top - probe[i]) > probe[i] / 32.0 + 1) {
+            fprintf(stderr, "HDR counter wrong for %llu: %d -> %llu\n", (unsigned long long)probe[i], idx, (unsigned long long)top); exit(1);
+        }
+    }
+
+    // 1..1000 ms over ten seconds, plus losses
+    KTermMetricsStore* m = (KTermMetricsStore*)calloc(1, sizeof(KTermMetricsStore));
+    for (int i = 1; i <= 1000; i++) KTerm_Metrics_RecordAt(m, "icmp:test", KTERM_METRIC_LATENCY, (double)i, 5000.0 + (i - 1) / 100);
+    KTerm_Metrics_RecordAt(m, "icmp:test", KTERM_METRIC_LATENCY, -1.0, 5009.5);
+    KTerm_Metrics_RecordAt(m, "icmp:test", KTERM_METRIC_LATENCY, -1.0, 5009.5);
+    KTermMetricsSummary sum;
+    if (!KTerm_Metrics_QueryAt(m, "icmp:test", 60, 5009.9, &sum)) { fprintf(stderr, "Series missing\n"); exit(1); }
+    if (sum.samples != 1000 || sum.lost != 2 || sum.window_sec != 10 || sum.min != 1.0 || sum.max != 1000.0 || fabs(sum.mean - 500.5) > 0.001 || fabs(sum.rate - 100.0) > 0.001) {
+        fprintf(stderr, "Summary wrong: n=%llu lost=%llu win=%d min=%f max=%f mean=%f\n", (unsigned long long)sum.samples, (unsigned long long)sum.lost, sum.window_sec, sum.min, sum.max, sum.mean); exit(1);
+    }
+    if (fabs(sum.p50 - 500) > 16 || fabs(sum.p90 - 900) > 29 || fabs(sum.p99 - 990) > 32 || sum.p999 > sum.max) {
+        fprintf(stderr, "Percentiles wrong: %f %f %f %f\n", sum.p50, sum.p90, sum.p99, sum.p999); exit(1);
+    }
+
+    // The window only sees its own seconds
+    KTerm_Metrics_QueryAt(m, "icmp:test", 3, 5009.9, &sum);
+    if (sum.samples != 300 || sum.min != 701.0) { fprintf(stderr, "3 s window wrong: %llu from %f\n", (unsigned long long)sum.samples, sum.min); exit(1); }
+    KTerm_Metrics_QueryAt(m, "icmp:test", 10, 5400.0, &sum);
+    if (sum.samples != 0 || sum.lost != 0 || sum.p50 != 0) { fprintf(stderr, "Expired samples reported\n"); exit(1); }
+
+    // Counters sum per second
+    KTerm_Metrics_RecordAt(m, "packetdiag:bytes", KTERM_METRIC_COUNTER, 1500, 6000.2);
+    KTerm_Metrics_RecordAt(m, "packetdiag:bytes", KTERM_METRIC_COUNTER, 500, 6001.7);
+    KTerm_Metrics_QueryAt(m, "packetdiag:bytes", 60, 6009.0, &sum);
+    if (sum.kind != KTERM_METRIC_COUNTER || sum.total != 2000 || fabs(sum.rate - 200.0) > 0.001) { fprintf(stderr, "Counter wrong: %f %f\n", sum.total, sum.rate); exit(1); }
+
+    // Full store: the series fed least recently makes room
+    for (int i = 0; i < KTERM_NET_METRICS_MAX_SERIES - 1; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "s%d", i);
+        KTerm_Metrics_RecordAt(m, name, KTERM_METRIC_LATENCY, 1.0, 7000.0 + i);
+    }
+    if (m->count != KTERM_NET_METRICS_MAX_SERIES || KTerm_Metrics_Find(m, "icmp:test") || !KTerm_Metrics_Find(m, "packetdiag:bytes") || !KTerm_Metrics_Find(m, "s30")) {
+        fprintf(stderr, "Series recycling wrong\n"); exit(1);
+    }
+    KTerm_Metrics_Free(m);
+
+    // Public API and per-flow throughput from the flow's own ring
+    KTerm_Net_Metrics_Record(term, session, "app:rtt", 12.5);
+    if (!KTerm_Net_Metrics_Query(term, session, "app:rtt", 60, &sum) || sum.samples != 1 || sum.max != 12.5) { fprintf(stderr, "Public record failed\n"); exit(1); }
+    char list[256];
+    if (KTerm_Net_Metrics_List(term, session, list, sizeof(list)) != 1 || strcmp(list, "app:rtt|") != 0) { fprintf(stderr, "List wrong: %s\n", list); exit(1); }
+
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=eth0;workers=0;render=0")) { fprintf(stderr, "Start failed\n"); exit(1); }
+    KTermPacketDiagContext* ctx = KTerm_Net_GetContext(session)->packetdiag;
+    while (ctx->running) usleep(1000);
+    ctx->running = true;
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 999, 0x02, NULL, 0, 0);
+    packetdiag_tcp(ctx, 1, 2, 40000, 8080, 1000, 0x18, "hello", 5, 946);
+    char series[32];
+    snprintf(series, sizeof(series), "flow:%u", packetdiag_first_flow_id(ctx));
+    if (!KTerm_Net_Metrics_Query(term, session, series, 60, &sum) || sum.total != 54 + 1000 || sum.window_sec != 60) {
+        fprintf(stderr, "Flow rate wrong: %f over %d\n", sum.total, sum.window_sec); exit(1);
+    }
+    if (KTerm_Net_Metrics_Query(term, session, "flow:999999", 60, &sum)) { fprintf(stderr, "Unknown flow reported\n"); exit(1); }
+    KTerm_Net_DestroyContext(session);
+}
+
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+void test_packetdiag_tpacket(KTerm* term, KTermSession* session) {
+    printf("  Testing PacketDiag TPACKET_V3 Capture...\n");
+
+    // Filter compiler
+    const char* good[] = { "udp port 53", "tcp and (src port 22 or dst port 80)", "not icmp", "host 10.0.0.1 or ip6 host ::1",
+                           "src net 192.168.0.0/16 && !arp", "icmp6 or ip6 dst host fe80::1" };
+    const char* bad[] = { "udp port", "tcp host 10.0.0.1", "port 70000", "(udp", "frobnicate", "net 10.0.0.0/40", "udp port 53 53" };
+    char err[160];
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        struct sock_fprog prog;
+        if (!PacketDiag_CompileFilter(good[i], false, 96, &prog, err, sizeof(err))) { fprintf(stderr, "Rejected '%s': %s\n", good[i], err); exit(1); }
+        if (prog.filter[prog.len - 2].k != 96 || prog.filter[prog.len - 1].k != 0) { fprintf(stderr, "Bad epilogue for '%s'\n", good[i]); exit(1); }
+        free(prog.filter);
+    }
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        struct sock_fprog prog;
+        if (PacketDiag_CompileFilter(bad[i], false, 96, &prog, err, sizeof(err))) { fprintf(stderr, "Accepted '%s'\n", bad[i]); exit(1); }
+    }
+
+    // VLAN tags the kernel moved into the ring header are reinserted after the MAC addresses
+    {
+        KTermPacketDiagContext* vctx = (KTermPacketDiagContext*)calloc(1, sizeof(KTermPacketDiagContext));
+        uint8_t* slot = (uint8_t*)calloc(1, 256);
+        struct tpacket3_hdr* h = (struct tpacket3_hdr*)slot;
+        h->tp_mac = 64;
+        h->tp_snaplen = h->tp_len = 60;
+        h->tp_status = TP_STATUS_VLAN_VALID;
+        h->hv1.tp_vlan_tci = 0x2064; // PCP 1, VID 100
+        for (int i = 0; i < 60; i++) slot[64 + i] = (uint8_t)i;
+        slot[64 + 12] = 0x08; slot[64 + 13] = 0x00;
+        uint8_t scratch[128];
+        struct pcap_pkthdr hdr;
+
+        vctx->dlt = DLT_EN10MB;
+        const uint8_t* f = PacketDiag_TPacketFrame(vctx, h, scratch, sizeof(scratch), &hdr);
+        if (f != scratch || hdr.caplen != 64 || hdr.len != 64 || f[11] != 11 || f[12] != 0x81 || f[13] != 0x00 ||
+            f[14] != 0x20 || f[15] != 0x64 || f[16] != 0x08 || f[17] != 0x00 || f[63] != 59) {
+            fprintf(stderr, "VLAN tag not reinserted\n"); exit(1);
+        }
+        PacketDiagLayers L;
+        memset(&L, 0, sizeof(L));
+        if (!PacketDiag_DissectLink(PACKETDIAG_LINK_ETHERNET, f, (int)hdr.caplen, &L) || L.vlan_count != 1 || (L.vlan[0] & 0x0FFF) != 100 || L.ethertype != 0x0800) {
+            fprintf(stderr, "Reinserted VLAN tag not dissected\n"); exit(1);
+        }
+
+        h->tp_status = 0;
+        f = PacketDiag_TPacketFrame(vctx, h, scratch, sizeof(scratch), &hdr);
+        if (f != slot + 64 || hdr.caplen != 60) { fprintf(stderr, "Untagged frame was rewritten\n"); exit(1); }
+        free(slot);
+        free(vctx);
+    }
+
+    // Loopback capture: only the filtered datagrams arrive, once each, cut to snaplen=auto
+    if (!KTerm_Net_PacketDiag_Start(term, session, "interface=lo;backend=tpacket;workers=0;snaplen=auto;filter=udp and dst port 47809")) {
+        printf("    (skipped: no AF_PACKET access)\n");
+        KTerm_Net_DestroyContext(session);
+        return;
+    }
+    KTermPacketDiagContext* ctx = KTerm_Net_GetContext(session)->packetdiag;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char payload[1000];
+    memset(payload, 'p', sizeof(payload));
+    for (int i = 0; i < 20; i++) {
+        to.sin_port = htons(47809);
+        sendto(fd, payload, sizeof(payload), 0, (struct sockaddr*)&to, sizeof(to));
+        to.sin_port = htons(47810);
+        sendto(fd, payload, sizeof(payload), 0, (struct sockaddr*)&to, sizeof(to));
+    }
+    close(fd);
+
+    char buf[512] = {0};
+    for (int t = 0; t < 300; t++) {
+        KTerm_Net_PacketDiag_GetStats(term, session, buf, sizeof(buf));
+        if (strncmp(buf, "PKTS=20;", 8) == 0) break;
+        usleep(10000);
+    }
+    usleep(250000); // A partial block is handed over after 100 ms: nothing else may follow
+    KTerm_Net_PacketDiag_GetStats(term, session, buf, sizeof(buf));
+    if (strncmp(buf, "PKTS=20;", 8) != 0 || !strstr(buf, "UDP=20")) { fprintf(stderr, "TPACKET capture wrong: %s\n", buf); exit(1); }
+    CapturedPacket* cp = &ctx->shards[0].history[0];
+    if (cp->len != KTERM_PACKETDIAG_AUTO_SNAPLEN || cp->wire_len != 14 + 20 + 8 + sizeof(payload)) {
+        fprintf(stderr, "Snaplen not applied: %d of %u bytes\n", cp->len, cp->wire_len); exit(1);
+    }
+    KTerm_Net_PacketDiag_GetStatus(term, session, buf, sizeof(buf));
+    if (!strstr(buf, ";BACKEND=TPACKET;KDROPS=0")) { fprintf(stderr, "Bad status: %s\n", buf); exit(1); }
+
+    // A filter the compiler rejects fails the start instead of capturing everything
+    if (KTerm_Net_PacketDiag_Start(term, session, "interface=lo;backend=tpacket;filter=udp port")) { fprintf(stderr, "Bad filter accepted\n"); exit(1); }
+
+    KTerm_Net_DestroyContext(session);
+}
+#endif
+
 void test_packetdiag_detail(KTerm* term, KTermSession* session) {
     printf("  Testing PacketDiag Detail...\n");
 
@@ -137,10 +879,12 @@ void test_packetdiag_detail(KTerm* term, KTermSession* session) {
 
     // Manual injection bypassing handler since pcap is mocked/threaded
     // Just directly manipulate ring for unit test
-    net->packetdiag->packet_ring[0].len = 64;
-    memcpy(net->packetdiag->packet_ring[0].data, pkt, 64);
-    net->packetdiag->ring_head = 1;
-    net->packetdiag->ring_count = 1;
+    // Packet 0 lands in the first worker's history
+    PacketDiagShard* sh = &net->packetdiag->shards[0];
+    sh->history[0].len = 64;
+    sh->history[0].id = 0;
+    memcpy(sh->history[0].data, pkt, 64);
+    sh->history_count = 1;
 
     // Request Detail
     // packetdiag_detail;packet=0
@@ -381,9 +1125,18 @@ void test_protocol_identification() {
     assert(strcmp(p->category, "Media") == 0);
 
 
+    p = KTerm_Net_IdentifyProtocol(14600, true);
+    assert(p != NULL && strcmp(p->short_name, "Dante-U") == 0);
+    assert(KTerm_Net_IdentifyProtocol(14601, true) == NULL);
+
+    // Duplicate exact ports: the later row wins when transports agree
+    p = KTerm_Net_QueryProtocol(22, false);
+    assert(p != NULL && strcmp(p->short_name, "SSH") == 0);
+
     // Test unknown port
     p = KTerm_Net_IdentifyProtocol(9999, false);
     assert(p == NULL);
+    assert(KTerm_Net_QueryProtocol(0, true) == NULL);
 }
 
 int main() {
@@ -399,12 +1152,23 @@ int main() {
         return 1;
     }
 
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     test_mtu_probe_api(term, session);
     test_frag_test_api(term, session);
     test_ping_ext_api(term, session);
     test_packetdiag_api(term, session);
+    test_packetdiag_workers(term, session);
+    test_packetdiag_flow_table(term, session);
+    test_packetdiag_layers(term, session);
+    test_packetdiag_record_replay(term, session);
+    test_packetdiag_render(term, session);
+    test_packetdiag_tcp_stream(term, session);
+    test_packetdiag_auth_automaton();
+    test_net_metrics(term, session);
+#ifdef KTERM_PACKETDIAG_HAVE_TPACKET
+    test_packetdiag_tpacket(term, session);
+#endif
 
     // Reset terminal/parser state for gateway tests
     reset_terminal(term);
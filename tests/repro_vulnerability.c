@@ -41,7 +41,7 @@ int main() {
     if (!term) return 1;
     KTerm_Net_Init(term);
     
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
     KTermNetCallbacks cbs = {0};
     cbs.on_auth = on_auth;
     KTerm_Net_SetCallbacks(term, session, cbs);
@@ -253,6 +253,20 @@ void test_ansi_sys_compliance(KTerm* term, KTermSession* session) {
     assert(session->current_attributes & KTERM_ATTR_UNDERLINE);
 }
 
+void test_ris_resets_session_modes(KTerm* term, KTermSession* session) {
+    // Designate DEC Special Graphics into G0 and clear every tab stop
+    write_sequence(term, "\x1B(0");
+    write_sequence(term, "\x1B[3g");
+    assert(session->charset.g0 == CHARSET_DEC_SPECIAL);
+    assert(session->tab_stops.count == 0);
+
+    // RIS must restore the power-on charsets and the default 8-column stops
+    write_sequence(term, "\x1B" "c");
+    session = GET_SESSION(term);
+    assert(session->charset.g0 == CHARSET_ASCII);
+    assert(session->tab_stops.count == 31);
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -292,6 +306,7 @@ int main() {
         {"test_session_attribute_isolation", test_session_attribute_isolation},
         {"test_session_switching_dirty_state", test_session_switching_dirty_state},
         {"test_ansi_sys_compliance", test_ansi_sys_compliance},
+        {"test_ris_resets_session_modes", test_ris_resets_session_modes},
     };
 
     int num_tests = sizeof(tests) / sizeof(tests[0]);
@@ -21,7 +21,8 @@ typedef struct KTermSession_T {
 } KTermSession;
 
 typedef struct KTerm_T {
-    KTermSession sessions[MAX_SESSIONS];
+    KTermSession* sessions[MAX_SESSIONS];
+    int session_capacity;
     void (*response_callback)(struct KTerm_T*, const char*, int);
     // Mock Resize
     int width, height;
@@ -78,6 +78,65 @@ void test_compositor_operations(KTerm* term, KTermSession* session) {
     KTerm_Draw(term);
 }
 
+static void flush_pane_sessions(KTerm* term) {
+    for (int n = 0; n < term->live_session_count; n++) {
+        KTerm_FlushOps(term, term->sessions[term->live_sessions[n]]);
+    }
+}
+
+void test_pane_damage_tracking(KTerm* unused_term, KTermSession* unused_session) {
+    (void)unused_term; (void)unused_session;
+    KTerm* term = create_test_term(80, 24);
+    assert(term && term->layout && term->terminal_buffer.id != 0);
+    KTermCompositor* comp = &term->compositor;
+
+    KTermPane* right = KTerm_SplitPane(term, term->layout->root, PANE_SPLIT_HORIZONTAL, 0.5f);
+    assert(right);
+    KTermPane* left = term->layout->root->child_a;
+    KTermPane* bottom = KTerm_SplitPane(term, right, PANE_SPLIT_VERTICAL, 0.5f);
+    assert(bottom);
+    KTermPane* top = right->child_a;
+    flush_pane_sessions(term);
+
+    // Both render buffers receive the new geometry, after which the panes are idle
+    KTermCompositor_Prepare(comp, term);
+    KTermCompositor_Prepare(comp, term);
+    assert(left->geometry_dirty == 0 && top->geometry_dirty == 0 && bottom->geometry_dirty == 0);
+    assert(comp->upload_top == 0 && comp->upload_bottom == 23);
+    comp->upload_top = 0; comp->upload_bottom = -1; // As if rendered
+
+    KTermCompositor_Prepare(comp, term);
+    assert(comp->upload_top > comp->upload_bottom);
+
+    // Output in one pane damages only its rows
+    KTermSession* top_session = KTerm_GetSession(term, top->session_index);
+    const char* out = "\x1B[4;2HX";
+    for (const char* c = out; *c; c++) KTerm_ProcessChar(term, top_session, (unsigned char)*c);
+    KTerm_FlushOps(term, top_session);
+    KTermCompositor_Prepare(comp, term);
+    assert(comp->upload_top == 3 && comp->upload_bottom == 3);
+    assert(comp->render_buffers[comp->rb_front].cells[3 * 80 + 41].char_code == 'X');
+    comp->upload_top = 0; comp->upload_bottom = -1;
+    KTermCompositor_Prepare(comp, term);
+    assert(comp->render_buffers[comp->rb_front].cells[3 * 80 + 41].char_code == 'X');
+
+    // Closing a pane re-encodes the sibling that grows, not the untouched left pane
+    for (int i = 0; i < 2; i++) comp->render_buffers[i].cells[5 * 80 + 7].char_code = 0x2588;
+    KTerm_ClosePane(term, bottom);
+    assert(left->geometry_dirty == 0);
+    assert(top->geometry_dirty == KTERM_PANE_RELAYOUT_FRAMES && top->height == 24);
+    flush_pane_sessions(term);
+    KTermCompositor_Prepare(comp, term);
+    KTermCompositor_Prepare(comp, term);
+    assert(top->geometry_dirty == 0);
+    for (int i = 0; i < 2; i++) {
+        assert(comp->render_buffers[i].cells[5 * 80 + 7].char_code == 0x2588);
+        assert(comp->render_buffers[i].cells[20 * 80 + 50].char_code != 0x2588);
+    }
+
+    destroy_test_term(term);
+}
+
 // ============================================================================
 // FONT RENDERING TESTS (from test_font_padding.c)
 // ============================================================================
@@ -262,6 +321,7 @@ int main() {
         {"test_kitty_image_protocol", test_kitty_image_protocol},
         {"test_kitty_defaults", test_kitty_defaults},
         {"test_compositor_operations", test_compositor_operations},
+        {"test_pane_damage_tracking", test_pane_damage_tracking},
         {"test_font_rendering_metrics", test_font_rendering_metrics},
         {"test_pane_tiling_performance", test_pane_tiling_performance},
         {"test_rectangle_fill_operations", test_rectangle_fill_operations},
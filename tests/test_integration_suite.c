@@ -85,6 +85,155 @@ void test_active_session_isolation(KTerm* term, KTermSession* session) {
     assert(session != NULL);
 }
 
+// ============================================================================
+// SESSION POOL TESTS
+// ============================================================================
+
+void test_session_pool_growth(KTerm* term, KTermSession* session) {
+    int count = KTerm_GetSessionCount(term);
+    assert(count >= 1);
+    assert(session->index == term->active_session);
+
+    // Slots past the initial table are created on first use, but not by the cross-thread writers
+    assert(KTerm_GetSession(term, 300) == NULL);
+    assert(KTerm_WriteToSession(term, 300, "abc", 3) == 0);
+    assert(KTerm_GetSession(term, 300) == NULL);
+
+    // Host output through the gateway only creates low session indices
+    write_sequence(term, "\x1BPGATE;KTERM;1;SET;SESSION;300\x1B\\");
+    assert(KTerm_GetSession(term, 300) == NULL);
+    assert(term->gateway_target_session != 300);
+    KTermSession* far = KTerm_AcquireSession(term, 300);
+    assert(far != NULL);
+    assert(far->index == 300);
+    assert(!far->session_open);
+    assert(term->session_capacity > 300);
+    assert(KTerm_GetSession(term, 300) == far);
+    assert(KTerm_AcquireSession(term, 300) == far);
+    assert(KTerm_GetSessionCount(term) == count + 1);
+    assert(KTerm_AcquireSession(term, KTERM_SESSION_LIMIT) == NULL);
+    assert(KTerm_AcquireSession(term, -1) == NULL);
+
+    // Op ring and key buffer stay unallocated until the session is used
+    assert(far->op_queue.ops == NULL);
+    assert(far->input.buffer == NULL);
+    assert(KTerm_WriteToSession(term, 300, "abc", 3) == 3);
+
+    // Opening takes the first free slot and leaves the active session alone
+    int opened = KTerm_OpenSession(term);
+    assert(opened > 0 && opened != 300);
+    assert(KTerm_GetSession(term, opened)->session_open);
+    assert(GET_SESSION(term) == session);
+    KTerm_GetSession(term, opened)->session_open = false;
+
+    // The classic sessions exist right after Init, so writers can reach them at once
+    KTerm* fresh = create_test_term(80, 24);
+    assert(fresh != NULL);
+    assert(KTerm_GetSessionCount(fresh) == MAX_SESSIONS);
+    assert(KTerm_WriteToSession(fresh, 1, "abc", 3) == 3);
+    for (int i = 0; i < MAX_SESSIONS; i++) assert(KTerm_GetSession(fresh, i) != NULL);
+
+#ifndef KTERM_DISABLE_NET
+    // A network target past the classic sessions is created rather than silently dropped
+    KTermSession* net_session = GET_SESSION(fresh);
+    KTermNetSession* net = KTerm_Net_CreateContext(net_session);
+    assert(net != NULL);
+    KTerm_Net_SetTargetSession(fresh, net_session, MAX_SESSIONS + 2);
+    assert(net->target_session_index == MAX_SESSIONS + 2);
+    assert(KTerm_GetSession(fresh, MAX_SESSIONS + 2) != NULL);
+    KTerm_Net_SetTargetSession(fresh, net_session, KTERM_SESSION_LIMIT);
+    assert(net->target_session_index == MAX_SESSIONS + 2);
+    KTerm_Net_DestroyContext(net_session);
+#endif
+    destroy_test_term(fresh);
+}
+
+// ============================================================================
+// RESIZE REFLOW TESTS
+// ============================================================================
+
+// Every logical line written below is one letter repeated; checks that each row of the
+// main screen above the cursor line (scrollback included) holds a run of a single letter,
+// full when the line continues, and that the letters run in order
+static void check_reflowed_rows(KTermSession* session, int* lines) {
+    char prev = 0;
+    *lines = 0;
+    for (int y = -session->history_rows_populated; y < session->cursor.y; y++) {
+        EnhancedTermChar* row = GetActiveScreenRow(session, y);
+        char ch = (char)row[0].ch;
+        if (ch == ' ' || ch == 0) continue;
+        int len = 0;
+        while (len < session->cols && row[len].ch == (unsigned int)ch) len++;
+        for (int x = len; x < session->cols; x++) assert(row[x].ch == ' ');
+        bool wrapped = (row[session->cols - 1].flags & KTERM_FLAG_WRAPPED) != 0;
+        assert(!wrapped || len == session->cols);
+        EnhancedTermChar* next = GetActiveScreenRow(session, y + 1);
+        assert(wrapped == (y + 1 < session->rows && next[0].ch == (unsigned int)ch));
+        if (ch != prev) {
+            if (prev) assert(ch == (prev == 'Z' ? 'A' : prev + 1));
+            (*lines)++;
+        }
+        prev = ch;
+    }
+}
+
+void test_resize_reflow(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B[2J\x1B[H");
+    char line[160];
+    for (int i = 0; i < 60; i++) { // 120 columns each: two rows at 80, three at 40 or 50
+        memset(line, 'A' + i % 26, 120);
+        line[120] = '\0';
+        write_sequence(term, line);
+        write_sequence(term, "\r\n");
+    }
+    write_sequence(term, "tail");
+    KTerm_FlushOps(term, session);
+    assert(GetActiveScreenRow(session, 0)[79].flags & KTERM_FLAG_WRAPPED);
+    assert(!(GetActiveScreenRow(session, 1)[79].flags & KTERM_FLAG_WRAPPED));
+    int history = session->history_rows_populated;
+    assert(history > 0);
+
+    // Consecutive resizes collapse into one queued op
+    int queued = session->op_queue.count;
+    KTerm_QueueResize(session, 50, 25, true);
+    KTerm_QueueResize(session, 40, 25, true);
+    assert(session->op_queue.count == queued + 1);
+    KTerm_FlushOps(term, session);
+    assert(session->cols == 40);
+
+    // The screen is rewrapped at once, with the cursor following its text
+    assert(session->cursor.y == 24 && session->cursor.x == 4);
+    assert(GetActiveScreenRow(session, 24)[0].ch == 't');
+    EnhancedTermChar* above = GetActiveScreenRow(session, 23);
+    assert(above[0].ch == above[39].ch && !(above[39].flags & KTERM_FLAG_WRAPPED));
+
+    // Scrollback is rewrapped only as far as the view reaches
+    assert(session->reflow.buffer != NULL);
+    int deferred = session->history_rows_populated;
+    KTerm_ReflowHistory(session, deferred + 10);
+    assert(session->history_rows_populated >= deferred + 10);
+    assert(session->reflow.buffer != NULL);
+    int lines = 0;
+    check_reflowed_rows(session, &lines);
+
+    // A second resize rewraps the rows already pulled in and keeps deferring the rest
+    KTerm_QueueResize(session, 60, 25, true);
+    KTerm_FlushOps(term, session);
+    KTerm_ReflowHistory(session, MAX_SCROLLBACK_LINES);
+    assert(session->reflow.buffer == NULL);
+    check_reflowed_rows(session, &lines);
+    assert(lines == 60);
+    assert(session->cursor.y == 16 && session->history_rows_populated == (60 - 8) * 2); // Screen lines now take fewer rows
+
+    KTerm_QueueResize(session, 80, 25, true);
+    KTerm_FlushOps(term, session);
+    KTerm_ReflowHistory(session, MAX_SCROLLBACK_LINES);
+    check_reflowed_rows(session, &lines);
+    assert(lines == 60);
+    write_sequence(term, "\x1B[2J\x1B[H");
+    KTerm_FlushOps(term, session);
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -118,6 +267,8 @@ int main() {
         {"test_thread_safety", test_thread_safety},
         {"test_safety_checks", test_safety_checks},
         {"test_active_session_isolation", test_active_session_isolation},
+        {"test_session_pool_growth", test_session_pool_growth},
+        {"test_resize_reflow", test_resize_reflow},
     };
 
     int num_tests = sizeof(tests) / sizeof(tests[0]);
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/resource.h>
 // Global for error handling
 // ============================================================================
 // NETWORK CONNECTIVITY TESTS (from test_kt_net.c)
@@ -71,6 +72,543 @@ void test_vt_pipe_integration(KTerm* term, KTermSession* session) {
     assert(cell != NULL);
 }
 
+// ============================================================================
+// ASYNC DNS RESOLVER TESTS (local stub DNS server)
+// ============================================================================
+
+typedef struct {
+    int calls;
+    bool success;
+    bool from_cache;
+    char ip[64];
+    uint32_t ttl;
+} DnsTestResult;
+
+static void dns_test_callback(KTerm* term, KTermSession* session, const KTermResolveResult* result, void* user_data) {
+    (void)term; (void)session;
+    DnsTestResult* r = (DnsTestResult*)user_data;
+    r->calls++;
+    r->success = result->success;
+    r->from_cache = result->from_cache;
+    r->ttl = result->ttl_sec;
+    snprintf(r->ip, sizeof(r->ip), "%s", result->ip);
+}
+
+// Answers one pending query on the stub socket with an A record (or NXDOMAIN)
+static bool dns_stub_answer(int fd, const uint8_t ip[4], uint32_t ttl, bool nxdomain) {
+    uint8_t q[512], a[600];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int n = (int)recvfrom(fd, q, sizeof(q), MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+    if (n < 12) return false;
+
+    memcpy(a, q, n);
+    a[2] = 0x81; // QR | RD
+    a[3] = nxdomain ? 0x83 : 0x80; // RA | RCODE
+    a[6] = 0; a[7] = nxdomain ? 0 : 1; // ANCOUNT
+    int pos = n;
+    if (!nxdomain) {
+        const uint8_t rr[] = { 0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01,
+                               (uint8_t)(ttl >> 24), (uint8_t)(ttl >> 16), (uint8_t)(ttl >> 8), (uint8_t)ttl,
+                               0x00, 0x04, ip[0], ip[1], ip[2], ip[3] };
+        memcpy(a + pos, rr, sizeof(rr));
+        pos += sizeof(rr);
+    }
+    sendto(fd, a, pos, 0, (struct sockaddr*)&from, from_len);
+    return true;
+}
+
+void test_async_dns_resolver(KTerm* term, KTermSession* session) {
+    int stub = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(stub >= 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(stub, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t alen = sizeof(addr);
+    getsockname(stub, (struct sockaddr*)&addr, &alen);
+
+    KTerm_Net_SetDnsServer("127.0.0.1", ntohs(addr.sin_port));
+    KTerm_Net_FlushDnsCache();
+
+    // 1. Lookup completes through the callback, never synchronously
+    DnsTestResult r = {0};
+    uint32_t id = KTerm_Net_ResolveAsync(term, session, "stub.kterm.test", KTERM_RESOLVE_IPV4, dns_test_callback, &r);
+    assert(id != 0);
+    assert(r.calls == 0);
+
+    const uint8_t ip[4] = { 10, 1, 2, 3 };
+    bool answered = false;
+    for (int i = 0; i < 200 && r.calls == 0; i++) {
+        if (!answered) answered = dns_stub_answer(stub, ip, 300, false);
+        KTerm_Net_ProcessResolver();
+        usleep(1000);
+    }
+    assert(r.calls == 1);
+    assert(r.success);
+    assert(strcmp(r.ip, "10.1.2.3") == 0);
+    assert(r.ttl == 300);
+    assert(!r.from_cache);
+
+    // 2. Second lookup is a cache hit shared by all sessions
+    KTermResolveResult cached;
+    assert(KTerm_Net_ResolveCached("stub.kterm.test", KTERM_RESOLVE_IPV4, &cached));
+    assert(cached.success && cached.from_cache);
+    char ip_str[64];
+    assert(KTerm_Net_Resolve("stub.kterm.test", ip_str, sizeof(ip_str)));
+    assert(strcmp(ip_str, "10.1.2.3") == 0);
+
+    // 3. NXDOMAIN is reported and negatively cached
+    DnsTestResult nx = {0};
+    id = KTerm_Net_ResolveAsync(term, session, "missing.kterm.test", KTERM_RESOLVE_IPV4, dns_test_callback, &nx);
+    answered = false;
+    for (int i = 0; i < 200 && nx.calls == 0; i++) {
+        if (!answered) answered = dns_stub_answer(stub, ip, 0, true);
+        KTerm_Net_ProcessResolver();
+        usleep(1000);
+    }
+    assert(nx.calls == 1 && !nx.success);
+    assert(KTerm_Net_ResolveCached("missing.kterm.test", KTERM_RESOLVE_IPV4, &cached) && !cached.success);
+
+    // 4. Cancelled lookups never call back
+    DnsTestResult cancelled = {0};
+    id = KTerm_Net_ResolveAsync(term, session, "cancel.kterm.test", KTERM_RESOLVE_IPV4, dns_test_callback, &cancelled);
+    KTerm_Net_ResolveCancel(id);
+    for (int i = 0; i < 20; i++) { dns_stub_answer(stub, ip, 60, false); KTerm_Net_ProcessResolver(); usleep(1000); }
+    assert(cancelled.calls == 0);
+
+    // 5. Literal addresses bypass the resolver
+    assert(KTerm_Net_ResolveCached("127.0.0.1", KTERM_RESOLVE_IPV4, &cached) && cached.success);
+
+    KTerm_Net_SetDnsServer(NULL, 0);
+    KTerm_Net_FlushDnsCache();
+    close(stub);
+}
+
+// ============================================================================
+// WINDOWED PORT SCAN TESTS (loopback listeners)
+// ============================================================================
+
+typedef struct {
+    int results;
+    int open;
+    int errors;
+    int order[16];
+} PortScanTestResult;
+
+static void portscan_test_callback(KTerm* term, KTermSession* session, const char* host, int port, int status, void* user_data) {
+    (void)term; (void)session; (void)host;
+    PortScanTestResult* r = (PortScanTestResult*)user_data;
+    if (r->results < 16) r->order[r->results] = port;
+    r->results++;
+    if (status == 1) r->open++;
+    if (status == 2) r->errors++;
+}
+
+// Fills the descriptor table under a lowered limit; returns how many fds were taken
+static int portscan_exhaust_fds(int* fds, int max, struct rlimit* saved) {
+    getrlimit(RLIMIT_NOFILE, saved);
+    struct rlimit low = *saved;
+    low.rlim_cur = 256;
+    setrlimit(RLIMIT_NOFILE, &low);
+    int n = 0;
+    while (n < max && (fds[n] = dup(0)) >= 0) n++;
+    return n;
+}
+
+static void portscan_release_fds(int* fds, int n, const struct rlimit* saved) {
+    for (int i = 0; i < n; i++) close(fds[i]);
+    setrlimit(RLIMIT_NOFILE, saved);
+}
+
+static int portscan_listen(int* port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    listen(fd, 8);
+    socklen_t alen = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &alen);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+void test_windowed_port_scan(KTerm* term, KTermSession* session) {
+    int open_ports[3], closed_ports[3];
+    int listeners[3];
+    for (int i = 0; i < 3; i++) listeners[i] = portscan_listen(&open_ports[i]);
+    for (int i = 0; i < 3; i++) close(portscan_listen(&closed_ports[i])); // Free but unbound
+
+    char ports[128];
+    snprintf(ports, sizeof(ports), "%d,%d,%d,%d,%d,%d",
+             open_ports[0], closed_ports[0], open_ports[1], closed_ports[1], open_ports[2], closed_ports[2]);
+
+    // 1. Window of 4: all six ports are reported exactly once
+    PortScanTestResult r = {0};
+    assert(KTerm_Net_PortScanEx(term, session, "127.0.0.1", ports, 500, 4, 0, portscan_test_callback, &r, NULL));
+    KTermNetSession* net = (KTermNetSession*)session->user_data;
+    for (int i = 0; i < 500 && net->port_scan; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(net->port_scan == NULL);
+    assert(r.results == 6);
+    assert(r.open == 3);
+
+    // 2. Ranges expand inline
+    PortScanTestResult rr = {0};
+    snprintf(ports, sizeof(ports), "%d-%d", open_ports[0], open_ports[0] + 2);
+    assert(KTerm_Net_PortScan(term, session, "127.0.0.1", ports, 500, portscan_test_callback, &rr, NULL));
+    for (int i = 0; i < 500 && net->port_scan; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(rr.results == 3);
+    assert(rr.order[0] >= open_ports[0] && rr.order[0] <= open_ports[0] + 2);
+
+    // 3. Rate limit paces connects (2/sec => only one launch on the first tick)
+    PortScanTestResult rl = {0};
+    snprintf(ports, sizeof(ports), "%d,%d,%d", open_ports[0], open_ports[1], open_ports[2]);
+    assert(KTerm_Net_PortScanEx(term, session, "127.0.0.1", ports, 500, 8, 2, portscan_test_callback, &rl, NULL));
+    KTerm_Net_Process(term);
+    assert(rl.results <= 1);
+    assert(net->port_scan && net->port_scan->in_flight + rl.results == 1);
+    KTerm_Net_FreePortScan(net->port_scan);
+    net->port_scan = NULL;
+
+    // 4. socket() failures requeue the port instead of reporting it closed
+    int fds[256];
+    struct rlimit saved;
+    PortScanTestResult rf = {0};
+    snprintf(ports, sizeof(ports), "%d", open_ports[0]);
+    assert(KTerm_Net_PortScan(term, session, "127.0.0.1", ports, 500, portscan_test_callback, &rf, NULL));
+    for (int i = 0; i < 500 && net->port_scan->state != 1; i++) { KTerm_Net_Process(term); usleep(1000); }
+    int taken = portscan_exhaust_fds(fds, 256, &saved);
+    for (int i = 0; i < 3; i++) KTerm_Net_Process(term);
+    assert(rf.results == 0 && net->port_scan && net->port_scan->retry_port == open_ports[0]);
+    portscan_release_fds(fds, taken, &saved);
+    for (int i = 0; i < 500 && net->port_scan; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(rf.results == 1 && rf.open == 1);
+
+    // ...and give up with ERROR once the retry budget is spent
+    PortScanTestResult re = {0};
+    assert(KTerm_Net_PortScan(term, session, "127.0.0.1", ports, 500, portscan_test_callback, &re, NULL));
+    for (int i = 0; i < 500 && net->port_scan->state != 1; i++) { KTerm_Net_Process(term); usleep(1000); }
+    taken = portscan_exhaust_fds(fds, 256, &saved);
+    for (int i = 0; i <= KTERM_NET_PORTSCAN_SOCKET_RETRIES + 1 && net->port_scan; i++) KTerm_Net_Process(term);
+    portscan_release_fds(fds, taken, &saved);
+    assert(net->port_scan == NULL);
+    assert(re.results == 1 && re.errors == 1 && re.open == 0);
+
+    for (int i = 0; i < 3; i++) close(listeners[i]);
+}
+
+// ============================================================================
+// THREADED SPEEDTEST TESTS (loopback source/sink server)
+// ============================================================================
+
+typedef struct {
+    int listen_fd;
+    atomic_bool stop;
+} SpeedtestStubServer;
+
+static void* speedtest_stub_conn(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    static char buf[65536];
+    char req[1024];
+    int n = (int)recv(fd, req, sizeof(req), 0);
+    if (n > 3 && memcmp(req, "GET", 3) == 0) {
+        while (send(fd, buf, sizeof(buf), MSG_NOSIGNAL) > 0) {} // Source until the client closes
+    } else {
+        char sink[65536];
+        while (recv(fd, sink, sizeof(sink), 0) > 0) {} // Sink uploads
+    }
+    close(fd);
+    return NULL;
+}
+
+static void* speedtest_stub_accept(void* arg) {
+    SpeedtestStubServer* srv = (SpeedtestStubServer*)arg;
+    while (!atomic_load(&srv->stop)) {
+        int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) break;
+        pthread_t t;
+        pthread_create(&t, NULL, speedtest_stub_conn, (void*)(intptr_t)fd);
+        pthread_detach(t);
+    }
+    return NULL;
+}
+
+typedef struct {
+    int progress_dl;
+    int progress_ul;
+    bool done;
+    SpeedtestResult final;
+} SpeedtestTestResult;
+
+static void speedtest_test_callback(KTerm* term, KTermSession* session, const SpeedtestResult* result, void* user_data) {
+    (void)term; (void)session;
+    SpeedtestTestResult* r = (SpeedtestTestResult*)user_data;
+    if (result->done) { r->done = true; r->final = *result; }
+    else if (result->phase == 1) r->progress_dl++;
+    else if (result->phase == 2) r->progress_ul++;
+}
+
+void test_threaded_speedtest(KTerm* term, KTermSession* session) {
+    SpeedtestStubServer srv;
+    atomic_init(&srv.stop, false);
+    int port = 0;
+    srv.listen_fd = portscan_listen(&port);
+    pthread_t acceptor;
+    pthread_create(&acceptor, NULL, speedtest_stub_accept, &srv);
+
+    KTermSpeedtestOptions opts = {0};
+    opts.threaded = true;
+    opts.duration_sec = 0.5;
+    opts.report_hz = 20;
+    opts.kernel_timestamps = true;
+
+    SpeedtestTestResult r = {0};
+    assert(KTerm_Net_SpeedtestEx(term, session, "127.0.0.1", port, 4, "/stream", &opts, speedtest_test_callback, &r, NULL));
+    KTermNetSession* net = (KTermNetSession*)session->user_data;
+    for (int i = 0; i < 10000 && !r.done; i++) { KTerm_Net_Process(term); usleep(1000); }
+
+    assert(r.done);
+    assert(r.final.dl_bytes > 0 && r.final.ul_bytes > 0);
+    assert(r.final.dl_mbps > 0 && r.final.ul_mbps > 0);
+    // Interim reports follow report_hz, not the frame rate (~500 frames per phase here)
+    assert(r.progress_dl >= 1 && r.progress_dl <= 12);
+    assert(r.progress_ul >= 1 && r.progress_ul <= 12);
+
+    KTerm_Net_FreeSpeedtest(net->speedtest);
+    net->speedtest = NULL;
+
+    atomic_store(&srv.stop, true);
+    shutdown(srv.listen_fd, SHUT_RDWR);
+    close(srv.listen_fd);
+    pthread_join(acceptor, NULL);
+}
+
+// ============================================================================
+// HTTP PROBE POOL TESTS (loopback keep-alive server)
+// ============================================================================
+
+static atomic_int http_stub_accepts;
+
+static void* http_stub_conn(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    char buf[8192];
+    int len = 0;
+    for (;;) {
+        int n = (int)recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) break;
+        len += n;
+        buf[len] = '\0';
+        char* end;
+        // Answer every complete request in the buffer (pipelining)
+        while ((end = strstr(buf, "\r\n\r\n")) != NULL) {
+            bool close_conn = strncmp(buf, "GET /close", 10) == 0;
+            const char* resp;
+            if (strncmp(buf, "GET /chunked", 12) == 0) {
+                resp = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+            } else if (close_conn) {
+                resp = "HTTP/1.1 200 OK\r\nContent-Length: 3\r\nConnection: close\r\n\r\nbye";
+            } else {
+                resp = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            }
+            send(fd, resp, strlen(resp), MSG_NOSIGNAL);
+            int used = (int)(end - buf) + 4;
+            memmove(buf, buf + used, len - used + 1);
+            len -= used;
+            if (close_conn) { close(fd); return NULL; }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void* http_stub_accept(void* arg) {
+    int lfd = (int)(intptr_t)arg;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) break;
+        atomic_fetch_add(&http_stub_accepts, 1);
+        pthread_t t;
+        pthread_create(&t, NULL, http_stub_conn, (void*)(intptr_t)fd);
+        pthread_detach(t);
+    }
+    return NULL;
+}
+
+typedef struct {
+    int results;
+    int ok;
+    int reused;
+    int pipelined;
+    int last_remaining;
+    bool seen[16];
+} HttpProbeTestResult;
+
+static void http_probe_test_callback(KTerm* term, KTermSession* session, const KTermHttpProbeResult* result, void* user_data) {
+    (void)term; (void)session;
+    HttpProbeTestResult* r = (HttpProbeTestResult*)user_data;
+    r->results++;
+    if (!result->error && result->status_code == 200) r->ok++;
+    if (result->reused) r->reused++;
+    if (result->pipelined) r->pipelined++;
+    if (result->index >= 0 && result->index < 16) r->seen[result->index] = true;
+    r->last_remaining = result->remaining;
+}
+
+void test_http_probe_pool(KTerm* term, KTermSession* session) {
+    int port = 0;
+    int lfd = portscan_listen(&port);
+    atomic_store(&http_stub_accepts, 0);
+    pthread_t acceptor;
+    pthread_create(&acceptor, NULL, http_stub_accept, (void*)(intptr_t)lfd);
+
+    char urls_buf[8][128];
+    const char* urls[8];
+    for (int i = 0; i < 8; i++) {
+        snprintf(urls_buf[i], sizeof(urls_buf[i]), "http://127.0.0.1:%d/%s%d", port, (i % 2) ? "chunked/" : "item/", i);
+        urls[i] = urls_buf[i];
+    }
+
+    // 1. Batch of 8 over at most 2 connections, 4 deep: every URL answered once
+    KTermHttpProbeOptions opts = {0};
+    opts.per_host = 2;
+    opts.pipeline_depth = 4;
+    HttpProbeTestResult r = {0};
+    assert(KTerm_Net_HttpProbeBatch(term, session, urls, 8, &opts, http_probe_test_callback, &r, NULL));
+    for (int i = 0; i < 2000 && r.results < 8; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(r.results == 8 && r.ok == 8);
+    for (int i = 0; i < 8; i++) assert(r.seen[i]);
+    assert(r.last_remaining == 0);
+    assert(r.pipelined > 0);
+    assert(atomic_load(&http_stub_accepts) <= 2);
+
+    // 2. A later single probe reuses a pooled keep-alive connection
+    int accepts = atomic_load(&http_stub_accepts);
+    HttpProbeTestResult single = {0};
+    assert(KTerm_Net_HttpProbe(term, session, urls[0], http_probe_test_callback, &single, NULL));
+    for (int i = 0; i < 2000 && single.results < 1; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(single.ok == 1 && single.reused == 1);
+    assert(atomic_load(&http_stub_accepts) == accepts);
+
+    // 3. Connection: close retires the connection; the next probe still succeeds
+    char close_url[128];
+    snprintf(close_url, sizeof(close_url), "http://127.0.0.1:%d/close", port);
+    HttpProbeTestResult closed = {0};
+    const char* close_urls[2] = { close_url, urls[2] };
+    opts.per_host = 1;
+    opts.pipeline_depth = 1;
+    assert(KTerm_Net_HttpProbeBatch(term, session, close_urls, 2, &opts, http_probe_test_callback, &closed, NULL));
+    for (int i = 0; i < 2000 && closed.results < 2; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(closed.ok == 2);
+
+    KTermNetSession* net = (KTermNetSession*)session->user_data;
+    KTerm_Net_FreeHttpProbe(net->http_probe);
+    net->http_probe = NULL;
+
+    shutdown(lfd, SHUT_RDWR);
+    close(lfd);
+    pthread_join(acceptor, NULL);
+}
+
+// ============================================================================
+// SHARED ICMP ENGINE TESTS (loopback echo; skipped without ICMP socket access)
+// ============================================================================
+
+typedef struct {
+    int results;
+    int ok;
+    int reached;
+    int kernel_timed;
+    int errors;
+    double max_rtt;
+} IcmpTestResult;
+
+static void icmp_test_callback(KTerm* term, KTermSession* session, const KTermIcmpResult* result, void* user_data) {
+    (void)term; (void)session;
+    IcmpTestResult* r = (IcmpTestResult*)user_data;
+    r->results++;
+    if (result->error[0]) r->errors++;
+    if (result->success) r->ok++;
+    if (result->reached) r->reached++;
+    if (result->kernel_timed) r->kernel_timed++;
+    if (result->rtt_ms > r->max_rtt) r->max_rtt = result->rtt_ms;
+}
+
+typedef struct {
+    int hops;
+    int last_hop;
+    bool reached;
+    char ip[64];
+} TracerouteTestResult;
+
+static void icmp_traceroute_callback(KTerm* term, KTermSession* session, int hop, const char* ip, double rtt_ms, bool reached, void* user_data) {
+    (void)term; (void)session; (void)rtt_ms;
+    TracerouteTestResult* r = (TracerouteTestResult*)user_data;
+    r->hops++;
+    r->last_hop = hop;
+    r->reached = reached;
+    snprintf(r->ip, sizeof(r->ip), "%s", ip);
+}
+
+static void icmp_response_time_callback(KTerm* term, KTermSession* session, const ResponseTimeResult* result, void* user_data) {
+    (void)term; (void)session;
+    *(ResponseTimeResult*)user_data = *result;
+}
+
+void test_shared_icmp_engine(KTerm* term, KTermSession* session) {
+    struct sockaddr_in lo = {0};
+    lo.sin_family = AF_INET;
+    lo.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // 1. Many concurrent probes share one socket and each completes exactly once
+    IcmpTestResult r = {0};
+    uint32_t ids[200];
+    for (int i = 0; i < 200; i++) {
+        ids[i] = KTerm_Net_IcmpEcho(term, session, &lo, sizeof(lo), 0, 64, 1000, icmp_test_callback, &r);
+        assert(ids[i] != 0);
+        if (i > 0) assert(ids[i] != ids[i - 1]);
+    }
+    for (int i = 0; i < 2000 && r.results < 200; i++) { KTerm_Net_ProcessIcmp(); usleep(1000); }
+    assert(r.results == 200);
+    if (r.errors == 200) {
+        printf("  (skipped: no ICMP socket permission)\n");
+        return;
+    }
+    assert(r.ok == 200 && r.reached == 200);
+    assert(r.max_rtt < 1000.0);
+    assert(r.kernel_timed == 200);
+
+    // 2. Cancelled probes never call back
+    IcmpTestResult cancelled = {0};
+    uint32_t id = KTerm_Net_IcmpEcho(term, session, &lo, sizeof(lo), 0, 64, 100, icmp_test_callback, &cancelled);
+    KTerm_Net_IcmpCancel(id);
+    for (int i = 0; i < 50; i++) { KTerm_Net_ProcessIcmp(); usleep(1000); }
+    assert(cancelled.results == 0);
+
+    // 3. Traceroute to loopback: every hop probed at once, reported up to the destination only
+    TracerouteTestResult tr = {0};
+    KTerm_Net_Traceroute(term, session, "127.0.0.1", 8, 1000, icmp_traceroute_callback, &tr, NULL);
+    for (int i = 0; i < 2000 && !tr.reached; i++) { KTerm_Net_Process(term); usleep(1000); }
+    for (int i = 0; i < 20; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(tr.hops == 1 && tr.last_hop == 1 && tr.reached);
+    assert(strcmp(tr.ip, "127.0.0.1") == 0);
+
+    // 4. Response time runs its probes through the engine
+    ResponseTimeResult rt;
+    memset(&rt, 0, sizeof(rt));
+    rt.sent = -1;
+    assert(KTerm_Net_ResponseTime(term, session, "127.0.0.1", 3, 10, 1000, icmp_response_time_callback, &rt, NULL, false));
+    for (int i = 0; i < 2000 && rt.sent < 0; i++) { KTerm_Net_Process(term); usleep(1000); }
+    assert(rt.sent == 3 && rt.received == 3 && rt.lost == 0);
+    assert(rt.max_rtt_ms < 1000.0);
+
+    KTermNetSession* net = (KTermNetSession*)session->user_data;
+    KTerm_Net_FreeTraceroute(net->traceroute);
+    net->traceroute = NULL;
+    KTerm_Net_FreeResponseTime(net->response_time);
+    net->response_time = NULL;
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -103,6 +641,11 @@ int main() {
         {"test_pane_multiplexing", test_pane_multiplexing},
         {"test_message_routing", test_message_routing},
         {"test_vt_pipe_integration", test_vt_pipe_integration},
+        {"test_async_dns_resolver", test_async_dns_resolver},
+        {"test_windowed_port_scan", test_windowed_port_scan},
+        {"test_threaded_speedtest", test_threaded_speedtest},
+        {"test_http_probe_pool", test_http_probe_pool},
+        {"test_shared_icmp_engine", test_shared_icmp_engine},
     };
 
     int num_tests = sizeof(tests) / sizeof(tests[0]);
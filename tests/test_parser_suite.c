@@ -243,6 +243,81 @@ void test_phase4_protocol(KTerm* term, KTermSession* session) {
     // Phase 4 protocol handling is internal to K-Term
 }
 
+// ============================================================================
+// STREAMING STRING SEQUENCE TESTS
+// ============================================================================
+
+static void write_bytes(KTerm* term, KTermSession* session, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) KTerm_ProcessChar(term, session, (unsigned char)data[i]);
+}
+
+void test_streaming_string_sequences(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B<"); // Leave VT52 mode if an earlier test entered it
+
+    // Gateway PIPE: the payload is decoded as it arrives and never leaves the inline buffer
+    size_t raw_len = 6000;
+    unsigned char* raw = malloc(raw_len);
+    for (size_t i = 0; i < raw_len; i++) raw[i] = (unsigned char)('a' + i % 26);
+    size_t b64_len = 4 * ((raw_len + 2) / 3) + 1;
+    char* b64 = malloc(b64_len);
+    EncodeBase64(raw, raw_len, b64, b64_len);
+
+    KTerm_InputQueue_Clear(&session->input_queue);
+    write_sequence(term, "\x1BPGATE;KTERM;1;PIPE;VT;B64;");
+    assert(session->string_sink.write != NULL);
+    write_bytes(term, session, b64, strlen(b64));
+    assert(session->escape_buffer == session->escape_inline);
+    write_sequence(term, "\x1B\\");
+    assert(session->string_sink.write == NULL);
+    assert(session->parse_state == VT_PARSE_NORMAL);
+    assert(KTerm_InputQueue_Pending(&session->input_queue) == raw_len);
+    unsigned char* piped = malloc(raw_len);
+    assert(KTerm_InputQueue_Pop(&session->input_queue, piped, raw_len) == raw_len);
+    assert(memcmp(piped, raw, raw_len) == 0);
+    free(piped);
+    free(raw);
+    free(b64);
+
+    // HEX pairs split across writes
+    write_sequence(term, "\x1BPGATE;KTERM;2;PIPE;VT;HEX;48656");
+    write_sequence(term, "C6C6F\x1B\\");
+    char hello[8] = {0};
+    assert(KTerm_InputQueue_Pop(&session->input_queue, hello, sizeof(hello)) == 5);
+    assert(strcmp(hello, "Hello") == 0);
+
+    // OSC 52 up to KTERM_CLIPBOARD_LIMIT streams past the inline buffer; a longer write is dropped
+    size_t clip_len = KTERM_CLIPBOARD_LIMIT + 4096;
+    char* clip = malloc(clip_len + 1);
+    for (size_t i = 0; i < clip_len; i++) clip[i] = (char)('A' + i % 3);
+    b64_len = 4 * ((clip_len + 2) / 3) + 1;
+    b64 = malloc(b64_len);
+    EncodeBase64((const unsigned char*)clip, KTERM_CLIPBOARD_LIMIT, b64, b64_len);
+    write_sequence(term, "\x1B]52;c;");
+    write_bytes(term, session, b64, strlen(b64));
+    assert(session->escape_buffer == session->escape_inline);
+    write_sequence(term, "\x07");
+    assert(strlen(last_clipboard_text) == KTERM_CLIPBOARD_LIMIT);
+    assert(memcmp(last_clipboard_text, clip, KTERM_CLIPBOARD_LIMIT) == 0);
+
+    EncodeBase64((const unsigned char*)clip, clip_len, b64, b64_len);
+    write_sequence(term, "\x1B]52;c;");
+    write_bytes(term, session, b64, strlen(b64));
+    assert(session->string_sink.data == NULL);
+    write_sequence(term, "\x07");
+    assert(strlen(last_clipboard_text) == KTERM_CLIPBOARD_LIMIT);
+    free(clip);
+    free(b64);
+
+    // Strings without a streaming handler move to the arena and give it back after dispatch
+    write_sequence(term, "\x1B]2;");
+    for (int i = 0; i < 3 * KTERM_ESCAPE_INLINE_SIZE; i++) KTerm_ProcessChar(term, session, 'T');
+    assert(session->escape_buffer != session->escape_inline);
+    assert(session->escape_pos == 2 + 3 * KTERM_ESCAPE_INLINE_SIZE);
+    write_sequence(term, "\x1B\\");
+    assert(session->escape_buffer == session->escape_inline);
+    assert(session->title.window_title[0] == 'T');
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -403,6 +478,15 @@ int main() {
     results.total++;
     print_test_result("test_input_pipeline", results.passed == 15);
 
+    if (1) { reset_terminal(term);
+        test_streaming_string_sequences(term, session);
+        results.passed++;
+    } else {
+        results.failed++;
+    }
+    results.total++;
+    print_test_result("test_streaming_string_sequences", results.passed == 16);
+
     destroy_test_term(term);
 
     print_test_summary(results.total, results.passed, results.failed);
@@ -119,6 +119,399 @@ int test_serialize_null_checks(KTerm* term, KTermSession* session) {
     return passed;
 }
 
+int test_snapshot_full_state(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B[2J\x1B[H");
+    char line[64];
+    for (int i = 0; i < 60; i++) {
+        snprintf(line, sizeof(line), "\x1B[%dmline %d\x1B[0m\r\n", 31 + i % 7, i);
+        write_sequence(term, line);
+    }
+    write_sequence(term, "\x1B]2;snap title\x07");
+    write_sequence(term, "\x1B[3g\x1B[1;6H\x1BH");        // Only tab stop at column 5
+    write_sequence(term, "\x1B[3;20r\x1B[?7l\x1B(0");     // Margins, no autowrap, DEC graphics in G0
+    write_sequence(term, "\x1B[8;11H\x1B[1;4;38;2;10;20;30m");
+
+    void* buffer = NULL;
+    size_t len = 0;
+    if (!KTerm_SerializeSessionEx(term, session, &buffer, &len)) {
+        fprintf(stderr, "Snapshot failed\n");
+        return 0;
+    }
+    size_t raw = (size_t)(session->history_rows_populated + session->rows) * session->cols * sizeof(EnhancedTermChar);
+    if (len * 20 > raw) {
+        fprintf(stderr, "Snapshot too large: %zu bytes for %zu bytes of cells\n", len, raw);
+        KTerm_Free(buffer);
+        return 0;
+    }
+    int history = session->history_rows_populated;
+
+    write_sequence(term, "\x1B" "c"); // RIS
+    write_sequence(term, "\x1B]2;other\x07");
+    KTerm_FlushOps(term, session);
+
+    int passed = 1;
+    if (!KTerm_DeserializeSessionEx(term, session, buffer, len)) {
+        fprintf(stderr, "Restore failed\n");
+        KTerm_Free(buffer);
+        return 0;
+    }
+    KTerm_Free(buffer);
+
+    if (session->cursor.x != 10 || session->cursor.y != 7) { fprintf(stderr, "Cursor %d,%d\n", session->cursor.x, session->cursor.y); passed = 0; }
+    if (session->scroll_top != 2 || session->scroll_bottom != 19) { fprintf(stderr, "Margins %d-%d\n", session->scroll_top, session->scroll_bottom); passed = 0; }
+    if (session->dec_modes & KTERM_MODE_DECAWM) { fprintf(stderr, "DECAWM not restored\n"); passed = 0; }
+    if (session->charset.g0 != CHARSET_DEC_SPECIAL || session->charset.gl != &session->charset.g0) { fprintf(stderr, "Charset not restored\n"); passed = 0; }
+    if (!session->tab_stops.stops[5] || session->tab_stops.stops[8] || session->tab_stops.count != 1) { fprintf(stderr, "Tab stops not restored\n"); passed = 0; }
+    if (!(session->current_attributes & KTERM_ATTR_BOLD) || !(session->current_attributes & KTERM_ATTR_UNDERLINE)) { fprintf(stderr, "SGR attributes not restored\n"); passed = 0; }
+    if (session->current_fg.color_mode != 1 || session->current_fg.value.rgb.g != 20) { fprintf(stderr, "SGR color not restored\n"); passed = 0; }
+    if (strcmp(session->title.window_title, "snap title") != 0) { fprintf(stderr, "Title '%s'\n", session->title.window_title); passed = 0; }
+    if (session->history_rows_populated != history) { fprintf(stderr, "History %d vs %d\n", session->history_rows_populated, history); passed = 0; }
+
+    // "line 59" was the last line written, just above the cursor's final row
+    EnhancedTermChar* cell = GetActiveScreenCell(session, session->rows - 2, 5);
+    if (!cell || cell->ch != '5' || cell->fg_color.value.index != COLOR_BLUE) { fprintf(stderr, "Screen text not restored\n"); passed = 0; }
+    EnhancedTermChar* first = GetActiveScreenRow(session, session->rows - 2 - 59); // "line 0", now in scrollback
+    if (first[0].ch != 'l' || first[5].ch != '0' || first[0].fg_color.value.index != COLOR_RED) { fprintf(stderr, "Scrollback not restored\n"); passed = 0; }
+    return passed;
+}
+
+int test_snapshot_resize_restore(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B(B\x1B[r\x1B[2J\x1B[HTop left\x1B[5;1HRow five");
+    void* buffer = NULL;
+    size_t len = 0;
+    if (!KTerm_SerializeSessionEx(term, session, &buffer, &len)) return 0;
+
+    KTerm* other = create_test_term(100, 30);
+    if (!other) {
+        KTerm_Free(buffer);
+        return 0;
+    }
+    KTermSession* target = GET_SESSION(other);
+    int passed = KTerm_DeserializeSessionEx(other, target, buffer, len);
+    KTerm_Free(buffer);
+
+    if (passed && (target->cols != 100 || target->rows != 30)) {
+        fprintf(stderr, "Restored session is %dx%d, expected 100x30\n", target->cols, target->rows);
+        passed = 0;
+    }
+    if (passed && (GetActiveScreenCell(target, 0, 0)->ch != 'T' || GetActiveScreenCell(target, 4, 4)->ch != 'f' ||
+                   GetActiveScreenCell(target, 4, 7)->ch != 'e')) {
+        fprintf(stderr, "Content lost across resize\n");
+        passed = 0;
+    }
+    destroy_test_term(other);
+    return passed;
+}
+
+int test_snapshot_rejects_damage(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B[2J\x1B[HKeep me");
+    void* buffer = NULL;
+    size_t len = 0;
+    if (!KTerm_SerializeSessionEx(term, session, &buffer, &len)) return 0;
+    write_sequence(term, "\x1B[HSecond");
+    KTerm_FlushOps(term, session);
+
+    int passed = 1;
+    for (size_t cut = KTERM_SERIALIZE_MAGIC_LEN; cut < len; cut += 7) {
+        if (KTerm_DeserializeSessionEx(term, session, buffer, cut)) {
+            fprintf(stderr, "Truncated snapshot (%zu of %zu bytes) accepted\n", cut, len);
+            passed = 0;
+            break;
+        }
+    }
+    if (GetActiveScreenCell(session, 0, 0)->ch != 'S') {
+        fprintf(stderr, "Failed restore modified the session\n");
+        passed = 0;
+    }
+    if (!KTerm_DeserializeSession(session, buffer, len) || GetActiveScreenCell(session, 0, 0)->ch != 'K') passed = 0;
+    KTerm_Free(buffer);
+    return passed;
+}
+
+int test_snapshot_reads_v1(KTerm* term, KTermSession* session) {
+    (void)term;
+    size_t screen_size = (size_t)session->buffer_height * session->cols * sizeof(EnhancedTermChar);
+    size_t alt_size = (size_t)session->rows * session->cols * sizeof(EnhancedTermChar);
+    size_t len = sizeof(KTermSessionHeader) + screen_size + alt_size;
+    unsigned char* buffer = (unsigned char*)KTerm_Calloc(1, len);
+    if (!buffer) return 0;
+
+    KTermSessionHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KTERM_SERIALIZE_MAGIC_V1, KTERM_SERIALIZE_MAGIC_LEN);
+    header.cols = session->cols;
+    header.rows = session->rows;
+    header.buffer_height = session->buffer_height;
+    header.cursor_x = 3;
+    header.cursor_y = 1;
+    header.scroll_bottom = session->rows - 1;
+    memcpy(buffer, &header, sizeof(header));
+    EnhancedTermChar* cells = (EnhancedTermChar*)(buffer + sizeof(header));
+    cells[0].ch = 'V';
+
+    int passed = KTerm_DeserializeSession(session, buffer, len) &&
+                 session->cursor.x == 3 && session->cursor.y == 1 && GetScreenCell(session, 0, 0)->ch == 'V';
+    KTerm_Free(buffer);
+    return passed;
+}
+
+// Compares every populated row of both screens and the cursor
+static int mirror_matches(KTermSession* a, KTermSession* b, const char* step) {
+    if (a->cols != b->cols || a->rows != b->rows || a->cursor.x != b->cursor.x || a->cursor.y != b->cursor.y ||
+        a->dec_modes != b->dec_modes || a->history_rows_populated != b->history_rows_populated) {
+        fprintf(stderr, "%s: mirror state differs\n", step);
+        return 0;
+    }
+    for (int alt = 0; alt < 2; alt++) {
+        KTermSnapRing ra = KTerm_Snap_GetRing(a, alt != 0);
+        KTermSnapRing rb = KTerm_Snap_GetRing(b, alt != 0);
+        int first = alt ? 0 : -a->history_rows_populated;
+        for (int y = first; y < a->rows; y++) {
+            const EnhancedTermChar* ca = &ra.buf[(size_t)KTerm_Snap_RingIndex(&ra, y) * a->cols];
+            const EnhancedTermChar* cb = &rb.buf[(size_t)KTerm_Snap_RingIndex(&rb, y) * b->cols];
+            for (int x = 0; x < a->cols; x++) {
+                if (ca[x].ch != cb[x].ch || !KTerm_Snap_SameAttr(&ca[x], &cb[x])) {
+                    fprintf(stderr, "%s: %s row %d col %d differs ('%c' vs '%c')\n", step, alt ? "alt" : "main", y, x, (char)ca[x].ch, (char)cb[x].ch);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+static int checkpoint_to(KTerm* term, KTermSession* session, KTermCheckpoint* src, KTerm* mirror, KTermCheckpoint* dst, size_t* out_len) {
+    void* buffer = NULL;
+    size_t len = 0;
+    if (!KTerm_CheckpointSession(term, session, src, &buffer, &len)) return 0;
+    int ok = KTerm_ApplySessionCheckpoint(mirror, GET_SESSION(mirror), dst, buffer, len);
+    KTerm_Free(buffer);
+    if (out_len) *out_len = len;
+    return ok;
+}
+
+int test_checkpoint_mirror(KTerm* term, KTermSession* session) {
+    static const char* steps[] = {
+        "\x1B<\x1B(B\x1B[r\x1B[0m\x1B[2J\x1B[HFirst line\r\n\x1B[1;31mred\x1B[0m text",
+        "\x1B[5;10Hmiddle\x1B[3;1H\x1B[2K",
+        "\x1B[24;1H\r\nscroll 1\r\nscroll 2\r\nscroll 3",
+        "\x1B[2;20r\x1B[20;1H\r\nregion\x1B[r\x1B[8;1H\x1B[2L\x1B[10;5H\x1B[3P",
+        "\x1B[?1049h\x1B[2J\x1B[Halternate\x1B[12;1H\x1B[44mblue",
+        "\x1B[?1049l\x1B]0;mirrored\x07\x1B[20;1H\x1B[J",
+        "\x1B[3g\x1B[1;9H\x1BH\x1B[?7l\x1B[4h",
+    };
+    KTerm* mirror = create_test_term(40, 10);
+    if (!mirror) return 0;
+    KTermSession* target = GET_SESSION(mirror);
+    KTermCheckpoint src = {0}, dst = {0};
+
+    int passed = 1;
+    size_t len = 0;
+    write_sequence(term, "\x1B[2J\x1B[Hbase");
+    if (!checkpoint_to(term, session, &src, mirror, &dst, NULL) || !mirror_matches(session, target, "keyframe")) passed = 0;
+
+    char line[96];
+    for (int i = 0; passed && i < 40; i++) { // Scroll well past the screen between two checkpoints
+        snprintf(line, sizeof(line), "\r\nhistory %d", i);
+        write_sequence(term, line);
+    }
+    if (passed && (!checkpoint_to(term, session, &src, mirror, &dst, NULL) || !mirror_matches(session, target, "history"))) passed = 0;
+
+    for (size_t i = 0; passed && i < sizeof(steps) / sizeof(steps[0]); i++) {
+        write_sequence(term, steps[i]);
+        snprintf(line, sizeof(line), "step %zu", i);
+        if (!checkpoint_to(term, session, &src, mirror, &dst, NULL) || !mirror_matches(session, target, line)) passed = 0;
+    }
+    if (passed && strcmp(target->title.window_title, "mirrored") != 0) { fprintf(stderr, "Title not mirrored\n"); passed = 0; }
+    if (passed && (target->tab_stops.count != 1 || !target->tab_stops.stops[8])) { fprintf(stderr, "Tab stops not mirrored\n"); passed = 0; }
+
+    // On a full screen, a one-cell change costs a small fraction of a snapshot
+    for (int i = 0; passed && i < session->rows; i++) {
+        snprintf(line, sizeof(line), "\x1B[%d;1Hrow %d: the quick brown fox jumps over the lazy dog", i + 1, i);
+        write_sequence(term, line);
+    }
+    if (passed && !checkpoint_to(term, session, &src, mirror, &dst, NULL)) passed = 0;
+    write_sequence(term, "\x1B[1;1HX");
+    if (passed && (!checkpoint_to(term, session, &src, mirror, &dst, &len) || !mirror_matches(session, target, "small"))) passed = 0;
+    void* full = NULL;
+    size_t full_len = 0;
+    if (passed && KTerm_SerializeSessionEx(term, session, &full, &full_len)) {
+        if (len * 10 > full_len) { fprintf(stderr, "Delta of %zu bytes vs snapshot of %zu\n", len, full_len); passed = 0; }
+        KTerm_Free(full);
+    }
+
+    write_sequence(term, "\x1B[?7h\x1B[4l");
+    KTerm_FlushOps(term, session);
+    destroy_test_term(mirror);
+    return passed;
+}
+
+int test_checkpoint_chain(KTerm* term, KTermSession* session) {
+    KTerm* mirror = create_test_term(80, 24);
+    if (!mirror) return 0;
+    KTermSession* target = GET_SESSION(mirror);
+    KTermCheckpoint src = {0}, dst = {0};
+    int passed = checkpoint_to(term, session, &src, mirror, &dst, NULL);
+
+    void* first = NULL;
+    void* second = NULL;
+    size_t first_len = 0, second_len = 0;
+    write_sequence(term, "\x1B[HOne");
+    if (passed) passed = KTerm_CheckpointSession(term, session, &src, &first, &first_len);
+    write_sequence(term, "\x1B[HTwo");
+    if (passed) passed = KTerm_CheckpointSession(term, session, &src, &second, &second_len);
+
+    // Out of order, then damaged, then in order
+    if (passed && KTerm_ApplySessionCheckpoint(mirror, target, &dst, second, second_len)) { fprintf(stderr, "Skipped delta accepted\n"); passed = 0; }
+    for (size_t cut = KTERM_SERIALIZE_MAGIC_LEN; passed && cut < first_len; cut++) {
+        if (KTerm_ApplySessionCheckpoint(mirror, target, &dst, first, cut)) { fprintf(stderr, "Truncated delta accepted\n"); passed = 0; }
+    }
+    if (passed && GetActiveScreenCell(target, 0, 0)->ch == 'O') { fprintf(stderr, "Rejected delta modified the mirror\n"); passed = 0; }
+    if (passed && (!KTerm_ApplySessionCheckpoint(mirror, target, &dst, first, first_len) ||
+                   !KTerm_ApplySessionCheckpoint(mirror, target, &dst, second, second_len) ||
+                   !mirror_matches(session, target, "chain"))) passed = 0;
+    if (first) KTerm_Free(first);
+    if (second) KTerm_Free(second);
+
+    // A resize restarts the chain with a keyframe
+    KTerm_QueueResize(session, 60, 20, true);
+    write_sequence(term, "\x1B[HResized");
+    size_t len = 0;
+    if (passed && (!checkpoint_to(term, session, &src, mirror, &dst, &len) || src.sequence != 1 || target->cols != 60 ||
+                   !mirror_matches(session, target, "resize"))) passed = 0;
+    KTerm_QueueResize(session, 80, 24, true);
+    KTerm_FlushOps(term, session);
+    destroy_test_term(mirror);
+    return passed;
+}
+
+// DECLRMM reset takes the right margin from the terminal width, which a narrower session must still restore
+int test_snapshot_clamps_margins(KTerm* term, KTermSession* session) {
+    write_sequence(term, "\x1B<\x1B(B\x1B[r\x1B[0m\x1B[2J\x1B[H");
+    KTerm_QueueResize(session, 50, 20, true);
+    KTerm_FlushOps(term, session);
+    write_sequence(term, "\x1B[?69l\x1B[HNarrow");
+    KTerm_FlushOps(term, session);
+
+    void* buffer = NULL;
+    size_t len = 0;
+    int passed = KTerm_SerializeSession(session, &buffer, &len);
+    if (passed && !KTerm_DeserializeSession(session, buffer, len)) { fprintf(stderr, "Narrow session refused\n"); passed = 0; }
+    if (passed && (session->right_margin != 49 || GetActiveScreenCell(session, 0, 0)->ch != 'N')) {
+        fprintf(stderr, "Right margin %d not clamped\n", session->right_margin);
+        passed = 0;
+    }
+    if (buffer) KTerm_Free(buffer);
+
+    KTerm* mirror = create_test_term(80, 24);
+    if (!mirror) passed = 0;
+    KTermCheckpoint src = {0}, dst = {0};
+    if (passed) {
+        write_sequence(term, "\x1B[?69l");
+        KTerm_FlushOps(term, session);
+        if (!checkpoint_to(term, session, &src, mirror, &dst, NULL)) { fprintf(stderr, "Keyframe refused\n"); passed = 0; }
+        write_sequence(term, "\x1B[2;1HDelta");
+        if (passed && (!checkpoint_to(term, session, &src, mirror, &dst, NULL) || !mirror_matches(session, GET_SESSION(mirror), "narrow"))) {
+            fprintf(stderr, "Delta refused\n");
+            passed = 0;
+        }
+    }
+    if (mirror) destroy_test_term(mirror);
+    KTerm_QueueResize(session, 80, 24, true);
+    KTerm_FlushOps(term, session);
+    return passed;
+}
+
+int test_mapped_snapshot(KTerm* term, KTermSession* session) {
+    const char* path = "test_mapped_snapshot.ktm";
+    write_sequence(term, "\x1B<\x1B(B\x1B[r\x1B[0m\x1B[2J\x1B[H");
+    char line[64];
+    for (int i = 0; i < 60; i++) {
+        snprintf(line, sizeof(line), "\x1B[%dmmapped %d\r\n", 31 + i % 7, i);
+        write_sequence(term, line);
+    }
+    write_sequence(term, "\x1B[0m\x1B]0;mapped\x07\x1B[5;7H");
+    if (!KTerm_SaveSessionMapped(term, session, path)) { fprintf(stderr, "Save failed\n"); return 0; }
+
+    KTerm* restored = create_test_term(80, 24);
+    if (!restored) { remove(path); return 0; }
+    KTermSession* target = GET_SESSION(restored);
+    int passed = KTerm_MapSession(restored, target, path);
+    if (!passed) fprintf(stderr, "Map failed\n");
+    if (passed && (!target->grid_map || !mirror_matches(session, target, "mapped") ||
+                   strcmp(target->title.window_title, "mapped") != 0)) passed = 0;
+
+    // Writes land in private pages, never in the file
+    write_sequence(restored, "\x1B[HOverwritten\r\n\r\n");
+    KTerm_FlushOps(restored, target);
+    KTerm* again = create_test_term(80, 24);
+    if (passed && again) {
+        if (!KTerm_MapSession(again, GET_SESSION(again), path) || !mirror_matches(session, GET_SESSION(again), "remapped")) passed = 0;
+    }
+    if (again) destroy_test_term(again);
+
+    // A mismatched file is rejected without touching the session
+    FILE* f = fopen(path, "r+b");
+    if (f) { fputc('X', f); fclose(f); }
+    if (passed && KTerm_MapSession(restored, target, path)) { fprintf(stderr, "Damaged file mapped\n"); passed = 0; }
+    if (passed && GetActiveScreenCell(target, 0, 0)->ch != 'O') { fprintf(stderr, "Rejected map modified the session\n"); passed = 0; }
+
+    // Resizing copies the screen out; the mapping is released once its scrollback is rewrapped
+    KTerm_QueueResize(target, 100, 30, true);
+    KTerm_FlushOps(restored, target);
+    KTerm_ReflowHistory(target, MAX_SCROLLBACK_LINES);
+    if (passed && (target->grid_map || target->cols != 100)) { fprintf(stderr, "Mapping not released on resize\n"); passed = 0; }
+
+    destroy_test_term(restored);
+    remove(path);
+    return passed;
+}
+
+// Cells in a mapped file are trusted as is, so the renderer must keep palette lookups in range
+int test_mapped_bad_colors(KTerm* term, KTermSession* session) {
+    const char* path = "test_mapped_colors.ktm";
+    write_sequence(term, "\x1B[0m\x1B[2J\x1B[H\x1B[31;42mcolors");
+    if (!KTerm_SaveSessionMapped(term, session, path)) { fprintf(stderr, "Save failed\n"); return 0; }
+
+    FILE* f = fopen(path, "r+b");
+    if (!f) return 0;
+    KTermMappedHeader header;
+    int passed = fread(&header, sizeof(header), 1, f) == 1;
+    size_t cells = passed ? (size_t)(header.grid_len / sizeof(EnhancedTermChar)) : 0;
+    EnhancedTermChar* grid = (EnhancedTermChar*)malloc(cells * sizeof(EnhancedTermChar));
+    if (!grid) passed = 0;
+    if (passed) passed = fseek(f, (long)header.grid_offset, SEEK_SET) == 0 && fread(grid, sizeof(EnhancedTermChar), cells, f) == cells;
+    for (size_t i = 0; passed && i < cells; i++) {
+        grid[i].fg_color.color_mode = 0;
+        grid[i].fg_color.value.index = 0x7FFF0003;
+        grid[i].bg_color.color_mode = 0;
+        grid[i].bg_color.value.index = -200;
+        grid[i].ul_color.color_mode = 0;
+        grid[i].ul_color.value.index = 1 << 30;
+    }
+    if (passed) passed = fseek(f, (long)header.grid_offset, SEEK_SET) == 0 && fwrite(grid, sizeof(EnhancedTermChar), cells, f) == cells;
+    fclose(f);
+    free(grid);
+
+    KTerm* restored = create_test_term(80, 24);
+    if (passed && restored) {
+        KTermSession* target = GET_SESSION(restored);
+        passed = KTerm_MapSession(restored, target, path);
+        if (!passed) fprintf(stderr, "Map failed\n");
+        if (passed) {
+            for (int y = 0; y < target->rows; y++) target->row_dirty[y] = 1;
+            KTermRenderBuffer* rb = &restored->compositor.render_buffers[restored->compositor.rb_back];
+            KTermCompositor_Prepare(&restored->compositor, restored);
+            RGB_KTermColor c = restored->color_palette[3];
+            uint32_t want = (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | (255u << 24);
+            if (rb->cells[0].fg_color != want) { fprintf(stderr, "Bad index not folded into the palette\n"); passed = 0; }
+        }
+    }
+    if (restored) destroy_test_term(restored);
+    remove(path);
+    return passed;
+}
+
 int main() {
     TestResults results = {0};
     KTerm* term = create_test_term(80, 24);
@@ -132,6 +525,15 @@ int main() {
 
     run_test("Basic Serialization & Restore", test_basic_serialization, term, session, &results);
     run_test("Serialization Null Checks", test_serialize_null_checks, term, session, &results);
+    run_test("Snapshot Full State", test_snapshot_full_state, term, session, &results);
+    run_test("Snapshot Restore Into Other Size", test_snapshot_resize_restore, term, session, &results);
+    run_test("Snapshot Rejects Damage", test_snapshot_rejects_damage, term, session, &results);
+    run_test("Snapshot Reads Version 1", test_snapshot_reads_v1, term, session, &results);
+    run_test("Checkpoint Mirror", test_checkpoint_mirror, term, session, &results);
+    run_test("Checkpoint Chain Order", test_checkpoint_chain, term, session, &results);
+    run_test("Snapshot Clamps Narrow Margins", test_snapshot_clamps_margins, term, session, &results);
+    run_test("Mapped Snapshot", test_mapped_snapshot, term, session, &results);
+    run_test("Mapped Snapshot Bad Colors", test_mapped_bad_colors, term, session, &results);
 
     print_test_summary(results.total, results.passed, results.failed);
     destroy_test_term(term);
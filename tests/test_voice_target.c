@@ -16,7 +16,7 @@ int main() {
         fprintf(stderr, "Failed to create KTerm\n");
         return 1;
     }
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // 1. Test Normal Target Setting
     printf("Testing normal target setting...\n");
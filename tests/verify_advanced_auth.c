@@ -22,14 +22,17 @@ typedef struct KTermSession_T {
 } KTermSession;
 
 typedef struct KTerm_T {
-    KTermSession sessions[MAX_SESSIONS];
+    KTermSession* sessions[MAX_SESSIONS];
+    int session_capacity;
     void (*response_callback)(struct KTerm_T*, const char*, int);
     int width, height;
 } KTerm;
 
 void KTerm_WriteCharToSession(KTerm* term, int session_index, char c) {}
+size_t KTerm_WriteToSession(KTerm* term, int session_index, const void* data, size_t length) { (void)term; (void)session_index; (void)data; return length; }
 void KTerm_Resize(KTerm* term, int w, int h) { term->width = w; term->height = h; }
 void KTerm_WriteString(KTerm* term, const char* s) {}
+KTermSession* KTerm_AcquireSession(KTerm* term, int index) { return (index >= 0 && index < term->session_capacity) ? term->sessions[index] : NULL; }
 void KTerm_SetOutputSink(KTerm* term, void* sink, void* user_data) {}
 
 // Include pcap header
@@ -45,6 +48,7 @@ void pcap_close(pcap_t* p) {}
 int pcap_findalldevs(pcap_if_t** alldevs, char* errbuf) { *alldevs = NULL; return 0; }
 void pcap_freealldevs(pcap_if_t* alldevs) {}
 char* pcap_geterr(pcap_t* p) { return "Stub Error"; }
+int pcap_datalink(pcap_t* p) { (void)p; return DLT_EN10MB; }
 
 #include "../kt_net.h"
 
@@ -75,7 +79,10 @@ int main() {
         // Need to set up session context because ScanAuthFlows uses GetContext(session)
 
         KTerm term = {0};
-        KTermSession* session = &term.sessions[0];
+        KTermSession session0 = {0};
+        KTermSession* session = &session0;
+        term.sessions[0] = session;
+        term.session_capacity = 1;
 
         // Mock session user_data to point to a KTermNetSession containing our ctx
         KTermNetSession net = {0};
@@ -95,6 +102,7 @@ int main() {
         hdr.len = 80;
 
         // Construct TCP Packet on Non-Standard Port (2222)
+        pkt[12] = 0x08; // EtherType IPv4
         pkt[14] = 0x45; // v4
         pkt[23] = 6;    // TCP
 
@@ -10,10 +10,11 @@ typedef struct KTerm_T KTerm;
 typedef struct KTermSession_T KTermSession;
 
 struct KTermSession_T { void* user_data; int rows; int cols; };
-struct KTerm_T { KTermSession sessions[MAX_SESSIONS]; void (*response_callback)(KTerm* term, const char* data, int len); int width; int height; };
+struct KTerm_T { KTermSession* sessions[MAX_SESSIONS]; int session_capacity; void (*response_callback)(KTerm* term, const char* data, int len); int width; int height; };
 
 void KTerm_WriteCharToSession(KTerm* term, int session_idx, int c) { (void)term; (void)session_idx; (void)c; }
 void KTerm_WriteString(KTerm* term, const char* s) { (void)term; (void)s; }
+KTermSession* KTerm_AcquireSession(KTerm* term, int index) { return (index >= 0 && index < term->session_capacity) ? term->sessions[index] : NULL; }
 void KTerm_Resize(KTerm* term, int w, int h) { (void)term; (void)w; (void)h; }
 void KTerm_SetOutputSink(KTerm* term, void* sink, void* user) { (void)term; (void)sink; (void)user; }
 
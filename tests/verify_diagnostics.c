@@ -34,7 +34,7 @@ int main() {
 
     // Test 1: Connections Command (Enhanced)
     // Manually create a net context for session 0 to ensure we have something to list
-    KTerm_Net_Connect(term, &term->sessions[0], "127.0.0.1", 80, NULL, NULL);
+    KTerm_Net_Connect(term, term->sessions[0], "127.0.0.1", 80, NULL, NULL);
 
     printf("[1] Testing EXT;net;connections...\n");
     last_response[0] = '\0';
@@ -42,7 +42,7 @@ int main() {
     }
 
     KTerm_Net_Init(term);
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // Simulate Gateway Command
     // ID="TEST1", Command="EXT", Params="net;traceroute;host=8.8.8.8;maxhops=3;timeout=1000"
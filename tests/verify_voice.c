@@ -20,7 +20,7 @@ int main() {
         fprintf(stderr, "Failed to create KTerm\n");
         return 1;
     }
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // Initialize Network with Loopback Socket Pair
     int sv[2];
@@ -14,7 +14,7 @@ int main() {
     KTermConfig config = {0};
     KTerm* term = KTerm_Create(config);
     if (!term) return 1;
-    KTermSession* session = &term->sessions[0];
+    KTermSession* session = term->sessions[0];
 
     // 1. Enable Voice
     if (KTerm_Voice_Enable(session, true) != SITUATION_SUCCESS) {
@@ -85,29 +85,31 @@ int main() {
     printf("Testing VAD Logic...\n");
     KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
 
-    // Feed high energy
-    float loud_samples[256];
-    for(int i=0; i<256; i++) loud_samples[i] = 1.0f; // Max amplitude
+    // Feed a loud voiced tone (200 Hz square wave) for 300 ms; the analysis worker needs a
+    // few frames of speech before it opens
+    static float loud_samples[14400];
+    for(int i=0; i<14400; i++) loud_samples[i] = ((i / 120) % 2) ? 1.0f : -1.0f;
 
-    // Simulate Ring Buffer Fill (via callback)
-    if (mock_audio_cb) mock_audio_cb(mock_audio_user_data, loud_samples, 256);
-
-    // Process Capture
+    // Simulate Ring Buffer Fill (via callback), then give the worker time to analyse it
+    if (mock_audio_cb) mock_audio_cb(mock_audio_user_data, loud_samples, 14400);
     KTerm_Net_Process(term);
+    for (int i = 0; i < 200 && !atomic_load(&ctx->vad_active); i++) usleep(5000);
 
     // Check VAD State
-    printf("Energy: %f, Active: %d\n", ctx->energy_level, ctx->vad_active);
-    if (!ctx->vad_active || ctx->energy_level < 0.9f) {
+    printf("Energy: %f, Active: %d\n", ctx->energy_level, atomic_load(&ctx->vad_active));
+    if (!atomic_load(&ctx->vad_active) || ctx->energy_level < 0.9f) {
         fprintf(stderr, "VAD Activation Failed\n");
         return 1;
     }
 
-    // Feed Silence
-    if (mock_audio_cb) mock_audio_cb(mock_audio_user_data, silence, 256);
+    // Feed Silence: the VAD closes once its hangover (200 ms) has passed
+    static float quiet[19200];
+    if (mock_audio_cb) mock_audio_cb(mock_audio_user_data, quiet, 19200);
 
     KTerm_Net_Process(term);
-    printf("Energy: %f, Active: %d\n", ctx->energy_level, ctx->vad_active);
-    if (ctx->vad_active) {
+    for (int i = 0; i < 200 && atomic_load(&ctx->vad_active); i++) usleep(5000);
+    printf("Energy: %f, Active: %d\n", ctx->energy_level, atomic_load(&ctx->vad_active));
+    if (atomic_load(&ctx->vad_active)) {
         fprintf(stderr, "VAD Deactivation Failed\n");
         return 1;
     }
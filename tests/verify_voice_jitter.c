@@ -0,0 +1,186 @@
+#define KTERM_TESTING
+#define KTERM_IMPLEMENTATION
+#define KTERM_ENABLE_GATEWAY
+
+#include "kterm.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#define FRAME 256
+#define MAX_PACKETS 32
+
+static uint8_t packets[MAX_PACKETS][KTERM_VOICE_HEADER_SIZE + FRAME * sizeof(float)];
+static size_t packet_len[MAX_PACKETS];
+static int packet_count = 0;
+
+static void capture_send(void* user_data, const void* data, size_t len) {
+    (void)user_data;
+    if (packet_count >= MAX_PACKETS) return;
+    memcpy(packets[packet_count], data, len);
+    packet_len[packet_count++] = len;
+}
+
+static void deliver(KTermSession* session, int index) {
+    KTerm_Voice_ProcessPlayback(session, packets[index], packet_len[index]);
+}
+
+static void play(float* out, int samples) {
+    mock_playback_cb(mock_playback_user_data, out, samples);
+}
+
+int main() {
+    printf("Starting Voice Codec / Jitter Buffer Verification...\n");
+
+    KTermConfig config = {0};
+    KTerm* term = KTerm_Create(config);
+    if (!term) return 1;
+    KTermSession* session = term->sessions[0];
+
+    if (KTerm_Voice_Enable(session, true) != SITUATION_SUCCESS) {
+        fprintf(stderr, "Voice Enable Failed\n");
+        return 1;
+    }
+    KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
+
+    // 1. Codec selection
+    if (KTerm_Voice_SetCodec(session, "nonexistent") == SITUATION_SUCCESS) {
+        fprintf(stderr, "Unknown codec accepted\n");
+        return 1;
+    }
+    if (KTerm_Voice_SetCodec(session, "ADPCM") != SITUATION_SUCCESS) {
+        fprintf(stderr, "ADPCM codec not available\n");
+        return 1;
+    }
+
+    // 2. Capture a 440 Hz tone into ADPCM packets
+    printf("Testing ADPCM capture...\n");
+    static float tone[16 * FRAME];
+    for (int i = 0; i < 16 * FRAME; i++) tone[i] = 0.5f * sinf(2.0f * 3.14159265f * 440.0f * i / 48000.0f);
+    mock_audio_cb(mock_audio_user_data, tone, 16 * FRAME);
+    KTerm_Voice_ProcessCapture(term, session, capture_send, NULL);
+
+    if (packet_count != 16) {
+        fprintf(stderr, "Expected 16 packets, got %d\n", packet_count);
+        return 1;
+    }
+    for (int i = 0; i < packet_count; i++) {
+        if (packets[i][0] != KTERM_VOICE_FORMAT_ADPCM || packet_len[i] != KTERM_VOICE_HEADER_SIZE + 4 + FRAME / 2) {
+            fprintf(stderr, "Packet %d: format %d, %zu bytes\n", i, packets[i][0], packet_len[i]);
+            return 1;
+        }
+        uint16_t seq = (uint16_t)((packets[i][3] << 8) | packets[i][4]);
+        if (seq != (uint16_t)i) {
+            fprintf(stderr, "Packet %d has sequence %d\n", i, seq);
+            return 1;
+        }
+    }
+
+    // 3. Reordered delivery plays back in sequence order
+    printf("Testing reordering...\n");
+    deliver(session, 0);
+    deliver(session, 2);
+    deliver(session, 1);
+    deliver(session, 3);
+    if (ctx->sources[0].jitter.lost != 0 || ctx->sources[0].jitter.held != 0) {
+        fprintf(stderr, "Reordered packets lost=%u held=%d\n", ctx->sources[0].jitter.lost, ctx->sources[0].jitter.held);
+        return 1;
+    }
+
+    static float out[16 * FRAME];
+    play(out, 4 * FRAME);
+    double signal = 0.0, noise = 0.0;
+    for (int i = 0; i < 4 * FRAME; i++) {
+        signal += (double)tone[i] * tone[i];
+        noise += (double)(out[i] - tone[i]) * (out[i] - tone[i]);
+    }
+    double snr = 10.0 * log10(signal / (noise + 1e-12));
+    printf("ADPCM SNR: %.1f dB\n", snr);
+    if (snr < 20.0) {
+        fprintf(stderr, "ADPCM round trip too lossy\n");
+        return 1;
+    }
+
+    // 4. A gap is waited on while audio is queued and concealed once the ring runs dry
+    printf("Testing loss concealment...\n");
+    deliver(session, 4);
+    deliver(session, 6); // 5 is missing, packet 4 is still queued
+    if (ctx->sources[0].jitter.held != 1 || ctx->sources[0].jitter.lost != 0) {
+        fprintf(stderr, "Gap not held: held=%d lost=%u\n", ctx->sources[0].jitter.held, ctx->sources[0].jitter.lost);
+        return 1;
+    }
+    play(out, FRAME);
+    deliver(session, 7);
+    if (ctx->sources[0].jitter.lost != 1 || ctx->sources[0].jitter.held != 0) {
+        fprintf(stderr, "Gap not concealed: held=%d lost=%u\n", ctx->sources[0].jitter.held, ctx->sources[0].jitter.lost);
+        return 1;
+    }
+    play(out, 3 * FRAME);
+    // The concealed frame repeats packet 4, faded
+    float peak = 0.0f;
+    for (int i = 0; i < FRAME; i++) if (fabsf(out[i]) > peak) peak = fabsf(out[i]);
+    if (peak < 0.1f || peak > 0.55f) {
+        fprintf(stderr, "Concealment peak %f\n", peak);
+        return 1;
+    }
+    for (int i = 0; i < FRAME; i++) {
+        if (fabsf(out[FRAME + i] - tone[6 * FRAME + i]) > 0.05f) {
+            fprintf(stderr, "Packet 6 mismatch at %d\n", i);
+            return 1;
+        }
+    }
+
+    // 5. The late packet is discarded
+    deliver(session, 5);
+    if (ctx->sources[0].jitter.late != 1) {
+        fprintf(stderr, "Late packet not dropped\n");
+        return 1;
+    }
+
+    // 6. A ring filling faster than it drains loses samples instead of packets
+    printf("Testing drift correction...\n");
+    for (int i = 8; i < 16; i++) deliver(session, i);
+    if (ctx->sources[0].jitter.dropped_samples == 0 || ctx->sources[0].jitter.overruns != 0) {
+        fprintf(stderr, "Drift correction: dropped=%u overruns=%u\n", ctx->sources[0].jitter.dropped_samples, ctx->sources[0].jitter.overruns);
+        return 1;
+    }
+
+    // 7. Irregular arrival raises the playout delay
+    printf("Testing adaptive delay...\n");
+    play(out, 16 * FRAME);
+    uint64_t base = 0;
+    for (int i = 0; i < 8; i++) base = (base << 8) | packets[0][5 + i];
+    for (int i = 0; i < 16; i++) {
+        uint64_t ts = base - (uint64_t)((i % 2) ? 20000 : 0);
+        for (int b = 0; b < 8; b++) packets[i][5 + b] = (uint8_t)(ts >> (56 - 8 * b));
+        uint16_t seq = (uint16_t)(100 + i);
+        packets[i][3] = (uint8_t)(seq >> 8);
+        packets[i][4] = (uint8_t)(seq & 0xFF);
+    }
+    for (int i = 0; i < 16; i++) deliver(session, i);
+    printf("Jitter: %.0f us, target delay %d samples\n", ctx->sources[0].jitter.jitter_us, ctx->sources[0].jitter.target);
+    if (ctx->sources[0].jitter.target <= FRAME) {
+        fprintf(stderr, "Playout delay did not adapt\n");
+        return 1;
+    }
+
+    // 8. A talker that restarts its sequence is followed instead of dropped as late
+    printf("Testing sender restart...\n");
+    play(out, 16 * FRAME);
+    uint32_t late = ctx->sources[0].jitter.late;
+    for (int i = 0; i < 4; i++) {
+        packets[i][3] = 0;
+        packets[i][4] = (uint8_t)i;
+        deliver(session, i);
+    }
+    if (ctx->sources[0].jitter.late != late || ctx->sources[0].jitter.next_seq != 4) {
+        fprintf(stderr, "Restart not followed: late=%u next_seq=%u\n", ctx->sources[0].jitter.late, (unsigned)ctx->sources[0].jitter.next_seq);
+        return 1;
+    }
+
+    KTerm_Voice_Enable(session, false);
+    printf("Voice Codec / Jitter Buffer Verification Passed!\n");
+    KTerm_Destroy(term);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#define KTERM_TESTING
+#define KTERM_IMPLEMENTATION
+#define KTERM_ENABLE_GATEWAY
+
+#include "kterm.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define RATE 48000
+#define CHUNK 480 // 10 ms
+
+static KTerm* term;
+static KTermSession* session;
+static KTermVoiceContext* ctx;
+static bool vad_seen = false;
+static uint32_t noise_state = 12345;
+
+static float noise(void) {
+    noise_state = noise_state * 1664525u + 1013904223u;
+    return (float)(noise_state >> 8) / 8388608.0f - 1.0f;
+}
+
+// A voiced sound: 140 Hz harmonics under a formant that glides from f_start to f_end
+static void synth_word(float* out, int count, int rate, float f_start, float f_end, float gain) {
+    double phase = 0.0;
+    for (int i = 0; i < count; i++) {
+        float t = (float)i / count;
+        float formant = f_start + (f_end - f_start) * t;
+        float envelope = sinf(3.14159265f * t);
+        float s = 0.0f;
+        for (int k = 1; k * 140.0f < rate / 2 && k <= 40; k++) {
+            float f = k * 140.0f;
+            float d = (f - formant) / 400.0f;
+            s += (expf(-d * d) + 0.05f) * sinf((float)(phase * k));
+        }
+        phase += 2.0 * 3.14159265358979 * 140.0 / rate;
+        out[i] = gain * 0.15f * envelope * s;
+    }
+}
+
+static void write_wav(const char* path, const float* samples, int count, int rate, int channels, bool float32) {
+    FILE* f = fopen(path, "wb");
+    int bytes = float32 ? 4 : 2;
+    uint32_t data_size = (uint32_t)(count * channels * bytes);
+    uint32_t v;
+    uint16_t h;
+    fwrite("RIFF", 1, 4, f); v = 36 + data_size; fwrite(&v, 4, 1, f);
+    fwrite("WAVEfmt ", 1, 8, f); v = 16; fwrite(&v, 4, 1, f);
+    h = float32 ? 3 : 1; fwrite(&h, 2, 1, f);
+    h = (uint16_t)channels; fwrite(&h, 2, 1, f);
+    v = (uint32_t)rate; fwrite(&v, 4, 1, f);
+    v = (uint32_t)(rate * channels * bytes); fwrite(&v, 4, 1, f);
+    h = (uint16_t)(channels * bytes); fwrite(&h, 2, 1, f);
+    h = (uint16_t)(bytes * 8); fwrite(&h, 2, 1, f);
+    fwrite("data", 1, 4, f); fwrite(&data_size, 4, 1, f);
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < channels; c++) {
+            if (float32) {
+                fwrite(&samples[i], 4, 1, f);
+            } else {
+                int16_t s = (int16_t)(samples[i] * 32767.0f);
+                fwrite(&s, 2, 1, f);
+            }
+        }
+    }
+    fclose(f);
+}
+
+// Feeds audio in 10 ms chunks, letting the worker analyse each one before the next
+static void feed(const float* samples, int count) {
+    struct timespec nap = {0, 1000000};
+    for (int i = 0; i < count; i += CHUNK) {
+        int n = (count - i < CHUNK) ? count - i : CHUNK;
+        mock_audio_cb(mock_audio_user_data, (float*)samples + i, n);
+        KTerm_Voice_ProcessCapture(term, session, NULL, NULL);
+        for (int spin = 0; spin < 1000; spin++) {
+            if (atomic_load(&ctx->analysis->samples_processed) >= atomic_load(&ctx->analysis->head)) break;
+            nanosleep(&nap, NULL);
+        }
+        if (atomic_load(&ctx->vad_active)) vad_seen = true;
+    }
+    KTerm_Voice_ProcessCapture(term, session, NULL, NULL);
+}
+
+static void feed_noise(int count, float level) {
+    static float buf[RATE];
+    for (int i = 0; i < count; i++) buf[i] = level * noise();
+    feed(buf, count);
+}
+
+// Reads back what InjectCommand typed (letters arrive as key codes)
+static void read_keys(char* out, int size) {
+    KTermKeyEvent event;
+    int n = 0;
+    while (KTerm_GetKey(term, &event)) {
+        char c = event.sequence[0];
+        if (event.key_code >= KTERM_KEY_A && event.key_code <= KTERM_KEY_Z) c = (char)((event.shift ? 'A' : 'a') + (event.key_code - KTERM_KEY_A));
+        if (n < size - 1 && c) out[n++] = c;
+    }
+    out[n] = '\0';
+}
+
+int main() {
+    printf("Starting Voice Keyword Spotting Verification...\n");
+
+    KTermConfig config = {0};
+    term = KTerm_Create(config);
+    if (!term) return 1;
+    session = term->sessions[0];
+
+    if (KTerm_Voice_Enable(session, true) != SITUATION_SUCCESS) {
+        fprintf(stderr, "Voice Enable Failed\n");
+        return 1;
+    }
+    ctx = KTerm_Voice_GetContext(session);
+
+    // 1. Enroll two keywords from WAV files in different formats
+    printf("Testing enrollment...\n");
+    static float word[RATE];
+    synth_word(word, 8000, 16000, 500.0f, 2500.0f, 1.0f);
+    write_wav("verify_voice_kw_up.wav", word, 8000, 16000, 1, false);
+    synth_word(word, 24000, 48000, 2500.0f, 500.0f, 1.0f);
+    write_wav("verify_voice_kw_down.wav", word, 24000, 48000, 2, true);
+
+    if (KTerm_Voice_AddKeywordWav(session, "verify_voice_kw_up.wav", "ls") != SITUATION_SUCCESS ||
+        KTerm_Voice_AddKeywordWav(session, "verify_voice_kw_down.wav", "pwd") != SITUATION_SUCCESS) {
+        fprintf(stderr, "Keyword enrollment failed\n");
+        return 1;
+    }
+    if (KTerm_Voice_AddKeywordWav(session, "verify_voice_kw_missing.wav", "x") == SITUATION_SUCCESS) {
+        fprintf(stderr, "Missing WAV accepted\n");
+        return 1;
+    }
+    remove("verify_voice_kw_up.wav");
+    remove("verify_voice_kw_down.wav");
+
+    // 2. Background noise alone neither opens the VAD nor types anything
+    feed_noise(RATE, 0.002f);
+    char keys[64];
+    read_keys(keys, sizeof(keys));
+    if (vad_seen || keys[0]) {
+        fprintf(stderr, "Noise triggered: vad=%d keys='%s'\n", vad_seen, keys);
+        return 1;
+    }
+
+    // 3. Spoken keywords (quieter, over noise) run their commands
+    printf("Testing keyword detection...\n");
+    static float live[RATE];
+    const struct { float from, to; const char* expect; } words[] = {
+        { 500.0f, 2500.0f, "ls" },
+        { 2500.0f, 500.0f, "pwd" },
+    };
+    for (int w = 0; w < 2; w++) {
+        synth_word(live, RATE / 2, RATE, words[w].from, words[w].to, 0.7f);
+        for (int i = 0; i < RATE / 2; i++) live[i] += 0.002f * noise();
+        vad_seen = false;
+        feed(live, RATE / 2);
+        feed_noise(RATE / 2, 0.002f);
+        read_keys(keys, sizeof(keys));
+        printf("Word %d: vad=%d keys='%s'\n", w, vad_seen, keys);
+        if (!vad_seen || strcmp(keys, words[w].expect) != 0) {
+            fprintf(stderr, "Expected '%s', got '%s'\n", words[w].expect, keys);
+            return 1;
+        }
+    }
+
+    // 4. Speech that is not a keyword is ignored
+    synth_word(live, RATE / 2, RATE, 1200.0f, 1300.0f, 0.7f);
+    vad_seen = false;
+    feed(live, RATE / 2);
+    feed_noise(RATE / 2, 0.002f);
+    read_keys(keys, sizeof(keys));
+    if (!vad_seen || keys[0]) {
+        fprintf(stderr, "Non-keyword: vad=%d keys='%s'\n", vad_seen, keys);
+        return 1;
+    }
+
+    // 5. A loud white-noise burst is not speech
+    printf("Testing noise rejection...\n");
+    vad_seen = false;
+    feed_noise(RATE / 2, 0.3f);
+    feed_noise(RATE / 4, 0.002f);
+    read_keys(keys, sizeof(keys));
+    if (vad_seen || keys[0]) {
+        fprintf(stderr, "Noise burst: vad=%d keys='%s'\n", vad_seen, keys);
+        return 1;
+    }
+
+    // 6. The worker stays well inside its CPU budget
+    uint64_t busy = atomic_load(&ctx->analysis->busy_us);
+    uint64_t samples = atomic_load(&ctx->analysis->samples_processed);
+    double load = (double)busy / (samples * 1e6 / RATE);
+    printf("Analysis load: %.2f%% (%llu us for %llu samples)\n", load * 100.0, (unsigned long long)busy, (unsigned long long)samples);
+    if (load > 0.05 || atomic_load(&ctx->analysis->overruns) != 0) {
+        fprintf(stderr, "Analysis too slow\n");
+        return 1;
+    }
+
+    KTerm_Voice_ClearKeywords(session);
+    KTerm_Voice_Enable(session, false);
+    KTerm_Destroy(term);
+
+    // 7. Teardown frees the analysis state and releases the context slot
+    if (ctx->analysis || ctx->session) {
+        fprintf(stderr, "Voice context not released on destroy\n");
+        return 1;
+    }
+    printf("Voice Keyword Spotting Verification Passed!\n");
+    return 0;
+}
@@ -0,0 +1,236 @@
+#define KTERM_TESTING
+#define KTERM_IMPLEMENTATION
+#define KTERM_ENABLE_GATEWAY
+
+#include "kterm.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#define FRAME 256
+
+static KTermSession* session;
+static uint16_t next_seq[4][256];
+
+// Builds a raw PCM packet from one talker and delivers it as if it came from `origin`
+static void send_frame(uint32_t origin, uint8_t source, uint8_t rate, const float* samples, int count) {
+    uint8_t packet[KTERM_VOICE_HEADER_SIZE + KTERM_VOICE_MAX_FRAME * sizeof(float)] = {0};
+    uint16_t seq = next_seq[origin][source]++;
+    uint64_t ts = KTerm_Voice_GetMicroseconds();
+    packet[0] = KTERM_VOICE_FORMAT_PCM_F32;
+    packet[1] = 1;
+    packet[2] = rate;
+    packet[3] = (uint8_t)(seq >> 8);
+    packet[4] = (uint8_t)(seq & 0xFF);
+    for (int b = 0; b < 8; b++) packet[5 + b] = (uint8_t)(ts >> (56 - 8 * b));
+    packet[13] = source;
+    memcpy(packet + KTERM_VOICE_HEADER_SIZE, samples, count * sizeof(float));
+    KTerm_Voice_ProcessPlaybackFrom(session, origin, packet, KTERM_VOICE_HEADER_SIZE + count * sizeof(float));
+}
+
+static void send_constant(uint32_t origin, uint8_t source, float value) {
+    float frame[FRAME];
+    for (int i = 0; i < FRAME; i++) frame[i] = value;
+    send_frame(origin, source, KTERM_VOICE_RATE_48000, frame, FRAME);
+}
+
+static void play(float* out, int samples) {
+    mock_playback_cb(mock_playback_user_data, out, samples);
+}
+
+static atomic_bool audio_running;
+static atomic_int bad_samples;
+
+// Stands in for the audio device: every sample must be a sum of some of the talkers' levels
+static void* audio_thread(void* arg) {
+    (void)arg;
+    float out[128];
+    while (atomic_load(&audio_running)) {
+        play(out, 128);
+        for (int i = 0; i < 128; i++) {
+            int units = (int)lroundf(out[i] * 100.0f);
+            if (fabsf(out[i] * 100.0f - units) > 1e-3f || units < 0 || units > 15) atomic_fetch_add(&bad_samples, 1);
+        }
+    }
+    return NULL;
+}
+
+// Stub codec whose decoder state is the channel count it was created for. Each payload's first
+// byte is the channel count of its packet.
+static int layout_creates;
+static int layout_mismatches;
+
+static void* layout_create(int sample_rate, int channels, bool encoder) {
+    (void)sample_rate;
+    if (encoder) return NULL;
+    int* state = (int*)malloc(sizeof(int));
+    if (state) *state = channels;
+    layout_creates++;
+    return state;
+}
+
+static void layout_destroy(void* state, bool encoder) {
+    (void)encoder;
+    free(state);
+}
+
+static int layout_encode(void* state, const float* in, int samples, uint8_t* out, int capacity) {
+    (void)state; (void)in; (void)samples; (void)out; (void)capacity;
+    return -1;
+}
+
+static int layout_decode(void* state, const uint8_t* in, int len, float* out, int capacity) {
+    if (!state || len < 1) return -1;
+    int channels = *(int*)state;
+    if (channels != in[0]) layout_mismatches++;
+    int samples = 64 * channels;
+    if (samples > capacity) samples = capacity;
+    for (int i = 0; i < samples; i++) out[i] = 0.0f;
+    return samples;
+}
+
+int main() {
+    printf("Starting Voice Mixer Verification...\n");
+
+    KTermConfig config = {0};
+    KTerm* term = KTerm_Create(config);
+    if (!term) return 1;
+    session = term->sessions[0];
+
+    if (KTerm_Voice_Enable(session, true) != SITUATION_SUCCESS) {
+        fprintf(stderr, "Voice Enable Failed\n");
+        return 1;
+    }
+    KTermVoiceContext* ctx = KTerm_Voice_GetContext(session);
+    static float out[48000];
+
+    // 1. A 44.1 kHz talker is resampled to the 48 kHz output
+    printf("Testing resampling...\n");
+    float tone[441];
+    for (int p = 0; p < 20; p++) {
+        for (int i = 0; i < 441; i++) tone[i] = 0.3f * sinf(2.0f * 3.14159265f * 1000.0f * (p * 441 + i) / 44100.0f);
+        send_frame(0, 1, KTERM_VOICE_RATE_44100, tone, 441);
+    }
+    play(out, 9600);
+    int crossings = 0;
+    double energy = 0.0;
+    for (int i = 1000; i < 9000; i++) {
+        if ((out[i - 1] < 0.0f) != (out[i] < 0.0f)) crossings++;
+        energy += (double)out[i] * out[i];
+    }
+    double freq = crossings / 2.0 / (8000.0 / 48000.0);
+    double rms = sqrt(energy / 8000.0);
+    printf("Resampled tone: %.0f Hz, RMS %.3f\n", freq, rms);
+    if (fabs(freq - 1000.0) > 15.0 || fabs(rms - 0.3 / sqrt(2.0)) > 0.02) {
+        fprintf(stderr, "44.1 kHz stream not resampled\n");
+        return 1;
+    }
+
+    // 2. Talkers are mixed; the same source byte on another connection is another talker
+    printf("Testing mixing and gain...\n");
+    for (int p = 0; p < 4; p++) {
+        send_constant(0, 5, 0.10f);
+        send_constant(1, 5, 0.25f);
+    }
+    if (KTerm_Voice_GetSourceCount(session) != 3) {
+        fprintf(stderr, "Expected 3 sources, got %d\n", KTerm_Voice_GetSourceCount(session));
+        return 1;
+    }
+    play(out, FRAME);
+    if (fabsf(out[100] - 0.35f) > 1e-5f) {
+        fprintf(stderr, "Mix %f, expected 0.35\n", out[100]);
+        return 1;
+    }
+    if (KTerm_Voice_SetSourceGain(session, (1u << 8) | 5, 0.5f) != SITUATION_SUCCESS ||
+        KTerm_Voice_SetSourceGain(session, (2u << 8) | 5, 0.5f) == SITUATION_SUCCESS) {
+        fprintf(stderr, "Source gain lookup failed\n");
+        return 1;
+    }
+    play(out, FRAME);
+    if (fabsf(out[100] - 0.225f) > 1e-5f) {
+        fprintf(stderr, "Gain mix %f, expected 0.225\n", out[100]);
+        return 1;
+    }
+    // Non-finite gains are refused, huge ones are clamped
+    if (KTerm_Voice_SetSourceGain(session, (1u << 8) | 5, INFINITY) == SITUATION_SUCCESS ||
+        KTerm_Voice_SetMasterGain(session, NAN) == SITUATION_SUCCESS ||
+        KTerm_Voice_SetMasterGain(session, 1e30f) != SITUATION_SUCCESS ||
+        atomic_load(&ctx->master_gain) != KTERM_VOICE_MAX_GAIN) {
+        fprintf(stderr, "Gain validation failed\n");
+        return 1;
+    }
+    KTerm_Voice_SetMasterGain(session, 1.0f);
+    KTerm_Voice_SetSourceGain(session, (1u << 8) | 5, 1.0f);
+    play(out, 4 * FRAME); // Drain
+
+    // 3. The limiter keeps a loud mix from clipping
+    printf("Testing limiter...\n");
+    for (int p = 0; p < 4; p++) {
+        send_constant(0, 5, 0.8f);
+        send_constant(1, 5, 0.8f);
+    }
+    play(out, 4 * FRAME);
+    float peak = 0.0f;
+    for (int i = 0; i < 4 * FRAME; i++) if (fabsf(out[i]) > peak) peak = fabsf(out[i]);
+    printf("Limited peak: %f\n", peak);
+    if (peak > KTERM_VOICE_LIMIT_CEILING + 1e-5f || peak < 0.9f || atomic_load(&ctx->limited_frames) == 0) {
+        fprintf(stderr, "Limiter failed: peak %f\n", peak);
+        return 1;
+    }
+
+    // 4. A full room turns new talkers away
+    for (int s = 0; s < KTERM_VOICE_MAX_SOURCES + 2; s++) send_constant(2, (uint8_t)s, 0.0f);
+    if (KTerm_Voice_GetSourceCount(session) != KTERM_VOICE_MAX_SOURCES) {
+        fprintf(stderr, "Room size %d\n", KTerm_Voice_GetSourceCount(session));
+        return 1;
+    }
+    play(out, 8 * FRAME);
+    KTerm_Voice_Enable(session, false);
+    KTerm_Voice_Enable(session, true);
+
+    // 5. Packets arriving while the audio thread mixes never produce torn or foreign samples
+    printf("Testing concurrent mixing...\n");
+    atomic_store(&audio_running, true);
+    pthread_t audio;
+    pthread_create(&audio, NULL, audio_thread, NULL);
+    const float levels[4] = { 0.01f, 0.02f, 0.04f, 0.08f };
+    for (int p = 0; p < 2000; p++) {
+        send_constant(3, (uint8_t)(p % 4), levels[p % 4]);
+        if (p % 64 == 0) {
+            struct timespec nap = {0, 1000000};
+            nanosleep(&nap, NULL);
+        }
+    }
+    atomic_store(&audio_running, false);
+    pthread_join(audio, NULL);
+    if (atomic_load(&bad_samples) != 0) {
+        fprintf(stderr, "%d mixed samples were not sums of the talkers\n", atomic_load(&bad_samples));
+        return 1;
+    }
+
+    // 6. A talker that switches between mono and stereo gets a decoder for the new layout
+    printf("Testing decoder channel layout...\n");
+    static const KTermVoiceCodec layout_codec = { 0x7E, "layout", FRAME, layout_create, layout_destroy, layout_encode, layout_decode };
+    KTerm_Voice_RegisterCodec(&layout_codec);
+    const uint8_t layouts[4] = { 1, 2, 2, 1 };
+    for (int p = 0; p < 4; p++) {
+        uint8_t packet[KTERM_VOICE_HEADER_SIZE + 1] = {0};
+        packet[0] = 0x7E;
+        packet[1] = layouts[p];
+        packet[2] = KTERM_VOICE_RATE_48000;
+        packet[4] = (uint8_t)p;
+        packet[13] = 200;
+        packet[KTERM_VOICE_HEADER_SIZE] = layouts[p];
+        KTerm_Voice_ProcessPlaybackFrom(session, 3, packet, sizeof(packet));
+    }
+    if (layout_creates != 3 || layout_mismatches != 0) {
+        fprintf(stderr, "Decoder layout: %d creates, %d mismatches\n", layout_creates, layout_mismatches);
+        return 1;
+    }
+
+    KTerm_Voice_Enable(session, false);
+    printf("Voice Mixer Verification Passed!\n");
+    KTerm_Destroy(term);
+    return 0;
+}
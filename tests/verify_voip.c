@@ -31,22 +31,22 @@ int main() {
     // Initialize session 0
     KTerm_InitSession(term, 0);
     term->active_session = 0;
-    term->sessions[0].session_open = true;
+    term->sessions[0]->session_open = true;
 
     printf("\n--- Testing EXT;voip;register ---\n");
-    KTerm_GatewayProcess(term, &term->sessions[0], "KTERM", "1", "EXT", "voip;register;user=alice;pass=123;domain=example.com");
+    KTerm_GatewayProcess(term, term->sessions[0], "KTERM", "1", "EXT", "voip;register;user=alice;pass=123;domain=example.com");
     KTerm_Update(term); // Flush responses
 
     printf("\n--- Testing EXT;voip;dial ---\n");
-    KTerm_GatewayProcess(term, &term->sessions[0], "KTERM", "2", "EXT", "voip;dial;sip:bob@example.com");
+    KTerm_GatewayProcess(term, term->sessions[0], "KTERM", "2", "EXT", "voip;dial;sip:bob@example.com");
     KTerm_Update(term);
 
     printf("\n--- Testing EXT;voip;dtmf ---\n");
-    KTerm_GatewayProcess(term, &term->sessions[0], "KTERM", "3", "EXT", "voip;dtmf;5");
+    KTerm_GatewayProcess(term, term->sessions[0], "KTERM", "3", "EXT", "voip;dtmf;5");
     KTerm_Update(term);
 
     printf("\n--- Testing EXT;voip;hangup ---\n");
-    KTerm_GatewayProcess(term, &term->sessions[0], "KTERM", "4", "EXT", "voip;hangup");
+    KTerm_GatewayProcess(term, term->sessions[0], "KTERM", "4", "EXT", "voip;hangup");
     KTerm_Update(term);
 
     KTerm_Destroy(term);